@@ -412,6 +412,25 @@ default_list_elem_insert(ENGINE_HANDLE* handle, const void* cookie,
     return ret;
 }
 
+static ENGINE_ERROR_CODE
+default_list_elem_insert_bulk(ENGINE_HANDLE* handle, const void* cookie,
+                              const void* key, const int nkey,
+                              int index, eitem **eitem_array,
+                              const uint32_t eitem_count,
+                              item_attr *attrp, bool *created,
+                              uint32_t *ins_count, uint16_t vbucket)
+{
+    struct default_engine* engine = get_handle(handle);
+    ENGINE_ERROR_CODE ret;
+    VBUCKET_GUARD(engine, vbucket);
+
+    ACTION_BEFORE_WRITE(cookie, key, nkey);
+    ret = list_elem_insert_bulk(engine, key, nkey, index, (list_elem_item **)eitem_array,
+                                eitem_count, attrp, created, ins_count, cookie);
+    ACTION_AFTER_WRITE(cookie, ret);
+    return ret;
+}
+
 static ENGINE_ERROR_CODE
 default_list_elem_delete(ENGINE_HANDLE* handle, const void* cookie,
                          const void* key, const int nkey,
@@ -513,6 +532,24 @@ default_set_elem_insert(ENGINE_HANDLE* handle, const void* cookie,
     return ret;
 }
 
+static ENGINE_ERROR_CODE
+default_set_elem_insert_bulk(ENGINE_HANDLE* handle, const void* cookie,
+                             const void* key, const int nkey,
+                             eitem **eitem_array, const uint32_t eitem_count,
+                             item_attr *attrp, bool *created,
+                             uint32_t *ins_count, uint16_t vbucket)
+{
+    struct default_engine *engine = get_handle(handle);
+    ENGINE_ERROR_CODE ret;
+    VBUCKET_GUARD(engine, vbucket);
+
+    ACTION_BEFORE_WRITE(cookie, key, nkey);
+    ret = set_elem_insert_bulk(engine, key, nkey, (set_elem_item**)eitem_array,
+                               eitem_count, attrp, created, ins_count, cookie);
+    ACTION_AFTER_WRITE(cookie, ret);
+    return ret;
+}
+
 static ENGINE_ERROR_CODE
 default_set_elem_delete(ENGINE_HANDLE* handle, const void* cookie,
                         const void* key, const int nkey,
@@ -548,7 +585,7 @@ default_set_elem_exist(ENGINE_HANDLE* handle, const void* cookie,
 static ENGINE_ERROR_CODE
 default_set_elem_get(ENGINE_HANDLE* handle, const void* cookie,
                      const void* key, const int nkey, const uint32_t count,
-                     const bool delete, const bool drop_if_empty,
+                     const bool delete, const bool drop_if_empty, const bool random,
                      eitem** eitem, uint32_t* eitem_count,
                      uint32_t* flags, bool* dropped, uint16_t vbucket)
 {
@@ -557,12 +594,48 @@ default_set_elem_get(ENGINE_HANDLE* handle, const void* cookie,
     VBUCKET_GUARD(engine, vbucket);
 
     if (delete) ACTION_BEFORE_WRITE(cookie, key, nkey);
-    ret = set_elem_get(engine, key, nkey, count, delete, drop_if_empty,
+    ret = set_elem_get(engine, key, nkey, count, delete, drop_if_empty, random,
                        (set_elem_item**)eitem, eitem_count, flags, dropped);
     if (delete) ACTION_AFTER_WRITE(cookie, ret);
     return ret;
 }
 
+static ENGINE_ERROR_CODE
+default_set_elem_scan(ENGINE_HANDLE* handle, const void* cookie,
+                      const void* key, const int nkey,
+                      const uint32_t cursor, const uint32_t count,
+                      eitem** eitem, uint32_t* eitem_count,
+                      uint32_t* next_cursor, uint32_t* flags, uint16_t vbucket)
+{
+    struct default_engine *engine = get_handle(handle);
+    ENGINE_ERROR_CODE ret;
+    VBUCKET_GUARD(engine, vbucket);
+
+    ret = set_elem_scan(engine, key, nkey, cursor, count,
+                        (set_elem_item**)eitem, eitem_count, next_cursor, flags);
+    return ret;
+}
+
+static ENGINE_ERROR_CODE
+default_set_elem_get_chunk(ENGINE_HANDLE* handle, const void* cookie,
+                           const void* key, const int nkey,
+                           item** item, uint32_t* cursor, const uint32_t count,
+                           const bool delete, const bool drop_if_empty, const bool random,
+                           eitem** eitem, uint32_t* eitem_count,
+                           uint32_t* flags, bool* dropped, uint16_t vbucket)
+{
+    struct default_engine *engine = get_handle(handle);
+    ENGINE_ERROR_CODE ret;
+    VBUCKET_GUARD(engine, vbucket);
+
+    if (delete) ACTION_BEFORE_WRITE(cookie, key, nkey);
+    ret = set_elem_get_chunk(engine, key, nkey, (hash_item**)item, cursor, count,
+                             delete, drop_if_empty, random,
+                             (set_elem_item**)eitem, eitem_count, flags, dropped);
+    if (delete) ACTION_AFTER_WRITE(cookie, ret);
+    return ret;
+}
+
 
 /*
  * Map Collection API
@@ -640,6 +713,24 @@ default_map_elem_update(ENGINE_HANDLE* handle, const void* cookie,
     return ret;
 }
 
+static ENGINE_ERROR_CODE
+default_map_elem_arithmetic(ENGINE_HANDLE* handle, const void* cookie,
+                            const void* key, const int nkey, const field_t *field,
+                            const bool increment, const bool create,
+                            const uint64_t delta, const uint64_t initial,
+                            uint64_t *result, uint16_t vbucket)
+{
+    struct default_engine *engine = get_handle(handle);
+    ENGINE_ERROR_CODE ret;
+    VBUCKET_GUARD(engine, vbucket);
+
+    ACTION_BEFORE_WRITE(cookie, key, nkey);
+    ret = map_elem_arithmetic(engine, key, nkey, field, increment, create,
+                              delta, initial, result, cookie);
+    ACTION_AFTER_WRITE(cookie, ret);
+    return ret;
+}
+
 static ENGINE_ERROR_CODE
 default_map_elem_delete(ENGINE_HANDLE* handle, const void* cookie,
                         const void* key, const int nkey, const int numfields,
@@ -674,6 +765,22 @@ default_map_elem_get(ENGINE_HANDLE* handle, const void* cookie,
     return ret;
 }
 
+static ENGINE_ERROR_CODE
+default_map_elem_scan(ENGINE_HANDLE* handle, const void* cookie,
+                      const void* key, const int nkey,
+                      const uint32_t cursor, const uint32_t count,
+                      eitem** eitem, uint32_t* eitem_count,
+                      uint32_t* next_cursor, uint32_t* flags, uint16_t vbucket)
+{
+    struct default_engine *engine = get_handle(handle);
+    ENGINE_ERROR_CODE ret;
+    VBUCKET_GUARD(engine, vbucket);
+
+    ret = map_elem_scan(engine, key, nkey, cursor, count,
+                        (map_elem_item**)eitem, eitem_count, next_cursor, flags);
+    return ret;
+}
+
 /*
  * B+Tree Collection API
  */
@@ -755,6 +862,24 @@ default_btree_elem_insert(ENGINE_HANDLE* handle, const void* cookie,
     return ret;
 }
 
+static ENGINE_ERROR_CODE
+default_btree_elem_insert_bulk(ENGINE_HANDLE* handle, const void* cookie,
+                               const void* key, const int nkey,
+                               eitem **eitem_array, const uint32_t eitem_count,
+                               item_attr *attrp, bool *created,
+                               uint32_t *ins_count, uint16_t vbucket)
+{
+    struct default_engine* engine = get_handle(handle);
+    ENGINE_ERROR_CODE ret;
+    VBUCKET_GUARD(engine, vbucket);
+
+    ACTION_BEFORE_WRITE(cookie, key, nkey);
+    ret = btree_elem_insert_bulk(engine, key, nkey, (btree_elem_item **)eitem_array,
+                                 eitem_count, attrp, created, ins_count, cookie);
+    ACTION_AFTER_WRITE(cookie, ret);
+    return ret;
+}
+
 static ENGINE_ERROR_CODE
 default_btree_elem_update(ENGINE_HANDLE* handle, const void* cookie,
                           const void* key, const int nkey,
@@ -902,6 +1027,21 @@ default_btree_elem_get_by_posi(ENGINE_HANDLE* handle, const void* cookie,
     return ret;
 }
 
+static ENGINE_ERROR_CODE
+default_btree_elem_aggregate(ENGINE_HANDLE* handle, const void* cookie,
+                             const void* key, const int nkey,
+                             const bkey_range *bkrange, const eflag_filter *efilter,
+                             const bop_aggr_spec *spec, bop_aggr_result *result,
+                             uint16_t vbucket)
+{
+    struct default_engine *engine = get_handle(handle);
+    ENGINE_ERROR_CODE ret;
+    VBUCKET_GUARD(engine, vbucket);
+
+    ret = btree_elem_aggregate(engine, key, nkey, bkrange, efilter, spec, result);
+    return ret;
+}
+
 #ifdef SUPPORT_BOP_SMGET
 #ifdef JHPARK_OLD_SMGET_INTERFACE
 /* smget old interface */
@@ -1064,6 +1204,9 @@ default_get_stats(ENGINE_HANDLE* handle, const void* cookie,
     else if (strncmp(stat_key, "scrub", 5) == 0) {
         item_stats_scrub(engine, add_stat, cookie);
     }
+    else if (strncmp(stat_key, "coll_del", 8) == 0) {
+        item_stats_coll_del(engine, add_stat, cookie);
+    }
     else if (strncmp(stat_key, "dump", 4) == 0) {
         item_stats_dump(engine, add_stat, cookie);
     }
@@ -1508,6 +1651,7 @@ create_instance(uint64_t interface, GET_SERVER_API get_server_api,
          .list_elem_alloc   = default_list_elem_alloc,
          .list_elem_release = default_list_elem_release,
          .list_elem_insert  = default_list_elem_insert,
+         .list_elem_insert_bulk = default_list_elem_insert_bulk,
          .list_elem_delete  = default_list_elem_delete,
          .list_elem_get     = default_list_elem_get,
          /* SET Colleciton API */
@@ -1515,22 +1659,28 @@ create_instance(uint64_t interface, GET_SERVER_API get_server_api,
          .set_elem_alloc    = default_set_elem_alloc,
          .set_elem_release  = default_set_elem_release,
          .set_elem_insert   = default_set_elem_insert,
+         .set_elem_insert_bulk = default_set_elem_insert_bulk,
          .set_elem_delete   = default_set_elem_delete,
          .set_elem_exist    = default_set_elem_exist,
          .set_elem_get      = default_set_elem_get,
+         .set_elem_scan     = default_set_elem_scan,
+         .set_elem_get_chunk = default_set_elem_get_chunk,
          /* MAP Collection API */
          .map_struct_create = default_map_struct_create,
          .map_elem_alloc    = default_map_elem_alloc,
          .map_elem_release  = default_map_elem_release,
          .map_elem_insert   = default_map_elem_insert,
          .map_elem_update   = default_map_elem_update,
+         .map_elem_arithmetic = default_map_elem_arithmetic,
          .map_elem_delete   = default_map_elem_delete,
          .map_elem_get      = default_map_elem_get,
+         .map_elem_scan     = default_map_elem_scan,
          /* B+Tree Collection API */
          .btree_struct_create = default_btree_struct_create,
          .btree_elem_alloc   = default_btree_elem_alloc,
          .btree_elem_release = default_btree_elem_release,
          .btree_elem_insert  = default_btree_elem_insert,
+         .btree_elem_insert_bulk = default_btree_elem_insert_bulk,
          .btree_elem_update  = default_btree_elem_update,
          .btree_elem_delete  = default_btree_elem_delete,
          .btree_elem_arithmetic  = default_btree_elem_arithmetic,
@@ -1539,6 +1689,7 @@ create_instance(uint64_t interface, GET_SERVER_API get_server_api,
          .btree_posi_find    = default_btree_posi_find,
          .btree_posi_find_with_get = default_btree_posi_find_with_get,
          .btree_elem_get_by_posi = default_btree_elem_get_by_posi,
+         .btree_elem_aggregate = default_btree_elem_aggregate,
 #ifdef SUPPORT_BOP_SMGET
 #ifdef JHPARK_OLD_SMGET_INTERFACE
          .btree_elem_smget_old = default_btree_elem_smget_old,
@@ -26,6 +26,9 @@
 #include <assert.h>
 #include <inttypes.h>
 #include <sys/time.h> /* gettimeofday() */
+#ifdef __SSE2__
+#include <emmintrin.h> /* eflag filter IN-list */
+#endif
 
 #include "default_engine.h"
 
@@ -53,7 +56,12 @@ static void item_link_q(struct default_engine *engine, hash_item *it);
 static void item_unlink_q(struct default_engine *engine, hash_item *it);
 static ENGINE_ERROR_CODE do_item_link(struct default_engine *engine, hash_item *it);
 static void do_item_unlink(struct default_engine *engine, hash_item *it, enum item_unlink_cause cause);
+static hash_item *do_item_find(struct default_engine *engine,
+                               const char *key, const size_t nkey, bool do_update);
 static void do_coll_all_elem_delete(struct default_engine *engine, hash_item *it);
+static void do_btree_eindex_free(struct default_engine *engine, btree_meta_info *info);
+static uint32_t do_btree_range_count(btree_meta_info *info,
+                                     const int bkrtype, const bkey_range *bkrange);
 static uint32_t do_map_elem_delete(struct default_engine *engine, map_meta_info *info,
                                    const uint32_t count, enum elem_delete_cause cause);
 
@@ -101,10 +109,23 @@ extern int genhash_string_hash(const void* p, size_t nkey);
 #define BTREE_UINT64_MIN_BKEY 0
 #define BTREE_UINT64_MAX_BKEY (uint64_t)((int64_t)-1) /* need check */
 
-/* btree element item or btree node item */
-#define BTREE_GET_ELEM_ITEM(node, indx) ((btree_elem_item *)((node)->item[indx]))
+/* btree element item or btree node item.
+ * The element item of a packed slot is decoded into the given buffer.
+ */
+#define BTREE_GET_ELEM_ITEM(node, indx, buf) do_btree_leaf_elem((node), (indx), (buf))
 #define BTREE_GET_NODE_ITEM(node, indx) ((btree_indx_node *)((node)->item[indx]))
 
+/* packed element: a small element kept in its item slot of the leaf node */
+#define BTREE_PACKED_VALUE_MAX 7 /* the max value length except "\r\n" */
+#define BTREE_SLOT_IS_PACKED(slot) ((((uintptr_t)(slot)) & 1) != 0)
+#define BTREE_ELEM_IS_DECODED(elem) ((elem)->slabs_clsid == 0)
+
+/* the buffer of a decoded packed element: header, uint64 bkey and value */
+typedef union {
+    btree_elem_item elem;
+    uint64_t        space[4];
+} btree_elem_buf;
+
 /* get bkey real size */
 #define BTREE_REAL_NBKEY(nbkey) ((nbkey)==0 ? sizeof(uint64_t) : (nbkey))
 
@@ -165,6 +186,9 @@ static char    forced_action_prefix[256];
 static int32_t forced_action_pfxlen = 0;
 static uint8_t forced_btree_ovflact = 0;
 
+/* random state for collection element sampling (protected by cache_lock) */
+static uint64_t coll_rand_state = 0;
+
 /* collection delete queue */
 static item_queue      coll_del_queue;
 static pthread_mutex_t coll_del_lock;
@@ -172,6 +196,54 @@ static pthread_cond_t  coll_del_cond;
 static bool            coll_del_sleep;
 static pthread_t       coll_del_tid; /* thread id */
 
+/* collections being deleted: the collection delete thread deletes
+ * a batch of elements of each collection in turn with cache_lock held.
+ * So, a huge collection doesn't hold back the other collections,
+ * and cache_lock is held only for a batch at a time.
+ * The slots are protected by cache_lock.
+ */
+#define COLL_DEL_SLOT_COUNT    8   /* the collections deleted in turn */
+#define COLL_DEL_BATCH_COUNT   30  /* the batch of list, set and map */
+#define BTREE_DEL_BATCH_COUNT  100 /* the batch of b+tree */
+
+typedef struct _coll_del_slot {
+    hash_item *it;       /* the collection being deleted */
+    uint32_t   deleted;  /* the deleted element count */
+#ifdef BTREE_DELETE_NO_MERGE
+    btree_elem_posi path[BTREE_MAX_DEPTH];
+#else
+    bkey_range bkrange;
+#endif
+} coll_del_slot;
+
+static coll_del_slot   coll_del_slots[COLL_DEL_SLOT_COUNT];
+static int             coll_del_nslots = 0; /* the number of collections being deleted */
+static uint32_t        coll_del_ntrims = 0; /* the number of queued b+tree trim works */
+static uint64_t        coll_del_colls = 0;  /* the number of deleted collections */
+static uint64_t        coll_del_elems = 0;  /* the number of deleted elements */
+static uint64_t        coll_del_space = 0;  /* the reclaimed space in bytes */
+
+/* the space freed by the delete thread while it holds cache_lock */
+static bool            coll_del_measure = false;
+static uint64_t        coll_del_freed = 0;
+
+/* b+tree trim work: the nodes cut off from a b+tree by a large trim.
+ * The works are queued with coll_del_lock and done by the collection delete thread.
+ */
+typedef struct _btree_trim_work {
+    struct _btree_trim_work *next;
+    hash_item       *it; /* the b+tree item referenced until the work is done */
+    btree_indx_node *head[BTREE_MAX_DEPTH]; /* the cut node chain of each depth */
+} btree_trim_work;
+
+static btree_trim_work *btree_trim_head = NULL;
+static btree_trim_work *btree_trim_tail = NULL;
+
+/* The trim of more elements than this is done by cutting the nodes off,
+ * and the cut nodes are freed by the collection delete thread.
+ */
+#define BTREE_BULK_TRIM_THRESHOLD 100
+
 static EXTENSION_LOGGER_DESCRIPTOR *logger;
 
 /* map element previous info internally used */
@@ -328,6 +400,40 @@ static hash_item *pop_coll_del_queue(void)
     return it;
 }
 
+static void push_btree_trim_queue(btree_trim_work *work)
+{
+    work->next = NULL;
+    pthread_mutex_lock(&coll_del_lock);
+    if (btree_trim_tail == NULL) {
+        btree_trim_head = work;
+    } else {
+        btree_trim_tail->next = work;
+    }
+    btree_trim_tail = work;
+    coll_del_ntrims++;
+    if (coll_del_sleep == true) {
+        /* wake up collection delete thead */
+        pthread_cond_signal(&coll_del_cond);
+    }
+    pthread_mutex_unlock(&coll_del_lock);
+}
+
+static btree_trim_work *pop_btree_trim_queue(void)
+{
+    btree_trim_work *work = NULL;
+    pthread_mutex_lock(&coll_del_lock);
+    if (btree_trim_head != NULL) {
+        work = btree_trim_head;
+        btree_trim_head = work->next;
+        if (btree_trim_head == NULL) {
+            btree_trim_tail = NULL;
+        }
+        coll_del_ntrims--;
+    }
+    pthread_mutex_unlock(&coll_del_lock);
+    return work;
+}
+
 static bool do_item_isvalid(struct default_engine *engine, hash_item *it, rel_time_t current_time)
 {
     /* check if it's expired */
@@ -746,6 +852,13 @@ static void do_item_free(struct default_engine *engine, hash_item *it)
             push_coll_del_queue(it);
             return;
         }
+        if (IS_BTREE_ITEM(it) && ((btree_meta_info *)info)->eindex != NULL) {
+            do_btree_eindex_free(engine, (btree_meta_info *)info);
+        }
+    }
+
+    if (coll_del_measure) {
+        coll_del_freed += slabs_space_size(engine, ntotal);
     }
 
     /* so slab size changer can tell later if item is already free or not */
@@ -1009,6 +1122,23 @@ static void do_item_replace(struct default_engine *engine,
     (void)do_item_link(engine, new_it);
 }
 
+/*
+ * Links the collection item created on a missing key. The lease placeholder
+ * of the key, which is missing to the others, is replaced by the item.
+ */
+static ENGINE_ERROR_CODE do_coll_item_link(struct default_engine *engine, hash_item *it)
+{
+    hash_item *old_it = do_item_find(engine, item_get_key(it), it->nkey, DONT_UPDATE);
+
+    if (old_it != NULL) {
+        assert(IS_LEASE_ITEM(old_it));
+        do_item_replace(engine, old_it, it);
+        do_item_release(engine, old_it);
+        return ENGINE_SUCCESS;
+    }
+    return do_item_link(engine, it);
+}
+
 /*@null@*/
 static char *do_item_cachedump(struct default_engine *engine, const unsigned int slabs_clsid,
                                const unsigned int limit, const bool forward, const bool sticky,
@@ -1152,8 +1282,8 @@ static void do_item_stats_sizes(struct default_engine *engine, ADD_STAT add_stat
 }
 
 /** wrapper around assoc_find which does the lazy expiration logic */
-static hash_item *do_item_get(struct default_engine *engine,
-                              const char *key, const size_t nkey, bool do_update)
+static hash_item *do_item_find(struct default_engine *engine,
+                               const char *key, const size_t nkey, bool do_update)
 {
     rel_time_t current_time = engine->server.core->get_current_time();
     const char *hkey = (nkey > MAX_HKEY_LEN) ? key+(nkey-MAX_HKEY_LEN) : key;
@@ -1185,6 +1315,22 @@ static hash_item *do_item_get(struct default_engine *engine,
     return it;
 }
 
+/*
+ * Returns the item found, which is not a lease placeholder.
+ * The lease placeholder is missing to the others than the store and delete.
+ */
+static hash_item *do_item_get(struct default_engine *engine,
+                              const char *key, const size_t nkey, bool do_update)
+{
+    hash_item *it = do_item_find(engine, key, nkey, do_update);
+
+    if (it != NULL && IS_LEASE_ITEM(it)) {
+        do_item_release(engine, it);
+        it = NULL;
+    }
+    return it;
+}
+
 /*
  * Stores an item in the cache according to the semantics of one of the set
  * commands. In threaded mode, this is protected by the cache lock.
@@ -1195,13 +1341,38 @@ static ENGINE_ERROR_CODE do_store_item(struct default_engine *engine, hash_item
                                        ENGINE_STORE_OPERATION operation, const void *cookie)
 {
     const char *key = item_get_key(it);
-    hash_item *old_it = do_item_get(engine, key, it->nkey, DONT_UPDATE);
+    hash_item *old_it = do_item_find(engine, key, it->nkey, DONT_UPDATE);
     ENGINE_ERROR_CODE stored = ENGINE_NOT_STORED;
     if (old_it != NULL && IS_COLL_ITEM(old_it)) {
         do_item_release(engine, old_it);
         return ENGINE_EBADTYPE;
     }
 
+    if (old_it != NULL && IS_LEASE_ITEM(old_it)) {
+        /* The lease placeholder is filled by the set or add, and by the cas
+         * with its cas value as the lease token. It is missing to the others.
+         */
+        if (operation == OPERATION_ADD) {
+            operation = OPERATION_SET;
+        } else if (operation != OPERATION_SET && operation != OPERATION_CAS) {
+            do_item_release(engine, old_it);
+            return (operation == OPERATION_LEASE) ? ENGINE_KEY_EEXISTS : ENGINE_NOT_STORED;
+        }
+    }
+    if (operation == OPERATION_LEASE) {
+        /* lease only installs a placeholder of a missing item */
+        if (old_it != NULL) {
+            do_item_release(engine, old_it);
+            return ENGINE_NOT_STORED;
+        }
+        it->iflag |= ITEM_LEASE;
+        stored = do_item_link(engine, it);
+        if (stored == ENGINE_SUCCESS) {
+            *cas = item_get_cas(it);
+        }
+        return stored;
+    }
+
     hash_item *new_it = NULL;
 
     if (old_it != NULL && operation == OPERATION_ADD) {
@@ -1367,6 +1538,9 @@ static void do_mem_slot_free(struct default_engine *engine, void *data, size_t n
     hash_item *it = (hash_item *)data;
     unsigned int clsid = it->slabs_clsid;;
     it->slabs_clsid = 0;
+    if (coll_del_measure) {
+        coll_del_freed += slabs_space_size(engine, ntotal);
+    }
     slabs_free(engine, it, ntotal, clsid);
 }
 
@@ -1781,6 +1955,7 @@ static set_hash_node *do_set_node_alloc(struct default_engine *engine,
         node->hdepth      = hash_depth;
         node->tot_hash_cnt = 0;
         node->tot_elem_cnt = 0;
+        node->sub_elem_cnt = 0;
         memset(node->hcnt, 0, SET_HASHTAB_SIZE*sizeof(uint16_t));
         memset(node->htab, 0, SET_HASHTAB_SIZE*sizeof(void*));
     }
@@ -1851,6 +2026,7 @@ static void do_set_node_link(struct default_engine *engine,
         }
         assert(fcnt == num_elems);
         node->tot_elem_cnt = fcnt;
+        node->sub_elem_cnt = fcnt;
 
         par_node->htab[par_hidx] = node;
         par_node->hcnt[par_hidx] = -1; /* child hash node */
@@ -1917,6 +2093,21 @@ static void do_set_node_unlink(struct default_engine *engine,
     do_set_node_free(engine, node);
 }
 
+/* adjust the subtree element counts on the hash path of the given hash value */
+static void do_set_node_path_adjust(set_meta_info *info, const uint32_t hval, const int delta)
+{
+    set_hash_node *node = info->root;
+    int hidx;
+
+    while (node != NULL) {
+        node->sub_elem_cnt += delta;
+        hidx = SET_GET_HASHIDX(hval, node->hdepth);
+        if (node->hcnt[hidx] >= 0) /* set element hash chain */
+            break;
+        node = node->htab[hidx];
+    }
+}
+
 static ENGINE_ERROR_CODE do_set_elem_link(struct default_engine *engine,
                                           set_meta_info *info, set_elem_item *elem,
                                           const void *cookie)
@@ -1962,6 +2153,7 @@ static ENGINE_ERROR_CODE do_set_elem_link(struct default_engine *engine,
     node->htab[hidx] = elem;
     node->hcnt[hidx] += 1;
     node->tot_elem_cnt += 1;
+    do_set_node_path_adjust(info, elem->hval, 1);
 
     info->ccnt++;
 
@@ -1984,6 +2176,7 @@ static void do_set_elem_unlink(struct default_engine *engine,
     elem->next = (set_elem_item *)ADDR_MEANS_UNLINKED;
     node->hcnt[hidx] -= 1;
     node->tot_elem_cnt -= 1;
+    do_set_node_path_adjust(info, elem->hval, -1);
 
     info->ccnt--;
 
@@ -2212,13 +2405,151 @@ static uint32_t do_set_elem_delete(struct default_engine *engine,
 }
 #endif
 
+/*
+ * Set element random sampling
+ * Every element is given a rank by the order of (hash slot, chain position)
+ * in the hash node tree. k distinct ranks are chosen at random and the
+ * elements of those ranks are located by descending the tree with
+ * the subtree element counts, which costs O(k * depth) instead of O(n).
+ */
+static uint32_t do_coll_rand(const uint32_t range)
+{
+    /* xorshift64* generator, scaled to [0, range) by multiply-shift */
+    uint64_t x = coll_rand_state;
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    coll_rand_state = x;
+    x *= 0x2545F4914F6CDD1DULL;
+    return (uint32_t)(((x >> 32) * (uint64_t)range) >> 32);
+}
+
+static int do_coll_rank_comp(const void *v1, const void *v2)
+{
+    uint32_t r1 = *(const uint32_t *)v1;
+    uint32_t r2 = *(const uint32_t *)v2;
+    return (r1 < r2 ? -1 : (r1 > r2 ? 1 : 0));
+}
+
+/* choose count distinct ranks in [0, total) in ascending order.
+ * The ranks buffer must have room for (2 * count) entries.
+ */
+static void do_coll_rand_ranks(const uint32_t total, const uint32_t count, uint32_t *ranks)
+{
+    /* If more than half are chosen, pick the excluded ranks instead. */
+    uint32_t  pick = (count <= total/2 ? count : total - count);
+    uint32_t *pbuf = (pick < count ? &ranks[count] : ranks);
+    uint32_t  fcnt = 0;
+    uint32_t  i, j;
+
+    /* draw and dedupe until enough distinct ranks are picked */
+    while (fcnt < pick) {
+        for (i = fcnt; i < pick; i++) {
+            pbuf[i] = do_coll_rand(total);
+        }
+        qsort(pbuf, pick, sizeof(uint32_t), do_coll_rank_comp);
+        for (i = 1, j = 1; i < pick; i++) {
+            if (pbuf[i] != pbuf[j-1]) pbuf[j++] = pbuf[i];
+        }
+        fcnt = j;
+    }
+
+    if (pick < count) { /* take the complement of the excluded ranks */
+        uint32_t rank;
+        for (rank = 0, i = 0, j = 0; rank < total; rank++) {
+            if (i < pick && pbuf[i] == rank) i++;
+            else                             ranks[j++] = rank;
+        }
+        assert(j == count);
+    }
+}
+
+/* find the elements of the given ascending ranks in the subtree of node */
+static int do_set_elem_traverse_rank(set_hash_node *node, uint32_t base,
+                                     const uint32_t *ranks, const uint32_t count,
+                                     set_elem_item **elem_array)
+{
+    uint32_t fcnt = 0;
+    uint32_t weight;
+    int hidx;
+
+    for (hidx = 0; hidx < SET_HASHTAB_SIZE && fcnt < count; hidx++) {
+        if (node->hcnt[hidx] == -1) {
+            set_hash_node *child_node = (set_hash_node *)node->htab[hidx];
+            uint32_t ccnt = 0;
+            weight = child_node->sub_elem_cnt;
+            while ((fcnt + ccnt) < count && ranks[fcnt+ccnt] < (base + weight)) {
+                ccnt++;
+            }
+            if (ccnt > 0) {
+                fcnt += do_set_elem_traverse_rank(child_node, base, &ranks[fcnt], ccnt,
+                                                  &elem_array[fcnt]);
+            }
+        } else {
+            set_elem_item *elem = node->htab[hidx];
+            uint32_t eidx = 0;
+            weight = node->hcnt[hidx];
+            while (fcnt < count && ranks[fcnt] < (base + weight)) {
+                while (eidx < (ranks[fcnt] - base)) {
+                    elem = elem->next; eidx++;
+                }
+                elem->refcount++;
+                elem_array[fcnt++] = elem;
+            }
+        }
+        base += weight;
+    }
+    return fcnt;
+}
+
+static ENGINE_ERROR_CODE do_set_elem_get_random(struct default_engine *engine,
+                                                set_meta_info *info, const uint32_t count,
+                                                const bool delete, set_elem_item **elem_array)
+{
+    set_elem_item *elem;
+    uint32_t *ranks;
+    uint32_t fcnt, i, j;
+
+    assert(info->root->sub_elem_cnt == info->ccnt);
+    if ((ranks = malloc(2 * count * sizeof(uint32_t))) == NULL) {
+        return ENGINE_ENOMEM;
+    }
+    do_coll_rand_ranks(info->ccnt, count, ranks);
+    fcnt = do_set_elem_traverse_rank(info->root, 0, ranks, count, elem_array);
+    assert(fcnt == count);
+    free(ranks);
+
+    /* shuffle the found elements so that they are not in hash order */
+    for (i = fcnt - 1; i > 0; i--) {
+        j = do_coll_rand(i + 1);
+        elem = elem_array[i]; elem_array[i] = elem_array[j]; elem_array[j] = elem;
+    }
+
+    if (delete) {
+        for (i = 0; i < fcnt; i++) {
+            elem = elem_array[i];
+            (void)do_set_elem_traverse_delete(engine, info, info->root,
+                                              elem->hval, elem->value, elem->nbytes);
+        }
+    }
+    return ENGINE_SUCCESS;
+}
+
 static ENGINE_ERROR_CODE do_set_elem_get(struct default_engine *engine,
-                                         set_meta_info *info, const uint32_t count, const bool delete,
+                                         set_meta_info *info, const uint32_t count,
+                                         const bool delete, const bool random,
                                          set_elem_item **elem_array, uint32_t *elem_count)
 {
     uint32_t fcnt = 0;
     if (info->root != NULL) {
-        fcnt = do_set_elem_traverse_dfs(engine, info, info->root, count, delete, elem_array);
+        if (random && count > 0 && count < info->ccnt) {
+            if (do_set_elem_get_random(engine, info, count, delete, elem_array) != ENGINE_SUCCESS) {
+                return ENGINE_ENOMEM;
+            }
+            fcnt = count;
+        } else {
+            fcnt = do_set_elem_traverse_dfs(engine, info, info->root, count, delete, elem_array);
+        }
         if (delete && info->root->tot_hash_cnt == 0 && info->root->tot_elem_cnt == 0) {
             do_set_node_unlink(engine, info, NULL, 0);
         }
@@ -2232,6 +2563,132 @@ static ENGINE_ERROR_CODE do_set_elem_get(struct default_engine *engine,
     }
 }
 
+/*
+ * Collection scan cursor
+ *
+ * A scan cursor is a position in the space of nibble-reversed hash values,
+ * where the hash index of depth 0 is the most significant nibble.
+ * Each hash chain then covers one contiguous range of positions
+ * regardless of its depth, so a cursor stays valid across node splits and merges.
+ * The elements existing during a whole scan are returned exactly once.
+ */
+#define COLL_SCAN_END_POSITION ((uint64_t)UINT32_MAX + 1)
+
+typedef struct _coll_scan_cand {
+    uint32_t rhval;     /* nibble-reversed hash value */
+    void    *elem;
+} coll_scan_cand;
+
+static inline uint32_t do_coll_hash_reverse(uint32_t hval)
+{
+    hval = ((hval & 0x0F0F0F0F) << 4) | ((hval >> 4) & 0x0F0F0F0F);
+    hval = ((hval & 0x00FF00FF) << 8) | ((hval >> 8) & 0x00FF00FF);
+    return (hval << 16) | (hval >> 16);
+}
+
+static inline int do_coll_scan_shift(const int hdepth)
+{
+    return (hdepth < 8 ? 28 - (hdepth * 4) : 0);
+}
+
+static int do_coll_scan_cand_comp(const void *v1, const void *v2)
+{
+    uint32_t r1 = ((const coll_scan_cand *)v1)->rhval;
+    uint32_t r2 = ((const coll_scan_cand *)v2)->rhval;
+    return (r1 < r2 ? -1 : (r1 > r2 ? 1 : 0));
+}
+
+/* decide which candidates of a hash chain are taken within the given space.
+ * The taken ones are placed at the front of cand array.
+ * Returns the number of taken candidates and sets the next scan position.
+ * If must_take is set, at least the first group of the same hash value is
+ * taken even if it exceeds the space. The group is bounded by the hash
+ * chain size, so the caller's array must hold that many elements.
+ */
+static uint32_t do_coll_scan_cand_take(coll_scan_cand *cand, const uint32_t ccnt,
+                                       const uint32_t space, const bool must_take,
+                                       const uint64_t bucket_end, uint64_t *position)
+{
+    uint32_t i, j;
+
+    if (ccnt <= space) {
+        *position = bucket_end;
+        return ccnt;
+    }
+
+    /* take the elements of the same hash value all together */
+    qsort(cand, ccnt, sizeof(coll_scan_cand), do_coll_scan_cand_comp);
+    for (i = 0; i < ccnt; i = j) {
+        for (j = i+1; j < ccnt && cand[j].rhval == cand[i].rhval; j++);
+        if (j > space) break;
+    }
+    if (i == 0 && must_take) {
+        /* Too many elements have the same hash value to fit in the space.
+         * Return all of them together, as the cursor cannot point to
+         * the middle of them.
+         */
+        *position = (j < ccnt ? cand[j].rhval : bucket_end);
+        return j;
+    }
+    *position = cand[i].rhval;
+    return i;
+}
+
+static ENGINE_ERROR_CODE do_set_elem_scan(set_meta_info *info,
+                                          const uint32_t cursor, const uint32_t count,
+                                          set_elem_item **elem_array, uint32_t *elem_count,
+                                          uint32_t *next_cursor)
+{
+    coll_scan_cand cand[SET_MAX_HASHCHAIN_SIZE];
+    set_hash_node *node;
+    set_elem_item *elem;
+    uint64_t position = cursor;
+    uint64_t bucket_end;
+    uint32_t hval, rhval, ccnt, tcnt, i;
+    uint32_t fcnt = 0;
+    int hidx, shift;
+
+    while (info->root != NULL && fcnt < count && position < COLL_SCAN_END_POSITION) {
+        /* find the hash chain covering the position */
+        hval = do_coll_hash_reverse((uint32_t)position);
+        node = info->root;
+        hidx = SET_GET_HASHIDX(hval, node->hdepth);
+        while (node->hcnt[hidx] == -1) {
+            node = node->htab[hidx];
+            hidx = SET_GET_HASHIDX(hval, node->hdepth);
+        }
+        shift = do_coll_scan_shift(node->hdepth);
+        bucket_end = ((position >> shift) + 1) << shift;
+
+        ccnt = 0;
+        for (elem = node->htab[hidx]; elem != NULL; elem = elem->next) {
+            rhval = do_coll_hash_reverse(elem->hval);
+            if (rhval >= position) {
+                assert(ccnt < SET_MAX_HASHCHAIN_SIZE);
+                cand[ccnt].rhval = rhval;
+                cand[ccnt].elem  = elem;
+                ccnt++;
+            }
+        }
+        tcnt = do_coll_scan_cand_take(cand, ccnt, count - fcnt, (fcnt == 0),
+                                      bucket_end, &position);
+        for (i = 0; i < tcnt; i++) {
+            elem = (set_elem_item *)cand[i].elem;
+            elem->refcount++;
+            elem_array[fcnt++] = elem;
+        }
+        if (tcnt < ccnt) break; /* no more space */
+    }
+
+    *next_cursor = (position < COLL_SCAN_END_POSITION ? (uint32_t)position : 0);
+    *elem_count = fcnt;
+    if (fcnt > 0) {
+        return ENGINE_SUCCESS;
+    } else {
+        return ENGINE_ELEM_ENOENT;
+    }
+}
+
 static ENGINE_ERROR_CODE do_set_elem_insert(struct default_engine *engine,
                                             hash_item *it, set_elem_item *elem,
                                             const void *cookie)
@@ -2332,6 +2789,9 @@ static hash_item *do_btree_item_alloc(struct default_engine *engine,
         info->bktype  = BKEY_TYPE_UNKNOWN;
         info->maxbkeyrange.len = BKEY_NULL;
         info->root    = NULL;
+        info->eifwhere  = attrp->eifwhere;
+        info->eiflength = attrp->eiflength;
+        info->eindex    = NULL;
         assert((hash_item*)COLL_GET_HASH_ITEM(info) == it);
     }
     return it;
@@ -2352,6 +2812,7 @@ static btree_indx_node *do_btree_node_alloc(struct default_engine *engine,
         node->used_count  = 0;
         node->prev = node->next = NULL;
         memset(node->item, 0, BTREE_ITEM_COUNT*sizeof(void*));
+        memset(node->ikey, 0, BTREE_ITEM_COUNT*sizeof(uint64_t));
         if (node_depth > 0)
             memset(node->ecnt, 0, BTREE_ITEM_COUNT*sizeof(uint16_t));
     }
@@ -2404,89 +2865,452 @@ static void do_btree_elem_release(struct default_engine *engine, btree_elem_item
     }
 }
 
-static inline btree_elem_item *do_btree_get_first_elem(btree_indx_node *node)
+/*
+ * B+TREE PACKED ELEMENT
+ *
+ * A small element having a uint64 bkey, no eflag and a short value
+ * is packed into its item slot of the leaf node, instead of being
+ * kept as a separate element item. Its bkey is the inline bkey(ikey)
+ * of the slot, and its value is stored in the slot itself:
+ *   the lowest byte : (value length << 1) | 1
+ *   the other bytes : value bytes except the trailing "\r\n"
+ * The lowest bit is never set in the pointer of an element item,
+ * so it tells a packed slot from an element item.
+ *
+ * A packed element is decoded into a buffer on the stack to be inspected.
+ * It's materialized as a standalone element item only when it's returned,
+ * and the standalone element item is freed when it's released.
+ */
+static inline bool do_btree_elem_packable(btree_elem_item *elem)
 {
-    while (node->ndepth > 0) {
-        node = (btree_indx_node *)(node->item[0]);
+    if (sizeof(void *) != sizeof(uint64_t) ||
+        elem->nbkey != 0 || elem->neflag != 0 ||
+        elem->nbytes < 2 || elem->nbytes > BTREE_PACKED_VALUE_MAX + 2) {
+        return false;
     }
-    assert(node->ndepth == 0);
-    return (btree_elem_item *)(node->item[0]);
+    return memcmp(elem->data + sizeof(uint64_t) + elem->nbytes - 2, "\r\n", 2) == 0;
 }
 
-static inline btree_elem_item *do_btree_get_last_elem(btree_indx_node *node)
+static inline void *do_btree_elem_pack(btree_elem_item *elem)
 {
-    while (node->ndepth > 0) {
-        node = (btree_indx_node *)(node->item[node->used_count-1]);
+    const unsigned char *value = elem->data + sizeof(uint64_t);
+    const int vlen = elem->nbytes - 2;
+    uint64_t slot = ((uint64_t)vlen << 1) | 1;
+
+    for (int i = 0; i < vlen; i++) {
+        slot |= (uint64_t)value[i] << (8 * (i+1));
     }
-    assert(node->ndepth == 0);
-    return (btree_elem_item *)(node->item[node->used_count-1]);
+    return (void *)(uintptr_t)slot;
 }
 
-static inline btree_indx_node *do_btree_get_first_leaf(btree_indx_node *node,
-                                                       btree_elem_posi *path)
+static inline btree_elem_item *do_btree_elem_unpack(void *slot, const uint64_t ikey,
+                                                    btree_elem_buf *buf)
 {
-    while (node->ndepth > 0) {
-        if (path) {
-            path[node->ndepth].node = node;
-            path[node->ndepth].indx = 0;
-        }
-        node = (btree_indx_node *)(node->item[0]);
+    btree_elem_item *elem = &buf->elem;
+    uint64_t bits = (uint64_t)(uintptr_t)slot;
+    const int vlen = (int)((bits & 0xFF) >> 1);
+    unsigned char *value = elem->data + sizeof(uint64_t);
+
+    elem->refcount    = 0;
+    elem->slabs_clsid = 0; /* not allocated */
+    elem->status      = BTREE_ITEM_STATUS_USED;
+    elem->nbkey       = 0;
+    elem->neflag      = 0;
+    elem->nbytes      = (uint16_t)(vlen + 2);
+    memcpy(elem->data, &ikey, sizeof(uint64_t));
+    for (int i = 0; i < vlen; i++) {
+        value[i] = (unsigned char)(bits >> (8 * (i+1)));
     }
-    assert(node->ndepth == 0);
-    return node;
+    value[vlen] = '\r';
+    value[vlen+1] = '\n';
+    return elem;
 }
 
-static inline btree_indx_node *do_btree_get_last_leaf(btree_indx_node *node,
-                                                      btree_elem_posi *path)
+static inline btree_elem_item *do_btree_leaf_elem(btree_indx_node *node, const int indx,
+                                                  btree_elem_buf *buf)
 {
-    while (node->ndepth > 0) {
-        if (path) {
-            path[node->ndepth].node = node;
-            path[node->ndepth].indx = node->used_count-1;
-        }
-        node = (btree_indx_node *)(node->item[node->used_count-1]);
+    void *slot = node->item[indx];
+    if (BTREE_SLOT_IS_PACKED(slot)) {
+        return do_btree_elem_unpack(slot, node->ikey[indx], buf);
     }
-    assert(node->ndepth == 0);
-    return node;
+    return (btree_elem_item *)slot;
 }
 
-static inline void do_btree_get_bkey(btree_elem_item *elem, bkey_t *bkey)
+/* the memory space of the element in the leaf node */
+static inline size_t do_btree_elem_space(struct default_engine *engine, btree_elem_item *elem)
 {
-    if (elem->nbkey > 0) {
-        bkey->len = elem->nbkey;
-        memcpy(bkey->val, elem->data, elem->nbkey);
-    } else {
-        bkey->len = 0;
-        memcpy(bkey->val, elem->data, sizeof(uint64_t));
-    }
+    return BTREE_ELEM_IS_DECODED(elem) ? 0 : slabs_space_size(engine, do_btree_elem_ntotal(elem));
 }
 
-/******************* BKEY COMPARISION CODE *************************/
-static inline int UINT64_COMP(const uint64_t *v1, const uint64_t *v2)
+/*
+ * Take a reference of the element to be returned.
+ * A decoded packed element is copied into a standalone element item.
+ * NULL is returned if it cannot be allocated.
+ */
+static btree_elem_item *do_btree_elem_take(struct default_engine *engine,
+                                           btree_elem_item *elem, const void *cookie)
 {
-    if (*v1 == *v2) return  0;
-    if (*v1 <  *v2) return -1;
-    else            return  1;
+    btree_elem_item *copy;
+
+    if (!BTREE_ELEM_IS_DECODED(elem)) {
+        elem->refcount++;
+        return elem;
+    }
+    copy = do_btree_elem_alloc(engine, elem->nbkey, elem->neflag, elem->nbytes, cookie);
+    if (copy != NULL) {
+        memcpy(copy->data, elem->data, sizeof(uint64_t) + elem->nbytes);
+    }
+    return copy;
 }
 
-static inline bool UINT64_ISEQ(const uint64_t *v1, const uint64_t *v2)
+/*
+ * Drop the element that was just removed from the leaf node.
+ * It's freed unless it's referenced. A decoded packed element has nothing to free.
+ */
+static void do_btree_elem_drop(struct default_engine *engine, btree_elem_item *elem)
 {
-    return ((*v1 == *v2) ? true : false);
+    if (BTREE_ELEM_IS_DECODED(elem)) {
+        return;
+    }
+    if (elem->refcount > 0) {
+        elem->status = BTREE_ITEM_STATUS_UNLINK;
+    } else  {
+        elem->status = BTREE_ITEM_STATUS_FREE;
+        do_btree_elem_free(engine, elem);
+    }
 }
 
-static inline bool UINT64_ISNE(const uint64_t *v1, const uint64_t *v2)
+/*
+ * B+TREE EFLAG INDEX
+ *
+ * The optional eflag index of a b+tree maps the value of an eflag field,
+ * declared at creation time, to the elements having the value.
+ * Every entry is chained into two hash tables: the eflag value hash table
+ * that is used to find the elements by eflag value, and the bkey hash table
+ * that is used to find the entry of a given element when it's unlinked.
+ * The index is best effort: if its memory cannot be allocated, it is dropped
+ * and the eflag filters are evaluated by scanning the elements again.
+ */
+static inline unsigned char *do_btree_eindex_field(btree_meta_info *info, btree_elem_item *elem)
 {
-    return ((*v1 != *v2) ? true : false);
+    if (elem->neflag < (info->eifwhere + info->eiflength)) {
+        return NULL; /* the element doesn't have the indexed field */
+    }
+    return elem->data + BTREE_REAL_NBKEY(elem->nbkey) + info->eifwhere;
 }
 
-static inline bool UINT64_ISLT(const uint64_t *v1, const uint64_t *v2)
+static inline uint32_t do_btree_eindex_vslot(btree_eindex_table *eindex,
+                                             const unsigned char *field, const int length)
 {
-    return ((*v1 <  *v2) ? true : false);
+    return genhash_string_hash(field, length) & ((1 << eindex->hbits) - 1);
 }
 
-static inline bool UINT64_ISLE(const uint64_t *v1, const uint64_t *v2)
+static inline uint32_t do_btree_eindex_bslot(btree_eindex_table *eindex, btree_elem_item *elem)
 {
-    return ((*v1 <= *v2) ? true : false);
+    return genhash_string_hash(elem->data, BTREE_REAL_NBKEY(elem->nbkey)) & ((1 << eindex->hbits) - 1);
+}
+
+static inline size_t do_btree_eindex_table_ntotal(const int hbits)
+{
+    return sizeof(btree_eindex_table)
+           + (1 << hbits) * (2*sizeof(btree_eindex_entry*) + sizeof(uint32_t));
+}
+
+static btree_eindex_table *do_btree_eindex_table_alloc(struct default_engine *engine,
+                                                       const int hbits, const void *cookie)
+{
+    size_t ntotal = do_btree_eindex_table_ntotal(hbits);
+    size_t hsize = (1 << hbits);
+
+    btree_eindex_table *eindex = do_item_alloc_internal(engine, ntotal, LRU_CLSID_FOR_SMALL, cookie);
+    if (eindex != NULL) {
+        assert(eindex->slabs_clsid == 0);
+        eindex->slabs_clsid = slabs_clsid(engine, ntotal);
+        assert(eindex->slabs_clsid > 0);
+        eindex->refcount = 0;
+        eindex->hbits    = (uint8_t)hbits;
+        eindex->count    = 0;
+        eindex->vtab = (btree_eindex_entry **)((char*)eindex + sizeof(btree_eindex_table));
+        eindex->btab = eindex->vtab + hsize;
+        eindex->vcnt = (uint32_t *)(eindex->btab + hsize);
+        memset(eindex->vtab, 0, hsize * (2*sizeof(btree_eindex_entry*) + sizeof(uint32_t)));
+    }
+    return eindex;
+}
+
+static void do_btree_eindex_table_free(struct default_engine *engine, btree_eindex_table *eindex)
+{
+    do_mem_slot_free(engine, eindex, do_btree_eindex_table_ntotal(eindex->hbits));
+}
+
+static void do_btree_eindex_entry_link(btree_meta_info *info, btree_eindex_entry *entry)
+{
+    btree_eindex_table *eindex = info->eindex;
+    uint32_t vslot = do_btree_eindex_vslot(eindex, do_btree_eindex_field(info, entry->elem),
+                                           info->eiflength);
+    uint32_t bslot = do_btree_eindex_bslot(eindex, entry->elem);
+
+    entry->vprev = NULL;
+    entry->vnext = eindex->vtab[vslot];
+    if (entry->vnext != NULL) entry->vnext->vprev = entry;
+    eindex->vtab[vslot] = entry;
+    eindex->vcnt[vslot]++;
+
+    entry->bnext = eindex->btab[bslot];
+    eindex->btab[bslot] = entry;
+    eindex->count++;
+}
+
+/* double the hash tables if they are crowded */
+static void do_btree_eindex_expand(struct default_engine *engine, btree_meta_info *info,
+                                   const void *cookie)
+{
+    btree_eindex_table *old_eindex = info->eindex;
+    btree_eindex_table *new_eindex;
+    btree_eindex_entry *entry, *next;
+    uint32_t i;
+
+    if (old_eindex->hbits >= BTREE_EINDEX_MAX_HBITS ||
+        old_eindex->count <= (2U << old_eindex->hbits)) {
+        return;
+    }
+    new_eindex = do_btree_eindex_table_alloc(engine, old_eindex->hbits+1, cookie);
+    if (new_eindex == NULL) {
+        return; /* keep the current hash tables */
+    }
+    info->eindex = new_eindex;
+    for (i = 0; i < (1U << old_eindex->hbits); i++) {
+        for (entry = old_eindex->btab[i]; entry != NULL; entry = next) {
+            next = entry->bnext;
+            do_btree_eindex_entry_link(info, entry);
+        }
+    }
+    assert(new_eindex->count == old_eindex->count);
+
+    if (1) { /* apply memory space */
+        size_t old_stotal = slabs_space_size(engine, do_btree_eindex_table_ntotal(old_eindex->hbits));
+        size_t new_stotal = slabs_space_size(engine, do_btree_eindex_table_ntotal(new_eindex->hbits));
+        increase_collection_space(engine, ITEM_TYPE_BTREE, (coll_meta_info *)info, new_stotal);
+        if (info->stotal > 0) {
+            decrease_collection_space(engine, ITEM_TYPE_BTREE, (coll_meta_info *)info, old_stotal);
+        }
+    }
+    do_btree_eindex_table_free(engine, old_eindex);
+}
+
+/* free the eflag index including all its entries */
+static void do_btree_eindex_free(struct default_engine *engine, btree_meta_info *info)
+{
+    btree_eindex_table *eindex = info->eindex;
+    btree_eindex_entry *entry, *next;
+    size_t stotal;
+    uint32_t i;
+
+    if (eindex == NULL) return;
+
+    stotal = slabs_space_size(engine, do_btree_eindex_table_ntotal(eindex->hbits))
+           + eindex->count * slabs_space_size(engine, sizeof(btree_eindex_entry));
+    for (i = 0; i < (1U << eindex->hbits); i++) {
+        for (entry = eindex->btab[i]; entry != NULL; entry = next) {
+            next = entry->bnext;
+            do_mem_slot_free(engine, entry, sizeof(btree_eindex_entry));
+        }
+    }
+    do_btree_eindex_table_free(engine, eindex);
+    info->eindex = NULL;
+
+    if (info->stotal > 0) { /* apply memory space */
+        decrease_collection_space(engine, ITEM_TYPE_BTREE, (coll_meta_info *)info, stotal);
+    }
+}
+
+/* drop the eflag index for good since its memory cannot be allocated */
+static void do_btree_eindex_disable(struct default_engine *engine, btree_meta_info *info)
+{
+    do_btree_eindex_free(engine, info);
+    info->eiflength = 0;
+}
+
+/*
+ * Detach the index entry of the element from the hash tables.
+ * The entry is returned to be attached again or freed by the caller.
+ */
+static btree_eindex_entry *do_btree_eindex_detach(btree_meta_info *info, btree_elem_item *elem)
+{
+    btree_eindex_table *eindex = info->eindex;
+    btree_eindex_entry *entry, *prev = NULL;
+    unsigned char *field;
+    uint32_t bslot;
+
+    if (eindex == NULL || (field = do_btree_eindex_field(info, elem)) == NULL) {
+        return NULL; /* not indexed */
+    }
+
+    bslot = do_btree_eindex_bslot(eindex, elem);
+    for (entry = eindex->btab[bslot]; entry != NULL; entry = entry->bnext) {
+        if (entry->elem == elem) break;
+        prev = entry;
+    }
+    assert(entry != NULL);
+    if (prev == NULL) eindex->btab[bslot] = entry->bnext;
+    else              prev->bnext = entry->bnext;
+
+    if (entry->vnext != NULL) entry->vnext->vprev = entry->vprev;
+    if (entry->vprev != NULL) {
+        entry->vprev->vnext = entry->vnext;
+    } else {
+        uint32_t vslot = do_btree_eindex_vslot(eindex, field, info->eiflength);
+        assert(eindex->vtab[vslot] == entry);
+        eindex->vtab[vslot] = entry->vnext;
+    }
+    eindex->vcnt[do_btree_eindex_vslot(eindex, field, info->eiflength)]--;
+    eindex->count--;
+    return entry;
+}
+
+/*
+ * Attach the element to the eflag index with the given detached entry.
+ * If the entry is not given, a new one is allocated.
+ * If the element doesn't have the indexed field, the given entry is freed.
+ */
+static void do_btree_eindex_attach(struct default_engine *engine, btree_meta_info *info,
+                                   btree_elem_item *elem, btree_eindex_entry *entry,
+                                   const void *cookie)
+{
+    if (do_btree_eindex_field(info, elem) == NULL) {
+        if (entry != NULL) {
+            do_mem_slot_free(engine, entry, sizeof(btree_eindex_entry));
+            if (info->stotal > 0) { /* apply memory space */
+                decrease_collection_space(engine, ITEM_TYPE_BTREE, (coll_meta_info *)info,
+                                          slabs_space_size(engine, sizeof(btree_eindex_entry)));
+            }
+        }
+        return;
+    }
+
+    if (entry == NULL) {
+        size_t stotal = slabs_space_size(engine, sizeof(btree_eindex_entry));
+        if (info->eindex == NULL) {
+            info->eindex = do_btree_eindex_table_alloc(engine, BTREE_EINDEX_MIN_HBITS, cookie);
+            if (info->eindex == NULL) {
+                do_btree_eindex_disable(engine, info);
+                return;
+            }
+            stotal += slabs_space_size(engine, do_btree_eindex_table_ntotal(BTREE_EINDEX_MIN_HBITS));
+        }
+        entry = do_item_alloc_internal(engine, sizeof(btree_eindex_entry), LRU_CLSID_FOR_SMALL, cookie);
+        if (entry == NULL) {
+            do_btree_eindex_disable(engine, info);
+            return;
+        }
+        assert(entry->slabs_clsid == 0);
+        entry->slabs_clsid = slabs_clsid(engine, sizeof(btree_eindex_entry));
+        assert(entry->slabs_clsid > 0);
+        entry->refcount = 0;
+        increase_collection_space(engine, ITEM_TYPE_BTREE, (coll_meta_info *)info, stotal);
+    }
+    entry->elem = elem;
+    do_btree_eindex_entry_link(info, entry);
+    do_btree_eindex_expand(engine, info, cookie);
+}
+
+/* remove the element from the eflag index */
+static inline void do_btree_eindex_remove(struct default_engine *engine, btree_meta_info *info,
+                                          btree_elem_item *elem)
+{
+    btree_eindex_entry *entry = do_btree_eindex_detach(info, elem);
+    if (entry != NULL) {
+        do_mem_slot_free(engine, entry, sizeof(btree_eindex_entry));
+        if (info->stotal > 0) { /* apply memory space */
+            decrease_collection_space(engine, ITEM_TYPE_BTREE, (coll_meta_info *)info,
+                                      slabs_space_size(engine, sizeof(btree_eindex_entry)));
+        }
+    }
+}
+
+static inline btree_elem_item *do_btree_get_first_elem(btree_indx_node *node, btree_elem_buf *buf)
+{
+    while (node->ndepth > 0) {
+        node = (btree_indx_node *)(node->item[0]);
+    }
+    assert(node->ndepth == 0);
+    return BTREE_GET_ELEM_ITEM(node, 0, buf);
+}
+
+static inline btree_elem_item *do_btree_get_last_elem(btree_indx_node *node, btree_elem_buf *buf)
+{
+    while (node->ndepth > 0) {
+        node = (btree_indx_node *)(node->item[node->used_count-1]);
+    }
+    assert(node->ndepth == 0);
+    return BTREE_GET_ELEM_ITEM(node, node->used_count-1, buf);
+}
+
+static inline btree_indx_node *do_btree_get_first_leaf(btree_indx_node *node,
+                                                       btree_elem_posi *path)
+{
+    while (node->ndepth > 0) {
+        if (path) {
+            path[node->ndepth].node = node;
+            path[node->ndepth].indx = 0;
+        }
+        node = (btree_indx_node *)(node->item[0]);
+    }
+    assert(node->ndepth == 0);
+    return node;
+}
+
+static inline btree_indx_node *do_btree_get_last_leaf(btree_indx_node *node,
+                                                      btree_elem_posi *path)
+{
+    while (node->ndepth > 0) {
+        if (path) {
+            path[node->ndepth].node = node;
+            path[node->ndepth].indx = node->used_count-1;
+        }
+        node = (btree_indx_node *)(node->item[node->used_count-1]);
+    }
+    assert(node->ndepth == 0);
+    return node;
+}
+
+static inline void do_btree_get_bkey(btree_elem_item *elem, bkey_t *bkey)
+{
+    if (elem->nbkey > 0) {
+        bkey->len = elem->nbkey;
+        memcpy(bkey->val, elem->data, elem->nbkey);
+    } else {
+        bkey->len = 0;
+        memcpy(bkey->val, elem->data, sizeof(uint64_t));
+    }
+}
+
+/******************* BKEY COMPARISION CODE *************************/
+static inline int UINT64_COMP(const uint64_t *v1, const uint64_t *v2)
+{
+    if (*v1 == *v2) return  0;
+    if (*v1 <  *v2) return -1;
+    else            return  1;
+}
+
+static inline bool UINT64_ISEQ(const uint64_t *v1, const uint64_t *v2)
+{
+    return ((*v1 == *v2) ? true : false);
+}
+
+static inline bool UINT64_ISNE(const uint64_t *v1, const uint64_t *v2)
+{
+    return ((*v1 != *v2) ? true : false);
+}
+
+static inline bool UINT64_ISLT(const uint64_t *v1, const uint64_t *v2)
+{
+    return ((*v1 <  *v2) ? true : false);
+}
+
+static inline bool UINT64_ISLE(const uint64_t *v1, const uint64_t *v2)
+{
+    return ((*v1 <= *v2) ? true : false);
 }
 
 static inline bool UINT64_ISGT(const uint64_t *v1, const uint64_t *v2)
@@ -2656,6 +3480,67 @@ static void (*BINARY_BITWISE_OP[BITWISE_OP_MAX]) (const unsigned char *v1, const
                                   : BINARY_ISGE((bk1),(nbk1),(bk2),(nbk2)))
 /******************* BKEY COMPARISION CODE *************************/
 
+/********************** INLINE BKEY CODE ***************************/
+/*
+ * Each btree node keeps the inline bkeys(ikey) of its items beside the
+ * item pointers, so that the node can be searched without touching
+ * the element items and the lower nodes.
+ * The inline bkey is the bkey itself for uint64 bkey, and the first 8 bytes
+ * of the bkey in big endian order with zero padding for binary bkey.
+ * So, (ikey1 < ikey2) means (bkey1 < bkey2), but (ikey1 == ikey2) does not
+ * mean (bkey1 == bkey2) for binary bkeys.
+ *
+ * leaf node   : ikey[i] is the inline bkey of the i-th element.
+ * nonleaf node: ikey[i] is a lower bound of the i-th child node such that
+ *   ikey of any bkey before the child <= ikey[i] <= ikey of the first bkey of the child.
+ *   The lower bound is kept valid on element deletion without any change.
+ */
+static inline uint64_t do_btree_bkey_ikey(const unsigned char *bkey, const int nbkey)
+{
+    if (nbkey == 0) {
+        return *(const uint64_t*)bkey;
+    } else {
+        uint64_t ikey = 0;
+        for (int i = 0; i < 8; i++) {
+            ikey = (ikey << 8) | (i < nbkey ? bkey[i] : 0);
+        }
+        return ikey;
+    }
+}
+
+#define BTREE_ELEM_IKEY(elem) do_btree_bkey_ikey((elem)->data, (elem)->nbkey)
+
+/* the first index whose ikey is not less than the given ikey (branchless) */
+static inline int do_btree_ikey_lower_bound(const uint64_t *ikeys, int count, const uint64_t ikey)
+{
+    const uint64_t *base = ikeys;
+    int half;
+
+    if (count <= 0) return 0;
+    while (count > 1) {
+        half = count / 2;
+        base = (base[half] < ikey ? base + half : base);
+        count -= half;
+    }
+    return (int)(base - ikeys) + (*base < ikey);
+}
+
+/* the first index whose ikey is greater than the given ikey (branchless) */
+static inline int do_btree_ikey_upper_bound(const uint64_t *ikeys, int count, const uint64_t ikey)
+{
+    const uint64_t *base = ikeys;
+    int half;
+
+    if (count <= 0) return 0;
+    while (count > 1) {
+        half = count / 2;
+        base = (base[half] <= ikey ? base + half : base);
+        count -= half;
+    }
+    return (int)(base - ikeys) + (*base <= ikey);
+}
+/********************** INLINE BKEY CODE ***************************/
+
 /**************** MAX BKEY RANGE MANIPULATION **********************/
 static inline void UINT64_COPY(const uint64_t *v, uint64_t *result)
 {
@@ -2842,21 +3727,30 @@ static void do_btree_decr_path(btree_elem_posi *path, int depth)
 static btree_indx_node *do_btree_find_leaf(btree_indx_node *root,
                                            const unsigned char *bkey, const int nbkey,
                                            btree_elem_posi *path,
-                                           btree_elem_item **found_elem)
+                                           btree_elem_item **found_elem,
+                                           btree_elem_buf *buf)
 {
     btree_indx_node *node = root;
     btree_elem_item *elem;
+    uint64_t ikey = do_btree_bkey_ikey(bkey, nbkey);
     int mid, left, right, comp;
 
     *found_elem = NULL; /* the same bkey is not found */
 
     while (node->ndepth > 0) {
-        left  = 1;
-        right = node->used_count-1;
+        /* The separators are compared with the inline bkeys.
+         * Only the separators having the same inline bkey are compared
+         * with the first element of the child node.
+         */
+        left  = 1 + do_btree_ikey_lower_bound(&node->ikey[1], node->used_count-1, ikey);
+        right = left-1;
+        if (left < node->used_count && node->ikey[left] == ikey) {
+            right = left + do_btree_ikey_upper_bound(&node->ikey[left], node->used_count-left, ikey) - 1;
+        }
 
         while (left <= right) {
             mid  = (left + right) / 2;
-            elem = do_btree_get_first_elem((btree_indx_node *)(node->item[mid])); /* separator */
+            elem = do_btree_get_first_elem((btree_indx_node *)(node->item[mid]), buf); /* separator */
             comp = BKEY_COMP(bkey, nbkey, elem->data, elem->nbkey);
             if (comp == 0) break;
             if (comp <  0) right = mid-1;
@@ -2883,16 +3777,52 @@ static btree_indx_node *do_btree_find_leaf(btree_indx_node *root,
     return node;
 }
 
+/*
+ * Search the bkey in the leaf node from the given index.
+ * If found, return true with the index of the element.
+ * Otherwise, return false with the index where the bkey can be inserted.
+ */
+static bool do_btree_leaf_search(btree_indx_node *node, const int from_indx,
+                                 const unsigned char *bkey, const int nbkey, int *indx)
+{
+    btree_elem_item *elem;
+    btree_elem_buf ebuf;
+    uint64_t ikey = do_btree_bkey_ikey(bkey, nbkey);
+    int mid, left, right, comp;
+
+    left  = from_indx + do_btree_ikey_lower_bound(&node->ikey[from_indx],
+                                                  node->used_count-from_indx, ikey);
+    right = left-1;
+    if (left < node->used_count && node->ikey[left] == ikey) {
+        right = left + do_btree_ikey_upper_bound(&node->ikey[left], node->used_count-left, ikey) - 1;
+    }
+
+    while (left <= right) {
+        mid  = (left + right) / 2;
+        elem = BTREE_GET_ELEM_ITEM(node, mid, &ebuf);
+        comp = BKEY_COMP(bkey, nbkey, elem->data, elem->nbkey);
+        if (comp == 0) {
+            *indx = mid;
+            return true;
+        }
+        if (comp <  0) right = mid-1;
+        else           left  = mid+1;
+    }
+    *indx = left;
+    return false;
+}
+
 static ENGINE_ERROR_CODE do_btree_find_insposi(btree_indx_node *root,
                                                const unsigned char *ins_bkey, const int ins_nbkey,
                                                btree_elem_posi *path)
 {
     btree_indx_node *node;
     btree_elem_item *elem;
-    int mid, left, right, comp;
+    btree_elem_buf ebuf;
+    int indx;
 
     /* find leaf node */
-    node = do_btree_find_leaf(root, ins_bkey, ins_nbkey, path, &elem);
+    node = do_btree_find_leaf(root, ins_bkey, ins_nbkey, path, &elem, &ebuf);
     if (elem != NULL) { /* the bkey(ins_bkey) is found */
         /* while traversing to leaf node, the bkey can be found.
          * refer to do_btree_find_leaf() function.
@@ -2903,40 +3833,63 @@ static ENGINE_ERROR_CODE do_btree_find_insposi(btree_indx_node *root,
     }
 
     /* do search the bkey(ins_bkey) in leaf node */
-    left  = 0;
-    right = node->used_count-1;
+    path[0].node = node;
+    if (do_btree_leaf_search(node, 0, ins_bkey, ins_nbkey, &indx)) {
+        path[0].indx = indx; /* the bkey(ins_bkey) is found */
+        return ENGINE_ELEM_EEXISTS;
+    } else {
+        path[0].indx = indx; /* the bkey(ins_bkey) is not found */
+        return ENGINE_SUCCESS;
+    }
+}
 
-    while (left <= right) {
-        mid  = (left + right) / 2;
-        elem = BTREE_GET_ELEM_ITEM(node, mid);
-        comp = BKEY_COMP(ins_bkey, ins_nbkey, elem->data, elem->nbkey);
-        if (comp == 0) break;
-        if (comp <  0) right = mid-1;
-        else           left  = mid+1;
+/*
+ * Find the insert position of the next bkey in the leaf node of the given path.
+ * The path is that of the element inserted just before with a smaller bkey.
+ * If the bkey cannot be placed in the leaf node, ENGINE_FAILED is returned
+ * and the insert position should be found from the root node.
+ */
+static ENGINE_ERROR_CODE do_btree_find_insposi_next(btree_elem_posi *path,
+                                                    const unsigned char *ins_bkey, const int ins_nbkey)
+{
+    btree_indx_node *node = path[0].node;
+    btree_elem_item *elem;
+    btree_elem_buf ebuf;
+    int indx;
+
+    /* the bkey must be larger than that of the previous element */
+    elem = BTREE_GET_ELEM_ITEM(node, path[0].indx, &ebuf);
+    if (BKEY_COMP(ins_bkey, ins_nbkey, elem->data, elem->nbkey) <= 0) {
+        return ENGINE_FAILED;
     }
 
-    if (left <= right) { /* the bkey(ins_bkey) is found */
-        path[0].node = node;
-        path[0].indx = mid;
+    if (do_btree_leaf_search(node, path[0].indx+1, ins_bkey, ins_nbkey, &indx)) {
+        path[0].indx = indx; /* the bkey(ins_bkey) is found */
         return ENGINE_ELEM_EEXISTS;
-    } else {             /* the bkey(ins_bkey) is not found */
-        path[0].node = node;
-        path[0].indx = left;
-        return ENGINE_SUCCESS;
     }
+    if (indx == node->used_count && node->next != NULL) {
+        /* The bkey might belong to the next leaf node.
+         * Even if not, appending it to this leaf node can break
+         * the lower bound(ikey) of the next leaf node in upper nodes.
+         */
+        return ENGINE_FAILED;
+    }
+    path[0].indx = indx;
+    return ENGINE_SUCCESS;
 }
 
 static btree_elem_item *do_btree_find_first(btree_indx_node *root,
                                             const int bkrtype, const bkey_range *bkrange,
-                                            btree_elem_posi *path, const bool path_flag)
+                                            btree_elem_posi *path, const bool path_flag,
+                                            btree_elem_buf *buf)
 {
     btree_indx_node *node;
     btree_elem_item *elem;
-    int mid, left, right, comp;
+    int indx, left, right;
 
     /* find leaf node */
     node = do_btree_find_leaf(root, bkrange->from_bkey, bkrange->from_nbkey,
-                              (path_flag ? path : NULL), &elem);
+                              (path_flag ? path : NULL), &elem, buf);
     if (elem != NULL) { /* the bkey(from_bkey) is found */
         /* while traversing to leaf node, the bkey can be found.
          * refer to do_btree_find_leaf() function.
@@ -2948,24 +3901,15 @@ static btree_elem_item *do_btree_find_first(btree_indx_node *root,
     }
 
     /* do search the bkey(from_bkey) in leaf node */
-    left  = 0;
-    right = node->used_count-1;
-
-    while (left <= right) {
-        mid  = (left + right) / 2;
-        elem = BTREE_GET_ELEM_ITEM(node, mid);
-        comp = BKEY_COMP(bkrange->from_bkey, bkrange->from_nbkey, elem->data, elem->nbkey);
-        if (comp == 0) break;
-        if (comp <  0) right = mid-1;
-        else           left  = mid+1;
-    }
-
-    if (left <= right) { /* the bkey(from_bkey) is found. */
+    if (do_btree_leaf_search(node, 0, bkrange->from_bkey, bkrange->from_nbkey, &indx)) {
+        /* the bkey(from_bkey) is found. */
         path[0].bkeq = true;
         path[0].node = node;
-        path[0].indx = mid;
-        /* elem != NULL */
+        path[0].indx = indx;
+        elem = BTREE_GET_ELEM_ITEM(node, indx, buf);
     } else {             /* the bkey(from_bkey) is not found */
+        left  = indx;
+        right = indx-1;
         path[0].bkeq = false;
         switch (bkrtype) {
           case BKEY_RANGE_TYPE_SIN: /* single bkey */
@@ -3009,7 +3953,7 @@ static btree_elem_item *do_btree_find_first(btree_indx_node *root,
             if (path[0].node == NULL) {
                 elem = NULL;
             } else {
-                elem = BTREE_GET_ELEM_ITEM(path[0].node, path[0].indx);
+                elem = BTREE_GET_ELEM_ITEM(path[0].node, path[0].indx, buf);
                 if (BKEY_ISGT(elem->data, elem->nbkey, bkrange->to_bkey, bkrange->to_nbkey))
                     elem = NULL;
             }
@@ -3031,7 +3975,7 @@ static btree_elem_item *do_btree_find_first(btree_indx_node *root,
             if (path[0].node == NULL) {
                 elem = NULL;
             } else {
-                elem = BTREE_GET_ELEM_ITEM(path[0].node, path[0].indx);
+                elem = BTREE_GET_ELEM_ITEM(path[0].node, path[0].indx, buf);
                 if (BKEY_ISLT(elem->data, elem->nbkey, bkrange->to_bkey, bkrange->to_nbkey))
                     elem = NULL;
             }
@@ -3041,7 +3985,8 @@ static btree_elem_item *do_btree_find_first(btree_indx_node *root,
     return elem;
 }
 
-static btree_elem_item *do_btree_find_next(btree_elem_posi *posi, const bkey_range *bkrange)
+static btree_elem_item *do_btree_find_next(btree_elem_posi *posi, const bkey_range *bkrange,
+                                           btree_elem_buf *buf)
 {
     btree_elem_item *elem;
     int comp;
@@ -3051,7 +3996,7 @@ static btree_elem_item *do_btree_find_next(btree_elem_posi *posi, const bkey_ran
         posi->bkeq = false;
         elem = NULL;
     } else {
-        elem = BTREE_GET_ELEM_ITEM(posi->node, posi->indx);
+        elem = BTREE_GET_ELEM_ITEM(posi->node, posi->indx, buf);
         comp = BKEY_COMP(elem->data, elem->nbkey, bkrange->to_bkey, bkrange->to_nbkey);
         if (comp == 0) {
             posi->bkeq = true;
@@ -3063,7 +4008,8 @@ static btree_elem_item *do_btree_find_next(btree_elem_posi *posi, const bkey_ran
     return elem;
 }
 
-static btree_elem_item *do_btree_find_prev(btree_elem_posi *posi, const bkey_range *bkrange)
+static btree_elem_item *do_btree_find_prev(btree_elem_posi *posi, const bkey_range *bkrange,
+                                           btree_elem_buf *buf)
 {
     btree_elem_item *elem;
     int comp;
@@ -3073,7 +4019,7 @@ static btree_elem_item *do_btree_find_prev(btree_elem_posi *posi, const bkey_ran
         posi->bkeq = false;
         elem = NULL;
     } else {
-        elem = BTREE_GET_ELEM_ITEM(posi->node, posi->indx);
+        elem = BTREE_GET_ELEM_ITEM(posi->node, posi->indx, buf);
         comp = BKEY_COMP(elem->data, elem->nbkey, bkrange->to_bkey, bkrange->to_nbkey);
         if (comp == 0) {
             posi->bkeq = true;
@@ -3085,9 +4031,116 @@ static btree_elem_item *do_btree_find_prev(btree_elem_posi *posi, const bkey_ran
     return elem;
 }
 
-static inline bool do_btree_elem_filter(btree_elem_item *elem, const eflag_filter *efilter)
+/*
+ * The eflag filter compiled once per request.
+ * If the compared part of eflag is 1~8 bytes, it's loaded as a big endian
+ * integer, so the comparison result is the same as that of binary values.
+ * Then, the bitwise operation and the comparison are done without branches.
+ */
+#define EFILTER_FAST_MAX_LENG   8
+#define EFILTER_LINEAR_IN_COUNT 16 /* the max IN-list count of linear scan */
+
+#define EFILTER_RES_LT 0x01
+#define EFILTER_RES_EQ 0x02
+#define EFILTER_RES_GT 0x04
+
+static const uint8_t EFILTER_COMPARE_MASK[COMPARE_OP_MAX]
+    = { EFILTER_RES_EQ,                  /* COMPARE_OP_EQ */
+        EFILTER_RES_LT | EFILTER_RES_GT, /* COMPARE_OP_NE */
+        EFILTER_RES_LT,                  /* COMPARE_OP_LT */
+        EFILTER_RES_LT | EFILTER_RES_EQ, /* COMPARE_OP_LE */
+        EFILTER_RES_GT,                  /* COMPARE_OP_GT */
+        EFILTER_RES_GT | EFILTER_RES_EQ  /* COMPARE_OP_GE */ };
+
+typedef struct _btree_efilter {
+    const eflag_filter *efilter; /* original eflag filter */
+    bool     fast;       /* use the integer kernel */
+    bool     negate;     /* IN-list with COMPARE_OP_NE */
+    uint8_t  compmask;   /* EFILTER_COMPARE_MASK of compop */
+    uint16_t compvcnt;   /* # of compare values */
+    uint64_t andmask;    /* ((operand & andmask) | ormask) ^ xormask */
+    uint64_t ormask;
+    uint64_t xormask;
+    uint64_t compval[MAX_EFLAG_COMPARE_COUNT]; /* sorted if IN-list is long */
+} btree_efilter;
+
+static inline uint64_t do_btree_efilter_load(const unsigned char *value, const int length)
+{
+    uint64_t ival = 0;
+    for (int i = 0; i < length; i++) {
+        ival = (ival << 8) | value[i];
+    }
+    return ival;
+}
+
+static int do_btree_efilter_compval_comp(const void *v1, const void *v2)
 {
-    assert(efilter != NULL);
+    uint64_t ival1 = *(const uint64_t *)v1;
+    uint64_t ival2 = *(const uint64_t *)v2;
+    return (ival1 < ival2 ? -1 : (ival1 > ival2 ? 1 : 0));
+}
+
+static const btree_efilter *do_btree_efilter_compile(const eflag_filter *efilter, btree_efilter *ef)
+{
+    if (efilter == NULL) {
+        return NULL;
+    }
+    ef->efilter = efilter;
+    ef->fast = (efilter->ncompval > 0 && efilter->ncompval <= EFILTER_FAST_MAX_LENG &&
+                (efilter->nbitwval == 0 || efilter->nbitwval == efilter->ncompval));
+    if (ef->fast) {
+        uint64_t bitwval = do_btree_efilter_load(efilter->bitwval, efilter->nbitwval);
+        ef->andmask = UINT64_MAX;
+        ef->ormask  = 0;
+        ef->xormask = 0;
+        if (efilter->nbitwval > 0) {
+            if (efilter->bitwop == BITWISE_OP_AND)     ef->andmask = bitwval;
+            else if (efilter->bitwop == BITWISE_OP_OR) ef->ormask  = bitwval;
+            else                                       ef->xormask = bitwval;
+        }
+        ef->compvcnt = (efilter->compvcnt > 1 ? efilter->compvcnt : 1);
+        for (int i = 0; i < ef->compvcnt; i++) {
+            ef->compval[i] = do_btree_efilter_load(&efilter->compval[i*efilter->ncompval],
+                                                   efilter->ncompval);
+        }
+        if (ef->compvcnt > EFILTER_LINEAR_IN_COUNT) {
+            qsort(ef->compval, ef->compvcnt, sizeof(uint64_t), do_btree_efilter_compval_comp);
+        }
+        ef->negate = (efilter->compop == COMPARE_OP_NE);
+        ef->compmask = EFILTER_COMPARE_MASK[efilter->compop];
+    }
+    return ef;
+}
+
+static inline bool do_btree_efilter_in(const btree_efilter *ef, const uint64_t operand)
+{
+    if (ef->compvcnt <= EFILTER_LINEAR_IN_COUNT) {
+        int found = 0;
+        int i = 0;
+#ifdef __SSE2__
+        /* compare 2 values at once: equal if both 32-bit halves are equal */
+        __m128i key = _mm_set1_epi64x((long long)operand);
+        __m128i acc = _mm_setzero_si128();
+        for ( ; (i+2) <= ef->compvcnt; i += 2) {
+            __m128i cmp = _mm_cmpeq_epi32(_mm_loadu_si128((const __m128i *)&ef->compval[i]), key);
+            acc = _mm_or_si128(acc, _mm_and_si128(cmp, _mm_shuffle_epi32(cmp, _MM_SHUFFLE(2,3,0,1))));
+        }
+        found = _mm_movemask_epi8(acc);
+#endif
+        for ( ; i < ef->compvcnt; i++) {
+            found |= (ef->compval[i] == operand);
+        }
+        return found != 0;
+    } else {
+        int indx = do_btree_ikey_lower_bound(ef->compval, ef->compvcnt, operand);
+        return (indx < ef->compvcnt && ef->compval[indx] == operand);
+    }
+}
+
+static inline bool do_btree_elem_filter(btree_elem_item *elem, const btree_efilter *ef)
+{
+    assert(ef != NULL);
+    const eflag_filter *efilter = ef->efilter;
     if (efilter->fwhere >= elem->neflag || efilter->ncompval > (elem->neflag-efilter->fwhere)) {
         return (efilter->compop == COMPARE_OP_NE ? true : false);
     }
@@ -3095,6 +4148,19 @@ static inline bool do_btree_elem_filter(btree_elem_item *elem, const eflag_filte
     unsigned char result[MAX_EFLAG_LENG];
     unsigned char *operand = elem->data + BTREE_REAL_NBKEY(elem->nbkey) + efilter->fwhere;
 
+    if (ef->fast) {
+        uint64_t ival = do_btree_efilter_load(operand, efilter->ncompval);
+        ival = ((ival & ef->andmask) | ef->ormask) ^ ef->xormask;
+        if (efilter->compvcnt > 1) {
+            return do_btree_efilter_in(ef, ival) != ef->negate;
+        } else {
+            uint8_t res = (ival < ef->compval[0] ? EFILTER_RES_LT : 0)
+                        | (ival == ef->compval[0] ? EFILTER_RES_EQ : 0)
+                        | (ival > ef->compval[0] ? EFILTER_RES_GT : 0);
+            return (res & ef->compmask) != 0;
+        }
+    }
+
     if (efilter->nbitwval > 0) {
         (*BINARY_BITWISE_OP[efilter->bitwop])(operand, efilter->bitwval, efilter->nbitwval, result);
         operand = &result[0];
@@ -3137,11 +4203,23 @@ static void do_btree_consistency_check(btree_indx_node *node, uint32_t ecount, b
             assert(node->ecnt[i] > 0);
             do_btree_consistency_check((btree_indx_node*)node->item[i], node->ecnt[i], detail);
             tot_ecnt += node->ecnt[i];
+            if (detail) { /* check the lower bound(ikey) of the child node */
+                btree_indx_node *leaf = (btree_indx_node*)node->item[i];
+                while (leaf->ndepth > 0) {
+                    leaf = (btree_indx_node*)leaf->item[0];
+                }
+                assert(node->ikey[i] <= leaf->ikey[0]);
+                if (leaf->prev != NULL) {
+                    assert(node->ikey[i] >= leaf->prev->ikey[leaf->prev->used_count-1]);
+                }
+            }
         }
         assert(tot_ecnt == ecount);
     } else { /* node->ndepth == 0: leaf page check */
+        btree_elem_buf ebuf[2]; /* the previous and the current elements */
         for (i = 0; i < node->used_count; i++) {
             assert(node->item[i] != NULL);
+            assert(node->ikey[i] == BTREE_ELEM_IKEY(BTREE_GET_ELEM_ITEM(node, i, &ebuf[0])));
         }
         assert(node->used_count == ecount);
         if (detail) {
@@ -3152,10 +4230,10 @@ static void do_btree_consistency_check(btree_indx_node *node, uint32_t ecount, b
             if (node->prev == NULL) {
                 p_elem = NULL;
             } else {
-                p_elem = BTREE_GET_ELEM_ITEM(node->prev, node->prev->used_count-1);
+                p_elem = BTREE_GET_ELEM_ITEM(node->prev, node->prev->used_count-1, &ebuf[1]);
             }
             for (i = 0; i < node->used_count; i++) {
-                c_elem = BTREE_GET_ELEM_ITEM(node, i);
+                c_elem = BTREE_GET_ELEM_ITEM(node, i, &ebuf[i % 2]);
                 if (p_elem != NULL) {
                     comp = BKEY_COMP(p_elem->data, p_elem->nbkey, c_elem->data, c_elem->nbkey);
                     assert(comp < 0);
@@ -3165,7 +4243,7 @@ static void do_btree_consistency_check(btree_indx_node *node, uint32_t ecount, b
             if (node->next == NULL) {
                 c_elem = NULL;
             } else {
-                c_elem = BTREE_GET_ELEM_ITEM(node->next, 0);
+                c_elem = BTREE_GET_ELEM_ITEM(node->next, 0, &ebuf[i % 2]);
             }
             if (c_elem != NULL) {
                 comp = BKEY_COMP(p_elem->data, p_elem->nbkey, c_elem->data, c_elem->nbkey);
@@ -3186,18 +4264,22 @@ static void do_btree_node_item_move(btree_indx_node *c_node, /* current node */
         if (c_node->ndepth == 0) { /* leaf node */
             for (i = (n_node->used_count-1); i >= 0; i--) {
                 n_node->item[move_count+i] = n_node->item[i];
+                n_node->ikey[move_count+i] = n_node->ikey[i];
             }
             for (i = 0; i < move_count; i++) {
                 n_node->item[i] = c_node->item[c_node->used_count-move_count+i];
+                n_node->ikey[i] = c_node->ikey[c_node->used_count-move_count+i];
                 c_node->item[c_node->used_count-move_count+i] = NULL;
             }
         } else { /* c_node->ndepth > 0: nonleaf node */
             for (i = (n_node->used_count-1); i >= 0; i--) {
                 n_node->item[move_count+i] = n_node->item[i];
+                n_node->ikey[move_count+i] = n_node->ikey[i];
                 n_node->ecnt[move_count+i] = n_node->ecnt[i];
             }
             for (i = 0; i < move_count; i++) {
                 n_node->item[i] = c_node->item[c_node->used_count-move_count+i];
+                n_node->ikey[i] = c_node->ikey[c_node->used_count-move_count+i];
                 c_node->item[c_node->used_count-move_count+i] = NULL;
                 n_node->ecnt[i] = c_node->ecnt[c_node->used_count-move_count+i];
                 c_node->ecnt[c_node->used_count-move_count+i] = 0;
@@ -3207,18 +4289,22 @@ static void do_btree_node_item_move(btree_indx_node *c_node, /* current node */
         if (c_node->ndepth == 0) { /* leaf node */
             for (i = 0; i < move_count; i++) {
                 n_node->item[n_node->used_count+i] = c_node->item[i];
+                n_node->ikey[n_node->used_count+i] = c_node->ikey[i];
             }
             for (i = move_count; i < c_node->used_count; i++) {
                 c_node->item[i-move_count] = c_node->item[i];
+                c_node->ikey[i-move_count] = c_node->ikey[i];
                 c_node->item[i] = NULL;
             }
         } else { /* c_node->ndepth > 0: nonleaf node */
             for (i = 0; i < move_count; i++) {
                 n_node->item[n_node->used_count+i] = c_node->item[i];
+                n_node->ikey[n_node->used_count+i] = c_node->ikey[i];
                 n_node->ecnt[n_node->used_count+i] = c_node->ecnt[i];
             }
             for (i = move_count; i < c_node->used_count; i++) {
                 c_node->item[i-move_count] = c_node->item[i];
+                c_node->ikey[i-move_count] = c_node->ikey[i];
                 c_node->item[i] = NULL;
                 c_node->ecnt[i-move_count] = c_node->ecnt[i];
                 c_node->ecnt[i] = 0;
@@ -3229,7 +4315,15 @@ static void do_btree_node_item_move(btree_indx_node *c_node, /* current node */
     c_node->used_count -= move_count;
 }
 
-static void do_btree_ecnt_move_split(btree_elem_posi *path, int depth, int direction, uint32_t elem_count)
+/*
+ * Move the element count in upper nodes.
+ * The elements are moved between the node of the path and its neighbor node,
+ * and the boundary of the two nodes is changed. So, the lower bound(ikey) of
+ * the right node(next node if NEXT direction, current node if PREV direction)
+ * is also changed into the given ikey in upper nodes.
+ */
+static void do_btree_ecnt_move_split(btree_elem_posi *path, int depth, int direction,
+                                     uint32_t elem_count, uint64_t ikey)
 {
     btree_elem_posi  posi;
     btree_indx_node *saved_node;
@@ -3237,6 +4331,9 @@ static void do_btree_ecnt_move_split(btree_elem_posi *path, int depth, int direc
     while (depth < BTREE_MAX_DEPTH) {
         posi = path[depth];
         posi.node->ecnt[posi.indx] -= elem_count;
+        if (direction == BTREE_DIRECTION_PREV) {
+            posi.node->ikey[posi.indx] = ikey;
+        }
 
         saved_node = posi.node;
         if (direction == BTREE_DIRECTION_NEXT) {
@@ -3245,13 +4342,17 @@ static void do_btree_ecnt_move_split(btree_elem_posi *path, int depth, int direc
             do_btree_decr_posi(&posi);
         }
         posi.node->ecnt[posi.indx] += elem_count;
+        if (direction == BTREE_DIRECTION_NEXT) {
+            posi.node->ikey[posi.indx] = ikey;
+        }
         if (saved_node == posi.node) break;
         depth += 1;
     }
     assert(depth < BTREE_MAX_DEPTH);
 }
 
-static void do_btree_ecnt_move_merge(btree_elem_posi *path, int depth, int direction, uint32_t elem_count)
+static void do_btree_ecnt_move_merge(btree_elem_posi *path, int depth, int direction,
+                                     uint32_t elem_count, uint64_t ikey)
 {
     btree_elem_posi  posi;
     btree_indx_node *saved_node;
@@ -3259,6 +4360,9 @@ static void do_btree_ecnt_move_merge(btree_elem_posi *path, int depth, int direc
     while (depth < BTREE_MAX_DEPTH) {
         posi = path[depth];
         posi.node->ecnt[posi.indx] -= elem_count;
+        if (direction == BTREE_DIRECTION_PREV) {
+            posi.node->ikey[posi.indx] = ikey;
+        }
 
         saved_node = posi.node;
         if (direction == BTREE_DIRECTION_NEXT) {
@@ -3273,6 +4377,9 @@ static void do_btree_ecnt_move_merge(btree_elem_posi *path, int depth, int direc
                      posi.node->ecnt[posi.indx] == 0);
         }
         posi.node->ecnt[posi.indx] += elem_count;
+        if (direction == BTREE_DIRECTION_NEXT) {
+            posi.node->ikey[posi.indx] = ikey;
+        }
         if (saved_node == posi.node) break;
         depth += 1;
     }
@@ -3299,8 +4406,10 @@ static void do_btree_node_sbalance(btree_indx_node *node, btree_elem_posi *path,
         if (node->next->used_count > 0) {
             move_count = (node->used_count - node->next->used_count) / 2;
         } else {
-            move_count = (node->next->next == NULL ? (node->used_count / 10)
-                                                   : (node->used_count / 2));
+            /* The new edge node gets only one item since the bkeys
+             * are usually appended in order at the edge of b+tree.
+             */
+            move_count = (node->next->next == NULL ? 1 : (node->used_count / 2));
         }
         if (move_count == 0) move_count = 1;
 
@@ -3316,7 +4425,7 @@ static void do_btree_node_sbalance(btree_indx_node *node, btree_elem_posi *path,
         do_btree_node_item_move(node, node->next, direction, move_count);
 
         /* move element count in upper btree nodes */
-        do_btree_ecnt_move_split(path, depth+1, direction, elem_count);
+        do_btree_ecnt_move_split(path, depth+1, direction, elem_count, node->next->ikey[0]);
 
         /* adjust posi information */
         posi = &path[depth];
@@ -3330,8 +4439,7 @@ static void do_btree_node_sbalance(btree_indx_node *node, btree_elem_posi *path,
         if (node->prev->used_count > 0) {
             move_count = (node->used_count - node->prev->used_count) / 2;
         } else {
-            move_count = (node->prev->prev == NULL ? (node->used_count / 10)
-                                                   : (node->used_count / 2));
+            move_count = (node->prev->prev == NULL ? 1 : (node->used_count / 2));
         }
         if (move_count == 0) move_count = 1;
 
@@ -3347,7 +4455,7 @@ static void do_btree_node_sbalance(btree_indx_node *node, btree_elem_posi *path,
         do_btree_node_item_move(node, node->prev, direction, move_count);
 
         /* move element count in upper btree nodes */
-        do_btree_ecnt_move_split(path, depth+1, direction, elem_count);
+        do_btree_ecnt_move_split(path, depth+1, direction, elem_count, node->ikey[0]);
 
         /* adjust posi information */
         posi = &path[depth];
@@ -3375,6 +4483,7 @@ static void do_btree_node_link(struct default_engine *engine,
             node->used_count = 0;
         } else {
             node->item[0] = info->root;
+            node->ikey[0] = info->root->ikey[0];
             node->ecnt[0] = info->ccnt;
             node->used_count = 1;
         }
@@ -3402,9 +4511,16 @@ static void do_btree_node_link(struct default_engine *engine,
 
         for (int i = (p_node->used_count-1); i >= p_posi->indx; i--) {
             p_node->item[i+1] = p_node->item[i];
+            p_node->ikey[i+1] = p_node->ikey[i];
             p_node->ecnt[i+1] = p_node->ecnt[i];
         }
         p_node->item[p_posi->indx] = node;
+        /* The empty node has a temporary lower bound of its neighbor.
+         * It's adjusted when items are moved into the node.
+         */
+        if (p_posi->indx == p_node->used_count) {
+            p_node->ikey[p_posi->indx] = p_node->ikey[p_posi->indx-1];
+        }
         p_node->ecnt[p_posi->indx] = 0;
         p_node->used_count++;
     }
@@ -3430,8 +4546,12 @@ static ENGINE_ERROR_CODE do_btree_node_split(struct default_engine *engine,
 
     s_node = path[btree_depth].node;
     do {
-        if ((s_node->next != NULL && s_node->next->used_count < (BTREE_ITEM_COUNT/2)) ||
-            (s_node->prev != NULL && s_node->prev->used_count < (BTREE_ITEM_COUNT/2))) {
+        /* Shift the items into a neighbor node having enough room
+         * instead of splitting the node. It keeps the nodes well filled
+         * even if the bkeys are inserted in random order.
+         */
+        if ((s_node->next != NULL && s_node->next->used_count < BTREE_SHIFT_LIMIT) ||
+            (s_node->prev != NULL && s_node->prev->used_count < BTREE_SHIFT_LIMIT)) {
             do_btree_node_sbalance(s_node, path, btree_depth);
             break;
         }
@@ -3492,6 +4612,7 @@ static ENGINE_ERROR_CODE do_btree_node_split(struct default_engine *engine,
 static void do_btree_node_mbalance(btree_indx_node *node, btree_elem_posi *path, int depth)
 {
     int direction;
+    uint64_t ikey;
 
     if (node->prev != NULL && node->next != NULL) {
         direction = (node->next->used_count < node->prev->used_count ?
@@ -3502,12 +4623,18 @@ static void do_btree_node_mbalance(btree_indx_node *node, btree_elem_posi *path,
     }
     if (direction == BTREE_DIRECTION_NEXT) {
         do_btree_node_item_move(node, node->next, direction, node->used_count);
+        ikey = node->next->ikey[0];
     } else {
         do_btree_node_item_move(node, node->prev, direction, node->used_count);
+        /* The node becomes empty. The lower bound of what follows it
+         * must not be less than the last element moved.
+         */
+        btree_elem_buf ebuf;
+        ikey = BTREE_ELEM_IKEY(do_btree_get_last_elem(node->prev, &ebuf));
     }
 
     int elem_count = path[depth+1].node->ecnt[path[depth+1].indx];
-    do_btree_ecnt_move_merge(path, depth+1, direction, elem_count);
+    do_btree_ecnt_move_merge(path, depth+1, direction, elem_count, ikey);
 }
 
 static void do_btree_node_unlink(struct default_engine *engine,
@@ -3528,6 +4655,7 @@ static void do_btree_node_unlink(struct default_engine *engine,
         assert(p_node->ecnt[p_posi->indx] == 0);
         for (int i = p_posi->indx+1; i < p_node->used_count; i++) {
             p_node->item[i-1] = p_node->item[i];
+            p_node->ikey[i-1] = p_node->ikey[i];
             p_node->ecnt[i-1] = p_node->ecnt[i];
         }
         p_node->item[p_node->used_count-1] = NULL;
@@ -3576,6 +4704,7 @@ static inline void do_btree_node_remove_null_items(btree_elem_posi *posi, const
         for (i = f+1; i < node->used_count; i++) {
             if (node->item[i] != NULL) {
                 node->item[f] = node->item[i];
+                node->ikey[f] = node->ikey[i];
                 node->item[i] = NULL;
                 if (node->ndepth > 0) {
                     node->ecnt[f] = node->ecnt[i];
@@ -3721,25 +4850,24 @@ static void do_btree_elem_unlink(struct default_engine *engine,
                                  enum elem_delete_cause cause)
 {
     btree_elem_posi *posi = &path[0];
-    btree_elem_item *elem = BTREE_GET_ELEM_ITEM(posi->node, posi->indx);
+    btree_elem_buf ebuf;
+    btree_elem_item *elem = BTREE_GET_ELEM_ITEM(posi->node, posi->indx, &ebuf);
     int i;
 
     if (info->stotal > 0) { /* apply memory space */
-        size_t stotal = slabs_space_size(engine, do_btree_elem_ntotal(elem));
+        size_t stotal = do_btree_elem_space(engine, elem);
         decrease_collection_space(engine, ITEM_TYPE_BTREE, (coll_meta_info *)info, stotal);
     }
-
-    if (elem->refcount > 0) {
-        elem->status = BTREE_ITEM_STATUS_UNLINK;
-    } else  {
-        elem->status = BTREE_ITEM_STATUS_FREE;
-        do_btree_elem_free(engine, elem);
+    if (info->eindex != NULL) {
+        do_btree_eindex_remove(engine, info, elem);
     }
+    do_btree_elem_drop(engine, elem);
 
     /* remove the element from the leaf node */
     btree_indx_node *node = posi->node;
     for (i = posi->indx+1; i < node->used_count; i++) {
         node->item[i-1] = node->item[i];
+        node->ikey[i-1] = node->ikey[i];
     }
     node->item[node->used_count-1] = NULL;
     node->used_count--;
@@ -3757,22 +4885,29 @@ static void do_btree_elem_unlink(struct default_engine *engine,
 static void do_btree_elem_replace(struct default_engine *engine, btree_meta_info *info,
                                   btree_elem_posi *posi, btree_elem_item *new_elem)
 {
-    btree_elem_item *old_elem = BTREE_GET_ELEM_ITEM(posi->node, posi->indx);
+    btree_elem_buf ebuf;
+    btree_elem_item *old_elem = BTREE_GET_ELEM_ITEM(posi->node, posi->indx, &ebuf);
+    bool packed = do_btree_elem_packable(new_elem);
     size_t old_stotal;
     size_t new_stotal;
 
-    old_stotal = slabs_space_size(engine, do_btree_elem_ntotal(old_elem));
-    new_stotal = slabs_space_size(engine, do_btree_elem_ntotal(new_elem));
+    old_stotal = do_btree_elem_space(engine, old_elem);
+    new_stotal = (packed ? 0 : slabs_space_size(engine, do_btree_elem_ntotal(new_elem)));
 
-    if (old_elem->refcount > 0) {
-        old_elem->status = BTREE_ITEM_STATUS_UNLINK;
-    } else  {
-        old_elem->status = BTREE_ITEM_STATUS_FREE;
-        do_btree_elem_free(engine, old_elem);
+    if (info->eiflength > 0) {
+        /* move the index entry of the old element to the new element */
+        btree_eindex_entry *entry = do_btree_eindex_detach(info, old_elem);
+        do_btree_eindex_attach(engine, info, new_elem, entry, NULL);
     }
+    do_btree_elem_drop(engine, old_elem);
 
-    new_elem->status = BTREE_ITEM_STATUS_USED;
-    posi->node->item[posi->indx] = new_elem;
+    if (packed) { /* the new element is released by the caller */
+        posi->node->item[posi->indx] = do_btree_elem_pack(new_elem);
+    } else {
+        new_elem->status = BTREE_ITEM_STATUS_USED;
+        posi->node->item[posi->indx] = new_elem;
+    }
+    posi->node->ikey[posi->indx] = BTREE_ELEM_IKEY(new_elem);
 
     if (new_stotal != old_stotal) { /* apply memory space */
         assert(info->stotal > 0);
@@ -3790,6 +4925,7 @@ static ENGINE_ERROR_CODE do_btree_elem_update(struct default_engine *engine, btr
 {
     btree_elem_posi  posi;
     btree_elem_item *elem;
+    btree_elem_buf   ebuf;
     unsigned char *ptr;
     int real_nbkey;
     int new_neflag;
@@ -3799,7 +4935,7 @@ static ENGINE_ERROR_CODE do_btree_elem_update(struct default_engine *engine, btr
         return ENGINE_ELEM_ENOENT;
     }
 
-    elem = do_btree_find_first(info->root, bkrtype, bkrange, &posi, false);
+    elem = do_btree_find_first(info->root, bkrtype, bkrange, &posi, false, &ebuf);
     if (elem == NULL) {
         return ENGINE_ELEM_ENOENT;
     }
@@ -3817,9 +4953,14 @@ static ENGINE_ERROR_CODE do_btree_elem_update(struct default_engine *engine, btr
     new_neflag = (eupdate == NULL || eupdate->bitwop < BITWISE_OP_MAX ? elem->neflag : eupdate->neflag);
     new_nbytes = (value == NULL ? elem->nbytes : nbytes);
 
-    if (elem->refcount == 0 && (elem->neflag+elem->nbytes) == (new_neflag+new_nbytes)) {
+    if (elem->refcount == 0 && !BTREE_ELEM_IS_DECODED(elem) &&
+        (elem->neflag+elem->nbytes) == (new_neflag+new_nbytes)) {
         /* old body size == new body size */
         /* do in-place update */
+        btree_eindex_entry *entry = NULL;
+        if (eupdate != NULL && info->eindex != NULL) {
+            entry = do_btree_eindex_detach(info, elem);
+        }
         if (eupdate != NULL) {
             if (eupdate->bitwop < BITWISE_OP_MAX) {
                 ptr = elem->data + real_nbkey + eupdate->fwhere;
@@ -3835,6 +4976,9 @@ static ENGINE_ERROR_CODE do_btree_elem_update(struct default_engine *engine, btr
             memcpy(elem->data + real_nbkey + elem->neflag, value, nbytes);
             elem->nbytes = nbytes;
         }
+        if (eupdate != NULL && info->eiflength > 0) {
+            do_btree_eindex_attach(engine, info, elem, entry, cookie);
+        }
     } else {
         /* old body size != new body size */
 #ifdef ENABLE_STICKY_ITEM
@@ -3887,7 +5031,7 @@ static int do_btree_elem_delete_fast(struct default_engine *engine, btree_meta_i
                                      btree_elem_posi *path, const uint32_t count)
 {
     btree_indx_node *node;
-    btree_elem_item *elem;
+    btree_elem_buf ebuf;
     int i, delcnt=0;
     int cur_depth;
 
@@ -3908,13 +5052,7 @@ static int do_btree_elem_delete_fast(struct default_engine *engine, btree_meta_i
         /* delete element items or lower nodes */
         if (node->ndepth == 0) { /* leaf node */
             for (i = 0; i < node->used_count; i++) {
-                elem = (btree_elem_item *)node->item[i];
-                if (elem->refcount > 0) {
-                    elem->status = BTREE_ITEM_STATUS_UNLINK;
-                } else {
-                    elem->status = BTREE_ITEM_STATUS_FREE;
-                    do_btree_elem_free(engine, elem);
-                }
+                do_btree_elem_drop(engine, BTREE_GET_ELEM_ITEM(node, i, &ebuf));
             }
         } else {
             for (i = 0; i < node->used_count; i++) {
@@ -3940,6 +5078,7 @@ static int do_btree_elem_delete_fast(struct default_engine *engine, btree_meta_i
     if (node == NULL) {
         info->root = NULL;
         info->ccnt = 0;
+        do_btree_eindex_free(engine, info);
         if (info->stotal > 0) {
             decrease_collection_space(engine, ITEM_TYPE_BTREE,
                                       (coll_meta_info *)info, info->stotal);
@@ -3956,8 +5095,11 @@ static uint32_t do_btree_elem_delete(struct default_engine *engine, btree_meta_i
 {
     btree_elem_posi  path[BTREE_MAX_DEPTH];
     btree_elem_item *elem;
+    btree_elem_buf   ebuf;
     uint32_t tot_found = 0; /* found count */
     uint32_t tot_access = 0; /* access count */
+    btree_efilter    ef_buf; /* eflag filter compiled once per request */
+    const btree_efilter *ef = do_btree_efilter_compile(efilter, &ef_buf);
 
     if (info->root == NULL) {
         if (access_count)
@@ -3966,12 +5108,16 @@ static uint32_t do_btree_elem_delete(struct default_engine *engine, btree_meta_i
     }
 
     assert(info->root->ndepth < BTREE_MAX_DEPTH);
-    elem = do_btree_find_first(info->root, bkrtype, bkrange, path, true);
+    if (cause == ELEM_DELETE_COLL && info->eindex != NULL) {
+        /* the whole collection is being deleted */
+        do_btree_eindex_free(engine, info);
+    }
+    elem = do_btree_find_first(info->root, bkrtype, bkrange, path, true, &ebuf);
     if (elem != NULL) {
         if (bkrtype == BKEY_RANGE_TYPE_SIN) {
             assert(path[0].bkeq == true);
             tot_access++;
-            if (efilter == NULL || do_btree_elem_filter(elem, efilter)) {
+            if (ef == NULL || do_btree_elem_filter(elem, ef)) {
                 /* cause == ELEM_DELETE_NORMAL */
                 do_btree_elem_unlink(engine, info, path, cause);
                 tot_found = 1;
@@ -3996,15 +5142,12 @@ static uint32_t do_btree_elem_delete(struct default_engine *engine, btree_meta_i
             c_posi.bkeq = false;
             do {
                 tot_access++;
-                if (efilter == NULL || do_btree_elem_filter(elem, efilter)) {
-                    stotal += slabs_space_size(engine, do_btree_elem_ntotal(elem));
-
-                    if (elem->refcount > 0) {
-                        elem->status = BTREE_ITEM_STATUS_UNLINK;
-                    } else {
-                        elem->status = BTREE_ITEM_STATUS_FREE;
-                        do_btree_elem_free(engine, elem);
+                if (ef == NULL || do_btree_elem_filter(elem, ef)) {
+                    stotal += do_btree_elem_space(engine, elem);
+                    if (info->eindex != NULL) {
+                        do_btree_eindex_remove(engine, info, elem);
                     }
+                    do_btree_elem_drop(engine, elem);
                     c_posi.node->item[c_posi.indx] = NULL;
 
                     cur_found++;
@@ -4014,8 +5157,8 @@ static uint32_t do_btree_elem_delete(struct default_engine *engine, btree_meta_i
                 if (c_posi.bkeq == true) {
                     elem = NULL; break;
                 }
-                elem = (forward ? do_btree_find_next(&c_posi, bkrange)
-                                : do_btree_find_prev(&c_posi, bkrange));
+                elem = (forward ? do_btree_find_next(&c_posi, bkrange, &ebuf)
+                                : do_btree_find_prev(&c_posi, bkrange, &ebuf));
                 if (elem == NULL) break;
 
                 if (s_posi.node != c_posi.node) {
@@ -4054,7 +5197,7 @@ static uint32_t do_btree_elem_delete(struct default_engine *engine, btree_meta_i
                      * If then, the btree doesn't have prefix info and has stotal of 0.
                      * So, do not need to descrese space total info.
                      */
-                    assert(stotal > 0 && stotal <= info->stotal);
+                    assert(stotal <= info->stotal); /* 0 if all were packed elements */
                     decrease_collection_space(engine, ITEM_TYPE_BTREE, (coll_meta_info *)info, stotal);
                 }
                 do_btree_node_merge(engine, info, path, forward, node_cnt);
@@ -4096,20 +5239,220 @@ static inline void get_bkey_full_range(const int bktype, const bool ascend, bkey
     }
 }
 
+/*
+ * Cut the given count of the smallest or largest elements off from the b+tree.
+ * Only the nodes on the path to the new edge element are changed, so the cost
+ * doesn't depend on the count. The nodes that are cut off entirely are linked
+ * into the trim work by depth and freed later by the collection delete thread.
+ */
+static void do_btree_elem_cut(struct default_engine *engine, btree_meta_info *info,
+                              const uint32_t count, const bool smallest, btree_trim_work *work)
+{
+    btree_elem_posi  path[BTREE_MAX_DEPTH];
+    btree_indx_node *edge[BTREE_MAX_DEPTH]; /* the edge node of each depth */
+    uint32_t         ccut[BTREE_MAX_DEPTH]; /* cut count in the child node of the path */
+    btree_indx_node *node;
+    btree_elem_item *elem;
+    btree_elem_buf   ebuf;
+    uint32_t rem = count;
+    size_t stotal = 0;
+    int c, d, i;
+
+    assert(count > 0 && count < info->ccnt);
+    assert(info->root->ndepth < BTREE_MAX_DEPTH);
+
+    /* find the path to the new edge element */
+    for (node = info->root; node->ndepth > 0; node = BTREE_GET_NODE_ITEM(node, c)) {
+        edge[node->ndepth] = node;
+        if (smallest) {
+            for (c = 0; rem >= node->ecnt[c]; c++) {
+                rem -= node->ecnt[c];
+            }
+        } else {
+            for (c = node->used_count-1; rem >= node->ecnt[c]; c--) {
+                rem -= node->ecnt[c];
+            }
+        }
+        path[node->ndepth].node = node;
+        path[node->ndepth].indx = c;
+        ccut[node->ndepth] = rem;
+    }
+    path[0].node = node;
+    for (d = info->root->ndepth-1; d >= 0; d--) {
+        edge[d] = (smallest ? BTREE_GET_NODE_ITEM(edge[d+1], 0)
+                            : BTREE_GET_NODE_ITEM(edge[d+1], edge[d+1]->used_count-1));
+    }
+
+    /* detach the node chains outside of the path */
+    for (d = 0; d < info->root->ndepth; d++) {
+        node = path[d].node;
+        work->head[d] = NULL;
+        if (smallest) {
+            if (node->prev != NULL) {
+                work->head[d] = edge[d];
+                node->prev->next = NULL;
+                node->prev = NULL;
+            }
+        } else {
+            if (node->next != NULL) {
+                work->head[d] = node->next;
+                node->next->prev = NULL;
+                node->next = NULL;
+            }
+        }
+    }
+    for (; d < BTREE_MAX_DEPTH; d++) {
+        work->head[d] = NULL;
+    }
+
+    /* remove the rest elements from the leaf node of the path */
+    node = path[0].node;
+    assert(rem < node->used_count);
+    for (i = 0; i < rem; i++) {
+        elem = BTREE_GET_ELEM_ITEM(node, (smallest ? i : node->used_count-1-i), &ebuf);
+        stotal += do_btree_elem_space(engine, elem);
+        do_btree_elem_drop(engine, elem);
+    }
+    if (smallest) {
+        for (i = rem; i < node->used_count; i++) {
+            node->item[i-rem] = node->item[i];
+            node->ikey[i-rem] = node->ikey[i];
+        }
+    }
+    for (i = node->used_count-rem; i < node->used_count; i++) {
+        node->item[i] = NULL;
+    }
+    node->used_count -= rem;
+
+    /* leave only the child nodes on the path in the upper nodes */
+    for (d = 1; d <= info->root->ndepth; d++) {
+        node = path[d].node;
+        c = path[d].indx;
+        node->ecnt[c] -= ccut[d];
+        if (smallest && c > 0) {
+            for (i = c; i < node->used_count; i++) {
+                node->item[i-c] = node->item[i];
+                node->ikey[i-c] = node->ikey[i];
+                node->ecnt[i-c] = node->ecnt[i];
+            }
+            for (i = node->used_count-c; i < node->used_count; i++) {
+                node->item[i] = NULL;
+                node->ecnt[i] = 0;
+            }
+            node->used_count -= c;
+        }
+        if (!smallest && c < node->used_count-1) {
+            for (i = c+1; i < node->used_count; i++) {
+                node->item[i] = NULL;
+                node->ecnt[i] = 0;
+            }
+            node->used_count = c+1;
+        }
+    }
+    info->ccnt -= count;
+
+    if (info->stotal > 0) { /* apply memory space */
+        decrease_collection_space(engine, ITEM_TYPE_BTREE, (coll_meta_info *)info, stotal);
+    }
+    /* shrink the root node having only one child node */
+    node = info->root;
+    while (node->used_count == 1 && node->ndepth > 0) {
+        btree_indx_node *new_root = BTREE_GET_NODE_ITEM(node, 0);
+        do_btree_node_unlink(engine, info, node, NULL);
+        info->root = new_root;
+        node = new_root;
+    }
+    if (btree_position_debug) {
+        do_btree_consistency_check(info->root, info->ccnt, true);
+    }
+}
+
+/*
+ * Free the elements and the nodes cut off by do_btree_elem_cut().
+ * It frees about the given count of elements at a time, and returns true when done.
+ */
+static bool do_btree_trim_work_free(struct default_engine *engine, btree_trim_work *work,
+                                    const uint32_t count)
+{
+    btree_meta_info *info = (btree_meta_info *)item_get_meta(work->it);
+    btree_indx_node *node;
+    btree_elem_item *elem;
+    btree_elem_buf   ebuf;
+    uint32_t fcnt = 0;
+    size_t stotal = 0;
+    int d, i;
+
+    for (d = 0; d < BTREE_MAX_DEPTH; d++) {
+        while (work->head[d] != NULL && fcnt < count) {
+            node = work->head[d];
+            work->head[d] = node->next;
+            if (d == 0) {
+                for (i = 0; i < node->used_count; i++) {
+                    elem = BTREE_GET_ELEM_ITEM(node, i, &ebuf);
+                    stotal += do_btree_elem_space(engine, elem);
+                    do_btree_elem_drop(engine, elem);
+                }
+                fcnt += node->used_count;
+                stotal += slabs_space_size(engine, sizeof(btree_leaf_node));
+            } else {
+                fcnt += 1;
+                stotal += slabs_space_size(engine, sizeof(btree_indx_node));
+            }
+            do_btree_node_free(engine, node);
+        }
+        if (work->head[d] != NULL) break;
+    }
+    if (stotal > 0 && info->stotal > 0) { /* apply memory space */
+        /* The b+tree might have been unlinked from hash table while the work is pending.
+         * If then, its stotal is 0 and the space statistics need not be decreased.
+         */
+        decrease_collection_space(engine, ITEM_TYPE_BTREE, (coll_meta_info *)info, stotal);
+    }
+    return (d == BTREE_MAX_DEPTH);
+}
+
+/*
+ * Trim the given count of the smallest or largest elements.
+ * A small trim is done by deleting the elements in place.
+ * A large one cuts the elements off from the b+tree and leaves freeing them
+ * to the collection delete thread, so the caller isn't blocked by the count.
+ */
+static void do_btree_elem_trim(struct default_engine *engine, btree_meta_info *info,
+                               const uint32_t count, const bool smallest)
+{
+    if (count > BTREE_BULK_TRIM_THRESHOLD && count < info->ccnt && info->eindex == NULL) {
+        btree_trim_work *work = malloc(sizeof(btree_trim_work));
+        if (work != NULL) {
+            do_btree_elem_cut(engine, info, count, smallest, work);
+            work->it = (hash_item *)COLL_GET_HASH_ITEM(info);
+            ITEM_REFCOUNT_INCR(work->it); /* released when the work is done */
+            push_btree_trim_queue(work);
+            return;
+        }
+    }
+
+    bkey_range bkrange_space;
+    get_bkey_full_range(info->bktype, smallest, &bkrange_space);
+    (void)do_btree_elem_delete(engine, info,
+                               (smallest ? BKEY_RANGE_TYPE_ASC : BKEY_RANGE_TYPE_DSC),
+                               &bkrange_space, NULL, count, NULL, ELEM_DELETE_TRIM);
+}
+
 static ENGINE_ERROR_CODE do_btree_overflow_check(btree_meta_info *info, btree_elem_item *elem,
                                                  int *overflow_type)
 {
     /* info->ccnt >= 1 */
     btree_elem_item *min_bkey_elem = NULL;
     btree_elem_item *max_bkey_elem = NULL;
+    btree_elem_buf   min_buf, max_buf;
     int32_t real_mcnt = (info->mcnt == -1 ? max_btree_size : info->mcnt);
 
     /* step 1: overflow check on max bkey range */
     if (info->maxbkeyrange.len != BKEY_NULL) {
         bkey_t newbkeyrange;
 
-        min_bkey_elem = do_btree_get_first_elem(info->root);
-        max_bkey_elem = do_btree_get_last_elem(info->root);
+        min_bkey_elem = do_btree_get_first_elem(info->root, &min_buf);
+        max_bkey_elem = do_btree_get_last_elem(info->root, &max_buf);
 
         if (BKEY_ISLT(elem->data, elem->nbkey, min_bkey_elem->data, min_bkey_elem->nbkey))
         {
@@ -4146,7 +5489,7 @@ static ENGINE_ERROR_CODE do_btree_overflow_check(btree_meta_info *info, btree_el
         }
         if (info->ovflact == OVFL_SMALLEST_TRIM || info->ovflact == OVFL_SMALLEST_SILENT_TRIM) {
             if (min_bkey_elem == NULL)
-                min_bkey_elem = do_btree_get_first_elem(info->root);
+                min_bkey_elem = do_btree_get_first_elem(info->root, &min_buf);
             if (BKEY_ISLT(elem->data, elem->nbkey, min_bkey_elem->data, min_bkey_elem->nbkey)) {
                 if (info->ovflact == OVFL_SMALLEST_TRIM) {
                     /* It means the implicit trim. */
@@ -4156,7 +5499,7 @@ static ENGINE_ERROR_CODE do_btree_overflow_check(btree_meta_info *info, btree_el
             }
         } else { /* OVFL_LARGEST_TRIM || OVFL_LARGEST_SILENT_TRIM */
             if (max_bkey_elem == NULL)
-                max_bkey_elem = do_btree_get_last_elem(info->root);
+                max_bkey_elem = do_btree_get_last_elem(info->root, &max_buf);
             if (BKEY_ISGT(elem->data, elem->nbkey, max_bkey_elem->data, max_bkey_elem->nbkey)) {
                 if (info->ovflact == OVFL_LARGEST_TRIM) {
                     /* It means the implicit trim. */
@@ -4173,13 +5516,15 @@ static ENGINE_ERROR_CODE do_btree_overflow_check(btree_meta_info *info, btree_el
 
 static void do_btree_overflow_trim(struct default_engine *engine, btree_meta_info *info,
                                    btree_elem_item *elem, const int overflow_type,
-                                   btree_elem_item **trimmed_elems, uint32_t *trimmed_count)
+                                   btree_elem_item **trimmed_elems, uint32_t *trimmed_count,
+                                   const void *cookie)
 {
     assert(info->ovflact == OVFL_SMALLEST_TRIM || info->ovflact == OVFL_SMALLEST_SILENT_TRIM ||
            info->ovflact == OVFL_LARGEST_TRIM  || info->ovflact == OVFL_LARGEST_SILENT_TRIM);
 
     if (overflow_type == OVFL_TYPE_RANGE) {
         btree_elem_item *edge_elem;
+        btree_elem_buf   ebuf;
         uint32_t del_count;
         int      bkrtype;
         bkey_range bkrange_space;
@@ -4188,7 +5533,7 @@ static void do_btree_overflow_trim(struct default_engine *engine, btree_meta_inf
              * => min bkey ~ (new max bkey - maxbkeyrange - 1)
              */
             /* from bkey */
-            edge_elem = do_btree_get_first_elem(info->root); /* min bkey elem */
+            edge_elem = do_btree_get_first_elem(info->root, &ebuf); /* min bkey elem */
             bkrange_space.from_nbkey = edge_elem->nbkey;
             BKEY_COPY(edge_elem->data, edge_elem->nbkey, bkrange_space.from_bkey);
             /* to bkey */
@@ -4203,7 +5548,7 @@ static void do_btree_overflow_trim(struct default_engine *engine, btree_meta_inf
              * => max bkey - (max bkey - new min bkey - maxbkeyrange - 1) ~ max bkey
              */
             /* from bkey */
-            edge_elem = do_btree_get_last_elem(info->root);  /* max bkey elem */
+            edge_elem = do_btree_get_last_elem(info->root, &ebuf);  /* max bkey elem */
             bkrange_space.from_nbkey = info->maxbkeyrange.len;
             BKEY_DIFF(edge_elem->data, edge_elem->nbkey,
                       elem->data, elem->nbkey,
@@ -4220,10 +5565,11 @@ static void do_btree_overflow_trim(struct default_engine *engine, btree_meta_inf
             BKEY_COPY(edge_elem->data, edge_elem->nbkey, bkrange_space.to_bkey);
         }
         bkrtype = do_btree_bkey_range_type(&bkrange_space);
-        del_count = do_btree_elem_delete(engine, info, bkrtype, &bkrange_space, NULL, 0,
-                                         NULL, ELEM_DELETE_TRIM);
-        assert(del_count > 0);
-        assert(info->ccnt > 0);
+        del_count = do_btree_range_count(info, bkrtype, &bkrange_space);
+        assert(del_count > 0 && del_count < info->ccnt);
+        do_btree_elem_trim(engine, info, del_count,
+                           (info->ovflact == OVFL_SMALLEST_TRIM ||
+                            info->ovflact == OVFL_SMALLEST_SILENT_TRIM));
         if (info->ovflact == OVFL_SMALLEST_TRIM || info->ovflact == OVFL_LARGEST_TRIM)
             info->mflags &= ~COLL_META_FLAG_TRIMMED; // clear trimmed
     } else { /* overflow_type == OVFL_TYPE_COUNT */
@@ -4239,10 +5585,11 @@ static void do_btree_overflow_trim(struct default_engine *engine, btree_meta_inf
             delpath[0].indx = delpath[0].node->used_count - 1;
         }
         if (trimmed_elems != NULL) {
-            btree_elem_item *edge_elem = BTREE_GET_ELEM_ITEM(delpath[0].node, delpath[0].indx);
-            edge_elem->refcount++;
-            *trimmed_elems = edge_elem;
-            *trimmed_count = 1;
+            btree_elem_buf ebuf;
+            btree_elem_item *edge_elem = BTREE_GET_ELEM_ITEM(delpath[0].node, delpath[0].indx, &ebuf);
+            /* the trimmed element isn't returned if its copy cannot be allocated */
+            *trimmed_elems = do_btree_elem_take(engine, edge_elem, cookie);
+            *trimmed_count = (*trimmed_elems != NULL ? 1 : 0);
         }
         do_btree_elem_unlink(engine, info, delpath, ELEM_DELETE_TRIM);
         if (info->ovflact == OVFL_SMALLEST_TRIM || info->ovflact == OVFL_LARGEST_TRIM)
@@ -4254,16 +5601,27 @@ static ENGINE_ERROR_CODE do_btree_elem_link(struct default_engine *engine,
                                             btree_meta_info *info, btree_elem_item *elem,
                                             const bool replace_if_exist, bool *replaced,
                                             btree_elem_item **trimmed_elems, uint32_t *trimmed_count,
-                                            const void *cookie)
+                                            btree_elem_posi *hint, const void *cookie)
 {
-    btree_elem_posi path[BTREE_MAX_DEPTH];
+    /* hint: the path of the element inserted just before, if it's given.
+     * It is kept valid only if the element is inserted without trimming.
+     * The caller must invalidate it when the insertion fails.
+     */
+    btree_elem_posi lpath[BTREE_MAX_DEPTH];
+    btree_elem_posi *path = (hint != NULL ? hint : lpath);
     int i, ovfl_type = OVFL_TYPE_NONE;
-    ENGINE_ERROR_CODE res;
+    bool packed;
+    ENGINE_ERROR_CODE res = ENGINE_FAILED;
 
     if (replaced) *replaced = false;
 
     assert(info->root->ndepth < BTREE_MAX_DEPTH);
-    res = do_btree_find_insposi(info->root, elem->data, elem->nbkey, path);
+    if (hint != NULL && hint[0].node != NULL) {
+        res = do_btree_find_insposi_next(path, elem->data, elem->nbkey);
+    }
+    if (res == ENGINE_FAILED) {
+        res = do_btree_find_insposi(info->root, elem->data, elem->nbkey, path);
+    }
     if (res == ENGINE_SUCCESS) {
 #ifdef ENABLE_STICKY_ITEM
         /* sticky memory limit check */
@@ -4295,34 +5653,58 @@ static ENGINE_ERROR_CODE do_btree_elem_link(struct default_engine *engine,
                 info->bktype = BKEY_TYPE_BINARY;
         }
 
-        /* insert the element into the leaf page */
-        elem->status = BTREE_ITEM_STATUS_USED;
+        /* insert the element into the leaf page.
+         * A packed element stays unlinked and is freed when the caller releases it.
+         */
+        packed = do_btree_elem_packable(elem);
+        if (!packed) {
+            elem->status = BTREE_ITEM_STATUS_USED;
+        }
         if (path[0].indx < path[0].node->used_count) {
             for (i = (path[0].node->used_count-1); i >= path[0].indx; i--) {
                 path[0].node->item[i+1] = path[0].node->item[i];
+                path[0].node->ikey[i+1] = path[0].node->ikey[i];
             }
         }
-        path[0].node->item[path[0].indx] = elem;
+        path[0].node->item[path[0].indx] = (packed ? do_btree_elem_pack(elem) : (void *)elem);
+        path[0].node->ikey[path[0].indx] = BTREE_ELEM_IKEY(elem);
         path[0].node->used_count++;
         /* increment element count in upper nodes */
         for (i = 1; i <= info->root->ndepth; i++) {
             path[i].node->ecnt[path[i].indx]++;
         }
+        if (path[0].indx == 0) {
+            /* the element becomes the first one of the leaf node,
+             * so lower the lower bound(ikey) of the leaf node in upper nodes.
+             */
+            for (i = 1; i <= info->root->ndepth; i++) {
+                path[i].node->ikey[path[i].indx] = path[0].node->ikey[0];
+                if (path[i].indx > 0) break;
+            }
+        }
         info->ccnt++;
 
-        if (1) { /* apply memory space */
+        if (!packed) { /* apply memory space */
             size_t stotal = slabs_space_size(engine, do_btree_elem_ntotal(elem));
             increase_collection_space(engine, ITEM_TYPE_BTREE, (coll_meta_info *)info, stotal);
         }
+        if (info->eiflength > 0 && !packed) {
+            do_btree_eindex_attach(engine, info, elem, NULL, cookie);
+        }
 
         if (ovfl_type != OVFL_TYPE_NONE) {
-            do_btree_overflow_trim(engine, info, elem, ovfl_type, trimmed_elems, trimmed_count);
+            do_btree_overflow_trim(engine, info, elem, ovfl_type, trimmed_elems, trimmed_count, cookie);
+            if (hint != NULL) {
+                /* the tree might be restructured by trimming */
+                hint[0].node = NULL;
+            }
         }
     }
     else if (res == ENGINE_ELEM_EEXISTS) {
         if (replace_if_exist) {
 #ifdef ENABLE_STICKY_ITEM
-            btree_elem_item *find = BTREE_GET_ELEM_ITEM(path[0].node, path[0].indx);
+            btree_elem_buf ebuf;
+            btree_elem_item *find = BTREE_GET_ELEM_ITEM(path[0].node, path[0].indx, &ebuf);
             if ((info->mflags & COLL_META_FLAG_STICKY) != 0 &&
                 (find->neflag+find->nbytes) < (elem->neflag+elem->nbytes)) {
                 /* sticky memory limit check */
@@ -4370,6 +5752,166 @@ static bool do_btree_overlapped_with_trimmed_space(btree_meta_info *info,
     return overlapped;
 }
 
+/*
+ * Check if the eflag filter can be evaluated with the eflag index.
+ * Only the equality filters on the whole indexed field are supported.
+ */
+static bool do_btree_eindex_usable(btree_meta_info *info, const int bkrtype,
+                                   const eflag_filter *efilter)
+{
+    return (info->eindex != NULL && efilter != NULL && bkrtype != BKEY_RANGE_TYPE_SIN &&
+            efilter->nbitwval == 0 && efilter->compop == COMPARE_OP_EQ &&
+            efilter->fwhere == info->eifwhere && efilter->ncompval == info->eiflength);
+}
+
+/*
+ * Get the distinct value hash slots of the compare values.
+ * The returned value is the number of entries chained in the slots.
+ */
+static uint32_t do_btree_eindex_slots(btree_meta_info *info, const eflag_filter *efilter,
+                                      uint32_t *slots, int *nslot)
+{
+    btree_eindex_table *eindex = info->eindex;
+    uint32_t total = 0;
+    uint32_t vslot;
+    int i, j;
+
+    *nslot = 0;
+    for (i = 0; i < efilter->compvcnt; i++) {
+        vslot = do_btree_eindex_vslot(eindex, &efilter->compval[i*efilter->ncompval],
+                                      efilter->ncompval);
+        for (j = 0; j < *nslot; j++) {
+            if (slots[j] == vslot) break;
+        }
+        if (j == *nslot) {
+            slots[(*nslot)++] = vslot;
+            total += eindex->vcnt[vslot];
+        }
+    }
+    return total;
+}
+
+static inline bool do_btree_elem_in_range(btree_elem_item *elem, const int bkrtype,
+                                          const bkey_range *bkrange)
+{
+    if (bkrtype == BKEY_RANGE_TYPE_ASC) {
+        return (BKEY_COMP(elem->data, elem->nbkey, bkrange->from_bkey, bkrange->from_nbkey) >= 0 &&
+                BKEY_COMP(elem->data, elem->nbkey, bkrange->to_bkey, bkrange->to_nbkey) <= 0);
+    } else { /* BKEY_RANGE_TYPE_DSC */
+        return (BKEY_COMP(elem->data, elem->nbkey, bkrange->to_bkey, bkrange->to_nbkey) >= 0 &&
+                BKEY_COMP(elem->data, elem->nbkey, bkrange->from_bkey, bkrange->from_nbkey) <= 0);
+    }
+}
+
+static int do_btree_eindex_elem_comp(const void *e1, const void *e2)
+{
+    btree_elem_item *elem1 = *(btree_elem_item **)e1;
+    btree_elem_item *elem2 = *(btree_elem_item **)e2;
+    return BKEY_COMP(elem1->data, elem1->nbkey, elem2->data, elem2->nbkey);
+}
+
+/*
+ * Get the elements passing the eflag filter with the eflag index.
+ * It's used instead of the bkey range scan only if the index entries to visit
+ * are expected to be fewer than the elements to scan.
+ * Returns false if the bkey range scan should be done.
+ */
+static bool do_btree_eindex_elem_get(btree_meta_info *info,
+                                     const int bkrtype, const bkey_range *bkrange,
+                                     const eflag_filter *efilter, const btree_efilter *ef,
+                                     const uint32_t offset, const uint32_t count,
+                                     btree_elem_item **elem_array, uint32_t *elem_count,
+                                     uint32_t *access_count)
+{
+    btree_eindex_entry *entry;
+    btree_elem_item **found;
+    uint32_t slots[MAX_EFLAG_COMPARE_COUNT];
+    uint32_t total, scan_cost, nfound = 0;
+    uint32_t tot_access = 0;
+    uint32_t i, s, e;
+    int nslot;
+
+    if ((info->mflags & COLL_META_FLAG_TRIMMED) != 0) {
+        return false; /* the trimmed space is checked with the range scan */
+    }
+    total = do_btree_eindex_slots(info, efilter, slots, &nslot);
+    scan_cost = do_btree_range_count(info, bkrtype, bkrange);
+    if (count > 0 && total > 0) {
+        /* the scan stops after finding (offset+count) elements */
+        uint64_t estimate = (uint64_t)(offset+count) * info->ccnt / total;
+        if (estimate < scan_cost) scan_cost = (uint32_t)estimate;
+    }
+    if (total >= scan_cost) {
+        return false;
+    }
+
+    if (total > 0) {
+        found = (btree_elem_item **)malloc(total * sizeof(btree_elem_item *));
+        if (found == NULL) {
+            return false;
+        }
+        for (i = 0; i < (uint32_t)nslot; i++) {
+            for (entry = info->eindex->vtab[slots[i]]; entry != NULL; entry = entry->vnext) {
+                tot_access++;
+                if (do_btree_elem_filter(entry->elem, ef) &&
+                    do_btree_elem_in_range(entry->elem, bkrtype, bkrange)) {
+                    found[nfound++] = entry->elem;
+                }
+            }
+        }
+        qsort(found, nfound, sizeof(btree_elem_item *), do_btree_eindex_elem_comp);
+
+        /* fill the elements in the bkey range order */
+        e = (count > 0 && offset+count < nfound ? offset+count : nfound);
+        for (s = offset; s < e; s++) {
+            i = (bkrtype == BKEY_RANGE_TYPE_ASC ? s : nfound-1-s);
+            found[i]->refcount++;
+            elem_array[s-offset] = found[i];
+        }
+        *elem_count = (offset < e ? e - offset : 0);
+        free(found);
+    } else {
+        *elem_count = 0;
+    }
+    if (access_count)
+        *access_count = tot_access;
+    return true;
+}
+
+/*
+ * Count the elements passing the eflag filter with the eflag index.
+ * Returns false if the bkey range scan should be done.
+ */
+static bool do_btree_eindex_elem_count(btree_meta_info *info,
+                                       const int bkrtype, const bkey_range *bkrange,
+                                       const eflag_filter *efilter, const btree_efilter *ef,
+                                       uint32_t *elem_count, uint32_t *access_count)
+{
+    btree_eindex_entry *entry;
+    uint32_t slots[MAX_EFLAG_COMPARE_COUNT];
+    uint32_t nfound = 0;
+    uint32_t tot_access = 0;
+    int i, nslot;
+
+    if (do_btree_eindex_slots(info, efilter, slots, &nslot) >=
+        do_btree_range_count(info, bkrtype, bkrange)) {
+        return false;
+    }
+    for (i = 0; i < nslot; i++) {
+        for (entry = info->eindex->vtab[slots[i]]; entry != NULL; entry = entry->vnext) {
+            tot_access++;
+            if (do_btree_elem_filter(entry->elem, ef) &&
+                do_btree_elem_in_range(entry->elem, bkrtype, bkrange)) {
+                nfound++;
+            }
+        }
+    }
+    *elem_count = nfound;
+    if (access_count)
+        *access_count = tot_access;
+    return true;
+}
+
 static ENGINE_ERROR_CODE do_btree_elem_get(struct default_engine *engine, btree_meta_info *info,
                                            const int bkrtype, const bkey_range *bkrange, const eflag_filter *efilter,
                                            const uint32_t offset, const uint32_t count, const bool delete,
@@ -4378,8 +5920,13 @@ static ENGINE_ERROR_CODE do_btree_elem_get(struct default_engine *engine, btree_
 {
     btree_elem_posi  path[BTREE_MAX_DEPTH];
     btree_elem_item *elem;
+    btree_elem_item *taken;
+    btree_elem_buf   ebuf;
+    bool nomem = false; /* the copy of a packed element cannot be allocated */
     uint32_t tot_found = 0; /* total found count */
     uint32_t tot_access = 0; /* total access count */
+    btree_efilter    ef_buf; /* eflag filter compiled once per request */
+    const btree_efilter *ef = do_btree_efilter_compile(efilter, &ef_buf);
 
     *potentialbkeytrim = false;
 
@@ -4389,18 +5936,28 @@ static ENGINE_ERROR_CODE do_btree_elem_get(struct default_engine *engine, btree_
         return ENGINE_ELEM_ENOENT;
     }
 
+    if (!delete && do_btree_eindex_usable(info, bkrtype, efilter) &&
+        do_btree_eindex_elem_get(info, bkrtype, bkrange, efilter, ef, offset, count,
+                                 elem_array, &tot_found, access_count)) {
+        *elem_count = tot_found;
+        return (tot_found > 0 ? ENGINE_SUCCESS : ENGINE_ELEM_ENOENT);
+    }
+
     assert(info->root->ndepth < BTREE_MAX_DEPTH);
-    elem = do_btree_find_first(info->root, bkrtype, bkrange, path, delete);
+    elem = do_btree_find_first(info->root, bkrtype, bkrange, path, delete, &ebuf);
     if (elem != NULL) {
         if (bkrtype == BKEY_RANGE_TYPE_SIN) { /* single bkey */
             assert(path[0].bkeq == true);
             tot_access++;
             if (offset == 0) {
-                if (efilter == NULL || do_btree_elem_filter(elem, efilter)) {
-                    elem->refcount++;
-                    elem_array[tot_found++] = elem;
-                    if (delete) {
-                        do_btree_elem_unlink(engine, info, path, ELEM_DELETE_NORMAL);
+                if (ef == NULL || do_btree_elem_filter(elem, ef)) {
+                    if ((taken = do_btree_elem_take(engine, elem, NULL)) != NULL) {
+                        elem_array[tot_found++] = taken;
+                        if (delete) {
+                            do_btree_elem_unlink(engine, info, path, ELEM_DELETE_NORMAL);
+                        }
+                    } else {
+                        nomem = true;
                     }
                 }
             }
@@ -4434,15 +5991,20 @@ static ENGINE_ERROR_CODE do_btree_elem_get(struct default_engine *engine, btree_
             c_posi.bkeq = false;
             do {
                 tot_access++;
-                if (efilter == NULL || do_btree_elem_filter(elem, efilter)) {
+                if (ef == NULL || do_btree_elem_filter(elem, ef)) {
                     if (skip_cnt < offset) {
                         skip_cnt++;
                     } else {
-                        elem->refcount++;
-                        elem_array[tot_found+cur_found] = elem;
+                        if ((taken = do_btree_elem_take(engine, elem, NULL)) == NULL) {
+                            nomem = true; break;
+                        }
+                        elem_array[tot_found+cur_found] = taken;
                         if (delete) {
-                            stotal += slabs_space_size(engine, do_btree_elem_ntotal(elem));
-                            elem->status = BTREE_ITEM_STATUS_UNLINK;
+                            stotal += do_btree_elem_space(engine, elem);
+                            if (info->eindex != NULL) {
+                                do_btree_eindex_remove(engine, info, elem);
+                            }
+                            taken->status = BTREE_ITEM_STATUS_UNLINK;
                             c_posi.node->item[c_posi.indx] = NULL;
                         }
                         cur_found++;
@@ -4453,8 +6015,8 @@ static ENGINE_ERROR_CODE do_btree_elem_get(struct default_engine *engine, btree_
                 if (c_posi.bkeq == true) {
                     elem = NULL; break;
                 }
-                elem = (forward ? do_btree_find_next(&c_posi, bkrange)
-                                : do_btree_find_prev(&c_posi, bkrange));
+                elem = (forward ? do_btree_find_next(&c_posi, bkrange, &ebuf)
+                                : do_btree_find_prev(&c_posi, bkrange, &ebuf));
                 if (elem == NULL) break;
 
                 if (s_posi.node != c_posi.node) {
@@ -4503,7 +6065,7 @@ static ENGINE_ERROR_CODE do_btree_elem_get(struct default_engine *engine, btree_
             }
             if (tot_found > 0 && delete) { /* apply memory space */
                 info->ccnt -= tot_found;
-                assert(stotal > 0 && stotal <= info->stotal);
+                assert(stotal <= info->stotal); /* 0 if all were packed elements */
                 decrease_collection_space(engine, ITEM_TYPE_BTREE, (coll_meta_info *)info, stotal);
                 do_btree_node_merge(engine, info, path, forward, node_cnt);
             }
@@ -4518,6 +6080,14 @@ static ENGINE_ERROR_CODE do_btree_elem_get(struct default_engine *engine, btree_
     if (access_count)
         *access_count = tot_access;
 
+    if (nomem && (!delete || tot_found == 0)) {
+        /* The found elements are returned only if they've been deleted. */
+        while (tot_found > 0) {
+            do_btree_elem_release(engine, elem_array[--tot_found]);
+        }
+        *elem_count = 0;
+        return ENGINE_ENOMEM;
+    }
     *elem_count = tot_found;
     if (tot_found > 0) {
         return ENGINE_SUCCESS;
@@ -4532,8 +6102,11 @@ static uint32_t do_btree_elem_count(struct default_engine *engine, btree_meta_in
 {
     btree_elem_posi  posi;
     btree_elem_item *elem;
+    btree_elem_buf   ebuf;
     uint32_t tot_found = 0; /* total found count */
     uint32_t tot_access = 0; /* total access count */
+    btree_efilter    ef_buf; /* eflag filter compiled once per request */
+    const btree_efilter *ef = do_btree_efilter_compile(efilter, &ef_buf);
 
     if (info->root == NULL) {
         if (access_count)
@@ -4541,10 +6114,16 @@ static uint32_t do_btree_elem_count(struct default_engine *engine, btree_meta_in
         return 0;
     }
 
+    if (do_btree_eindex_usable(info, bkrtype, efilter) &&
+        do_btree_eindex_elem_count(info, bkrtype, bkrange, efilter, ef, &tot_found, access_count)) {
+        return tot_found;
+    }
+
 #ifdef BOP_COUNT_OPTIMIZE
     if (bkrtype != BKEY_RANGE_TYPE_SIN && efilter == NULL) {
-        btree_elem_item *min_bkey_elem = do_btree_get_first_elem(info->root);
-        btree_elem_item *max_bkey_elem = do_btree_get_last_elem(info->root);
+        btree_elem_buf min_buf, max_buf;
+        btree_elem_item *min_bkey_elem = do_btree_get_first_elem(info->root, &min_buf);
+        btree_elem_item *max_bkey_elem = do_btree_get_last_elem(info->root, &max_buf);
         int min_comp, max_comp;
         if (bkrtype == BKEY_RANGE_TYPE_ASC) {
             min_comp = BKEY_COMP(bkrange->from_bkey, bkrange->from_nbkey,
@@ -4563,26 +6142,26 @@ static uint32_t do_btree_elem_count(struct default_engine *engine, btree_meta_in
     }
 #endif
 
-    elem = do_btree_find_first(info->root, bkrtype, bkrange, &posi, false);
+    elem = do_btree_find_first(info->root, bkrtype, bkrange, &posi, false, &ebuf);
     if (elem != NULL) {
         if (bkrtype == BKEY_RANGE_TYPE_SIN) {
             assert(posi.bkeq == true);
             tot_access++;
-            if (efilter == NULL || do_btree_elem_filter(elem, efilter))
+            if (ef == NULL || do_btree_elem_filter(elem, ef))
                 tot_found++;
         } else { /* BKEY_RANGE_TYPE_ASC || BKEY_RANGE_TYPE_DSC */
             bool forward = (bkrtype == BKEY_RANGE_TYPE_ASC ? true : false);
             posi.bkeq = false;
             do {
                 tot_access++;
-                if (efilter == NULL || do_btree_elem_filter(elem, efilter))
+                if (ef == NULL || do_btree_elem_filter(elem, ef))
                     tot_found++;
 
                 if (posi.bkeq == true) {
                     elem = NULL; break;
                 }
-                elem = (forward ? do_btree_find_next(&posi, bkrange)
-                                : do_btree_find_prev(&posi, bkrange));
+                elem = (forward ? do_btree_find_next(&posi, bkrange, &ebuf)
+                                : do_btree_find_prev(&posi, bkrange, &ebuf));
             } while (elem != NULL);
         }
     }
@@ -4595,7 +6174,8 @@ static ENGINE_ERROR_CODE do_btree_elem_insert(struct default_engine *engine,
                                               hash_item *it, btree_elem_item *elem,
                                               const bool replace_if_exist, bool *replaced,
                                               btree_elem_item **trimmed_elems,
-                                              uint32_t *trimmed_count, const void *cookie)
+                                              uint32_t *trimmed_count,
+                                              btree_elem_posi *hint, const void *cookie)
 {
     btree_meta_info *info = (btree_meta_info *)item_get_meta(it);
     ENGINE_ERROR_CODE ret;
@@ -4604,35 +6184,153 @@ static ENGINE_ERROR_CODE do_btree_elem_insert(struct default_engine *engine,
     if (info->ccnt > 0 || info->maxbkeyrange.len != BKEY_NULL) {
         if ((info->bktype == BKEY_TYPE_UINT64 && elem->nbkey >  0) ||
             (info->bktype == BKEY_TYPE_BINARY && elem->nbkey == 0)) {
+            if (hint != NULL) hint[0].node = NULL;
             return ENGINE_EBADBKEY;
         }
     }
 
-    /* Both sticky memory limit check and overflow check
-     * are to be performed in the below do_btree_elem_link().
+    /* Both sticky memory limit check and overflow check
+     * are to be performed in the below do_btree_elem_link().
+     */
+
+    /* create the root node if it does not exist */
+    bool new_root_flag = false;
+    if (info->root == NULL) {
+        btree_indx_node *r_node = do_btree_node_alloc(engine, 0, cookie);
+        if (r_node == NULL) {
+            return ENGINE_ENOMEM;
+        }
+        do_btree_node_link(engine, info, r_node, NULL);
+        new_root_flag = true;
+    }
+
+    /* insert the element */
+    ret = do_btree_elem_link(engine, info, elem, replace_if_exist, replaced,
+                             trimmed_elems, trimmed_count, hint, cookie);
+    if (ret != ENGINE_SUCCESS) {
+        if (new_root_flag) {
+            do_btree_node_unlink(engine, info, info->root, NULL);
+        }
+        if (hint != NULL) hint[0].node = NULL;
+        return ret;
+    }
+
+    return ENGINE_SUCCESS;
+}
+
+/*
+ * Append the element after the last element of the b+tree without splitting nodes.
+ * The last leaf node is filled up to BTREE_BULK_FILL_COUNT and then a new leaf node
+ * is added, and the new nodes are added to the upper nodes on the rightmost path
+ * bottom-up as a bulk loading does, so the element counts are kept in one pass.
+ * path: the rightmost path kept across the appends. path[0].node is NULL at first.
+ * ENGINE_FAILED is returned if the element cannot be appended,
+ * and then it must be inserted by do_btree_elem_insert().
+ */
+static ENGINE_ERROR_CODE do_btree_elem_append(struct default_engine *engine,
+                                              btree_meta_info *info, btree_elem_item *elem,
+                                              btree_elem_posi *path, const void *cookie)
+{
+    btree_indx_node *new_node[BTREE_MAX_DEPTH];
+    btree_indx_node *node;
+    int32_t real_mcnt = (info->mcnt == -1 ? max_btree_size : info->mcnt);
+    int d, i;
+
+    /* Only the elements that never overflow are appended. */
+    if (info->ccnt == 0 || info->ccnt >= real_mcnt || info->maxbkeyrange.len != BKEY_NULL) {
+        return ENGINE_FAILED;
+    }
+#ifdef ENABLE_STICKY_ITEM
+    if ((info->mflags & COLL_META_FLAG_STICKY) != 0) {
+        return ENGINE_FAILED; /* the sticky memory limit is checked in do_btree_elem_link() */
+    }
+#endif
+    if ((info->bktype == BKEY_TYPE_UINT64 && elem->nbkey >  0) ||
+        (info->bktype == BKEY_TYPE_BINARY && elem->nbkey == 0)) {
+        return ENGINE_FAILED;
+    }
+    if (path[0].node == NULL) {
+        path[0].node = do_btree_get_last_leaf(info->root, path);
+        path[0].indx = path[0].node->used_count - 1;
+    }
+    btree_elem_buf ebuf;
+    btree_elem_item *last = BTREE_GET_ELEM_ITEM(path[0].node, path[0].node->used_count-1, &ebuf);
+    if (BKEY_ISLE(elem->data, elem->nbkey, last->data, last->nbkey)) {
+        return ENGINE_FAILED;
+    }
+
+    /* the lowest depth of the path having room for the element or the new node */
+    for (d = 0; d <= info->root->ndepth; d++) {
+        if (path[d].node->used_count < BTREE_BULK_FILL_COUNT) break;
+    }
+    bool new_root = (d > info->root->ndepth);
+    if (new_root && d >= BTREE_MAX_DEPTH) {
+        return ENGINE_FAILED;
+    }
+    /* allocate all the new nodes ahead: one for each full depth and the new root */
+    int new_count = d + (new_root ? 1 : 0);
+    for (i = 0; i < new_count; i++) {
+        new_node[i] = do_btree_node_alloc(engine, i, cookie);
+        if (new_node[i] == NULL) {
+            while (--i >= 0) {
+                do_btree_node_free(engine, new_node[i]);
+            }
+            return ENGINE_ENOMEM;
+        }
+    }
+
+    /* link the element and the new nodes bottom-up.
+     * A packed element stays unlinked and is freed when the caller releases it.
      */
-
-    /* create the root node if it does not exist */
-    bool new_root_flag = false;
-    if (info->root == NULL) {
-        btree_indx_node *r_node = do_btree_node_alloc(engine, 0, cookie);
-        if (r_node == NULL) {
-            return ENGINE_ENOMEM;
+    bool packed = do_btree_elem_packable(elem);
+    if (!packed) {
+        elem->status = BTREE_ITEM_STATUS_USED;
+    }
+    for (i = 0; i <= d; i++) {
+        if (i < d) {
+            /* the new node next to the full node of the path */
+            node = new_node[i];
+            node->prev = path[i].node;
+            path[i].node->next = node;
+        } else if (new_root) {
+            /* the new root node over the old one */
+            node = new_node[i];
+            node->item[0] = info->root;
+            node->ikey[0] = info->root->ikey[0];
+            node->ecnt[0] = info->ccnt;
+            node->used_count = 1;
+            info->root = node;
+        } else {
+            node = path[i].node;
         }
-        do_btree_node_link(engine, info, r_node, NULL);
-        new_root_flag = true;
+        if (i == 0) {
+            node->item[node->used_count] = (packed ? do_btree_elem_pack(elem) : (void *)elem);
+        } else {
+            node->item[node->used_count] = path[i-1].node;
+        }
+        node->ikey[node->used_count] = BTREE_ELEM_IKEY(elem);
+        if (i > 0) node->ecnt[node->used_count] = 1;
+        path[i].node = node;
+        path[i].indx = node->used_count;
+        node->used_count++;
+    }
+    /* increment element count in the upper nodes */
+    for (i = d+1; i <= info->root->ndepth; i++) {
+        path[i].node->ecnt[path[i].indx]++;
     }
+    info->ccnt++;
 
-    /* insert the element */
-    ret = do_btree_elem_link(engine, info, elem, replace_if_exist, replaced,
-                             trimmed_elems, trimmed_count, cookie);
-    if (ret != ENGINE_SUCCESS) {
-        if (new_root_flag) {
-            do_btree_node_unlink(engine, info, info->root, NULL);
+    if (1) { /* apply memory space */
+        size_t stotal = (packed ? 0 : slabs_space_size(engine, do_btree_elem_ntotal(elem)));
+        if (new_count > 0) {
+            stotal += slabs_space_size(engine, sizeof(btree_leaf_node));
+            stotal += (new_count-1) * slabs_space_size(engine, sizeof(btree_indx_node));
         }
-        return ret;
+        increase_collection_space(engine, ITEM_TYPE_BTREE, (coll_meta_info *)info, stotal);
+    }
+    if (info->eiflength > 0 && !packed) {
+        do_btree_eindex_attach(engine, info, elem, NULL, cookie);
     }
-
     return ENGINE_SUCCESS;
 }
 
@@ -4645,6 +6343,7 @@ static ENGINE_ERROR_CODE do_btree_elem_arithmetic(struct default_engine *engine,
 {
     ENGINE_ERROR_CODE ret;
     btree_elem_item *elem;
+    btree_elem_buf   ebuf;
     btree_elem_posi  posi;
     uint64_t value;
     char     nbuf[128];
@@ -4656,7 +6355,7 @@ static ENGINE_ERROR_CODE do_btree_elem_arithmetic(struct default_engine *engine,
         return ENGINE_ELEM_ENOENT;
     }
 
-    elem = do_btree_find_first(info->root, bkrtype, bkrange, &posi, false);
+    elem = do_btree_find_first(info->root, bkrtype, bkrange, &posi, false, &ebuf);
     if (elem == NULL) {
         if (create != true) return ENGINE_ELEM_ENOENT;
 
@@ -4680,7 +6379,7 @@ static ENGINE_ERROR_CODE do_btree_elem_arithmetic(struct default_engine *engine,
             memcpy(elem->data + real_nbkey + eflagp->len, nbuf, nlen);
         }
 
-        ret = do_btree_elem_link(engine, info, elem, false, NULL, NULL, NULL, cookie);
+        ret = do_btree_elem_link(engine, info, elem, false, NULL, NULL, NULL, NULL, cookie);
         if (ret != ENGINE_SUCCESS) {
             assert(ret != ENGINE_ELEM_EEXISTS);
             /* ENGINE_ENOMEM || ENGINE_BKEYOOR || ENGINE_OVERFLOW */
@@ -4706,7 +6405,7 @@ static ENGINE_ERROR_CODE do_btree_elem_arithmetic(struct default_engine *engine,
             return ENGINE_EINVAL;
         }
 
-        if (elem->refcount == 0 && elem->nbytes == nlen) {
+        if (elem->refcount == 0 && !BTREE_ELEM_IS_DECODED(elem) && elem->nbytes == nlen) {
             memcpy(elem->data + real_nbkey + elem->neflag, nbuf, elem->nbytes);
         } else {
 #ifdef ENABLE_STICKY_ITEM
@@ -4753,11 +6452,12 @@ static int do_btree_posi_find(btree_meta_info *info,
 {
     btree_elem_posi  path[BTREE_MAX_DEPTH];
     btree_elem_item *elem;
+    btree_elem_buf   ebuf;
     int bpos; /* btree position */
 
     if (info->root == NULL) return -1; /* not found */
 
-    elem = do_btree_find_first(info->root, bkrtype, bkrange, path, true);
+    elem = do_btree_find_first(info->root, bkrtype, bkrange, path, true, &ebuf);
     if (elem != NULL) {
         assert(path[0].bkeq == true);
         bpos = do_btree_posi_from_path(info, path, order);
@@ -4768,19 +6468,210 @@ static int do_btree_posi_find(btree_meta_info *info,
     return bpos;
 }
 
-static int do_btree_elem_batch_get(btree_elem_posi posi, const int count,
+/*
+ * Count the elements of the bkey range without visiting them.
+ * The positions of the first and the last elements are summed up
+ * from the ecnt of the index nodes on their paths.
+ */
+static uint32_t do_btree_range_count(btree_meta_info *info,
+                                     const int bkrtype, const bkey_range *bkrange)
+{
+    btree_elem_posi  path[BTREE_MAX_DEPTH];
+    btree_elem_item *elem;
+    btree_elem_buf   ebuf;
+    bkey_range       rev_bkrange;
+    int fpos, lpos;
+
+    if (info->root == NULL) return 0;
+
+    elem = do_btree_find_first(info->root, bkrtype, bkrange, path, true, &ebuf);
+    if (elem == NULL) return 0;
+    if (bkrtype == BKEY_RANGE_TYPE_SIN) return 1;
+    fpos = do_btree_posi_from_path(info, path, BTREE_ORDER_ASC);
+
+    /* find the last element with the reversed bkey range */
+    memcpy(rev_bkrange.from_bkey, bkrange->to_bkey, BTREE_REAL_NBKEY(bkrange->to_nbkey));
+    memcpy(rev_bkrange.to_bkey, bkrange->from_bkey, BTREE_REAL_NBKEY(bkrange->from_nbkey));
+    rev_bkrange.from_nbkey = bkrange->to_nbkey;
+    rev_bkrange.to_nbkey   = bkrange->from_nbkey;
+    elem = do_btree_find_first(info->root, (bkrtype == BKEY_RANGE_TYPE_ASC ? BKEY_RANGE_TYPE_DSC
+                                                                           : BKEY_RANGE_TYPE_ASC),
+                               &rev_bkrange, path, true, &ebuf);
+    assert(elem != NULL);
+    lpos = do_btree_posi_from_path(info, path, BTREE_ORDER_ASC);
+
+    return (uint32_t)(fpos <= lpos ? lpos - fpos : fpos - lpos) + 1;
+}
+
+/*
+ * Get the aggregate group of the given group field from the group array
+ * sorted by group field. If not found, a new group is inserted in order.
+ */
+static bop_aggr_group *do_btree_aggr_group_get(bop_aggr_result *result,
+                                               const unsigned char *gfield, const int glength)
+{
+    bop_aggr_group *group;
+    int mid, left, right, comp;
+
+    left  = 0;
+    right = (int)result->group_count - 1;
+    while (left <= right) {
+        mid  = (left + right) / 2;
+        comp = memcmp(gfield, result->groups[mid].gfield, glength);
+        if (comp == 0) return &result->groups[mid];
+        if (comp <  0) right = mid-1;
+        else           left  = mid+1;
+    }
+    if (result->group_count >= result->group_arrsz) {
+        return NULL; /* too many groups */
+    }
+    if (left < (int)result->group_count) {
+        memmove(&result->groups[left+1], &result->groups[left],
+                (result->group_count - left) * sizeof(bop_aggr_group));
+    }
+    group = &result->groups[left];
+    memcpy(group->gfield, gfield, glength);
+    group->count = 0;
+    group->sum = group->min = group->max = 0;
+    result->group_count++;
+    return group;
+}
+
+static ENGINE_ERROR_CODE do_btree_aggr_elem(btree_elem_item *elem, const bop_aggr_spec *spec,
+                                            bop_aggr_result *result)
+{
+    bop_aggr_group *group;
+    unsigned char  *eflag = elem->data + BTREE_REAL_NBKEY(elem->nbkey);
+    int64_t         value = 0;
+
+    /* the elements without the group field or the operand are not aggregated */
+    if (spec->glength > 0 && elem->neflag < (spec->gwhere + spec->glength)) {
+        return ENGINE_SUCCESS;
+    }
+    if (spec->operand == BOP_AGGR_OPERAND_VALUE) {
+        if (elem->nbytes <= 2 || !safe_strtoll((const char*)eflag + elem->neflag, &value)) {
+            return ENGINE_SUCCESS; /* not an integer value */
+        }
+    } else if (spec->operand == BOP_AGGR_OPERAND_EFLAG) {
+        uint64_t uvalue = 0;
+        int i;
+        if (elem->neflag < (spec->fwhere + spec->flength)) {
+            return ENGINE_SUCCESS;
+        }
+        for (i = 0; i < spec->flength; i++) {
+            uvalue = (uvalue << 8) | eflag[spec->fwhere + i];
+        }
+        if (uvalue > (uint64_t)INT64_MAX) {
+            return ENGINE_SUCCESS;
+        }
+        value = (int64_t)uvalue;
+    }
+
+    group = do_btree_aggr_group_get(result, eflag + spec->gwhere, spec->glength);
+    if (group == NULL) {
+        return ENGINE_E2BIG;
+    }
+    if (group->count == 0) {
+        group->min = group->max = value;
+    } else {
+        if ((value > 0 && group->sum > INT64_MAX - value) ||
+            (value < 0 && group->sum < INT64_MIN - value)) {
+            return ENGINE_EOVERFLOW;
+        }
+        if (group->min > value) group->min = value;
+        if (group->max < value) group->max = value;
+    }
+    group->sum += value;
+    group->count++;
+    return ENGINE_SUCCESS;
+}
+
+static ENGINE_ERROR_CODE do_btree_elem_aggregate(btree_meta_info *info,
+                                                 const int bkrtype, const bkey_range *bkrange,
+                                                 const eflag_filter *efilter,
+                                                 const bop_aggr_spec *spec,
+                                                 bop_aggr_result *result)
+{
+    btree_elem_posi  posi;
+    btree_elem_item *elem;
+    btree_elem_buf   ebuf;
+    btree_efilter    ef_buf; /* eflag filter compiled once per request */
+    const btree_efilter *ef = do_btree_efilter_compile(efilter, &ef_buf);
+    ENGINE_ERROR_CODE ret = ENGINE_SUCCESS;
+
+    assert(result->group_arrsz > 0);
+    result->group_count = 0;
+
+    if (info->root == NULL) {
+        return ENGINE_ELEM_ENOENT;
+    }
+
+    if (spec->operand == BOP_AGGR_OPERAND_NONE && spec->glength == 0 && ef == NULL) {
+        /* unfiltered count: answered from the index nodes */
+        uint32_t count = do_btree_range_count(info, bkrtype, bkrange);
+        if (count == 0) {
+            return ENGINE_ELEM_ENOENT;
+        }
+        result->groups[0].count = count;
+        result->groups[0].sum = result->groups[0].min = result->groups[0].max = 0;
+        result->group_count = 1;
+        return ENGINE_SUCCESS;
+    }
+
+    elem = do_btree_find_first(info->root, bkrtype, bkrange, &posi, false, &ebuf);
+    if (elem != NULL) {
+        if (bkrtype == BKEY_RANGE_TYPE_SIN) {
+            assert(posi.bkeq == true);
+            if (ef == NULL || do_btree_elem_filter(elem, ef))
+                ret = do_btree_aggr_elem(elem, spec, result);
+        } else { /* BKEY_RANGE_TYPE_ASC || BKEY_RANGE_TYPE_DSC */
+            bool forward = (bkrtype == BKEY_RANGE_TYPE_ASC ? true : false);
+            posi.bkeq = false;
+            do {
+                if (ef == NULL || do_btree_elem_filter(elem, ef)) {
+                    ret = do_btree_aggr_elem(elem, spec, result);
+                    if (ret != ENGINE_SUCCESS) break;
+                }
+                if (posi.bkeq == true) {
+                    elem = NULL; break;
+                }
+                elem = (forward ? do_btree_find_next(&posi, bkrange, &ebuf)
+                                : do_btree_find_prev(&posi, bkrange, &ebuf));
+            } while (elem != NULL);
+        }
+    }
+    if (ret == ENGINE_SUCCESS && result->group_count == 0) {
+        ret = ENGINE_ELEM_ENOENT;
+    }
+    return ret;
+}
+
+/*
+ * Get the elements next to the given position.
+ * -1 is returned if the copy of a packed element cannot be allocated,
+ * and then the elements taken so far are released.
+ */
+static int do_btree_elem_batch_get(struct default_engine *engine,
+                                   btree_elem_posi posi, const int count,
                                    const bool forward, const bool reverse,
                                    btree_elem_item **elem_array)
 {
     btree_elem_item *elem;
+    btree_elem_buf ebuf;
     int nfound = 0;
     while (nfound < count) {
         if (forward) do_btree_incr_posi(&posi);
         else         do_btree_decr_posi(&posi);
         if (posi.node == NULL) break;
 
-        elem = BTREE_GET_ELEM_ITEM(posi.node, posi.indx);
-        elem->refcount++;
+        elem = do_btree_elem_take(engine, BTREE_GET_ELEM_ITEM(posi.node, posi.indx, &ebuf), NULL);
+        if (elem == NULL) {
+            while (nfound > 0) {
+                nfound -= 1;
+                do_btree_elem_release(engine, elem_array[reverse ? count-nfound-1 : nfound]);
+            }
+            return -1;
+        }
         if (reverse) elem_array[count-nfound-1] = elem;
         else         elem_array[nfound] = elem;
         nfound += 1;
@@ -4788,55 +6679,68 @@ static int do_btree_elem_batch_get(btree_elem_posi posi, const int count,
     return nfound;
 }
 
-static int do_btree_posi_find_with_get(btree_meta_info *info,
-                                       const int bkrtype, const bkey_range *bkrange,
-                                       ENGINE_BTREE_ORDER order, const int count,
-                                       btree_elem_item **elem_array,
-                                       uint32_t *elem_count, uint32_t *elem_index)
+static ENGINE_ERROR_CODE do_btree_posi_find_with_get(struct default_engine *engine,
+                                                     btree_meta_info *info,
+                                                     const int bkrtype, const bkey_range *bkrange,
+                                                     ENGINE_BTREE_ORDER order, const int count,
+                                                     btree_elem_item **elem_array,
+                                                     uint32_t *elem_count, uint32_t *elem_index,
+                                                     int *position)
 {
     btree_elem_posi  path[BTREE_MAX_DEPTH];
     btree_elem_item *elem;
-    int bpos, ecnt, eidx;
+    btree_elem_buf   ebuf;
+    int bpos, ecnt, eidx, nprev, nnext;
 
-    if (info->root == NULL) return -1; /* not found */
+    if (info->root == NULL) return ENGINE_ELEM_ENOENT;
 
-    elem = do_btree_find_first(info->root, bkrtype, bkrange, path, true);
-    if (elem != NULL) {
-        assert(path[0].bkeq == true);
-        bpos = do_btree_posi_from_path(info, path, order);
-        assert(bpos >= 0);
+    elem = do_btree_find_first(info->root, bkrtype, bkrange, path, true, &ebuf);
+    if (elem == NULL) {
+        return ENGINE_ELEM_ENOENT;
+    }
+    assert(path[0].bkeq == true);
+    bpos = do_btree_posi_from_path(info, path, order);
+    assert(bpos >= 0);
 
-        ecnt = 1;                             /* elem count */
-        eidx = (bpos < count) ? bpos : count; /* elem index in elem array */
-        elem->refcount++;
-        elem_array[eidx] = elem;
+    eidx = (bpos < count) ? bpos : count; /* elem index in elem array */
+    elem = do_btree_elem_take(engine, elem, NULL);
+    if (elem == NULL) {
+        return ENGINE_ENOMEM;
+    }
+    elem_array[eidx] = elem;
 
-        if (order == BTREE_ORDER_ASC) {
-            ecnt += do_btree_elem_batch_get(path[0], eidx,  false, true,  &elem_array[0]);
-            assert((ecnt-1) == eidx);
-            ecnt += do_btree_elem_batch_get(path[0], count, true,  false, &elem_array[eidx+1]);
-        } else {
-            ecnt += do_btree_elem_batch_get(path[0], eidx,  true,  true,  &elem_array[0]);
-            assert((ecnt-1) == eidx);
-            ecnt += do_btree_elem_batch_get(path[0], count, false, false, &elem_array[eidx+1]);
+    bool forward = (order == BTREE_ORDER_ASC ? false : true);
+    nprev = do_btree_elem_batch_get(engine, path[0], eidx, forward, true, &elem_array[0]);
+    if (nprev < 0) {
+        do_btree_elem_release(engine, elem);
+        return ENGINE_ENOMEM;
+    }
+    assert(nprev == eidx);
+    nnext = do_btree_elem_batch_get(engine, path[0], count, !forward, false, &elem_array[eidx+1]);
+    if (nnext < 0) {
+        for (ecnt = 0; ecnt <= eidx; ecnt++) {
+            do_btree_elem_release(engine, elem_array[ecnt]);
         }
-        *elem_count = (uint32_t)ecnt;
-        *elem_index = (uint32_t)eidx;
-    } else {
-        bpos = -1; /* not found */
+        return ENGINE_ENOMEM;
     }
-    return bpos; /* btree_position */
+    ecnt = 1 + nprev + nnext;
+
+    *elem_count = (uint32_t)ecnt;
+    *elem_index = (uint32_t)eidx;
+    *position = bpos;
+    return ENGINE_SUCCESS;
 }
 
-static ENGINE_ERROR_CODE do_btree_elem_get_by_posi(btree_meta_info *info,
+static ENGINE_ERROR_CODE do_btree_elem_get_by_posi(struct default_engine *engine,
+                                                   btree_meta_info *info,
                                                    const int index, const uint32_t count, const bool forward,
                                                    btree_elem_item **elem_array, uint32_t *elem_count)
 {
     btree_elem_posi  posi;
     btree_indx_node *node;
     btree_elem_item *elem;
-    int i, tot_ecnt;
-    uint32_t nfound; /* found count */
+    btree_elem_buf   ebuf;
+    int i, tot_ecnt, nnext;
 
     if (info->root == NULL) return ENGINE_ELEM_ENOENT;
 
@@ -4855,18 +6759,18 @@ static ENGINE_ERROR_CODE do_btree_elem_get_by_posi(btree_meta_info *info,
     posi.node = node;
     posi.indx = index-tot_ecnt;
 
-    elem = BTREE_GET_ELEM_ITEM(posi.node, posi.indx);
-    elem->refcount++;
+    elem = do_btree_elem_take(engine, BTREE_GET_ELEM_ITEM(posi.node, posi.indx, &ebuf), NULL);
+    if (elem == NULL) {
+        return ENGINE_ENOMEM;
+    }
     elem_array[0] = elem;
-    nfound = 1;
-    nfound += do_btree_elem_batch_get(posi, count-1, forward, false, &elem_array[nfound]);
-
-    *elem_count = nfound;
-    if (*elem_count > 0) {
-        return ENGINE_SUCCESS;
-    } else {
-        return ENGINE_ELEM_ENOENT;
+    nnext = do_btree_elem_batch_get(engine, posi, count-1, forward, false, &elem_array[1]);
+    if (nnext < 0) {
+        do_btree_elem_release(engine, elem);
+        return ENGINE_ENOMEM;
     }
+    *elem_count = 1 + nnext;
+    return ENGINE_SUCCESS;
 }
 
 #ifdef SUPPORT_BOP_SMGET
@@ -4887,6 +6791,143 @@ static inline int do_btree_comp_hkey(hash_item *it1, hash_item *it2)
     return cmp_res;
 }
 
+/*
+ * SMGET SCAN MERGE
+ * The scans of smget are merged with a binary heap of scan indexes.
+ * The 1st phase keeps the best req_count scans having the worst scan on the top,
+ * and the 2nd phase emits the elements taking the best scan from the top.
+ * The scans are compared by (bkey, hkey) with the inline bkeys of the leaf nodes.
+ * The bkey hash of the sorted scans finds the scans having the same bkey,
+ * which is used to check the same key given twice and to make unique bkeys.
+ */
+#define BTREE_SCAN_ELEM(scan, buf) BTREE_GET_ELEM_ITEM((scan)->posi.node, (scan)->posi.indx, (buf))
+#define BTREE_SCAN_IKEY(scan) ((scan)->posi.node->ikey[(scan)->posi.indx])
+
+static inline int do_btree_smget_scan_comp(btree_scan_info *scan1, btree_scan_info *scan2)
+{
+    uint64_t ikey1 = BTREE_SCAN_IKEY(scan1);
+    uint64_t ikey2 = BTREE_SCAN_IKEY(scan2);
+    btree_elem_item *elem1, *elem2;
+    btree_elem_buf ebuf1, ebuf2;
+    int cmp_res;
+
+    if (ikey1 != ikey2) {
+        return (ikey1 < ikey2 ? -1 : 1);
+    }
+    elem1 = BTREE_SCAN_ELEM(scan1, &ebuf1);
+    elem2 = BTREE_SCAN_ELEM(scan2, &ebuf2);
+    cmp_res = BKEY_COMP(elem1->data, elem1->nbkey, elem2->data, elem2->nbkey);
+    if (cmp_res == 0) {
+        cmp_res = do_btree_comp_hkey(scan1->it, scan2->it);
+    }
+    return cmp_res;
+}
+
+/* order: 1(the smallest scan on the top) or -1(the largest scan on the top) */
+static void do_btree_smget_heap_down(btree_scan_info *scan_buf, uint16_t *heap,
+                                     const int count, int pos, const int order)
+{
+    uint16_t sidx = heap[pos];
+    int child;
+
+    while ((child = 2*pos + 1) < count) {
+        if (child+1 < count &&
+            order * do_btree_smget_scan_comp(&scan_buf[heap[child+1]], &scan_buf[heap[child]]) < 0) {
+            child++;
+        }
+        if (order * do_btree_smget_scan_comp(&scan_buf[sidx], &scan_buf[heap[child]]) < 0) {
+            break;
+        }
+        heap[pos] = heap[child];
+        pos = child;
+    }
+    heap[pos] = sidx;
+}
+
+static void do_btree_smget_heap_up(btree_scan_info *scan_buf, uint16_t *heap,
+                                   int pos, const int order)
+{
+    uint16_t sidx = heap[pos];
+    int parent;
+
+    while (pos > 0) {
+        parent = (pos - 1) / 2;
+        if (order * do_btree_smget_scan_comp(&scan_buf[heap[parent]], &scan_buf[sidx]) < 0) {
+            break;
+        }
+        heap[pos] = heap[parent];
+        pos = parent;
+    }
+    heap[pos] = sidx;
+}
+
+static void do_btree_smget_heap_build(btree_scan_info *scan_buf, uint16_t *heap,
+                                      const int count, const int order)
+{
+    for (int pos = count/2 - 1; pos >= 0; pos--) {
+        do_btree_smget_heap_down(scan_buf, heap, count, pos, order);
+    }
+}
+
+/* The hash chain of a sorted scan is linked with its next field. */
+static inline int do_btree_smget_hash_slot(btree_scan_info *scan, const int hmask)
+{
+    return (int)((BTREE_SCAN_IKEY(scan) * 0x9E3779B97F4A7C15ULL) >> 32) & hmask;
+}
+
+static int do_btree_smget_hash_size(const uint32_t req_count)
+{
+    int hsize = 1;
+    while (hsize < req_count) hsize <<= 1;
+    return hsize;
+}
+
+static void do_btree_smget_hash_link(btree_scan_info *scan_buf, int32_t *htable,
+                                     const int hmask, const int sidx)
+{
+    int slot = do_btree_smget_hash_slot(&scan_buf[sidx], hmask);
+    scan_buf[sidx].next = htable[slot];
+    htable[slot] = sidx;
+}
+
+static void do_btree_smget_hash_unlink(btree_scan_info *scan_buf, int32_t *htable,
+                                       const int hmask, const int sidx)
+{
+    int32_t *pidx = &htable[do_btree_smget_hash_slot(&scan_buf[sidx], hmask)];
+    while (*pidx != sidx) {
+        assert(*pidx != -1);
+        pidx = &scan_buf[*pidx].next;
+    }
+    *pidx = scan_buf[sidx].next;
+}
+
+/* find a sorted scan having the same bkey with the given scan */
+static ENGINE_ERROR_CODE
+do_btree_smget_hash_find(btree_scan_info *scan_buf, int32_t *htable,
+                         const int hmask, const int sidx, int *same_idx)
+{
+    btree_scan_info *scan = &scan_buf[sidx];
+    btree_elem_buf ebuf, cbuf;
+    btree_elem_item *elem = BTREE_SCAN_ELEM(scan, &ebuf);
+    btree_elem_item *comp;
+    int32_t cidx = htable[do_btree_smget_hash_slot(scan, hmask)];
+
+    *same_idx = -1;
+    while (cidx != -1) {
+        if (BTREE_SCAN_IKEY(&scan_buf[cidx]) == BTREE_SCAN_IKEY(scan)) {
+            comp = BTREE_SCAN_ELEM(&scan_buf[cidx], &cbuf);
+            if (BKEY_COMP(elem->data, elem->nbkey, comp->data, comp->nbkey) == 0) {
+                if (do_btree_comp_hkey(scan->it, scan_buf[cidx].it) == 0) {
+                    return ENGINE_EBADVALUE; /* the same key is given twice */
+                }
+                if (*same_idx == -1) *same_idx = cidx;
+            }
+        }
+        cidx = scan_buf[cidx].next;
+    }
+    return ENGINE_SUCCESS;
+}
+
 /*** NOT USED CODE ***
 static inline int do_comp_key_string(const char *key1, const int len1,
                                      const char *key2, const int len2)
@@ -4907,15 +6948,16 @@ static inline int do_comp_key_string(const char *key1, const int len1,
 **********************/
 
 static btree_elem_item *do_btree_scan_next(btree_elem_posi *posi,
-                             const int bkrtype, const bkey_range *bkrange)
+                             const int bkrtype, const bkey_range *bkrange,
+                             btree_elem_buf *buf)
 {
     if (posi->bkeq == true)
         return NULL;
 
     if (bkrtype != BKEY_RANGE_TYPE_DSC) // ascending
-        return do_btree_find_next(posi, bkrange);
+        return do_btree_find_next(posi, bkrange, buf);
     else // descending
-        return do_btree_find_prev(posi, bkrange);
+        return do_btree_find_prev(posi, bkrange, buf);
 }
 
 static void do_btree_smget_add_miss(smget_result_t *smres,
@@ -4927,15 +6969,35 @@ static void do_btree_smget_add_miss(smget_result_t *smres,
     smres->miss_count++;
 }
 
-static void do_btree_smget_add_trim(smget_result_t *smres,
-                                    uint16_t kidx, btree_elem_item *elem)
+static ENGINE_ERROR_CODE do_btree_smget_add_trim(struct default_engine *engine,
+                                                 smget_result_t *smres,
+                                                 uint16_t kidx, btree_elem_item *elem)
 {
     /* trim_elems & trim_kinfo: backward array */
     assert(smres->trim_count < smres->keys_arrsz);
+    /* the element might be decoded from a packed slot */
+    elem = do_btree_elem_take(engine, elem, NULL);
+    if (elem == NULL) {
+        return ENGINE_ENOMEM;
+    }
     smres->trim_elems[smres->keys_arrsz-1-smres->trim_count] = elem;
     smres->trim_kinfo[smres->keys_arrsz-1-smres->trim_count].kidx = kidx;
     //smres->trim_kinfo[smres->keys_arrsz-1-smres->trim_count].code = 0;
     smres->trim_count++;
+    return ENGINE_SUCCESS;
+}
+
+static void do_btree_smget_release(struct default_engine *engine, smget_result_t *smres)
+{
+    int i;
+    for (i = 0; i < smres->elem_count; i++) {
+        do_btree_elem_release(engine, smres->elem_array[i]);
+    }
+    for (i = 0; i < smres->trim_count; i++) { /* backward array */
+        do_btree_elem_release(engine, smres->trim_elems[smres->keys_arrsz-1-i]);
+    }
+    smres->elem_count = 0;
+    smres->trim_count = 0;
 }
 
 #if 0 // JHPARK_SMGET_OFFSET_HANDLING
@@ -4969,7 +7031,7 @@ static bool do_btree_smget_check_trim(smget_result_t *smres)
 }
 #endif
 
-static void do_btree_smget_adjust_trim(smget_result_t *smres)
+static void do_btree_smget_adjust_trim(struct default_engine *engine, smget_result_t *smres)
 {
     eitem       **new_trim_elems = &smres->elem_array[smres->elem_count];
     smget_emis_t *new_trim_kinfo = &smres->miss_kinfo[smres->miss_count];
@@ -4999,6 +7061,7 @@ static void do_btree_smget_adjust_trim(smget_result_t *smres)
                             tail_elem->data, tail_elem->nbkey);
             if ((smres->ascending == true && res >= 0) ||
                 (smres->ascending != true && res <= 0)) {
+                do_btree_elem_release(engine, trim_elem);
                 continue; /* invalid trim */
             }
         }
@@ -5032,7 +7095,6 @@ static void do_btree_smget_adjust_trim(smget_result_t *smres)
             }
             pos = left;
         }
-        trim_elem->refcount++;
         new_trim_elems[pos] = trim_elem;
         new_trim_kinfo[pos].kidx = trim_kidx;
         new_trim_count++;
@@ -5054,17 +7116,26 @@ static ENGINE_ERROR_CODE do_btree_smget_scan_sort_old(struct default_engine *eng
     ENGINE_ERROR_CODE ret = ENGINE_SUCCESS;
     hash_item *it;
     btree_meta_info *info;
-    btree_elem_item *elem, *comp;
+    btree_elem_item *elem;
+    btree_elem_buf   ebuf;
     btree_elem_posi posi;
     uint16_t comp_idx;
     uint16_t curr_idx = 0;
     uint16_t free_idx = req_count;
     int sort_count = 0; /* sorted scan count */
+    int same_idx;
     int k, i, cmp_res;
-    int mid, left, right;
     bool ascending = (bkrtype != BKEY_RANGE_TYPE_DSC ? true : false);
+    int order = (ascending ? -1 : 1); /* the worst scan on the top */
     bool is_first;
+    btree_efilter    ef_buf; /* eflag filter compiled once per request */
+    const btree_efilter *ef = do_btree_efilter_compile(efilter, &ef_buf);
+    const int hash_size = do_btree_smget_hash_size(req_count);
+    int32_t   hash_tab[hash_size]; /* bkey hash of the sorted scans */
 
+    for (i = 0; i < hash_size; i++) {
+        hash_tab[i] = -1;
+    }
     *missed_key_count = 0;
 
     for (k = 0; k < key_count; k++) {
@@ -5094,7 +7165,7 @@ static ENGINE_ERROR_CODE do_btree_smget_scan_sort_old(struct default_engine *eng
         }
         assert(info->root != NULL);
 
-        elem = do_btree_find_first(info->root, bkrtype, bkrange, &posi, false);
+        elem = do_btree_find_first(info->root, bkrtype, bkrange, &posi, false, &ebuf);
         if (elem == NULL) { /* No elements within the bkey range */
             if ((info->mflags & COLL_META_FLAG_TRIMMED) != 0) {
                 /* Some elements weren't cached because of overflow trim */
@@ -5122,7 +7193,7 @@ static ENGINE_ERROR_CODE do_btree_smget_scan_sort_old(struct default_engine *eng
 scan_next:
         if (is_first != true) {
             assert(elem != NULL);
-            elem = do_btree_scan_next(&posi, bkrtype, bkrange);
+            elem = do_btree_scan_next(&posi, bkrtype, bkrange, &ebuf);
             if (elem == NULL) {
                 if (posi.node == NULL && (info->mflags & COLL_META_FLAG_TRIMMED) != 0) {
                     if (do_btree_overlapped_with_trimmed_space(info, &posi, bkrtype)) {
@@ -5136,7 +7207,7 @@ scan_next:
         }
         is_first = false;
 
-        if (efilter != NULL && !do_btree_elem_filter(elem, efilter)) {
+        if (ef != NULL && !do_btree_elem_filter(elem, ef)) {
             goto scan_next;
         }
 
@@ -5146,26 +7217,15 @@ scan_next:
         btree_scan_buf[curr_idx].kidx = k;
 
         /* add the current scan into the scan sort buffer */
-        if (sort_count == 0) {
-            sort_sindx_buf[sort_count++] = curr_idx;
-            curr_idx += 1;
-            continue;
-        }
-
         if (sort_count >= req_count) {
-            /* compare with the element of the last scan */
-            comp_idx = sort_sindx_buf[sort_count-1];
-            comp = BTREE_GET_ELEM_ITEM(btree_scan_buf[comp_idx].posi.node,
-                                       btree_scan_buf[comp_idx].posi.indx);
-            cmp_res = BKEY_COMP(elem->data, elem->nbkey, comp->data, comp->nbkey);
+            /* compare with the element of the worst scan */
+            comp_idx = sort_sindx_buf[0];
+            cmp_res = do_btree_smget_scan_comp(&btree_scan_buf[curr_idx],
+                                               &btree_scan_buf[comp_idx]);
             if (cmp_res == 0) {
-                cmp_res = do_btree_comp_hkey(btree_scan_buf[curr_idx].it,
-                                             btree_scan_buf[comp_idx].it);
-                if (cmp_res == 0) {
-                    do_item_release(engine, btree_scan_buf[curr_idx].it);
-                    btree_scan_buf[curr_idx].it = NULL;
-                    ret = ENGINE_EBADVALUE; break;
-                }
+                do_item_release(engine, btree_scan_buf[curr_idx].it);
+                btree_scan_buf[curr_idx].it = NULL;
+                ret = ENGINE_EBADVALUE; break;
             }
             if ((ascending ==  true && cmp_res > 0) ||
                 (ascending == false && cmp_res < 0)) {
@@ -5176,29 +7236,8 @@ scan_next:
             }
         }
 
-        left = 0;
-        right = sort_count-1;
-        while (left <= right) {
-            mid  = (left + right) / 2;
-            comp_idx = sort_sindx_buf[mid];
-            comp = BTREE_GET_ELEM_ITEM(btree_scan_buf[comp_idx].posi.node,
-                                       btree_scan_buf[comp_idx].posi.indx);
-            cmp_res = BKEY_COMP(elem->data, elem->nbkey, comp->data, comp->nbkey);
-            if (cmp_res == 0) {
-                cmp_res = do_btree_comp_hkey(btree_scan_buf[curr_idx].it,
-                                             btree_scan_buf[comp_idx].it);
-                if (cmp_res == 0) {
-                    ret = ENGINE_EBADVALUE; break;
-                }
-            }
-            if (ascending) {
-                if (cmp_res < 0) right = mid-1;
-                else             left  = mid+1;
-            } else {
-                if (cmp_res > 0) right = mid-1;
-                else             left  = mid+1;
-            }
-        }
+        ret = do_btree_smget_hash_find(btree_scan_buf, hash_tab, hash_size-1,
+                                       curr_idx, &same_idx);
         if (ret == ENGINE_EBADVALUE) {
             do_item_release(engine, btree_scan_buf[curr_idx].it);
             btree_scan_buf[curr_idx].it = NULL;
@@ -5206,18 +7245,19 @@ scan_next:
         }
 
         if (sort_count >= req_count) {
-            /* free the last scan */
-            comp_idx = sort_sindx_buf[sort_count-1];
+            /* replace the worst scan with the current scan */
+            comp_idx = sort_sindx_buf[0];
+            do_btree_smget_hash_unlink(btree_scan_buf, hash_tab, hash_size-1, comp_idx);
             do_item_release(engine, btree_scan_buf[comp_idx].it);
             btree_scan_buf[comp_idx].it = NULL;
             free_idx = comp_idx;
-            sort_count--;
-        }
-        for (i = sort_count-1; i >= left; i--) {
-            sort_sindx_buf[i+1] = sort_sindx_buf[i];
+            sort_sindx_buf[0] = curr_idx;
+            do_btree_smget_heap_down(btree_scan_buf, sort_sindx_buf, sort_count, 0, order);
+        } else {
+            sort_sindx_buf[sort_count++] = curr_idx;
+            do_btree_smget_heap_up(btree_scan_buf, sort_sindx_buf, sort_count-1, order);
         }
-        sort_sindx_buf[left] = curr_idx;
-        sort_count++;
+        do_btree_smget_hash_link(btree_scan_buf, hash_tab, hash_size-1, curr_idx);
 
         if (sort_count < req_count) {
             curr_idx += 1;
@@ -5252,16 +7292,27 @@ do_btree_smget_scan_sort(struct default_engine *engine,
     ENGINE_ERROR_CODE ret = ENGINE_SUCCESS;
     hash_item *it;
     btree_meta_info *info;
-    btree_elem_item *elem, *comp;
+    btree_elem_item *elem;
+    btree_elem_buf   ebuf[2];
+    int              eb = 0;
     btree_elem_posi posi;
-    int comp_idx;
+    btree_scan_info *same;
+    int comp_idx, same_idx;
     int curr_idx = -1; /* curr scan index */
     int free_idx = 0;  /* free scan list */
     int sort_count = 0; /* sorted scan count */
     int k, i, kidx, cmp_res;
-    int mid, left, right;
     bool ascending = (bkrtype != BKEY_RANGE_TYPE_DSC ? true : false);
+    int order = (ascending ? -1 : 1); /* the worst scan on the top */
     bool is_first;
+    btree_efilter    ef_buf; /* eflag filter compiled once per request */
+    const btree_efilter *ef = do_btree_efilter_compile(efilter, &ef_buf);
+    const int hash_size = do_btree_smget_hash_size(req_count);
+    int32_t   hash_tab[hash_size]; /* bkey hash of the sorted scans */
+
+    for (i = 0; i < hash_size; i++) {
+        hash_tab[i] = -1;
+    }
 
     for (k = 0; k < key_count; k++) {
         kidx = k;
@@ -5289,7 +7340,7 @@ do_btree_smget_scan_sort(struct default_engine *engine,
         }
         assert(info->root != NULL);
 
-        elem = do_btree_find_first(info->root, bkrtype, bkrange, &posi, false);
+        elem = do_btree_find_first(info->root, bkrtype, bkrange, &posi, false, &ebuf[eb]);
         if (elem == NULL) { /* No elements within the bkey range */
             if ((info->mflags & COLL_META_FLAG_TRIMMED) != 0 &&
                 do_btree_overlapped_with_trimmed_space(info, &posi, bkrtype)) {
@@ -5314,19 +7365,22 @@ scan_next:
         if (is_first != true) {
             assert(elem != NULL);
             btree_elem_item *prev = elem;
-            elem = do_btree_scan_next(&posi, bkrtype, bkrange);
+            eb ^= 1; /* keep the prev element */
+            elem = do_btree_scan_next(&posi, bkrtype, bkrange, &ebuf[eb]);
             if (elem == NULL) {
                 if (posi.node == NULL && (info->mflags & COLL_META_FLAG_TRIMMED) != 0 &&
                     do_btree_overlapped_with_trimmed_space(info, &posi, bkrtype)) {
                     /* Some elements weren't cached because of overflow trim */
-                    do_btree_smget_add_trim(smres, kidx, prev);
+                    ret = do_btree_smget_add_trim(engine, smres, kidx, prev);
                 }
-                do_item_release(engine, it); continue;
+                do_item_release(engine, it);
+                if (ret != ENGINE_SUCCESS) break;
+                continue;
             }
         }
         is_first = false;
 
-        if (efilter != NULL && !do_btree_elem_filter(elem, efilter)) {
+        if (ef != NULL && !do_btree_elem_filter(elem, ef)) {
             goto scan_next;
         }
 
@@ -5342,26 +7396,15 @@ scan_next:
         btree_scan_buf[curr_idx].kidx = kidx;
 
         /* add the current scan into the scan sort buffer */
-        if (sort_count == 0) {
-            sort_sindx_buf[sort_count++] = curr_idx;
-            curr_idx = -1;
-            continue;
-        }
-
         if (sort_count >= req_count) {
-            /* compare with the element of the last scan */
-            comp_idx = sort_sindx_buf[sort_count-1];
-            comp = BTREE_GET_ELEM_ITEM(btree_scan_buf[comp_idx].posi.node,
-                                       btree_scan_buf[comp_idx].posi.indx);
-            cmp_res = BKEY_COMP(elem->data, elem->nbkey, comp->data, comp->nbkey);
+            /* compare with the element of the worst scan */
+            comp_idx = sort_sindx_buf[0];
+            cmp_res = do_btree_smget_scan_comp(&btree_scan_buf[curr_idx],
+                                               &btree_scan_buf[comp_idx]);
             if (cmp_res == 0) {
-                cmp_res = do_btree_comp_hkey(btree_scan_buf[curr_idx].it,
-                                             btree_scan_buf[comp_idx].it);
-                if (cmp_res == 0) {
-                    do_item_release(engine, btree_scan_buf[curr_idx].it);
-                    btree_scan_buf[curr_idx].it = NULL;
-                    ret = ENGINE_EBADVALUE; break;
-                }
+                do_item_release(engine, btree_scan_buf[curr_idx].it);
+                btree_scan_buf[curr_idx].it = NULL;
+                ret = ENGINE_EBADVALUE; break;
             }
             if ((ascending ==  true && cmp_res > 0) ||
                 (ascending == false && cmp_res < 0)) {
@@ -5372,65 +7415,52 @@ scan_next:
             }
         }
 
-        left = 0;
-        right = sort_count-1;
-        while (left <= right) {
-            mid  = (left + right) / 2;
-            comp_idx = sort_sindx_buf[mid];
-            comp = BTREE_GET_ELEM_ITEM(btree_scan_buf[comp_idx].posi.node,
-                                       btree_scan_buf[comp_idx].posi.indx);
-            cmp_res = BKEY_COMP(elem->data, elem->nbkey, comp->data, comp->nbkey);
-            if (cmp_res == 0) {
-                cmp_res = do_btree_comp_hkey(btree_scan_buf[curr_idx].it,
-                                             btree_scan_buf[comp_idx].it);
-                if (cmp_res == 0) {
-                    ret = ENGINE_EBADVALUE; break;
-                }
-                if (unique) break;
-            }
-            if (ascending) {
-                if (cmp_res < 0) right = mid-1;
-                else             left  = mid+1;
-            } else {
-                if (cmp_res > 0) right = mid-1;
-                else             left  = mid+1;
-            }
-        }
+        ret = do_btree_smget_hash_find(btree_scan_buf, hash_tab, hash_size-1,
+                                       curr_idx, &same_idx);
         if (ret == ENGINE_EBADVALUE) {
             do_item_release(engine, btree_scan_buf[curr_idx].it);
             btree_scan_buf[curr_idx].it = NULL;
             break;
         }
-        if (left <= right) {
-            assert(unique == true);
+        if (unique && same_idx != -1) {
+            /* keep the preceding one of the scans having the same bkey,
+             * and proceed the other scan.
+             */
+            same = &btree_scan_buf[same_idx];
+            cmp_res = do_btree_comp_hkey(btree_scan_buf[curr_idx].it, same->it);
             if ((ascending ==  true && cmp_res < 0) ||
                 (ascending == false && cmp_res > 0)) {
-                assert(sort_sindx_buf[mid] == comp_idx);
-                sort_sindx_buf[mid] = curr_idx;
-                it = btree_scan_buf[comp_idx].it;
-                posi = btree_scan_buf[comp_idx].posi;
-                kidx = btree_scan_buf[comp_idx].kidx;
+                /* The sorted position and the hash chain are kept
+                 * since the bkey of the sorted scan is not changed.
+                 */
+                it   = same->it;
+                posi = same->posi;
+                kidx = same->kidx;
+                same->it   = btree_scan_buf[curr_idx].it;
+                same->posi = btree_scan_buf[curr_idx].posi;
+                same->kidx = btree_scan_buf[curr_idx].kidx;
                 info = (btree_meta_info *)item_get_meta(it);
-                btree_scan_buf[comp_idx].it = NULL;
-                curr_idx = comp_idx;
+                elem = BTREE_GET_ELEM_ITEM(posi.node, posi.indx, &ebuf[eb]);
             }
+            btree_scan_buf[curr_idx].it = NULL;
             goto scan_next;
         }
 
         if (sort_count >= req_count) {
-            /* free the last scan */
-            comp_idx = sort_sindx_buf[sort_count-1];
+            /* free the worst scan and replace it with the current scan */
+            comp_idx = sort_sindx_buf[0];
+            do_btree_smget_hash_unlink(btree_scan_buf, hash_tab, hash_size-1, comp_idx);
             do_item_release(engine, btree_scan_buf[comp_idx].it);
             btree_scan_buf[comp_idx].it = NULL;
-            sort_count--;
             btree_scan_buf[comp_idx].next = free_idx;
             free_idx = comp_idx;
+            sort_sindx_buf[0] = curr_idx;
+            do_btree_smget_heap_down(btree_scan_buf, sort_sindx_buf, sort_count, 0, order);
+        } else {
+            sort_sindx_buf[sort_count++] = curr_idx;
+            do_btree_smget_heap_up(btree_scan_buf, sort_sindx_buf, sort_count-1, order);
         }
-        for (i = sort_count-1; i >= left; i--) {
-            sort_sindx_buf[i+1] = sort_sindx_buf[i];
-        }
-        sort_sindx_buf[left] = curr_idx;
-        sort_count++;
+        do_btree_smget_hash_link(btree_scan_buf, hash_tab, hash_size-1, curr_idx);
         curr_idx = -1;
     }
 
@@ -5449,7 +7479,8 @@ scan_next:
 
 #ifdef SUPPORT_BOP_SMGET
 #ifdef JHPARK_OLD_SMGET_INTERFACE
-static ENGINE_ERROR_CODE do_btree_smget_elem_sort_old(btree_scan_info *btree_scan_buf,
+static ENGINE_ERROR_CODE do_btree_smget_elem_sort_old(struct default_engine *engine,
+                                   btree_scan_info *btree_scan_buf,
                                    uint16_t *sort_sindx_buf, const int sort_sindx_cnt,
                                    const int bkrtype, const bkey_range *bkrange, const eflag_filter *efilter,
                                    const uint32_t offset, const uint32_t count, btree_elem_item **elem_array,
@@ -5457,24 +7488,30 @@ static ENGINE_ERROR_CODE do_btree_smget_elem_sort_old(btree_scan_info *btree_sca
                                    bool *potentialbkeytrim, bool *bkey_duplicated)
 {
     btree_meta_info *info;
-    btree_elem_item *elem, *comp;
+    btree_elem_item *elem;
     btree_elem_item *prev = NULL;
-    uint16_t first_idx = 0;
+    btree_elem_buf   ebuf[2]; /* the current and prev elements */
+    btree_elem_buf   sbuf;    /* the next element of the scan */
+    int              eb = 0;
     uint16_t curr_idx;
-    uint16_t comp_idx;
-    int i, cmp_res;
-    int mid, left, right;
     int skip_count = 0;
     int sort_count = sort_sindx_cnt;
     bool ascending = (bkrtype != BKEY_RANGE_TYPE_DSC ? true : false);
+    int order = (ascending ? 1 : -1); /* the best scan on the top */
     bool key_trim_found = false;
     bool dup_bkey_found;
+    btree_efilter    ef_buf; /* eflag filter compiled once per request */
+    const btree_efilter *ef = do_btree_efilter_compile(efilter, &ef_buf);
     *elem_count = 0;
 
+    /* the sorted scans are merged with the best scan on the top */
+    do_btree_smget_heap_build(btree_scan_buf, sort_sindx_buf, sort_count, order);
+
     while (sort_count > 0) {
-        curr_idx = sort_sindx_buf[first_idx];
+        curr_idx = sort_sindx_buf[0];
+        eb ^= 1; /* keep the prev element */
         elem = BTREE_GET_ELEM_ITEM(btree_scan_buf[curr_idx].posi.node,
-                                   btree_scan_buf[curr_idx].posi.indx);
+                                   btree_scan_buf[curr_idx].posi.indx, &ebuf[eb]);
         dup_bkey_found = false;
         if (prev != NULL) { /* check duplicate bkeys */
             if (BKEY_COMP(prev->data, prev->nbkey, elem->data, elem->nbkey) == 0) {
@@ -5493,8 +7530,10 @@ static ENGINE_ERROR_CODE do_btree_smget_elem_sort_old(btree_scan_info *btree_sca
             if (*elem_count > 0 && dup_bkey_found) {
                 *bkey_duplicated = true;
             }
-            elem->refcount++;
-            elem_array[*elem_count] = elem;
+            elem_array[*elem_count] = do_btree_elem_take(engine, elem, NULL);
+            if (elem_array[*elem_count] == NULL) {
+                return ENGINE_ENOMEM;
+            }
             kfnd_array[*elem_count] = btree_scan_buf[curr_idx].kidx;
             flag_array[*elem_count] = btree_scan_buf[curr_idx].it->flags;
             *elem_count += 1;
@@ -5502,7 +7541,7 @@ static ENGINE_ERROR_CODE do_btree_smget_elem_sort_old(btree_scan_info *btree_sca
         }
 
 scan_next:
-        elem = do_btree_scan_next(&btree_scan_buf[curr_idx].posi, bkrtype, bkrange);
+        elem = do_btree_scan_next(&btree_scan_buf[curr_idx].posi, bkrtype, bkrange, &sbuf);
         if (elem == NULL) {
             if (btree_scan_buf[curr_idx].posi.node == NULL) {
                 /* reached to the end of b+tree scan */
@@ -5512,47 +7551,23 @@ scan_next:
                     key_trim_found = true;
                 }
             }
-            first_idx++; sort_count--;
+            /* remove the scan from the top */
+            sort_count--;
+            if (sort_count > 0) {
+                sort_sindx_buf[0] = sort_sindx_buf[sort_count];
+                do_btree_smget_heap_down(btree_scan_buf, sort_sindx_buf, sort_count, 0, order);
+            }
             continue;
         }
 
-        if (efilter != NULL && !do_btree_elem_filter(elem, efilter)) {
+        if (ef != NULL && !do_btree_elem_filter(elem, ef)) {
             goto scan_next;
         }
 
-        if (sort_count == 1) {
-            continue; /* sorting is not needed */
-        }
-
-        left  = first_idx + 1;
-        right = first_idx + sort_count - 1;
-        while (left <= right) {
-            mid  = (left + right) / 2;
-            comp_idx = sort_sindx_buf[mid];
-            comp = BTREE_GET_ELEM_ITEM(btree_scan_buf[comp_idx].posi.node,
-                                       btree_scan_buf[comp_idx].posi.indx);
-
-            cmp_res = BKEY_COMP(elem->data, elem->nbkey, comp->data, comp->nbkey);
-            if (cmp_res == 0) {
-                cmp_res = do_btree_comp_hkey(btree_scan_buf[curr_idx].it,
-                                             btree_scan_buf[comp_idx].it);
-                assert(cmp_res != 0);
-            }
-            if (ascending) {
-                if (cmp_res < 0) right = mid-1;
-                else             left  = mid+1;
-            } else {
-                if (cmp_res > 0) right = mid-1;
-                else             left  = mid+1;
-            }
-        }
-
-        assert(left > right);
-        /* right : insertion position */
-        for (i = first_idx+1; i <= right; i++) {
-            sort_sindx_buf[i-1] = sort_sindx_buf[i];
+        if (sort_count > 1) {
+            /* the bkey of the top scan is changed */
+            do_btree_smget_heap_down(btree_scan_buf, sort_sindx_buf, sort_count, 0, order);
         }
-        sort_sindx_buf[right] = curr_idx;
     }
 
     if (key_trim_found && *elem_count < count) {
@@ -5563,7 +7578,8 @@ scan_next:
 #endif
 
 static ENGINE_ERROR_CODE
-do_btree_smget_elem_sort(btree_scan_info *btree_scan_buf,
+do_btree_smget_elem_sort(struct default_engine *engine,
+                         btree_scan_info *btree_scan_buf,
                          uint16_t *sort_sindx_buf, const int sort_sindx_cnt,
                          const int bkrtype, const bkey_range *bkrange,
                          const eflag_filter *efilter,
@@ -5573,23 +7589,29 @@ do_btree_smget_elem_sort(btree_scan_info *btree_scan_buf,
 {
     ENGINE_ERROR_CODE ret = ENGINE_SUCCESS;
     btree_meta_info *info;
-    btree_elem_item *elem, *comp;
+    btree_elem_item *elem;
     btree_elem_item *last;
     btree_elem_item *prev = NULL;
-    uint16_t first_idx = 0;
+    btree_elem_buf   ebuf[2]; /* the current and prev elements */
+    btree_elem_buf   sbuf[2]; /* the next and last elements of the scan */
+    int              eb = 0, sb = 0;
     uint16_t curr_idx;
-    uint16_t comp_idx;
-    int i, cmp_res;
-    int mid, left, right;
     int skip_count = 0;
     int sort_count = sort_sindx_cnt;
     bool ascending = (bkrtype != BKEY_RANGE_TYPE_DSC ? true : false);
+    int order = (ascending ? 1 : -1); /* the best scan on the top */
     bool dup_bkey_found;
+    btree_efilter    ef_buf; /* eflag filter compiled once per request */
+    const btree_efilter *ef = do_btree_efilter_compile(efilter, &ef_buf);
+
+    /* the sorted scans are merged with the best scan on the top */
+    do_btree_smget_heap_build(btree_scan_buf, sort_sindx_buf, sort_count, order);
 
     while (sort_count > 0) {
-        curr_idx = sort_sindx_buf[first_idx];
+        curr_idx = sort_sindx_buf[0];
+        eb ^= 1; /* keep the prev element */
         elem = BTREE_GET_ELEM_ITEM(btree_scan_buf[curr_idx].posi.node,
-                                   btree_scan_buf[curr_idx].posi.indx);
+                                   btree_scan_buf[curr_idx].posi.indx, &ebuf[eb]);
         dup_bkey_found = false;
         if (prev != NULL) { /* check duplicate bkeys */
             if (BKEY_COMP(prev->data, prev->nbkey, elem->data, elem->nbkey) == 0) {
@@ -5609,7 +7631,10 @@ do_btree_smget_elem_sort(btree_scan_info *btree_scan_buf,
             if (smres->elem_count > 0 && dup_bkey_found) {
                 smres->duplicated = true;
             }
-            smres->elem_array[smres->elem_count] = elem;
+            smres->elem_array[smres->elem_count] = do_btree_elem_take(engine, elem, NULL);
+            if (smres->elem_array[smres->elem_count] == NULL) {
+                ret = ENGINE_ENOMEM; break;
+            }
             smres->elem_kinfo[smres->elem_count].kidx = btree_scan_buf[curr_idx].kidx;
             smres->elem_kinfo[smres->elem_count].flag = btree_scan_buf[curr_idx].it->flags;
             smres->elem_count += 1;
@@ -5624,13 +7649,13 @@ do_btree_smget_elem_sort(btree_scan_info *btree_scan_buf,
                 }
             }
 #endif
-            elem->refcount++;
             if (smres->elem_count >= count) break;
         }
 
 scan_next:
         last = elem;
-        elem = do_btree_scan_next(&btree_scan_buf[curr_idx].posi, bkrtype, bkrange);
+        sb ^= 1; /* keep the last element */
+        elem = do_btree_scan_next(&btree_scan_buf[curr_idx].posi, bkrtype, bkrange, &sbuf[sb]);
         if (elem == NULL) {
             if (btree_scan_buf[curr_idx].posi.node == NULL) {
                 /* reached to the end of b+tree scan */
@@ -5646,56 +7671,31 @@ scan_next:
                         ret = ENGINE_EBKEYOOR; break;
                     }
 #endif
-                    do_btree_smget_add_trim(smres, btree_scan_buf[curr_idx].kidx, last);
+                    ret = do_btree_smget_add_trim(engine, smres, btree_scan_buf[curr_idx].kidx, last);
+                    if (ret != ENGINE_SUCCESS) break;
                 }
             }
-            first_idx++; sort_count--;
+            /* remove the scan from the top */
+            sort_count--;
+            if (sort_count > 0) {
+                sort_sindx_buf[0] = sort_sindx_buf[sort_count];
+                do_btree_smget_heap_down(btree_scan_buf, sort_sindx_buf, sort_count, 0, order);
+            }
             continue;
         }
 
-        if (efilter != NULL && !do_btree_elem_filter(elem, efilter)) {
-            goto scan_next;
-        }
-
-        if (sort_count == 1) {
-            continue; /* sorting is not needed */
-        }
-
-        left  = first_idx + 1;
-        right = first_idx + sort_count - 1;
-        while (left <= right) {
-            mid  = (left + right) / 2;
-            comp_idx = sort_sindx_buf[mid];
-            comp = BTREE_GET_ELEM_ITEM(btree_scan_buf[comp_idx].posi.node,
-                                       btree_scan_buf[comp_idx].posi.indx);
-
-            cmp_res = BKEY_COMP(elem->data, elem->nbkey, comp->data, comp->nbkey);
-            if (cmp_res == 0) {
-                cmp_res = do_btree_comp_hkey(btree_scan_buf[curr_idx].it,
-                                             btree_scan_buf[comp_idx].it);
-                assert(cmp_res != 0);
-            }
-            if (ascending) {
-                if (cmp_res < 0) right = mid-1;
-                else             left  = mid+1;
-            } else {
-                if (cmp_res > 0) right = mid-1;
-                else             left  = mid+1;
-            }
-        }
-        if (left <= right) { /* Duplicate bkey is found */
+        if (ef != NULL && !do_btree_elem_filter(elem, ef)) {
             goto scan_next;
         }
 
-        /* right : insertion position */
-        for (i = first_idx+1; i <= right; i++) {
-            sort_sindx_buf[i-1] = sort_sindx_buf[i];
+        if (sort_count > 1) {
+            /* the bkey of the top scan is changed */
+            do_btree_smget_heap_down(btree_scan_buf, sort_sindx_buf, sort_count, 0, order);
         }
-        sort_sindx_buf[right] = curr_idx;
     }
     if (ret == ENGINE_SUCCESS) {
         if (smres->trim_count > 0) {
-            do_btree_smget_adjust_trim(smres);
+            do_btree_smget_adjust_trim(engine, smres);
         }
     }
     return ret;
@@ -5793,7 +7793,7 @@ static void coll_del_thread_sleep(void)
     struct timeval  tv;
     struct timespec to;
     pthread_mutex_lock(&coll_del_lock);
-    if (coll_del_queue.head == NULL) {
+    if (coll_del_queue.head == NULL && btree_trim_head == NULL) {
         /* 50 mili second sleep */
         gettimeofday(&tv, NULL);
         tv.tv_usec += 50000;
@@ -5812,10 +7812,70 @@ static void coll_del_thread_sleep(void)
     pthread_mutex_unlock(&coll_del_lock);
 }
 
+static void do_coll_del_begin(coll_del_slot *slot, hash_item *it)
+{
+    slot->it = it;
+    slot->deleted = 0;
+    if (IS_BTREE_ITEM(it)) {
+#ifdef BTREE_DELETE_NO_MERGE
+        slot->path[0].node = NULL;
+#else
+        btree_meta_info *info = (btree_meta_info *)item_get_meta(it);
+        get_bkey_full_range(info->bktype, true, &slot->bkrange);
+#endif
+    }
+}
+
+/* delete a batch of elements of the collection in the slot.
+ * The collection is freed if it becomes empty, and then true is returned.
+ */
+static bool do_coll_del_batch(struct default_engine *engine, coll_del_slot *slot)
+{
+    hash_item *it = slot->it;
+    coll_meta_info *info = (coll_meta_info *)item_get_meta(it);
+    uint32_t ccnt = info->ccnt;
+
+    if (IS_LIST_ITEM(it)) {
+        (void)do_list_elem_delete(engine, (list_meta_info *)info, 0, COLL_DEL_BATCH_COUNT, ELEM_DELETE_COLL);
+        assert(info->ccnt > 0 || (((list_meta_info *)info)->head == NULL &&
+                                  ((list_meta_info *)info)->tail == NULL));
+    } else if (IS_SET_ITEM(it)) {
+#ifdef SET_DELETE_NO_MERGE
+        (void)do_set_elem_delete_fast(engine, (set_meta_info *)info, COLL_DEL_BATCH_COUNT);
+#else
+        (void)do_set_elem_delete(engine, (set_meta_info *)info, COLL_DEL_BATCH_COUNT, ELEM_DELETE_COLL);
+#endif
+        assert(info->ccnt > 0 || ((set_meta_info *)info)->root == NULL);
+    } else if (IS_MAP_ITEM(it)) {
+        (void)do_map_elem_delete(engine, (map_meta_info *)info, COLL_DEL_BATCH_COUNT, ELEM_DELETE_COLL);
+        assert(info->ccnt > 0 || ((map_meta_info *)info)->root == NULL);
+    } else if (IS_BTREE_ITEM(it)) {
+#ifdef BTREE_DELETE_NO_MERGE
+        (void)do_btree_elem_delete_fast(engine, (btree_meta_info *)info, slot->path, BTREE_DEL_BATCH_COUNT);
+#else
+        (void)do_btree_elem_delete(engine, (btree_meta_info *)info, BKEY_RANGE_TYPE_ASC, &slot->bkrange,
+                                   NULL, BTREE_DEL_BATCH_COUNT, NULL, ELEM_DELETE_COLL);
+#endif
+        assert(info->ccnt > 0 || ((btree_meta_info *)info)->root == NULL);
+    }
+    slot->deleted += (ccnt - info->ccnt);
+    coll_del_elems += (ccnt - info->ccnt);
+
+    if (info->ccnt == 0) {
+        slot->it = NULL;
+        do_item_free(engine, it);
+        coll_del_colls++;
+        return true;
+    }
+    return false;
+}
+
 static void *collection_delete_thread(void *arg)
 {
     struct default_engine *engine = arg;
+    btree_trim_work *work;
     hash_item *it;
+    int i;
     uint32_t expired_cnt;
     int      space_shortage_level;
     bool     background_evict_flag = false;
@@ -5823,8 +7883,32 @@ static void *collection_delete_thread(void *arg)
     struct timespec background_sleep_time = {0, 0};
 
     while (engine->initialized) {
-        it = pop_coll_del_queue();
-        if (it == NULL) {
+        work = pop_btree_trim_queue();
+        if (work != NULL) {
+            bool done = false;
+            while (done == false) {
+                pthread_mutex_lock(&engine->cache_lock);
+                coll_del_measure = true;
+                done = do_btree_trim_work_free(engine, work, BTREE_DEL_BATCH_COUNT);
+                if (done) {
+                    do_item_release(engine, work->it);
+                }
+                coll_del_measure = false;
+                coll_del_space += coll_del_freed;
+                coll_del_freed = 0;
+                pthread_mutex_unlock(&engine->cache_lock);
+            }
+            free(work);
+            continue;
+        }
+        /* take the queued collections into the free slots */
+        while (coll_del_nslots < COLL_DEL_SLOT_COUNT && (it = pop_coll_del_queue()) != NULL) {
+            pthread_mutex_lock(&engine->cache_lock);
+            do_coll_del_begin(&coll_del_slots[coll_del_nslots], it);
+            coll_del_nslots++;
+            pthread_mutex_unlock(&engine->cache_lock);
+        }
+        if (coll_del_nslots == 0) {
 #ifdef USE_SINGLE_LRU_LIST
             expired_cnt = check_expired_collections(engine, 1, &space_shortage_level);
 #else
@@ -5864,80 +7948,23 @@ static void *collection_delete_thread(void *arg)
             }
             continue;
         }
-        if (IS_LIST_ITEM(it)) {
-            bool dropped = false;
-            list_meta_info *info;
-            while (dropped == false) {
-                pthread_mutex_lock(&engine->cache_lock);
-                info = (list_meta_info *)item_get_meta(it);
-                (void)do_list_elem_delete(engine, info, 0, 30, ELEM_DELETE_COLL);
-                if (info->ccnt == 0) {
-                    assert(info->head == NULL && info->tail == NULL);
-                    do_item_free(engine, it);
-                    dropped = true;
-                }
-                pthread_mutex_unlock(&engine->cache_lock);
-            }
-        } else if (IS_SET_ITEM(it)) {
-            bool dropped = false;
-            set_meta_info *info;
-            while (dropped == false) {
-                pthread_mutex_lock(&engine->cache_lock);
-                info = (set_meta_info *)item_get_meta(it);
-#ifdef SET_DELETE_NO_MERGE
-                (void)do_set_elem_delete_fast(engine, info, 30);
-#else
-                (void)do_set_elem_delete(engine, info, 30, ELEM_DELETE_COLL);
-#endif
-                if (info->ccnt == 0) {
-                    assert(info->root == NULL);
-                    do_item_free(engine, it);
-                    dropped = true;
-                }
-                pthread_mutex_unlock(&engine->cache_lock);
-            }
-        }
-        else if (IS_MAP_ITEM(it)) {
-            bool dropped = false;
-            map_meta_info *info;
-            while (dropped == false) {
-                pthread_mutex_lock(&engine->cache_lock);
-                info = (map_meta_info *)item_get_meta(it);
-                (void)do_map_elem_delete(engine, info, 30, ELEM_DELETE_COLL);
-                if (info->ccnt == 0) {
-                    assert(info->root == NULL);
-                    do_item_free(engine, it);
-                    dropped = true;
-                }
-                pthread_mutex_unlock(&engine->cache_lock);
-            }
-        }
-        else if (IS_BTREE_ITEM(it)) {
-            bool dropped = false;
-            btree_meta_info *info = (btree_meta_info *)item_get_meta(it);
-#ifdef BTREE_DELETE_NO_MERGE
-            btree_elem_posi path[BTREE_MAX_DEPTH];
-            path[0].node = NULL;
-#else
-            bkey_range bkrange_space;
-            get_bkey_full_range(info->bktype, true, &bkrange_space);
-#endif
-            while (dropped == false) {
-                pthread_mutex_lock(&engine->cache_lock);
-                info = (btree_meta_info *)item_get_meta(it);
-#ifdef BTREE_DELETE_NO_MERGE
-                (void)do_btree_elem_delete_fast(engine, info, path, 100);
-#else
-                (void)do_btree_elem_delete(engine, info, BKEY_RANGE_TYPE_ASC, &bkrange_space,
-                                           NULL, 100, NULL, ELEM_DELETE_COLL);
-#endif
-                if (info->ccnt == 0) {
-                    assert(info->root == NULL);
-                    do_item_free(engine, it);
-                    dropped = true;
-                }
-                pthread_mutex_unlock(&engine->cache_lock);
+        /* delete a batch of each collection in turn */
+        i = 0;
+        while (i < coll_del_nslots) {
+            pthread_mutex_lock(&engine->cache_lock);
+            coll_del_measure = true;
+            if (do_coll_del_batch(engine, &coll_del_slots[i])) {
+                /* the collection is freed: move the last slot into it */
+                coll_del_nslots--;
+                coll_del_slots[i] = coll_del_slots[coll_del_nslots];
+                coll_del_slots[coll_del_nslots].it = NULL;
+            } else {
+                i++;
             }
+            coll_del_measure = false;
+            coll_del_space += coll_del_freed;
+            coll_del_freed = 0;
+            pthread_mutex_unlock(&engine->cache_lock);
         }
     }
     return NULL;
@@ -6085,7 +8112,8 @@ static ENGINE_ERROR_CODE do_item_delete(struct default_engine *engine,
                                         uint64_t cas)
 {
     ENGINE_ERROR_CODE ret;
-    hash_item *it = do_item_get(engine, key, nkey, DONT_UPDATE);
+    /* The lease placeholder is deleted as well, so as to invalidate the lease. */
+    hash_item *it = do_item_find(engine, key, nkey, DONT_UPDATE);
     if (it == NULL) {
         ret = ENGINE_KEY_ENOENT;
     } else {
@@ -6329,9 +8357,17 @@ ENGINE_ERROR_CODE item_init(struct default_engine *engine)
     coll_del_queue.head = coll_del_queue.tail = NULL;
     coll_del_queue.size = 0;
     coll_del_sleep = false;
+    btree_trim_head = btree_trim_tail = NULL;
 
     item_evict_to_free = engine->config.evict_to_free;
 
+    if (1) { /* seed the random state of collection element sampling */
+        struct timeval tv;
+        gettimeofday(&tv, NULL);
+        coll_rand_state = ((uint64_t)tv.tv_sec << 20) ^ (uint64_t)tv.tv_usec ^ (uint64_t)getpid();
+        if (coll_rand_state == 0) coll_rand_state = 1;
+    }
+
     /* adjust maximum collection size */
     if (engine->config.max_list_size > max_list_size) {
         max_list_size = engine->config.max_list_size < coll_size_limit
@@ -6425,7 +8461,7 @@ ENGINE_ERROR_CODE list_struct_create(struct default_engine *engine,
         if (it == NULL) {
             ret = ENGINE_ENOMEM;
         } else {
-            ret = do_item_link(engine, it);
+            ret = do_coll_item_link(engine, it);
             do_item_release(engine, it);
         }
     }
@@ -6476,7 +8512,7 @@ ENGINE_ERROR_CODE list_elem_insert(struct default_engine *engine,
         if (it == NULL) {
             ret = ENGINE_ENOMEM;
         } else {
-            ret = do_item_link(engine, it);
+            ret = do_coll_item_link(engine, it);
             if (ret == ENGINE_SUCCESS) {
                 *created = true;
             } else {
@@ -6495,6 +8531,59 @@ ENGINE_ERROR_CODE list_elem_insert(struct default_engine *engine,
     return ret;
 }
 
+/*
+ * Insert the given elements into the list in the given order
+ * with a single item lookup. The elements that cannot be inserted are skipped.
+ */
+ENGINE_ERROR_CODE list_elem_insert_bulk(struct default_engine *engine,
+                                        const char *key, const size_t nkey,
+                                        int index, list_elem_item **elem_array,
+                                        const uint32_t elem_count, item_attr *attrp,
+                                        bool *created, uint32_t *ins_count,
+                                        const void *cookie)
+{
+    hash_item *it = NULL;
+    ENGINE_ERROR_CODE ret;
+
+    *created = false;
+    *ins_count = 0;
+
+    pthread_mutex_lock(&engine->cache_lock);
+    ret = do_list_item_find(engine, key, nkey, DONT_UPDATE, &it);
+    if (ret == ENGINE_KEY_ENOENT && attrp != NULL) {
+        it = do_list_item_alloc(engine, key, nkey, attrp, cookie);
+        if (it == NULL) {
+            ret = ENGINE_ENOMEM;
+        } else {
+            ret = do_coll_item_link(engine, it);
+            if (ret == ENGINE_SUCCESS) {
+                *created = true;
+            } else {
+                /* The item is to be released, below */
+            }
+        }
+    }
+    if (ret == ENGINE_SUCCESS) {
+        for (int i = 0; i < elem_count; i++) {
+            /* A negative index keeps the order of elements by itself. */
+            ret = do_list_elem_insert(engine, it, (index >= 0 ? index + *ins_count : index),
+                                      elem_array[i], cookie);
+            if (ret == ENGINE_SUCCESS) {
+                *ins_count += 1;
+            }
+        }
+        if (*ins_count > 0) {
+            ret = ENGINE_SUCCESS;
+        } else if (*created) {
+            /* ret: the result of the last element */
+            do_item_unlink(engine, it, ITEM_UNLINK_NORMAL);
+        }
+    }
+    if (it != NULL) do_item_release(engine, it);
+    pthread_mutex_unlock(&engine->cache_lock);
+    return ret;
+}
+
 static int adjust_list_range(list_meta_info *info, int *from_index, int *to_index)
 {
     if (info->ccnt <= 0) return -1; /* out of range */
@@ -6643,7 +8732,7 @@ ENGINE_ERROR_CODE set_struct_create(struct default_engine *engine,
         if (it == NULL) {
             ret = ENGINE_ENOMEM;
         } else {
-            ret = do_item_link(engine, it);
+            ret = do_coll_item_link(engine, it);
             do_item_release(engine, it);
         }
     }
@@ -6689,7 +8778,7 @@ ENGINE_ERROR_CODE set_elem_insert(struct default_engine *engine, const char *key
         if (it == NULL) {
             ret = ENGINE_ENOMEM;
         } else {
-            ret = do_item_link(engine, it);
+            ret = do_coll_item_link(engine, it);
             if (ret == ENGINE_SUCCESS) {
                 *created = true;
             } else {
@@ -6708,6 +8797,56 @@ ENGINE_ERROR_CODE set_elem_insert(struct default_engine *engine, const char *key
     return ret;
 }
 
+/*
+ * Insert the given elements into the set with a single item lookup.
+ * The elements that cannot be inserted are skipped.
+ */
+ENGINE_ERROR_CODE set_elem_insert_bulk(struct default_engine *engine,
+                                       const char *key, const size_t nkey,
+                                       set_elem_item **elem_array, const uint32_t elem_count,
+                                       item_attr *attrp, bool *created,
+                                       uint32_t *ins_count, const void *cookie)
+{
+    hash_item *it = NULL;
+    ENGINE_ERROR_CODE ret;
+
+    *created = false;
+    *ins_count = 0;
+
+    pthread_mutex_lock(&engine->cache_lock);
+    ret = do_set_item_find(engine, key, nkey, DONT_UPDATE, &it);
+    if (ret == ENGINE_KEY_ENOENT && attrp != NULL) {
+        it = do_set_item_alloc(engine, key, nkey, attrp, cookie);
+        if (it == NULL) {
+            ret = ENGINE_ENOMEM;
+        } else {
+            ret = do_coll_item_link(engine, it);
+            if (ret == ENGINE_SUCCESS) {
+                *created = true;
+            } else {
+                /* The item is to be released, below */
+            }
+        }
+    }
+    if (ret == ENGINE_SUCCESS) {
+        for (int i = 0; i < elem_count; i++) {
+            ret = do_set_elem_insert(engine, it, elem_array[i], cookie);
+            if (ret == ENGINE_SUCCESS) {
+                *ins_count += 1;
+            }
+        }
+        if (*ins_count > 0) {
+            ret = ENGINE_SUCCESS;
+        } else if (*created) {
+            /* ret: the result of the last element */
+            do_item_unlink(engine, it, ITEM_UNLINK_NORMAL);
+        }
+    }
+    if (it != NULL) do_item_release(engine, it);
+    pthread_mutex_unlock(&engine->cache_lock);
+    return ret;
+}
+
 ENGINE_ERROR_CODE set_elem_delete(struct default_engine *engine,
                                   const char *key, const size_t nkey,
                                   const char *value, const size_t nbytes,
@@ -6765,37 +8904,124 @@ ENGINE_ERROR_CODE set_elem_exist(struct default_engine *engine,
     return ret;
 }
 
-ENGINE_ERROR_CODE set_elem_get(struct default_engine *engine,
-                               const char *key, const size_t nkey, const uint32_t count,
-                               const bool delete, const bool drop_if_empty,
-                               set_elem_item **elem_array, uint32_t *elem_count,
-                               uint32_t *flags, bool *dropped)
+ENGINE_ERROR_CODE set_elem_get(struct default_engine *engine,
+                               const char *key, const size_t nkey, const uint32_t count,
+                               const bool delete, const bool drop_if_empty, const bool random,
+                               set_elem_item **elem_array, uint32_t *elem_count,
+                               uint32_t *flags, bool *dropped)
+{
+    hash_item     *it;
+    set_meta_info *info;
+    ENGINE_ERROR_CODE ret;
+
+    pthread_mutex_lock(&engine->cache_lock);
+    ret = do_set_item_find(engine, key, nkey, DO_UPDATE, &it);
+    if (ret == ENGINE_SUCCESS) {
+        info = (set_meta_info *)item_get_meta(it);
+        do {
+            if ((info->mflags & COLL_META_FLAG_READABLE) == 0) {
+                ret = ENGINE_UNREADABLE; break;
+            }
+            ret = do_set_elem_get(engine, info, count, delete, random, elem_array, elem_count);
+            if (ret == ENGINE_SUCCESS) {
+                if (info->ccnt == 0 && drop_if_empty) {
+                    assert(delete == true);
+                    do_item_unlink(engine, it, ITEM_UNLINK_NORMAL);
+                    *dropped = true;
+                } else {
+                    *dropped = false;
+                }
+                *flags = it->flags;
+            } /* ret = ENGINE_ELEM_ENOENT */
+        } while (0);
+        do_item_release(engine, it);
+    }
+    pthread_mutex_unlock(&engine->cache_lock);
+    return ret;
+}
+
+ENGINE_ERROR_CODE set_elem_scan(struct default_engine *engine,
+                                const char *key, const size_t nkey,
+                                const uint32_t cursor, const uint32_t count,
+                                set_elem_item **elem_array, uint32_t *elem_count,
+                                uint32_t *next_cursor, uint32_t *flags)
+{
+    hash_item     *it;
+    set_meta_info *info;
+    ENGINE_ERROR_CODE ret;
+
+    pthread_mutex_lock(&engine->cache_lock);
+    ret = do_set_item_find(engine, key, nkey, DO_UPDATE, &it);
+    if (ret == ENGINE_SUCCESS) {
+        info = (set_meta_info *)item_get_meta(it);
+        do {
+            if ((info->mflags & COLL_META_FLAG_READABLE) == 0) {
+                ret = ENGINE_UNREADABLE; break;
+            }
+            ret = do_set_elem_scan(info, cursor, count, elem_array, elem_count, next_cursor);
+            if (ret == ENGINE_SUCCESS) {
+                *flags = it->flags;
+            } /* ret = ENGINE_ELEM_ENOENT */
+        } while (0);
+        do_item_release(engine, it);
+    }
+    pthread_mutex_unlock(&engine->cache_lock);
+    return ret;
+}
+
+/*
+ * Gets the elements of a set in chunks, each chunk in its own hold of the
+ * cache lock. The first call finds the set and keeps a reference to it in
+ * *item, which the caller releases after the last chunk. The later calls
+ * go on only while the key maps to the same set; if the set is deleted or
+ * replaced in the meantime, ENGINE_KEY_ENOENT or the error of the key is
+ * returned. The deleting get takes the elements in turn, and the others
+ * go on with the scan cursor.
+ */
+ENGINE_ERROR_CODE set_elem_get_chunk(struct default_engine *engine,
+                                     const char *key, const size_t nkey,
+                                     hash_item **item, uint32_t *cursor,
+                                     const uint32_t count, const bool delete,
+                                     const bool drop_if_empty, const bool random,
+                                     set_elem_item **elem_array, uint32_t *elem_count,
+                                     uint32_t *flags, bool *dropped)
 {
     hash_item     *it;
     set_meta_info *info;
     ENGINE_ERROR_CODE ret;
 
     pthread_mutex_lock(&engine->cache_lock);
-    ret = do_set_item_find(engine, key, nkey, DO_UPDATE, &it);
+    ret = do_set_item_find(engine, key, nkey, (*item == NULL ? DO_UPDATE : DONT_UPDATE), &it);
+    if (ret == ENGINE_SUCCESS) {
+        if (*item == NULL) {
+            *item = it; /* kept until the last chunk */
+        } else {
+            do_item_release(engine, it);
+            if (it != *item) {
+                ret = ENGINE_KEY_ENOENT; /* another set on the key */
+            }
+        }
+    }
     if (ret == ENGINE_SUCCESS) {
         info = (set_meta_info *)item_get_meta(it);
         do {
             if ((info->mflags & COLL_META_FLAG_READABLE) == 0) {
                 ret = ENGINE_UNREADABLE; break;
             }
-            ret = do_set_elem_get(engine, info, count, delete, elem_array, elem_count);
-            if (ret == ENGINE_SUCCESS) {
-                if (info->ccnt == 0 && drop_if_empty) {
-                    assert(delete == true);
+            *dropped = false;
+            if (delete) {
+                ret = do_set_elem_get(engine, info, count, true, random, elem_array, elem_count);
+                if (ret == ENGINE_SUCCESS && info->ccnt == 0 && drop_if_empty) {
                     do_item_unlink(engine, it, ITEM_UNLINK_NORMAL);
                     *dropped = true;
-                } else {
-                    *dropped = false;
                 }
+            } else {
+                ret = do_set_elem_scan(info, *cursor, count, elem_array, elem_count, cursor);
+            }
+            if (ret == ENGINE_SUCCESS) {
                 *flags = it->flags;
             } /* ret = ENGINE_ELEM_ENOENT */
         } while (0);
-        do_item_release(engine, it);
     }
     pthread_mutex_unlock(&engine->cache_lock);
     return ret;
@@ -6821,7 +9047,7 @@ ENGINE_ERROR_CODE btree_struct_create(struct default_engine *engine,
         if (it == NULL) {
             ret = ENGINE_ENOMEM;
         } else {
-            ret = do_item_link(engine, it);
+            ret = do_coll_item_link(engine, it);
             do_item_release(engine, it);
         }
     }
@@ -6878,7 +9104,7 @@ ENGINE_ERROR_CODE btree_elem_insert(struct default_engine *engine,
         if (it == NULL) {
             ret = ENGINE_ENOMEM;
         } else {
-            ret = do_item_link(engine, it);
+            ret = do_coll_item_link(engine, it);
             if (ret == ENGINE_SUCCESS) {
                 *created = true;
             } else {
@@ -6888,7 +9114,7 @@ ENGINE_ERROR_CODE btree_elem_insert(struct default_engine *engine,
     }
     if (ret == ENGINE_SUCCESS) {
         ret = do_btree_elem_insert(engine, it, elem, replace_if_exist, replaced,
-                                   trimmed_elems, trimmed_count, cookie);
+                                   trimmed_elems, trimmed_count, NULL, cookie);
         if (ret != ENGINE_SUCCESS && *created) {
             do_item_unlink(engine, it, ITEM_UNLINK_NORMAL);
         }
@@ -6901,6 +9127,87 @@ ENGINE_ERROR_CODE btree_elem_insert(struct default_engine *engine,
     return ret;
 }
 
+static int do_btree_elem_bkey_comp(const void *e1, const void *e2)
+{
+    btree_elem_item *elem1 = *(btree_elem_item **)e1;
+    btree_elem_item *elem2 = *(btree_elem_item **)e2;
+
+    /* uint64 bkeys precede binary bkeys to keep the total order */
+    if (elem1->nbkey == 0 && elem2->nbkey > 0) return -1;
+    if (elem1->nbkey > 0 && elem2->nbkey == 0) return 1;
+    return BKEY_COMP(elem1->data, elem1->nbkey, elem2->data, elem2->nbkey);
+}
+
+/*
+ * Insert the given elements into the b+tree with a single item lookup.
+ * The elements are sorted by bkey and inserted in the leaf order,
+ * so that the insert position of each element can be found
+ * from that of the previous one without descending from the root node.
+ * The elements following the last element of the b+tree are appended
+ * by building the nodes bottom-up, as they're given when a b+tree is loaded.
+ * The elements that cannot be inserted are skipped.
+ */
+ENGINE_ERROR_CODE btree_elem_insert_bulk(struct default_engine *engine,
+                                         const char *key, const size_t nkey,
+                                         btree_elem_item **elem_array, const uint32_t elem_count,
+                                         item_attr *attrp, bool *created,
+                                         uint32_t *ins_count, const void *cookie)
+{
+    btree_elem_posi hint[BTREE_MAX_DEPTH];
+    hash_item *it = NULL;
+    ENGINE_ERROR_CODE ret;
+
+    *created = false;
+    *ins_count = 0;
+
+    /* sort the elements outside of the cache lock */
+    qsort(elem_array, elem_count, sizeof(btree_elem_item *), do_btree_elem_bkey_comp);
+
+    pthread_mutex_lock(&engine->cache_lock);
+    ret = do_btree_item_find(engine, key, nkey, DONT_UPDATE, &it);
+    if (ret == ENGINE_KEY_ENOENT && attrp != NULL) {
+        it = do_btree_item_alloc(engine, key, nkey, attrp, cookie);
+        if (it == NULL) {
+            ret = ENGINE_ENOMEM;
+        } else {
+            ret = do_coll_item_link(engine, it);
+            if (ret == ENGINE_SUCCESS) {
+                *created = true;
+            } else {
+                /* The item is to be released, below */
+            }
+        }
+    }
+    if (ret == ENGINE_SUCCESS) {
+        btree_meta_info *info = (btree_meta_info *)item_get_meta(it);
+        btree_elem_posi apath[BTREE_MAX_DEPTH]; /* rightmost path for appending */
+        hint[0].node = NULL;
+        apath[0].node = NULL;
+        for (int i = 0; i < elem_count; i++) {
+            ret = do_btree_elem_append(engine, info, elem_array[i], apath, cookie);
+            if (ret == ENGINE_FAILED) {
+                apath[0].node = NULL; /* the tree might be changed by the insertion */
+                ret = do_btree_elem_insert(engine, it, elem_array[i], false, NULL,
+                                           NULL, NULL, hint, cookie);
+            } else {
+                hint[0].node = NULL;
+            }
+            if (ret == ENGINE_SUCCESS) {
+                *ins_count += 1;
+            }
+        }
+        if (*ins_count > 0) {
+            ret = ENGINE_SUCCESS;
+        } else if (*created) {
+            /* ret: the result of the last element */
+            do_item_unlink(engine, it, ITEM_UNLINK_NORMAL);
+        }
+    }
+    if (it != NULL) do_item_release(engine, it);
+    pthread_mutex_unlock(&engine->cache_lock);
+    return ret;
+}
+
 ENGINE_ERROR_CODE btree_elem_update(struct default_engine *engine,
                                     const char *key, const size_t nkey, const bkey_range *bkrange,
                                     const eflag_update *eupdate, const char *value, const int nbytes,
@@ -7074,9 +9381,9 @@ ENGINE_ERROR_CODE btree_elem_get(struct default_engine *engine,
                 }
                 *flags = it->flags;
             } else {
-                if (potentialbkeytrim == true)
+                if (ret == ENGINE_ELEM_ENOENT && potentialbkeytrim == true)
                     ret = ENGINE_EBKEYOOR;
-                /* ret = ENGINE_ELEM_ENOENT; */
+                /* ret = ENGINE_ELEM_ENOENT or ENGINE_ENOMEM */
             }
         } while (0);
         do_item_release(engine, it);
@@ -7182,10 +9489,10 @@ ENGINE_ERROR_CODE btree_posi_find_with_get(struct default_engine *engine,
                 (info->bktype == BKEY_TYPE_BINARY && bkrange->from_nbkey == 0)) {
                 ret = ENGINE_EBADBKEY; break;
             }
-            *position = do_btree_posi_find_with_get(info, bkrtype, bkrange, order, count,
-                                                    elem_array, elem_count, elem_index);
-            if (*position < 0) {
-                ret = ENGINE_ELEM_ENOENT; break;
+            ret = do_btree_posi_find_with_get(engine, info, bkrtype, bkrange, order, count,
+                                              elem_array, elem_count, elem_index, position);
+            if (ret != ENGINE_SUCCESS) {
+                break;
             }
             *flags = it->flags;
         } while (0);
@@ -7236,8 +9543,9 @@ ENGINE_ERROR_CODE btree_elem_get_by_posi(struct default_engine *engine,
                 forward = false;
                 rqcount = from_posi - to_posi + 1;
             }
-            ret = do_btree_elem_get_by_posi(info, from_posi, rqcount, forward, elem_array, elem_count);
-            if (ret != ENGINE_SUCCESS) /* ret == ENGINE_ELEM_ENOENT */
+            ret = do_btree_elem_get_by_posi(engine, info, from_posi, rqcount, forward,
+                                            elem_array, elem_count);
+            if (ret != ENGINE_SUCCESS) /* ENGINE_ELEM_ENOENT or ENGINE_ENOMEM */
                 break;
             *flags = it->flags;
         } while (0);
@@ -7247,6 +9555,36 @@ ENGINE_ERROR_CODE btree_elem_get_by_posi(struct default_engine *engine,
     return ret;
 }
 
+ENGINE_ERROR_CODE btree_elem_aggregate(struct default_engine *engine,
+                                       const char *key, const size_t nkey,
+                                       const bkey_range *bkrange, const eflag_filter *efilter,
+                                       const bop_aggr_spec *spec, bop_aggr_result *result)
+{
+    hash_item       *it;
+    btree_meta_info *info;
+    int bkrtype = do_btree_bkey_range_type(bkrange);
+    ENGINE_ERROR_CODE ret;
+
+    pthread_mutex_lock(&engine->cache_lock);
+    ret = do_btree_item_find(engine, key, nkey, DO_UPDATE, &it);
+    if (ret == ENGINE_SUCCESS) {
+        info = (btree_meta_info *)item_get_meta(it);
+        do {
+            if ((info->mflags & COLL_META_FLAG_READABLE) == 0) {
+                ret = ENGINE_UNREADABLE; break;
+            }
+            if ((info->bktype == BKEY_TYPE_UINT64 && bkrange->from_nbkey >  0) ||
+                (info->bktype == BKEY_TYPE_BINARY && bkrange->from_nbkey == 0)) {
+                ret = ENGINE_EBADBKEY; break;
+            }
+            ret = do_btree_elem_aggregate(info, bkrtype, bkrange, efilter, spec, result);
+        } while (0);
+        do_item_release(engine, it);
+    }
+    pthread_mutex_unlock(&engine->cache_lock);
+    return ret;
+}
+
 #ifdef SUPPORT_BOP_SMGET
 #ifdef JHPARK_OLD_SMGET_INTERFACE
 ENGINE_ERROR_CODE btree_elem_smget_old(struct default_engine *engine,
@@ -7259,7 +9597,7 @@ ENGINE_ERROR_CODE btree_elem_smget_old(struct default_engine *engine,
                                    bool *trimmed, bool *duplicated)
 {
     btree_scan_info btree_scan_buf[offset+count+1]; /* one more scan needed */
-    uint16_t        sort_sindx_buf[offset+count];   /* sorted scan index buffer */
+    uint16_t        sort_sindx_buf[offset+count];   /* scan index heap buffer */
     uint32_t        sort_sindx_cnt, i;
     int             bkrtype = do_btree_bkey_range_type(bkrange);
     ENGINE_ERROR_CODE ret;
@@ -7281,7 +9619,7 @@ ENGINE_ERROR_CODE btree_elem_smget_old(struct default_engine *engine,
                                    missed_key_array, missed_key_count);
     if (ret == ENGINE_SUCCESS) {
         /* the 2nd phase: get the sorted elems */
-        ret = do_btree_smget_elem_sort_old(btree_scan_buf, sort_sindx_buf, sort_sindx_cnt,
+        ret = do_btree_smget_elem_sort_old(engine, btree_scan_buf, sort_sindx_buf, sort_sindx_cnt,
                                            bkrtype, bkrange, efilter, offset, count,
                                            elem_array, kfnd_array, flag_array, elem_count,
                                            trimmed, duplicated);
@@ -7289,6 +9627,12 @@ ENGINE_ERROR_CODE btree_elem_smget_old(struct default_engine *engine,
             if (btree_scan_buf[i].it != NULL)
                 do_item_release(engine, btree_scan_buf[i].it);
         }
+        if (ret != ENGINE_SUCCESS) {
+            for (i = 0; i < *elem_count; i++) {
+                do_btree_elem_release(engine, elem_array[i]);
+            }
+            *elem_count = 0;
+        }
     }
 
     pthread_mutex_unlock(&engine->cache_lock);
@@ -7305,7 +9649,7 @@ ENGINE_ERROR_CODE btree_elem_smget(struct default_engine *engine,
                                    smget_result_t *result)
 {
     btree_scan_info btree_scan_buf[offset+count+1]; /* one more scan needed */
-    uint16_t        sort_sindx_buf[offset+count];   /* sorted scan index buffer */
+    uint16_t        sort_sindx_buf[offset+count];   /* scan index heap buffer */
     uint32_t        sort_sindx_cnt, i;
     int             bkrtype = do_btree_bkey_range_type(bkrange);
     ENGINE_ERROR_CODE ret;
@@ -7342,18 +9686,19 @@ ENGINE_ERROR_CODE btree_elem_smget(struct default_engine *engine,
         }
 
         /* the 2nd phase: get the sorted elems */
-        ret = do_btree_smget_elem_sort(btree_scan_buf, sort_sindx_buf, sort_sindx_cnt,
+        ret = do_btree_smget_elem_sort(engine, btree_scan_buf, sort_sindx_buf, sort_sindx_cnt,
                                        bkrtype, bkrange, efilter, offset, count, unique,
                                        result);
-        if (ret != ENGINE_SUCCESS) {
-            break;
-        }
 
         for (i = 0; i <= (offset+count); i++) {
             if (btree_scan_buf[i].it != NULL)
                 do_item_release(engine, btree_scan_buf[i].it);
         }
     } while(0);
+    if (ret != ENGINE_SUCCESS) {
+        /* release the elements referenced so far */
+        do_btree_smget_release(engine, result);
+    }
     pthread_mutex_unlock(&engine->cache_lock);
 
     return ret;
@@ -7429,9 +9774,10 @@ do_item_getattr(struct default_engine *engine, hash_item *it,
             attr_data->maxbkeyrange = binfo->maxbkeyrange;
             attr_data->trimmed = (((binfo->mflags & COLL_META_FLAG_TRIMMED) != 0) ? 1 : 0);
             if (info->ccnt > 0) {
-                btree_elem_item *min_bkey_elem = do_btree_get_first_elem(binfo->root);
+                btree_elem_buf ebuf;
+                btree_elem_item *min_bkey_elem = do_btree_get_first_elem(binfo->root, &ebuf);
                 do_btree_get_bkey(min_bkey_elem, &attr_data->minbkey);
-                btree_elem_item *max_bkey_elem = do_btree_get_last_elem(binfo->root);
+                btree_elem_item *max_bkey_elem = do_btree_get_last_elem(binfo->root, &ebuf);
                 do_btree_get_bkey(max_bkey_elem, &attr_data->maxbkey);
             }
         }
@@ -7474,6 +9820,28 @@ ENGINE_ERROR_CODE item_getattr(struct default_engine *engine,
     return ret;
 }
 
+/* Check if the b+tree can be trimmed to a smaller maxcount
+ * by the overflow action that it will have after setattr.
+ */
+static bool
+do_btree_setattr_trimmable(hash_item *it,
+                           ENGINE_ITEM_ATTR *attr_ids, const uint32_t attr_count,
+                           item_attr *attr_data)
+{
+    uint8_t ovflact = ((coll_meta_info *)item_get_meta(it))->ovflact;
+    for (int i = 0; i < attr_count; i++) {
+        if (attr_ids[i] == ATTR_OVFLACTION) {
+            ovflact = attr_data->ovflaction;
+            if (forced_btree_ovflact != 0 && forced_action_pfxlen < it->nkey &&
+                memcmp(forced_action_prefix, item_get_key(it), forced_action_pfxlen) == 0) {
+                ovflact = forced_btree_ovflact;
+            }
+        }
+    }
+    return (ovflact == OVFL_SMALLEST_TRIM || ovflact == OVFL_SMALLEST_SILENT_TRIM ||
+            ovflact == OVFL_LARGEST_TRIM  || ovflact == OVFL_LARGEST_SILENT_TRIM);
+}
+
 static ENGINE_ERROR_CODE
 do_item_setattr_check(hash_item *it,
                       ENGINE_ITEM_ATTR *attr_ids, const uint32_t attr_count,
@@ -7502,7 +9870,11 @@ do_item_setattr_check(hash_item *it,
         if (attr_ids[i] == ATTR_MAXCOUNT) {
             attr_data->maxcount = do_coll_real_maxcount(it, attr_data->maxcount);
             if (attr_data->maxcount > 0 && attr_data->maxcount < info->ccnt) {
-                ret = ENGINE_EBADVALUE; break;
+                /* b+tree having a trim overflow action is trimmed to the new maxcount */
+                if (!IS_BTREE_ITEM(it) ||
+                    !do_btree_setattr_trimmable(it, attr_ids, attr_count, attr_data)) {
+                    ret = ENGINE_EBADVALUE; break;
+                }
             }
             continue;
         }
@@ -7548,8 +9920,9 @@ do_item_setattr_check(hash_item *it,
                      BKEY_ISNE(attr_data->maxbkeyrange.val, attr_data->maxbkeyrange.len,
                                binfo->maxbkeyrange.val, binfo->maxbkeyrange.len))) {
                     bkey_t curbkeyrange;
-                    btree_elem_item *min_bkey_elem = do_btree_get_first_elem(binfo->root);
-                    btree_elem_item *max_bkey_elem = do_btree_get_last_elem(binfo->root);
+                    btree_elem_buf min_buf, max_buf;
+                    btree_elem_item *min_bkey_elem = do_btree_get_first_elem(binfo->root, &min_buf);
+                    btree_elem_item *max_bkey_elem = do_btree_get_last_elem(binfo->root, &max_buf);
                     curbkeyrange.len = attr_data->maxbkeyrange.len;
                     BKEY_DIFF(max_bkey_elem->data, max_bkey_elem->nbkey,
                               min_bkey_elem->data, min_bkey_elem->nbkey,
@@ -7650,6 +10023,15 @@ do_item_setattr_exec(struct default_engine *engine, hash_item *it,
             continue;
         }
     }
+    if (info != NULL && IS_BTREE_ITEM(it) && info->mcnt > 0 && info->ccnt > info->mcnt) {
+        /* trim the b+tree to the new maxcount */
+        btree_meta_info *binfo = (btree_meta_info *)info;
+        bool smallest = (binfo->ovflact == OVFL_SMALLEST_TRIM ||
+                         binfo->ovflact == OVFL_SMALLEST_SILENT_TRIM);
+        do_btree_elem_trim(engine, binfo, binfo->ccnt - binfo->mcnt, smallest);
+        if (binfo->ovflact == OVFL_SMALLEST_TRIM || binfo->ovflact == OVFL_LARGEST_TRIM)
+            binfo->mflags |= COLL_META_FLAG_TRIMMED; // set trimmed
+    }
 }
 
 ENGINE_ERROR_CODE item_setattr(struct default_engine *engine,
@@ -8009,6 +10391,48 @@ bool item_onoff_scrub(struct default_engine *engine, bool val)
     return old_val;
 }
 
+void item_stats_coll_del(struct default_engine *engine,
+                         ADD_STAT add_stat, const void *cookie)
+{
+    char name[64];
+    char val[128];
+    int nlen, len;
+    uint32_t queued_colls, queued_trims;
+
+    pthread_mutex_lock(&coll_del_lock);
+    queued_colls = coll_del_queue.size;
+    queued_trims = coll_del_ntrims;
+    pthread_mutex_unlock(&coll_del_lock);
+
+    pthread_mutex_lock(&engine->cache_lock);
+    len = sprintf(val, "%d", coll_del_nslots);
+    add_stat("coll_del:deleting_colls", 23, val, len, cookie);
+    len = sprintf(val, "%u", queued_colls);
+    add_stat("coll_del:queued_colls", 21, val, len, cookie);
+    len = sprintf(val, "%u", queued_trims);
+    add_stat("coll_del:queued_trims", 21, val, len, cookie);
+    len = sprintf(val, "%"PRIu64, coll_del_colls);
+    add_stat("coll_del:deleted_colls", 22, val, len, cookie);
+    len = sprintf(val, "%"PRIu64, coll_del_elems);
+    add_stat("coll_del:deleted_elems", 22, val, len, cookie);
+    len = sprintf(val, "%"PRIu64, coll_del_space);
+    add_stat("coll_del:reclaimed_bytes", 24, val, len, cookie);
+    for (int i = 0; i < coll_del_nslots; i++) {
+        coll_del_slot *slot = &coll_del_slots[i];
+        /* the progress of the collection being deleted */
+        coll_meta_info *info = (coll_meta_info *)item_get_meta(slot->it);
+        nlen = sprintf(name, "coll_del:coll%d:key", i);
+        add_stat(name, nlen, item_get_key(slot->it), slot->it->nkey, cookie);
+        nlen = sprintf(name, "coll_del:coll%d:deleted", i);
+        len = sprintf(val, "%u", slot->deleted);
+        add_stat(name, nlen, val, len, cookie);
+        nlen = sprintf(name, "coll_del:coll%d:remaining", i);
+        len = sprintf(val, "%u", info->ccnt);
+        add_stat(name, nlen, val, len, cookie);
+    }
+    pthread_mutex_unlock(&engine->cache_lock);
+}
+
 void item_stats_scrub(struct default_engine *engine,
                       ADD_STAT add_stat, const void *cookie)
 {
@@ -8937,6 +11361,61 @@ static ENGINE_ERROR_CODE do_map_elem_get(struct default_engine *engine,
     }
 }
 
+static ENGINE_ERROR_CODE do_map_elem_scan(map_meta_info *info,
+                                          const uint32_t cursor, const uint32_t count,
+                                          map_elem_item **elem_array, uint32_t *elem_count,
+                                          uint32_t *next_cursor)
+{
+    coll_scan_cand cand[MAP_MAX_HASHCHAIN_SIZE];
+    map_hash_node *node;
+    map_elem_item *elem;
+    uint64_t position = cursor;
+    uint64_t bucket_end;
+    uint32_t hval, rhval, ccnt, tcnt, i;
+    uint32_t fcnt = 0;
+    int hidx, shift;
+
+    while (info->root != NULL && fcnt < count && position < COLL_SCAN_END_POSITION) {
+        /* find the hash chain covering the position */
+        hval = do_coll_hash_reverse((uint32_t)position);
+        node = info->root;
+        hidx = MAP_GET_HASHIDX(hval, node->hdepth);
+        while (node->hcnt[hidx] == -1) {
+            node = node->htab[hidx];
+            hidx = MAP_GET_HASHIDX(hval, node->hdepth);
+        }
+        shift = do_coll_scan_shift(node->hdepth);
+        bucket_end = ((position >> shift) + 1) << shift;
+
+        ccnt = 0;
+        for (elem = node->htab[hidx]; elem != NULL; elem = elem->next) {
+            rhval = do_coll_hash_reverse(elem->hval);
+            if (rhval >= position) {
+                assert(ccnt < MAP_MAX_HASHCHAIN_SIZE);
+                cand[ccnt].rhval = rhval;
+                cand[ccnt].elem  = elem;
+                ccnt++;
+            }
+        }
+        tcnt = do_coll_scan_cand_take(cand, ccnt, count - fcnt, (fcnt == 0),
+                                      bucket_end, &position);
+        for (i = 0; i < tcnt; i++) {
+            elem = (map_elem_item *)cand[i].elem;
+            elem->refcount++;
+            elem_array[fcnt++] = elem;
+        }
+        if (tcnt < ccnt) break; /* no more space */
+    }
+
+    *next_cursor = (position < COLL_SCAN_END_POSITION ? (uint32_t)position : 0);
+    *elem_count = fcnt;
+    if (fcnt > 0) {
+        return ENGINE_SUCCESS;
+    } else {
+        return ENGINE_ELEM_ENOENT;
+    }
+}
+
 static ENGINE_ERROR_CODE do_map_elem_insert(struct default_engine *engine,
                                             hash_item *it, map_elem_item *elem,
                                             const bool replace_if_exist, const void *cookie)
@@ -8974,6 +11453,87 @@ static ENGINE_ERROR_CODE do_map_elem_insert(struct default_engine *engine,
     return ENGINE_SUCCESS;
 }
 
+static ENGINE_ERROR_CODE do_map_elem_arithmetic(struct default_engine *engine, hash_item *it,
+                                                const field_t *field,
+                                                const bool increment, const bool create,
+                                                const uint64_t delta, const uint64_t initial,
+                                                uint64_t *result, const void *cookie)
+{
+    map_meta_info *info = (map_meta_info *)item_get_meta(it);
+    map_prev_info  pinfo;
+    map_elem_item *elem = NULL;
+    ENGINE_ERROR_CODE ret;
+    uint64_t value;
+    char     nbuf[128];
+    int      nlen;
+
+    if (info->root != NULL) {
+        elem = do_map_elem_find(info->root, field, &pinfo);
+    }
+    if (elem == NULL) {
+        if (create != true) return ENGINE_ELEM_ENOENT;
+
+        if ((nlen = snprintf(nbuf, sizeof(nbuf), "%"PRIu64"\r\n", initial)) == -1) {
+            return ENGINE_EINVAL;
+        }
+
+        elem = do_map_elem_alloc(engine, field->length, nlen, cookie);
+        if (elem == NULL) {
+            return ENGINE_ENOMEM;
+        }
+        memcpy(elem->data, field->value, field->length);
+        memcpy(elem->data + field->length, nbuf, nlen);
+
+        ret = do_map_elem_insert(engine, it, elem, false /* replace_if_exist */, cookie);
+        do_map_elem_release(engine, elem);
+        if (ret != ENGINE_SUCCESS) {
+            assert(ret != ENGINE_ELEM_EEXISTS);
+            return ret; /* ENGINE_ENOMEM || ENGINE_EOVERFLOW */
+        }
+        *result = initial;
+    } else {
+        if (! safe_strtoull((const char*)elem->data + elem->nfield, &value) || elem->nbytes == 2) {
+            return ENGINE_EINVAL;
+        }
+
+        if (increment) {
+            value += delta;
+        } else {
+            if (delta >= value) {
+                value = 0;
+            } else {
+                value -= delta;
+            }
+        }
+        if ((nlen = snprintf(nbuf, sizeof(nbuf), "%"PRIu64"\r\n", value)) == -1) {
+            return ENGINE_EINVAL;
+        }
+
+        if (elem->refcount == 0 && elem->nbytes == nlen) {
+            /* do in-place update */
+            memcpy(elem->data + elem->nfield, nbuf, elem->nbytes);
+        } else {
+#ifdef ENABLE_STICKY_ITEM
+            /* sticky memory limit check : do not check it
+             * Because, the space difference is negligible.
+             */
+#endif
+            map_elem_item *new_elem = do_map_elem_alloc(engine, elem->nfield, nlen, cookie);
+            if (new_elem == NULL) {
+                return ENGINE_ENOMEM;
+            }
+            memcpy(new_elem->data, elem->data, elem->nfield);
+            memcpy(new_elem->data + elem->nfield, nbuf, nlen);
+            new_elem->hval = elem->hval;
+
+            do_map_elem_replace(engine, info, &pinfo, new_elem);
+            do_map_elem_release(engine, new_elem);
+        }
+        *result = value;
+    }
+    return ENGINE_SUCCESS;
+}
+
 /*
  * MAP Interface Functions
  */
@@ -8994,7 +11554,7 @@ ENGINE_ERROR_CODE map_struct_create(struct default_engine *engine,
         if (it == NULL) {
             ret = ENGINE_ENOMEM;
         } else {
-            ret = do_item_link(engine, it);
+            ret = do_coll_item_link(engine, it);
             do_item_release(engine, it);
         }
     }
@@ -9040,7 +11600,7 @@ ENGINE_ERROR_CODE map_elem_insert(struct default_engine *engine, const char *key
         if (it == NULL) {
             ret = ENGINE_ENOMEM;
         } else {
-            ret = do_item_link(engine, it);
+            ret = do_coll_item_link(engine, it);
             if (ret == ENGINE_SUCCESS) {
                 *created = true;
             } else {
@@ -9077,6 +11637,27 @@ ENGINE_ERROR_CODE map_elem_update(struct default_engine *engine, const char *key
     return ret;
 }
 
+ENGINE_ERROR_CODE map_elem_arithmetic(struct default_engine *engine,
+                                      const char *key, const size_t nkey,
+                                      const field_t *field,
+                                      const bool increment, const bool create,
+                                      const uint64_t delta, const uint64_t initial,
+                                      uint64_t *result, const void *cookie)
+{
+    hash_item *it;
+    ENGINE_ERROR_CODE ret;
+
+    pthread_mutex_lock(&engine->cache_lock);
+    ret = do_map_item_find(engine, key, nkey, DONT_UPDATE, &it);
+    if (ret == ENGINE_SUCCESS) { /* it != NULL */
+        ret = do_map_elem_arithmetic(engine, it, field, increment, create,
+                                     delta, initial, result, cookie);
+        do_item_release(engine, it);
+    }
+    pthread_mutex_unlock(&engine->cache_lock);
+    return ret;
+}
+
 ENGINE_ERROR_CODE map_elem_delete(struct default_engine *engine, const char *key, const size_t nkey,
                                   const int numfields, const field_t *flist, const bool drop_if_empty,
                                   uint32_t *del_count, bool *dropped)
@@ -9141,3 +11722,32 @@ ENGINE_ERROR_CODE map_elem_get(struct default_engine *engine, const char *key, c
     pthread_mutex_unlock(&engine->cache_lock);
     return ret;
 }
+
+ENGINE_ERROR_CODE map_elem_scan(struct default_engine *engine,
+                                const char *key, const size_t nkey,
+                                const uint32_t cursor, const uint32_t count,
+                                map_elem_item **elem_array, uint32_t *elem_count,
+                                uint32_t *next_cursor, uint32_t *flags)
+{
+    hash_item     *it;
+    map_meta_info *info;
+    ENGINE_ERROR_CODE ret;
+
+    pthread_mutex_lock(&engine->cache_lock);
+    ret = do_map_item_find(engine, key, nkey, DO_UPDATE, &it);
+    if (ret == ENGINE_SUCCESS) {
+        info = (map_meta_info *)item_get_meta(it);
+        do {
+            if ((info->mflags & COLL_META_FLAG_READABLE) == 0) {
+                ret = ENGINE_UNREADABLE; break;
+            }
+            ret = do_map_elem_scan(info, cursor, count, elem_array, elem_count, next_cursor);
+            if (ret == ENGINE_SUCCESS) {
+                *flags = it->flags;
+            } /* ret = ENGINE_ELEM_ENOENT */
+        } while (0);
+        do_item_release(engine, it);
+    }
+    pthread_mutex_unlock(&engine->cache_lock);
+    return ret;
+}
@@ -26,6 +26,7 @@
 #define ITEM_IFLAG_BTREE 4   /* b+tree item */
 #define ITEM_IFLAG_COLL  7   /* collection item: list/set/map/b+tree */
 /* 2) item flag: decreasing order */
+#define ITEM_LEASE       16  /* lease placeholder of a missing item */
 #define ITEM_LINKED      32  /* linked to assoc hash table */
 #define ITEM_INTERNAL    64  /* internal cache item */
 #define ITEM_WITH_CAS    128 /* having CAS value */
@@ -37,6 +38,7 @@
 #define IS_MAP_ITEM(it)   (((it)->iflag & ITEM_IFLAG_COLL) == ITEM_IFLAG_MAP)
 #define IS_BTREE_ITEM(it) (((it)->iflag & ITEM_IFLAG_COLL) == ITEM_IFLAG_BTREE)
 #define IS_COLL_ITEM(it)  (((it)->iflag & ITEM_IFLAG_COLL) != 0)
+#define IS_LEASE_ITEM(it) (((it)->iflag & ITEM_LEASE) != 0)
 
 /* collection meta flag */
 #define COLL_META_FLAG_READABLE 2
@@ -140,6 +142,7 @@ typedef struct _set_hash_node {
     uint16_t tot_elem_cnt;
     uint16_t tot_hash_cnt;
     int16_t  hcnt[SET_HASHTAB_SIZE];
+    uint32_t sub_elem_cnt;        /* element count of the subtree rooted at this node */
     void    *htab[SET_HASHTAB_SIZE];
 } set_hash_node;
 
@@ -180,7 +183,17 @@ typedef struct _map_meta_info {
 
 /* btree meta info */
 #define BTREE_MAX_DEPTH  7
-#define BTREE_ITEM_COUNT 32 /* Recommend BTREE_ITEM_COUNT >= 8 */
+#ifndef BTREE_ITEM_COUNT /* it can be given by configure --with-btree-fanout */
+#define BTREE_ITEM_COUNT 32
+#endif
+/* The half-full nodes of BTREE_MAX_DEPTH must hold ARCUS_COLL_SIZE_LIMIT(1M) elements. */
+#if BTREE_ITEM_COUNT < 16 || BTREE_ITEM_COUNT > 1024
+#error "BTREE_ITEM_COUNT must be in the range of 16 ~ 1024"
+#endif
+/* A full node shifts its items into a neighbor node having fewer items than this. */
+#define BTREE_SHIFT_LIMIT ((BTREE_ITEM_COUNT*3)/4)
+/* The nodes built by appending sorted elements are filled up to this. */
+#define BTREE_BULK_FILL_COUNT BTREE_ITEM_COUNT
 
 typedef struct _btree_leaf_node {
     uint16_t refcount;
@@ -191,6 +204,7 @@ typedef struct _btree_leaf_node {
     struct _btree_indx_node *prev;
     struct _btree_indx_node *next;
     void    *item[BTREE_ITEM_COUNT];
+    uint64_t ikey[BTREE_ITEM_COUNT]; /* inline bkeys of the elements */
 } btree_leaf_node;
 
 typedef struct _btree_indx_node {
@@ -202,9 +216,34 @@ typedef struct _btree_indx_node {
     struct _btree_indx_node *prev;
     struct _btree_indx_node *next;
     void    *item[BTREE_ITEM_COUNT];
+    uint64_t ikey[BTREE_ITEM_COUNT]; /* inline bkeys: lower bounds of the child nodes */
     uint32_t ecnt[BTREE_ITEM_COUNT];
 } btree_indx_node;
 
+/* b+tree eflag index: eflag field value => elements */
+#define BTREE_EINDEX_MIN_HBITS 6
+#define BTREE_EINDEX_MAX_HBITS 14
+
+typedef struct _btree_eindex_entry {
+    uint16_t refcount;
+    uint8_t  slabs_clsid;      /* which slab class we're in */
+    uint8_t  reserved[5];
+    struct _btree_eindex_entry *vnext; /* eflag value hash chain */
+    struct _btree_eindex_entry *vprev;
+    struct _btree_eindex_entry *bnext; /* bkey hash chain */
+    btree_elem_item *elem;
+} btree_eindex_entry;
+
+typedef struct _btree_eindex_table {
+    uint16_t refcount;
+    uint8_t  slabs_clsid;      /* which slab class we're in */
+    uint8_t  hbits;            /* hash table size = (1 << hbits) */
+    uint32_t count;            /* # of indexed elements */
+    btree_eindex_entry **vtab; /* eflag value hash table */
+    btree_eindex_entry **btab; /* bkey hash table: used to find the entry of an element */
+    uint32_t *vcnt;            /* # of entries in each eflag value hash chain */
+} btree_eindex_table;
+
 typedef struct _btree_meta_info {
     int32_t  mcnt;      /* maximum count */
     int32_t  ccnt;      /* current count */
@@ -213,9 +252,12 @@ typedef struct _btree_meta_info {
     uint16_t itdist;    /* distance from hash item (unit: sizeof(size_t)) */
     uint32_t stotal;    /* total space */
     uint8_t  bktype;    /* bkey type : BKEY_TYPE_UINT64 or BKEY_TYPE_BINARY */
-    uint8_t  dummy[7];  /* reserved space */
+    uint8_t  eifwhere;  /* eflag index: offset of the indexed eflag field */
+    uint8_t  eiflength; /* eflag index: length of the indexed eflag field (0: no index) */
+    uint8_t  dummy[5];  /* reserved space */
     bkey_t   maxbkeyrange;
     btree_indx_node *root;
+    btree_eindex_table *eindex; /* eflag index: allocated on the first indexed element */
 } btree_meta_info;
 
 /* btree element position */
@@ -234,7 +276,7 @@ typedef struct _btree_scan_info {
     hash_item       *it;
     btree_elem_posi  posi;
     uint32_t         kidx; /* An index in the given key array as a parameter */
-    int32_t          next; /* for free scan link */
+    int32_t          next; /* for free scan link or bkey hash chain of smget */
 } btree_scan_info;
 
 /* common meta info of list and set */
@@ -396,6 +438,8 @@ ENGINE_ERROR_CODE item_delete(struct default_engine *engine,
                               uint64_t cas);
 
 void coll_del_thread_wakeup(void);
+void item_stats_coll_del(struct default_engine *engine,
+                         ADD_STAT add_stat, const void *cookie);
 
 ENGINE_ERROR_CODE item_init(struct default_engine *engine);
 
@@ -417,6 +461,13 @@ ENGINE_ERROR_CODE list_elem_insert(struct default_engine *engine,
                                    item_attr *attrp,
                                    bool *created, const void *cookie);
 
+ENGINE_ERROR_CODE list_elem_insert_bulk(struct default_engine *engine,
+                                        const char *key, const size_t nkey,
+                                        int index, list_elem_item **elem_array,
+                                        const uint32_t elem_count, item_attr *attrp,
+                                        bool *created, uint32_t *ins_count,
+                                        const void *cookie);
+
 ENGINE_ERROR_CODE list_elem_delete(struct default_engine *engine,
                                    const char *key, const size_t nkey,
                                    int from_index, int to_index,
@@ -446,6 +497,12 @@ ENGINE_ERROR_CODE set_elem_insert(struct default_engine *engine,
                                   item_attr *attrp,
                                   bool *created, const void *cookie);
 
+ENGINE_ERROR_CODE set_elem_insert_bulk(struct default_engine *engine,
+                                       const char *key, const size_t nkey,
+                                       set_elem_item **elem_array, const uint32_t elem_count,
+                                       item_attr *attrp, bool *created,
+                                       uint32_t *ins_count, const void *cookie);
+
 ENGINE_ERROR_CODE set_elem_delete(struct default_engine *engine,
                                   const char *key, const size_t nkey,
                                   const char *value, const size_t nbytes,
@@ -459,10 +516,24 @@ ENGINE_ERROR_CODE set_elem_exist(struct default_engine *engine,
 
 ENGINE_ERROR_CODE set_elem_get(struct default_engine *engine,
                                const char *key, const size_t nkey, const uint32_t count,
-                               const bool delete, const bool drop_if_empty,
+                               const bool delete, const bool drop_if_empty, const bool random,
                                set_elem_item **elem_array, uint32_t *elem_count,
                                uint32_t *flags, bool *dropped);
 
+ENGINE_ERROR_CODE set_elem_scan(struct default_engine *engine,
+                                const char *key, const size_t nkey,
+                                const uint32_t cursor, const uint32_t count,
+                                set_elem_item **elem_array, uint32_t *elem_count,
+                                uint32_t *next_cursor, uint32_t *flags);
+
+ENGINE_ERROR_CODE set_elem_get_chunk(struct default_engine *engine,
+                                     const char *key, const size_t nkey,
+                                     hash_item **item, uint32_t *cursor,
+                                     const uint32_t count, const bool delete,
+                                     const bool drop_if_empty, const bool random,
+                                     set_elem_item **elem_array, uint32_t *elem_count,
+                                     uint32_t *flags, bool *dropped);
+
 ENGINE_ERROR_CODE map_struct_create(struct default_engine *engine,
                                     const char *key, const size_t nkey,
                                     item_attr *attrp, const void *cookie);
@@ -485,6 +556,13 @@ ENGINE_ERROR_CODE map_elem_update(struct default_engine *engine,
                                   const char *value, const int nbytes,
                                   const void *cookie);
 
+ENGINE_ERROR_CODE map_elem_arithmetic(struct default_engine *engine,
+                                      const char *key, const size_t nkey,
+                                      const field_t *field,
+                                      const bool increment, const bool create,
+                                      const uint64_t delta, const uint64_t initial,
+                                      uint64_t *result, const void *cookie);
+
 ENGINE_ERROR_CODE map_elem_delete(struct default_engine *engine,
                                   const char *key, const size_t nkey,
                                   const int numfields, const field_t *flist,
@@ -497,6 +575,12 @@ ENGINE_ERROR_CODE map_elem_get(struct default_engine *engine,
                                const bool drop_if_empty, map_elem_item **elem_array,
                                uint32_t *elem_count, uint32_t *flags, bool *dropped);
 
+ENGINE_ERROR_CODE map_elem_scan(struct default_engine *engine,
+                                const char *key, const size_t nkey,
+                                const uint32_t cursor, const uint32_t count,
+                                map_elem_item **elem_array, uint32_t *elem_count,
+                                uint32_t *next_cursor, uint32_t *flags);
+
 ENGINE_ERROR_CODE btree_struct_create(struct default_engine *engine,
                                       const char *key, const size_t nkey,
                                       item_attr *attrp, const void *cookie);
@@ -514,6 +598,12 @@ ENGINE_ERROR_CODE btree_elem_insert(struct default_engine *engine,
                                     bool *replaced, bool *created, btree_elem_item **trimmed_elems,
                                     uint32_t *trimmed_count, uint32_t *trimmed_flags, const void *cookie);
 
+ENGINE_ERROR_CODE btree_elem_insert_bulk(struct default_engine *engine,
+                                         const char *key, const size_t nkey,
+                                         btree_elem_item **elem_array, const uint32_t elem_count,
+                                         item_attr *attrp, bool *created,
+                                         uint32_t *ins_count, const void *cookie);
+
 ENGINE_ERROR_CODE btree_elem_update(struct default_engine *engine,
                                     const char *key, const size_t nkey, const bkey_range *bkrange,
                                     const eflag_update *eupdate, const char *value, const int nbytes,
@@ -563,6 +653,11 @@ ENGINE_ERROR_CODE btree_elem_get_by_posi(struct default_engine *engine,
                                   ENGINE_BTREE_ORDER order, int from_posi, int to_posi,
                                   btree_elem_item **elem_array, uint32_t *elem_count, uint32_t *flags);
 
+ENGINE_ERROR_CODE btree_elem_aggregate(struct default_engine *engine,
+                                       const char *key, const size_t nkey,
+                                       const bkey_range *bkrange, const eflag_filter *efilter,
+                                       const bop_aggr_spec *spec, bop_aggr_result *result);
+
 #ifdef SUPPORT_BOP_SMGET
 #ifdef JHPARK_OLD_SMGET_INTERFACE
 /* smget old interface */
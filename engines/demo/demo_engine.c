@@ -306,6 +306,17 @@ Demo_list_elem_insert(ENGINE_HANDLE* handle, const void* cookie,
     return ENGINE_ENOTSUP;
 }
 
+static ENGINE_ERROR_CODE
+Demo_list_elem_insert_bulk(ENGINE_HANDLE* handle, const void* cookie,
+                           const void* key, const int nkey,
+                           int index, eitem **eitem_array,
+                           const uint32_t eitem_count,
+                           item_attr *attrp, bool *created,
+                           uint32_t *ins_count, uint16_t vbucket)
+{
+    return ENGINE_ENOTSUP;
+}
+
 static ENGINE_ERROR_CODE
 Demo_list_elem_delete(ENGINE_HANDLE* handle, const void* cookie,
                          const void* key, const int nkey,
@@ -361,6 +372,16 @@ Demo_set_elem_insert(ENGINE_HANDLE* handle, const void* cookie,
     return ENGINE_ENOTSUP;
 }
 
+static ENGINE_ERROR_CODE
+Demo_set_elem_insert_bulk(ENGINE_HANDLE* handle, const void* cookie,
+                          const void* key, const int nkey,
+                          eitem **eitem_array, const uint32_t eitem_count,
+                          item_attr *attrp, bool *created,
+                          uint32_t *ins_count, uint16_t vbucket)
+{
+    return ENGINE_ENOTSUP;
+}
+
 static ENGINE_ERROR_CODE
 Demo_set_elem_delete(ENGINE_HANDLE* handle, const void* cookie,
                         const void* key, const int nkey,
@@ -383,13 +404,34 @@ Demo_set_elem_exist(ENGINE_HANDLE* handle, const void* cookie,
 static ENGINE_ERROR_CODE
 Demo_set_elem_get(ENGINE_HANDLE* handle, const void* cookie,
                      const void* key, const int nkey, const uint32_t count,
-                     const bool delete, const bool drop_if_empty,
+                     const bool delete, const bool drop_if_empty, const bool random,
                      eitem** eitem, uint32_t* eitem_count,
                      uint32_t* flags, bool* dropped, uint16_t vbucket)
 {
     return ENGINE_ENOTSUP;
 }
 
+static ENGINE_ERROR_CODE
+Demo_set_elem_scan(ENGINE_HANDLE* handle, const void* cookie,
+                      const void* key, const int nkey,
+                      const uint32_t cursor, const uint32_t count,
+                      eitem** eitem, uint32_t* eitem_count,
+                      uint32_t* next_cursor, uint32_t* flags, uint16_t vbucket)
+{
+    return ENGINE_ENOTSUP;
+}
+
+static ENGINE_ERROR_CODE
+Demo_set_elem_get_chunk(ENGINE_HANDLE* handle, const void* cookie,
+                        const void* key, const int nkey,
+                        item** item, uint32_t* cursor, const uint32_t count,
+                        const bool delete, const bool drop_if_empty, const bool random,
+                        eitem** eitem, uint32_t* eitem_count,
+                        uint32_t* flags, bool* dropped, uint16_t vbucket)
+{
+    return ENGINE_ENOTSUP;
+}
+
 /*
  * Map Collection API
  */
@@ -433,6 +475,16 @@ Demo_map_elem_update(ENGINE_HANDLE* handle, const void* cookie,
     return ENGINE_ENOTSUP;
 }
 
+static ENGINE_ERROR_CODE
+Demo_map_elem_arithmetic(ENGINE_HANDLE* handle, const void* cookie,
+                            const void* key, const int nkey, const field_t *field,
+                            const bool increment, const bool create,
+                            const uint64_t delta, const uint64_t initial,
+                            uint64_t *result, uint16_t vbucket)
+{
+    return ENGINE_ENOTSUP;
+}
+
 static ENGINE_ERROR_CODE
 Demo_map_elem_delete(ENGINE_HANDLE* handle, const void* cookie,
                         const void* key, const int nkey, const int numfields,
@@ -452,6 +504,16 @@ Demo_map_elem_get(ENGINE_HANDLE* handle, const void* cookie,
     return ENGINE_ENOTSUP;
 }
 
+static ENGINE_ERROR_CODE
+Demo_map_elem_scan(ENGINE_HANDLE* handle, const void* cookie,
+                      const void* key, const int nkey,
+                      const uint32_t cursor, const uint32_t count,
+                      eitem** eitem, uint32_t* eitem_count,
+                      uint32_t* next_cursor, uint32_t* flags, uint16_t vbucket)
+{
+    return ENGINE_ENOTSUP;
+}
+
 /*
  * B+Tree Collection API
  */
@@ -491,6 +553,16 @@ Demo_btree_elem_insert(ENGINE_HANDLE* handle, const void* cookie,
     return ENGINE_ENOTSUP;
 }
 
+static ENGINE_ERROR_CODE
+Demo_btree_elem_insert_bulk(ENGINE_HANDLE* handle, const void* cookie,
+                            const void* key, const int nkey,
+                            eitem **eitem_array, const uint32_t eitem_count,
+                            item_attr *attrp, bool *created,
+                            uint32_t *ins_count, uint16_t vbucket)
+{
+    return ENGINE_ENOTSUP;
+}
+
 static ENGINE_ERROR_CODE
 Demo_btree_elem_update(ENGINE_HANDLE* handle, const void* cookie,
                           const void* key, const int nkey,
@@ -579,6 +651,16 @@ Demo_btree_elem_get_by_posi(ENGINE_HANDLE* handle, const void* cookie,
     return ENGINE_ENOTSUP;
 }
 
+static ENGINE_ERROR_CODE
+Demo_btree_elem_aggregate(ENGINE_HANDLE* handle, const void* cookie,
+                          const void* key, const int nkey,
+                          const bkey_range *bkrange, const eflag_filter *efilter,
+                          const bop_aggr_spec *spec, bop_aggr_result *result,
+                          uint16_t vbucket)
+{
+    return ENGINE_ENOTSUP;
+}
+
 #ifdef SUPPORT_BOP_SMGET
 /* smget new interface */
 static ENGINE_ERROR_CODE
@@ -770,6 +852,7 @@ create_instance(uint64_t interface, GET_SERVER_API get_server_api,
          .list_elem_alloc   = Demo_list_elem_alloc,
          .list_elem_release = Demo_list_elem_release,
          .list_elem_insert  = Demo_list_elem_insert,
+         .list_elem_insert_bulk = Demo_list_elem_insert_bulk,
          .list_elem_delete  = Demo_list_elem_delete,
          .list_elem_get     = Demo_list_elem_get,
          /* SET Colleciton API */
@@ -777,22 +860,28 @@ create_instance(uint64_t interface, GET_SERVER_API get_server_api,
          .set_elem_alloc    = Demo_set_elem_alloc,
          .set_elem_release  = Demo_set_elem_release,
          .set_elem_insert   = Demo_set_elem_insert,
+         .set_elem_insert_bulk = Demo_set_elem_insert_bulk,
          .set_elem_delete   = Demo_set_elem_delete,
          .set_elem_exist    = Demo_set_elem_exist,
          .set_elem_get      = Demo_set_elem_get,
+         .set_elem_scan     = Demo_set_elem_scan,
+         .set_elem_get_chunk = Demo_set_elem_get_chunk,
          /* MAP Collection API */
          .map_struct_create = Demo_map_struct_create,
          .map_elem_alloc    = Demo_map_elem_alloc,
          .map_elem_release  = Demo_map_elem_release,
          .map_elem_insert   = Demo_map_elem_insert,
          .map_elem_update   = Demo_map_elem_update,
+         .map_elem_arithmetic = Demo_map_elem_arithmetic,
          .map_elem_delete   = Demo_map_elem_delete,
          .map_elem_get      = Demo_map_elem_get,
+         .map_elem_scan     = Demo_map_elem_scan,
          /* B+Tree Collection API */
          .btree_struct_create = Demo_btree_struct_create,
          .btree_elem_alloc   = Demo_btree_elem_alloc,
          .btree_elem_release = Demo_btree_elem_release,
          .btree_elem_insert  = Demo_btree_elem_insert,
+         .btree_elem_insert_bulk = Demo_btree_elem_insert_bulk,
          .btree_elem_update  = Demo_btree_elem_update,
          .btree_elem_delete  = Demo_btree_elem_delete,
          .btree_elem_arithmetic  = Demo_btree_elem_arithmetic,
@@ -801,6 +890,7 @@ create_instance(uint64_t interface, GET_SERVER_API get_server_api,
          .btree_posi_find    = Demo_btree_posi_find,
          .btree_posi_find_with_get = Demo_btree_posi_find_with_get,
          .btree_elem_get_by_posi = Demo_btree_elem_get_by_posi,
+         .btree_elem_aggregate = Demo_btree_elem_aggregate,
 #ifdef SUPPORT_BOP_SMGET
          .btree_elem_smget   = Demo_btree_elem_smget,
 #endif
@@ -360,6 +360,13 @@ extern "C" {
                                               item_attr *attrp, bool *created,
                                               uint16_t vbucket);
 
+        ENGINE_ERROR_CODE (*list_elem_insert_bulk)(ENGINE_HANDLE* handle, const void* cookie,
+                                                   const void* key, const int nkey,
+                                                   int index, eitem **eitem_array,
+                                                   const uint32_t eitem_count,
+                                                   item_attr *attrp, bool *created,
+                                                   uint32_t *ins_count, uint16_t vbucket);
+
         ENGINE_ERROR_CODE (*list_elem_delete)(ENGINE_HANDLE* handle, const void* cookie,
                                               const void* key, const int nkey,
                                               int from_index, int to_index,
@@ -394,6 +401,12 @@ extern "C" {
                                              item_attr *attrp, bool *created,
                                              uint16_t vbucket);
 
+        ENGINE_ERROR_CODE (*set_elem_insert_bulk)(ENGINE_HANDLE* handle, const void* cookie,
+                                                  const void* key, const int nkey,
+                                                  eitem **eitem_array, const uint32_t eitem_count,
+                                                  item_attr *attrp, bool *created,
+                                                  uint32_t *ins_count, uint16_t vbucket);
+
         ENGINE_ERROR_CODE (*set_elem_delete)(ENGINE_HANDLE* handle, const void* cookie,
                                              const void* key, const int nkey,
                                              const void* value, const int nbytes,
@@ -409,10 +422,28 @@ extern "C" {
                                           const void* key, const int nkey,
                                           const uint32_t count,
                                           const bool delete, const bool drop_if_empty,
+                                          const bool random,
                                           eitem** eitem, uint32_t* eitem_count,
                                           uint32_t* flags, bool* dropped,
                                           uint16_t vbucket);
 
+        ENGINE_ERROR_CODE (*set_elem_scan)(ENGINE_HANDLE* handle, const void* cookie,
+                                           const void* key, const int nkey,
+                                           const uint32_t cursor, const uint32_t count,
+                                           eitem** eitem, uint32_t* eitem_count,
+                                           uint32_t* next_cursor, uint32_t* flags,
+                                           uint16_t vbucket);
+
+        ENGINE_ERROR_CODE (*set_elem_get_chunk)(ENGINE_HANDLE* handle, const void* cookie,
+                                                const void* key, const int nkey,
+                                                item** item, uint32_t* cursor,
+                                                const uint32_t count,
+                                                const bool delete, const bool drop_if_empty,
+                                                const bool random,
+                                                eitem** eitem, uint32_t* eitem_count,
+                                                uint32_t* flags, bool* dropped,
+                                                uint16_t vbucket);
+
         /*
          * MAP Interface
          */
@@ -449,6 +480,17 @@ extern "C" {
                                              const void* value,
                                              const int nbytes,
                                              uint16_t vbucket);
+        ENGINE_ERROR_CODE (*map_elem_arithmetic)(ENGINE_HANDLE* handle,
+                                                 const void* cookie,
+                                                 const void* key,
+                                                 const int nkey,
+                                                 const field_t *field,
+                                                 const bool increment,
+                                                 const bool create,
+                                                 const uint64_t delta,
+                                                 const uint64_t initial,
+                                                 uint64_t *result,
+                                                 uint16_t vbucket);
         ENGINE_ERROR_CODE (*map_elem_delete)(ENGINE_HANDLE* handle,
                                              const void* cookie,
                                              const void* key,
@@ -472,6 +514,17 @@ extern "C" {
                                           uint32_t* flags,
                                           bool* dropped,
                                           uint16_t vbucket);
+        ENGINE_ERROR_CODE (*map_elem_scan)(ENGINE_HANDLE* handle,
+                                           const void* cookie,
+                                           const void* key,
+                                           const int nkey,
+                                           const uint32_t cursor,
+                                           const uint32_t count,
+                                           eitem** eitem,
+                                           uint32_t* eitem_count,
+                                           uint32_t* next_cursor,
+                                           uint32_t* flags,
+                                           uint16_t vbucket);
 
         /*
          * B+Tree Interface
@@ -496,6 +549,12 @@ extern "C" {
                                               eitem_result *trimmed,
                                               uint16_t vbucket);
 
+        ENGINE_ERROR_CODE (*btree_elem_insert_bulk)(ENGINE_HANDLE* handle, const void* cookie,
+                                                   const void* key, const int nkey,
+                                                   eitem **eitem_array, const uint32_t eitem_count,
+                                                   item_attr *attrp, bool *created,
+                                                   uint32_t *ins_count, uint16_t vbucket);
+
         ENGINE_ERROR_CODE (*btree_elem_update)(ENGINE_HANDLE* handle, const void* cookie,
                                               const void* key, const int nkey,
                                               const bkey_range *bkrange,
@@ -560,6 +619,14 @@ extern "C" {
                                              eitem **eitem_array, uint32_t *eitem_count,
                                              uint32_t *flags, uint16_t vbucket);
 
+        ENGINE_ERROR_CODE (*btree_elem_aggregate)(ENGINE_HANDLE* handle, const void* cookie,
+                                                  const void* key, const int nkey,
+                                                  const bkey_range *bkrange,
+                                                  const eflag_filter *efilter,
+                                                  const bop_aggr_spec *spec,
+                                                  bop_aggr_result *result,
+                                                  uint16_t vbucket);
+
 #ifdef SUPPORT_BOP_SMGET
 #ifdef JHPARK_OLD_SMGET_INTERFACE
         /* smget old interface */
@@ -218,6 +218,17 @@ extern "C"
         PROTOCOL_BINARY_CMD_BOP_DELETEQ = 0x7f,
         /* End B+Tree */
 
+        /* MAP commands */
+        PROTOCOL_BINARY_CMD_MOP_CREATE  = 0x80,
+        PROTOCOL_BINARY_CMD_MOP_INSERT  = 0x81,
+        PROTOCOL_BINARY_CMD_MOP_UPDATE  = 0x82,
+        PROTOCOL_BINARY_CMD_MOP_DELETE  = 0x83,
+        PROTOCOL_BINARY_CMD_MOP_GET     = 0x84,
+        PROTOCOL_BINARY_CMD_MOP_INSERTQ = 0x85,
+        PROTOCOL_BINARY_CMD_MOP_UPDATEQ = 0x86,
+        PROTOCOL_BINARY_CMD_MOP_DELETEQ = 0x87,
+        /* End MAP */
+
         PROTOCOL_BINARY_CMD_FLUSH_PREFIX = 0x90,
 
         PROTOCOL_BINARY_CMD_LAST_RESERVED = 0xef,
@@ -662,7 +673,7 @@ extern "C"
                 uint32_t count;
                 uint8_t delete;
                 uint8_t drop;
-                uint8_t reserved2;
+                uint8_t random;
                 uint8_t reserved3;
             } body;
         } message;
@@ -694,6 +705,101 @@ extern "C"
         uint8_t bytes[sizeof(protocol_binary_response_header) + 4];
     } protocol_binary_response_sop_exist;
 
+    /**
+     * Definition of the structure used by mop insert/update/delete/get command.
+     * The field string precedes the value in the body of insert and update.
+     * The field list of delete and get is a space separated string.
+     * See section 4
+     */
+    typedef union {
+        struct {
+            protocol_binary_request_header header;
+            struct {
+                uint32_t flags;
+                int32_t  exptime;
+                int32_t  maxcount;
+                uint8_t  ovflaction;
+                uint8_t  readable;
+                uint8_t  reserved1;
+                uint8_t  reserved2;
+            } body;
+        } message;
+        uint8_t bytes[sizeof(protocol_binary_request_header) + 16];
+    } protocol_binary_request_mop_create;
+
+    typedef union {
+        struct {
+            protocol_binary_request_header header;
+            struct {
+                uint32_t flags;
+                int32_t  exptime;
+                int32_t  maxcount;
+                uint8_t  create;
+                uint8_t  nfield;
+                uint8_t  reserved1;
+                uint8_t  reserved2;
+            } body;
+        } message;
+        uint8_t bytes[sizeof(protocol_binary_request_header) + 16];
+    } protocol_binary_request_mop_insert;
+
+    typedef union {
+        struct {
+            protocol_binary_request_header header;
+            struct {
+                uint8_t  nfield;
+                uint8_t  reserved1;
+                uint8_t  reserved2;
+                uint8_t  reserved3;
+            } body;
+        } message;
+        uint8_t bytes[sizeof(protocol_binary_request_header) + 4];
+    } protocol_binary_request_mop_update;
+
+    typedef union {
+        struct {
+            protocol_binary_request_header header;
+            struct {
+                uint32_t numfields;
+                uint8_t  drop;
+                uint8_t  reserved1;
+                uint8_t  reserved2;
+                uint8_t  reserved3;
+            } body;
+        } message;
+        uint8_t bytes[sizeof(protocol_binary_request_header) + 8];
+    } protocol_binary_request_mop_delete;
+
+    typedef union {
+        struct {
+            protocol_binary_request_header header;
+            struct {
+                uint32_t numfields;
+                uint8_t  delete;
+                uint8_t  drop;
+                uint8_t  reserved1;
+                uint8_t  reserved2;
+            } body;
+        } message;
+        uint8_t bytes[sizeof(protocol_binary_request_header) + 8];
+    } protocol_binary_request_mop_get;
+
+    typedef protocol_binary_response_no_extras protocol_binary_response_mop_create;
+    typedef protocol_binary_response_no_extras protocol_binary_response_mop_insert;
+    typedef protocol_binary_response_no_extras protocol_binary_response_mop_update;
+    typedef protocol_binary_response_no_extras protocol_binary_response_mop_delete;
+
+    typedef union {
+        struct {
+            protocol_binary_response_header header;
+            struct {
+                uint32_t flags;
+                uint32_t count;
+            } body;
+        } message;
+        uint8_t bytes[sizeof(protocol_binary_response_header) + 8];
+    } protocol_binary_response_mop_get;
+
     /**
      * Definition of the structure used by b+tree insert/delete/get command.
      * See section 4
@@ -93,7 +93,8 @@ extern "C" {
         OPERATION_REPLACE, /**< Store with replace semantics */
         OPERATION_APPEND,  /**< Store with append semantics */
         OPERATION_PREPEND, /**< Store with prepend semantics */
-        OPERATION_CAS      /**< Store with set semantics. */
+        OPERATION_CAS,     /**< Store with set semantics. */
+        OPERATION_LEASE    /**< Store a lease placeholder of a missing item */
     } ENGINE_STORE_OPERATION;
 
     /**
@@ -112,6 +113,7 @@ extern "C" {
         OPERATION_LOP_INSERT,        /**< List operation with insert element semantics */
         OPERATION_LOP_DELETE,        /**< List operation with delete element semantics */
         OPERATION_LOP_GET,           /**< List operation with get element semantics */
+        OPERATION_LOP_MINSERT,       /**< List operation with insert multiple elements semantics */
 
         /* set operation */
         OPERATION_SOP_CREATE = 0x60, /**< Set operation with create structure semantics */
@@ -119,6 +121,7 @@ extern "C" {
         OPERATION_SOP_DELETE,        /**< Set operation with delete element semantics */
         OPERATION_SOP_EXIST,         /**< Set operation with check existence of element semantics */
         OPERATION_SOP_GET,           /**< Set operation with get element semantics */
+        OPERATION_SOP_MINSERT,       /**< Set operation with insert multiple elements semantics */
 
         /* map operation */
         OPERATION_MOP_CREATE = 0x70, /**< Map operation with create structure semantics */
@@ -141,7 +144,8 @@ extern "C" {
         // SUPPORT_BOP_MGET
         OPERATION_BOP_MGET,          /**< B+tree operation with mget(multiple get) element semantics */
         // SUPPORT_BOP_SMGET
-        OPERATION_BOP_SMGET          /**< B+tree operation with smget(sort-merge get) element semantics */
+        OPERATION_BOP_SMGET,         /**< B+tree operation with smget(sort-merge get) element semantics */
+        OPERATION_BOP_MINSERT        /**< B+tree operation with insert multiple elements semantics */
     } ENGINE_COLL_OPERATION;
 
     /* item type */
@@ -349,6 +353,36 @@ extern "C" {
         bool          ascending;  /* bkey order of found elements: ascending ? */
     } smget_result_t;
 
+    /* bop aggregate operand */
+#define BOP_AGGR_OPERAND_NONE  0 /* count only */
+#define BOP_AGGR_OPERAND_VALUE 1 /* element value parsed as an integer */
+#define BOP_AGGR_OPERAND_EFLAG 2 /* eflag byte range as a big-endian integer */
+
+    /* bop aggregate specification */
+    typedef struct {
+        uint8_t  operand;  /* BOP_AGGR_OPERAND_XXX */
+        uint8_t  fwhere;   /* eflag operand offset */
+        uint8_t  flength;  /* eflag operand length: 1 ~ 8 */
+        uint8_t  gwhere;   /* eflag group field offset */
+        uint8_t  glength;  /* eflag group field length: 0(no group) ~ MAX_EFLAG_LENG */
+    } bop_aggr_spec;
+
+    /* aggregated values of a group */
+    typedef struct {
+        unsigned char gfield[MAX_EFLAG_LENG]; /* group field value */
+        uint32_t count;
+        int64_t  sum;
+        int64_t  min;
+        int64_t  max;
+    } bop_aggr_group;
+
+    /* bop aggregate result structure */
+    typedef struct {
+        bop_aggr_group *groups;      /* aggregated groups sorted by group field */
+        uint32_t        group_count; /* # of groups */
+        uint32_t        group_arrsz; /* group array size */
+    } bop_aggr_result;
+
     /* item attribute structure */
     typedef struct {
         uint32_t flags; /**< Flags associated with the item (in network byte order)*/
@@ -363,6 +397,8 @@ extern "C" {
         uint8_t  ovflaction;
         uint8_t  readable;
         uint8_t  trimmed;
+        uint8_t  eifwhere;  /* b+tree eflag index: offset of the indexed eflag field */
+        uint8_t  eiflength; /* b+tree eflag index: length of the indexed eflag field (0: no index) */
     } item_attr;
 
     /* prefix stats of engine */
@@ -21,6 +21,9 @@
 #include <stdlib.h>
 #include <string.h>
 #include <assert.h>
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
 #include "mc_util.h"
 
 /*
@@ -308,35 +311,82 @@ int detokenize(token_t *tokens, int ntokens, char *buffer, int length)
     return nb;
 }
 
+/*
+ * Find the first delimiter or space character in the key string.
+ * The key string is compared 32 or 16 bytes at a time if the instruction set
+ * is available, and the remaining bytes are compared one by one.
+ * Returns NULL if neither of them is found.
+ */
+static inline char *find_key_delimiter(char *str, size_t length, char delimiter)
+{
+    char *p = str;
+    char *e = str + length;
+
+#if defined(__AVX2__)
+    const __m256i dvec32 = _mm256_set1_epi8(delimiter);
+    const __m256i svec32 = _mm256_set1_epi8(' ');
+    while (e - p >= 32) {
+        __m256i chunk = _mm256_loadu_si256((const __m256i *)p);
+        uint32_t mask = (uint32_t)_mm256_movemask_epi8(
+                        _mm256_or_si256(_mm256_cmpeq_epi8(chunk, dvec32),
+                                        _mm256_cmpeq_epi8(chunk, svec32)));
+        if (mask != 0) {
+            return p + __builtin_ctz(mask);
+        }
+        p += 32;
+    }
+#endif
+#if defined(__AVX2__) || defined(__SSE2__)
+    const __m128i dvec16 = _mm_set1_epi8(delimiter);
+    const __m128i svec16 = _mm_set1_epi8(' ');
+    while (e - p >= 16) {
+        __m128i chunk = _mm_loadu_si128((const __m128i *)p);
+        uint32_t mask = (uint32_t)_mm_movemask_epi8(
+                        _mm_or_si128(_mm_cmpeq_epi8(chunk, dvec16),
+                                     _mm_cmpeq_epi8(chunk, svec16)));
+        if (mask != 0) {
+            return p + __builtin_ctz(mask);
+        }
+        p += 16;
+    }
+#endif
+    for (; p < e; p++) {
+        if (*p == delimiter || *p == ' ') {
+            return p;
+        }
+    }
+    return NULL;
+}
+
 int tokenize_keys(char *keystr, int slength, char delimiter, int keycnt, token_t *tokens)
 {
     char *s, *e;
-    int checked = 0;
+    char *end = keystr + slength;
     int ntokens = 0;
     bool finish = false;
 
     assert(keystr != NULL && slength > 0 && tokens != NULL && keycnt > 0);
 
     s = keystr;
-    for (e = s; ntokens < keycnt; ++e, ++checked) {
-        if (checked >= slength) {
-            if (s == e) break;
+    while (ntokens < keycnt) {
+        e = find_key_delimiter(s, end - s, delimiter);
+        if (e == NULL) {
+            if (s == end) break;
             tokens[ntokens].value = s;
-            tokens[ntokens].length = e - s;
+            tokens[ntokens].length = end - s;
             ntokens++;
             if (ntokens == keycnt)
                 finish = true;
             break; /* string end */
         }
-        if (*e == delimiter) {
-            if (s == e) break;
-            tokens[ntokens].value = s;
-            tokens[ntokens].length = e - s;
-            ntokens++;
-            s = e + 1;
-        } else if (*e == ' ') {
+        if (*e != delimiter) {
             break; /* invalid character in key string */
         }
+        if (s == e) break;
+        tokens[ntokens].value = s;
+        tokens[ntokens].length = e - s;
+        ntokens++;
+        s = e + 1;
     }
     if (finish == true) {
         return ntokens;
@@ -383,31 +433,31 @@ static int check_sblock_tail_string(mblck_list_t *sblcks, int length)
 static int tokenize_mblck(char *keystr, int slength, char delimiter, int keycnt, token_t *tokens)
 {
     char *s, *e;
-    int checked = 0;
+    char *end = keystr + slength;
     int ntokens = 0;
     bool finish = false;
 
     assert(keystr != NULL && slength > 0 && tokens != NULL && keycnt > 0);
 
     s = keystr;
-    for (e = s; ntokens < keycnt; ++e, ++checked) {
-        if (checked >= slength) {
-            if (s == e) break;
+    while (ntokens < keycnt) {
+        e = find_key_delimiter(s, end - s, delimiter);
+        if (e == NULL) {
+            if (s == end) break;
             tokens[ntokens].value = s;
-            tokens[ntokens].length = e - s;
+            tokens[ntokens].length = end - s;
             ntokens++;
             finish = true;
             break; /* string end */
         }
-        if (*e == delimiter) {
-            if (s == e) break;
-            tokens[ntokens].value = s;
-            tokens[ntokens].length = e - s;
-            ntokens++;
-            s = e + 1;
-        } else if (*e == ' ') {
+        if (*e != delimiter) {
             break; /* invalid character in key string */
         }
+        if (s == e) break;
+        tokens[ntokens].value = s;
+        tokens[ntokens].length = e - s;
+        ntokens++;
+        s = e + 1;
     }
     if (finish == true) {
         return ntokens;
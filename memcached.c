@@ -183,6 +183,8 @@ static int lenstr_size = 10;
 
 /** file scope variables **/
 static conn *listen_conn = NULL;
+static int *worker_listen_sfds = NULL; /* listening sockets of worker threads */
+static int worker_listen_count = 0;
 static struct event_base *main_base;
 static struct independent_stats *default_independent_stats;
 
@@ -223,12 +225,12 @@ static void stats_init(void);
 static void server_stats(ADD_STAT add_stats, conn *c, bool aggregate);
 static void process_stat_settings(ADD_STAT add_stats, void *c);
 static void update_stat_cas(conn *c, ENGINE_ERROR_CODE ret);
+static bool process_meta_set_complete(conn *c, ENGINE_ERROR_CODE ret);
 
 /* defaults */
 static void settings_init(void);
 
 /* event handling, network IO */
-static void event_handler(const int fd, const short which, void *arg);
 static bool update_event(conn *c, const int new_flags);
 static void complete_nread(conn *c);
 static void process_command(conn *c, char *command, int cmdlen);
@@ -245,6 +247,8 @@ enum transmit_result {
 };
 
 static enum transmit_result transmit(conn *c);
+static bool conn_coal_send(conn *c);
+static void conn_coal_flush(conn *c);
 
 
 /* time-sensitive callers can call it by hand with this,
@@ -376,6 +380,12 @@ static void settings_init(void) {
     settings.max_map_size = MAX_MAP_SIZE;
     settings.max_btree_size = MAX_BTREE_SIZE;
     settings.topkeys = 0;
+    settings.io_uring = false;
+    settings.worker_listen = false;
+    settings.udp_batch = 8;
+    settings.dispatch = DISPATCH_ROUNDROBIN;
+    settings.heavy_threads = 0;
+    settings.heavy_threshold = 1000;
     settings.require_sasl = false;
     settings.extensions.logger = get_stderr_logger();
 }
@@ -420,6 +430,17 @@ static int add_msghdr(conn *c)
         return add_iov(c, NULL, UDP_HEADER_SIZE);
     }
 
+    if (c->msgused == 1) {
+        /* The coalesced responses go ahead of the new response. */
+        c->coal_iovs = 0;
+        if (c->coal_bytes > c->coal_sent) {
+            if (add_iov(c, c->coal_buf + c->coal_sent,
+                        c->coal_bytes - c->coal_sent) != 0) {
+                return -1;
+            }
+            c->coal_iovs = c->iovused;
+        }
+    }
     return 0;
 }
 
@@ -452,9 +473,7 @@ void safe_close(int sfd) {
                            "Failed to close socket %d (%s)!!\n",
                            (int)sfd, strerror(errno));
         } else {
-            STATS_LOCK();
-            mc_stats.curr_conns--;
-            STATS_UNLOCK();
+            __sync_fetch_and_sub(&mc_stats.curr_conns, 1);
         }
     }
 }
@@ -623,12 +642,115 @@ static void conn_destructor(void *buffer, void *unused) {
     free(c->suffixlist);
     free(c->iov);
     free(c->msglist);
+    free(c->coal_buf);
+    free(c->udp_batch);
 
     STATS_LOCK();
     mc_stats.conn_structs--;
     STATS_UNLOCK();
 }
 
+/*
+ * A client connection returns its buffers to the pool of its worker thread
+ * when it waits for a new request, and borrows them again when it reads
+ * the request. So the memory of the buffers follows the number of the
+ * active connections rather than that of all the connections.
+ * The buffer sets of the default sizes are kept in the pool, each linked
+ * through its read buffer.
+ */
+struct conn_bufs {
+    struct conn_bufs *next;
+    char          *wbuf;
+    item         **ilist;
+    char         **suffixlist;
+    struct iovec  *iov;
+    struct msghdr *msglist;
+};
+
+static void conn_free_buffers(conn *c) {
+    free(c->rbuf);
+    free(c->wbuf);
+    free(c->ilist);
+    free(c->suffixlist);
+    free(c->iov);
+    free(c->msglist);
+    c->rbuf = c->wbuf = NULL;
+    c->ilist = NULL;
+    c->suffixlist = NULL;
+    c->iov = NULL;
+    c->msglist = NULL;
+    c->rsize = c->wsize = c->isize = c->suffixsize = 0;
+    c->iovsize = c->msgsize = 0;
+}
+
+static bool conn_borrow_buffers(conn *c) {
+    LIBEVENT_THREAD *t = c->thread;
+    struct conn_bufs *bufs = t->bufs_pool;
+
+    assert(c->rbuf == NULL);
+    if (bufs != NULL) {
+        t->bufs_pool = bufs->next;
+        t->bufs_pooled--;
+        c->rbuf = (char *)bufs;
+        c->wbuf = bufs->wbuf;
+        c->ilist = bufs->ilist;
+        c->suffixlist = bufs->suffixlist;
+        c->iov = bufs->iov;
+        c->msglist = bufs->msglist;
+        c->rsize = c->wsize = DATA_BUFFER_SIZE;
+        c->isize = ITEM_LIST_INITIAL;
+        c->suffixsize = SUFFIX_LIST_INITIAL;
+        c->iovsize = IOV_LIST_INITIAL;
+        c->msgsize = MSG_LIST_INITIAL;
+    } else if (!conn_reset_buffersize(c)) {
+        conn_free_buffers(c);
+        return false;
+    }
+    c->rcurr = c->rbuf;
+    c->wcurr = c->wbuf;
+    c->icurr = c->ilist;
+    c->suffixcurr = c->suffixlist;
+    t->bufs_borrowed++;
+    return true;
+}
+
+static void conn_return_buffers(conn *c, LIBEVENT_THREAD *t) {
+    struct conn_bufs *bufs;
+
+    if (c->coal_buf != NULL && c->coal_bytes == 0) {
+        free(c->coal_buf);
+        c->coal_buf = NULL;
+        c->coal_size = 0;
+    }
+    if (c->rbuf == NULL) {
+        return;
+    }
+    if (t == NULL || t->bufs_pooled >= CONN_BUFS_POOL_MAX ||
+        c->rsize != DATA_BUFFER_SIZE || c->wsize != DATA_BUFFER_SIZE ||
+        c->isize != ITEM_LIST_INITIAL || c->suffixsize != SUFFIX_LIST_INITIAL ||
+        c->iovsize != IOV_LIST_INITIAL || c->msgsize != MSG_LIST_INITIAL) {
+        conn_free_buffers(c);
+        return;
+    }
+    bufs = (struct conn_bufs *)c->rbuf;
+    bufs->wbuf = c->wbuf;
+    bufs->ilist = c->ilist;
+    bufs->suffixlist = c->suffixlist;
+    bufs->iov = c->iov;
+    bufs->msglist = c->msglist;
+    bufs->next = t->bufs_pool;
+    t->bufs_pool = bufs;
+    t->bufs_pooled++;
+
+    c->rbuf = c->wbuf = NULL;
+    c->ilist = NULL;
+    c->suffixlist = NULL;
+    c->iov = NULL;
+    c->msglist = NULL;
+    c->rsize = c->wsize = c->isize = c->suffixsize = 0;
+    c->iovsize = c->msgsize = 0;
+}
+
 conn *conn_new(const int sfd, STATE_FUNC init_state,
                 const int event_flags,
                 const int read_buffer_size, enum network_transport transport,
@@ -641,7 +763,14 @@ conn *conn_new(const int sfd, STATE_FUNC init_state,
 
     assert(c->thread == NULL);
 
-    if (c->rsize < read_buffer_size) {
+    /* The client connections borrow the buffers when reading a request. */
+    c->bufs_pooled = (init_state == conn_new_cmd && !IS_UDP(transport));
+    if (!c->bufs_pooled && !conn_reset_buffersize(c)) {
+        cache_free(conn_cache, c);
+        return NULL;
+    }
+
+    if (c->rsize < read_buffer_size && !c->bufs_pooled) {
         void *mem = malloc(read_buffer_size);
         if (mem) {
             c->rsize = read_buffer_size;
@@ -718,6 +847,9 @@ conn *conn_new(const int sfd, STATE_FUNC init_state,
 
     c->write_and_go = init_state;
     c->write_and_free = 0;
+    c->coal_bytes = 0;
+    c->coal_sent = 0;
+    c->coal_iovs = 0;
     c->item = 0;
 
     c->coll_strkeys = 0;
@@ -728,6 +860,7 @@ conn *conn_new(const int sfd, STATE_FUNC init_state,
     c->pipe_state = PIPE_STATE_OFF;
     c->pipe_count = 0;
     c->noreply = false;
+    c->meta_store = false;
 
     event_set(&c->event, sfd, event_flags, event_handler, (void *)c);
     event_base_set(base, &c->event);
@@ -748,7 +881,9 @@ conn *conn_new(const int sfd, STATE_FUNC init_state,
     c->aiostat = ENGINE_SUCCESS;
     c->ewouldblock = false;
     c->io_blocked = false;
+    c->io_pending = false;
     c->premature_notify_io_complete = false;
+    c->last_cmd_time = current_time;
 
     /* save client ip address in connection object */
     struct sockaddr_in addr;
@@ -790,6 +925,12 @@ static void conn_coll_eitem_free(conn *c) {
       case OPERATION_SOP_EXIST:
         free(c->coll_eitem);
         break;
+      /* lop/sop/bop minsert */
+      case OPERATION_LOP_MINSERT:
+      case OPERATION_SOP_MINSERT:
+      case OPERATION_BOP_MINSERT:
+        free(c->coll_eitem);
+        break;
       case OPERATION_SOP_GET:
         mc_engine.v1->set_elem_release(mc_engine.v0, c, c->coll_eitem, c->coll_ecount);
         free(c->coll_eitem);
@@ -888,6 +1029,15 @@ static void conn_cleanup(conn *c) {
         c->write_and_free = 0;
     }
 
+    if (c->coal_buf != NULL) {
+        free(c->coal_buf);
+        c->coal_buf = NULL;
+        c->coal_size = 0;
+    }
+    c->coal_bytes = 0;
+    c->coal_sent = 0;
+    c->coal_iovs = 0;
+
     if (c->sasl_conn) {
         sasl_dispose(&c->sasl_conn);
         c->sasl_conn = NULL;
@@ -895,6 +1045,7 @@ static void conn_cleanup(conn *c) {
 
     c->engine_storage = NULL;
     /* disconnect it from the conn_list of a thread in charge */
+    __sync_fetch_and_sub(&c->thread->load_conns, 1);
     if (c->conn_prev != NULL) {
         c->conn_prev->conn_next = c->conn_next;
     } else {
@@ -915,12 +1066,19 @@ static void conn_cleanup(conn *c) {
 }
 
 void conn_close(conn *c) {
+    LIBEVENT_THREAD *thread;
+
     assert(c != NULL);
 
     /* delete the event, the socket and the conn */
     if (c->sfd != -1) {
         MEMCACHED_CONN_RELEASE(c->sfd);
         event_del(&c->event);
+#ifdef ENABLE_IO_URING
+        if (c->uring.active) {
+            uring_conn_detach(c);
+        }
+#endif
 
         if (settings.verbose > 1) {
             mc_logger->log(EXTENSION_LOG_DEBUG, c,
@@ -944,16 +1102,23 @@ void conn_close(conn *c) {
                        "Current connection was in the pending-io list.. Nuking it\n");
     }
     c->thread->pending_io = list_remove(c->thread->pending_io, c);
+    c->io_pending = false;
     UNLOCK_THREAD(c->thread);
 
+    thread = c->thread;
     conn_cleanup(c);
 
     /*
      * The contract with the object cache is that we should return the
      * object in a constructed state. Reset the buffers to the default
-     * size
+     * size, or return them to the pool of the thread. conn_new() allocates
+     * the buffers again if the connection does not borrow them.
      */
-    conn_reset_buffersize(c);
+    if (c->bufs_pooled) {
+        conn_return_buffers(c, thread);
+    } else {
+        conn_reset_buffersize(c);
+    }
     assert(c->thread == NULL);
     cache_free(conn_cache, c);
 }
@@ -972,6 +1137,13 @@ static void conn_shrink(conn *c) {
     if (IS_UDP(c->transport))
         return;
 
+    if (c->coal_buf != NULL && c->coal_bytes == 0 && c->rbytes == 0) {
+        /* no more pipelined commands to coalesce the responses of */
+        free(c->coal_buf);
+        c->coal_buf = NULL;
+        c->coal_size = 0;
+    }
+
     if (c->rsize > READ_BUFFER_HIGHWAT && c->rbytes < DATA_BUFFER_SIZE) {
         char *newbuf;
 
@@ -1115,6 +1287,8 @@ const char *state_text(STATE_FUNC state) {
         return "conn_closing";
     } else if (state == conn_mwrite) {
         return "conn_mwrite";
+    } else if (state == conn_heavy_complete) {
+        return "conn_heavy_complete";
     } else {
         return "Unknown";
     }
@@ -2350,6 +2524,272 @@ static void process_bop_insert_complete(conn *c) {
     }
 }
 
+static inline int get_bkey_from_str(const char *str, unsigned char *bkey)
+{
+    if (strncmp(str, "0x", 2) == 0) { /* hexadeciaml bkey */
+        if (safe_strtohexa(str+2, bkey, MAX_BKEY_LENG)) {
+            return (strlen(str+2)/2);
+        }
+    } else { /* 64 bit unsigned integer */
+        if (safe_strtoull(str, (uint64_t*)bkey)) {
+            return 0;
+        }
+    }
+    return -1;
+}
+
+static inline int get_eflag_from_str(const char *str, unsigned char *eflag)
+{
+    if (strncmp(str, "0x", 2) == 0) {
+        if (safe_strtohexa(str+2, eflag, MAX_EFLAG_LENG)) {
+            return (strlen(str+2)/2);
+        }
+    }
+    return -1;
+}
+
+/*
+ * lop/sop/bop minsert
+ *
+ * The data block of minsert consists of the element lines below.
+ *   lop/sop : <bytes>\r\n<data>\r\n
+ *   bop     : <bkey> [<eflag>] <bytes>\r\n<data>\r\n
+ */
+static ENGINE_ITEM_TYPE get_coll_minsert_type(int cmd)
+{
+    if (cmd == (int)OPERATION_LOP_MINSERT) return ITEM_TYPE_LIST;
+    if (cmd == (int)OPERATION_SOP_MINSERT) return ITEM_TYPE_SET;
+    return ITEM_TYPE_BTREE; /* OPERATION_BOP_MINSERT */
+}
+
+static void coll_minsert_elem_release(conn *c, eitem **elem_array, const uint32_t elem_count)
+{
+    switch (get_coll_minsert_type(c->coll_op)) {
+    case ITEM_TYPE_LIST:
+        mc_engine.v1->list_elem_release(mc_engine.v0, c, elem_array, elem_count);
+        break;
+    case ITEM_TYPE_SET:
+        mc_engine.v1->set_elem_release(mc_engine.v0, c, elem_array, elem_count);
+        break;
+    default:
+        mc_engine.v1->btree_elem_release(mc_engine.v0, c, elem_array, elem_count);
+    }
+}
+
+static int einfo_copy_value(eitem_info *einfo, const char *value)
+{
+    int i, offset = einfo->nvalue;
+
+    if (einfo->nvalue > 0) {
+        memcpy((void*)einfo->value, value, einfo->nvalue);
+    }
+    for (i = 0; i < einfo->naddnl; i++) {
+        memcpy(einfo->addnl[i]->ptr, value + offset, einfo->addnl[i]->len);
+        offset += einfo->addnl[i]->len;
+    }
+    return offset;
+}
+
+static ENGINE_ERROR_CODE
+process_coll_minsert_alloc_elems(conn *c, value_item *value,
+                                 eitem **elem_array, uint32_t *elem_count)
+{
+    ENGINE_ITEM_TYPE type = get_coll_minsert_type(c->coll_op);
+    char *ptr = value->ptr;
+    char *end = value->ptr + value->len - 2; /* exclude the tail "\r\n" */
+    char  header[MINSERT_ELEM_HEAD_LENG+1];
+    token_t tokens[6];
+    size_t ntokens;
+    unsigned char bkey[MAX_BKEY_LENG];
+    unsigned char eflag[MAX_EFLAG_LENG];
+    int nbkey, neflag, hlen;
+    int32_t vlen;
+    eitem *elem;
+    ENGINE_ERROR_CODE ret;
+
+    *elem_count = 0;
+    while (ptr < end) {
+        char *eol = memchr(ptr, '\n', end - ptr);
+        if (eol == NULL || eol == ptr || *(eol-1) != '\r') {
+            return ENGINE_EINVAL;
+        }
+        hlen = eol - ptr - 1;
+        if (hlen == 0 || hlen > MINSERT_ELEM_HEAD_LENG || *elem_count >= c->coll_rcount) {
+            return ENGINE_EINVAL;
+        }
+        memcpy(header, ptr, hlen);
+        header[hlen] = '\0';
+        ntokens = tokenize_command(header, hlen, tokens, 5);
+
+        nbkey = neflag = 0;
+        if (type == ITEM_TYPE_BTREE) {
+            if (ntokens < 3 || ntokens > 4) {
+                return ENGINE_EINVAL;
+            }
+            if ((nbkey = get_bkey_from_str(tokens[0].value, bkey)) == -1) {
+                return ENGINE_EINVAL;
+            }
+            if (ntokens == 4 &&
+                (neflag = get_eflag_from_str(tokens[1].value, eflag)) == -1) {
+                return ENGINE_EINVAL;
+            }
+        } else {
+            if (ntokens != 2) {
+                return ENGINE_EINVAL;
+            }
+        }
+        if ((! safe_strtol(tokens[ntokens-2].value, &vlen)) ||
+            (vlen < 0 || vlen > (MAX_ELEMENT_BYTES-2))) {
+            return ENGINE_EINVAL;
+        }
+        vlen += 2;
+
+        /* the element data must be followed by "\r\n" within the data block */
+        ptr = eol + 1;
+        if ((end - ptr) < vlen || strncmp(ptr + vlen - 2, "\r\n", 2) != 0) {
+            return ENGINE_EINVAL;
+        }
+
+        if (type == ITEM_TYPE_LIST) {
+            ret = mc_engine.v1->list_elem_alloc(mc_engine.v0, c, c->coll_key, c->coll_nkey,
+                                                vlen, &elem);
+        } else if (type == ITEM_TYPE_SET) {
+            ret = mc_engine.v1->set_elem_alloc(mc_engine.v0, c, c->coll_key, c->coll_nkey,
+                                               vlen, &elem);
+        } else {
+            ret = mc_engine.v1->btree_elem_alloc(mc_engine.v0, c, c->coll_key, c->coll_nkey,
+                                                 nbkey, neflag, vlen, &elem);
+        }
+        if (ret != ENGINE_SUCCESS) {
+            return ret;
+        }
+        elem_array[(*elem_count)++] = elem;
+
+        mc_engine.v1->get_elem_info(mc_engine.v0, c, type, elem, &c->einfo);
+        if (type == ITEM_TYPE_BTREE) {
+            memcpy((void*)c->einfo.score, bkey, (c->einfo.nscore==0 ? sizeof(uint64_t) : c->einfo.nscore));
+            if (c->einfo.neflag > 0)
+                memcpy((void*)c->einfo.eflag, eflag, c->einfo.neflag);
+        }
+        ptr += einfo_copy_value(&c->einfo, ptr);
+    }
+    if (*elem_count != c->coll_rcount) {
+        return ENGINE_EINVAL;
+    }
+    return ENGINE_SUCCESS;
+}
+
+static void process_coll_minsert_complete(conn *c)
+{
+    assert(c->coll_op == OPERATION_LOP_MINSERT ||
+           c->coll_op == OPERATION_SOP_MINSERT ||
+           c->coll_op == OPERATION_BOP_MINSERT);
+    assert(c->coll_eitem != NULL);
+    ENGINE_ITEM_TYPE type = get_coll_minsert_type(c->coll_op);
+    value_item *value = (value_item *)c->coll_eitem;
+    eitem **elem_array;
+    uint32_t elem_count = 0;
+    uint32_t ins_count = 0;
+    bool created = false;
+    ENGINE_ERROR_CODE ret;
+
+    if (strncmp(&value->ptr[value->len-2], "\r\n", 2) != 0) {
+        ret = ENGINE_EINVAL;
+    } else if ((elem_array = (eitem **)malloc(c->coll_rcount * sizeof(eitem*))) == NULL) {
+        ret = ENGINE_ENOMEM;
+    } else {
+        ret = process_coll_minsert_alloc_elems(c, value, elem_array, &elem_count);
+        if (ret == ENGINE_SUCCESS) {
+            if (type == ITEM_TYPE_LIST) {
+                ret = mc_engine.v1->list_elem_insert_bulk(mc_engine.v0, c,
+                                                          c->coll_key, c->coll_nkey,
+                                                          c->coll_index, elem_array, elem_count,
+                                                          c->coll_attrp, &created, &ins_count, 0);
+            } else if (type == ITEM_TYPE_SET) {
+                ret = mc_engine.v1->set_elem_insert_bulk(mc_engine.v0, c,
+                                                         c->coll_key, c->coll_nkey,
+                                                         elem_array, elem_count,
+                                                         c->coll_attrp, &created, &ins_count, 0);
+            } else {
+                ret = mc_engine.v1->btree_elem_insert_bulk(mc_engine.v0, c,
+                                                           c->coll_key, c->coll_nkey,
+                                                           elem_array, elem_count,
+                                                           c->coll_attrp, &created, &ins_count, 0);
+            }
+            if (ret == ENGINE_EWOULDBLOCK) {
+                c->ewouldblock = true;
+                ret = ENGINE_SUCCESS;
+            }
+        }
+        /* release the elements allocated or inserted */
+        if (elem_count > 0) {
+            coll_minsert_elem_release(c, elem_array, elem_count);
+        }
+        free(elem_array);
+    }
+
+    free(c->coll_eitem);
+    c->coll_eitem = NULL;
+
+    if (settings.detail_enabled) {
+        if (type == ITEM_TYPE_LIST)
+            stats_prefix_record_lop_insert(c->coll_key, c->coll_nkey, (ret==ENGINE_SUCCESS));
+        else if (type == ITEM_TYPE_SET)
+            stats_prefix_record_sop_insert(c->coll_key, c->coll_nkey, (ret==ENGINE_SUCCESS));
+        else
+            stats_prefix_record_bop_insert(c->coll_key, c->coll_nkey, (ret==ENGINE_SUCCESS));
+    }
+
+    switch (ret) {
+    case ENGINE_SUCCESS:
+        {
+        char buffer[64];
+        if (type == ITEM_TYPE_LIST) {
+            STATS_HITS(c, lop_insert, c->coll_key, c->coll_nkey);
+        } else if (type == ITEM_TYPE_SET) {
+            STATS_HITS(c, sop_insert, c->coll_key, c->coll_nkey);
+        } else {
+            STATS_HITS(c, bop_insert, c->coll_key, c->coll_nkey);
+        }
+        sprintf(buffer, "%s %u", (created ? "CREATED_STORED" : "STORED"), ins_count);
+        out_string(c, buffer);
+        }
+        break;
+    case ENGINE_DISCONNECT:
+        c->state = conn_closing;
+        break;
+    case ENGINE_KEY_ENOENT:
+        if (type == ITEM_TYPE_LIST) {
+            STATS_MISS(c, lop_insert, c->coll_key, c->coll_nkey);
+        } else if (type == ITEM_TYPE_SET) {
+            STATS_MISS(c, sop_insert, c->coll_key, c->coll_nkey);
+        } else {
+            STATS_MISS(c, bop_insert, c->coll_key, c->coll_nkey);
+        }
+        out_string(c, "NOT_FOUND");
+        break;
+    default:
+        if (type == ITEM_TYPE_LIST) {
+            STATS_NOKEY(c, cmd_lop_insert);
+        } else if (type == ITEM_TYPE_SET) {
+            STATS_NOKEY(c, cmd_sop_insert);
+        } else {
+            STATS_NOKEY(c, cmd_bop_insert);
+        }
+        if (ret == ENGINE_EINVAL)            out_string(c, "CLIENT_ERROR bad data chunk");
+        else if (ret == ENGINE_EBADTYPE)     out_string(c, "TYPE_MISMATCH");
+        else if (ret == ENGINE_EBADBKEY)     out_string(c, "BKEY_MISMATCH");
+        else if (ret == ENGINE_EOVERFLOW)    out_string(c, "OVERFLOWED");
+        else if (ret == ENGINE_EBKEYOOR)     out_string(c, "OUT_OF_RANGE");
+        else if (ret == ENGINE_EINDEXOOR)    out_string(c, "OUT_OF_RANGE");
+        else if (ret == ENGINE_ELEM_EEXISTS) out_string(c, "ELEMENT_EXISTS");
+        else if (ret == ENGINE_PREFIX_ENAME) out_string(c, "CLIENT_ERROR invalid prefix name");
+        else if (ret == ENGINE_ENOMEM)       out_string(c, "SERVER_ERROR out of memory");
+        else if (ret == ENGINE_ENOTSUP)      out_string(c, "NOT_SUPPORTED");
+        else handle_unexpected_errorcode_ascii(c, ret);
+    }
+}
+
 static void process_bop_update_complete(conn *c)
 {
     assert(c->coll_op == OPERATION_BOP_UPDATE);
@@ -2606,6 +3046,26 @@ static void process_bop_mget_complete(conn *c) {
 }
 #endif
 
+/*
+ * Offloads the rest of the command to the heavy threads if its estimated
+ * cost reaches the threshold. The command is dispatched after the conn is
+ * parked. execute() runs on a heavy thread and builds the response, and
+ * then complete() releases the per-thread resources on the worker thread
+ * in the conn_heavy_complete state. Returns false if not offloaded.
+ */
+static bool heavy_cmd_offload(conn *c, uint32_t cost,
+                              void (*execute)(conn *c), void (*complete)(conn *c))
+{
+    if (settings.heavy_threads <= 0 || cost < settings.heavy_threshold ||
+        IS_UDP(c->transport)) {
+        return false;
+    }
+    c->heavy.execute = execute;
+    c->heavy.complete = complete;
+    c->ewouldblock = true;
+    return true;
+}
+
 #ifdef SUPPORT_BOP_SMGET
 static char *get_smget_miss_response(int res)
 {
@@ -2797,55 +3257,12 @@ static void process_bop_smget_complete_old(conn *c) {
 }
 #endif
 
-static void process_bop_smget_complete(conn *c) {
-    assert(c->coll_op == OPERATION_BOP_SMGET);
-    assert(c->coll_eitem != NULL);
-#ifdef JHPARK_OLD_SMGET_INTERFACE
-    if (c->coll_smgmode == 0) {
-        process_bop_smget_complete_old(c);
-        return;
-    }
-#endif
-    int i, idx;
-    char delimiter = ' ';
-    char old_delimiter = ','; /* need to keep backwards compatibility */
-    token_t *keys_array = NULL;
-    char *respptr;
-    int   resplen;
-    smget_result_t smres;
-
-    smres.elem_array = (eitem **)c->coll_eitem;
-    smres.elem_kinfo = (smget_ehit_t *)&smres.elem_array[c->coll_rcount+c->coll_numkeys];
-    smres.miss_kinfo = (smget_emis_t *)&smres.elem_kinfo[c->coll_rcount];
-
-    respptr = (char *)&smres.miss_kinfo[c->coll_numkeys];
+static void process_bop_smget_response(conn *c);
 
-    ENGINE_ERROR_CODE ret = ENGINE_SUCCESS;
-    keys_array = (token_t*)token_buff_get(&c->thread->token_buff, c->coll_numkeys);
-    if (keys_array != NULL) {
-        int ntokens = tokenize_sblocks(&c->memblist, c->coll_lenkeys, delimiter, c->coll_numkeys, keys_array);
-        if (ntokens == -1) {
-            ntokens = tokenize_sblocks(&c->memblist, c->coll_lenkeys, old_delimiter, c->coll_numkeys, keys_array);
-        }
-        if (ntokens == -1) {
-            ret = ENGINE_EBADVALUE;
-        } else if (ntokens == -2) {
-            ret = ENGINE_ENOMEM;
-        }
-    } else {
-        ret = ENGINE_ENOMEM;
-    }
-    if (ret == ENGINE_SUCCESS) {
-        if (c->coll_bkrange.to_nbkey == BKEY_NULL) {
-            memcpy(c->coll_bkrange.to_bkey, c->coll_bkrange.from_bkey,
-                   (c->coll_bkrange.from_nbkey==0 ? sizeof(uint64_t) : c->coll_bkrange.from_nbkey));
-            c->coll_bkrange.to_nbkey = c->coll_bkrange.from_nbkey;
-        }
-        assert(c->coll_numkeys > 0);
-        assert(c->coll_rcount > 0);
-        assert((c->coll_roffset + c->coll_rcount) <= MAX_SMGET_REQ_COUNT);
-        ret = mc_engine.v1->btree_elem_smget(mc_engine.v0, c,
-                                             keys_array, c->coll_numkeys,
+/* Executes bop smget and builds its response, on a heavy thread if offloaded. */
+static void process_bop_smget_execute(conn *c) {
+    c->heavy.ret = mc_engine.v1->btree_elem_smget(mc_engine.v0, c,
+                                             c->heavy.keys, c->coll_numkeys,
                                              &c->coll_bkrange,
                                              (c->coll_efilter.ncompval==0 ? NULL : &c->coll_efilter),
                                              c->coll_roffset, c->coll_rcount,
@@ -2854,8 +3271,17 @@ static void process_bop_smget_complete(conn *c) {
 #else
                                              c->coll_unique,
 #endif
-                                             &smres, 0);
-    }
+                                             &c->heavy.smres, 0);
+    process_bop_smget_response(c);
+}
+
+static void process_bop_smget_response(conn *c) {
+    int i, idx;
+    token_t *keys_array = c->heavy.keys;
+    smget_result_t smres = c->heavy.smres;
+    char *respptr = (char *)&smres.miss_kinfo[c->coll_numkeys];
+    int   resplen;
+    ENGINE_ERROR_CODE ret = c->heavy.ret;
 
     switch (ret) {
     case ENGINE_SUCCESS:
@@ -2965,13 +3391,21 @@ static void process_bop_smget_complete(conn *c) {
 #endif
         else handle_unexpected_errorcode_ascii(c, ret);
     }
+    c->heavy.ret = ret;
+}
 
+/*
+ * Releases the buffers of bop smget to the pools of the worker thread,
+ * after its response is built.
+ */
+static void process_bop_smget_release(conn *c) {
     /* free token buffer */
-    if (keys_array != NULL) {
-        token_buff_release(&c->thread->token_buff, keys_array);
+    if (c->heavy.keys != NULL) {
+        token_buff_release(&c->thread->token_buff, c->heavy.keys);
+        c->heavy.keys = NULL;
     }
 
-    if (ret != ENGINE_SUCCESS) {
+    if (c->heavy.ret != ENGINE_SUCCESS) {
         if (c->coll_strkeys != NULL) {
             /* free key string memory blocks */
             assert(c->coll_strkeys == (void*)&c->memblist);
@@ -2984,15 +3418,70 @@ static void process_bop_smget_complete(conn *c) {
         }
     }
 }
-#endif
 
-/**
- * Get a suffix buffer and insert it into the list of used suffix buffers
- * @param c the connection object
- * @return a pointer to a new suffix buffer or NULL if allocation failed
- */
-static char *get_suffix_buffer(conn *c)
-{
+static void process_bop_smget_complete(conn *c) {
+    assert(c->coll_op == OPERATION_BOP_SMGET);
+    assert(c->coll_eitem != NULL);
+#ifdef JHPARK_OLD_SMGET_INTERFACE
+    if (c->coll_smgmode == 0) {
+        process_bop_smget_complete_old(c);
+        return;
+    }
+#endif
+    char delimiter = ' ';
+    char old_delimiter = ','; /* need to keep backwards compatibility */
+    token_t *keys_array = NULL;
+    smget_result_t *smres = &c->heavy.smres;
+
+    smres->elem_array = (eitem **)c->coll_eitem;
+    smres->elem_kinfo = (smget_ehit_t *)&smres->elem_array[c->coll_rcount+c->coll_numkeys];
+    smres->miss_kinfo = (smget_emis_t *)&smres->elem_kinfo[c->coll_rcount];
+
+    ENGINE_ERROR_CODE ret = ENGINE_SUCCESS;
+    keys_array = (token_t*)token_buff_get(&c->thread->token_buff, c->coll_numkeys);
+    if (keys_array != NULL) {
+        int ntokens = tokenize_sblocks(&c->memblist, c->coll_lenkeys, delimiter, c->coll_numkeys, keys_array);
+        if (ntokens == -1) {
+            ntokens = tokenize_sblocks(&c->memblist, c->coll_lenkeys, old_delimiter, c->coll_numkeys, keys_array);
+        }
+        if (ntokens == -1) {
+            ret = ENGINE_EBADVALUE;
+        } else if (ntokens == -2) {
+            ret = ENGINE_ENOMEM;
+        }
+    } else {
+        ret = ENGINE_ENOMEM;
+    }
+    c->heavy.keys = keys_array;
+    c->heavy.ret = ret;
+    if (ret == ENGINE_SUCCESS) {
+        if (c->coll_bkrange.to_nbkey == BKEY_NULL) {
+            memcpy(c->coll_bkrange.to_bkey, c->coll_bkrange.from_bkey,
+                   (c->coll_bkrange.from_nbkey==0 ? sizeof(uint64_t) : c->coll_bkrange.from_nbkey));
+            c->coll_bkrange.to_nbkey = c->coll_bkrange.from_nbkey;
+        }
+        assert(c->coll_numkeys > 0);
+        assert(c->coll_rcount > 0);
+        assert((c->coll_roffset + c->coll_rcount) <= MAX_SMGET_REQ_COUNT);
+        if (heavy_cmd_offload(c, c->coll_numkeys + c->coll_roffset + c->coll_rcount,
+                              process_bop_smget_execute, process_bop_smget_release)) {
+            return;
+        }
+        process_bop_smget_execute(c);
+    } else {
+        process_bop_smget_response(c);
+    }
+    process_bop_smget_release(c);
+}
+#endif
+
+/**
+ * Get a suffix buffer and insert it into the list of used suffix buffers
+ * @param c the connection object
+ * @return a pointer to a new suffix buffer or NULL if allocation failed
+ */
+static char *get_suffix_buffer(conn *c)
+{
     if (c->suffixleft == c->suffixsize) {
         char **new_suffix_list;
         size_t sz = sizeof(char*) * c->suffixsize * 2;
@@ -3202,6 +3691,9 @@ static void complete_update_ascii(conn *c) {
         else if (c->coll_op == OPERATION_BOP_INSERT ||
                  c->coll_op == OPERATION_BOP_UPSERT) process_bop_insert_complete(c);
         else if (c->coll_op == OPERATION_BOP_UPDATE) process_bop_update_complete(c);
+        else if (c->coll_op == OPERATION_LOP_MINSERT ||
+                 c->coll_op == OPERATION_SOP_MINSERT ||
+                 c->coll_op == OPERATION_BOP_MINSERT) process_coll_minsert_complete(c);
 #ifdef SUPPORT_BOP_MGET
         else if (c->coll_op == OPERATION_BOP_MGET) process_bop_mget_complete(c);
 #endif
@@ -3261,51 +3753,55 @@ static void complete_update_ascii(conn *c) {
             ret = ENGINE_SUCCESS;
         }
 
-        switch (ret) {
-        case ENGINE_SUCCESS:
-            out_string(c, "STORED");
-            break;
-        case ENGINE_KEY_EEXISTS:
-            out_string(c, "EXISTS");
-            break;
-        case ENGINE_KEY_ENOENT:
-            out_string(c, "NOT_FOUND");
-            break;
-        case ENGINE_NOT_STORED:
-            out_string(c, "NOT_STORED");
-            break;
-        case ENGINE_DISCONNECT:
-            c->state = conn_closing;
-            break;
-        case ENGINE_ENOTSUP:
-            out_string(c, "NOT_SUPPORTED");
-            break;
-        case ENGINE_PREFIX_ENAME:
-            out_string(c, "CLIENT_ERROR invalid prefix name");
-            break;
-        case ENGINE_ENOMEM:
-            out_string(c, "SERVER_ERROR out of memory");
-            break;
-        case ENGINE_EINVAL:
-            out_string(c, "CLIENT_ERROR invalid arguments");
-            break;
-        case ENGINE_E2BIG:
-            out_string(c, "CLIENT_ERROR value too big");
-            break;
-        case ENGINE_EACCESS:
-            out_string(c, "CLIENT_ERROR access control violation");
-            break;
-        case ENGINE_NOT_MY_VBUCKET:
-            out_string(c, "SERVER_ERROR not my vbucket");
-            break;
-        case ENGINE_EBADTYPE:
-            out_string(c, "TYPE_MISMATCH");
-            break;
-        case ENGINE_FAILED:
-            out_string(c, "SERVER_ERROR failure");
-            break;
-        default:
-            handle_unexpected_errorcode_ascii(c, ret);
+        if (c->meta_store && process_meta_set_complete(c, ret)) {
+            /* responded in the meta command format */
+        } else {
+            switch (ret) {
+            case ENGINE_SUCCESS:
+                out_string(c, "STORED");
+                break;
+            case ENGINE_KEY_EEXISTS:
+                out_string(c, "EXISTS");
+                break;
+            case ENGINE_KEY_ENOENT:
+                out_string(c, "NOT_FOUND");
+                break;
+            case ENGINE_NOT_STORED:
+                out_string(c, "NOT_STORED");
+                break;
+            case ENGINE_DISCONNECT:
+                c->state = conn_closing;
+                break;
+            case ENGINE_ENOTSUP:
+                out_string(c, "NOT_SUPPORTED");
+                break;
+            case ENGINE_PREFIX_ENAME:
+                out_string(c, "CLIENT_ERROR invalid prefix name");
+                break;
+            case ENGINE_ENOMEM:
+                out_string(c, "SERVER_ERROR out of memory");
+                break;
+            case ENGINE_EINVAL:
+                out_string(c, "CLIENT_ERROR invalid arguments");
+                break;
+            case ENGINE_E2BIG:
+                out_string(c, "CLIENT_ERROR value too big");
+                break;
+            case ENGINE_EACCESS:
+                out_string(c, "CLIENT_ERROR access control violation");
+                break;
+            case ENGINE_NOT_MY_VBUCKET:
+                out_string(c, "SERVER_ERROR not my vbucket");
+                break;
+            case ENGINE_EBADTYPE:
+                out_string(c, "TYPE_MISMATCH");
+                break;
+            case ENGINE_FAILED:
+                out_string(c, "SERVER_ERROR failure");
+                break;
+            default:
+                handle_unexpected_errorcode_ascii(c, ret);
+            }
         }
     }
 
@@ -3318,6 +3814,7 @@ static void complete_update_ascii(conn *c) {
     /* release the c->item reference */
     mc_engine.v1->release(mc_engine.v0, c, c->item);
     c->item = 0;
+    c->meta_store = false;
 }
 
 /**
@@ -5248,8 +5745,9 @@ static void process_bin_sop_get(conn *c) {
         for (int ii = 0; ii < nkey; ++ii) {
             fprintf(stderr, "%c", key[ii]);
         }
-        fprintf(stderr, " Count(%d) Delete(%s)\n", req_count,
-                (req->message.body.delete ? "true" : "false"));
+        fprintf(stderr, " Count(%d) Delete(%s) Random(%s)\n", req_count,
+                (req->message.body.delete ? "true" : "false"),
+                (req->message.body.random ? "true" : "false"));
     }
 
     eitem  **elem_array = NULL;
@@ -5270,6 +5768,7 @@ static void process_bin_sop_get(conn *c) {
     ret = mc_engine.v1->set_elem_get(mc_engine.v0, c, key, nkey, req_count,
                                      (bool)req->message.body.delete,
                                      (bool)req->message.body.drop,
+                                     (bool)req->message.body.random,
                                      elem_array, &elem_count, &flags, &dropped,
                                      c->binary_header.request.vbucket);
     if (ret == ENGINE_EWOULDBLOCK) {
@@ -5359,217 +5858,96 @@ static void process_bin_sop_get(conn *c) {
     }
 }
 
-static void process_bin_bop_create(conn *c) {
+static void process_bin_mop_create(conn *c) {
     assert(c != NULL);
     assert(c->ewouldblock == false);
     char *key = binary_get_key(c);
     int  nkey = c->binary_header.request.keylen;
 
     /* fix byteorder in the request */
-    protocol_binary_request_bop_create* req = binary_get_request(c);
+    protocol_binary_request_mop_create* req = binary_get_request(c);
     req->message.body.exptime  = ntohl(req->message.body.exptime);
     req->message.body.maxcount = ntohl(req->message.body.maxcount);
 
     if (settings.verbose > 1) {
-        fprintf(stderr, "<%d BOP CREATE ", c->sfd);
+        fprintf(stderr, "<%d MOP CREATE ", c->sfd);
         for (int ii = 0; ii < nkey; ++ii) {
             fprintf(stderr, "%c", key[ii]);
         }
         fprintf(stderr, " flags(%u) exptime(%d) maxcount(%d) ovflaction(%s) readable(%d)\n",
                 req->message.body.flags, req->message.body.exptime, req->message.body.maxcount,
-                get_ovflaction_str(req->message.body.ovflaction), req->message.body.readable);
+                "error", req->message.body.readable);
     }
 
     item_attr attr_data;
     attr_data.flags = req->message.body.flags;
     attr_data.exptime = realtime(req->message.body.exptime);
     attr_data.maxcount = req->message.body.maxcount;
-
-    if ((req->message.body.ovflaction > 0) &&
-        (req->message.body.ovflaction == OVFL_ERROR ||
-         req->message.body.ovflaction == OVFL_SMALLEST_TRIM ||
-         req->message.body.ovflaction == OVFL_LARGEST_TRIM ||
-         req->message.body.ovflaction == OVFL_SMALLEST_SILENT_TRIM ||
-         req->message.body.ovflaction == OVFL_LARGEST_SILENT_TRIM)) {
-        attr_data.ovflaction = req->message.body.ovflaction;
-    } else {
-        attr_data.ovflaction = 0;
-    }
     attr_data.readable = req->message.body.readable;
 
     ENGINE_ERROR_CODE ret;
-    ret = mc_engine.v1->btree_struct_create(mc_engine.v0, c, key, nkey, &attr_data,
-                                            c->binary_header.request.vbucket);
+    ret = mc_engine.v1->map_struct_create(mc_engine.v0, c, key, nkey, &attr_data,
+                                          c->binary_header.request.vbucket);
     if (ret == ENGINE_EWOULDBLOCK) {
         c->ewouldblock = true;
         ret = ENGINE_SUCCESS;
     }
+
     if (settings.detail_enabled) {
-        stats_prefix_record_bop_create(key, nkey);
+        stats_prefix_record_mop_create(key, nkey);
     }
 
     switch (ret) {
     case ENGINE_SUCCESS:
-        STATS_OKS(c, bop_create, key, nkey);
+        STATS_OKS(c, mop_create, key, nkey);
         write_bin_response(c, NULL, 0, 0, 0);
         break;
     case ENGINE_DISCONNECT:
         c->state = conn_closing;
         break;
     default:
-        STATS_NOKEY(c, cmd_bop_create);
+        STATS_NOKEY(c, cmd_mop_create);
         if (ret == ENGINE_KEY_EEXISTS)
             write_bin_packet(c, PROTOCOL_BINARY_RESPONSE_KEY_EEXISTS, 0);
         else if (ret == ENGINE_PREFIX_ENAME)
             write_bin_packet(c, PROTOCOL_BINARY_RESPONSE_PREFIX_ENAME, 0);
         else if (ret == ENGINE_ENOMEM)
             write_bin_packet(c, PROTOCOL_BINARY_RESPONSE_ENOMEM, 0);
+        else if (ret == ENGINE_ENOTSUP)
+            write_bin_packet(c, PROTOCOL_BINARY_RESPONSE_NOT_SUPPORTED, 0);
         else
             write_bin_packet(c, PROTOCOL_BINARY_RESPONSE_EINTERNAL, 0);
     }
 }
 
-static void process_bin_bop_prepare_nread(conn *c) {
-    assert(c != NULL);
-    assert(c->cmd == PROTOCOL_BINARY_CMD_BOP_INSERT ||
-           c->cmd == PROTOCOL_BINARY_CMD_BOP_UPSERT);
-    char *key = binary_get_key(c);
-    uint32_t nkey = c->binary_header.request.keylen;
-    uint32_t vlen = 0;
-
-    if (nkey + c->binary_header.request.extlen <= c->binary_header.request.bodylen) {
-        vlen = c->binary_header.request.bodylen - (nkey + c->binary_header.request.extlen);
-    } else {
-        handle_binary_protocol_error(c);
-        return;
-    }
-
-    /* fix byteorder in the request */
-    protocol_binary_request_bop_insert* req = binary_get_request(c);
-    if (req->message.body.nbkey == 0) {
-        uint64_t bkey_temp;
-        memcpy((uint8_t*)&bkey_temp, req->message.body.bkey, sizeof(uint64_t));
-        bkey_temp = ntohll(bkey_temp);
-        memcpy(req->message.body.bkey, (uint8_t*)&bkey_temp, sizeof(uint64_t));
-        //*(uint64_t*)req->message.body.bkey = ntohll(*(uint64_t*)req->message.body.bkey);
-    }
-    if (req->message.body.create) {
-        req->message.body.exptime  = ntohl(req->message.body.exptime);
-        req->message.body.maxcount = ntohl(req->message.body.maxcount);
-    }
-
-    if (settings.verbose > 1) {
-        fprintf(stderr, "<%d BOP %s ",
-                c->sfd, (c->cmd == PROTOCOL_BINARY_CMD_BOP_INSERT ? "INSERT" : "UPSERT"));
-        for (int ii = 0; ii < nkey; ++ii) {
-            fprintf(stderr, "%c", key[ii]);
-        }
-        fprintf(stderr, " NBKey(%d) NEFlag(%d) NBytes(%d)",
-                req->message.body.nbkey, req->message.body.neflag, vlen);
-        if (req->message.body.create) {
-            fprintf(stderr, " %s", "Create");
-        }
-        fprintf(stderr, "\n");
-    }
-
-    eitem *elem;
-
-    ENGINE_ERROR_CODE ret;
-    if ((vlen + 2) > MAX_ELEMENT_BYTES) {
-        ret = ENGINE_E2BIG;
-    } else {
-        ret = mc_engine.v1->btree_elem_alloc(mc_engine.v0, c, key, nkey,
-                                             req->message.body.nbkey,
-                                             req->message.body.neflag, vlen+2,
-                                             &elem);
-    }
-
-    if (settings.detail_enabled && ret != ENGINE_SUCCESS) {
-        stats_prefix_record_bop_insert(key, nkey, false);
-    }
-
-    switch (ret) {
-    case ENGINE_SUCCESS:
-        {
-        mc_engine.v1->get_elem_info(mc_engine.v0, c, ITEM_TYPE_BTREE, elem, &c->einfo);
-        if (c->einfo.nscore == 0) {
-            memcpy((void*)c->einfo.score, req->message.body.bkey, sizeof(uint64_t));
-        } else {
-            memcpy((void*)c->einfo.score, req->message.body.bkey, c->einfo.nscore);
-        }
-        if (c->einfo.neflag > 0) {
-            memcpy((void*)c->einfo.eflag, req->message.body.eflag, c->einfo.neflag);
-        }
-
-        ritem_set_first(c, CONN_RTYPE_EINFO, vlen);
-        c->coll_eitem  = (void *)elem;
-        c->coll_ecount = 1;
-        c->coll_op     = (c->cmd == PROTOCOL_BINARY_CMD_BOP_INSERT ? OPERATION_BOP_INSERT
-                                                                   : OPERATION_BOP_UPSERT);
-        c->coll_key    = key;
-        c->coll_nkey   = nkey;
-        if (req->message.body.create) {
-            c->coll_attrp = &c->coll_attr_space; /* create if not exist */
-            c->coll_attrp->flags    = req->message.body.flags;
-            c->coll_attrp->exptime  = realtime(req->message.body.exptime);
-            c->coll_attrp->maxcount = req->message.body.maxcount;
-            c->coll_attrp->readable = 1;
-        } else {
-            c->coll_attrp = NULL;
-        }
-        conn_set_state(c, conn_nread);
-        c->substate = bin_reading_bop_nread_complete;
-        }
-        break;
-    case ENGINE_DISCONNECT:
-        c->state = conn_closing;
-        break;
-    default:
-        STATS_NOKEY(c, cmd_bop_insert);
-        if (ret == ENGINE_E2BIG)
-            write_bin_packet(c, PROTOCOL_BINARY_RESPONSE_E2BIG, vlen);
-        else if (ret == ENGINE_ENOMEM)
-            write_bin_packet(c, PROTOCOL_BINARY_RESPONSE_ENOMEM, vlen);
-        else
-            write_bin_packet(c, PROTOCOL_BINARY_RESPONSE_EINTERNAL, 0);
-
-        /* swallow the data line */
-        c->write_and_go = conn_swallow;
-    }
-}
-
-static void process_bin_bop_insert_complete(conn *c) {
-    assert(c->coll_op == OPERATION_BOP_INSERT ||
-           c->coll_op == OPERATION_BOP_UPSERT);
+static void process_bin_mop_insert_complete(conn *c) {
     assert(c->coll_eitem != NULL);
-    eitem *elem = (eitem *)c->coll_eitem;
+    eitem *elem = c->coll_eitem;
 
     /* We don't actually receive the trailing two characters in the bin
      * protocol, so we're going to just set them here */
-    mc_engine.v1->get_elem_info(mc_engine.v0, c, ITEM_TYPE_BTREE, elem, &c->einfo);
+    mc_engine.v1->get_elem_info(mc_engine.v0, c, ITEM_TYPE_MAP, elem, &c->einfo);
     einfo_set_ascii_tail_string(&c->einfo); /* set "\r\n" */
 
     bool created;
-    bool replaced;
-    bool replace_if_exist = (c->coll_op == OPERATION_BOP_UPSERT ? true : false);
 
     ENGINE_ERROR_CODE ret;
-    ret = mc_engine.v1->btree_elem_insert(mc_engine.v0, c,
-                                   c->coll_key, c->coll_nkey, elem, replace_if_exist,
-                                   c->coll_attrp, &replaced, &created, NULL,
-                                   c->binary_header.request.vbucket);
+    ret = mc_engine.v1->map_elem_insert(mc_engine.v0, c,
+                                        c->coll_key, c->coll_nkey, elem,
+                                        c->coll_attrp, &created,
+                                        c->binary_header.request.vbucket);
     if (ret == ENGINE_EWOULDBLOCK) {
         c->ewouldblock = true;
         ret = ENGINE_SUCCESS;
     }
 
     if (settings.detail_enabled) {
-        stats_prefix_record_bop_insert(c->coll_key, c->coll_nkey, (ret==ENGINE_SUCCESS));
+        stats_prefix_record_mop_insert(c->coll_key, c->coll_nkey, (ret==ENGINE_SUCCESS));
     }
 
     switch (ret) {
     case ENGINE_SUCCESS:
-        STATS_HITS(c, bop_insert, c->coll_key, c->coll_nkey);
+        STATS_HITS(c, mop_insert, c->coll_key, c->coll_nkey);
         /* Stored */
         write_bin_response(c, NULL, 0, 0, 0);
         break;
@@ -5577,388 +5955,260 @@ static void process_bin_bop_insert_complete(conn *c) {
         c->state = conn_closing;
         break;
     case ENGINE_KEY_ENOENT:
-        STATS_MISS(c, bop_insert, c->coll_key, c->coll_nkey);
+        STATS_MISS(c, mop_insert, c->coll_key, c->coll_nkey);
         write_bin_packet(c, PROTOCOL_BINARY_RESPONSE_KEY_ENOENT, 0);
         break;
     default:
-        STATS_NOKEY(c, cmd_bop_insert);
-
+        STATS_NOKEY(c, cmd_mop_insert);
         if (ret == ENGINE_EBADTYPE)
             write_bin_packet(c, PROTOCOL_BINARY_RESPONSE_EBADTYPE, 0);
-        else if (ret == ENGINE_EBADBKEY)
-            write_bin_packet(c, PROTOCOL_BINARY_RESPONSE_EBADBKEY, 0);
         else if (ret == ENGINE_EOVERFLOW)
             write_bin_packet(c, PROTOCOL_BINARY_RESPONSE_EOVERFLOW, 0);
-        else if (ret == ENGINE_EBKEYOOR)
-            write_bin_packet(c, PROTOCOL_BINARY_RESPONSE_EBKEYOOR, 0);
         else if (ret == ENGINE_ELEM_EEXISTS)
             write_bin_packet(c, PROTOCOL_BINARY_RESPONSE_ELEM_EEXISTS, 0);
         else if (ret == ENGINE_PREFIX_ENAME)
             write_bin_packet(c, PROTOCOL_BINARY_RESPONSE_PREFIX_ENAME, 0);
         else if (ret == ENGINE_ENOMEM)
             write_bin_packet(c, PROTOCOL_BINARY_RESPONSE_ENOMEM, 0);
+        else if (ret == ENGINE_ENOTSUP)
+            write_bin_packet(c, PROTOCOL_BINARY_RESPONSE_NOT_SUPPORTED, 0);
         else
             write_bin_packet(c, PROTOCOL_BINARY_RESPONSE_EINTERNAL, 0);
     }
 
     /* release the c->coll_eitem reference */
-    mc_engine.v1->btree_elem_release(mc_engine.v0, c, &c->coll_eitem, 1);
+    mc_engine.v1->map_elem_release(mc_engine.v0, c, &c->coll_eitem, 1);
     c->coll_eitem = NULL;
 }
 
-static void process_bin_bop_nread_complete(conn *c) {
-    //protocol_binary_response_status eno = PROTOCOL_BINARY_RESPONSE_EINVAL;
-    assert(c != NULL);
-    process_bin_bop_insert_complete(c);
-}
-
-static void process_bin_bop_update_complete(conn *c) {
-    assert(c->coll_op == OPERATION_BOP_UPDATE);
-    char *new_value;
-    int  new_nbytes;
-    eflag_update *eupdate_ptr;
-
-    if (c->coll_eitem != NULL) {
-        value_item *value = (value_item *)c->coll_eitem;
-        memcpy(value->ptr + value->len - 2, "\r\n", 2);
-        new_value  = value->ptr;
-        new_nbytes = value->len;
-    } else {
-        new_value  = NULL;
-        new_nbytes = 0;
-    }
+static void process_bin_mop_update_complete(conn *c) {
+    assert(c->coll_eitem != NULL);
 
-    eupdate_ptr = (c->coll_eupdate.neflag == EFLAG_NULL ? NULL : &c->coll_eupdate);
+    /* We don't actually receive the trailing two characters in the bin
+     * protocol, so we're going to just set them here */
+    value_item *value = (value_item *)c->coll_eitem;
+    memcpy(value->ptr + value->len - 2, "\r\n", 2);
 
     ENGINE_ERROR_CODE ret;
-    ret = mc_engine.v1->btree_elem_update(mc_engine.v0, c,
-                                       c->coll_key, c->coll_nkey,
-                                       &c->coll_bkrange, eupdate_ptr,
-                                       new_value, new_nbytes,
-                                       c->binary_header.request.vbucket);
+    ret = mc_engine.v1->map_elem_update(mc_engine.v0, c,
+                                        c->coll_key, c->coll_nkey, &c->coll_field,
+                                        value->ptr + c->coll_field.length,
+                                        value->len - c->coll_field.length,
+                                        c->binary_header.request.vbucket);
     if (ret == ENGINE_EWOULDBLOCK) {
         c->ewouldblock = true;
         ret = ENGINE_SUCCESS;
     }
 
     if (settings.detail_enabled) {
-        stats_prefix_record_bop_update(c->coll_key, c->coll_nkey,
-                                       (ret==ENGINE_SUCCESS || ret==ENGINE_ELEM_ENOENT));
+        stats_prefix_record_mop_update(c->coll_key, c->coll_nkey, (ret==ENGINE_SUCCESS));
     }
 
     switch (ret) {
     case ENGINE_SUCCESS:
-        STATS_ELEM_HITS(c, bop_update, c->coll_key, c->coll_nkey);
+        STATS_ELEM_HITS(c, mop_update, c->coll_key, c->coll_nkey);
         write_bin_response(c, NULL, 0, 0, 0);
         break;
     case ENGINE_ELEM_ENOENT:
-        STATS_NONE_HITS(c, bop_update, c->coll_key, c->coll_nkey);
+        STATS_NONE_HITS(c, mop_update, c->coll_key, c->coll_nkey);
         write_bin_packet(c, PROTOCOL_BINARY_RESPONSE_ELEM_ENOENT, 0);
         break;
     case ENGINE_DISCONNECT:
         c->state = conn_closing;
         break;
     case ENGINE_KEY_ENOENT:
-        STATS_MISS(c, bop_update, c->coll_key, c->coll_nkey);
+        STATS_MISS(c, mop_update, c->coll_key, c->coll_nkey);
         write_bin_packet(c, PROTOCOL_BINARY_RESPONSE_KEY_ENOENT, 0);
         break;
     default:
-        STATS_NOKEY(c, cmd_bop_update);
+        STATS_NOKEY(c, cmd_mop_update);
         if (ret == ENGINE_EBADTYPE)
             write_bin_packet(c, PROTOCOL_BINARY_RESPONSE_EBADTYPE, 0);
-        else if (ret == ENGINE_EBADBKEY)
-            write_bin_packet(c, PROTOCOL_BINARY_RESPONSE_EBADBKEY, 0);
-        else if (ret == ENGINE_EBADEFLAG)
-            write_bin_packet(c, PROTOCOL_BINARY_RESPONSE_EBADEFLAG, 0);
         else if (ret == ENGINE_ENOMEM)
             write_bin_packet(c, PROTOCOL_BINARY_RESPONSE_ENOMEM, 0);
+        else if (ret == ENGINE_ENOTSUP)
+            write_bin_packet(c, PROTOCOL_BINARY_RESPONSE_NOT_SUPPORTED, 0);
         else
             write_bin_packet(c, PROTOCOL_BINARY_RESPONSE_EINTERNAL, 0);
     }
 
-    if (c->coll_eitem != NULL) {
-        free((void*)c->coll_eitem);
-        c->coll_eitem = NULL;
-    }
+    /* release the c->coll_eitem reference */
+    free(c->coll_eitem);
+    c->coll_eitem = NULL;
 }
 
-static void process_bin_bop_update_prepare_nread(conn *c) {
-    assert(c != NULL);
-    assert(c->cmd == PROTOCOL_BINARY_CMD_BOP_UPDATE);
-    char *key = binary_get_key(c);
-
-    uint32_t nkey = 0;
-    uint32_t vlen = 0;
-    int  real_nbkey;
-
-    nkey = c->binary_header.request.keylen;
-    if (nkey + c->binary_header.request.extlen <= c->binary_header.request.bodylen) {
-        vlen = c->binary_header.request.bodylen - (nkey + c->binary_header.request.extlen);
-    } else {
-        handle_binary_protocol_error(c);
-        return;
-    }
+/*
+ * Tokenize the field list of mop delete/get request.
+ * We don't actually receive the trailing two("\r\n") characters in binary protocol.
+ */
+static ENGINE_ERROR_CODE process_bin_mop_tokenize_fields(conn *c, field_t **flist)
+{
+    ENGINE_ERROR_CODE ret = ENGINE_SUCCESS;
+    char delimiter = ' ';
+    char old_delimiter = ','; /* need to keep backwards compatibility */
+    int  i;
 
-    /* fix byteorder in the request */
-    protocol_binary_request_bop_update* req = binary_get_request(c);
-    if (req->message.body.nbkey == 0) {
-        uint64_t bkey_temp;
-        memcpy((uint8_t*)&bkey_temp, req->message.body.bkey, sizeof(uint64_t));
-        bkey_temp = ntohll(bkey_temp);
-        memcpy(req->message.body.bkey, (uint8_t*)&bkey_temp, sizeof(uint64_t));
-        //*(uint64_t*)req->message.body.bkey = ntohll(*(uint64_t*)req->message.body.bkey);
-        real_nbkey = 8;
+    *flist = (field_t*)token_buff_get(&c->thread->token_buff, c->coll_numkeys);
+    if (*flist != NULL) {
+        int ntokens = tokenize_mblocks(&c->memblist, c->coll_lenkeys-2, delimiter, c->coll_numkeys, (token_t*)*flist);
+        if (ntokens == -1) {
+            ntokens = tokenize_mblocks(&c->memblist, c->coll_lenkeys-2, old_delimiter, c->coll_numkeys, (token_t*)*flist);
+        }
+        if (ntokens == -1) {
+            ret = ENGINE_EBADVALUE;
+        } else if (ntokens == -2) {
+            ret = ENGINE_ENOMEM;
+        }
     } else {
-        real_nbkey = req->message.body.nbkey;
-    }
-    /* build bkey range */
-    memcpy(c->coll_bkrange.from_bkey, req->message.body.bkey, real_nbkey);
-    c->coll_bkrange.from_nbkey = req->message.body.nbkey;
-    c->coll_bkrange.to_nbkey   = BKEY_NULL;
-    /* build elem update */
-    c->coll_eupdate.fwhere = req->message.body.fwhere;
-    c->coll_eupdate.bitwop = req->message.body.bitwop;
-    c->coll_eupdate.neflag = req->message.body.neflag;
-    if (req->message.body.neflag > 0) {
-        memcpy(c->coll_eupdate.eflag, req->message.body.eflag, req->message.body.neflag);
+        ret = ENGINE_ENOMEM;
     }
 
-    if (settings.verbose > 1) {
-        fprintf(stderr, "<%d BOP UPDATE", c->sfd);
-        for (int ii = 0; ii < nkey; ++ii) {
-            fprintf(stderr, "%c", key[ii]);
+    if (ret == ENGINE_SUCCESS) { /* field validation check */
+        for (i = 0; i < c->coll_numkeys; i++) {
+            if ((*flist)[i].length > MAX_FIELD_LENG) {
+                ret = ENGINE_EBADVALUE;
+                break;
+            }
         }
-        fprintf(stderr, " NBKey(%d) NEFlag(%d) NBytes(%d)",
-                req->message.body.nbkey, req->message.body.neflag, vlen);
-        fprintf(stderr, "\n");
     }
+    return ret;
+}
 
-    if (req->message.body.novalue) {
-        c->coll_eitem  = NULL;
-        c->coll_ecount = 0;
-        c->coll_key    = key;
-        c->coll_nkey   = nkey;
-        c->coll_op     = OPERATION_BOP_UPDATE;
-        process_bin_bop_update_complete(c);
-        return;
+static void process_bin_mop_release_fields(conn *c, field_t *flist)
+{
+    /* free key strings and tokens buffer */
+    if (c->coll_strkeys != NULL) {
+        /* free token buffer */
+        if (flist != NULL) {
+            token_buff_release(&c->thread->token_buff, flist);
+        }
+        /* free key string memory blocks */
+        assert(c->coll_strkeys == (void*)&c->memblist);
+        mblck_list_free(&c->thread->mblck_pool, &c->memblist);
+        c->coll_strkeys = NULL;
     }
+}
 
-    eitem *elem = NULL;
+static void process_bin_mop_delete_complete(conn *c) {
+    assert(c->coll_op == OPERATION_MOP_DELETE);
 
     ENGINE_ERROR_CODE ret = ENGINE_SUCCESS;
-    if ((vlen + 2) > MAX_ELEMENT_BYTES) {
-        ret = ENGINE_E2BIG;
-    } else {
-        if ((elem = (eitem *)malloc(sizeof(value_item) + vlen + 2)) == NULL)
-            ret = ENGINE_ENOMEM;
-        else
-            ((value_item*)elem)->len = vlen + 2;
-    }
-
-    if (settings.detail_enabled && ret != ENGINE_SUCCESS) {
-        stats_prefix_record_bop_update(key, nkey, false);
-    }
-
-    switch (ret) {
-    case ENGINE_SUCCESS:
-        c->ritem       = ((value_item *)elem)->ptr;
-        c->rlbytes     = vlen;
-        c->coll_eitem  = (void *)elem;
-        c->coll_ecount = 1;
-        c->coll_key    = key;
-        c->coll_nkey   = nkey;
-        c->coll_op     = OPERATION_BOP_UPDATE;
-        conn_set_state(c, conn_nread);
-        c->substate = bin_reading_bop_update_nread_complete;
-        break;
-    default:
-        STATS_NOKEY(c, cmd_bop_update);
-        /* ret == ENGINE_E2BIG || ret == ENGINE_ENOMEM */
-        if (ret == ENGINE_E2BIG)
-            write_bin_packet(c, PROTOCOL_BINARY_RESPONSE_E2BIG, vlen);
-        else
-            write_bin_packet(c, PROTOCOL_BINARY_RESPONSE_EINTERNAL, 0);
-
-        /* swallow the data line */
-        c->write_and_go = conn_swallow;
-    }
-}
-
-static void process_bin_bop_delete(conn *c) {
-    assert(c != NULL);
-    assert(c->ewouldblock == false);
-    char *key = binary_get_key(c);
-    int  nkey = c->binary_header.request.keylen;
+    field_t *flist = NULL;
+    uint32_t del_count = 0;
+    bool dropped;
 
-    /* fix byteorder in the request */
-    protocol_binary_request_bop_delete* req = binary_get_request(c);
-    bkey_range   *bkrange = &req->message.body.bkrange;
-    eflag_filter *efilter = &req->message.body.efilter;
-    if (bkrange->from_nbkey == 0) {
-        uint64_t bkey_temp;
-        memcpy((unsigned char*)&bkey_temp, bkrange->from_bkey, sizeof(uint64_t));
-        bkey_temp = ntohll(bkey_temp);
-        memcpy(bkrange->from_bkey, (unsigned char*)&bkey_temp, sizeof(uint64_t));
-        //*(uint64_t*)bkrange->from_bkey = ntohll(*(uint64_t*)bkrange->from_bkey);
-    }
-    if (bkrange->to_nbkey   == 0) {
-        uint64_t bkey_temp;
-        memcpy((unsigned char*)&bkey_temp, bkrange->to_bkey, sizeof(uint64_t));
-        bkey_temp = ntohll(bkey_temp);
-        memcpy(bkrange->to_bkey, (unsigned char*)&bkey_temp, sizeof(uint64_t));
-        //*(uint64_t*)bkrange->to_bkey   = ntohll(*(uint64_t*)bkrange->to_bkey);
+    if (c->coll_strkeys != NULL) {
+        ret = process_bin_mop_tokenize_fields(c, &flist);
     }
-    req->message.body.count = ntohl(req->message.body.count);
 
-    if (settings.verbose > 1) {
-        fprintf(stderr, "<%d BOP DELETE ", c->sfd);
-        for (int ii = 0; ii < nkey; ++ii) {
-            fprintf(stderr, "%c", key[ii]);
+    if (ret == ENGINE_SUCCESS) {
+        ret = mc_engine.v1->map_elem_delete(mc_engine.v0, c, c->coll_key, c->coll_nkey,
+                                            c->coll_numkeys, flist, c->coll_drop,
+                                            &del_count, &dropped,
+                                            c->binary_header.request.vbucket);
+        if (ret == ENGINE_EWOULDBLOCK) {
+            c->ewouldblock = true;
+            ret = ENGINE_SUCCESS;
         }
     }
 
-    uint32_t del_count;
-    uint32_t acc_count; /* access count */
-    bool     dropped;
-
-    ENGINE_ERROR_CODE ret;
-    ret = mc_engine.v1->btree_elem_delete(mc_engine.v0, c, key, nkey,
-                                          bkrange, efilter, req->message.body.count,
-                                          (bool)req->message.body.drop,
-                                          &del_count, &acc_count, &dropped,
-                                          c->binary_header.request.vbucket);
-    if (ret == ENGINE_EWOULDBLOCK) {
-        c->ewouldblock = true;
-        ret = ENGINE_SUCCESS;
-    }
-
     if (settings.detail_enabled) {
-        stats_prefix_record_bop_delete(key, nkey,
+        stats_prefix_record_mop_delete(c->coll_key, c->coll_nkey,
                                        (ret==ENGINE_SUCCESS || ret==ENGINE_ELEM_ENOENT));
     }
 
     switch (ret) {
     case ENGINE_SUCCESS:
-        STATS_ELEM_HITS(c, bop_delete, key, nkey);
+        STATS_ELEM_HITS(c, mop_delete, c->coll_key, c->coll_nkey);
         write_bin_response(c, NULL, 0, 0, 0);
         break;
     case ENGINE_ELEM_ENOENT:
-        STATS_NONE_HITS(c, bop_delete, key, nkey);
+        STATS_NONE_HITS(c, mop_delete, c->coll_key, c->coll_nkey);
         write_bin_packet(c, PROTOCOL_BINARY_RESPONSE_ELEM_ENOENT, 0);
         break;
     case ENGINE_DISCONNECT:
         c->state = conn_closing;
         break;
     case ENGINE_KEY_ENOENT:
-        STATS_MISS(c, bop_delete, key, nkey);
+        STATS_MISS(c, mop_delete, c->coll_key, c->coll_nkey);
         write_bin_packet(c, PROTOCOL_BINARY_RESPONSE_KEY_ENOENT, 0);
         break;
     default:
-        STATS_NOKEY(c, cmd_bop_delete);
+        STATS_NOKEY(c, cmd_mop_delete);
         if (ret == ENGINE_EBADTYPE)
             write_bin_packet(c, PROTOCOL_BINARY_RESPONSE_EBADTYPE, 0);
-        else if (ret == ENGINE_EBADBKEY)
-            write_bin_packet(c, PROTOCOL_BINARY_RESPONSE_EBADBKEY, 0);
+        else if (ret == ENGINE_EBADVALUE)
+            write_bin_packet(c, PROTOCOL_BINARY_RESPONSE_EBADVALUE, 0);
+        else if (ret == ENGINE_ENOMEM)
+            write_bin_packet(c, PROTOCOL_BINARY_RESPONSE_ENOMEM, 0);
+        else if (ret == ENGINE_ENOTSUP)
+            write_bin_packet(c, PROTOCOL_BINARY_RESPONSE_NOT_SUPPORTED, 0);
         else
             write_bin_packet(c, PROTOCOL_BINARY_RESPONSE_EINTERNAL, 0);
     }
+
+    process_bin_mop_release_fields(c, flist);
 }
 
-static void process_bin_bop_get(conn *c) {
-    assert(c != NULL);
+static void process_bin_mop_get_complete(conn *c) {
+    assert(c->coll_op == OPERATION_MOP_GET);
     assert(c->ewouldblock == false);
-    assert(c->cmd == PROTOCOL_BINARY_CMD_BOP_GET);
-    char *key = binary_get_key(c);
-    int  nkey = c->binary_header.request.keylen;
-
-    /* fix byteorder in the request */
-    protocol_binary_request_bop_get* req = binary_get_request(c);
-    bkey_range   *bkrange = &req->message.body.bkrange;
-    eflag_filter *efilter = &req->message.body.efilter;
-    if (bkrange->from_nbkey == 0) {
-        uint64_t bkey_temp;
-        memcpy((unsigned char*)&bkey_temp, bkrange->from_bkey, sizeof(uint64_t));
-        bkey_temp = ntohll(bkey_temp);
-        memcpy(bkrange->from_bkey, (unsigned char*)&bkey_temp, sizeof(uint64_t));
-        //*(uint64_t*)bkrange->from_bkey = ntohll(*(uint64_t*)bkrange->from_bkey);
-    }
-    if (bkrange->to_nbkey   == 0) {
-        uint64_t bkey_temp;
-        memcpy((unsigned char*)&bkey_temp, bkrange->to_bkey, sizeof(uint64_t));
-        bkey_temp = ntohll(bkey_temp);
-        memcpy(bkrange->to_bkey, (unsigned char*)&bkey_temp, sizeof(uint64_t));
-        //*(uint64_t*)bkrange->to_bkey   = ntohll(*(uint64_t*)bkrange->to_bkey);
-    }
-    req->message.body.offset = ntohl(req->message.body.offset);
-    req->message.body.count  = ntohl(req->message.body.count);
-
-    if (settings.verbose > 1) {
-        fprintf(stderr, "<%d BOP GET ", c->sfd);
-        for (int ii = 0; ii < nkey; ++ii) {
-            fprintf(stderr, "%c", key[ii]);
-        }
-        fprintf(stderr, " Offset(%u) Count(%u) Delete(%s)\n",
-                req->message.body.offset, req->message.body.count,
-                (req->message.body.delete ? "true" : "false"));
-    }
 
+    ENGINE_ERROR_CODE ret = ENGINE_SUCCESS;
     eitem  **elem_array = NULL;
-    uint32_t elem_count;
-    uint32_t access_count;
+    field_t *flist = NULL;
+    uint32_t elem_count = 0;
     uint32_t flags, i;
-    bool     dropped_trimmed;
-    int      est_count;
+    bool     dropped;
     int      need_size;
 
-    ENGINE_ERROR_CODE ret = ENGINE_SUCCESS;
-
-    est_count = MAX_BTREE_SIZE;
-    if (req->message.body.count > 0 && req->message.body.count < MAX_BTREE_SIZE) {
-        est_count = req->message.body.count;
-        if (est_count % 2) est_count += 1;
+    /* elem pointer array, value length array and field length array */
+    if (c->coll_numkeys <= 0 || c->coll_numkeys > MAX_MAP_SIZE) {
+        need_size = MAX_MAP_SIZE * (sizeof(eitem*)+sizeof(uint32_t)+sizeof(uint8_t));
+    } else {
+        need_size = c->coll_numkeys * (sizeof(eitem*)+sizeof(uint32_t)+sizeof(uint8_t));
     }
-    need_size = est_count * (sizeof(eitem*)+MAX_BKEY_LENG+MAX_EFLAG_LENG+sizeof(uint32_t));
     if ((elem_array = (eitem **)malloc(need_size)) == NULL) {
-        write_bin_packet(c, PROTOCOL_BINARY_RESPONSE_ENOMEM, 0);
-        return;
+        ret = ENGINE_ENOMEM;
     }
 
-    ret = mc_engine.v1->btree_elem_get(mc_engine.v0, c, key, nkey,
-                                       bkrange, efilter,
-                                       req->message.body.offset,
-                                       req->message.body.count,
-                                       (bool)req->message.body.delete,
-                                       (bool)req->message.body.drop,
-                                       elem_array, &elem_count, &access_count,
-                                       &flags, &dropped_trimmed,
-                                       c->binary_header.request.vbucket);
-    if (ret == ENGINE_EWOULDBLOCK) {
-        c->ewouldblock = true;
-        ret = ENGINE_SUCCESS;
+    if (ret == ENGINE_SUCCESS && c->coll_strkeys != NULL) {
+        ret = process_bin_mop_tokenize_fields(c, &flist);
+    }
+
+    if (ret == ENGINE_SUCCESS) {
+        ret = mc_engine.v1->map_elem_get(mc_engine.v0, c, c->coll_key, c->coll_nkey,
+                                         c->coll_numkeys, flist,
+                                         c->coll_delete, c->coll_drop,
+                                         elem_array, &elem_count, &flags, &dropped,
+                                         c->binary_header.request.vbucket);
+        if (ret == ENGINE_EWOULDBLOCK) {
+            c->ewouldblock = true;
+            ret = ENGINE_SUCCESS;
+        }
     }
 
     if (settings.detail_enabled) {
-        stats_prefix_record_bop_get(key, nkey,
+        stats_prefix_record_mop_get(c->coll_key, c->coll_nkey,
                                     (ret==ENGINE_SUCCESS || ret==ENGINE_ELEM_ENOENT));
     }
 
     switch (ret) {
     case ENGINE_SUCCESS:
         {
-        protocol_binary_response_bop_get* rsp = (protocol_binary_response_bop_get*)c->wbuf;
-        uint64_t *bkeyptr = ((elem_count % 2) == 0 /* for 8 byte align */
-                             ? (uint64_t *)&elem_array[elem_count]
-                             : (uint64_t *)&elem_array[elem_count+1]);
-        uint32_t *vlenptr = (uint32_t *)((char*)bkeyptr + (sizeof(uint64_t) * elem_count));
+        protocol_binary_response_mop_get* rsp = (protocol_binary_response_mop_get*)c->wbuf;
+        uint32_t *vlenptr = (uint32_t *)&elem_array[elem_count];
+        uint8_t  *flenptr = (uint8_t *)&vlenptr[elem_count];
         uint32_t  bodylen;
 
-        bodylen = sizeof(rsp->message.body) + (elem_count * (sizeof(uint64_t)+sizeof(uint32_t)));
+        bodylen = sizeof(rsp->message.body)
+                + (elem_count * (sizeof(uint32_t)+sizeof(uint8_t)));
         for (i = 0; i < elem_count; i++) {
-            mc_engine.v1->get_elem_info(mc_engine.v0, c, ITEM_TYPE_BTREE,
+            mc_engine.v1->get_elem_info(mc_engine.v0, c, ITEM_TYPE_MAP,
                                         elem_array[i], &c->einfo);
-            bodylen += (c->einfo.nbytes - 2);
-            bkeyptr[i] = htonll(*(uint64_t*)c->einfo.score);
+            bodylen += (c->einfo.nscore + c->einfo.nbytes - 2);
             vlenptr[i] = htonl(c->einfo.nbytes - 2);
+            flenptr[i] = (uint8_t)c->einfo.nscore;
         }
         add_bin_header(c, 0, sizeof(rsp->message.body), 0, bodylen);
 
@@ -5967,28 +6217,30 @@ static void process_bin_bop_get(conn *c) {
         rsp->message.body.count = htonl(elem_count);
         add_iov(c, &rsp->message.body, sizeof(rsp->message.body));
 
-        // add bkey data and value lengths
-        add_iov(c, (char*)bkeyptr, elem_count*(sizeof(uint64_t)+sizeof(uint32_t)));
+        // add value lengths and field lengths
+        add_iov(c, (char*)vlenptr, elem_count*sizeof(uint32_t));
+        add_iov(c, (char*)flenptr, elem_count*sizeof(uint8_t));
 
-        /* Add the data without CRLF */
+        /* Add the field and the data without CRLF */
         for (i = 0; i < elem_count; i++) {
-            mc_engine.v1->get_elem_info(mc_engine.v0, c, ITEM_TYPE_BTREE,
+            mc_engine.v1->get_elem_info(mc_engine.v0, c, ITEM_TYPE_MAP,
                                         elem_array[i], &c->einfo);
-            if (add_iov_einfo_some_value(c, &c->einfo, c->einfo.nbytes - 2) != 0) {
+            if (add_iov(c, c->einfo.score, c->einfo.nscore) != 0 ||
+                add_iov_einfo_some_value(c, &c->einfo, c->einfo.nbytes - 2) != 0) {
                 ret = ENGINE_ENOMEM; break;
             }
         }
 
         if (ret == ENGINE_SUCCESS) {
-            STATS_ELEM_HITS(c, bop_get, key, nkey);
+            STATS_ELEM_HITS(c, mop_get, c->coll_key, c->coll_nkey);
             /* Remember this command so we can garbage collect it later */
             c->coll_eitem  = (void *)elem_array;
             c->coll_ecount = elem_count;
-            c->coll_op     = OPERATION_BOP_GET;
+            c->coll_op     = OPERATION_MOP_GET;
             conn_set_state(c, conn_mwrite);
         } else {
-            STATS_NOKEY(c, cmd_bop_get);
-            mc_engine.v1->btree_elem_release(mc_engine.v0, c, elem_array, elem_count);
+            STATS_NOKEY(c, cmd_mop_get);
+            mc_engine.v1->map_elem_release(mc_engine.v0, c, elem_array, elem_count);
             if (c->ewouldblock)
                 c->ewouldblock = false;
             write_bin_packet(c, PROTOCOL_BINARY_RESPONSE_ENOMEM, 0);
@@ -5996,123 +6248,350 @@ static void process_bin_bop_get(conn *c) {
         }
         break;
     case ENGINE_ELEM_ENOENT:
-        STATS_NONE_HITS(c, bop_get, key, nkey);
+        STATS_NONE_HITS(c, mop_get, c->coll_key, c->coll_nkey);
         write_bin_packet(c, PROTOCOL_BINARY_RESPONSE_ELEM_ENOENT, 0);
         break;
     case ENGINE_DISCONNECT:
         c->state = conn_closing;
         break;
     case ENGINE_KEY_ENOENT:
-    case ENGINE_EBKEYOOR:
     case ENGINE_UNREADABLE:
-        STATS_MISS(c, bop_get, key, nkey);
+        STATS_MISS(c, mop_get, c->coll_key, c->coll_nkey);
         if (ret == ENGINE_KEY_ENOENT)
             write_bin_packet(c, PROTOCOL_BINARY_RESPONSE_KEY_ENOENT, 0);
-        else if (ret == ENGINE_EBKEYOOR)
-            write_bin_packet(c, PROTOCOL_BINARY_RESPONSE_EBKEYOOR, 0);
         else
             write_bin_packet(c, PROTOCOL_BINARY_RESPONSE_UNREADABLE, 0);
         break;
     default:
-        STATS_NOKEY(c, cmd_bop_get);
+        STATS_NOKEY(c, cmd_mop_get);
         if (ret == ENGINE_EBADTYPE)
             write_bin_packet(c, PROTOCOL_BINARY_RESPONSE_EBADTYPE, 0);
-        else if (ret == ENGINE_EBADBKEY)
-            write_bin_packet(c, PROTOCOL_BINARY_RESPONSE_EBADBKEY, 0);
+        else if (ret == ENGINE_EBADVALUE)
+            write_bin_packet(c, PROTOCOL_BINARY_RESPONSE_EBADVALUE, 0);
+        else if (ret == ENGINE_ENOMEM)
+            write_bin_packet(c, PROTOCOL_BINARY_RESPONSE_ENOMEM, 0);
+        else if (ret == ENGINE_ENOTSUP)
+            write_bin_packet(c, PROTOCOL_BINARY_RESPONSE_NOT_SUPPORTED, 0);
         else
             write_bin_packet(c, PROTOCOL_BINARY_RESPONSE_EINTERNAL, 0);
     }
 
+    process_bin_mop_release_fields(c, flist);
+
     if (ret != ENGINE_SUCCESS && elem_array != NULL) {
         free((void *)elem_array);
     }
 }
 
-static void process_bin_bop_count(conn *c) {
+static void process_bin_mop_prepare_nread(conn *c) {
     assert(c != NULL);
-    assert(c->cmd == PROTOCOL_BINARY_CMD_BOP_COUNT);
+    assert(c->cmd == PROTOCOL_BINARY_CMD_MOP_INSERT ||
+           c->cmd == PROTOCOL_BINARY_CMD_MOP_UPDATE ||
+           c->cmd == PROTOCOL_BINARY_CMD_MOP_DELETE ||
+           c->cmd == PROTOCOL_BINARY_CMD_MOP_GET);
     char *key = binary_get_key(c);
-    int  nkey = c->binary_header.request.keylen;
+    uint32_t nkey = c->binary_header.request.keylen;
+    uint32_t vlen = 0;
+    uint32_t nfield = 0;
+    uint32_t numfields = 0;
 
-    /* fix byteorder in the request */
-    protocol_binary_request_bop_count* req = binary_get_request(c);
-    bkey_range   *bkrange = &req->message.body.bkrange;
-    eflag_filter *efilter = &req->message.body.efilter;
-    if (bkrange->from_nbkey == 0) {
-        uint64_t bkey_temp;
-        memcpy((unsigned char*)&bkey_temp, bkrange->from_bkey, sizeof(uint64_t));
-        bkey_temp = ntohll(bkey_temp);
-        memcpy(bkrange->from_bkey, (unsigned char*)&bkey_temp, sizeof(uint64_t));
-        //*(uint64_t*)bkrange->from_bkey = ntohll(*(uint64_t*)bkrange->from_bkey);
+    if (nkey + c->binary_header.request.extlen <= c->binary_header.request.bodylen) {
+        vlen = c->binary_header.request.bodylen - (nkey + c->binary_header.request.extlen);
+    } else {
+        handle_binary_protocol_error(c);
+        return;
     }
-    if (bkrange->to_nbkey   == 0) {
-        uint64_t bkey_temp;
-        memcpy((unsigned char*)&bkey_temp, bkrange->to_bkey, sizeof(uint64_t));
-        bkey_temp = ntohll(bkey_temp);
-        memcpy(bkrange->to_bkey, (unsigned char*)&bkey_temp, sizeof(uint64_t));
-        //*(uint64_t*)bkrange->to_bkey   = ntohll(*(uint64_t*)bkrange->to_bkey);
+
+    /* fix byteorder in the request */
+    if (c->cmd == PROTOCOL_BINARY_CMD_MOP_INSERT) {
+        protocol_binary_request_mop_insert* req = binary_get_request(c);
+        req->message.body.exptime  = ntohl(req->message.body.exptime);
+        req->message.body.maxcount = ntohl(req->message.body.maxcount);
+        nfield = req->message.body.nfield;
+    } else if (c->cmd == PROTOCOL_BINARY_CMD_MOP_UPDATE) {
+        protocol_binary_request_mop_update* req = binary_get_request(c);
+        nfield = req->message.body.nfield;
+    } else if (c->cmd == PROTOCOL_BINARY_CMD_MOP_DELETE) {
+        protocol_binary_request_mop_delete* req = binary_get_request(c);
+        numfields = ntohl(req->message.body.numfields);
+    } else { /* PROTOCOL_BINARY_CMD_MOP_GET */
+        protocol_binary_request_mop_get* req = binary_get_request(c);
+        numfields = ntohl(req->message.body.numfields);
     }
 
     if (settings.verbose > 1) {
-        fprintf(stderr, "<%d BOP COUNT", c->sfd);
+        if (c->cmd == PROTOCOL_BINARY_CMD_MOP_INSERT) {
+            fprintf(stderr, "<%d MOP INSERT ", c->sfd);
+        } else if (c->cmd == PROTOCOL_BINARY_CMD_MOP_UPDATE) {
+            fprintf(stderr, "<%d MOP UPDATE ", c->sfd);
+        } else if (c->cmd == PROTOCOL_BINARY_CMD_MOP_DELETE) {
+            fprintf(stderr, "<%d MOP DELETE ", c->sfd);
+        } else {
+            fprintf(stderr, "<%d MOP GET ", c->sfd);
+        }
         for (int ii = 0; ii < nkey; ++ii) {
             fprintf(stderr, "%c", key[ii]);
         }
-        fprintf(stderr, "\n");
+        if (c->cmd == PROTOCOL_BINARY_CMD_MOP_INSERT ||
+            c->cmd == PROTOCOL_BINARY_CMD_MOP_UPDATE) {
+            fprintf(stderr, " NField(%d) NBytes(%d)\n", nfield, vlen - nfield);
+        } else {
+            fprintf(stderr, " NumFields(%d) NBytes(%d)\n", numfields, vlen);
+        }
     }
 
-    uint32_t elem_count;
-    uint32_t access_count;
-    uint32_t flags = 0;
+    if (c->cmd == PROTOCOL_BINARY_CMD_MOP_DELETE ||
+        c->cmd == PROTOCOL_BINARY_CMD_MOP_GET) {
+        ENGINE_ERROR_CODE ret = ENGINE_SUCCESS;
+        if (vlen == 0) {
+            if (numfields != 0) ret = ENGINE_EBADVALUE;
+        } else {
+            if (numfields == 0 || numfields > ARCUS_COLL_SIZE_LIMIT ||
+                numfields > ((vlen/2)+1)) {
+                ret = ENGINE_EBADVALUE;
+            } else if (mblck_list_alloc(&c->thread->mblck_pool, 1, vlen, &c->memblist) < 0) {
+                ret = ENGINE_ENOMEM;
+            }
+        }
 
-    ENGINE_ERROR_CODE ret;
-    ret = mc_engine.v1->btree_elem_count(mc_engine.v0, c, key, nkey,
-                                         bkrange, efilter, &elem_count, &access_count,
-                                         c->binary_header.request.vbucket);
+        if (ret != ENGINE_SUCCESS) {
+            if (c->cmd == PROTOCOL_BINARY_CMD_MOP_DELETE) {
+                STATS_NOKEY(c, cmd_mop_delete);
+            } else {
+                STATS_NOKEY(c, cmd_mop_get);
+            }
+            if (ret == ENGINE_EBADVALUE)
+                write_bin_packet(c, PROTOCOL_BINARY_RESPONSE_EBADVALUE, vlen);
+            else
+                write_bin_packet(c, PROTOCOL_BINARY_RESPONSE_ENOMEM, vlen);
 
-    if (settings.detail_enabled) {
-        stats_prefix_record_bop_count(key, nkey, (ret==ENGINE_SUCCESS));
+            /* swallow the data line */
+            c->write_and_go = conn_swallow;
+            return;
+        }
+
+        c->coll_key     = key;
+        c->coll_nkey    = nkey;
+        c->coll_numkeys = numfields;
+        c->coll_lenkeys = (vlen > 0 ? vlen + 2 : 0);
+        if (c->cmd == PROTOCOL_BINARY_CMD_MOP_DELETE) {
+            protocol_binary_request_mop_delete* req = binary_get_request(c);
+            c->coll_op     = OPERATION_MOP_DELETE;
+            c->coll_drop   = (req->message.body.drop ? true : false);
+        } else {
+            protocol_binary_request_mop_get* req = binary_get_request(c);
+            c->coll_op     = OPERATION_MOP_GET;
+            c->coll_delete = (req->message.body.delete || req->message.body.drop ? true : false);
+            c->coll_drop   = (req->message.body.drop ? true : false);
+        }
+
+        if (vlen == 0) {
+            /* no field list : all the fields are requested */
+            if (c->cmd == PROTOCOL_BINARY_CMD_MOP_DELETE)
+                process_bin_mop_delete_complete(c);
+            else
+                process_bin_mop_get_complete(c);
+        } else {
+            c->coll_strkeys = (void*)&c->memblist;
+            ritem_set_first(c, CONN_RTYPE_MBLCK, vlen);
+            conn_set_state(c, conn_nread);
+            c->substate = bin_reading_mop_nread_complete;
+        }
+        return;
+    }
+
+    /* PROTOCOL_BINARY_CMD_MOP_INSERT or PROTOCOL_BINARY_CMD_MOP_UPDATE */
+    eitem *elem = NULL;
+
+    ENGINE_ERROR_CODE ret = ENGINE_SUCCESS;
+    if (nfield < 1 || nfield > MAX_FIELD_LENG || nfield > vlen) {
+        ret = ENGINE_EBADVALUE;
+    } else if ((vlen - nfield + 2) > MAX_ELEMENT_BYTES) {
+        ret = ENGINE_E2BIG;
+    } else {
+        if (c->cmd == PROTOCOL_BINARY_CMD_MOP_INSERT) {
+            ret = mc_engine.v1->map_elem_alloc(mc_engine.v0, c, key, nkey,
+                                               nfield, vlen - nfield + 2, &elem);
+        } else {
+            /* the field string is followed by the value in the buffer */
+            if ((elem = (eitem *)malloc(sizeof(value_item) + vlen + 2)) == NULL)
+                ret = ENGINE_ENOMEM;
+            else
+                ((value_item*)elem)->len = vlen + 2;
+        }
+    }
+
+    if (settings.detail_enabled && ret != ENGINE_SUCCESS) {
+        if (c->cmd == PROTOCOL_BINARY_CMD_MOP_INSERT)
+            stats_prefix_record_mop_insert(key, nkey, false);
+        else
+            stats_prefix_record_mop_update(key, nkey, false);
     }
 
     switch (ret) {
     case ENGINE_SUCCESS:
-        STATS_HITS(c, bop_count, key, nkey);
-        protocol_binary_response_bop_count* rsp = (protocol_binary_response_bop_count*)c->wbuf;
-        // add the flags and count
-        rsp->message.body.flags = flags;
-        rsp->message.body.count = htonl(elem_count);
-        write_bin_response(c, &rsp->message.body, 0, 0, sizeof(rsp->message.body));
+        c->coll_eitem  = (void *)elem;
+        c->coll_ecount = 1;
+        c->coll_key    = key;
+        c->coll_nkey   = nkey;
+        if (c->cmd == PROTOCOL_BINARY_CMD_MOP_INSERT) {
+            protocol_binary_request_mop_insert* req = binary_get_request(c);
+            c->coll_op     = OPERATION_MOP_INSERT;
+            if (req->message.body.create) {
+                c->coll_attrp = &c->coll_attr_space; /* create if not exist */
+                c->coll_attrp->flags    = req->message.body.flags;
+                c->coll_attrp->exptime  = realtime(req->message.body.exptime);
+                c->coll_attrp->maxcount = req->message.body.maxcount;
+                c->coll_attrp->readable = 1;
+            } else {
+                c->coll_attrp = NULL;
+            }
+            /* read the field string first, and then the value */
+            mc_engine.v1->get_elem_info(mc_engine.v0, c, ITEM_TYPE_MAP,
+                                        elem, &c->einfo);
+            c->ritem   = (char *)c->einfo.score;
+            c->rlbytes = nfield;
+            c->substate = bin_reading_mop_nread_field;
+        } else {
+            c->coll_op     = OPERATION_MOP_UPDATE;
+            c->coll_field.value  = ((value_item *)elem)->ptr;
+            c->coll_field.length = nfield;
+            c->ritem   = ((value_item *)elem)->ptr;
+            c->rlbytes = vlen;
+            c->substate = bin_reading_mop_nread_complete;
+        }
+        conn_set_state(c, conn_nread);
         break;
     case ENGINE_DISCONNECT:
         c->state = conn_closing;
         break;
-    case ENGINE_KEY_ENOENT:
-    case ENGINE_UNREADABLE:
-        STATS_MISS(c, bop_count, key, nkey);
-        if (ret == ENGINE_KEY_ENOENT)
-            write_bin_packet(c, PROTOCOL_BINARY_RESPONSE_KEY_ENOENT, 0);
-        else
-            write_bin_packet(c, PROTOCOL_BINARY_RESPONSE_UNREADABLE, 0);
-        break;
     default:
-        STATS_NOKEY(c, cmd_bop_count);
-        if (ret == ENGINE_EBADTYPE)
-            write_bin_packet(c, PROTOCOL_BINARY_RESPONSE_EBADTYPE, 0);
-        else if (ret == ENGINE_EBADBKEY)
-            write_bin_packet(c, PROTOCOL_BINARY_RESPONSE_EBADBKEY, 0);
+        if (c->cmd == PROTOCOL_BINARY_CMD_MOP_INSERT) {
+            STATS_NOKEY(c, cmd_mop_insert);
+        } else {
+            STATS_NOKEY(c, cmd_mop_update);
+        }
+
+        if (ret == ENGINE_EBADVALUE)
+            write_bin_packet(c, PROTOCOL_BINARY_RESPONSE_EBADVALUE, vlen);
+        else if (ret == ENGINE_E2BIG)
+            write_bin_packet(c, PROTOCOL_BINARY_RESPONSE_E2BIG, vlen);
+        else if (ret == ENGINE_ENOMEM)
+            write_bin_packet(c, PROTOCOL_BINARY_RESPONSE_ENOMEM, vlen);
         else
             write_bin_packet(c, PROTOCOL_BINARY_RESPONSE_EINTERNAL, 0);
+
+        /* swallow the data line */
+        c->write_and_go = conn_swallow;
     }
 }
 
-#if defined(SUPPORT_BOP_MGET) || defined(SUPPORT_BOP_SMGET)
-static void process_bin_bop_prepare_nread_keys(conn *c) {
-    assert(c != NULL);
-    assert(c->cmd == PROTOCOL_BINARY_CMD_BOP_MGET || c->cmd == PROTOCOL_BINARY_CMD_BOP_SMGET);
-
+static void process_bin_mop_nread_field(conn *c) {
+    assert(c->coll_op == OPERATION_MOP_INSERT);
+    assert(c->coll_eitem != NULL);
+    uint32_t vlen = c->binary_header.request.bodylen
+                  - (c->binary_header.request.keylen + c->binary_header.request.extlen);
+
+    /* the field string has been read, now read the value */
+    mc_engine.v1->get_elem_info(mc_engine.v0, c, ITEM_TYPE_MAP,
+                                c->coll_eitem, &c->einfo);
+    ritem_set_first(c, CONN_RTYPE_EINFO, vlen - c->einfo.nscore);
+    conn_set_state(c, conn_nread);
+    c->substate = bin_reading_mop_nread_complete;
+}
+
+static void process_bin_mop_nread_complete(conn *c) {
+    assert(c != NULL);
+
+    if (c->cmd == PROTOCOL_BINARY_CMD_MOP_INSERT)
+        process_bin_mop_insert_complete(c);
+    else if (c->cmd == PROTOCOL_BINARY_CMD_MOP_UPDATE)
+        process_bin_mop_update_complete(c);
+    else if (c->cmd == PROTOCOL_BINARY_CMD_MOP_DELETE)
+        process_bin_mop_delete_complete(c);
+    else if (c->cmd == PROTOCOL_BINARY_CMD_MOP_GET)
+        process_bin_mop_get_complete(c);
+}
+
+static void process_bin_bop_create(conn *c) {
+    assert(c != NULL);
+    assert(c->ewouldblock == false);
+    char *key = binary_get_key(c);
+    int  nkey = c->binary_header.request.keylen;
+
+    /* fix byteorder in the request */
+    protocol_binary_request_bop_create* req = binary_get_request(c);
+    req->message.body.exptime  = ntohl(req->message.body.exptime);
+    req->message.body.maxcount = ntohl(req->message.body.maxcount);
+
+    if (settings.verbose > 1) {
+        fprintf(stderr, "<%d BOP CREATE ", c->sfd);
+        for (int ii = 0; ii < nkey; ++ii) {
+            fprintf(stderr, "%c", key[ii]);
+        }
+        fprintf(stderr, " flags(%u) exptime(%d) maxcount(%d) ovflaction(%s) readable(%d)\n",
+                req->message.body.flags, req->message.body.exptime, req->message.body.maxcount,
+                get_ovflaction_str(req->message.body.ovflaction), req->message.body.readable);
+    }
+
+    item_attr attr_data;
+    attr_data.flags = req->message.body.flags;
+    attr_data.exptime = realtime(req->message.body.exptime);
+    attr_data.maxcount = req->message.body.maxcount;
+
+    if ((req->message.body.ovflaction > 0) &&
+        (req->message.body.ovflaction == OVFL_ERROR ||
+         req->message.body.ovflaction == OVFL_SMALLEST_TRIM ||
+         req->message.body.ovflaction == OVFL_LARGEST_TRIM ||
+         req->message.body.ovflaction == OVFL_SMALLEST_SILENT_TRIM ||
+         req->message.body.ovflaction == OVFL_LARGEST_SILENT_TRIM)) {
+        attr_data.ovflaction = req->message.body.ovflaction;
+    } else {
+        attr_data.ovflaction = 0;
+    }
+    attr_data.readable = req->message.body.readable;
+    attr_data.eifwhere = 0;
+    attr_data.eiflength = 0;
+
+    ENGINE_ERROR_CODE ret;
+    ret = mc_engine.v1->btree_struct_create(mc_engine.v0, c, key, nkey, &attr_data,
+                                            c->binary_header.request.vbucket);
+    if (ret == ENGINE_EWOULDBLOCK) {
+        c->ewouldblock = true;
+        ret = ENGINE_SUCCESS;
+    }
+    if (settings.detail_enabled) {
+        stats_prefix_record_bop_create(key, nkey);
+    }
+
+    switch (ret) {
+    case ENGINE_SUCCESS:
+        STATS_OKS(c, bop_create, key, nkey);
+        write_bin_response(c, NULL, 0, 0, 0);
+        break;
+    case ENGINE_DISCONNECT:
+        c->state = conn_closing;
+        break;
+    default:
+        STATS_NOKEY(c, cmd_bop_create);
+        if (ret == ENGINE_KEY_EEXISTS)
+            write_bin_packet(c, PROTOCOL_BINARY_RESPONSE_KEY_EEXISTS, 0);
+        else if (ret == ENGINE_PREFIX_ENAME)
+            write_bin_packet(c, PROTOCOL_BINARY_RESPONSE_PREFIX_ENAME, 0);
+        else if (ret == ENGINE_ENOMEM)
+            write_bin_packet(c, PROTOCOL_BINARY_RESPONSE_ENOMEM, 0);
+        else
+            write_bin_packet(c, PROTOCOL_BINARY_RESPONSE_EINTERNAL, 0);
+    }
+}
+
+static void process_bin_bop_prepare_nread(conn *c) {
+    assert(c != NULL);
+    assert(c->cmd == PROTOCOL_BINARY_CMD_BOP_INSERT ||
+           c->cmd == PROTOCOL_BINARY_CMD_BOP_UPSERT);
     char *key = binary_get_key(c);
     uint32_t nkey = c->binary_header.request.keylen;
-    size_t vlen = 0;
+    uint32_t vlen = 0;
 
     if (nkey + c->binary_header.request.extlen <= c->binary_header.request.bodylen) {
         vlen = c->binary_header.request.bodylen - (nkey + c->binary_header.request.extlen);
@@ -6122,2699 +6601,4088 @@ static void process_bin_bop_prepare_nread_keys(conn *c) {
     }
 
     /* fix byteorder in the request */
-    protocol_binary_request_bop_mkeys* req = binary_get_request(c);
-    bkey_range   *bkrange = &req->message.body.bkrange;
-    if (bkrange->from_nbkey == 0) {
+    protocol_binary_request_bop_insert* req = binary_get_request(c);
+    if (req->message.body.nbkey == 0) {
         uint64_t bkey_temp;
-        memcpy((unsigned char*)&bkey_temp, bkrange->from_bkey, sizeof(uint64_t));
+        memcpy((uint8_t*)&bkey_temp, req->message.body.bkey, sizeof(uint64_t));
         bkey_temp = ntohll(bkey_temp);
-        memcpy(bkrange->from_bkey, (unsigned char*)&bkey_temp, sizeof(uint64_t));
-        //*(uint64_t*)bkrange->from_bkey = ntohll(*(uint64_t*)bkrange->from_bkey);
+        memcpy(req->message.body.bkey, (uint8_t*)&bkey_temp, sizeof(uint64_t));
+        //*(uint64_t*)req->message.body.bkey = ntohll(*(uint64_t*)req->message.body.bkey);
     }
-    if (bkrange->to_nbkey   == 0) {
-        uint64_t bkey_temp;
-        memcpy((unsigned char*)&bkey_temp, bkrange->to_bkey, sizeof(uint64_t));
-        bkey_temp = ntohll(bkey_temp);
-        memcpy(bkrange->to_bkey, (unsigned char*)&bkey_temp, sizeof(uint64_t));
-        //*(uint64_t*)bkrange->to_bkey   = ntohll(*(uint64_t*)bkrange->to_bkey);
+    if (req->message.body.create) {
+        req->message.body.exptime  = ntohl(req->message.body.exptime);
+        req->message.body.maxcount = ntohl(req->message.body.maxcount);
     }
-    req->message.body.req_offset = ntohl(req->message.body.req_offset);
-    req->message.body.req_count  = ntohl(req->message.body.req_count);
-    req->message.body.key_count  = ntohl(req->message.body.key_count);
 
     if (settings.verbose > 1) {
-        fprintf(stderr, "<%d BOP %s ", c->sfd, (c->cmd==PROTOCOL_BINARY_CMD_BOP_MGET ? "MGET" : "SMGET"));
+        fprintf(stderr, "<%d BOP %s ",
+                c->sfd, (c->cmd == PROTOCOL_BINARY_CMD_BOP_INSERT ? "INSERT" : "UPSERT"));
         for (int ii = 0; ii < nkey; ++ii) {
             fprintf(stderr, "%c", key[ii]);
         }
-        fprintf(stderr, " ReqOffset(%u) ReqCount(%u) KeyCount(%u)\n",
-                req->message.body.req_offset, req->message.body.req_count, req->message.body.key_count);
+        fprintf(stderr, " NBKey(%d) NEFlag(%d) NBytes(%d)",
+                req->message.body.nbkey, req->message.body.neflag, vlen);
+        if (req->message.body.create) {
+            fprintf(stderr, " %s", "Create");
+        }
+        fprintf(stderr, "\n");
     }
 
-    eitem *elem=NULL;
+    eitem *elem;
 
-    ENGINE_ERROR_CODE ret = ENGINE_SUCCESS;
-    int need_size = 0;
-    do {
-        /* validation checking on arguments */
-        if (req->message.body.key_count < 1 || vlen < 1 || req->message.body.req_count < 1) {
-            ret = ENGINE_EBADVALUE; break;
-        }
-        if (req->message.body.key_count > ((vlen/2)+1)) {
-            ret = ENGINE_EBADVALUE; break;
-        }
-#ifdef SUPPORT_BOP_MGET
-        if (c->cmd == PROTOCOL_BINARY_CMD_BOP_MGET) {
-            int bmget_count;
-            int elem_array_size;
+    ENGINE_ERROR_CODE ret;
+    if ((vlen + 2) > MAX_ELEMENT_BYTES) {
+        ret = ENGINE_E2BIG;
+    } else {
+        ret = mc_engine.v1->btree_elem_alloc(mc_engine.v0, c, key, nkey,
+                                             req->message.body.nbkey,
+                                             req->message.body.neflag, vlen+2,
+                                             &elem);
+    }
 
-            if (req->message.body.key_count > MAX_BMGET_KEY_COUNT ||
-                req->message.body.req_count > MAX_BMGET_ELM_COUNT) {
-                ret = ENGINE_EBADVALUE; break;
-            }
-            bmget_count = req->message.body.key_count * req->message.body.req_count;
-            elem_array_size = bmget_count * sizeof(eitem*);
+    if (settings.detail_enabled && ret != ENGINE_SUCCESS) {
+        stats_prefix_record_bop_insert(key, nkey, false);
+    }
 
-            need_size = elem_array_size;
+    switch (ret) {
+    case ENGINE_SUCCESS:
+        {
+        mc_engine.v1->get_elem_info(mc_engine.v0, c, ITEM_TYPE_BTREE, elem, &c->einfo);
+        if (c->einfo.nscore == 0) {
+            memcpy((void*)c->einfo.score, req->message.body.bkey, sizeof(uint64_t));
+        } else {
+            memcpy((void*)c->einfo.score, req->message.body.bkey, c->einfo.nscore);
         }
-#endif
-#ifdef SUPPORT_BOP_SMGET
-        if (c->cmd == PROTOCOL_BINARY_CMD_BOP_SMGET) {
-#ifdef JHPARK_OLD_SMGET_INTERFACE
-          if (c->coll_smgmode == 0) {
-            int smget_count;
-            int elem_array_size; /* elem pointer array where the found elements will be saved */
-            int kmis_array_size; /* key index array where the missed key indexes are to be saved */
-            int elem_rshdr_size; /* the size of result header about the found elems */
-            int kmis_rshdr_size; /* the size of result header about the missed keys */
-
-            if (req->message.body.key_count > MAX_SMGET_KEY_COUNT ||
-                (req->message.body.req_offset + req->message.body.req_count) > MAX_SMGET_REQ_COUNT) {
-                ret = ENGINE_EBADVALUE; break;
-            }
-            smget_count = req->message.body.req_offset + req->message.body.req_count;
-            elem_array_size = smget_count * (sizeof(eitem*) + (2*sizeof(uint32_t)));
-            kmis_array_size = req->message.body.key_count * sizeof(uint32_t);
-            elem_rshdr_size = smget_count * (sizeof(uint64_t) + (3*sizeof(uint32_t)));
-            kmis_rshdr_size = req->message.body.key_count * sizeof(uint32_t);
-            need_size = elem_array_size + kmis_array_size + elem_rshdr_size + kmis_rshdr_size;
-          } else {
-#endif
-            int elem_array_size; /* smget element array size */
-            int ehit_array_size; /* smget hitted elem array size */
-            int emis_array_size; /* element missed keys array size */
-            int elem_rshdr_size; /* the size of result header about the found elems */
-            int emis_rshdr_size; /* the size of result header about the missed keys */
-
-            if (req->message.body.key_count > MAX_SMGET_KEY_COUNT ||
-                (req->message.body.req_offset + req->message.body.req_count) > MAX_SMGET_REQ_COUNT) {
-                ret = ENGINE_EBADVALUE; break;
-            }
-            elem_array_size = (req->message.body.req_count + req->message.body.key_count) * sizeof(eitem*);
-            ehit_array_size = req->message.body.req_count * sizeof(smget_ehit_t);
-            emis_array_size = req->message.body.key_count * sizeof(smget_emis_t);
-            elem_rshdr_size = req->message.body.req_count * (sizeof(uint64_t) + (3*sizeof(uint32_t)));
-            emis_rshdr_size = req->message.body.key_count * sizeof(uint32_t);
-            need_size = elem_array_size + ehit_array_size + emis_array_size
-                      + elem_rshdr_size + emis_rshdr_size;
-#ifdef JHPARK_OLD_SMGET_INTERFACE
-          }
-#endif
+        if (c->einfo.neflag > 0) {
+            memcpy((void*)c->einfo.eflag, req->message.body.eflag, c->einfo.neflag);
         }
-#endif
-        assert(need_size > 0);
 
-        if ((elem = (eitem *)malloc(need_size)) == NULL) {
-            ret = ENGINE_ENOMEM;
+        ritem_set_first(c, CONN_RTYPE_EINFO, vlen);
+        c->coll_eitem  = (void *)elem;
+        c->coll_ecount = 1;
+        c->coll_op     = (c->cmd == PROTOCOL_BINARY_CMD_BOP_INSERT ? OPERATION_BOP_INSERT
+                                                                   : OPERATION_BOP_UPSERT);
+        c->coll_key    = key;
+        c->coll_nkey   = nkey;
+        if (req->message.body.create) {
+            c->coll_attrp = &c->coll_attr_space; /* create if not exist */
+            c->coll_attrp->flags    = req->message.body.flags;
+            c->coll_attrp->exptime  = realtime(req->message.body.exptime);
+            c->coll_attrp->maxcount = req->message.body.maxcount;
+            c->coll_attrp->readable = 1;
+            c->coll_attrp->eifwhere = 0;
+            c->coll_attrp->eiflength = 0;
         } else {
-            /* allocate memory blocks needed */
-            if (mblck_list_alloc(&c->thread->mblck_pool, 1, vlen, &c->memblist) < 0) {
-                free((void*)elem);
-                ret = ENGINE_ENOMEM;
-            } else {
-                c->coll_bkrange = req->message.body.bkrange;
-                c->coll_efilter = req->message.body.efilter;
-                c->coll_roffset = req->message.body.req_offset;
-                c->coll_rcount  = req->message.body.req_count;
-                c->coll_numkeys = req->message.body.key_count;
-                c->coll_lenkeys = vlen + 2;
-            }
+            c->coll_attrp = NULL;
         }
-    } while(0);
-
-    switch (ret) {
-    case ENGINE_SUCCESS:
-        c->coll_strkeys = (void*)&c->memblist;
-        ritem_set_first(c, CONN_RTYPE_MBLCK, vlen);
-        c->coll_eitem  = (void *)elem;
-        c->coll_ecount = 0;
-        c->coll_op = (c->cmd==PROTOCOL_BINARY_CMD_BOP_MGET ? OPERATION_BOP_MGET : OPERATION_BOP_SMGET);
         conn_set_state(c, conn_nread);
-        c->substate = bin_reading_bop_nread_keys_complete;
+        c->substate = bin_reading_bop_nread_complete;
+        }
+        break;
+    case ENGINE_DISCONNECT:
+        c->state = conn_closing;
         break;
     default:
-        /* ret == ENGINE_EBADVALUE || ret == ENGINE_ENOMEM */
-        if (ret == ENGINE_EBADVALUE)
-            write_bin_packet(c, PROTOCOL_BINARY_RESPONSE_EBADVALUE, vlen);
-        else
+        STATS_NOKEY(c, cmd_bop_insert);
+        if (ret == ENGINE_E2BIG)
+            write_bin_packet(c, PROTOCOL_BINARY_RESPONSE_E2BIG, vlen);
+        else if (ret == ENGINE_ENOMEM)
             write_bin_packet(c, PROTOCOL_BINARY_RESPONSE_ENOMEM, vlen);
+        else
+            write_bin_packet(c, PROTOCOL_BINARY_RESPONSE_EINTERNAL, 0);
 
         /* swallow the data line */
         c->write_and_go = conn_swallow;
     }
 }
-#endif
 
-#ifdef SUPPORT_BOP_MGET
-static void process_bin_bop_mget_complete(conn *c) {
-    assert(c->coll_op == OPERATION_BOP_MGET);
+static void process_bin_bop_insert_complete(conn *c) {
+    assert(c->coll_op == OPERATION_BOP_INSERT ||
+           c->coll_op == OPERATION_BOP_UPSERT);
     assert(c->coll_eitem != NULL);
+    eitem *elem = (eitem *)c->coll_eitem;
 
-    ENGINE_ERROR_CODE ret = ENGINE_ENOTSUP;
-    write_bin_packet(c, PROTOCOL_BINARY_RESPONSE_NOT_SUPPORTED, 0);
-
-    if (ret != ENGINE_SUCCESS) {
-        if (c->coll_strkeys != NULL) {
-            /* free key string memory blocks */
-            assert(c->coll_strkeys == (void*)&c->memblist);
-            mblck_list_free(&c->thread->mblck_pool, &c->memblist);
-            c->coll_strkeys = NULL;
-        }
-        if (c->coll_eitem != NULL) {
-            free((void *)c->coll_eitem);
-            c->coll_eitem = NULL;
-        }
-    }
-}
-#endif
-
-#ifdef SUPPORT_BOP_SMGET
-#ifdef JHPARK_OLD_SMGET_INTERFACE
-static void process_bin_bop_smget_complete_old(conn *c) {
-    int smget_count = c->coll_roffset + c->coll_rcount;
-    int kmis_array_size = c->coll_numkeys * sizeof(uint32_t);
-    char *resultptr;
-    char delimiter = ' ';
-    char old_delimiter = ','; /* need to keep backwards compatibility */
-    token_t *keys_array = NULL;
-    uint32_t  kmis_count = 0;
-    uint32_t  elem_count = 0;
-    eitem   **elem_array = (eitem  **)c->coll_eitem;
-    uint32_t *kfnd_array = (uint32_t*)((char*)elem_array + (smget_count*sizeof(eitem*)));
-    uint32_t *flag_array = (uint32_t*)((char*)kfnd_array + (smget_count*sizeof(uint32_t)));
-    uint32_t *kmis_array = (uint32_t*)((char*)flag_array + (smget_count*sizeof(uint32_t)));
-
-    resultptr = ((char *)kmis_array + kmis_array_size);
+    /* We don't actually receive the trailing two characters in the bin
+     * protocol, so we're going to just set them here */
+    mc_engine.v1->get_elem_info(mc_engine.v0, c, ITEM_TYPE_BTREE, elem, &c->einfo);
+    einfo_set_ascii_tail_string(&c->einfo); /* set "\r\n" */
 
-    bool trimmed;
-    bool duplicated;
+    bool created;
+    bool replaced;
+    bool replace_if_exist = (c->coll_op == OPERATION_BOP_UPSERT ? true : false);
 
-    /* We don't actually receive the trailing two("\r\n") characters in binary protocol.
-     * We should consider this when tokenizing key strings.
-     */
-    ENGINE_ERROR_CODE ret = ENGINE_SUCCESS;
-    keys_array = (token_t*)token_buff_get(&c->thread->token_buff, c->coll_numkeys);
-    if (keys_array != NULL) {
-        int ntokens = tokenize_mblocks(&c->memblist, c->coll_lenkeys-2, delimiter, c->coll_numkeys, keys_array);
-        if (ntokens == -1) {
-            ntokens = tokenize_mblocks(&c->memblist, c->coll_lenkeys-2, old_delimiter, c->coll_numkeys, keys_array);
-        }
-        if (ntokens == -1) {
-            ret = ENGINE_EBADVALUE;
-        } else if (ntokens == -2) {
-            ret = ENGINE_ENOMEM;
-        }
-    } else {
-        ret = ENGINE_ENOMEM;
+    ENGINE_ERROR_CODE ret;
+    ret = mc_engine.v1->btree_elem_insert(mc_engine.v0, c,
+                                   c->coll_key, c->coll_nkey, elem, replace_if_exist,
+                                   c->coll_attrp, &replaced, &created, NULL,
+                                   c->binary_header.request.vbucket);
+    if (ret == ENGINE_EWOULDBLOCK) {
+        c->ewouldblock = true;
+        ret = ENGINE_SUCCESS;
     }
-    if (ret == ENGINE_SUCCESS) {
-        if (c->coll_bkrange.to_nbkey == BKEY_NULL) {
-            memcpy(c->coll_bkrange.to_bkey, c->coll_bkrange.from_bkey,
-                   (c->coll_bkrange.from_nbkey==0 ? sizeof(uint64_t) : c->coll_bkrange.from_nbkey));
-            c->coll_bkrange.to_nbkey = c->coll_bkrange.from_nbkey;
-        }
-        assert(c->coll_numkeys > 0);
-        assert(c->coll_rcount > 0);
-        assert((c->coll_roffset + c->coll_rcount) <= MAX_SMGET_REQ_COUNT);
-        ret = mc_engine.v1->btree_elem_smget_old(mc_engine.v0, c,
-                                     keys_array, c->coll_numkeys,
-                                     &c->coll_bkrange,
-                                     (c->coll_efilter.ncompval==0 ? NULL : &c->coll_efilter),
-                                     c->coll_roffset, c->coll_rcount,
-                                     elem_array, kfnd_array, flag_array, &elem_count,
-                                     kmis_array, &kmis_count, &trimmed, &duplicated,
-                                     c->binary_header.request.vbucket);
+
+    if (settings.detail_enabled) {
+        stats_prefix_record_bop_insert(c->coll_key, c->coll_nkey, (ret==ENGINE_SUCCESS));
     }
 
     switch (ret) {
     case ENGINE_SUCCESS:
-        {
-        protocol_binary_response_bop_smget* rsp = (protocol_binary_response_bop_smget*)c->wbuf;
-        uint32_t real_elem_hdr_size = elem_count * (sizeof(uint64_t) + (3*sizeof(uint32_t)));
-        uint32_t real_kmis_hdr_size = kmis_count * sizeof(uint32_t);
-        uint32_t bodylen, i;
-        uint64_t *bkeyptr;
-        uint32_t *vlenptr;
-        uint32_t *flagptr;
-        uint32_t *klenptr;
-
-        if (((long)resultptr % 8) != 0) /* NOT aligned */
-            resultptr += (8 - ((long)resultptr % 8));
-        bkeyptr = (uint64_t *)resultptr;
-        vlenptr = (uint32_t *)((char*)bkeyptr + (sizeof(uint64_t) * elem_count));
-        flagptr = (uint32_t *)((char*)vlenptr + (sizeof(uint32_t) * elem_count));
-        klenptr = (uint32_t *)((char*)flagptr + (sizeof(uint32_t) * elem_count));
-
-        bodylen = sizeof(rsp->message.body) + (real_elem_hdr_size + real_kmis_hdr_size);
-        for (i = 0; i < elem_count; i++) {
-            mc_engine.v1->get_elem_info(mc_engine.v0, c, ITEM_TYPE_BTREE,
-                                        elem_array[i], &c->einfo);
-            bodylen += ((c->einfo.nbytes - 2) + keys_array[kfnd_array[i]].length);
-            bkeyptr[i] = htonll(*(uint64_t*)c->einfo.score);
-            vlenptr[i] = htonl(c->einfo.nbytes - 2);
-            flagptr[i] = flag_array[i];
-            klenptr[i] = htonl(keys_array[kfnd_array[i]].length);
-        }
-        for (i = 0; i < kmis_count; i++) {
-            bodylen += keys_array[kmis_array[i]].length;
-            klenptr[elem_count+i] = htonl(keys_array[kmis_array[i]].length);
-        }
-        add_bin_header(c, 0, sizeof(rsp->message.body), 0, bodylen);
-
-        // add the flags and count
-        rsp->message.body.elem_count = htonl(elem_count);
-        rsp->message.body.miss_count = htonl(kmis_count);
-        add_iov(c, &rsp->message.body, sizeof(rsp->message.body));
-
-        // add value lengths
-        if (add_iov(c, (char*)bkeyptr, real_elem_hdr_size+real_kmis_hdr_size) != 0) {
-            ret = ENGINE_ENOMEM;
-        }
-
-        /* Add the data without CRLF */
-        if (ret == ENGINE_SUCCESS) {
-            for (i = 0; i < elem_count; i++) {
-                mc_engine.v1->get_elem_info(mc_engine.v0, c, ITEM_TYPE_BTREE,
-                                            elem_array[i], &c->einfo);
-                if (add_iov_einfo_some_value(c, &c->einfo, c->einfo.nbytes - 2) != 0) {
-                    ret = ENGINE_ENOMEM; break;
-                }
-            }
-        }
-        /* Add the found key */
-        if (ret == ENGINE_SUCCESS) {
-            for (i = 0; i < elem_count; i++) {
-                if (add_iov(c, keys_array[kfnd_array[i]].value,
-                               keys_array[kfnd_array[i]].length) != 0) {
-                    ret = ENGINE_ENOMEM; break;
-                }
-            }
-        }
-        /* Add the missed key */
-        if (ret == ENGINE_SUCCESS) {
-            for (i = 0; i < kmis_count; i++) {
-                if (add_iov(c, keys_array[kmis_array[i]].value,
-                               keys_array[kmis_array[i]].length) != 0) {
-                    ret = ENGINE_ENOMEM; break;
-                }
-            }
-        }
-
-        if (ret == ENGINE_SUCCESS) {
-            /* Remember this command so we can garbage collect it later */
-            /* c->coll_eitem  = (void *)elem_array; */
-            STATS_NOKEY2(c, cmd_bop_smget, bop_smget_oks);
-            c->coll_ecount = elem_count;
-            c->coll_op     = OPERATION_BOP_SMGET;
-            conn_set_state(c, conn_mwrite);
-        } else {
-            STATS_NOKEY(c, cmd_bop_smget);
-            mc_engine.v1->btree_elem_release(mc_engine.v0, c, elem_array, elem_count);
-            write_bin_packet(c, PROTOCOL_BINARY_RESPONSE_ENOMEM, 0);
-        }
-        }
+        STATS_HITS(c, bop_insert, c->coll_key, c->coll_nkey);
+        /* Stored */
+        write_bin_response(c, NULL, 0, 0, 0);
         break;
     case ENGINE_DISCONNECT:
         c->state = conn_closing;
         break;
+    case ENGINE_KEY_ENOENT:
+        STATS_MISS(c, bop_insert, c->coll_key, c->coll_nkey);
+        write_bin_packet(c, PROTOCOL_BINARY_RESPONSE_KEY_ENOENT, 0);
+        break;
     default:
-        STATS_NOKEY(c, cmd_bop_smget);
-        if (ret == ENGINE_EBADVALUE)
-            write_bin_packet(c, PROTOCOL_BINARY_RESPONSE_EBADVALUE, 0);
-        else if (ret == ENGINE_EBADTYPE)
+        STATS_NOKEY(c, cmd_bop_insert);
+
+        if (ret == ENGINE_EBADTYPE)
             write_bin_packet(c, PROTOCOL_BINARY_RESPONSE_EBADTYPE, 0);
         else if (ret == ENGINE_EBADBKEY)
             write_bin_packet(c, PROTOCOL_BINARY_RESPONSE_EBADBKEY, 0);
-        else if (ret == ENGINE_EBADATTR)
-            write_bin_packet(c, PROTOCOL_BINARY_RESPONSE_EBADATTR, 0);
+        else if (ret == ENGINE_EOVERFLOW)
+            write_bin_packet(c, PROTOCOL_BINARY_RESPONSE_EOVERFLOW, 0);
         else if (ret == ENGINE_EBKEYOOR)
             write_bin_packet(c, PROTOCOL_BINARY_RESPONSE_EBKEYOOR, 0);
+        else if (ret == ENGINE_ELEM_EEXISTS)
+            write_bin_packet(c, PROTOCOL_BINARY_RESPONSE_ELEM_EEXISTS, 0);
+        else if (ret == ENGINE_PREFIX_ENAME)
+            write_bin_packet(c, PROTOCOL_BINARY_RESPONSE_PREFIX_ENAME, 0);
         else if (ret == ENGINE_ENOMEM)
             write_bin_packet(c, PROTOCOL_BINARY_RESPONSE_ENOMEM, 0);
         else
             write_bin_packet(c, PROTOCOL_BINARY_RESPONSE_EINTERNAL, 0);
     }
 
-    /* free token buffer */
-    if (keys_array != NULL) {
-        token_buff_release(&c->thread->token_buff, keys_array);
-    }
+    /* release the c->coll_eitem reference */
+    mc_engine.v1->btree_elem_release(mc_engine.v0, c, &c->coll_eitem, 1);
+    c->coll_eitem = NULL;
+}
 
-    if (ret != ENGINE_SUCCESS) {
-        if (c->coll_strkeys != NULL) {
-            /* free key string memory blocks */
-            assert(c->coll_strkeys == (void*)&c->memblist);
-            mblck_list_free(&c->thread->mblck_pool, &c->memblist);
-            c->coll_strkeys = NULL;
-        }
-        if (c->coll_eitem != NULL) {
-            free((void *)c->coll_eitem);
-            c->coll_eitem = NULL;
-        }
-    }
+static void process_bin_bop_nread_complete(conn *c) {
+    //protocol_binary_response_status eno = PROTOCOL_BINARY_RESPONSE_EINVAL;
+    assert(c != NULL);
+    process_bin_bop_insert_complete(c);
 }
-#endif
 
-static void process_bin_bop_smget_complete(conn *c) {
-    assert(c->coll_eitem != NULL);
-#ifdef JHPARK_OLD_SMGET_INTERFACE
-    if (c->coll_smgmode == 0) {
-        process_bin_bop_smget_complete_old(c);
-        return;
-    }
-#endif
-    smget_result_t smres;
-    char *resultptr;
-    char delimiter = ' ';
-    char old_delimiter = ','; /* need to keep backwards compatibility */
-    token_t *keys_array = NULL;
+static void process_bin_bop_update_complete(conn *c) {
+    assert(c->coll_op == OPERATION_BOP_UPDATE);
+    char *new_value;
+    int  new_nbytes;
+    eflag_update *eupdate_ptr;
 
-    smres.elem_array = (eitem **)c->coll_eitem;
-    smres.elem_kinfo = (smget_ehit_t *)&smres.elem_array[c->coll_rcount+c->coll_numkeys];
-    smres.miss_kinfo = (smget_emis_t *)&smres.elem_kinfo[c->coll_rcount];
+    if (c->coll_eitem != NULL) {
+        value_item *value = (value_item *)c->coll_eitem;
+        memcpy(value->ptr + value->len - 2, "\r\n", 2);
+        new_value  = value->ptr;
+        new_nbytes = value->len;
+    } else {
+        new_value  = NULL;
+        new_nbytes = 0;
+    }
 
-    resultptr = (char *)&smres.miss_kinfo[c->coll_numkeys];
+    eupdate_ptr = (c->coll_eupdate.neflag == EFLAG_NULL ? NULL : &c->coll_eupdate);
 
-    /* We don't actually receive the trailing two("\r\n") characters in binary protocol.
-     * We should consider this when tokenizing key strings.
-     */
-    ENGINE_ERROR_CODE ret = ENGINE_SUCCESS;
-    keys_array = (token_t*)token_buff_get(&c->thread->token_buff, c->coll_numkeys);
-    if (keys_array != NULL) {
-        int ntokens = tokenize_mblocks(&c->memblist, c->coll_lenkeys-2, delimiter, c->coll_numkeys, keys_array);
-        if (ntokens == -1) {
-            ntokens = tokenize_mblocks(&c->memblist, c->coll_lenkeys-2, old_delimiter, c->coll_numkeys, keys_array);
-        }
-        if (ntokens == -1) {
-            ret = ENGINE_EBADVALUE;
-        } else if (ntokens == -2) {
-            ret = ENGINE_ENOMEM;
-        }
-    } else {
-        ret = ENGINE_ENOMEM;
+    ENGINE_ERROR_CODE ret;
+    ret = mc_engine.v1->btree_elem_update(mc_engine.v0, c,
+                                       c->coll_key, c->coll_nkey,
+                                       &c->coll_bkrange, eupdate_ptr,
+                                       new_value, new_nbytes,
+                                       c->binary_header.request.vbucket);
+    if (ret == ENGINE_EWOULDBLOCK) {
+        c->ewouldblock = true;
+        ret = ENGINE_SUCCESS;
     }
-    if (ret == ENGINE_SUCCESS) {
-        if (c->coll_bkrange.to_nbkey == BKEY_NULL) {
-            memcpy(c->coll_bkrange.to_bkey, c->coll_bkrange.from_bkey,
-                   (c->coll_bkrange.from_nbkey==0 ? sizeof(uint64_t) : c->coll_bkrange.from_nbkey));
-            c->coll_bkrange.to_nbkey = c->coll_bkrange.from_nbkey;
-        }
-        assert(c->coll_numkeys > 0);
-        assert(c->coll_rcount > 0);
-        assert((c->coll_roffset + c->coll_rcount) <= MAX_SMGET_REQ_COUNT);
-        ret = mc_engine.v1->btree_elem_smget(mc_engine.v0, c,
-                                     keys_array, c->coll_numkeys,
-                                     &c->coll_bkrange,
-                                     (c->coll_efilter.ncompval==0 ? NULL : &c->coll_efilter),
-                                     c->coll_roffset, c->coll_rcount,
-#ifdef JHPARK_OLD_SMGET_INTERFACE
-                                     (c->coll_smgmode == 2 ? true : false), &smres,
-#else
-                                     c->coll_unique, &smres,
-#endif
-                                     c->binary_header.request.vbucket);
+
+    if (settings.detail_enabled) {
+        stats_prefix_record_bop_update(c->coll_key, c->coll_nkey,
+                                       (ret==ENGINE_SUCCESS || ret==ENGINE_ELEM_ENOENT));
     }
 
     switch (ret) {
     case ENGINE_SUCCESS:
-        {
-        protocol_binary_response_bop_smget* rsp = (protocol_binary_response_bop_smget*)c->wbuf;
-        uint32_t real_elem_hdr_size = smres.elem_count * (sizeof(uint64_t) + (3*sizeof(uint32_t)));
-        uint32_t real_emis_hdr_size = (smres.miss_count + smres.trim_count) * sizeof(uint32_t);
-        uint32_t bodylen, i;
-        uint64_t *bkeyptr;
-        uint32_t *vlenptr;
-        uint32_t *flagptr;
-        uint32_t *klenptr;
-
-        if (((long)resultptr % 8) != 0) /* NOT aligned */
-            resultptr += (8 - ((long)resultptr % 8));
-        bkeyptr = (uint64_t *)resultptr;
-        vlenptr = (uint32_t *)((char*)bkeyptr + (sizeof(uint64_t) * smres.elem_count));
-        flagptr = (uint32_t *)((char*)vlenptr + (sizeof(uint32_t) * smres.elem_count));
-        klenptr = (uint32_t *)((char*)flagptr + (sizeof(uint32_t) * smres.elem_count));
-
-        bodylen = sizeof(rsp->message.body) + (real_elem_hdr_size + real_emis_hdr_size);
-        for (i = 0; i < smres.elem_count; i++) {
-            mc_engine.v1->get_elem_info(mc_engine.v0, c, ITEM_TYPE_BTREE,
-                                        smres.elem_array[i], &c->einfo);
-            bodylen += ((c->einfo.nbytes - 2) + keys_array[smres.elem_kinfo[i].kidx].length);
-            bkeyptr[i] = htonll(*(uint64_t*)c->einfo.score);
-            vlenptr[i] = htonl(c->einfo.nbytes - 2);
-            flagptr[i] = smres.elem_kinfo[i].flag;
-            klenptr[i] = htonl(keys_array[smres.elem_kinfo[i].kidx].length);
-        }
-        for (i = 0; i < smres.miss_count; i++) {
-            bodylen += keys_array[smres.miss_kinfo[i].kidx].length;
-            klenptr[smres.elem_count+i] = htonl(keys_array[smres.miss_kinfo[i].kidx].length);
-        }
-        for (i = 0; i < smres.trim_count; i++) {
-            bodylen += keys_array[smres.trim_kinfo[i].kidx].length;
-            klenptr[smres.elem_count+smres.miss_count+i] = htonl(keys_array[smres.trim_kinfo[i].kidx].length);
-        }
-        add_bin_header(c, 0, sizeof(rsp->message.body), 0, bodylen);
-
-        // add the flags and count
-        rsp->message.body.elem_count = htonl(smres.elem_count);
-        rsp->message.body.miss_count = htonl(smres.miss_count);
-        rsp->message.body.trim_count = htonl(smres.trim_count);
-        add_iov(c, &rsp->message.body, sizeof(rsp->message.body));
-
-        // add value lengths
-        if (add_iov(c, (char*)bkeyptr, real_elem_hdr_size+real_emis_hdr_size) != 0) {
-            ret = ENGINE_ENOMEM;
-        }
-
-        /* Add the data without CRLF */
-        if (ret == ENGINE_SUCCESS) {
-            for (i = 0; i < smres.elem_count; i++) {
-                mc_engine.v1->get_elem_info(mc_engine.v0, c, ITEM_TYPE_BTREE,
-                                            smres.elem_array[i], &c->einfo);
-                if (add_iov_einfo_some_value(c, &c->einfo, c->einfo.nbytes - 2) != 0) {
-                    ret = ENGINE_ENOMEM; break;
-                }
-            }
-        }
-        /* Add the found key */
-        if (ret == ENGINE_SUCCESS) {
-            for (i = 0; i < smres.elem_count; i++) {
-                if (add_iov(c, keys_array[smres.elem_kinfo[i].kidx].value,
-                               keys_array[smres.elem_kinfo[i].kidx].length) != 0) {
-                    ret = ENGINE_ENOMEM; break;
-                }
-            }
-        }
-        /* Add the missed key */
-        if (ret == ENGINE_SUCCESS) {
-            for (i = 0; i < smres.miss_count; i++) {
-                if (add_iov(c, keys_array[smres.miss_kinfo[i].kidx].value,
-                               keys_array[smres.miss_kinfo[i].kidx].length) != 0) {
-                    ret = ENGINE_ENOMEM; break;
-                }
-            }
-        }
-        /* Add the trimmed key */
-        if (ret == ENGINE_SUCCESS) {
-            for (i = 0; i < smres.trim_count; i++) {
-                if (add_iov(c, keys_array[smres.trim_kinfo[i].kidx].value,
-                               keys_array[smres.trim_kinfo[i].kidx].length) != 0) {
-                    ret = ENGINE_ENOMEM; break;
-                }
-            }
-        }
-
-        if (ret == ENGINE_SUCCESS) {
-            /* Remember this command so we can garbage collect it later */
-            /* c->coll_eitem  = (void *)elem_array; */
-            STATS_NOKEY2(c, cmd_bop_smget, bop_smget_oks);
-            c->coll_ecount = smres.elem_count+smres.trim_count;
-            c->coll_op     = OPERATION_BOP_SMGET;
-            conn_set_state(c, conn_mwrite);
-        } else {
-            STATS_NOKEY(c, cmd_bop_smget);
-            mc_engine.v1->btree_elem_release(mc_engine.v0, c, smres.elem_array,
-                                             smres.elem_count+smres.trim_count);
-            write_bin_packet(c, PROTOCOL_BINARY_RESPONSE_ENOMEM, 0);
-        }
-        }
+        STATS_ELEM_HITS(c, bop_update, c->coll_key, c->coll_nkey);
+        write_bin_response(c, NULL, 0, 0, 0);
+        break;
+    case ENGINE_ELEM_ENOENT:
+        STATS_NONE_HITS(c, bop_update, c->coll_key, c->coll_nkey);
+        write_bin_packet(c, PROTOCOL_BINARY_RESPONSE_ELEM_ENOENT, 0);
         break;
     case ENGINE_DISCONNECT:
         c->state = conn_closing;
         break;
+    case ENGINE_KEY_ENOENT:
+        STATS_MISS(c, bop_update, c->coll_key, c->coll_nkey);
+        write_bin_packet(c, PROTOCOL_BINARY_RESPONSE_KEY_ENOENT, 0);
+        break;
     default:
-        STATS_NOKEY(c, cmd_bop_smget);
-        if (ret == ENGINE_EBADVALUE)
-            write_bin_packet(c, PROTOCOL_BINARY_RESPONSE_EBADVALUE, 0);
-        else if (ret == ENGINE_EBADTYPE)
+        STATS_NOKEY(c, cmd_bop_update);
+        if (ret == ENGINE_EBADTYPE)
             write_bin_packet(c, PROTOCOL_BINARY_RESPONSE_EBADTYPE, 0);
         else if (ret == ENGINE_EBADBKEY)
             write_bin_packet(c, PROTOCOL_BINARY_RESPONSE_EBADBKEY, 0);
-        else if (ret == ENGINE_EBADATTR)
-            write_bin_packet(c, PROTOCOL_BINARY_RESPONSE_EBADATTR, 0);
-#if 0 // JHPARK_SMGET_OFFSET_HANDLING
-        else if (ret == ENGINE_EBKEYOOR)
-            write_bin_packet(c, PROTOCOL_BINARY_RESPONSE_EBKEYOOR, 0);
-#endif
+        else if (ret == ENGINE_EBADEFLAG)
+            write_bin_packet(c, PROTOCOL_BINARY_RESPONSE_EBADEFLAG, 0);
         else if (ret == ENGINE_ENOMEM)
             write_bin_packet(c, PROTOCOL_BINARY_RESPONSE_ENOMEM, 0);
         else
             write_bin_packet(c, PROTOCOL_BINARY_RESPONSE_EINTERNAL, 0);
     }
 
-    /* free token buffer */
-    if (keys_array != NULL) {
-        token_buff_release(&c->thread->token_buff, keys_array);
-    }
-
-    if (ret != ENGINE_SUCCESS) {
-        if (c->coll_strkeys != NULL) {
-            /* free key string memory blocks */
-            assert(c->coll_strkeys == (void*)&c->memblist);
-            mblck_list_free(&c->thread->mblck_pool, &c->memblist);
-            c->coll_strkeys = NULL;
-        }
-        if (c->coll_eitem != NULL) {
-            free((void *)c->coll_eitem);
-            c->coll_eitem = NULL;
-        }
+    if (c->coll_eitem != NULL) {
+        free((void*)c->coll_eitem);
+        c->coll_eitem = NULL;
     }
 }
-#endif
-
-#if defined(SUPPORT_BOP_MGET) || defined(SUPPORT_BOP_SMGET)
-static void process_bin_bop_nread_keys_complete(conn *c) {
-    assert(c != NULL);
-#ifdef SUPPORT_BOP_MGET
-    if (c->coll_op == OPERATION_BOP_MGET)
-        process_bin_bop_mget_complete(c);
-#endif
-#ifdef SUPPORT_BOP_SMGET
-    if (c->coll_op == OPERATION_BOP_SMGET)
-        process_bin_bop_smget_complete(c);
-#endif
-}
-#endif
 
-static void process_bin_getattr(conn *c) {
+static void process_bin_bop_update_prepare_nread(conn *c) {
     assert(c != NULL);
+    assert(c->cmd == PROTOCOL_BINARY_CMD_BOP_UPDATE);
     char *key = binary_get_key(c);
-    int  nkey = c->binary_header.request.keylen;
 
-    if (settings.verbose > 1) {
-        fprintf(stderr, "<%d GETATTR ", c->sfd);
-        for (int ii = 0; ii < nkey; ++ii) {
-            fprintf(stderr, "%c", key[ii]);
-        }
-        fprintf(stderr, "\n");
-    }
-
-    item_attr attr_data;
-    ENGINE_ITEM_ATTR attr_ids[ATTR_END];
-    uint32_t attr_count = 0;
-
-    ENGINE_ERROR_CODE ret;
-    ret = mc_engine.v1->getattr(mc_engine.v0, c, key, nkey,
-                                attr_ids, attr_count, &attr_data,
-                                c->binary_header.request.vbucket);
+    uint32_t nkey = 0;
+    uint32_t vlen = 0;
+    int  real_nbkey;
 
-    if (settings.detail_enabled) {
-        stats_prefix_record_getattr(key, nkey);
+    nkey = c->binary_header.request.keylen;
+    if (nkey + c->binary_header.request.extlen <= c->binary_header.request.bodylen) {
+        vlen = c->binary_header.request.bodylen - (nkey + c->binary_header.request.extlen);
+    } else {
+        handle_binary_protocol_error(c);
+        return;
     }
 
-    switch (ret) {
-    case ENGINE_SUCCESS:
-        {
-        STATS_HITS(c, getattr, key, nkey);
-
-        protocol_binary_response_getattr* rsp = (protocol_binary_response_getattr*)c->wbuf;
-        rsp->message.body.flags      = attr_data.flags;
-        rsp->message.body.expiretime = htonl(attr_data.exptime);
-        rsp->message.body.type       = attr_data.type;
-        if (attr_data.type == ITEM_TYPE_LIST || attr_data.type == ITEM_TYPE_SET ||
-            attr_data.type == ITEM_TYPE_BTREE) {
-            rsp->message.body.count      = htonl(attr_data.count);
-            rsp->message.body.maxcount   = htonl(attr_data.maxcount);
-            rsp->message.body.ovflaction = attr_data.ovflaction;
-            rsp->message.body.readable   = attr_data.readable;
-        }
-        if (attr_data.type == ITEM_TYPE_BTREE) {
-            rsp->message.body.maxbkeyrange.len = attr_data.maxbkeyrange.len;
-            if (attr_data.maxbkeyrange.len != BKEY_NULL) {
-                if (attr_data.maxbkeyrange.len == 0) {
-                    uint64_t bkey_temp;
-                    memcpy((unsigned char*)&bkey_temp, attr_data.maxbkeyrange.val, sizeof(uint64_t));
-                    bkey_temp = htonll(bkey_temp);
-                    memcpy(rsp->message.body.maxbkeyrange.val, (unsigned char*)&bkey_temp, sizeof(uint64_t));
-                    //*(uint64_t*)rsp->message.body.maxbkeyrange.val = htonll(*(uint64_t*)attr_data.maxbkeyrange.val);
-                } else {
-                    memcpy(rsp->message.body.maxbkeyrange.val, attr_data.maxbkeyrange.val, attr_data.maxbkeyrange.len);
-                }
-            }
-        }
-        write_bin_response(c, &rsp->message.body, 0, 0, sizeof(rsp->message.body));
+    /* fix byteorder in the request */
+    protocol_binary_request_bop_update* req = binary_get_request(c);
+    if (req->message.body.nbkey == 0) {
+        uint64_t bkey_temp;
+        memcpy((uint8_t*)&bkey_temp, req->message.body.bkey, sizeof(uint64_t));
+        bkey_temp = ntohll(bkey_temp);
+        memcpy(req->message.body.bkey, (uint8_t*)&bkey_temp, sizeof(uint64_t));
+        //*(uint64_t*)req->message.body.bkey = ntohll(*(uint64_t*)req->message.body.bkey);
+        real_nbkey = 8;
+    } else {
+        real_nbkey = req->message.body.nbkey;
+    }
+    /* build bkey range */
+    memcpy(c->coll_bkrange.from_bkey, req->message.body.bkey, real_nbkey);
+    c->coll_bkrange.from_nbkey = req->message.body.nbkey;
+    c->coll_bkrange.to_nbkey   = BKEY_NULL;
+    /* build elem update */
+    c->coll_eupdate.fwhere = req->message.body.fwhere;
+    c->coll_eupdate.bitwop = req->message.body.bitwop;
+    c->coll_eupdate.neflag = req->message.body.neflag;
+    if (req->message.body.neflag > 0) {
+        memcpy(c->coll_eupdate.eflag, req->message.body.eflag, req->message.body.neflag);
+    }
+
+    if (settings.verbose > 1) {
+        fprintf(stderr, "<%d BOP UPDATE", c->sfd);
+        for (int ii = 0; ii < nkey; ++ii) {
+            fprintf(stderr, "%c", key[ii]);
         }
-        break;
-    case ENGINE_DISCONNECT:
-        c->state = conn_closing;
-        break;
-    case ENGINE_KEY_ENOENT:
-        STATS_MISS(c, getattr, key, nkey);
-        write_bin_packet(c, PROTOCOL_BINARY_RESPONSE_KEY_ENOENT, 0);
+        fprintf(stderr, " NBKey(%d) NEFlag(%d) NBytes(%d)",
+                req->message.body.nbkey, req->message.body.neflag, vlen);
+        fprintf(stderr, "\n");
+    }
+
+    if (req->message.body.novalue) {
+        c->coll_eitem  = NULL;
+        c->coll_ecount = 0;
+        c->coll_key    = key;
+        c->coll_nkey   = nkey;
+        c->coll_op     = OPERATION_BOP_UPDATE;
+        process_bin_bop_update_complete(c);
+        return;
+    }
+
+    eitem *elem = NULL;
+
+    ENGINE_ERROR_CODE ret = ENGINE_SUCCESS;
+    if ((vlen + 2) > MAX_ELEMENT_BYTES) {
+        ret = ENGINE_E2BIG;
+    } else {
+        if ((elem = (eitem *)malloc(sizeof(value_item) + vlen + 2)) == NULL)
+            ret = ENGINE_ENOMEM;
+        else
+            ((value_item*)elem)->len = vlen + 2;
+    }
+
+    if (settings.detail_enabled && ret != ENGINE_SUCCESS) {
+        stats_prefix_record_bop_update(key, nkey, false);
+    }
+
+    switch (ret) {
+    case ENGINE_SUCCESS:
+        c->ritem       = ((value_item *)elem)->ptr;
+        c->rlbytes     = vlen;
+        c->coll_eitem  = (void *)elem;
+        c->coll_ecount = 1;
+        c->coll_key    = key;
+        c->coll_nkey   = nkey;
+        c->coll_op     = OPERATION_BOP_UPDATE;
+        conn_set_state(c, conn_nread);
+        c->substate = bin_reading_bop_update_nread_complete;
         break;
     default:
-        STATS_NOKEY(c, cmd_getattr);
-        if (ret == ENGINE_EBADATTR)
-            write_bin_packet(c, PROTOCOL_BINARY_RESPONSE_EBADATTR, 0);
+        STATS_NOKEY(c, cmd_bop_update);
+        /* ret == ENGINE_E2BIG || ret == ENGINE_ENOMEM */
+        if (ret == ENGINE_E2BIG)
+            write_bin_packet(c, PROTOCOL_BINARY_RESPONSE_E2BIG, vlen);
         else
             write_bin_packet(c, PROTOCOL_BINARY_RESPONSE_EINTERNAL, 0);
+
+        /* swallow the data line */
+        c->write_and_go = conn_swallow;
     }
 }
 
-static void process_bin_setattr(conn *c) {
+static void process_bin_bop_delete(conn *c) {
     assert(c != NULL);
     assert(c->ewouldblock == false);
     char *key = binary_get_key(c);
     int  nkey = c->binary_header.request.keylen;
 
-    item_attr attr_data;
-    ENGINE_ITEM_ATTR attr_ids[ATTR_END];
-    uint32_t attr_count = 0;
-
     /* fix byteorder in the request */
-    protocol_binary_request_setattr* req = binary_get_request(c);
-
-    if (req->message.body.expiretime_f != 0) {
-        attr_ids[attr_count++] = ATTR_EXPIRETIME;
-        req->message.body.expiretime = ntohl(req->message.body.expiretime);
-        attr_data.exptime = realtime(req->message.body.expiretime);
-    }
-    if (req->message.body.maxcount_f != 0) {
-        attr_ids[attr_count++] = ATTR_MAXCOUNT;
-        req->message.body.maxcount = ntohl(req->message.body.maxcount);
-        attr_data.maxcount = req->message.body.maxcount;
-    }
-    if (req->message.body.maxbkeyrange.len != BKEY_NULL) {
-        attr_ids[attr_count++] = ATTR_MAXBKEYRANGE;
-        if (req->message.body.maxbkeyrange.len == 0) {
-            uint64_t bkey_temp;
-            memcpy((unsigned char*)&bkey_temp, req->message.body.maxbkeyrange.val, sizeof(uint64_t));
-            bkey_temp = ntohll(bkey_temp);
-            memcpy(attr_data.maxbkeyrange.val, (unsigned char*)&bkey_temp, sizeof(uint64_t));
-            //*(uint64_t*)attr_data.maxbkeyrange.val = ntohll(*(uint64_t*)req->message.body.maxbkeyrange.val);
-        } else {
-            memcpy(attr_data.maxbkeyrange.val, req->message.body.maxbkeyrange.val, req->message.body.maxbkeyrange.len);
-        }
-        attr_data.maxbkeyrange.len = req->message.body.maxbkeyrange.len;
-    }
-    if (req->message.body.ovflaction != 0) {
-        attr_ids[attr_count++] = ATTR_OVFLACTION;
-        attr_data.ovflaction = req->message.body.ovflaction;
+    protocol_binary_request_bop_delete* req = binary_get_request(c);
+    bkey_range   *bkrange = &req->message.body.bkrange;
+    eflag_filter *efilter = &req->message.body.efilter;
+    if (bkrange->from_nbkey == 0) {
+        uint64_t bkey_temp;
+        memcpy((unsigned char*)&bkey_temp, bkrange->from_bkey, sizeof(uint64_t));
+        bkey_temp = ntohll(bkey_temp);
+        memcpy(bkrange->from_bkey, (unsigned char*)&bkey_temp, sizeof(uint64_t));
+        //*(uint64_t*)bkrange->from_bkey = ntohll(*(uint64_t*)bkrange->from_bkey);
     }
-    if (req->message.body.readable != 0) {
-        attr_ids[attr_count++] = ATTR_READABLE;
-        attr_data.readable = req->message.body.readable;
+    if (bkrange->to_nbkey   == 0) {
+        uint64_t bkey_temp;
+        memcpy((unsigned char*)&bkey_temp, bkrange->to_bkey, sizeof(uint64_t));
+        bkey_temp = ntohll(bkey_temp);
+        memcpy(bkrange->to_bkey, (unsigned char*)&bkey_temp, sizeof(uint64_t));
+        //*(uint64_t*)bkrange->to_bkey   = ntohll(*(uint64_t*)bkrange->to_bkey);
     }
+    req->message.body.count = ntohl(req->message.body.count);
 
     if (settings.verbose > 1) {
-        fprintf(stderr, "<%d SETATTR ", c->sfd);
+        fprintf(stderr, "<%d BOP DELETE ", c->sfd);
         for (int ii = 0; ii < nkey; ++ii) {
             fprintf(stderr, "%c", key[ii]);
         }
-        for (int ii = 0; ii < attr_count; ii++) {
-             if (attr_ids[ii] == ATTR_EXPIRETIME)
-                 fprintf(stderr, " expiretime=%d", (int32_t)attr_data.exptime);
-             else if (attr_ids[ii] == ATTR_MAXCOUNT)
-                 fprintf(stderr, " maxcount=%d", attr_data.maxcount);
-             else if (attr_ids[ii] == ATTR_OVFLACTION)
-                 fprintf(stderr, " ovflaction=%s", get_ovflaction_str(attr_data.ovflaction));
-             else if (attr_ids[ii] == ATTR_READABLE)
-                 fprintf(stderr, " readable=%s", (attr_data.readable ? "on" : "off"));
-             else if (attr_ids[ii] == ATTR_MAXBKEYRANGE) {
-                 char buffer[MAX_BKEY_LENG*2+4];
-                 if (attr_data.maxbkeyrange.len == 0) {
-                     uint64_t bkey_temp;
-                     memcpy((unsigned char*)&bkey_temp, attr_data.maxbkeyrange.val, sizeof(uint64_t));
-                     fprintf(stderr, "maxbkeyrange=%"PRIu64, bkey_temp);
-                     //fprintf(stderr, "maxbkeyrange=%"PRIu64, *(uint64_t*)attr_data.maxbkeyrange.val);
-                 } else {
-                     safe_hexatostr(attr_data.maxbkeyrange.val, attr_data.maxbkeyrange.len, buffer);
-                     fprintf(stderr, "maxbkeyrange=0x%s", buffer);
-                 }
-             }
-        }
-        fprintf(stderr, "\n");
     }
 
+    uint32_t del_count;
+    uint32_t acc_count; /* access count */
+    bool     dropped;
+
     ENGINE_ERROR_CODE ret;
-    ret = mc_engine.v1->setattr(mc_engine.v0, c, key, nkey,
-                                attr_ids, attr_count, &attr_data,
-                                c->binary_header.request.vbucket);
+    ret = mc_engine.v1->btree_elem_delete(mc_engine.v0, c, key, nkey,
+                                          bkrange, efilter, req->message.body.count,
+                                          (bool)req->message.body.drop,
+                                          &del_count, &acc_count, &dropped,
+                                          c->binary_header.request.vbucket);
     if (ret == ENGINE_EWOULDBLOCK) {
         c->ewouldblock = true;
         ret = ENGINE_SUCCESS;
     }
 
     if (settings.detail_enabled) {
-        stats_prefix_record_setattr(key, nkey);
+        stats_prefix_record_bop_delete(key, nkey,
+                                       (ret==ENGINE_SUCCESS || ret==ENGINE_ELEM_ENOENT));
     }
 
     switch (ret) {
     case ENGINE_SUCCESS:
-        STATS_HITS(c, setattr, key, nkey);
+        STATS_ELEM_HITS(c, bop_delete, key, nkey);
         write_bin_response(c, NULL, 0, 0, 0);
         break;
+    case ENGINE_ELEM_ENOENT:
+        STATS_NONE_HITS(c, bop_delete, key, nkey);
+        write_bin_packet(c, PROTOCOL_BINARY_RESPONSE_ELEM_ENOENT, 0);
+        break;
     case ENGINE_DISCONNECT:
         c->state = conn_closing;
         break;
     case ENGINE_KEY_ENOENT:
-        STATS_MISS(c, setattr, key, nkey);
+        STATS_MISS(c, bop_delete, key, nkey);
         write_bin_packet(c, PROTOCOL_BINARY_RESPONSE_KEY_ENOENT, 0);
         break;
     default:
-        STATS_NOKEY(c, cmd_setattr);
-        if (ret == ENGINE_EBADATTR)
-            write_bin_packet(c, PROTOCOL_BINARY_RESPONSE_EBADATTR, 0);
-        else if (ret == ENGINE_EBADVALUE)
-            write_bin_packet(c, PROTOCOL_BINARY_RESPONSE_EBADVALUE, 0);
+        STATS_NOKEY(c, cmd_bop_delete);
+        if (ret == ENGINE_EBADTYPE)
+            write_bin_packet(c, PROTOCOL_BINARY_RESPONSE_EBADTYPE, 0);
+        else if (ret == ENGINE_EBADBKEY)
+            write_bin_packet(c, PROTOCOL_BINARY_RESPONSE_EBADBKEY, 0);
         else
             write_bin_packet(c, PROTOCOL_BINARY_RESPONSE_EINTERNAL, 0);
     }
 }
 
-static bool binary_response_handler(const void *key, uint16_t keylen,
-                                    const void *ext, uint8_t extlen,
-                                    const void *body, uint32_t bodylen,
-                                    uint8_t datatype, uint16_t status,
-                                    uint64_t cas, const void *cookie)
-{
-    conn *c = (conn*)cookie;
-    /* Look at append_bin_stats */
-    size_t needed = keylen + extlen + bodylen + sizeof(protocol_binary_response_header);
-    if (!grow_dynamic_buffer(c, needed)) {
-        if (settings.verbose > 0) {
-            mc_logger->log(EXTENSION_LOG_INFO, c,
-                    "<%d ERROR: Failed to allocate memory for response\n", c->sfd);
-        }
-        return false;
-    }
+static void process_bin_bop_get(conn *c) {
+    assert(c != NULL);
+    assert(c->ewouldblock == false);
+    assert(c->cmd == PROTOCOL_BINARY_CMD_BOP_GET);
+    char *key = binary_get_key(c);
+    int  nkey = c->binary_header.request.keylen;
 
-    char *buf = c->dynamic_buffer.buffer + c->dynamic_buffer.offset;
-    protocol_binary_response_header header = {
-        .response.magic = (uint8_t)PROTOCOL_BINARY_RES,
-        .response.opcode = c->binary_header.request.opcode,
-        .response.keylen = (uint16_t)htons(keylen),
-        .response.extlen = extlen,
-        .response.datatype = datatype,
-        .response.status = (uint16_t)htons(status),
-        .response.bodylen = htonl(bodylen + keylen + extlen),
-        .response.opaque = c->opaque,
-        .response.cas = htonll(cas),
-    };
+    /* fix byteorder in the request */
+    protocol_binary_request_bop_get* req = binary_get_request(c);
+    bkey_range   *bkrange = &req->message.body.bkrange;
+    eflag_filter *efilter = &req->message.body.efilter;
+    if (bkrange->from_nbkey == 0) {
+        uint64_t bkey_temp;
+        memcpy((unsigned char*)&bkey_temp, bkrange->from_bkey, sizeof(uint64_t));
+        bkey_temp = ntohll(bkey_temp);
+        memcpy(bkrange->from_bkey, (unsigned char*)&bkey_temp, sizeof(uint64_t));
+        //*(uint64_t*)bkrange->from_bkey = ntohll(*(uint64_t*)bkrange->from_bkey);
+    }
+    if (bkrange->to_nbkey   == 0) {
+        uint64_t bkey_temp;
+        memcpy((unsigned char*)&bkey_temp, bkrange->to_bkey, sizeof(uint64_t));
+        bkey_temp = ntohll(bkey_temp);
+        memcpy(bkrange->to_bkey, (unsigned char*)&bkey_temp, sizeof(uint64_t));
+        //*(uint64_t*)bkrange->to_bkey   = ntohll(*(uint64_t*)bkrange->to_bkey);
+    }
+    req->message.body.offset = ntohl(req->message.body.offset);
+    req->message.body.count  = ntohl(req->message.body.count);
 
-    memcpy(buf, header.bytes, sizeof(header.response));
-    buf += sizeof(header.response);
+    if (settings.verbose > 1) {
+        fprintf(stderr, "<%d BOP GET ", c->sfd);
+        for (int ii = 0; ii < nkey; ++ii) {
+            fprintf(stderr, "%c", key[ii]);
+        }
+        fprintf(stderr, " Offset(%u) Count(%u) Delete(%s)\n",
+                req->message.body.offset, req->message.body.count,
+                (req->message.body.delete ? "true" : "false"));
+    }
 
-    if (extlen > 0) {
-        memcpy(buf, ext, extlen);
-        buf += extlen;
+    eitem  **elem_array = NULL;
+    uint32_t elem_count;
+    uint32_t access_count;
+    uint32_t flags, i;
+    bool     dropped_trimmed;
+    int      est_count;
+    int      need_size;
+
+    ENGINE_ERROR_CODE ret = ENGINE_SUCCESS;
+
+    est_count = MAX_BTREE_SIZE;
+    if (req->message.body.count > 0 && req->message.body.count < MAX_BTREE_SIZE) {
+        est_count = req->message.body.count;
+        if (est_count % 2) est_count += 1;
+    }
+    need_size = est_count * (sizeof(eitem*)+MAX_BKEY_LENG+MAX_EFLAG_LENG+sizeof(uint32_t));
+    if ((elem_array = (eitem **)malloc(need_size)) == NULL) {
+        write_bin_packet(c, PROTOCOL_BINARY_RESPONSE_ENOMEM, 0);
+        return;
     }
 
-    if (keylen > 0) {
-        memcpy(buf, key, keylen);
-        buf += keylen;
+    ret = mc_engine.v1->btree_elem_get(mc_engine.v0, c, key, nkey,
+                                       bkrange, efilter,
+                                       req->message.body.offset,
+                                       req->message.body.count,
+                                       (bool)req->message.body.delete,
+                                       (bool)req->message.body.drop,
+                                       elem_array, &elem_count, &access_count,
+                                       &flags, &dropped_trimmed,
+                                       c->binary_header.request.vbucket);
+    if (ret == ENGINE_EWOULDBLOCK) {
+        c->ewouldblock = true;
+        ret = ENGINE_SUCCESS;
     }
 
-    if (bodylen > 0) {
-        memcpy(buf, body, bodylen);
+    if (settings.detail_enabled) {
+        stats_prefix_record_bop_get(key, nkey,
+                                    (ret==ENGINE_SUCCESS || ret==ENGINE_ELEM_ENOENT));
     }
 
-    c->dynamic_buffer.offset += needed;
+    switch (ret) {
+    case ENGINE_SUCCESS:
+        {
+        protocol_binary_response_bop_get* rsp = (protocol_binary_response_bop_get*)c->wbuf;
+        uint64_t *bkeyptr = ((elem_count % 2) == 0 /* for 8 byte align */
+                             ? (uint64_t *)&elem_array[elem_count]
+                             : (uint64_t *)&elem_array[elem_count+1]);
+        uint32_t *vlenptr = (uint32_t *)((char*)bkeyptr + (sizeof(uint64_t) * elem_count));
+        uint32_t  bodylen;
 
-    return true;
-}
+        bodylen = sizeof(rsp->message.body) + (elem_count * (sizeof(uint64_t)+sizeof(uint32_t)));
+        for (i = 0; i < elem_count; i++) {
+            mc_engine.v1->get_elem_info(mc_engine.v0, c, ITEM_TYPE_BTREE,
+                                        elem_array[i], &c->einfo);
+            bodylen += (c->einfo.nbytes - 2);
+            bkeyptr[i] = htonll(*(uint64_t*)c->einfo.score);
+            vlenptr[i] = htonl(c->einfo.nbytes - 2);
+        }
+        add_bin_header(c, 0, sizeof(rsp->message.body), 0, bodylen);
 
-static void process_bin_unknown_packet(conn *c) {
-    void *packet = c->rcurr - (c->binary_header.request.bodylen +
-                               sizeof(c->binary_header));
+        // add the flags and count
+        rsp->message.body.flags = flags;
+        rsp->message.body.count = htonl(elem_count);
+        add_iov(c, &rsp->message.body, sizeof(rsp->message.body));
 
-    ENGINE_ERROR_CODE ret;
-    ret = mc_engine.v1->unknown_command(mc_engine.v0, c, packet,
-                                        binary_response_handler);
+        // add bkey data and value lengths
+        add_iov(c, (char*)bkeyptr, elem_count*(sizeof(uint64_t)+sizeof(uint32_t)));
 
-    switch (ret) {
-    case ENGINE_SUCCESS:
-        write_and_free(c, c->dynamic_buffer.buffer, c->dynamic_buffer.offset);
-        c->dynamic_buffer.buffer = NULL;
+        /* Add the data without CRLF */
+        for (i = 0; i < elem_count; i++) {
+            mc_engine.v1->get_elem_info(mc_engine.v0, c, ITEM_TYPE_BTREE,
+                                        elem_array[i], &c->einfo);
+            if (add_iov_einfo_some_value(c, &c->einfo, c->einfo.nbytes - 2) != 0) {
+                ret = ENGINE_ENOMEM; break;
+            }
+        }
+
+        if (ret == ENGINE_SUCCESS) {
+            STATS_ELEM_HITS(c, bop_get, key, nkey);
+            /* Remember this command so we can garbage collect it later */
+            c->coll_eitem  = (void *)elem_array;
+            c->coll_ecount = elem_count;
+            c->coll_op     = OPERATION_BOP_GET;
+            conn_set_state(c, conn_mwrite);
+        } else {
+            STATS_NOKEY(c, cmd_bop_get);
+            mc_engine.v1->btree_elem_release(mc_engine.v0, c, elem_array, elem_count);
+            if (c->ewouldblock)
+                c->ewouldblock = false;
+            write_bin_packet(c, PROTOCOL_BINARY_RESPONSE_ENOMEM, 0);
+        }
+        }
         break;
-    case ENGINE_ENOTSUP:
-        write_bin_packet(c, PROTOCOL_BINARY_RESPONSE_UNKNOWN_COMMAND, 0);
+    case ENGINE_ELEM_ENOENT:
+        STATS_NONE_HITS(c, bop_get, key, nkey);
+        write_bin_packet(c, PROTOCOL_BINARY_RESPONSE_ELEM_ENOENT, 0);
+        break;
+    case ENGINE_DISCONNECT:
+        c->state = conn_closing;
+        break;
+    case ENGINE_KEY_ENOENT:
+    case ENGINE_EBKEYOOR:
+    case ENGINE_UNREADABLE:
+        STATS_MISS(c, bop_get, key, nkey);
+        if (ret == ENGINE_KEY_ENOENT)
+            write_bin_packet(c, PROTOCOL_BINARY_RESPONSE_KEY_ENOENT, 0);
+        else if (ret == ENGINE_EBKEYOOR)
+            write_bin_packet(c, PROTOCOL_BINARY_RESPONSE_EBKEYOOR, 0);
+        else
+            write_bin_packet(c, PROTOCOL_BINARY_RESPONSE_UNREADABLE, 0);
         break;
     default:
-        /* FATAL ERROR, shut down connection */
-        conn_set_state(c, conn_closing);
+        STATS_NOKEY(c, cmd_bop_get);
+        if (ret == ENGINE_EBADTYPE)
+            write_bin_packet(c, PROTOCOL_BINARY_RESPONSE_EBADTYPE, 0);
+        else if (ret == ENGINE_EBADBKEY)
+            write_bin_packet(c, PROTOCOL_BINARY_RESPONSE_EBADBKEY, 0);
+        else
+            write_bin_packet(c, PROTOCOL_BINARY_RESPONSE_EINTERNAL, 0);
+    }
+
+    if (ret != ENGINE_SUCCESS && elem_array != NULL) {
+        free((void *)elem_array);
     }
 }
 
-static void dispatch_bin_command(conn *c) {
-    int protocol_error = 0;
+static void process_bin_bop_count(conn *c) {
+    assert(c != NULL);
+    assert(c->cmd == PROTOCOL_BINARY_CMD_BOP_COUNT);
+    char *key = binary_get_key(c);
+    int  nkey = c->binary_header.request.keylen;
 
-    int extlen = c->binary_header.request.extlen;
-    int keylen = c->binary_header.request.keylen;
-    uint32_t bodylen = c->binary_header.request.bodylen;
+    /* fix byteorder in the request */
+    protocol_binary_request_bop_count* req = binary_get_request(c);
+    bkey_range   *bkrange = &req->message.body.bkrange;
+    eflag_filter *efilter = &req->message.body.efilter;
+    if (bkrange->from_nbkey == 0) {
+        uint64_t bkey_temp;
+        memcpy((unsigned char*)&bkey_temp, bkrange->from_bkey, sizeof(uint64_t));
+        bkey_temp = ntohll(bkey_temp);
+        memcpy(bkrange->from_bkey, (unsigned char*)&bkey_temp, sizeof(uint64_t));
+        //*(uint64_t*)bkrange->from_bkey = ntohll(*(uint64_t*)bkrange->from_bkey);
+    }
+    if (bkrange->to_nbkey   == 0) {
+        uint64_t bkey_temp;
+        memcpy((unsigned char*)&bkey_temp, bkrange->to_bkey, sizeof(uint64_t));
+        bkey_temp = ntohll(bkey_temp);
+        memcpy(bkrange->to_bkey, (unsigned char*)&bkey_temp, sizeof(uint64_t));
+        //*(uint64_t*)bkrange->to_bkey   = ntohll(*(uint64_t*)bkrange->to_bkey);
+    }
 
-    if (settings.require_sasl && !authenticated(c)) {
-        write_bin_packet(c, PROTOCOL_BINARY_RESPONSE_AUTH_ERROR, 0);
-        c->write_and_go = conn_closing;
-        return;
+    if (settings.verbose > 1) {
+        fprintf(stderr, "<%d BOP COUNT", c->sfd);
+        for (int ii = 0; ii < nkey; ++ii) {
+            fprintf(stderr, "%c", key[ii]);
+        }
+        fprintf(stderr, "\n");
     }
 
-    MEMCACHED_PROCESS_COMMAND_START(c->sfd, c->rcurr, c->rbytes);
-    c->noreply = true;
+    uint32_t elem_count;
+    uint32_t access_count;
+    uint32_t flags = 0;
 
-    /* binprot supports 16bit keys, but internals are still 8bit */
-    if (keylen > KEY_MAX_LENGTH) {
-        handle_binary_protocol_error(c);
-        return;
+    ENGINE_ERROR_CODE ret;
+    ret = mc_engine.v1->btree_elem_count(mc_engine.v0, c, key, nkey,
+                                         bkrange, efilter, &elem_count, &access_count,
+                                         c->binary_header.request.vbucket);
+
+    if (settings.detail_enabled) {
+        stats_prefix_record_bop_count(key, nkey, (ret==ENGINE_SUCCESS));
     }
 
-    switch (c->cmd) {
-    case PROTOCOL_BINARY_CMD_SETQ:
-        c->cmd = PROTOCOL_BINARY_CMD_SET;
-        break;
-    case PROTOCOL_BINARY_CMD_ADDQ:
-        c->cmd = PROTOCOL_BINARY_CMD_ADD;
-        break;
-    case PROTOCOL_BINARY_CMD_REPLACEQ:
-        c->cmd = PROTOCOL_BINARY_CMD_REPLACE;
-        break;
-    case PROTOCOL_BINARY_CMD_DELETEQ:
-        c->cmd = PROTOCOL_BINARY_CMD_DELETE;
+    switch (ret) {
+    case ENGINE_SUCCESS:
+        STATS_HITS(c, bop_count, key, nkey);
+        protocol_binary_response_bop_count* rsp = (protocol_binary_response_bop_count*)c->wbuf;
+        // add the flags and count
+        rsp->message.body.flags = flags;
+        rsp->message.body.count = htonl(elem_count);
+        write_bin_response(c, &rsp->message.body, 0, 0, sizeof(rsp->message.body));
         break;
-    case PROTOCOL_BINARY_CMD_INCREMENTQ:
-        c->cmd = PROTOCOL_BINARY_CMD_INCREMENT;
+    case ENGINE_DISCONNECT:
+        c->state = conn_closing;
         break;
-    case PROTOCOL_BINARY_CMD_DECREMENTQ:
-        c->cmd = PROTOCOL_BINARY_CMD_DECREMENT;
-        break;
-    case PROTOCOL_BINARY_CMD_QUITQ:
-        c->cmd = PROTOCOL_BINARY_CMD_QUIT;
-        break;
-    case PROTOCOL_BINARY_CMD_FLUSHQ:
-        c->cmd = PROTOCOL_BINARY_CMD_FLUSH;
-        break;
-    case PROTOCOL_BINARY_CMD_APPENDQ:
-        c->cmd = PROTOCOL_BINARY_CMD_APPEND;
-        break;
-    case PROTOCOL_BINARY_CMD_PREPENDQ:
-        c->cmd = PROTOCOL_BINARY_CMD_PREPEND;
-        break;
-    case PROTOCOL_BINARY_CMD_GETQ:
-        c->cmd = PROTOCOL_BINARY_CMD_GET;
-        break;
-    case PROTOCOL_BINARY_CMD_GETKQ:
-        c->cmd = PROTOCOL_BINARY_CMD_GETK;
-        break;
-    case PROTOCOL_BINARY_CMD_LOP_INSERTQ:
-        c->cmd = PROTOCOL_BINARY_CMD_LOP_INSERT;
-        break;
-    case PROTOCOL_BINARY_CMD_LOP_DELETEQ:
-        c->cmd = PROTOCOL_BINARY_CMD_LOP_DELETE;
-        break;
-    case PROTOCOL_BINARY_CMD_SOP_INSERTQ:
-        c->cmd = PROTOCOL_BINARY_CMD_SOP_INSERT;
-        break;
-    case PROTOCOL_BINARY_CMD_SOP_DELETEQ:
-        c->cmd = PROTOCOL_BINARY_CMD_SOP_DELETE;
-        break;
-    case PROTOCOL_BINARY_CMD_BOP_INSERTQ:
-        c->cmd = PROTOCOL_BINARY_CMD_BOP_INSERT;
-        break;
-    case PROTOCOL_BINARY_CMD_BOP_UPSERTQ:
-        c->cmd = PROTOCOL_BINARY_CMD_BOP_UPSERT;
-        break;
-    case PROTOCOL_BINARY_CMD_BOP_UPDATEQ:
-        c->cmd = PROTOCOL_BINARY_CMD_BOP_UPDATE;
-        break;
-    case PROTOCOL_BINARY_CMD_BOP_DELETEQ:
-        c->cmd = PROTOCOL_BINARY_CMD_BOP_DELETE;
+    case ENGINE_KEY_ENOENT:
+    case ENGINE_UNREADABLE:
+        STATS_MISS(c, bop_count, key, nkey);
+        if (ret == ENGINE_KEY_ENOENT)
+            write_bin_packet(c, PROTOCOL_BINARY_RESPONSE_KEY_ENOENT, 0);
+        else
+            write_bin_packet(c, PROTOCOL_BINARY_RESPONSE_UNREADABLE, 0);
         break;
     default:
-        c->noreply = false;
+        STATS_NOKEY(c, cmd_bop_count);
+        if (ret == ENGINE_EBADTYPE)
+            write_bin_packet(c, PROTOCOL_BINARY_RESPONSE_EBADTYPE, 0);
+        else if (ret == ENGINE_EBADBKEY)
+            write_bin_packet(c, PROTOCOL_BINARY_RESPONSE_EBADBKEY, 0);
+        else
+            write_bin_packet(c, PROTOCOL_BINARY_RESPONSE_EINTERNAL, 0);
     }
+}
 
-    switch (c->cmd) {
-        case PROTOCOL_BINARY_CMD_VERSION:
-            if (extlen == 0 && keylen == 0 && bodylen == 0) {
-                write_bin_response(c, VERSION, 0, 0, strlen(VERSION));
-            } else {
-                protocol_error = 1;
-            }
-            break;
-        case PROTOCOL_BINARY_CMD_FLUSH:
-            if (keylen == 0 && bodylen == extlen && (extlen == 0 || extlen == 4)) {
-                bin_read_key(c, bin_read_flush_exptime, extlen);
-            } else {
-                protocol_error = 1;
-            }
-            break;
-        case PROTOCOL_BINARY_CMD_FLUSH_PREFIX:
-            if (keylen > 0 && bodylen == extlen && (extlen == 0 || extlen == 4)) {
-                bin_read_key(c, bin_read_flush_prefix_exptime, extlen);
-            } else {
-                protocol_error = 1;
-            }
-            break;
-        case PROTOCOL_BINARY_CMD_NOOP:
-            if (extlen == 0 && keylen == 0 && bodylen == 0) {
-                write_bin_response(c, NULL, 0, 0, 0);
-            } else {
-                protocol_error = 1;
-            }
-            break;
-        case PROTOCOL_BINARY_CMD_SET: /* FALLTHROUGH */
-        case PROTOCOL_BINARY_CMD_ADD: /* FALLTHROUGH */
-        case PROTOCOL_BINARY_CMD_REPLACE:
-            if (extlen == 8 && keylen != 0 && bodylen >= (keylen + 8)) {
-                bin_read_key(c, bin_reading_set_header, 8);
-            } else {
-                protocol_error = 1;
-            }
-            break;
-        case PROTOCOL_BINARY_CMD_GETQ:  /* FALLTHROUGH */
-        case PROTOCOL_BINARY_CMD_GET:   /* FALLTHROUGH */
-        case PROTOCOL_BINARY_CMD_GETKQ: /* FALLTHROUGH */
-        case PROTOCOL_BINARY_CMD_GETK:
-            if (extlen == 0 && bodylen == keylen && keylen > 0) {
-                bin_read_key(c, bin_reading_get_key, 0);
-            } else {
-                protocol_error = 1;
-            }
-            break;
-        case PROTOCOL_BINARY_CMD_DELETE:
-            if (keylen > 0 && extlen == 0 && bodylen == keylen) {
-                bin_read_key(c, bin_reading_del_header, extlen);
-            } else {
-                protocol_error = 1;
+#if defined(SUPPORT_BOP_MGET) || defined(SUPPORT_BOP_SMGET)
+static void process_bin_bop_prepare_nread_keys(conn *c) {
+    assert(c != NULL);
+    assert(c->cmd == PROTOCOL_BINARY_CMD_BOP_MGET || c->cmd == PROTOCOL_BINARY_CMD_BOP_SMGET);
+
+    char *key = binary_get_key(c);
+    uint32_t nkey = c->binary_header.request.keylen;
+    size_t vlen = 0;
+
+    if (nkey + c->binary_header.request.extlen <= c->binary_header.request.bodylen) {
+        vlen = c->binary_header.request.bodylen - (nkey + c->binary_header.request.extlen);
+    } else {
+        handle_binary_protocol_error(c);
+        return;
+    }
+
+    /* fix byteorder in the request */
+    protocol_binary_request_bop_mkeys* req = binary_get_request(c);
+    bkey_range   *bkrange = &req->message.body.bkrange;
+    if (bkrange->from_nbkey == 0) {
+        uint64_t bkey_temp;
+        memcpy((unsigned char*)&bkey_temp, bkrange->from_bkey, sizeof(uint64_t));
+        bkey_temp = ntohll(bkey_temp);
+        memcpy(bkrange->from_bkey, (unsigned char*)&bkey_temp, sizeof(uint64_t));
+        //*(uint64_t*)bkrange->from_bkey = ntohll(*(uint64_t*)bkrange->from_bkey);
+    }
+    if (bkrange->to_nbkey   == 0) {
+        uint64_t bkey_temp;
+        memcpy((unsigned char*)&bkey_temp, bkrange->to_bkey, sizeof(uint64_t));
+        bkey_temp = ntohll(bkey_temp);
+        memcpy(bkrange->to_bkey, (unsigned char*)&bkey_temp, sizeof(uint64_t));
+        //*(uint64_t*)bkrange->to_bkey   = ntohll(*(uint64_t*)bkrange->to_bkey);
+    }
+    req->message.body.req_offset = ntohl(req->message.body.req_offset);
+    req->message.body.req_count  = ntohl(req->message.body.req_count);
+    req->message.body.key_count  = ntohl(req->message.body.key_count);
+
+    if (settings.verbose > 1) {
+        fprintf(stderr, "<%d BOP %s ", c->sfd, (c->cmd==PROTOCOL_BINARY_CMD_BOP_MGET ? "MGET" : "SMGET"));
+        for (int ii = 0; ii < nkey; ++ii) {
+            fprintf(stderr, "%c", key[ii]);
+        }
+        fprintf(stderr, " ReqOffset(%u) ReqCount(%u) KeyCount(%u)\n",
+                req->message.body.req_offset, req->message.body.req_count, req->message.body.key_count);
+    }
+
+    eitem *elem=NULL;
+
+    ENGINE_ERROR_CODE ret = ENGINE_SUCCESS;
+    int need_size = 0;
+    do {
+        /* validation checking on arguments */
+        if (req->message.body.key_count < 1 || vlen < 1 || req->message.body.req_count < 1) {
+            ret = ENGINE_EBADVALUE; break;
+        }
+        if (req->message.body.key_count > ((vlen/2)+1)) {
+            ret = ENGINE_EBADVALUE; break;
+        }
+#ifdef SUPPORT_BOP_MGET
+        if (c->cmd == PROTOCOL_BINARY_CMD_BOP_MGET) {
+            int bmget_count;
+            int elem_array_size;
+
+            if (req->message.body.key_count > MAX_BMGET_KEY_COUNT ||
+                req->message.body.req_count > MAX_BMGET_ELM_COUNT) {
+                ret = ENGINE_EBADVALUE; break;
             }
-            break;
-        case PROTOCOL_BINARY_CMD_INCREMENT:
-        case PROTOCOL_BINARY_CMD_DECREMENT:
-            if (keylen > 0 && extlen == 20 && bodylen == (keylen + extlen)) {
-                bin_read_key(c, bin_reading_incr_header, 20);
-            } else {
-                protocol_error = 1;
+            bmget_count = req->message.body.key_count * req->message.body.req_count;
+            elem_array_size = bmget_count * sizeof(eitem*);
+
+            need_size = elem_array_size;
+        }
+#endif
+#ifdef SUPPORT_BOP_SMGET
+        if (c->cmd == PROTOCOL_BINARY_CMD_BOP_SMGET) {
+#ifdef JHPARK_OLD_SMGET_INTERFACE
+          if (c->coll_smgmode == 0) {
+            int smget_count;
+            int elem_array_size; /* elem pointer array where the found elements will be saved */
+            int kmis_array_size; /* key index array where the missed key indexes are to be saved */
+            int elem_rshdr_size; /* the size of result header about the found elems */
+            int kmis_rshdr_size; /* the size of result header about the missed keys */
+
+            if (req->message.body.key_count > MAX_SMGET_KEY_COUNT ||
+                (req->message.body.req_offset + req->message.body.req_count) > MAX_SMGET_REQ_COUNT) {
+                ret = ENGINE_EBADVALUE; break;
             }
-            break;
-        case PROTOCOL_BINARY_CMD_APPEND:
-        case PROTOCOL_BINARY_CMD_PREPEND:
-            if (keylen > 0 && extlen == 0) {
-                bin_read_key(c, bin_reading_set_header, 0);
-            } else {
-                protocol_error = 1;
+            smget_count = req->message.body.req_offset + req->message.body.req_count;
+            elem_array_size = smget_count * (sizeof(eitem*) + (2*sizeof(uint32_t)));
+            kmis_array_size = req->message.body.key_count * sizeof(uint32_t);
+            elem_rshdr_size = smget_count * (sizeof(uint64_t) + (3*sizeof(uint32_t)));
+            kmis_rshdr_size = req->message.body.key_count * sizeof(uint32_t);
+            need_size = elem_array_size + kmis_array_size + elem_rshdr_size + kmis_rshdr_size;
+          } else {
+#endif
+            int elem_array_size; /* smget element array size */
+            int ehit_array_size; /* smget hitted elem array size */
+            int emis_array_size; /* element missed keys array size */
+            int elem_rshdr_size; /* the size of result header about the found elems */
+            int emis_rshdr_size; /* the size of result header about the missed keys */
+
+            if (req->message.body.key_count > MAX_SMGET_KEY_COUNT ||
+                (req->message.body.req_offset + req->message.body.req_count) > MAX_SMGET_REQ_COUNT) {
+                ret = ENGINE_EBADVALUE; break;
             }
-            break;
-        case PROTOCOL_BINARY_CMD_STAT:
-            if (extlen == 0) {
-                bin_read_key(c, bin_reading_stat, 0);
+            elem_array_size = (req->message.body.req_count + req->message.body.key_count) * sizeof(eitem*);
+            ehit_array_size = req->message.body.req_count * sizeof(smget_ehit_t);
+            emis_array_size = req->message.body.key_count * sizeof(smget_emis_t);
+            elem_rshdr_size = req->message.body.req_count * (sizeof(uint64_t) + (3*sizeof(uint32_t)));
+            emis_rshdr_size = req->message.body.key_count * sizeof(uint32_t);
+            need_size = elem_array_size + ehit_array_size + emis_array_size
+                      + elem_rshdr_size + emis_rshdr_size;
+#ifdef JHPARK_OLD_SMGET_INTERFACE
+          }
+#endif
+        }
+#endif
+        assert(need_size > 0);
+
+        if ((elem = (eitem *)malloc(need_size)) == NULL) {
+            ret = ENGINE_ENOMEM;
+        } else {
+            /* allocate memory blocks needed */
+            if (mblck_list_alloc(&c->thread->mblck_pool, 1, vlen, &c->memblist) < 0) {
+                free((void*)elem);
+                ret = ENGINE_ENOMEM;
             } else {
-                protocol_error = 1;
+                c->coll_bkrange = req->message.body.bkrange;
+                c->coll_efilter = req->message.body.efilter;
+                c->coll_roffset = req->message.body.req_offset;
+                c->coll_rcount  = req->message.body.req_count;
+                c->coll_numkeys = req->message.body.key_count;
+                c->coll_lenkeys = vlen + 2;
             }
-            break;
-        case PROTOCOL_BINARY_CMD_QUIT:
-            if (keylen == 0 && extlen == 0 && bodylen == 0) {
-                write_bin_response(c, NULL, 0, 0, 0);
-                c->write_and_go = conn_closing;
-                if (c->noreply) {
-                    conn_set_state(c, conn_closing);
-                }
-            } else {
-                protocol_error = 1;
-            }
-            break;
-        case PROTOCOL_BINARY_CMD_GETATTR:
-            if (keylen > 0 && extlen == (sizeof(bkey_t)+24) && bodylen == (keylen + extlen)) {
-                bin_read_key(c, bin_reading_getattr, (sizeof(bkey_t)+24));
-            } else {
-                protocol_error = 1;
-            }
-            break;
-        case PROTOCOL_BINARY_CMD_SETATTR:
-            if (keylen > 0 && extlen == (sizeof(bkey_t)+12) && bodylen == (keylen + extlen)) {
-                bin_read_key(c, bin_reading_setattr, (sizeof(bkey_t)+12));
-            } else {
-                protocol_error = 1;
-            }
-            break;
-        case PROTOCOL_BINARY_CMD_LOP_CREATE:
-            if (keylen > 0 && extlen == 16 && bodylen == (keylen + extlen)) {
-                bin_read_key(c, bin_reading_lop_create, 16);
-            } else {
-                protocol_error = 1;
-            }
-            break;
-        case PROTOCOL_BINARY_CMD_LOP_INSERT:
-            if (keylen > 0 && extlen == 20 && bodylen > (keylen + extlen)) {
-                bin_read_key(c, bin_reading_lop_prepare_nread, 20);
-            } else {
-                protocol_error = 1;
-            }
-            break;
-        case PROTOCOL_BINARY_CMD_LOP_DELETE:
-            if (keylen > 0 && extlen == 12 && bodylen == (keylen + extlen)) {
-                bin_read_key(c, bin_reading_lop_delete, 12);
-            } else {
-                protocol_error = 1;
-            }
-            break;
-        case PROTOCOL_BINARY_CMD_LOP_GET:
-            if (keylen > 0 && extlen == 12 && bodylen == (keylen + extlen)) {
-                bin_read_key(c, bin_reading_lop_get, 12);
-            } else {
-                protocol_error = 1;
-            }
-            break;
-        case PROTOCOL_BINARY_CMD_SOP_CREATE:
-            if (keylen > 0 && extlen == 16 && bodylen == (keylen + extlen)) {
-                bin_read_key(c, bin_reading_sop_create, 16);
-            } else {
-                protocol_error = 1;
-            }
-            break;
-        case PROTOCOL_BINARY_CMD_SOP_INSERT:
-            if (keylen > 0 && extlen == 16 && bodylen > (keylen + extlen)) {
-                bin_read_key(c, bin_reading_sop_prepare_nread, 16);
-            } else {
-                protocol_error = 1;
-            }
-            break;
-        case PROTOCOL_BINARY_CMD_SOP_DELETE:
-            if (keylen > 0 && extlen == 4 && bodylen > (keylen + extlen)) {
-                bin_read_key(c, bin_reading_sop_prepare_nread, 4);
-            } else {
-                protocol_error = 1;
-            }
-            break;
-        case PROTOCOL_BINARY_CMD_SOP_EXIST:
-            if (keylen > 0 && extlen == 0 && bodylen > (keylen + extlen)) {
-                bin_read_key(c, bin_reading_sop_prepare_nread, 0);
-            } else {
-                protocol_error = 1;
-            }
-            break;
-        case PROTOCOL_BINARY_CMD_SOP_GET:
-            if (keylen > 0 && extlen == 8 && bodylen == (keylen + extlen)) {
-                bin_read_key(c, bin_reading_sop_get, 8);
-            } else {
-                protocol_error = 1;
-            }
-            break;
-        case PROTOCOL_BINARY_CMD_BOP_CREATE:
-            if (keylen > 0 && extlen == 16 && bodylen == (keylen + extlen)) {
-                bin_read_key(c, bin_reading_bop_create, 16);
-            } else {
-                protocol_error = 1;
-            }
-            break;
-        case PROTOCOL_BINARY_CMD_BOP_INSERT:
-        case PROTOCOL_BINARY_CMD_BOP_UPSERT:
-            if (keylen > 0 && extlen == (MAX_BKEY_LENG+1+MAX_EFLAG_LENG+1+16) && bodylen > (keylen + extlen)) {
-                bin_read_key(c, bin_reading_bop_prepare_nread, (MAX_BKEY_LENG+1+MAX_EFLAG_LENG+1+16));
-            } else {
-                protocol_error = 1;
-            }
-            break;
-        case PROTOCOL_BINARY_CMD_BOP_UPDATE:
-            if (keylen > 0 && extlen == (MAX_BKEY_LENG+1+MAX_EFLAG_LENG+1+8) && bodylen > (keylen + extlen)) {
-                bin_read_key(c, bin_reading_bop_update_prepare_nread, (MAX_BKEY_LENG+1+MAX_EFLAG_LENG+1+8));
-            } else {
-                protocol_error = 1;
-            }
-            break;
-        case PROTOCOL_BINARY_CMD_BOP_DELETE:
-            if (keylen > 0 && extlen == (sizeof(bkey_range)+sizeof(eflag_filter)+8) && bodylen == (keylen + extlen)) {
-                bin_read_key(c, bin_reading_bop_delete, (sizeof(bkey_range)+sizeof(eflag_filter)+8));
-            } else {
-                protocol_error = 1;
-            }
-            break;
-        case PROTOCOL_BINARY_CMD_BOP_GET:
-            if (keylen > 0 && extlen == (sizeof(bkey_range)+sizeof(eflag_filter)+12) && bodylen == (keylen + extlen)) {
-                bin_read_key(c, bin_reading_bop_get, (sizeof(bkey_range)+sizeof(eflag_filter)+12));
-            } else {
-                protocol_error = 1;
-            }
-            break;
-        case PROTOCOL_BINARY_CMD_BOP_COUNT:
-            if (keylen > 0 && extlen == (sizeof(bkey_range)+sizeof(eflag_filter)) && bodylen == (keylen + extlen)) {
-                bin_read_key(c, bin_reading_bop_count, (sizeof(bkey_range)+sizeof(eflag_filter)));
-            } else {
-                protocol_error = 1;
-            }
-            break;
-#if defined(SUPPORT_BOP_MGET) || defined(SUPPORT_BOP_SMGET)
-#ifdef SUPPORT_BOP_MGET
-        case PROTOCOL_BINARY_CMD_BOP_MGET:
-#endif
-#ifdef SUPPORT_BOP_SMGET
-        case PROTOCOL_BINARY_CMD_BOP_SMGET:
-#endif
-            if (keylen > 0 && extlen == (sizeof(bkey_range)+sizeof(eflag_filter)+12) && bodylen > (keylen + extlen)) {
-                bin_read_key(c, bin_reading_bop_prepare_nread_keys, (sizeof(bkey_range)+sizeof(eflag_filter)+12));
-            } else {
-                protocol_error = 1;
-            }
-            break;
-#endif
-#ifdef SASL_ENABLED
-        case PROTOCOL_BINARY_CMD_SASL_LIST_MECHS:
-            if (extlen == 0 && keylen == 0 && bodylen == 0) {
-                bin_list_sasl_mechs(c);
-            } else {
-                protocol_error = 1;
-            }
-            break;
-        case PROTOCOL_BINARY_CMD_SASL_AUTH:
-        case PROTOCOL_BINARY_CMD_SASL_STEP:
-            if (extlen == 0 && keylen != 0) {
-                bin_read_key(c, bin_reading_sasl_auth, 0);
-            } else {
-                protocol_error = 1;
-            }
-            break;
-#endif
-        default:
-            if (mc_engine.v1->unknown_command == NULL) {
-                write_bin_packet(c, PROTOCOL_BINARY_RESPONSE_UNKNOWN_COMMAND,
-                                bodylen);
-            } else {
-                bin_read_chunk(c, bin_reading_packet, c->binary_header.request.bodylen);
-            }
-    }
-
-    if (protocol_error)
-        handle_binary_protocol_error(c);
-}
-
-static void process_bin_update(conn *c) {
-    assert(c != NULL);
-
-    char *key;
-    item *it;
-    protocol_binary_request_set* req = binary_get_request(c);
-    key = binary_get_key(c);
-    uint32_t nkey = c->binary_header.request.keylen;
-    uint32_t vlen = 0;
+        }
+    } while(0);
 
-    /* fix byteorder in the request */
-    req->message.body.flags = req->message.body.flags;
-    req->message.body.expiration = ntohl(req->message.body.expiration);
+    switch (ret) {
+    case ENGINE_SUCCESS:
+        c->coll_strkeys = (void*)&c->memblist;
+        ritem_set_first(c, CONN_RTYPE_MBLCK, vlen);
+        c->coll_eitem  = (void *)elem;
+        c->coll_ecount = 0;
+        c->coll_op = (c->cmd==PROTOCOL_BINARY_CMD_BOP_MGET ? OPERATION_BOP_MGET : OPERATION_BOP_SMGET);
+        conn_set_state(c, conn_nread);
+        c->substate = bin_reading_bop_nread_keys_complete;
+        break;
+    default:
+        /* ret == ENGINE_EBADVALUE || ret == ENGINE_ENOMEM */
+        if (ret == ENGINE_EBADVALUE)
+            write_bin_packet(c, PROTOCOL_BINARY_RESPONSE_EBADVALUE, vlen);
+        else
+            write_bin_packet(c, PROTOCOL_BINARY_RESPONSE_ENOMEM, vlen);
 
-    if (nkey + c->binary_header.request.extlen <= c->binary_header.request.bodylen) {
-        vlen = c->binary_header.request.bodylen - (nkey + c->binary_header.request.extlen);
-    } else {
-        handle_binary_protocol_error(c);
-        return;
+        /* swallow the data line */
+        c->write_and_go = conn_swallow;
     }
+}
+#endif
 
-    if (settings.verbose > 1) {
-        char buffer[1024];
-        const char *prefix;
-        if (c->cmd == PROTOCOL_BINARY_CMD_ADD) {
-            prefix = "ADD";
-        } else if (c->cmd == PROTOCOL_BINARY_CMD_SET) {
-            prefix = "SET";
-        } else {
-            prefix = "REPLACE";
-        }
+#ifdef SUPPORT_BOP_MGET
+static void process_bin_bop_mget_complete(conn *c) {
+    assert(c->coll_op == OPERATION_BOP_MGET);
+    assert(c->coll_eitem != NULL);
 
-        size_t nw;
-        nw = key_to_printable_buffer(buffer, sizeof(buffer), c->sfd, true,
-                                     prefix, key, nkey);
+    ENGINE_ERROR_CODE ret = ENGINE_ENOTSUP;
+    write_bin_packet(c, PROTOCOL_BINARY_RESPONSE_NOT_SUPPORTED, 0);
 
-        if (nw != -1) {
-            if (snprintf(buffer + nw, sizeof(buffer) - nw,
-                         " Value len is %d\n", vlen)) {
-                mc_logger->log(EXTENSION_LOG_DEBUG, c, "%s", buffer);
-            }
+    if (ret != ENGINE_SUCCESS) {
+        if (c->coll_strkeys != NULL) {
+            /* free key string memory blocks */
+            assert(c->coll_strkeys == (void*)&c->memblist);
+            mblck_list_free(&c->thread->mblck_pool, &c->memblist);
+            c->coll_strkeys = NULL;
+        }
+        if (c->coll_eitem != NULL) {
+            free((void *)c->coll_eitem);
+            c->coll_eitem = NULL;
         }
     }
+}
+#endif
 
-    if (settings.detail_enabled) {
-        stats_prefix_record_set(key, nkey);
-    }
-
-    ENGINE_ERROR_CODE ret;
-    ret = mc_engine.v1->allocate(mc_engine.v0, c, &it, key, nkey, vlen+2,
-                                 req->message.body.flags,
-                                 realtime(req->message.body.expiration),
-                                 c->binary_header.request.cas);
-    if (ret == ENGINE_SUCCESS && !mc_engine.v1->get_item_info(mc_engine.v0,
-                                                              c, it, &c->hinfo)) {
-        mc_engine.v1->release(mc_engine.v0, c, it);
-        write_bin_packet(c, PROTOCOL_BINARY_RESPONSE_EINTERNAL, 0);
-        return;
+#ifdef SUPPORT_BOP_SMGET
+#ifdef JHPARK_OLD_SMGET_INTERFACE
+static void process_bin_bop_smget_complete_old(conn *c) {
+    int smget_count = c->coll_roffset + c->coll_rcount;
+    int kmis_array_size = c->coll_numkeys * sizeof(uint32_t);
+    char *resultptr;
+    char delimiter = ' ';
+    char old_delimiter = ','; /* need to keep backwards compatibility */
+    token_t *keys_array = NULL;
+    uint32_t  kmis_count = 0;
+    uint32_t  elem_count = 0;
+    eitem   **elem_array = (eitem  **)c->coll_eitem;
+    uint32_t *kfnd_array = (uint32_t*)((char*)elem_array + (smget_count*sizeof(eitem*)));
+    uint32_t *flag_array = (uint32_t*)((char*)kfnd_array + (smget_count*sizeof(uint32_t)));
+    uint32_t *kmis_array = (uint32_t*)((char*)flag_array + (smget_count*sizeof(uint32_t)));
+
+    resultptr = ((char *)kmis_array + kmis_array_size);
+
+    bool trimmed;
+    bool duplicated;
+
+    /* We don't actually receive the trailing two("\r\n") characters in binary protocol.
+     * We should consider this when tokenizing key strings.
+     */
+    ENGINE_ERROR_CODE ret = ENGINE_SUCCESS;
+    keys_array = (token_t*)token_buff_get(&c->thread->token_buff, c->coll_numkeys);
+    if (keys_array != NULL) {
+        int ntokens = tokenize_mblocks(&c->memblist, c->coll_lenkeys-2, delimiter, c->coll_numkeys, keys_array);
+        if (ntokens == -1) {
+            ntokens = tokenize_mblocks(&c->memblist, c->coll_lenkeys-2, old_delimiter, c->coll_numkeys, keys_array);
+        }
+        if (ntokens == -1) {
+            ret = ENGINE_EBADVALUE;
+        } else if (ntokens == -2) {
+            ret = ENGINE_ENOMEM;
+        }
+    } else {
+        ret = ENGINE_ENOMEM;
+    }
+    if (ret == ENGINE_SUCCESS) {
+        if (c->coll_bkrange.to_nbkey == BKEY_NULL) {
+            memcpy(c->coll_bkrange.to_bkey, c->coll_bkrange.from_bkey,
+                   (c->coll_bkrange.from_nbkey==0 ? sizeof(uint64_t) : c->coll_bkrange.from_nbkey));
+            c->coll_bkrange.to_nbkey = c->coll_bkrange.from_nbkey;
+        }
+        assert(c->coll_numkeys > 0);
+        assert(c->coll_rcount > 0);
+        assert((c->coll_roffset + c->coll_rcount) <= MAX_SMGET_REQ_COUNT);
+        ret = mc_engine.v1->btree_elem_smget_old(mc_engine.v0, c,
+                                     keys_array, c->coll_numkeys,
+                                     &c->coll_bkrange,
+                                     (c->coll_efilter.ncompval==0 ? NULL : &c->coll_efilter),
+                                     c->coll_roffset, c->coll_rcount,
+                                     elem_array, kfnd_array, flag_array, &elem_count,
+                                     kmis_array, &kmis_count, &trimmed, &duplicated,
+                                     c->binary_header.request.vbucket);
     }
 
     switch (ret) {
     case ENGINE_SUCCESS:
-        switch (c->cmd) {
-        case PROTOCOL_BINARY_CMD_ADD:
-            c->store_op = OPERATION_ADD;
-            break;
-        case PROTOCOL_BINARY_CMD_SET:
-            c->store_op = OPERATION_SET;
-            break;
-        case PROTOCOL_BINARY_CMD_REPLACE:
-            c->store_op = OPERATION_REPLACE;
-            break;
-        default:
-            assert(0);
+        {
+        protocol_binary_response_bop_smget* rsp = (protocol_binary_response_bop_smget*)c->wbuf;
+        uint32_t real_elem_hdr_size = elem_count * (sizeof(uint64_t) + (3*sizeof(uint32_t)));
+        uint32_t real_kmis_hdr_size = kmis_count * sizeof(uint32_t);
+        uint32_t bodylen, i;
+        uint64_t *bkeyptr;
+        uint32_t *vlenptr;
+        uint32_t *flagptr;
+        uint32_t *klenptr;
+
+        if (((long)resultptr % 8) != 0) /* NOT aligned */
+            resultptr += (8 - ((long)resultptr % 8));
+        bkeyptr = (uint64_t *)resultptr;
+        vlenptr = (uint32_t *)((char*)bkeyptr + (sizeof(uint64_t) * elem_count));
+        flagptr = (uint32_t *)((char*)vlenptr + (sizeof(uint32_t) * elem_count));
+        klenptr = (uint32_t *)((char*)flagptr + (sizeof(uint32_t) * elem_count));
+
+        bodylen = sizeof(rsp->message.body) + (real_elem_hdr_size + real_kmis_hdr_size);
+        for (i = 0; i < elem_count; i++) {
+            mc_engine.v1->get_elem_info(mc_engine.v0, c, ITEM_TYPE_BTREE,
+                                        elem_array[i], &c->einfo);
+            bodylen += ((c->einfo.nbytes - 2) + keys_array[kfnd_array[i]].length);
+            bkeyptr[i] = htonll(*(uint64_t*)c->einfo.score);
+            vlenptr[i] = htonl(c->einfo.nbytes - 2);
+            flagptr[i] = flag_array[i];
+            klenptr[i] = htonl(keys_array[kfnd_array[i]].length);
+        }
+        for (i = 0; i < kmis_count; i++) {
+            bodylen += keys_array[kmis_array[i]].length;
+            klenptr[elem_count+i] = htonl(keys_array[kmis_array[i]].length);
         }
+        add_bin_header(c, 0, sizeof(rsp->message.body), 0, bodylen);
 
-        if (c->binary_header.request.cas != 0) {
-            c->store_op = OPERATION_CAS;
+        // add the flags and count
+        rsp->message.body.elem_count = htonl(elem_count);
+        rsp->message.body.miss_count = htonl(kmis_count);
+        add_iov(c, &rsp->message.body, sizeof(rsp->message.body));
+
+        // add value lengths
+        if (add_iov(c, (char*)bkeyptr, real_elem_hdr_size+real_kmis_hdr_size) != 0) {
+            ret = ENGINE_ENOMEM;
         }
 
-        c->item = it;
-        ritem_set_first(c, CONN_RTYPE_HINFO, vlen);
-        conn_set_state(c, conn_nread);
-        c->substate = bin_read_set_value;
+        /* Add the data without CRLF */
+        if (ret == ENGINE_SUCCESS) {
+            for (i = 0; i < elem_count; i++) {
+                mc_engine.v1->get_elem_info(mc_engine.v0, c, ITEM_TYPE_BTREE,
+                                            elem_array[i], &c->einfo);
+                if (add_iov_einfo_some_value(c, &c->einfo, c->einfo.nbytes - 2) != 0) {
+                    ret = ENGINE_ENOMEM; break;
+                }
+            }
+        }
+        /* Add the found key */
+        if (ret == ENGINE_SUCCESS) {
+            for (i = 0; i < elem_count; i++) {
+                if (add_iov(c, keys_array[kfnd_array[i]].value,
+                               keys_array[kfnd_array[i]].length) != 0) {
+                    ret = ENGINE_ENOMEM; break;
+                }
+            }
+        }
+        /* Add the missed key */
+        if (ret == ENGINE_SUCCESS) {
+            for (i = 0; i < kmis_count; i++) {
+                if (add_iov(c, keys_array[kmis_array[i]].value,
+                               keys_array[kmis_array[i]].length) != 0) {
+                    ret = ENGINE_ENOMEM; break;
+                }
+            }
+        }
+
+        if (ret == ENGINE_SUCCESS) {
+            /* Remember this command so we can garbage collect it later */
+            /* c->coll_eitem  = (void *)elem_array; */
+            STATS_NOKEY2(c, cmd_bop_smget, bop_smget_oks);
+            c->coll_ecount = elem_count;
+            c->coll_op     = OPERATION_BOP_SMGET;
+            conn_set_state(c, conn_mwrite);
+        } else {
+            STATS_NOKEY(c, cmd_bop_smget);
+            mc_engine.v1->btree_elem_release(mc_engine.v0, c, elem_array, elem_count);
+            write_bin_packet(c, PROTOCOL_BINARY_RESPONSE_ENOMEM, 0);
+        }
+        }
         break;
     case ENGINE_DISCONNECT:
         c->state = conn_closing;
         break;
     default:
-        if (ret == ENGINE_E2BIG) {
-            write_bin_packet(c, PROTOCOL_BINARY_RESPONSE_E2BIG, vlen);
-        } else {
-            write_bin_packet(c, PROTOCOL_BINARY_RESPONSE_ENOMEM, vlen);
-        }
+        STATS_NOKEY(c, cmd_bop_smget);
+        if (ret == ENGINE_EBADVALUE)
+            write_bin_packet(c, PROTOCOL_BINARY_RESPONSE_EBADVALUE, 0);
+        else if (ret == ENGINE_EBADTYPE)
+            write_bin_packet(c, PROTOCOL_BINARY_RESPONSE_EBADTYPE, 0);
+        else if (ret == ENGINE_EBADBKEY)
+            write_bin_packet(c, PROTOCOL_BINARY_RESPONSE_EBADBKEY, 0);
+        else if (ret == ENGINE_EBADATTR)
+            write_bin_packet(c, PROTOCOL_BINARY_RESPONSE_EBADATTR, 0);
+        else if (ret == ENGINE_EBKEYOOR)
+            write_bin_packet(c, PROTOCOL_BINARY_RESPONSE_EBKEYOOR, 0);
+        else if (ret == ENGINE_ENOMEM)
+            write_bin_packet(c, PROTOCOL_BINARY_RESPONSE_ENOMEM, 0);
+        else
+            write_bin_packet(c, PROTOCOL_BINARY_RESPONSE_EINTERNAL, 0);
+    }
 
-        /*
-         * Avoid stale data persisting in cache because we failed alloc.
-         * Unacceptable for SET (but only if cas matches).
-         * Anywhere else too?
-         */
-        if (c->cmd == PROTOCOL_BINARY_CMD_SET) {
-            /* @todo fix this for the ASYNC interface! */
-            mc_engine.v1->remove(mc_engine.v0, c, key, nkey,
-                                 ntohll(req->message.header.request.cas),
-                                 c->binary_header.request.vbucket);
-        }
+    /* free token buffer */
+    if (keys_array != NULL) {
+        token_buff_release(&c->thread->token_buff, keys_array);
+    }
 
-        /* swallow the data line */
-        c->write_and_go = conn_swallow;
+    if (ret != ENGINE_SUCCESS) {
+        if (c->coll_strkeys != NULL) {
+            /* free key string memory blocks */
+            assert(c->coll_strkeys == (void*)&c->memblist);
+            mblck_list_free(&c->thread->mblck_pool, &c->memblist);
+            c->coll_strkeys = NULL;
+        }
+        if (c->coll_eitem != NULL) {
+            free((void *)c->coll_eitem);
+            c->coll_eitem = NULL;
+        }
     }
 }
+#endif
 
-static void process_bin_append_prepend(conn *c) {
-    assert(c != NULL);
-
-    char *key;
-    item *it;
-    uint32_t nkey = c->binary_header.request.keylen;
-    uint32_t vlen = 0;
-
-    key = binary_get_key(c);
-    nkey = c->binary_header.request.keylen;
-    if (nkey <= c->binary_header.request.bodylen) {
-        vlen = c->binary_header.request.bodylen - nkey;
-    } else {
-        handle_binary_protocol_error(c);
+static void process_bin_bop_smget_complete(conn *c) {
+    assert(c->coll_eitem != NULL);
+#ifdef JHPARK_OLD_SMGET_INTERFACE
+    if (c->coll_smgmode == 0) {
+        process_bin_bop_smget_complete_old(c);
         return;
     }
+#endif
+    smget_result_t smres;
+    char *resultptr;
+    char delimiter = ' ';
+    char old_delimiter = ','; /* need to keep backwards compatibility */
+    token_t *keys_array = NULL;
 
-    if (settings.detail_enabled) {
-        stats_prefix_record_set(key, nkey);
-    }
+    smres.elem_array = (eitem **)c->coll_eitem;
+    smres.elem_kinfo = (smget_ehit_t *)&smres.elem_array[c->coll_rcount+c->coll_numkeys];
+    smres.miss_kinfo = (smget_emis_t *)&smres.elem_kinfo[c->coll_rcount];
 
-    ENGINE_ERROR_CODE ret;
-    ret = mc_engine.v1->allocate(mc_engine.v0, c, &it, key, nkey, vlen+2,
-                                 0, 0, c->binary_header.request.cas);
-    if (ret == ENGINE_SUCCESS && !mc_engine.v1->get_item_info(mc_engine.v0,
-                                                              c, it, &c->hinfo)) {
-        mc_engine.v1->release(mc_engine.v0, c, it);
-        write_bin_packet(c, PROTOCOL_BINARY_RESPONSE_EINTERNAL, 0);
-        return;
-    }
+    resultptr = (char *)&smres.miss_kinfo[c->coll_numkeys];
 
-    switch (ret) {
-    case ENGINE_SUCCESS:
-        switch (c->cmd) {
-        case PROTOCOL_BINARY_CMD_APPEND:
-            c->store_op = OPERATION_APPEND;
-            break;
-        case PROTOCOL_BINARY_CMD_PREPEND:
-            c->store_op = OPERATION_PREPEND;
-            break;
-        default:
-            assert(0);
-        }
-
-        c->item = it;
-        ritem_set_first(c, CONN_RTYPE_HINFO, vlen);
-        conn_set_state(c, conn_nread);
-        c->substate = bin_read_set_value;
-        break;
-    case ENGINE_DISCONNECT:
-        c->state = conn_closing;
-        break;
-    default:
-        if (ret == ENGINE_E2BIG) {
-            write_bin_packet(c, PROTOCOL_BINARY_RESPONSE_E2BIG, vlen);
-        } else {
-            write_bin_packet(c, PROTOCOL_BINARY_RESPONSE_ENOMEM, vlen);
-        }
-        /* swallow the data line */
-        c->write_and_go = conn_swallow;
-    }
-}
-
-static void process_bin_flush(conn *c) {
-    protocol_binary_request_flush* req = binary_get_request(c);
-    time_t exptime = 0;
+    /* We don't actually receive the trailing two("\r\n") characters in binary protocol.
+     * We should consider this when tokenizing key strings.
+     */
     ENGINE_ERROR_CODE ret = ENGINE_SUCCESS;
-
-    if (c->binary_header.request.extlen == sizeof(req->message.body)) {
-        exptime = ntohl(req->message.body.expiration);
-        if (exptime < 0) {
-            ret = ENGINE_EINVAL;
+    keys_array = (token_t*)token_buff_get(&c->thread->token_buff, c->coll_numkeys);
+    if (keys_array != NULL) {
+        int ntokens = tokenize_mblocks(&c->memblist, c->coll_lenkeys-2, delimiter, c->coll_numkeys, keys_array);
+        if (ntokens == -1) {
+            ntokens = tokenize_mblocks(&c->memblist, c->coll_lenkeys-2, old_delimiter, c->coll_numkeys, keys_array);
         }
+        if (ntokens == -1) {
+            ret = ENGINE_EBADVALUE;
+        } else if (ntokens == -2) {
+            ret = ENGINE_ENOMEM;
+        }
+    } else {
+        ret = ENGINE_ENOMEM;
     }
-
-    if (settings.verbose > 1) {
-        mc_logger->log(EXTENSION_LOG_DEBUG, c,
-                       "%d: flush %ld", c->sfd, (long)exptime);
-    }
-
     if (ret == ENGINE_SUCCESS) {
-        ret = mc_engine.v1->flush(mc_engine.v0, c, NULL, -1, realtime(exptime));
-        if (ret == ENGINE_EWOULDBLOCK) {
-            c->ewouldblock = true;
-            ret = ENGINE_SUCCESS;
+        if (c->coll_bkrange.to_nbkey == BKEY_NULL) {
+            memcpy(c->coll_bkrange.to_bkey, c->coll_bkrange.from_bkey,
+                   (c->coll_bkrange.from_nbkey==0 ? sizeof(uint64_t) : c->coll_bkrange.from_nbkey));
+            c->coll_bkrange.to_nbkey = c->coll_bkrange.from_nbkey;
         }
+        assert(c->coll_numkeys > 0);
+        assert(c->coll_rcount > 0);
+        assert((c->coll_roffset + c->coll_rcount) <= MAX_SMGET_REQ_COUNT);
+        ret = mc_engine.v1->btree_elem_smget(mc_engine.v0, c,
+                                     keys_array, c->coll_numkeys,
+                                     &c->coll_bkrange,
+                                     (c->coll_efilter.ncompval==0 ? NULL : &c->coll_efilter),
+                                     c->coll_roffset, c->coll_rcount,
+#ifdef JHPARK_OLD_SMGET_INTERFACE
+                                     (c->coll_smgmode == 2 ? true : false), &smres,
+#else
+                                     c->coll_unique, &smres,
+#endif
+                                     c->binary_header.request.vbucket);
     }
 
-    if (ret == ENGINE_SUCCESS) {
-        write_bin_response(c, NULL, 0, 0, 0);
-    } else if (ret == ENGINE_ENOTSUP) {
-        write_bin_packet(c, PROTOCOL_BINARY_RESPONSE_NOT_SUPPORTED, 0);
-    } else {
-        write_bin_packet(c, PROTOCOL_BINARY_RESPONSE_EINVAL, 0);
-    }
-    STATS_NOKEY(c, cmd_flush);
-}
+    switch (ret) {
+    case ENGINE_SUCCESS:
+        {
+        protocol_binary_response_bop_smget* rsp = (protocol_binary_response_bop_smget*)c->wbuf;
+        uint32_t real_elem_hdr_size = smres.elem_count * (sizeof(uint64_t) + (3*sizeof(uint32_t)));
+        uint32_t real_emis_hdr_size = (smres.miss_count + smres.trim_count) * sizeof(uint32_t);
+        uint32_t bodylen, i;
+        uint64_t *bkeyptr;
+        uint32_t *vlenptr;
+        uint32_t *flagptr;
+        uint32_t *klenptr;
 
-static void process_bin_flush_prefix(conn *c) {
-    protocol_binary_request_flush_prefix *req = binary_get_request(c);
-    char *prefix = binary_get_key(c);
-    size_t nprefix = c->binary_header.request.keylen;
-    time_t exptime = 0;
-    ENGINE_ERROR_CODE ret = ENGINE_SUCCESS;
+        if (((long)resultptr % 8) != 0) /* NOT aligned */
+            resultptr += (8 - ((long)resultptr % 8));
+        bkeyptr = (uint64_t *)resultptr;
+        vlenptr = (uint32_t *)((char*)bkeyptr + (sizeof(uint64_t) * smres.elem_count));
+        flagptr = (uint32_t *)((char*)vlenptr + (sizeof(uint32_t) * smres.elem_count));
+        klenptr = (uint32_t *)((char*)flagptr + (sizeof(uint32_t) * smres.elem_count));
 
-    if (c->binary_header.request.extlen == sizeof(req->message.body)) {
-        exptime = ntohl(req->message.body.expiration);
-        if (exptime < 0) {
-            ret = ENGINE_EINVAL;
+        bodylen = sizeof(rsp->message.body) + (real_elem_hdr_size + real_emis_hdr_size);
+        for (i = 0; i < smres.elem_count; i++) {
+            mc_engine.v1->get_elem_info(mc_engine.v0, c, ITEM_TYPE_BTREE,
+                                        smres.elem_array[i], &c->einfo);
+            bodylen += ((c->einfo.nbytes - 2) + keys_array[smres.elem_kinfo[i].kidx].length);
+            bkeyptr[i] = htonll(*(uint64_t*)c->einfo.score);
+            vlenptr[i] = htonl(c->einfo.nbytes - 2);
+            flagptr[i] = smres.elem_kinfo[i].flag;
+            klenptr[i] = htonl(keys_array[smres.elem_kinfo[i].kidx].length);
         }
-    }
-
-    if (settings.verbose > 1) {
-        char buffer[1024];
-        if (key_to_printable_buffer(buffer, sizeof(buffer), c->sfd, true, "FLUSH_PREFIX", prefix, nprefix) != -1) {
-            mc_logger->log(EXTENSION_LOG_DEBUG, c, "%s %ld\n", buffer, (long)exptime);
+        for (i = 0; i < smres.miss_count; i++) {
+            bodylen += keys_array[smres.miss_kinfo[i].kidx].length;
+            klenptr[smres.elem_count+i] = htonl(keys_array[smres.miss_kinfo[i].kidx].length);
         }
-    }
+        for (i = 0; i < smres.trim_count; i++) {
+            bodylen += keys_array[smres.trim_kinfo[i].kidx].length;
+            klenptr[smres.elem_count+smres.miss_count+i] = htonl(keys_array[smres.trim_kinfo[i].kidx].length);
+        }
+        add_bin_header(c, 0, sizeof(rsp->message.body), 0, bodylen);
 
-    if (nprefix == 6 && strncmp(prefix, "<null>", 6) == 0) {
-        /* flush null prefix */
-        prefix = NULL;
-        nprefix = 0;
-    }
+        // add the flags and count
+        rsp->message.body.elem_count = htonl(smres.elem_count);
+        rsp->message.body.miss_count = htonl(smres.miss_count);
+        rsp->message.body.trim_count = htonl(smres.trim_count);
+        add_iov(c, &rsp->message.body, sizeof(rsp->message.body));
 
-    if (ret == ENGINE_SUCCESS) {
-        ret = mc_engine.v1->flush(mc_engine.v0, c, prefix, nprefix, realtime(exptime));
-        if (ret == ENGINE_EWOULDBLOCK) {
-            c->ewouldblock = true;
-            ret = ENGINE_SUCCESS;
+        // add value lengths
+        if (add_iov(c, (char*)bkeyptr, real_elem_hdr_size+real_emis_hdr_size) != 0) {
+            ret = ENGINE_ENOMEM;
         }
-    }
 
-    if (settings.detail_enabled) {
-        if (ret == ENGINE_SUCCESS || ret == ENGINE_PREFIX_ENOENT) {
-            if (stats_prefix_delete(prefix, nprefix) == 0) { /* found */
-                ret = ENGINE_SUCCESS;
+        /* Add the data without CRLF */
+        if (ret == ENGINE_SUCCESS) {
+            for (i = 0; i < smres.elem_count; i++) {
+                mc_engine.v1->get_elem_info(mc_engine.v0, c, ITEM_TYPE_BTREE,
+                                            smres.elem_array[i], &c->einfo);
+                if (add_iov_einfo_some_value(c, &c->einfo, c->einfo.nbytes - 2) != 0) {
+                    ret = ENGINE_ENOMEM; break;
+                }
+            }
+        }
+        /* Add the found key */
+        if (ret == ENGINE_SUCCESS) {
+            for (i = 0; i < smres.elem_count; i++) {
+                if (add_iov(c, keys_array[smres.elem_kinfo[i].kidx].value,
+                               keys_array[smres.elem_kinfo[i].kidx].length) != 0) {
+                    ret = ENGINE_ENOMEM; break;
+                }
+            }
+        }
+        /* Add the missed key */
+        if (ret == ENGINE_SUCCESS) {
+            for (i = 0; i < smres.miss_count; i++) {
+                if (add_iov(c, keys_array[smres.miss_kinfo[i].kidx].value,
+                               keys_array[smres.miss_kinfo[i].kidx].length) != 0) {
+                    ret = ENGINE_ENOMEM; break;
+                }
+            }
+        }
+        /* Add the trimmed key */
+        if (ret == ENGINE_SUCCESS) {
+            for (i = 0; i < smres.trim_count; i++) {
+                if (add_iov(c, keys_array[smres.trim_kinfo[i].kidx].value,
+                               keys_array[smres.trim_kinfo[i].kidx].length) != 0) {
+                    ret = ENGINE_ENOMEM; break;
+                }
             }
         }
-    }
 
-    switch (ret) {
-    case ENGINE_SUCCESS:
-        write_bin_response(c, NULL, 0, 0, 0);
+        if (ret == ENGINE_SUCCESS) {
+            /* Remember this command so we can garbage collect it later */
+            /* c->coll_eitem  = (void *)elem_array; */
+            STATS_NOKEY2(c, cmd_bop_smget, bop_smget_oks);
+            c->coll_ecount = smres.elem_count+smres.trim_count;
+            c->coll_op     = OPERATION_BOP_SMGET;
+            conn_set_state(c, conn_mwrite);
+        } else {
+            STATS_NOKEY(c, cmd_bop_smget);
+            mc_engine.v1->btree_elem_release(mc_engine.v0, c, smres.elem_array,
+                                             smres.elem_count+smres.trim_count);
+            write_bin_packet(c, PROTOCOL_BINARY_RESPONSE_ENOMEM, 0);
+        }
+        }
         break;
     case ENGINE_DISCONNECT:
         c->state = conn_closing;
         break;
-    case ENGINE_PREFIX_ENOENT:
-        write_bin_packet(c, PROTOCOL_BINARY_RESPONSE_PREFIX_ENOENT, 0);
-        break;
-    case ENGINE_ENOTSUP:
-        write_bin_packet(c, PROTOCOL_BINARY_RESPONSE_NOT_SUPPORTED, 0);
-        break;
     default:
-        write_bin_packet(c, PROTOCOL_BINARY_RESPONSE_EINVAL, 0);
-        break;
+        STATS_NOKEY(c, cmd_bop_smget);
+        if (ret == ENGINE_EBADVALUE)
+            write_bin_packet(c, PROTOCOL_BINARY_RESPONSE_EBADVALUE, 0);
+        else if (ret == ENGINE_EBADTYPE)
+            write_bin_packet(c, PROTOCOL_BINARY_RESPONSE_EBADTYPE, 0);
+        else if (ret == ENGINE_EBADBKEY)
+            write_bin_packet(c, PROTOCOL_BINARY_RESPONSE_EBADBKEY, 0);
+        else if (ret == ENGINE_EBADATTR)
+            write_bin_packet(c, PROTOCOL_BINARY_RESPONSE_EBADATTR, 0);
+#if 0 // JHPARK_SMGET_OFFSET_HANDLING
+        else if (ret == ENGINE_EBKEYOOR)
+            write_bin_packet(c, PROTOCOL_BINARY_RESPONSE_EBKEYOOR, 0);
+#endif
+        else if (ret == ENGINE_ENOMEM)
+            write_bin_packet(c, PROTOCOL_BINARY_RESPONSE_ENOMEM, 0);
+        else
+            write_bin_packet(c, PROTOCOL_BINARY_RESPONSE_EINTERNAL, 0);
     }
 
-    STATS_NOKEY(c, cmd_flush_prefix);
-    return;
-}
-
-static void process_bin_delete(conn *c) {
-    protocol_binary_request_delete* req = binary_get_request(c);
-
-    char* key = binary_get_key(c);
-    size_t nkey = c->binary_header.request.keylen;
-
-    assert(c != NULL);
+    /* free token buffer */
+    if (keys_array != NULL) {
+        token_buff_release(&c->thread->token_buff, keys_array);
+    }
 
-    if (settings.verbose > 1) {
-        char buffer[1024];
-        if (key_to_printable_buffer(buffer, sizeof(buffer), c->sfd, true,
-                                    "DELETE", key, nkey) != -1) {
-            mc_logger->log(EXTENSION_LOG_DEBUG, c, "%s\n", buffer);
+    if (ret != ENGINE_SUCCESS) {
+        if (c->coll_strkeys != NULL) {
+            /* free key string memory blocks */
+            assert(c->coll_strkeys == (void*)&c->memblist);
+            mblck_list_free(&c->thread->mblck_pool, &c->memblist);
+            c->coll_strkeys = NULL;
+        }
+        if (c->coll_eitem != NULL) {
+            free((void *)c->coll_eitem);
+            c->coll_eitem = NULL;
         }
     }
+}
+#endif
 
-    ENGINE_ERROR_CODE ret;
-    ret = mc_engine.v1->remove(mc_engine.v0, c, key, nkey,
-                               ntohll(req->message.header.request.cas),
-                               c->binary_header.request.vbucket);
-    if (ret == ENGINE_EWOULDBLOCK) {
-        c->ewouldblock = true;
-        ret = ENGINE_SUCCESS;
+#if defined(SUPPORT_BOP_MGET) || defined(SUPPORT_BOP_SMGET)
+static void process_bin_bop_nread_keys_complete(conn *c) {
+    assert(c != NULL);
+#ifdef SUPPORT_BOP_MGET
+    if (c->coll_op == OPERATION_BOP_MGET)
+        process_bin_bop_mget_complete(c);
+#endif
+#ifdef SUPPORT_BOP_SMGET
+    if (c->coll_op == OPERATION_BOP_SMGET)
+        process_bin_bop_smget_complete(c);
+#endif
+}
+#endif
+
+static void process_bin_getattr(conn *c) {
+    assert(c != NULL);
+    char *key = binary_get_key(c);
+    int  nkey = c->binary_header.request.keylen;
+
+    if (settings.verbose > 1) {
+        fprintf(stderr, "<%d GETATTR ", c->sfd);
+        for (int ii = 0; ii < nkey; ++ii) {
+            fprintf(stderr, "%c", key[ii]);
+        }
+        fprintf(stderr, "\n");
     }
 
+    item_attr attr_data;
+    ENGINE_ITEM_ATTR attr_ids[ATTR_END];
+    uint32_t attr_count = 0;
+
+    ENGINE_ERROR_CODE ret;
+    ret = mc_engine.v1->getattr(mc_engine.v0, c, key, nkey,
+                                attr_ids, attr_count, &attr_data,
+                                c->binary_header.request.vbucket);
+
     if (settings.detail_enabled) {
-        stats_prefix_record_delete(key, nkey);
+        stats_prefix_record_getattr(key, nkey);
     }
 
     switch (ret) {
     case ENGINE_SUCCESS:
-        write_bin_response(c, NULL, 0, 0, 0);
+        {
+        STATS_HITS(c, getattr, key, nkey);
+
+        protocol_binary_response_getattr* rsp = (protocol_binary_response_getattr*)c->wbuf;
+        rsp->message.body.flags      = attr_data.flags;
+        rsp->message.body.expiretime = htonl(attr_data.exptime);
+        rsp->message.body.type       = attr_data.type;
+        if (attr_data.type == ITEM_TYPE_LIST || attr_data.type == ITEM_TYPE_SET ||
+            attr_data.type == ITEM_TYPE_BTREE) {
+            rsp->message.body.count      = htonl(attr_data.count);
+            rsp->message.body.maxcount   = htonl(attr_data.maxcount);
+            rsp->message.body.ovflaction = attr_data.ovflaction;
+            rsp->message.body.readable   = attr_data.readable;
+        }
+        if (attr_data.type == ITEM_TYPE_BTREE) {
+            rsp->message.body.maxbkeyrange.len = attr_data.maxbkeyrange.len;
+            if (attr_data.maxbkeyrange.len != BKEY_NULL) {
+                if (attr_data.maxbkeyrange.len == 0) {
+                    uint64_t bkey_temp;
+                    memcpy((unsigned char*)&bkey_temp, attr_data.maxbkeyrange.val, sizeof(uint64_t));
+                    bkey_temp = htonll(bkey_temp);
+                    memcpy(rsp->message.body.maxbkeyrange.val, (unsigned char*)&bkey_temp, sizeof(uint64_t));
+                    //*(uint64_t*)rsp->message.body.maxbkeyrange.val = htonll(*(uint64_t*)attr_data.maxbkeyrange.val);
+                } else {
+                    memcpy(rsp->message.body.maxbkeyrange.val, attr_data.maxbkeyrange.val, attr_data.maxbkeyrange.len);
+                }
+            }
+        }
+        write_bin_response(c, &rsp->message.body, 0, 0, sizeof(rsp->message.body));
+        }
         break;
-    case ENGINE_KEY_EEXISTS:
-        write_bin_packet(c, PROTOCOL_BINARY_RESPONSE_KEY_EEXISTS, 0);
+    case ENGINE_DISCONNECT:
+        c->state = conn_closing;
         break;
     case ENGINE_KEY_ENOENT:
+        STATS_MISS(c, getattr, key, nkey);
         write_bin_packet(c, PROTOCOL_BINARY_RESPONSE_KEY_ENOENT, 0);
         break;
-    case ENGINE_NOT_MY_VBUCKET:
-        write_bin_packet(c, PROTOCOL_BINARY_RESPONSE_NOT_MY_VBUCKET, 0);
-        break;
     default:
-        write_bin_packet(c, PROTOCOL_BINARY_RESPONSE_EINVAL, 0);
+        STATS_NOKEY(c, cmd_getattr);
+        if (ret == ENGINE_EBADATTR)
+            write_bin_packet(c, PROTOCOL_BINARY_RESPONSE_EBADATTR, 0);
+        else
+            write_bin_packet(c, PROTOCOL_BINARY_RESPONSE_EINTERNAL, 0);
     }
 }
 
-static void complete_nread_binary(conn *c) {
+static void process_bin_setattr(conn *c) {
     assert(c != NULL);
-    assert(c->cmd >= 0);
+    assert(c->ewouldblock == false);
+    char *key = binary_get_key(c);
+    int  nkey = c->binary_header.request.keylen;
 
-    switch(c->substate) {
-    case bin_reading_set_header:
-        if (c->cmd == PROTOCOL_BINARY_CMD_APPEND ||
-                c->cmd == PROTOCOL_BINARY_CMD_PREPEND) {
-            process_bin_append_prepend(c);
+    item_attr attr_data;
+    ENGINE_ITEM_ATTR attr_ids[ATTR_END];
+    uint32_t attr_count = 0;
+
+    /* fix byteorder in the request */
+    protocol_binary_request_setattr* req = binary_get_request(c);
+
+    if (req->message.body.expiretime_f != 0) {
+        attr_ids[attr_count++] = ATTR_EXPIRETIME;
+        req->message.body.expiretime = ntohl(req->message.body.expiretime);
+        attr_data.exptime = realtime(req->message.body.expiretime);
+    }
+    if (req->message.body.maxcount_f != 0) {
+        attr_ids[attr_count++] = ATTR_MAXCOUNT;
+        req->message.body.maxcount = ntohl(req->message.body.maxcount);
+        attr_data.maxcount = req->message.body.maxcount;
+    }
+    if (req->message.body.maxbkeyrange.len != BKEY_NULL) {
+        attr_ids[attr_count++] = ATTR_MAXBKEYRANGE;
+        if (req->message.body.maxbkeyrange.len == 0) {
+            uint64_t bkey_temp;
+            memcpy((unsigned char*)&bkey_temp, req->message.body.maxbkeyrange.val, sizeof(uint64_t));
+            bkey_temp = ntohll(bkey_temp);
+            memcpy(attr_data.maxbkeyrange.val, (unsigned char*)&bkey_temp, sizeof(uint64_t));
+            //*(uint64_t*)attr_data.maxbkeyrange.val = ntohll(*(uint64_t*)req->message.body.maxbkeyrange.val);
         } else {
-            process_bin_update(c);
+            memcpy(attr_data.maxbkeyrange.val, req->message.body.maxbkeyrange.val, req->message.body.maxbkeyrange.len);
         }
+        attr_data.maxbkeyrange.len = req->message.body.maxbkeyrange.len;
+    }
+    if (req->message.body.ovflaction != 0) {
+        attr_ids[attr_count++] = ATTR_OVFLACTION;
+        attr_data.ovflaction = req->message.body.ovflaction;
+    }
+    if (req->message.body.readable != 0) {
+        attr_ids[attr_count++] = ATTR_READABLE;
+        attr_data.readable = req->message.body.readable;
+    }
+
+    if (settings.verbose > 1) {
+        fprintf(stderr, "<%d SETATTR ", c->sfd);
+        for (int ii = 0; ii < nkey; ++ii) {
+            fprintf(stderr, "%c", key[ii]);
+        }
+        for (int ii = 0; ii < attr_count; ii++) {
+             if (attr_ids[ii] == ATTR_EXPIRETIME)
+                 fprintf(stderr, " expiretime=%d", (int32_t)attr_data.exptime);
+             else if (attr_ids[ii] == ATTR_MAXCOUNT)
+                 fprintf(stderr, " maxcount=%d", attr_data.maxcount);
+             else if (attr_ids[ii] == ATTR_OVFLACTION)
+                 fprintf(stderr, " ovflaction=%s", get_ovflaction_str(attr_data.ovflaction));
+             else if (attr_ids[ii] == ATTR_READABLE)
+                 fprintf(stderr, " readable=%s", (attr_data.readable ? "on" : "off"));
+             else if (attr_ids[ii] == ATTR_MAXBKEYRANGE) {
+                 char buffer[MAX_BKEY_LENG*2+4];
+                 if (attr_data.maxbkeyrange.len == 0) {
+                     uint64_t bkey_temp;
+                     memcpy((unsigned char*)&bkey_temp, attr_data.maxbkeyrange.val, sizeof(uint64_t));
+                     fprintf(stderr, "maxbkeyrange=%"PRIu64, bkey_temp);
+                     //fprintf(stderr, "maxbkeyrange=%"PRIu64, *(uint64_t*)attr_data.maxbkeyrange.val);
+                 } else {
+                     safe_hexatostr(attr_data.maxbkeyrange.val, attr_data.maxbkeyrange.len, buffer);
+                     fprintf(stderr, "maxbkeyrange=0x%s", buffer);
+                 }
+             }
+        }
+        fprintf(stderr, "\n");
+    }
+
+    ENGINE_ERROR_CODE ret;
+    ret = mc_engine.v1->setattr(mc_engine.v0, c, key, nkey,
+                                attr_ids, attr_count, &attr_data,
+                                c->binary_header.request.vbucket);
+    if (ret == ENGINE_EWOULDBLOCK) {
+        c->ewouldblock = true;
+        ret = ENGINE_SUCCESS;
+    }
+
+    if (settings.detail_enabled) {
+        stats_prefix_record_setattr(key, nkey);
+    }
+
+    switch (ret) {
+    case ENGINE_SUCCESS:
+        STATS_HITS(c, setattr, key, nkey);
+        write_bin_response(c, NULL, 0, 0, 0);
         break;
-    case bin_read_set_value:
-        complete_update_bin(c);
-        break;
-    case bin_reading_get_key:
-        process_bin_get(c);
-        break;
-    case bin_reading_stat:
-        process_bin_stat(c);
-        break;
-    case bin_reading_del_header:
-        process_bin_delete(c);
-        break;
-    case bin_reading_incr_header:
-        complete_incr_bin(c);
-        break;
-    case bin_read_flush_exptime:
-        process_bin_flush(c);
-        break;
-    case bin_read_flush_prefix_exptime:
-        process_bin_flush_prefix(c);
-        break;
-    case bin_reading_sasl_auth:
-        process_bin_sasl_auth(c);
-        break;
-    case bin_reading_sasl_auth_data:
-        process_bin_complete_sasl_auth(c);
-        break;
-    case bin_reading_getattr:
-        process_bin_getattr(c);
-        break;
-    case bin_reading_setattr:
-        process_bin_setattr(c);
-        break;
-    case bin_reading_lop_create:
-        process_bin_lop_create(c);
-        break;
-    case bin_reading_lop_prepare_nread:
-        process_bin_lop_prepare_nread(c);
-        break;
-    case bin_reading_lop_nread_complete:
-        process_bin_lop_nread_complete(c);
-        break;
-    case bin_reading_lop_delete:
-        process_bin_lop_delete(c);
-        break;
-    case bin_reading_lop_get:
-        process_bin_lop_get(c);
-        break;
-    case bin_reading_sop_create:
-        process_bin_sop_create(c);
+    case ENGINE_DISCONNECT:
+        c->state = conn_closing;
         break;
-    case bin_reading_sop_prepare_nread:
-        process_bin_sop_prepare_nread(c);
+    case ENGINE_KEY_ENOENT:
+        STATS_MISS(c, setattr, key, nkey);
+        write_bin_packet(c, PROTOCOL_BINARY_RESPONSE_KEY_ENOENT, 0);
         break;
-    case bin_reading_sop_nread_complete:
-        process_bin_sop_nread_complete(c);
+    default:
+        STATS_NOKEY(c, cmd_setattr);
+        if (ret == ENGINE_EBADATTR)
+            write_bin_packet(c, PROTOCOL_BINARY_RESPONSE_EBADATTR, 0);
+        else if (ret == ENGINE_EBADVALUE)
+            write_bin_packet(c, PROTOCOL_BINARY_RESPONSE_EBADVALUE, 0);
+        else
+            write_bin_packet(c, PROTOCOL_BINARY_RESPONSE_EINTERNAL, 0);
+    }
+}
+
+static bool binary_response_handler(const void *key, uint16_t keylen,
+                                    const void *ext, uint8_t extlen,
+                                    const void *body, uint32_t bodylen,
+                                    uint8_t datatype, uint16_t status,
+                                    uint64_t cas, const void *cookie)
+{
+    conn *c = (conn*)cookie;
+    /* Look at append_bin_stats */
+    size_t needed = keylen + extlen + bodylen + sizeof(protocol_binary_response_header);
+    if (!grow_dynamic_buffer(c, needed)) {
+        if (settings.verbose > 0) {
+            mc_logger->log(EXTENSION_LOG_INFO, c,
+                    "<%d ERROR: Failed to allocate memory for response\n", c->sfd);
+        }
+        return false;
+    }
+
+    char *buf = c->dynamic_buffer.buffer + c->dynamic_buffer.offset;
+    protocol_binary_response_header header = {
+        .response.magic = (uint8_t)PROTOCOL_BINARY_RES,
+        .response.opcode = c->binary_header.request.opcode,
+        .response.keylen = (uint16_t)htons(keylen),
+        .response.extlen = extlen,
+        .response.datatype = datatype,
+        .response.status = (uint16_t)htons(status),
+        .response.bodylen = htonl(bodylen + keylen + extlen),
+        .response.opaque = c->opaque,
+        .response.cas = htonll(cas),
+    };
+
+    memcpy(buf, header.bytes, sizeof(header.response));
+    buf += sizeof(header.response);
+
+    if (extlen > 0) {
+        memcpy(buf, ext, extlen);
+        buf += extlen;
+    }
+
+    if (keylen > 0) {
+        memcpy(buf, key, keylen);
+        buf += keylen;
+    }
+
+    if (bodylen > 0) {
+        memcpy(buf, body, bodylen);
+    }
+
+    c->dynamic_buffer.offset += needed;
+
+    return true;
+}
+
+static void process_bin_unknown_packet(conn *c) {
+    void *packet = c->rcurr - (c->binary_header.request.bodylen +
+                               sizeof(c->binary_header));
+
+    ENGINE_ERROR_CODE ret;
+    ret = mc_engine.v1->unknown_command(mc_engine.v0, c, packet,
+                                        binary_response_handler);
+
+    switch (ret) {
+    case ENGINE_SUCCESS:
+        write_and_free(c, c->dynamic_buffer.buffer, c->dynamic_buffer.offset);
+        c->dynamic_buffer.buffer = NULL;
         break;
-    case bin_reading_sop_get:
-        process_bin_sop_get(c);
+    case ENGINE_ENOTSUP:
+        write_bin_packet(c, PROTOCOL_BINARY_RESPONSE_UNKNOWN_COMMAND, 0);
         break;
-    case bin_reading_bop_create:
-        process_bin_bop_create(c);
+    default:
+        /* FATAL ERROR, shut down connection */
+        conn_set_state(c, conn_closing);
+    }
+}
+
+static void dispatch_bin_command(conn *c) {
+    int protocol_error = 0;
+
+    int extlen = c->binary_header.request.extlen;
+    int keylen = c->binary_header.request.keylen;
+    uint32_t bodylen = c->binary_header.request.bodylen;
+
+    if (settings.require_sasl && !authenticated(c)) {
+        write_bin_packet(c, PROTOCOL_BINARY_RESPONSE_AUTH_ERROR, 0);
+        c->write_and_go = conn_closing;
+        return;
+    }
+
+    MEMCACHED_PROCESS_COMMAND_START(c->sfd, c->rcurr, c->rbytes);
+    c->noreply = true;
+
+    /* binprot supports 16bit keys, but internals are still 8bit */
+    if (keylen > KEY_MAX_LENGTH) {
+        handle_binary_protocol_error(c);
+        return;
+    }
+
+    switch (c->cmd) {
+    case PROTOCOL_BINARY_CMD_SETQ:
+        c->cmd = PROTOCOL_BINARY_CMD_SET;
         break;
-    case bin_reading_bop_prepare_nread:
-        process_bin_bop_prepare_nread(c);
+    case PROTOCOL_BINARY_CMD_ADDQ:
+        c->cmd = PROTOCOL_BINARY_CMD_ADD;
         break;
-    case bin_reading_bop_nread_complete:
-        process_bin_bop_nread_complete(c);
+    case PROTOCOL_BINARY_CMD_REPLACEQ:
+        c->cmd = PROTOCOL_BINARY_CMD_REPLACE;
         break;
-    case bin_reading_bop_update_prepare_nread:
-        process_bin_bop_update_prepare_nread(c);
+    case PROTOCOL_BINARY_CMD_DELETEQ:
+        c->cmd = PROTOCOL_BINARY_CMD_DELETE;
         break;
-    case bin_reading_bop_update_nread_complete:
-        process_bin_bop_update_complete(c);
+    case PROTOCOL_BINARY_CMD_INCREMENTQ:
+        c->cmd = PROTOCOL_BINARY_CMD_INCREMENT;
         break;
-    case bin_reading_bop_delete:
-        process_bin_bop_delete(c);
+    case PROTOCOL_BINARY_CMD_DECREMENTQ:
+        c->cmd = PROTOCOL_BINARY_CMD_DECREMENT;
         break;
-    case bin_reading_bop_get:
-        process_bin_bop_get(c);
+    case PROTOCOL_BINARY_CMD_QUITQ:
+        c->cmd = PROTOCOL_BINARY_CMD_QUIT;
         break;
-    case bin_reading_bop_count:
-        process_bin_bop_count(c);
+    case PROTOCOL_BINARY_CMD_FLUSHQ:
+        c->cmd = PROTOCOL_BINARY_CMD_FLUSH;
         break;
-#if defined(SUPPORT_BOP_MGET) || defined(SUPPORT_BOP_SMGET)
-    case bin_reading_bop_prepare_nread_keys:
-        process_bin_bop_prepare_nread_keys(c);
+    case PROTOCOL_BINARY_CMD_APPENDQ:
+        c->cmd = PROTOCOL_BINARY_CMD_APPEND;
         break;
-    case bin_reading_bop_nread_keys_complete:
-        process_bin_bop_nread_keys_complete(c);
+    case PROTOCOL_BINARY_CMD_PREPENDQ:
+        c->cmd = PROTOCOL_BINARY_CMD_PREPEND;
         break;
-#endif
-    case bin_reading_packet:
-        process_bin_unknown_packet(c);
+    case PROTOCOL_BINARY_CMD_GETQ:
+        c->cmd = PROTOCOL_BINARY_CMD_GET;
+        break;
+    case PROTOCOL_BINARY_CMD_GETKQ:
+        c->cmd = PROTOCOL_BINARY_CMD_GETK;
+        break;
+    case PROTOCOL_BINARY_CMD_LOP_INSERTQ:
+        c->cmd = PROTOCOL_BINARY_CMD_LOP_INSERT;
+        break;
+    case PROTOCOL_BINARY_CMD_LOP_DELETEQ:
+        c->cmd = PROTOCOL_BINARY_CMD_LOP_DELETE;
+        break;
+    case PROTOCOL_BINARY_CMD_SOP_INSERTQ:
+        c->cmd = PROTOCOL_BINARY_CMD_SOP_INSERT;
+        break;
+    case PROTOCOL_BINARY_CMD_SOP_DELETEQ:
+        c->cmd = PROTOCOL_BINARY_CMD_SOP_DELETE;
+        break;
+    case PROTOCOL_BINARY_CMD_MOP_INSERTQ:
+        c->cmd = PROTOCOL_BINARY_CMD_MOP_INSERT;
+        break;
+    case PROTOCOL_BINARY_CMD_MOP_UPDATEQ:
+        c->cmd = PROTOCOL_BINARY_CMD_MOP_UPDATE;
+        break;
+    case PROTOCOL_BINARY_CMD_MOP_DELETEQ:
+        c->cmd = PROTOCOL_BINARY_CMD_MOP_DELETE;
+        break;
+    case PROTOCOL_BINARY_CMD_BOP_INSERTQ:
+        c->cmd = PROTOCOL_BINARY_CMD_BOP_INSERT;
+        break;
+    case PROTOCOL_BINARY_CMD_BOP_UPSERTQ:
+        c->cmd = PROTOCOL_BINARY_CMD_BOP_UPSERT;
+        break;
+    case PROTOCOL_BINARY_CMD_BOP_UPDATEQ:
+        c->cmd = PROTOCOL_BINARY_CMD_BOP_UPDATE;
+        break;
+    case PROTOCOL_BINARY_CMD_BOP_DELETEQ:
+        c->cmd = PROTOCOL_BINARY_CMD_BOP_DELETE;
         break;
     default:
-        mc_logger->log(EXTENSION_LOG_WARNING, c,
-                "Not handling substate %d\n", c->substate);
-        abort();
+        c->noreply = false;
     }
-}
 
-static void reset_cmd_handler(conn *c) {
-    c->ascii_cmd = NULL;
-    c->cmd = -1;
-    c->substate = bin_no_state;
-    if(c->item != NULL) {
-        mc_engine.v1->release(mc_engine.v0, c, c->item);
-        c->item = NULL;
-    }
-#ifdef DETECT_LONG_QUERY
-    if (c->lq_bufcnt != 0) {
-        lqdetect_buffer_release(c->lq_bufcnt);
-        c->lq_bufcnt = 0;
-    }
-#endif
-    if (c->coll_eitem != NULL) {
-        conn_coll_eitem_free(c);
-    }
-    if (c->coll_strkeys != NULL) {
-        assert(c->coll_strkeys == (void*)&c->memblist);
-        mblck_list_free(&c->thread->mblck_pool, &c->memblist);
-        c->coll_strkeys = NULL;
-    }
-    conn_shrink(c);
-    if (c->rbytes > 0) {
-        conn_set_state(c, conn_parse_cmd);
-    } else {
-        conn_set_state(c, conn_waiting);
-    }
-}
+    switch (c->cmd) {
+        case PROTOCOL_BINARY_CMD_VERSION:
+            if (extlen == 0 && keylen == 0 && bodylen == 0) {
+                write_bin_response(c, VERSION, 0, 0, strlen(VERSION));
+            } else {
+                protocol_error = 1;
+            }
+            break;
+        case PROTOCOL_BINARY_CMD_FLUSH:
+            if (keylen == 0 && bodylen == extlen && (extlen == 0 || extlen == 4)) {
+                bin_read_key(c, bin_read_flush_exptime, extlen);
+            } else {
+                protocol_error = 1;
+            }
+            break;
+        case PROTOCOL_BINARY_CMD_FLUSH_PREFIX:
+            if (keylen > 0 && bodylen == extlen && (extlen == 0 || extlen == 4)) {
+                bin_read_key(c, bin_read_flush_prefix_exptime, extlen);
+            } else {
+                protocol_error = 1;
+            }
+            break;
+        case PROTOCOL_BINARY_CMD_NOOP:
+            if (extlen == 0 && keylen == 0 && bodylen == 0) {
+                write_bin_response(c, NULL, 0, 0, 0);
+            } else {
+                protocol_error = 1;
+            }
+            break;
+        case PROTOCOL_BINARY_CMD_SET: /* FALLTHROUGH */
+        case PROTOCOL_BINARY_CMD_ADD: /* FALLTHROUGH */
+        case PROTOCOL_BINARY_CMD_REPLACE:
+            if (extlen == 8 && keylen != 0 && bodylen >= (keylen + 8)) {
+                bin_read_key(c, bin_reading_set_header, 8);
+            } else {
+                protocol_error = 1;
+            }
+            break;
+        case PROTOCOL_BINARY_CMD_GETQ:  /* FALLTHROUGH */
+        case PROTOCOL_BINARY_CMD_GET:   /* FALLTHROUGH */
+        case PROTOCOL_BINARY_CMD_GETKQ: /* FALLTHROUGH */
+        case PROTOCOL_BINARY_CMD_GETK:
+            if (extlen == 0 && bodylen == keylen && keylen > 0) {
+                bin_read_key(c, bin_reading_get_key, 0);
+            } else {
+                protocol_error = 1;
+            }
+            break;
+        case PROTOCOL_BINARY_CMD_DELETE:
+            if (keylen > 0 && extlen == 0 && bodylen == keylen) {
+                bin_read_key(c, bin_reading_del_header, extlen);
+            } else {
+                protocol_error = 1;
+            }
+            break;
+        case PROTOCOL_BINARY_CMD_INCREMENT:
+        case PROTOCOL_BINARY_CMD_DECREMENT:
+            if (keylen > 0 && extlen == 20 && bodylen == (keylen + extlen)) {
+                bin_read_key(c, bin_reading_incr_header, 20);
+            } else {
+                protocol_error = 1;
+            }
+            break;
+        case PROTOCOL_BINARY_CMD_APPEND:
+        case PROTOCOL_BINARY_CMD_PREPEND:
+            if (keylen > 0 && extlen == 0) {
+                bin_read_key(c, bin_reading_set_header, 0);
+            } else {
+                protocol_error = 1;
+            }
+            break;
+        case PROTOCOL_BINARY_CMD_STAT:
+            if (extlen == 0) {
+                bin_read_key(c, bin_reading_stat, 0);
+            } else {
+                protocol_error = 1;
+            }
+            break;
+        case PROTOCOL_BINARY_CMD_QUIT:
+            if (keylen == 0 && extlen == 0 && bodylen == 0) {
+                write_bin_response(c, NULL, 0, 0, 0);
+                c->write_and_go = conn_closing;
+                if (c->noreply) {
+                    conn_set_state(c, conn_closing);
+                }
+            } else {
+                protocol_error = 1;
+            }
+            break;
+        case PROTOCOL_BINARY_CMD_GETATTR:
+            if (keylen > 0 && extlen == (sizeof(bkey_t)+24) && bodylen == (keylen + extlen)) {
+                bin_read_key(c, bin_reading_getattr, (sizeof(bkey_t)+24));
+            } else {
+                protocol_error = 1;
+            }
+            break;
+        case PROTOCOL_BINARY_CMD_SETATTR:
+            if (keylen > 0 && extlen == (sizeof(bkey_t)+12) && bodylen == (keylen + extlen)) {
+                bin_read_key(c, bin_reading_setattr, (sizeof(bkey_t)+12));
+            } else {
+                protocol_error = 1;
+            }
+            break;
+        case PROTOCOL_BINARY_CMD_LOP_CREATE:
+            if (keylen > 0 && extlen == 16 && bodylen == (keylen + extlen)) {
+                bin_read_key(c, bin_reading_lop_create, 16);
+            } else {
+                protocol_error = 1;
+            }
+            break;
+        case PROTOCOL_BINARY_CMD_LOP_INSERT:
+            if (keylen > 0 && extlen == 20 && bodylen > (keylen + extlen)) {
+                bin_read_key(c, bin_reading_lop_prepare_nread, 20);
+            } else {
+                protocol_error = 1;
+            }
+            break;
+        case PROTOCOL_BINARY_CMD_LOP_DELETE:
+            if (keylen > 0 && extlen == 12 && bodylen == (keylen + extlen)) {
+                bin_read_key(c, bin_reading_lop_delete, 12);
+            } else {
+                protocol_error = 1;
+            }
+            break;
+        case PROTOCOL_BINARY_CMD_LOP_GET:
+            if (keylen > 0 && extlen == 12 && bodylen == (keylen + extlen)) {
+                bin_read_key(c, bin_reading_lop_get, 12);
+            } else {
+                protocol_error = 1;
+            }
+            break;
+        case PROTOCOL_BINARY_CMD_SOP_CREATE:
+            if (keylen > 0 && extlen == 16 && bodylen == (keylen + extlen)) {
+                bin_read_key(c, bin_reading_sop_create, 16);
+            } else {
+                protocol_error = 1;
+            }
+            break;
+        case PROTOCOL_BINARY_CMD_SOP_INSERT:
+            if (keylen > 0 && extlen == 16 && bodylen > (keylen + extlen)) {
+                bin_read_key(c, bin_reading_sop_prepare_nread, 16);
+            } else {
+                protocol_error = 1;
+            }
+            break;
+        case PROTOCOL_BINARY_CMD_SOP_DELETE:
+            if (keylen > 0 && extlen == 4 && bodylen > (keylen + extlen)) {
+                bin_read_key(c, bin_reading_sop_prepare_nread, 4);
+            } else {
+                protocol_error = 1;
+            }
+            break;
+        case PROTOCOL_BINARY_CMD_SOP_EXIST:
+            if (keylen > 0 && extlen == 0 && bodylen > (keylen + extlen)) {
+                bin_read_key(c, bin_reading_sop_prepare_nread, 0);
+            } else {
+                protocol_error = 1;
+            }
+            break;
+        case PROTOCOL_BINARY_CMD_SOP_GET:
+            if (keylen > 0 && extlen == 8 && bodylen == (keylen + extlen)) {
+                bin_read_key(c, bin_reading_sop_get, 8);
+            } else {
+                protocol_error = 1;
+            }
+            break;
+        case PROTOCOL_BINARY_CMD_MOP_CREATE:
+            if (keylen > 0 && extlen == 16 && bodylen == (keylen + extlen)) {
+                bin_read_key(c, bin_reading_mop_create, 16);
+            } else {
+                protocol_error = 1;
+            }
+            break;
+        case PROTOCOL_BINARY_CMD_MOP_INSERT:
+            if (keylen > 0 && extlen == 16 && bodylen > (keylen + extlen)) {
+                bin_read_key(c, bin_reading_mop_prepare_nread, 16);
+            } else {
+                protocol_error = 1;
+            }
+            break;
+        case PROTOCOL_BINARY_CMD_MOP_UPDATE:
+            if (keylen > 0 && extlen == 4 && bodylen > (keylen + extlen)) {
+                bin_read_key(c, bin_reading_mop_prepare_nread, 4);
+            } else {
+                protocol_error = 1;
+            }
+            break;
+        case PROTOCOL_BINARY_CMD_MOP_DELETE:
+        case PROTOCOL_BINARY_CMD_MOP_GET:
+            if (keylen > 0 && extlen == 8 && bodylen >= (keylen + extlen)) {
+                bin_read_key(c, bin_reading_mop_prepare_nread, 8);
+            } else {
+                protocol_error = 1;
+            }
+            break;
+        case PROTOCOL_BINARY_CMD_BOP_CREATE:
+            if (keylen > 0 && extlen == 16 && bodylen == (keylen + extlen)) {
+                bin_read_key(c, bin_reading_bop_create, 16);
+            } else {
+                protocol_error = 1;
+            }
+            break;
+        case PROTOCOL_BINARY_CMD_BOP_INSERT:
+        case PROTOCOL_BINARY_CMD_BOP_UPSERT:
+            if (keylen > 0 && extlen == (MAX_BKEY_LENG+1+MAX_EFLAG_LENG+1+16) && bodylen > (keylen + extlen)) {
+                bin_read_key(c, bin_reading_bop_prepare_nread, (MAX_BKEY_LENG+1+MAX_EFLAG_LENG+1+16));
+            } else {
+                protocol_error = 1;
+            }
+            break;
+        case PROTOCOL_BINARY_CMD_BOP_UPDATE:
+            if (keylen > 0 && extlen == (MAX_BKEY_LENG+1+MAX_EFLAG_LENG+1+8) && bodylen > (keylen + extlen)) {
+                bin_read_key(c, bin_reading_bop_update_prepare_nread, (MAX_BKEY_LENG+1+MAX_EFLAG_LENG+1+8));
+            } else {
+                protocol_error = 1;
+            }
+            break;
+        case PROTOCOL_BINARY_CMD_BOP_DELETE:
+            if (keylen > 0 && extlen == (sizeof(bkey_range)+sizeof(eflag_filter)+8) && bodylen == (keylen + extlen)) {
+                bin_read_key(c, bin_reading_bop_delete, (sizeof(bkey_range)+sizeof(eflag_filter)+8));
+            } else {
+                protocol_error = 1;
+            }
+            break;
+        case PROTOCOL_BINARY_CMD_BOP_GET:
+            if (keylen > 0 && extlen == (sizeof(bkey_range)+sizeof(eflag_filter)+12) && bodylen == (keylen + extlen)) {
+                bin_read_key(c, bin_reading_bop_get, (sizeof(bkey_range)+sizeof(eflag_filter)+12));
+            } else {
+                protocol_error = 1;
+            }
+            break;
+        case PROTOCOL_BINARY_CMD_BOP_COUNT:
+            if (keylen > 0 && extlen == (sizeof(bkey_range)+sizeof(eflag_filter)) && bodylen == (keylen + extlen)) {
+                bin_read_key(c, bin_reading_bop_count, (sizeof(bkey_range)+sizeof(eflag_filter)));
+            } else {
+                protocol_error = 1;
+            }
+            break;
+#if defined(SUPPORT_BOP_MGET) || defined(SUPPORT_BOP_SMGET)
+#ifdef SUPPORT_BOP_MGET
+        case PROTOCOL_BINARY_CMD_BOP_MGET:
+#endif
+#ifdef SUPPORT_BOP_SMGET
+        case PROTOCOL_BINARY_CMD_BOP_SMGET:
+#endif
+            if (keylen > 0 && extlen == (sizeof(bkey_range)+sizeof(eflag_filter)+12) && bodylen > (keylen + extlen)) {
+                bin_read_key(c, bin_reading_bop_prepare_nread_keys, (sizeof(bkey_range)+sizeof(eflag_filter)+12));
+            } else {
+                protocol_error = 1;
+            }
+            break;
+#endif
+#ifdef SASL_ENABLED
+        case PROTOCOL_BINARY_CMD_SASL_LIST_MECHS:
+            if (extlen == 0 && keylen == 0 && bodylen == 0) {
+                bin_list_sasl_mechs(c);
+            } else {
+                protocol_error = 1;
+            }
+            break;
+        case PROTOCOL_BINARY_CMD_SASL_AUTH:
+        case PROTOCOL_BINARY_CMD_SASL_STEP:
+            if (extlen == 0 && keylen != 0) {
+                bin_read_key(c, bin_reading_sasl_auth, 0);
+            } else {
+                protocol_error = 1;
+            }
+            break;
+#endif
+        default:
+            if (mc_engine.v1->unknown_command == NULL) {
+                write_bin_packet(c, PROTOCOL_BINARY_RESPONSE_UNKNOWN_COMMAND,
+                                bodylen);
+            } else {
+                bin_read_chunk(c, bin_reading_packet, c->binary_header.request.bodylen);
+            }
+    }
+
+    if (protocol_error)
+        handle_binary_protocol_error(c);
+}
+
+static void process_bin_update(conn *c) {
+    assert(c != NULL);
+
+    char *key;
+    item *it;
+    protocol_binary_request_set* req = binary_get_request(c);
+    key = binary_get_key(c);
+    uint32_t nkey = c->binary_header.request.keylen;
+    uint32_t vlen = 0;
+
+    /* fix byteorder in the request */
+    req->message.body.flags = req->message.body.flags;
+    req->message.body.expiration = ntohl(req->message.body.expiration);
+
+    if (nkey + c->binary_header.request.extlen <= c->binary_header.request.bodylen) {
+        vlen = c->binary_header.request.bodylen - (nkey + c->binary_header.request.extlen);
+    } else {
+        handle_binary_protocol_error(c);
+        return;
+    }
+
+    if (settings.verbose > 1) {
+        char buffer[1024];
+        const char *prefix;
+        if (c->cmd == PROTOCOL_BINARY_CMD_ADD) {
+            prefix = "ADD";
+        } else if (c->cmd == PROTOCOL_BINARY_CMD_SET) {
+            prefix = "SET";
+        } else {
+            prefix = "REPLACE";
+        }
+
+        size_t nw;
+        nw = key_to_printable_buffer(buffer, sizeof(buffer), c->sfd, true,
+                                     prefix, key, nkey);
+
+        if (nw != -1) {
+            if (snprintf(buffer + nw, sizeof(buffer) - nw,
+                         " Value len is %d\n", vlen)) {
+                mc_logger->log(EXTENSION_LOG_DEBUG, c, "%s", buffer);
+            }
+        }
+    }
+
+    if (settings.detail_enabled) {
+        stats_prefix_record_set(key, nkey);
+    }
+
+    ENGINE_ERROR_CODE ret;
+    ret = mc_engine.v1->allocate(mc_engine.v0, c, &it, key, nkey, vlen+2,
+                                 req->message.body.flags,
+                                 realtime(req->message.body.expiration),
+                                 c->binary_header.request.cas);
+    if (ret == ENGINE_SUCCESS && !mc_engine.v1->get_item_info(mc_engine.v0,
+                                                              c, it, &c->hinfo)) {
+        mc_engine.v1->release(mc_engine.v0, c, it);
+        write_bin_packet(c, PROTOCOL_BINARY_RESPONSE_EINTERNAL, 0);
+        return;
+    }
+
+    switch (ret) {
+    case ENGINE_SUCCESS:
+        switch (c->cmd) {
+        case PROTOCOL_BINARY_CMD_ADD:
+            c->store_op = OPERATION_ADD;
+            break;
+        case PROTOCOL_BINARY_CMD_SET:
+            c->store_op = OPERATION_SET;
+            break;
+        case PROTOCOL_BINARY_CMD_REPLACE:
+            c->store_op = OPERATION_REPLACE;
+            break;
+        default:
+            assert(0);
+        }
+
+        if (c->binary_header.request.cas != 0) {
+            c->store_op = OPERATION_CAS;
+        }
+
+        c->item = it;
+        ritem_set_first(c, CONN_RTYPE_HINFO, vlen);
+        conn_set_state(c, conn_nread);
+        c->substate = bin_read_set_value;
+        break;
+    case ENGINE_DISCONNECT:
+        c->state = conn_closing;
+        break;
+    default:
+        if (ret == ENGINE_E2BIG) {
+            write_bin_packet(c, PROTOCOL_BINARY_RESPONSE_E2BIG, vlen);
+        } else {
+            write_bin_packet(c, PROTOCOL_BINARY_RESPONSE_ENOMEM, vlen);
+        }
+
+        /*
+         * Avoid stale data persisting in cache because we failed alloc.
+         * Unacceptable for SET (but only if cas matches).
+         * Anywhere else too?
+         */
+        if (c->cmd == PROTOCOL_BINARY_CMD_SET) {
+            /* @todo fix this for the ASYNC interface! */
+            mc_engine.v1->remove(mc_engine.v0, c, key, nkey,
+                                 ntohll(req->message.header.request.cas),
+                                 c->binary_header.request.vbucket);
+        }
+
+        /* swallow the data line */
+        c->write_and_go = conn_swallow;
+    }
+}
+
+static void process_bin_append_prepend(conn *c) {
+    assert(c != NULL);
+
+    char *key;
+    item *it;
+    uint32_t nkey = c->binary_header.request.keylen;
+    uint32_t vlen = 0;
+
+    key = binary_get_key(c);
+    nkey = c->binary_header.request.keylen;
+    if (nkey <= c->binary_header.request.bodylen) {
+        vlen = c->binary_header.request.bodylen - nkey;
+    } else {
+        handle_binary_protocol_error(c);
+        return;
+    }
+
+    if (settings.detail_enabled) {
+        stats_prefix_record_set(key, nkey);
+    }
+
+    ENGINE_ERROR_CODE ret;
+    ret = mc_engine.v1->allocate(mc_engine.v0, c, &it, key, nkey, vlen+2,
+                                 0, 0, c->binary_header.request.cas);
+    if (ret == ENGINE_SUCCESS && !mc_engine.v1->get_item_info(mc_engine.v0,
+                                                              c, it, &c->hinfo)) {
+        mc_engine.v1->release(mc_engine.v0, c, it);
+        write_bin_packet(c, PROTOCOL_BINARY_RESPONSE_EINTERNAL, 0);
+        return;
+    }
+
+    switch (ret) {
+    case ENGINE_SUCCESS:
+        switch (c->cmd) {
+        case PROTOCOL_BINARY_CMD_APPEND:
+            c->store_op = OPERATION_APPEND;
+            break;
+        case PROTOCOL_BINARY_CMD_PREPEND:
+            c->store_op = OPERATION_PREPEND;
+            break;
+        default:
+            assert(0);
+        }
+
+        c->item = it;
+        ritem_set_first(c, CONN_RTYPE_HINFO, vlen);
+        conn_set_state(c, conn_nread);
+        c->substate = bin_read_set_value;
+        break;
+    case ENGINE_DISCONNECT:
+        c->state = conn_closing;
+        break;
+    default:
+        if (ret == ENGINE_E2BIG) {
+            write_bin_packet(c, PROTOCOL_BINARY_RESPONSE_E2BIG, vlen);
+        } else {
+            write_bin_packet(c, PROTOCOL_BINARY_RESPONSE_ENOMEM, vlen);
+        }
+        /* swallow the data line */
+        c->write_and_go = conn_swallow;
+    }
+}
+
+static void process_bin_flush(conn *c) {
+    protocol_binary_request_flush* req = binary_get_request(c);
+    time_t exptime = 0;
+    ENGINE_ERROR_CODE ret = ENGINE_SUCCESS;
+
+    if (c->binary_header.request.extlen == sizeof(req->message.body)) {
+        exptime = ntohl(req->message.body.expiration);
+        if (exptime < 0) {
+            ret = ENGINE_EINVAL;
+        }
+    }
+
+    if (settings.verbose > 1) {
+        mc_logger->log(EXTENSION_LOG_DEBUG, c,
+                       "%d: flush %ld", c->sfd, (long)exptime);
+    }
+
+    if (ret == ENGINE_SUCCESS) {
+        ret = mc_engine.v1->flush(mc_engine.v0, c, NULL, -1, realtime(exptime));
+        if (ret == ENGINE_EWOULDBLOCK) {
+            c->ewouldblock = true;
+            ret = ENGINE_SUCCESS;
+        }
+    }
+
+    if (ret == ENGINE_SUCCESS) {
+        write_bin_response(c, NULL, 0, 0, 0);
+    } else if (ret == ENGINE_ENOTSUP) {
+        write_bin_packet(c, PROTOCOL_BINARY_RESPONSE_NOT_SUPPORTED, 0);
+    } else {
+        write_bin_packet(c, PROTOCOL_BINARY_RESPONSE_EINVAL, 0);
+    }
+    STATS_NOKEY(c, cmd_flush);
+}
+
+static void process_bin_flush_prefix(conn *c) {
+    protocol_binary_request_flush_prefix *req = binary_get_request(c);
+    char *prefix = binary_get_key(c);
+    size_t nprefix = c->binary_header.request.keylen;
+    time_t exptime = 0;
+    ENGINE_ERROR_CODE ret = ENGINE_SUCCESS;
+
+    if (c->binary_header.request.extlen == sizeof(req->message.body)) {
+        exptime = ntohl(req->message.body.expiration);
+        if (exptime < 0) {
+            ret = ENGINE_EINVAL;
+        }
+    }
+
+    if (settings.verbose > 1) {
+        char buffer[1024];
+        if (key_to_printable_buffer(buffer, sizeof(buffer), c->sfd, true, "FLUSH_PREFIX", prefix, nprefix) != -1) {
+            mc_logger->log(EXTENSION_LOG_DEBUG, c, "%s %ld\n", buffer, (long)exptime);
+        }
+    }
+
+    if (nprefix == 6 && strncmp(prefix, "<null>", 6) == 0) {
+        /* flush null prefix */
+        prefix = NULL;
+        nprefix = 0;
+    }
+
+    if (ret == ENGINE_SUCCESS) {
+        ret = mc_engine.v1->flush(mc_engine.v0, c, prefix, nprefix, realtime(exptime));
+        if (ret == ENGINE_EWOULDBLOCK) {
+            c->ewouldblock = true;
+            ret = ENGINE_SUCCESS;
+        }
+    }
+
+    if (settings.detail_enabled) {
+        if (ret == ENGINE_SUCCESS || ret == ENGINE_PREFIX_ENOENT) {
+            if (stats_prefix_delete(prefix, nprefix) == 0) { /* found */
+                ret = ENGINE_SUCCESS;
+            }
+        }
+    }
+
+    switch (ret) {
+    case ENGINE_SUCCESS:
+        write_bin_response(c, NULL, 0, 0, 0);
+        break;
+    case ENGINE_DISCONNECT:
+        c->state = conn_closing;
+        break;
+    case ENGINE_PREFIX_ENOENT:
+        write_bin_packet(c, PROTOCOL_BINARY_RESPONSE_PREFIX_ENOENT, 0);
+        break;
+    case ENGINE_ENOTSUP:
+        write_bin_packet(c, PROTOCOL_BINARY_RESPONSE_NOT_SUPPORTED, 0);
+        break;
+    default:
+        write_bin_packet(c, PROTOCOL_BINARY_RESPONSE_EINVAL, 0);
+        break;
+    }
+
+    STATS_NOKEY(c, cmd_flush_prefix);
+    return;
+}
+
+static void process_bin_delete(conn *c) {
+    protocol_binary_request_delete* req = binary_get_request(c);
+
+    char* key = binary_get_key(c);
+    size_t nkey = c->binary_header.request.keylen;
+
+    assert(c != NULL);
+
+    if (settings.verbose > 1) {
+        char buffer[1024];
+        if (key_to_printable_buffer(buffer, sizeof(buffer), c->sfd, true,
+                                    "DELETE", key, nkey) != -1) {
+            mc_logger->log(EXTENSION_LOG_DEBUG, c, "%s\n", buffer);
+        }
+    }
+
+    ENGINE_ERROR_CODE ret;
+    ret = mc_engine.v1->remove(mc_engine.v0, c, key, nkey,
+                               ntohll(req->message.header.request.cas),
+                               c->binary_header.request.vbucket);
+    if (ret == ENGINE_EWOULDBLOCK) {
+        c->ewouldblock = true;
+        ret = ENGINE_SUCCESS;
+    }
+
+    if (settings.detail_enabled) {
+        stats_prefix_record_delete(key, nkey);
+    }
+
+    switch (ret) {
+    case ENGINE_SUCCESS:
+        write_bin_response(c, NULL, 0, 0, 0);
+        break;
+    case ENGINE_KEY_EEXISTS:
+        write_bin_packet(c, PROTOCOL_BINARY_RESPONSE_KEY_EEXISTS, 0);
+        break;
+    case ENGINE_KEY_ENOENT:
+        write_bin_packet(c, PROTOCOL_BINARY_RESPONSE_KEY_ENOENT, 0);
+        break;
+    case ENGINE_NOT_MY_VBUCKET:
+        write_bin_packet(c, PROTOCOL_BINARY_RESPONSE_NOT_MY_VBUCKET, 0);
+        break;
+    default:
+        write_bin_packet(c, PROTOCOL_BINARY_RESPONSE_EINVAL, 0);
+    }
+}
+
+static void complete_nread_binary(conn *c) {
+    assert(c != NULL);
+    assert(c->cmd >= 0);
+
+    switch(c->substate) {
+    case bin_reading_set_header:
+        if (c->cmd == PROTOCOL_BINARY_CMD_APPEND ||
+                c->cmd == PROTOCOL_BINARY_CMD_PREPEND) {
+            process_bin_append_prepend(c);
+        } else {
+            process_bin_update(c);
+        }
+        break;
+    case bin_read_set_value:
+        complete_update_bin(c);
+        break;
+    case bin_reading_get_key:
+        process_bin_get(c);
+        break;
+    case bin_reading_stat:
+        process_bin_stat(c);
+        break;
+    case bin_reading_del_header:
+        process_bin_delete(c);
+        break;
+    case bin_reading_incr_header:
+        complete_incr_bin(c);
+        break;
+    case bin_read_flush_exptime:
+        process_bin_flush(c);
+        break;
+    case bin_read_flush_prefix_exptime:
+        process_bin_flush_prefix(c);
+        break;
+    case bin_reading_sasl_auth:
+        process_bin_sasl_auth(c);
+        break;
+    case bin_reading_sasl_auth_data:
+        process_bin_complete_sasl_auth(c);
+        break;
+    case bin_reading_getattr:
+        process_bin_getattr(c);
+        break;
+    case bin_reading_setattr:
+        process_bin_setattr(c);
+        break;
+    case bin_reading_lop_create:
+        process_bin_lop_create(c);
+        break;
+    case bin_reading_lop_prepare_nread:
+        process_bin_lop_prepare_nread(c);
+        break;
+    case bin_reading_lop_nread_complete:
+        process_bin_lop_nread_complete(c);
+        break;
+    case bin_reading_lop_delete:
+        process_bin_lop_delete(c);
+        break;
+    case bin_reading_lop_get:
+        process_bin_lop_get(c);
+        break;
+    case bin_reading_sop_create:
+        process_bin_sop_create(c);
+        break;
+    case bin_reading_sop_prepare_nread:
+        process_bin_sop_prepare_nread(c);
+        break;
+    case bin_reading_sop_nread_complete:
+        process_bin_sop_nread_complete(c);
+        break;
+    case bin_reading_sop_get:
+        process_bin_sop_get(c);
+        break;
+    case bin_reading_mop_create:
+        process_bin_mop_create(c);
+        break;
+    case bin_reading_mop_prepare_nread:
+        process_bin_mop_prepare_nread(c);
+        break;
+    case bin_reading_mop_nread_field:
+        process_bin_mop_nread_field(c);
+        break;
+    case bin_reading_mop_nread_complete:
+        process_bin_mop_nread_complete(c);
+        break;
+    case bin_reading_bop_create:
+        process_bin_bop_create(c);
+        break;
+    case bin_reading_bop_prepare_nread:
+        process_bin_bop_prepare_nread(c);
+        break;
+    case bin_reading_bop_nread_complete:
+        process_bin_bop_nread_complete(c);
+        break;
+    case bin_reading_bop_update_prepare_nread:
+        process_bin_bop_update_prepare_nread(c);
+        break;
+    case bin_reading_bop_update_nread_complete:
+        process_bin_bop_update_complete(c);
+        break;
+    case bin_reading_bop_delete:
+        process_bin_bop_delete(c);
+        break;
+    case bin_reading_bop_get:
+        process_bin_bop_get(c);
+        break;
+    case bin_reading_bop_count:
+        process_bin_bop_count(c);
+        break;
+#if defined(SUPPORT_BOP_MGET) || defined(SUPPORT_BOP_SMGET)
+    case bin_reading_bop_prepare_nread_keys:
+        process_bin_bop_prepare_nread_keys(c);
+        break;
+    case bin_reading_bop_nread_keys_complete:
+        process_bin_bop_nread_keys_complete(c);
+        break;
+#endif
+    case bin_reading_packet:
+        process_bin_unknown_packet(c);
+        break;
+    default:
+        mc_logger->log(EXTENSION_LOG_WARNING, c,
+                "Not handling substate %d\n", c->substate);
+        abort();
+    }
+}
+
+static void reset_cmd_handler(conn *c) {
+    c->ascii_cmd = NULL;
+    c->cmd = -1;
+    c->substate = bin_no_state;
+    if(c->item != NULL) {
+        mc_engine.v1->release(mc_engine.v0, c, c->item);
+        c->item = NULL;
+    }
+#ifdef DETECT_LONG_QUERY
+    if (c->lq_bufcnt != 0) {
+        lqdetect_buffer_release(c->lq_bufcnt);
+        c->lq_bufcnt = 0;
+    }
+#endif
+    if (c->coll_eitem != NULL) {
+        conn_coll_eitem_free(c);
+    }
+    if (c->coll_strkeys != NULL) {
+        assert(c->coll_strkeys == (void*)&c->memblist);
+        mblck_list_free(&c->thread->mblck_pool, &c->memblist);
+        c->coll_strkeys = NULL;
+    }
+    conn_shrink(c);
+    if (c->rbytes > 0) {
+        conn_set_state(c, conn_parse_cmd);
+    } else {
+        conn_set_state(c, conn_waiting);
+    }
+}
+
+static bool ascii_response_handler(const void *cookie,
+                                   int nbytes,
+                                   const char *dta)
+{
+    conn *c = (conn*)cookie;
+    if (!grow_dynamic_buffer(c, nbytes)) {
+        if (settings.verbose > 0) {
+            mc_logger->log(EXTENSION_LOG_INFO, c,
+                    "<%d ERROR: Failed to allocate memory for response\n", c->sfd);
+        }
+        return false;
+    }
+
+    char *buf = c->dynamic_buffer.buffer + c->dynamic_buffer.offset;
+    memcpy(buf, dta, nbytes);
+    c->dynamic_buffer.offset += nbytes;
+
+    return true;
+}
+
+static void complete_nread_ascii(conn *c) {
+    if (c->ascii_cmd != NULL) {
+        if (!c->ascii_cmd->execute(c->ascii_cmd->cookie, c, 0, NULL,
+                                   ascii_response_handler)) {
+            conn_set_state(c, conn_closing);
+        } else if (c->dynamic_buffer.buffer != NULL) {
+            write_and_free(c, c->dynamic_buffer.buffer,
+                           c->dynamic_buffer.offset);
+            c->dynamic_buffer.buffer = NULL;
+        } else {
+            conn_set_state(c, conn_new_cmd);
+        }
+    } else {
+        complete_update_ascii(c);
+    }
+}
+
+static void complete_nread(conn *c)
+{
+    assert(c != NULL);
+    assert(c->protocol == ascii_prot || c->protocol == binary_prot);
+
+    if (c->protocol == ascii_prot) {
+        complete_nread_ascii(c);
+    } else {
+        complete_nread_binary(c);
+    }
+}
+
+#define COMMAND_TOKEN 0
+#define SUBCOMMAND_TOKEN 1
+#define PREFIX_TOKEN 1
+#define KEY_TOKEN 1
+#define LOP_KEY_TOKEN 2
+#define SOP_KEY_TOKEN 2
+#define MOP_KEY_TOKEN 2
+#define BOP_KEY_TOKEN 2
+
+#define MAX_TOKENS 30
+
+static void
+print_invalid_command(conn *c, token_t *tokens, const size_t ntokens)
+{
+    /* To understand this function's implementation,
+     * You must know how the command is tokenized.
+     * See tokenize_command().
+     */
+    if (ntokens >= 2) {
+        int i;
+        /* make single string */
+        for (i = 0; i < (ntokens-2); i++) {
+            tokens[i].value[tokens[i].length] = ' ';
+        }
+        mc_logger->log(EXTENSION_LOG_INFO, c, "[%s] INVALID_COMMAND: %s\n",
+                       c->client_ip, tokens[0].value);
+        /* restore the tokens */
+        for (i = 0; i < (ntokens-2); i++) {
+            tokens[i].value[tokens[i].length] = '\0';
+        }
+    }
+}
+
+/* set up a connection to write a buffer then free it, used for stats */
+static void write_and_free(conn *c, char *buf, int bytes) {
+    if (buf) {
+        c->write_and_free = buf;
+        c->wcurr = buf;
+        c->wbytes = bytes;
+        conn_set_state(c, conn_write);
+        c->write_and_go = conn_new_cmd;
+    } else {
+        out_string(c, "SERVER_ERROR out of memory writing stats");
+    }
+}
+
+#ifdef JHPARK_OLD_SMGET_INTERFACE
+static inline int set_smget_mode_maybe(conn *c, token_t *tokens, size_t ntokens)
+{
+    int mode_index = ntokens - 2;
+    int mode_value = 0;
+
+    if (tokens[mode_index].value) {
+        if (strcmp(tokens[mode_index].value, "duplicate") == 0)
+            mode_value = 1;
+        else if (strcmp(tokens[mode_index].value, "unique") == 0)
+            mode_value = 2;
+    }
+    return mode_value;
+}
+#else
+static inline bool set_unique_maybe(conn *c, token_t *tokens, size_t ntokens)
+{
+    int unique_index = ntokens - 2;
+
+    if (tokens[unique_index].value
+        && strcmp(tokens[unique_index].value, "unique") == 0)
+        return true;
+    else
+        return false;
+}
+#endif
+
+static inline bool set_noreply_maybe(conn *c, token_t *tokens, size_t ntokens)
+{
+    int noreply_index = ntokens - 2;
+
+    /*
+      NOTE: this function is not the first place where we are going to
+      send the reply.  We could send it instead from process_command()
+      if the request line has wrong number of tokens.  However parsing
+      malformed line for "noreply" option is not reliable anyway, so
+      it can't be helped.
+    */
+    if (tokens[noreply_index].value
+        && strcmp(tokens[noreply_index].value, "noreply") == 0) {
+        c->noreply = true;
+    }
+    return c->noreply;
+}
+
+static inline bool set_pipe_noreply_maybe(conn *c, token_t *tokens, size_t ntokens)
+{
+    int noreply_index = ntokens - 2;
+
+    /*
+      NOTE: this function is not the first place where we are going to
+      send the reply.  We could send it instead from process_command()
+      if the request line has wrong number of tokens.  However parsing
+      malformed line for "noreply" or "pipe" option is not reliable anyway,
+      so it can't be helped.
+    */
+    if (tokens[noreply_index].value) {
+        if (strcmp(tokens[noreply_index].value, "noreply") == 0) {
+            c->noreply = true;
+        } else if (strcmp(tokens[noreply_index].value, "pipe") == 0) {
+            c->noreply = true;
+            if (unlikely(c->pipe_state == PIPE_STATE_OFF))
+                c->pipe_state = PIPE_STATE_ON;
+        }
+    }
+    return c->noreply;
+}
+
+static inline bool set_pipe_maybe(conn *c, token_t *tokens, size_t ntokens)
+{
+    int noreply_index = ntokens - 2;
+
+    /*
+      NOTE: this function is not the first place where we are going to
+      send the reply.  We could send it instead from process_command()
+      if the request line has wrong number of tokens.  However parsing
+      malformed line for "pipe" option is not reliable anyway,
+      so it can't be helped.
+    */
+    if (tokens[noreply_index].value) {
+        if (strcmp(tokens[noreply_index].value, "pipe") == 0) {
+            c->noreply = true;
+            if (unlikely(c->pipe_state == PIPE_STATE_OFF))
+                c->pipe_state = PIPE_STATE_ON;
+        }
+    }
+    return c->noreply;
+}
+
+static bool check_and_handle_pipe_state(conn *c, size_t swallow)
+{
+    if (c->pipe_state == PIPE_STATE_OFF || c->pipe_state == PIPE_STATE_ON) {
+        return true;
+    } else {
+        assert(c->pipe_state == PIPE_STATE_ERR_CFULL ||
+               c->pipe_state == PIPE_STATE_ERR_MFULL ||
+               c->pipe_state == PIPE_STATE_ERR_BAD);
+        if (c->noreply == true) {
+            c->noreply = false; /* reset noreply */
+        } else  {
+            /* The last command of pipelining has come. */
+            /* clear pipe_state: the end of pipe */
+            c->pipe_state = PIPE_STATE_OFF;
+            c->pipe_count = 0;
+        }
+        if (swallow > 0) {
+            c->sbytes = swallow;
+            conn_set_state(c, conn_swallow);
+        }
+        return false;
+    }
+}
+
+void append_stat(const char *name, ADD_STAT add_stats, conn *c,
+                 const char *fmt, ...) {
+    char val_str[STAT_VAL_LEN];
+    int vlen;
+    va_list ap;
+
+    assert(name);
+    assert(add_stats);
+    assert(c);
+    assert(fmt);
+
+    va_start(ap, fmt);
+    vlen = vsnprintf(val_str, sizeof(val_str) - 1, fmt, ap);
+    va_end(ap);
+
+    add_stats(name, strlen(name), val_str, vlen, c);
+}
+
+inline static void process_stats_detail(conn *c, const char *command) {
+    assert(c != NULL);
+
+    if (settings.allow_detailed) {
+        if (strcmp(command, "on") == 0) {
+            settings.detail_enabled = 1;
+            out_string(c, "OK");
+        }
+        else if (strcmp(command, "off") == 0) {
+            settings.detail_enabled = 0;
+            out_string(c, "OK");
+        }
+        else if (strcmp(command, "dump") == 0) {
+            int len;
+            char *stats = stats_prefix_dump(&len);
+            write_and_free(c, stats, len);
+        }
+        else {
+            out_string(c, "CLIENT_ERROR usage: stats detail on|off|dump");
+        }
+    }
+    else {
+        out_string(c, "CLIENT_ERROR detailed stats disabled");
+    }
+}
+
+static void process_stats_prefix(conn *c, const char *prefix, const int nprefix) {
+    assert(c != NULL);
+    ENGINE_ERROR_CODE ret;
+
+    if (nprefix < 0) {
+        char *prefix_data;
+        ret = mc_engine.v1->get_prefix_stats(mc_engine.v0, c, prefix, nprefix, &prefix_data);
+        switch (ret) {
+            case ENGINE_SUCCESS:
+                c->write_and_free = prefix_data;
+                c->wcurr  = prefix_data + sizeof(uint32_t);
+                c->wbytes = *(uint32_t*)prefix_data;
+                conn_set_state(c, conn_write);
+                c->write_and_go = conn_new_cmd;
+                break;
+            case ENGINE_DISCONNECT:
+                c->state = conn_closing;
+                break;
+            case ENGINE_ENOMEM:
+                out_string(c, "SERVER_ERROR no more memory");
+                break;
+            default:
+                out_string(c, "PREFIX_ERROR");
+        }
+    } else {
+        /****** SPEC-OUT FUNCTIONS **********
+        prefix_engine_stats prefix_data;
+        if (nprefix > PREFIX_MAX_LENGTH) {
+            out_string(c, "CLIENT_ERROR too long prefix name");
+            return;
+        }
+        ret = mc_engine.v1->get_prefix_stats(mc_engine.v0, c, prefix, nprefix, &prefix_data);
+        switch (ret) {
+            case ENGINE_SUCCESS:
+                {
+                char buffer[1024];
+                char *str = &buffer[0];
+                *str = '\0';
+                sprintf(str, "PREFIX name=%s\r\n", (prefix == NULL ? "<null>" : prefix));
+                sprintf(str+strlen(str), "PREFIX hash_items=%"PRIu64"\r\n", prefix_data.hash_items);
+                sprintf(str+strlen(str), "PREFIX hash_items_bytes=%"PRIu64"\r\n", prefix_data.hash_items_bytes);
+                sprintf(str+strlen(str), "PREFIX prefix_items=%u\r\n", prefix_data.prefix_items);
+                sprintf(str+strlen(str), "PREFIX tot_prefix_items=%u\r\n", prefix_data.tot_prefix_items);
+                sprintf(str+strlen(str), "END");
+                out_string(c, str);
+                }
+                break;
+            case ENGINE_DISCONNECT:
+                c->state = conn_closing;
+                break;
+            case ENGINE_PREFIX_ENOENT:
+                out_string(c, "NOT_FOUND");
+                break;
+            default:
+                out_string(c, "PREFIX_ERROR");
+        }
+        ************************************/
+    }
+    return;
+}
+
+static void aggregate_callback(void *in, void *out) {
+    struct thread_stats *out_thread_stats = out;
+    struct independent_stats *in_independent_stats = in;
+    threadlocal_stats_aggregate(in_independent_stats->thread_stats,
+                                out_thread_stats);
+}
+
+/* return server specific stats only */
+static void server_stats(ADD_STAT add_stats, conn *c, bool aggregate) {
+    pid_t pid = getpid();
+    rel_time_t now = current_time;
+
+    struct thread_stats thread_stats;
+    threadlocal_stats_clear(&thread_stats);
+
+    if (aggregate && mc_engine.v1->aggregate_stats != NULL) {
+        mc_engine.v1->aggregate_stats(mc_engine.v0, (const void *)c,
+                                      aggregate_callback, &thread_stats);
+    } else {
+        threadlocal_stats_aggregate(get_independent_stats(c)->thread_stats,
+                                    &thread_stats);
+    }
+
+    struct slab_stats slab_stats;
+    slab_stats_aggregate(&thread_stats, &slab_stats);
+
+#ifndef __WIN32__
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+#endif
+
+#ifdef ENABLE_ZK_INTEGRATION
+    arcus_zk_stats zk_stats;
+    arcus_zk_get_stats(&zk_stats);
+#endif
+
+    STATS_LOCK();
+
+    APPEND_STAT("pid", "%lu", (long)pid);
+    APPEND_STAT("uptime", "%u", now);
+    APPEND_STAT("time", "%ld", now + (long)process_started);
+    APPEND_STAT("version", "%s", VERSION);
+    APPEND_STAT("libevent", "%s", event_get_version());
+    APPEND_STAT("pointer_size", "%d", (int)(8 * sizeof(void *)));
+#ifdef ENABLE_ZK_INTEGRATION
+    APPEND_STAT("zk_connected", "%s", zk_stats.zk_connected ? "true" : "false");
+    APPEND_STAT("zk_failstop", "%s", zk_stats.zk_failstop ? "on" : "off");
+    APPEND_STAT("zk_timeout", "%u", zk_stats.zk_timeout);
+    APPEND_STAT("hb_timeout", "%u", zk_stats.hb_timeout);
+    APPEND_STAT("hb_failstop", "%u", zk_stats.hb_failstop);
+    APPEND_STAT("hb_count", "%"PRIu64, zk_stats.hb_count);
+    APPEND_STAT("hb_latency", "%"PRIu64, zk_stats.hb_latency);
+#endif
+
+#ifndef __WIN32__
+    append_stat("rusage_user", add_stats, c, "%ld.%06ld",
+                (long)usage.ru_utime.tv_sec,
+                (long)usage.ru_utime.tv_usec);
+    append_stat("rusage_system", add_stats, c, "%ld.%06ld",
+                (long)usage.ru_stime.tv_sec,
+                (long)usage.ru_stime.tv_usec);
+#endif
+
+    APPEND_STAT("daemon_connections", "%u", mc_stats.daemon_conns);
+    APPEND_STAT("curr_connections", "%u", mc_stats.curr_conns);
+    APPEND_STAT("quit_connections", "%u", mc_stats.quit_conns);
+    APPEND_STAT("reject_connections", "%u", mc_stats.rejected_conns);
+    APPEND_STAT("total_connections", "%u", mc_stats.total_conns);
+    APPEND_STAT("connection_structures", "%u", mc_stats.conn_structs);
+    APPEND_STAT("cmd_get", "%"PRIu64, thread_stats.cmd_get);
+    APPEND_STAT("cmd_set", "%"PRIu64, slab_stats.cmd_set);
+    APPEND_STAT("cmd_incr", "%"PRIu64, thread_stats.cmd_incr);
+    APPEND_STAT("cmd_decr", "%"PRIu64, thread_stats.cmd_decr);
+    APPEND_STAT("cmd_delete", "%"PRIu64, thread_stats.cmd_delete);
+    APPEND_STAT("cmd_flush", "%"PRIu64, thread_stats.cmd_flush);
+    APPEND_STAT("cmd_flush_prefix", "%"PRIu64, thread_stats.cmd_flush_prefix);
+    APPEND_STAT("cmd_cas", "%"PRIu64, thread_stats.cmd_cas);
+    APPEND_STAT("cmd_lop_create", "%"PRIu64, thread_stats.cmd_lop_create);
+    APPEND_STAT("cmd_lop_insert", "%"PRIu64, thread_stats.cmd_lop_insert);
+    APPEND_STAT("cmd_lop_delete", "%"PRIu64, thread_stats.cmd_lop_delete);
+    APPEND_STAT("cmd_lop_get", "%"PRIu64, thread_stats.cmd_lop_get);
+    APPEND_STAT("cmd_sop_create", "%"PRIu64, thread_stats.cmd_sop_create);
+    APPEND_STAT("cmd_sop_insert", "%"PRIu64, thread_stats.cmd_sop_insert);
+    APPEND_STAT("cmd_sop_delete", "%"PRIu64, thread_stats.cmd_sop_delete);
+    APPEND_STAT("cmd_sop_get", "%"PRIu64, thread_stats.cmd_sop_get);
+    APPEND_STAT("cmd_sop_exist", "%"PRIu64, thread_stats.cmd_sop_exist);
+    APPEND_STAT("cmd_mop_create", "%"PRIu64, thread_stats.cmd_mop_create);
+    APPEND_STAT("cmd_mop_insert", "%"PRIu64, thread_stats.cmd_mop_insert);
+    APPEND_STAT("cmd_mop_update", "%"PRIu64, thread_stats.cmd_mop_update);
+    APPEND_STAT("cmd_mop_delete", "%"PRIu64, thread_stats.cmd_mop_delete);
+    APPEND_STAT("cmd_mop_get", "%"PRIu64, thread_stats.cmd_mop_get);
+    APPEND_STAT("cmd_mop_incr", "%"PRIu64, thread_stats.cmd_mop_incr);
+    APPEND_STAT("cmd_mop_decr", "%"PRIu64, thread_stats.cmd_mop_decr);
+    APPEND_STAT("cmd_bop_create", "%"PRIu64, thread_stats.cmd_bop_create);
+    APPEND_STAT("cmd_bop_insert", "%"PRIu64, thread_stats.cmd_bop_insert);
+    APPEND_STAT("cmd_bop_update", "%"PRIu64, thread_stats.cmd_bop_update);
+    APPEND_STAT("cmd_bop_delete", "%"PRIu64, thread_stats.cmd_bop_delete);
+    APPEND_STAT("cmd_bop_get", "%"PRIu64, thread_stats.cmd_bop_get);
+    APPEND_STAT("cmd_bop_count", "%"PRIu64, thread_stats.cmd_bop_count);
+    APPEND_STAT("cmd_bop_position", "%"PRIu64, thread_stats.cmd_bop_position);
+    APPEND_STAT("cmd_bop_pwg", "%"PRIu64, thread_stats.cmd_bop_pwg);
+    APPEND_STAT("cmd_bop_gbp", "%"PRIu64, thread_stats.cmd_bop_gbp);
+#ifdef SUPPORT_BOP_MGET
+    APPEND_STAT("cmd_bop_mget", "%"PRIu64, thread_stats.cmd_bop_mget);
+#endif
+#ifdef SUPPORT_BOP_SMGET
+    APPEND_STAT("cmd_bop_smget", "%"PRIu64, thread_stats.cmd_bop_smget);
+#endif
+    APPEND_STAT("cmd_bop_incr", "%"PRIu64, thread_stats.cmd_bop_incr);
+    APPEND_STAT("cmd_bop_decr", "%"PRIu64, thread_stats.cmd_bop_decr);
+    APPEND_STAT("cmd_getattr", "%"PRIu64, thread_stats.cmd_getattr);
+    APPEND_STAT("cmd_setattr", "%"PRIu64, thread_stats.cmd_setattr);
+    APPEND_STAT("auth_cmds", "%"PRIu64, thread_stats.auth_cmds);
+    APPEND_STAT("auth_errors", "%"PRIu64, thread_stats.auth_errors);
+    APPEND_STAT("get_hits", "%"PRIu64, slab_stats.get_hits);
+    APPEND_STAT("get_misses", "%"PRIu64, thread_stats.get_misses);
+    APPEND_STAT("delete_misses", "%"PRIu64, thread_stats.delete_misses);
+    APPEND_STAT("delete_hits", "%"PRIu64, slab_stats.delete_hits);
+    APPEND_STAT("incr_misses", "%"PRIu64, thread_stats.incr_misses);
+    APPEND_STAT("incr_hits", "%"PRIu64, thread_stats.incr_hits);
+    APPEND_STAT("decr_misses", "%"PRIu64, thread_stats.decr_misses);
+    APPEND_STAT("decr_hits", "%"PRIu64, thread_stats.decr_hits);
+    APPEND_STAT("cas_misses", "%"PRIu64, thread_stats.cas_misses);
+    APPEND_STAT("cas_hits", "%"PRIu64, slab_stats.cas_hits);
+    APPEND_STAT("cas_badval", "%"PRIu64, slab_stats.cas_badval);
+    APPEND_STAT("lop_create_oks", "%"PRIu64, thread_stats.lop_create_oks);
+    APPEND_STAT("lop_insert_misses", "%"PRIu64, thread_stats.lop_insert_misses);
+    APPEND_STAT("lop_insert_hits", "%"PRIu64, thread_stats.lop_insert_hits);
+    APPEND_STAT("lop_delete_misses", "%"PRIu64, thread_stats.lop_delete_misses);
+    APPEND_STAT("lop_delete_elem_hits", "%"PRIu64, thread_stats.lop_delete_elem_hits);
+    APPEND_STAT("lop_delete_none_hits", "%"PRIu64, thread_stats.lop_delete_none_hits);
+    APPEND_STAT("lop_get_misses", "%"PRIu64, thread_stats.lop_get_misses);
+    APPEND_STAT("lop_get_elem_hits", "%"PRIu64, thread_stats.lop_get_elem_hits);
+    APPEND_STAT("lop_get_none_hits", "%"PRIu64, thread_stats.lop_get_none_hits);
+    APPEND_STAT("sop_create_oks", "%"PRIu64, thread_stats.sop_create_oks);
+    APPEND_STAT("sop_insert_misses", "%"PRIu64, thread_stats.sop_insert_misses);
+    APPEND_STAT("sop_insert_hits", "%"PRIu64, thread_stats.sop_insert_hits);
+    APPEND_STAT("sop_delete_misses", "%"PRIu64, thread_stats.sop_delete_misses);
+    APPEND_STAT("sop_delete_elem_hits", "%"PRIu64, thread_stats.sop_delete_elem_hits);
+    APPEND_STAT("sop_delete_none_hits", "%"PRIu64, thread_stats.sop_delete_none_hits);
+    APPEND_STAT("sop_get_misses", "%"PRIu64, thread_stats.sop_get_misses);
+    APPEND_STAT("sop_get_elem_hits", "%"PRIu64, thread_stats.sop_get_elem_hits);
+    APPEND_STAT("sop_get_none_hits", "%"PRIu64, thread_stats.sop_get_none_hits);
+    APPEND_STAT("sop_exist_misses", "%"PRIu64, thread_stats.sop_exist_misses);
+    APPEND_STAT("sop_exist_hits", "%"PRIu64, thread_stats.sop_exist_hits);
+    APPEND_STAT("mop_create_oks", "%"PRIu64, thread_stats.mop_create_oks);
+    APPEND_STAT("mop_insert_misses", "%"PRIu64, thread_stats.mop_insert_misses);
+    APPEND_STAT("mop_insert_hits", "%"PRIu64, thread_stats.mop_insert_hits);
+    APPEND_STAT("mop_update_misses", "%"PRIu64, thread_stats.mop_update_misses);
+    APPEND_STAT("mop_update_elem_hits", "%"PRIu64, thread_stats.mop_update_elem_hits);
+    APPEND_STAT("mop_update_none_hits", "%"PRIu64, thread_stats.mop_update_none_hits);
+    APPEND_STAT("mop_delete_misses", "%"PRIu64, thread_stats.mop_delete_misses);
+    APPEND_STAT("mop_delete_elem_hits", "%"PRIu64, thread_stats.mop_delete_elem_hits);
+    APPEND_STAT("mop_delete_none_hits", "%"PRIu64, thread_stats.mop_delete_none_hits);
+    APPEND_STAT("mop_get_misses", "%"PRIu64, thread_stats.mop_get_misses);
+    APPEND_STAT("mop_get_elem_hits", "%"PRIu64, thread_stats.mop_get_elem_hits);
+    APPEND_STAT("mop_get_none_hits", "%"PRIu64, thread_stats.mop_get_none_hits);
+    APPEND_STAT("mop_incr_elem_hits", "%"PRIu64, thread_stats.mop_incr_elem_hits);
+    APPEND_STAT("mop_incr_none_hits", "%"PRIu64, thread_stats.mop_incr_none_hits);
+    APPEND_STAT("mop_incr_misses", "%"PRIu64, thread_stats.mop_incr_misses);
+    APPEND_STAT("mop_decr_elem_hits", "%"PRIu64, thread_stats.mop_decr_elem_hits);
+    APPEND_STAT("mop_decr_none_hits", "%"PRIu64, thread_stats.mop_decr_none_hits);
+    APPEND_STAT("mop_decr_misses", "%"PRIu64, thread_stats.mop_decr_misses);
+    APPEND_STAT("bop_create_oks", "%"PRIu64, thread_stats.bop_create_oks);
+    APPEND_STAT("bop_insert_misses", "%"PRIu64, thread_stats.bop_insert_misses);
+    APPEND_STAT("bop_insert_hits", "%"PRIu64, thread_stats.bop_insert_hits);
+    APPEND_STAT("bop_update_misses", "%"PRIu64, thread_stats.bop_update_misses);
+    APPEND_STAT("bop_update_elem_hits", "%"PRIu64, thread_stats.bop_update_elem_hits);
+    APPEND_STAT("bop_update_none_hits", "%"PRIu64, thread_stats.bop_update_none_hits);
+    APPEND_STAT("bop_delete_misses", "%"PRIu64, thread_stats.bop_delete_misses);
+    APPEND_STAT("bop_delete_elem_hits", "%"PRIu64, thread_stats.bop_delete_elem_hits);
+    APPEND_STAT("bop_delete_none_hits", "%"PRIu64, thread_stats.bop_delete_none_hits);
+    APPEND_STAT("bop_get_misses", "%"PRIu64, thread_stats.bop_get_misses);
+    APPEND_STAT("bop_get_elem_hits", "%"PRIu64, thread_stats.bop_get_elem_hits);
+    APPEND_STAT("bop_get_none_hits", "%"PRIu64, thread_stats.bop_get_none_hits);
+    APPEND_STAT("bop_count_misses", "%"PRIu64, thread_stats.bop_count_misses);
+    APPEND_STAT("bop_count_hits", "%"PRIu64, thread_stats.bop_count_hits);
+    APPEND_STAT("bop_position_misses", "%"PRIu64, thread_stats.bop_position_misses);
+    APPEND_STAT("bop_position_elem_hits", "%"PRIu64, thread_stats.bop_position_elem_hits);
+    APPEND_STAT("bop_position_none_hits", "%"PRIu64, thread_stats.bop_position_none_hits);
+    APPEND_STAT("bop_pwg_misses", "%"PRIu64, thread_stats.bop_pwg_misses);
+    APPEND_STAT("bop_pwg_elem_hits", "%"PRIu64, thread_stats.bop_pwg_elem_hits);
+    APPEND_STAT("bop_pwg_none_hits", "%"PRIu64, thread_stats.bop_pwg_none_hits);
+    APPEND_STAT("bop_gbp_misses", "%"PRIu64, thread_stats.bop_gbp_misses);
+    APPEND_STAT("bop_gbp_elem_hits", "%"PRIu64, thread_stats.bop_gbp_elem_hits);
+    APPEND_STAT("bop_gbp_none_hits", "%"PRIu64, thread_stats.bop_gbp_none_hits);
+#ifdef SUPPORT_BOP_MGET
+    APPEND_STAT("bop_mget_oks", "%"PRIu64, thread_stats.bop_mget_oks);
+#endif
+#ifdef SUPPORT_BOP_SMGET
+    APPEND_STAT("bop_smget_oks", "%"PRIu64, thread_stats.bop_smget_oks);
+#endif
+    APPEND_STAT("bop_incr_elem_hits", "%"PRIu64, thread_stats.bop_incr_elem_hits);
+    APPEND_STAT("bop_incr_none_hits", "%"PRIu64, thread_stats.bop_incr_none_hits);
+    APPEND_STAT("bop_incr_misses", "%"PRIu64, thread_stats.bop_incr_misses);
+    APPEND_STAT("bop_decr_elem_hits", "%"PRIu64, thread_stats.bop_decr_elem_hits);
+    APPEND_STAT("bop_decr_none_hits", "%"PRIu64, thread_stats.bop_decr_none_hits);
+    APPEND_STAT("bop_decr_misses", "%"PRIu64, thread_stats.bop_decr_misses);
+    APPEND_STAT("getattr_misses", "%"PRIu64, thread_stats.getattr_misses);
+    APPEND_STAT("getattr_hits", "%"PRIu64, thread_stats.getattr_hits);
+    APPEND_STAT("setattr_misses", "%"PRIu64, thread_stats.setattr_misses);
+    APPEND_STAT("setattr_hits", "%"PRIu64, thread_stats.setattr_hits);
+    APPEND_STAT("stat_prefixes", "%"PRIu64, stats_prefix_count());
+    APPEND_STAT("bytes_read", "%"PRIu64, thread_stats.bytes_read);
+    APPEND_STAT("bytes_written", "%"PRIu64, thread_stats.bytes_written);
+    APPEND_STAT("limit_maxbytes", "%"PRIu64, settings.maxbytes);
+    APPEND_STAT("threads", "%d", settings.num_threads);
+    APPEND_STAT("conn_yields", "%"PRIu64, thread_stats.conn_yields);
+    APPEND_STAT("coalesced_responses", "%"PRIu64, thread_stats.coalesced_responses);
+    STATS_UNLOCK();
+}
+
+static void process_stat_settings(ADD_STAT add_stats, void *c) {
+    assert(add_stats);
+    APPEND_STAT("maxbytes", "%llu", (unsigned long long)settings.maxbytes);
+    APPEND_STAT("maxconns", "%d", settings.maxconns);
+    APPEND_STAT("tcpport", "%d", settings.port);
+    APPEND_STAT("udpport", "%d", settings.udpport);
+    APPEND_STAT("sticky_limit", "%llu", (unsigned long long)settings.sticky_limit);
+    APPEND_STAT("inter", "%s", settings.inter ? settings.inter : "NULL");
+    APPEND_STAT("verbosity", "%d", settings.verbose);
+    APPEND_STAT("oldest", "%lu", (unsigned long)settings.oldest_live);
+    APPEND_STAT("evictions", "%s", settings.evict_to_free ? "on" : "off");
+    APPEND_STAT("domain_socket", "%s",
+                settings.socketpath ? settings.socketpath : "NULL");
+    APPEND_STAT("umask", "%o", settings.access);
+    APPEND_STAT("growth_factor", "%.2f", settings.factor);
+    APPEND_STAT("chunk_size", "%d", settings.chunk_size);
+    APPEND_STAT("num_threads", "%d", settings.num_threads);
+    APPEND_STAT("stat_key_prefix", "%c", settings.prefix_delimiter);
+    APPEND_STAT("detail_enabled", "%s",
+                settings.detail_enabled ? "yes" : "no");
+    APPEND_STAT("allow_detailed", "%s",
+                settings.allow_detailed ? "yes" : "no");
+    APPEND_STAT("reqs_per_event", "%d", settings.reqs_per_event);
+    APPEND_STAT("cas_enabled", "%s", settings.use_cas ? "yes" : "no");
+    APPEND_STAT("tcp_backlog", "%d", settings.backlog);
+    APPEND_STAT("binding_protocol", "%s",
+                prot_text(settings.binding_protocol));
+#ifdef SASL_ENABLED
+    APPEND_STAT("auth_enabled_sasl", "%s", "yes");
+#else
+    APPEND_STAT("auth_enabled_sasl", "%s", "no");
+#endif
 
-static bool ascii_response_handler(const void *cookie,
-                                   int nbytes,
-                                   const char *dta)
-{
-    conn *c = (conn*)cookie;
-    if (!grow_dynamic_buffer(c, nbytes)) {
-        if (settings.verbose > 0) {
-            mc_logger->log(EXTENSION_LOG_INFO, c,
-                    "<%d ERROR: Failed to allocate memory for response\n", c->sfd);
-        }
-        return false;
-    }
+#ifdef ENABLE_ISASL
+    APPEND_STAT("auth_sasl_engine", "%s", "isasl");
+#elif defined(ENABLE_SASL)
+    APPEND_STAT("auth_sasl_engine", "%s", "cyrus");
+#else
+    APPEND_STAT("auth_sasl_engine", "%s", "none");
+#endif
+    APPEND_STAT("auth_required_sasl", "%s", settings.require_sasl ? "yes" : "no");
+    APPEND_STAT("item_size_max", "%llu", settings.item_size_max);
+    APPEND_STAT("max_list_size", "%d", settings.max_list_size);
+    APPEND_STAT("max_set_size", "%d", settings.max_set_size);
+    APPEND_STAT("max_map_size", "%d", settings.max_map_size);
+    APPEND_STAT("max_btree_size", "%d", settings.max_btree_size);
+    APPEND_STAT("topkeys", "%d", settings.topkeys);
+    APPEND_STAT("network_backend", "%s", settings.io_uring ? "io_uring" : "libevent");
+    APPEND_STAT("worker_listen", "%s", settings.worker_listen ? "yes" : "no");
+    APPEND_STAT("udp_batch", "%d", settings.udp_batch);
+    APPEND_STAT("dispatch", "%s", dispatch_policy_text(settings.dispatch));
+    APPEND_STAT("heavy_threads", "%d", settings.heavy_threads);
+    APPEND_STAT("heavy_threshold", "%d", settings.heavy_threshold);
 
-    char *buf = c->dynamic_buffer.buffer + c->dynamic_buffer.offset;
-    memcpy(buf, dta, nbytes);
-    c->dynamic_buffer.offset += nbytes;
+    for (EXTENSION_DAEMON_DESCRIPTOR *ptr = settings.extensions.daemons;
+         ptr != NULL;
+         ptr = ptr->next) {
+        APPEND_STAT("extension", "%s", ptr->get_name());
+    }
 
-    return true;
-}
+    APPEND_STAT("logger", "%s", mc_logger->get_name());
 
-static void complete_nread_ascii(conn *c) {
-    if (c->ascii_cmd != NULL) {
-        if (!c->ascii_cmd->execute(c->ascii_cmd->cookie, c, 0, NULL,
-                                   ascii_response_handler)) {
-            conn_set_state(c, conn_closing);
-        } else if (c->dynamic_buffer.buffer != NULL) {
-            write_and_free(c, c->dynamic_buffer.buffer,
-                           c->dynamic_buffer.offset);
-            c->dynamic_buffer.buffer = NULL;
-        } else {
-            conn_set_state(c, conn_new_cmd);
-        }
-    } else {
-        complete_update_ascii(c);
+    for (EXTENSION_ASCII_PROTOCOL_DESCRIPTOR *ptr = settings.extensions.ascii;
+         ptr != NULL;
+         ptr = ptr->next) {
+        APPEND_STAT("ascii_extension", "%s", ptr->get_name(ptr->cookie));
     }
 }
 
-static void complete_nread(conn *c)
-{
+static void process_stat(conn *c, token_t *tokens, const size_t ntokens) {
+    const char *subcommand = tokens[SUBCOMMAND_TOKEN].value;
     assert(c != NULL);
-    assert(c->protocol == ascii_prot || c->protocol == binary_prot);
 
-    if (c->protocol == ascii_prot) {
-        complete_nread_ascii(c);
-    } else {
-        complete_nread_binary(c);
+    if (ntokens < 2) {
+        out_string(c, "CLIENT_ERROR bad command line");
+        return;
     }
-}
-
-#define COMMAND_TOKEN 0
-#define SUBCOMMAND_TOKEN 1
-#define PREFIX_TOKEN 1
-#define KEY_TOKEN 1
-#define LOP_KEY_TOKEN 2
-#define SOP_KEY_TOKEN 2
-#define MOP_KEY_TOKEN 2
-#define BOP_KEY_TOKEN 2
 
-#define MAX_TOKENS 30
+    if (ntokens == 2) {
+        server_stats(&append_stats, c, false);
+        (void)mc_engine.v1->get_stats(mc_engine.v0, c,
+                                      NULL, 0, &append_stats);
+    } else if (strcmp(subcommand, "reset") == 0) {
+        stats_reset(c);
+        out_string(c, "RESET");
+        return ;
+    } else if (strcmp(subcommand, "detail") == 0) {
+        /* NOTE: how to tackle detail with binary? */
+        if (ntokens < 4)
+            process_stats_detail(c, "");  /* outputs the error message */
+        else
+            process_stats_detail(c, tokens[2].value);
+        /* Output already generated */
+        return ;
+    } else if (strcmp(subcommand, "settings") == 0) {
+        process_stat_settings(&append_stats, c);
+    } else if (strcmp(subcommand, "threads") == 0) {
+        threads_load_stats(&append_stats, c);
+    } else if (strcmp(subcommand, "cachedump") == 0) {
+        char *buf = NULL;
+        unsigned int bytes = 0, id, limit = 0;
+        bool forward=true, sticky=false;
 
-static void
-print_invalid_command(conn *c, token_t *tokens, const size_t ntokens)
-{
-    /* To understand this function's implementation,
-     * You must know how the command is tokenized.
-     * See tokenize_command().
-     */
-    if (ntokens >= 2) {
-        int i;
-        /* make single string */
-        for (i = 0; i < (ntokens-2); i++) {
-            tokens[i].value[tokens[i].length] = ' ';
+        if (ntokens < 5 || ntokens > 7) {
+            print_invalid_command(c, tokens, ntokens);
+            out_string(c, "CLIENT_ERROR bad command line format");
+            return;
         }
-        mc_logger->log(EXTENSION_LOG_INFO, c, "[%s] INVALID_COMMAND: %s\n",
-                       c->client_ip, tokens[0].value);
-        /* restore the tokens */
-        for (i = 0; i < (ntokens-2); i++) {
-            tokens[i].value[tokens[i].length] = '\0';
+        if (!safe_strtoul(tokens[2].value, &id) ||
+            !safe_strtoul(tokens[3].value, &limit)) {
+            print_invalid_command(c, tokens, ntokens);
+            out_string(c, "CLIENT_ERROR bad command line format");
+            return;
+        }
+        if (id > POWER_LARGEST) {
+            out_string(c, "CLIENT_ERROR Illegal slab id");
+            return;
         }
-    }
-}
-
-/* set up a connection to write a buffer then free it, used for stats */
-static void write_and_free(conn *c, char *buf, int bytes) {
-    if (buf) {
-        c->write_and_free = buf;
-        c->wcurr = buf;
-        c->wbytes = bytes;
-        conn_set_state(c, conn_write);
-        c->write_and_go = conn_new_cmd;
-    } else {
-        out_string(c, "SERVER_ERROR out of memory writing stats");
-    }
-}
-
-#ifdef JHPARK_OLD_SMGET_INTERFACE
-static inline int set_smget_mode_maybe(conn *c, token_t *tokens, size_t ntokens)
-{
-    int mode_index = ntokens - 2;
-    int mode_value = 0;
-
-    if (tokens[mode_index].value) {
-        if (strcmp(tokens[mode_index].value, "duplicate") == 0)
-            mode_value = 1;
-        else if (strcmp(tokens[mode_index].value, "unique") == 0)
-            mode_value = 2;
-    }
-    return mode_value;
-}
-#else
-static inline bool set_unique_maybe(conn *c, token_t *tokens, size_t ntokens)
-{
-    int unique_index = ntokens - 2;
-
-    if (tokens[unique_index].value
-        && strcmp(tokens[unique_index].value, "unique") == 0)
-        return true;
-    else
-        return false;
-}
-#endif
 
-static inline bool set_noreply_maybe(conn *c, token_t *tokens, size_t ntokens)
-{
-    int noreply_index = ntokens - 2;
+        if (limit == 0)  limit = 50;
+        if (limit > 200) limit = 200;
 
-    /*
-      NOTE: this function is not the first place where we are going to
-      send the reply.  We could send it instead from process_command()
-      if the request line has wrong number of tokens.  However parsing
-      malformed line for "noreply" option is not reliable anyway, so
-      it can't be helped.
-    */
-    if (tokens[noreply_index].value
-        && strcmp(tokens[noreply_index].value, "noreply") == 0) {
-        c->noreply = true;
-    }
-    return c->noreply;
-}
+        if (ntokens >= 6) {
+            if (strcmp(tokens[4].value, "forward")==0) forward = true;
+            else if (strcmp(tokens[4].value, "backward")==0) forward = false;
+            else {
+                print_invalid_command(c, tokens, ntokens);
+                out_string(c, "CLIENT_ERROR bad command line format");
+                return;
+            }
+        }
 
-static inline bool set_pipe_noreply_maybe(conn *c, token_t *tokens, size_t ntokens)
-{
-    int noreply_index = ntokens - 2;
+        if (ntokens == 7) {
+            if (strcmp(tokens[5].value, "sticky")==0) sticky = true;
+            else {
+                print_invalid_command(c, tokens, ntokens);
+                out_string(c, "CLIENT_ERROR bad command line format");
+                return;
+            }
+        }
 
-    /*
-      NOTE: this function is not the first place where we are going to
-      send the reply.  We could send it instead from process_command()
-      if the request line has wrong number of tokens.  However parsing
-      malformed line for "noreply" or "pipe" option is not reliable anyway,
-      so it can't be helped.
-    */
-    if (tokens[noreply_index].value) {
-        if (strcmp(tokens[noreply_index].value, "noreply") == 0) {
-            c->noreply = true;
-        } else if (strcmp(tokens[noreply_index].value, "pipe") == 0) {
-            c->noreply = true;
-            if (unlikely(c->pipe_state == PIPE_STATE_OFF))
-                c->pipe_state = PIPE_STATE_ON;
+        buf = mc_engine.v1->cachedump(mc_engine.v0, c, id, limit,
+                                      forward, sticky,  &bytes);
+        write_and_free(c, buf, bytes);
+        return ;
+    } else if (strcmp(subcommand, "aggregate") == 0) {
+        server_stats(&append_stats, c, true);
+    } else if (strcmp(subcommand, "topkeys") == 0) {
+        topkeys_t *tk = get_independent_stats(c)->topkeys;
+        if (tk != NULL) {
+            topkeys_stats(tk, c, current_time, append_stats);
+        } else {
+            out_string(c, "NOT_SUPPORTED");
+            return;
         }
-    }
-    return c->noreply;
-}
+    } else if (strcmp(subcommand, "prefixes") == 0) {
+        process_stats_prefix(c, NULL, -1);
+        return;
+    /****** SPEC-OUT FUNCTIONS **********
+    } else if (strcmp(subcommand, "prefix") == 0) {
+        if (ntokens < 4) {
+            out_string(c, "CLIENT_ERROR usage: stats prefix <prefix>");
+        } else {
+            process_stats_prefix(c, tokens[2].value, tokens[2].length);
+        }
+        return;
+    } else if (strcmp(subcommand, "noprefix") == 0) {
+        process_stats_prefix(c, NULL, 0);
+        return;
+    ************************************/
+    } else {
+        /* getting here means that the subcommand is either engine specific or
+           is invalid. query the engine and see. */
+        ENGINE_ERROR_CODE ret;
+        int nb;
+        char buf[1024];
 
-static inline bool set_pipe_maybe(conn *c, token_t *tokens, size_t ntokens)
-{
-    int noreply_index = ntokens - 2;
+        nb = detokenize(&tokens[1], ntokens - 2, buf, 1024);
+        if (nb <= 0) {
+            /* no matching stat */
+            ret = ENGINE_KEY_ENOENT;
+        } else {
+            ret = mc_engine.v1->get_stats(mc_engine.v0, c, buf,
+                                          nb, append_stats);
+        }
 
-    /*
-      NOTE: this function is not the first place where we are going to
-      send the reply.  We could send it instead from process_command()
-      if the request line has wrong number of tokens.  However parsing
-      malformed line for "pipe" option is not reliable anyway,
-      so it can't be helped.
-    */
-    if (tokens[noreply_index].value) {
-        if (strcmp(tokens[noreply_index].value, "pipe") == 0) {
-            c->noreply = true;
-            if (unlikely(c->pipe_state == PIPE_STATE_OFF))
-                c->pipe_state = PIPE_STATE_ON;
+        switch (ret) {
+        case ENGINE_SUCCESS:
+            append_stats(NULL, 0, NULL, 0, c);
+            write_and_free(c, c->dynamic_buffer.buffer, c->dynamic_buffer.offset);
+            c->dynamic_buffer.buffer = NULL;
+            break;
+        case ENGINE_ENOMEM:
+            out_string(c, "SERVER_ERROR out of memory writing stats");
+            break;
+        case ENGINE_DISCONNECT:
+            c->state = conn_closing;
+            break;
+        case ENGINE_ENOTSUP:
+            out_string(c, "NOT_SUPPORTED");
+            break;
+        default:
+            out_string(c, "ERROR no matching stat");
+            break;
         }
+        return ;
     }
-    return c->noreply;
-}
 
-static bool check_and_handle_pipe_state(conn *c, size_t swallow)
-{
-    if (c->pipe_state == PIPE_STATE_OFF || c->pipe_state == PIPE_STATE_ON) {
-        return true;
+    /* append terminator and start the transfer */
+    append_stats(NULL, 0, NULL, 0, c);
+
+    if (c->dynamic_buffer.buffer == NULL) {
+        out_string(c, "SERVER_ERROR out of memory writing stats");
     } else {
-        assert(c->pipe_state == PIPE_STATE_ERR_CFULL ||
-               c->pipe_state == PIPE_STATE_ERR_MFULL ||
-               c->pipe_state == PIPE_STATE_ERR_BAD);
-        if (c->noreply == true) {
-            c->noreply = false; /* reset noreply */
-        } else  {
-            /* The last command of pipelining has come. */
-            /* clear pipe_state: the end of pipe */
-            c->pipe_state = PIPE_STATE_OFF;
-            c->pipe_count = 0;
-        }
-        if (swallow > 0) {
-            c->sbytes = swallow;
-            conn_set_state(c, conn_swallow);
-        }
-        return false;
+        write_and_free(c, c->dynamic_buffer.buffer, c->dynamic_buffer.offset);
+        c->dynamic_buffer.buffer = NULL;
     }
 }
 
-void append_stat(const char *name, ADD_STAT add_stats, conn *c,
-                 const char *fmt, ...) {
-    char val_str[STAT_VAL_LEN];
-    int vlen;
-    va_list ap;
-
-    assert(name);
-    assert(add_stats);
-    assert(c);
-    assert(fmt);
+/* ntokens is overwritten here... shrug.. */
+static inline void process_get_command(conn *c, token_t *tokens, size_t ntokens, bool return_cas)
+{
+    ENGINE_ERROR_CODE ret;
+    item *it;
+    char *key;
+    size_t nkey;
+    int nitems = 0;
+    int cas_len = 0;
+    char *cas_val = NULL;
+    token_t *key_token = &tokens[KEY_TOKEN];
+    assert(c != NULL);
 
-    va_start(ap, fmt);
-    vlen = vsnprintf(val_str, sizeof(val_str) - 1, fmt, ap);
-    va_end(ap);
+    do {
+        while (key_token->length != 0) {
+            key = key_token->value;
+            nkey = key_token->length;
+            if (nkey > KEY_MAX_LENGTH) {
+                out_string(c, "CLIENT_ERROR bad command line format");
+                return;
+            }
 
-    add_stats(name, strlen(name), val_str, vlen, c);
-}
+            ret = mc_engine.v1->get(mc_engine.v0, c, &it, key, nkey, 0);
+            if (ret != ENGINE_SUCCESS) {
+                it = NULL;
+            }
+            if (settings.detail_enabled) {
+                stats_prefix_record_get(key, nkey, NULL != it);
+            }
 
-inline static void process_stats_detail(conn *c, const char *command) {
-    assert(c != NULL);
+            if (it) {
+                if (!mc_engine.v1->get_item_info(mc_engine.v0, c, it, &c->hinfo)) {
+                    mc_engine.v1->release(mc_engine.v0, c, it);
+                    out_string(c, "SERVER_ERROR error getting item data");
+                    break;
+                }
+                assert(hinfo_check_ascii_tail_string(&c->hinfo) == 0); /* check "\r\n" */
 
-    if (settings.allow_detailed) {
-        if (strcmp(command, "on") == 0) {
-            settings.detail_enabled = 1;
-            out_string(c, "OK");
-        }
-        else if (strcmp(command, "off") == 0) {
-            settings.detail_enabled = 0;
-            out_string(c, "OK");
-        }
-        else if (strcmp(command, "dump") == 0) {
-            int len;
-            char *stats = stats_prefix_dump(&len);
-            write_and_free(c, stats, len);
-        }
-        else {
-            out_string(c, "CLIENT_ERROR usage: stats detail on|off|dump");
-        }
-    }
-    else {
-        out_string(c, "CLIENT_ERROR detailed stats disabled");
-    }
-}
+                if (nitems >= c->isize) {
+                    item **new_list = realloc(c->ilist, sizeof(item *) * c->isize * 2);
+                    if (new_list) {
+                        c->isize *= 2;
+                        c->ilist = new_list;
+                    } else {
+                        mc_engine.v1->release(mc_engine.v0, c, it);
+                        break;
+                    }
+                }
 
-static void process_stats_prefix(conn *c, const char *prefix, const int nprefix) {
-    assert(c != NULL);
-    ENGINE_ERROR_CODE ret;
+                /* Rebuild the suffix */
+                char *suffix = get_suffix_buffer(c);
+                if (suffix == NULL) {
+                    out_string(c, "SERVER_ERROR out of memory rebuilding suffix");
+                    mc_engine.v1->release(mc_engine.v0, c, it);
+                    return;
+                }
+                int suffix_len = snprintf(suffix, SUFFIX_SIZE, " %u %u\r\n",
+                                          htonl(c->hinfo.flags), c->hinfo.nbytes - 2);
 
-    if (nprefix < 0) {
-        char *prefix_data;
-        ret = mc_engine.v1->get_prefix_stats(mc_engine.v0, c, prefix, nprefix, &prefix_data);
-        switch (ret) {
-            case ENGINE_SUCCESS:
-                c->write_and_free = prefix_data;
-                c->wcurr  = prefix_data + sizeof(uint32_t);
-                c->wbytes = *(uint32_t*)prefix_data;
-                conn_set_state(c, conn_write);
-                c->write_and_go = conn_new_cmd;
-                break;
-            case ENGINE_DISCONNECT:
-                c->state = conn_closing;
-                break;
-            case ENGINE_ENOMEM:
-                out_string(c, "SERVER_ERROR no more memory");
-                break;
-            default:
-                out_string(c, "PREFIX_ERROR");
-        }
-    } else {
-        /****** SPEC-OUT FUNCTIONS **********
-        prefix_engine_stats prefix_data;
-        if (nprefix > PREFIX_MAX_LENGTH) {
-            out_string(c, "CLIENT_ERROR too long prefix name");
-            return;
-        }
-        ret = mc_engine.v1->get_prefix_stats(mc_engine.v0, c, prefix, nprefix, &prefix_data);
-        switch (ret) {
-            case ENGINE_SUCCESS:
-                {
-                char buffer[1024];
-                char *str = &buffer[0];
-                *str = '\0';
-                sprintf(str, "PREFIX name=%s\r\n", (prefix == NULL ? "<null>" : prefix));
-                sprintf(str+strlen(str), "PREFIX hash_items=%"PRIu64"\r\n", prefix_data.hash_items);
-                sprintf(str+strlen(str), "PREFIX hash_items_bytes=%"PRIu64"\r\n", prefix_data.hash_items_bytes);
-                sprintf(str+strlen(str), "PREFIX prefix_items=%u\r\n", prefix_data.prefix_items);
-                sprintf(str+strlen(str), "PREFIX tot_prefix_items=%u\r\n", prefix_data.tot_prefix_items);
-                sprintf(str+strlen(str), "END");
-                out_string(c, str);
+                /* rebuild cas value */
+                if (return_cas) {
+                    cas_val = get_suffix_buffer(c);
+                    if (cas_val == NULL) {
+                        out_string(c, "SERVER_ERROR out of memory making CAS suffix");
+                        mc_engine.v1->release(mc_engine.v0, c, it);
+                        return;
+                    }
+                    cas_len = snprintf(cas_val, SUFFIX_SIZE, " %"PRIu64"\r\n", c->hinfo.cas);
+                    suffix_len -= 2; /* remove "\r\n" from suffix string */
                 }
-                break;
-            case ENGINE_DISCONNECT:
-                c->state = conn_closing;
-                break;
-            case ENGINE_PREFIX_ENOENT:
-                out_string(c, "NOT_FOUND");
-                break;
-            default:
-                out_string(c, "PREFIX_ERROR");
-        }
-        ************************************/
-    }
-    return;
-}
 
-static void aggregate_callback(void *in, void *out) {
-    struct thread_stats *out_thread_stats = out;
-    struct independent_stats *in_independent_stats = in;
-    threadlocal_stats_aggregate(in_independent_stats->thread_stats,
-                                out_thread_stats);
-}
+                MEMCACHED_COMMAND_GET(c->sfd, c->hinfo.key, c->hinfo.nkey, c->hinfo.nbytes, c->hinfo.cas);
+                /*
+                 * Construct the response. Each hit adds three elements to the
+                 * outgoing data list:
+                 *   "VALUE "
+                 *   key
+                 *   " " + flags + " " + data length + "\r\n" + data (with \r\n)
+                 */
+                if (add_iov(c, "VALUE ", 6) != 0 ||
+                    add_iov(c, c->hinfo.key, c->hinfo.nkey) != 0 ||
+                    add_iov(c, suffix, suffix_len) != 0 ||
+                    (return_cas && add_iov(c, cas_val, cas_len) != 0) ||
+                    add_iov_hinfo_value(c, &c->hinfo) != 0)
+                {
+                    mc_engine.v1->release(mc_engine.v0, c, it);
+                    break;
+                }
 
-/* return server specific stats only */
-static void server_stats(ADD_STAT add_stats, conn *c, bool aggregate) {
-    pid_t pid = getpid();
-    rel_time_t now = current_time;
+                if (settings.verbose > 1) {
+                    mc_logger->log(EXTENSION_LOG_DEBUG, c, ">%d sending key %s\n",
+                                   c->sfd, (char*)c->hinfo.key);
+                }
+                /* item_get() has incremented it->refcount for us */
+                STATS_HIT(c, get, key, nkey);
+                *(c->ilist + nitems) = it;
+                nitems++;
+            } else {
+                STATS_MISS(c, get, key, nkey);
+                MEMCACHED_COMMAND_GET(c->sfd, key, nkey, -1, 0);
+            }
 
-    struct thread_stats thread_stats;
-    threadlocal_stats_clear(&thread_stats);
+            key_token++;
+        }
 
-    if (aggregate && mc_engine.v1->aggregate_stats != NULL) {
-        mc_engine.v1->aggregate_stats(mc_engine.v0, (const void *)c,
-                                      aggregate_callback, &thread_stats);
-    } else {
-        threadlocal_stats_aggregate(get_independent_stats(c)->thread_stats,
-                                    &thread_stats);
-    }
+        /*
+         * If the command string hasn't been fully processed, get the next set
+         * of tokens.
+         */
+        if (key_token->value != NULL) {
+            /* The next reserved token has the length of untokenized command. */
+            ntokens = tokenize_command(key_token->value, (key_token+1)->length,
+                                       tokens, MAX_TOKENS);
+            key_token = tokens;
+        }
 
-    struct slab_stats slab_stats;
-    slab_stats_aggregate(&thread_stats, &slab_stats);
+    } while(key_token->value != NULL);
 
-#ifndef __WIN32__
-    struct rusage usage;
-    getrusage(RUSAGE_SELF, &usage);
-#endif
+    c->icurr = c->ilist;
+    c->ileft = nitems;
+    c->suffixcurr = c->suffixlist;
 
-#ifdef ENABLE_ZK_INTEGRATION
-    arcus_zk_stats zk_stats;
-    arcus_zk_get_stats(&zk_stats);
-#endif
+    if (settings.verbose > 1) {
+        mc_logger->log(EXTENSION_LOG_DEBUG, c, ">%d END\n", c->sfd);
+    }
 
-    STATS_LOCK();
+    /*
+        If the loop was terminated because of out-of-memory, it is not
+        reliable to add END\r\n to the buffer, because it might not end
+        in \r\n. So we send SERVER_ERROR instead.
+    */
+    if (key_token->value != NULL || add_iov(c, "END\r\n", 5) != 0
+        || (IS_UDP(c->transport) && build_udp_headers(c) != 0)) {
+        out_string(c, "SERVER_ERROR out of memory writing get response");
+    }
+    else {
+        conn_set_state(c, conn_mwrite);
+        c->msgcurr = 0;
+    }
+    return;
+}
 
-    APPEND_STAT("pid", "%lu", (long)pid);
-    APPEND_STAT("uptime", "%u", now);
-    APPEND_STAT("time", "%ld", now + (long)process_started);
-    APPEND_STAT("version", "%s", VERSION);
-    APPEND_STAT("libevent", "%s", event_get_version());
-    APPEND_STAT("pointer_size", "%d", (int)(8 * sizeof(void *)));
-#ifdef ENABLE_ZK_INTEGRATION
-    APPEND_STAT("zk_connected", "%s", zk_stats.zk_connected ? "true" : "false");
-    APPEND_STAT("zk_failstop", "%s", zk_stats.zk_failstop ? "on" : "off");
-    APPEND_STAT("zk_timeout", "%u", zk_stats.zk_timeout);
-    APPEND_STAT("hb_timeout", "%u", zk_stats.hb_timeout);
-    APPEND_STAT("hb_failstop", "%u", zk_stats.hb_failstop);
-    APPEND_STAT("hb_count", "%"PRIu64, zk_stats.hb_count);
-    APPEND_STAT("hb_latency", "%"PRIu64, zk_stats.hb_latency);
-#endif
+static void process_prepare_nread_keys(conn *c, uint32_t vlen, uint32_t kcnt)
+{
+    ENGINE_ERROR_CODE ret = ENGINE_SUCCESS;
 
-#ifndef __WIN32__
-    append_stat("rusage_user", add_stats, c, "%ld.%06ld",
-                (long)usage.ru_utime.tv_sec,
-                (long)usage.ru_utime.tv_usec);
-    append_stat("rusage_system", add_stats, c, "%ld.%06ld",
-                (long)usage.ru_stime.tv_sec,
-                (long)usage.ru_stime.tv_usec);
-#endif
+    /* allocate memory blocks needed */
+    if (mblck_list_alloc(&c->thread->mblck_pool, 1, vlen, &c->memblist) < 0) {
+        ret = ENGINE_ENOMEM;
+    }
 
-    APPEND_STAT("daemon_connections", "%u", mc_stats.daemon_conns);
-    APPEND_STAT("curr_connections", "%u", mc_stats.curr_conns);
-    APPEND_STAT("quit_connections", "%u", mc_stats.quit_conns);
-    APPEND_STAT("reject_connections", "%u", mc_stats.rejected_conns);
-    APPEND_STAT("total_connections", "%u", mc_stats.total_conns);
-    APPEND_STAT("connection_structures", "%u", mc_stats.conn_structs);
-    APPEND_STAT("cmd_get", "%"PRIu64, thread_stats.cmd_get);
-    APPEND_STAT("cmd_set", "%"PRIu64, slab_stats.cmd_set);
-    APPEND_STAT("cmd_incr", "%"PRIu64, thread_stats.cmd_incr);
-    APPEND_STAT("cmd_decr", "%"PRIu64, thread_stats.cmd_decr);
-    APPEND_STAT("cmd_delete", "%"PRIu64, thread_stats.cmd_delete);
-    APPEND_STAT("cmd_flush", "%"PRIu64, thread_stats.cmd_flush);
-    APPEND_STAT("cmd_flush_prefix", "%"PRIu64, thread_stats.cmd_flush_prefix);
-    APPEND_STAT("cmd_cas", "%"PRIu64, thread_stats.cmd_cas);
-    APPEND_STAT("cmd_lop_create", "%"PRIu64, thread_stats.cmd_lop_create);
-    APPEND_STAT("cmd_lop_insert", "%"PRIu64, thread_stats.cmd_lop_insert);
-    APPEND_STAT("cmd_lop_delete", "%"PRIu64, thread_stats.cmd_lop_delete);
-    APPEND_STAT("cmd_lop_get", "%"PRIu64, thread_stats.cmd_lop_get);
-    APPEND_STAT("cmd_sop_create", "%"PRIu64, thread_stats.cmd_sop_create);
-    APPEND_STAT("cmd_sop_insert", "%"PRIu64, thread_stats.cmd_sop_insert);
-    APPEND_STAT("cmd_sop_delete", "%"PRIu64, thread_stats.cmd_sop_delete);
-    APPEND_STAT("cmd_sop_get", "%"PRIu64, thread_stats.cmd_sop_get);
-    APPEND_STAT("cmd_sop_exist", "%"PRIu64, thread_stats.cmd_sop_exist);
-    APPEND_STAT("cmd_mop_create", "%"PRIu64, thread_stats.cmd_mop_create);
-    APPEND_STAT("cmd_mop_insert", "%"PRIu64, thread_stats.cmd_mop_insert);
-    APPEND_STAT("cmd_mop_update", "%"PRIu64, thread_stats.cmd_mop_update);
-    APPEND_STAT("cmd_mop_delete", "%"PRIu64, thread_stats.cmd_mop_delete);
-    APPEND_STAT("cmd_mop_get", "%"PRIu64, thread_stats.cmd_mop_get);
-    APPEND_STAT("cmd_bop_create", "%"PRIu64, thread_stats.cmd_bop_create);
-    APPEND_STAT("cmd_bop_insert", "%"PRIu64, thread_stats.cmd_bop_insert);
-    APPEND_STAT("cmd_bop_update", "%"PRIu64, thread_stats.cmd_bop_update);
-    APPEND_STAT("cmd_bop_delete", "%"PRIu64, thread_stats.cmd_bop_delete);
-    APPEND_STAT("cmd_bop_get", "%"PRIu64, thread_stats.cmd_bop_get);
-    APPEND_STAT("cmd_bop_count", "%"PRIu64, thread_stats.cmd_bop_count);
-    APPEND_STAT("cmd_bop_position", "%"PRIu64, thread_stats.cmd_bop_position);
-    APPEND_STAT("cmd_bop_pwg", "%"PRIu64, thread_stats.cmd_bop_pwg);
-    APPEND_STAT("cmd_bop_gbp", "%"PRIu64, thread_stats.cmd_bop_gbp);
-#ifdef SUPPORT_BOP_MGET
-    APPEND_STAT("cmd_bop_mget", "%"PRIu64, thread_stats.cmd_bop_mget);
-#endif
-#ifdef SUPPORT_BOP_SMGET
-    APPEND_STAT("cmd_bop_smget", "%"PRIu64, thread_stats.cmd_bop_smget);
-#endif
-    APPEND_STAT("cmd_bop_incr", "%"PRIu64, thread_stats.cmd_bop_incr);
-    APPEND_STAT("cmd_bop_decr", "%"PRIu64, thread_stats.cmd_bop_decr);
-    APPEND_STAT("cmd_getattr", "%"PRIu64, thread_stats.cmd_getattr);
-    APPEND_STAT("cmd_setattr", "%"PRIu64, thread_stats.cmd_setattr);
-    APPEND_STAT("auth_cmds", "%"PRIu64, thread_stats.auth_cmds);
-    APPEND_STAT("auth_errors", "%"PRIu64, thread_stats.auth_errors);
-    APPEND_STAT("get_hits", "%"PRIu64, slab_stats.get_hits);
-    APPEND_STAT("get_misses", "%"PRIu64, thread_stats.get_misses);
-    APPEND_STAT("delete_misses", "%"PRIu64, thread_stats.delete_misses);
-    APPEND_STAT("delete_hits", "%"PRIu64, slab_stats.delete_hits);
-    APPEND_STAT("incr_misses", "%"PRIu64, thread_stats.incr_misses);
-    APPEND_STAT("incr_hits", "%"PRIu64, thread_stats.incr_hits);
-    APPEND_STAT("decr_misses", "%"PRIu64, thread_stats.decr_misses);
-    APPEND_STAT("decr_hits", "%"PRIu64, thread_stats.decr_hits);
-    APPEND_STAT("cas_misses", "%"PRIu64, thread_stats.cas_misses);
-    APPEND_STAT("cas_hits", "%"PRIu64, slab_stats.cas_hits);
-    APPEND_STAT("cas_badval", "%"PRIu64, slab_stats.cas_badval);
-    APPEND_STAT("lop_create_oks", "%"PRIu64, thread_stats.lop_create_oks);
-    APPEND_STAT("lop_insert_misses", "%"PRIu64, thread_stats.lop_insert_misses);
-    APPEND_STAT("lop_insert_hits", "%"PRIu64, thread_stats.lop_insert_hits);
-    APPEND_STAT("lop_delete_misses", "%"PRIu64, thread_stats.lop_delete_misses);
-    APPEND_STAT("lop_delete_elem_hits", "%"PRIu64, thread_stats.lop_delete_elem_hits);
-    APPEND_STAT("lop_delete_none_hits", "%"PRIu64, thread_stats.lop_delete_none_hits);
-    APPEND_STAT("lop_get_misses", "%"PRIu64, thread_stats.lop_get_misses);
-    APPEND_STAT("lop_get_elem_hits", "%"PRIu64, thread_stats.lop_get_elem_hits);
-    APPEND_STAT("lop_get_none_hits", "%"PRIu64, thread_stats.lop_get_none_hits);
-    APPEND_STAT("sop_create_oks", "%"PRIu64, thread_stats.sop_create_oks);
-    APPEND_STAT("sop_insert_misses", "%"PRIu64, thread_stats.sop_insert_misses);
-    APPEND_STAT("sop_insert_hits", "%"PRIu64, thread_stats.sop_insert_hits);
-    APPEND_STAT("sop_delete_misses", "%"PRIu64, thread_stats.sop_delete_misses);
-    APPEND_STAT("sop_delete_elem_hits", "%"PRIu64, thread_stats.sop_delete_elem_hits);
-    APPEND_STAT("sop_delete_none_hits", "%"PRIu64, thread_stats.sop_delete_none_hits);
-    APPEND_STAT("sop_get_misses", "%"PRIu64, thread_stats.sop_get_misses);
-    APPEND_STAT("sop_get_elem_hits", "%"PRIu64, thread_stats.sop_get_elem_hits);
-    APPEND_STAT("sop_get_none_hits", "%"PRIu64, thread_stats.sop_get_none_hits);
-    APPEND_STAT("sop_exist_misses", "%"PRIu64, thread_stats.sop_exist_misses);
-    APPEND_STAT("sop_exist_hits", "%"PRIu64, thread_stats.sop_exist_hits);
-    APPEND_STAT("mop_create_oks", "%"PRIu64, thread_stats.mop_create_oks);
-    APPEND_STAT("mop_insert_misses", "%"PRIu64, thread_stats.mop_insert_misses);
-    APPEND_STAT("mop_insert_hits", "%"PRIu64, thread_stats.mop_insert_hits);
-    APPEND_STAT("mop_update_misses", "%"PRIu64, thread_stats.mop_update_misses);
-    APPEND_STAT("mop_update_elem_hits", "%"PRIu64, thread_stats.mop_update_elem_hits);
-    APPEND_STAT("mop_update_none_hits", "%"PRIu64, thread_stats.mop_update_none_hits);
-    APPEND_STAT("mop_delete_misses", "%"PRIu64, thread_stats.mop_delete_misses);
-    APPEND_STAT("mop_delete_elem_hits", "%"PRIu64, thread_stats.mop_delete_elem_hits);
-    APPEND_STAT("mop_delete_none_hits", "%"PRIu64, thread_stats.mop_delete_none_hits);
-    APPEND_STAT("mop_get_misses", "%"PRIu64, thread_stats.mop_get_misses);
-    APPEND_STAT("mop_get_elem_hits", "%"PRIu64, thread_stats.mop_get_elem_hits);
-    APPEND_STAT("mop_get_none_hits", "%"PRIu64, thread_stats.mop_get_none_hits);
-    APPEND_STAT("bop_create_oks", "%"PRIu64, thread_stats.bop_create_oks);
-    APPEND_STAT("bop_insert_misses", "%"PRIu64, thread_stats.bop_insert_misses);
-    APPEND_STAT("bop_insert_hits", "%"PRIu64, thread_stats.bop_insert_hits);
-    APPEND_STAT("bop_update_misses", "%"PRIu64, thread_stats.bop_update_misses);
-    APPEND_STAT("bop_update_elem_hits", "%"PRIu64, thread_stats.bop_update_elem_hits);
-    APPEND_STAT("bop_update_none_hits", "%"PRIu64, thread_stats.bop_update_none_hits);
-    APPEND_STAT("bop_delete_misses", "%"PRIu64, thread_stats.bop_delete_misses);
-    APPEND_STAT("bop_delete_elem_hits", "%"PRIu64, thread_stats.bop_delete_elem_hits);
-    APPEND_STAT("bop_delete_none_hits", "%"PRIu64, thread_stats.bop_delete_none_hits);
-    APPEND_STAT("bop_get_misses", "%"PRIu64, thread_stats.bop_get_misses);
-    APPEND_STAT("bop_get_elem_hits", "%"PRIu64, thread_stats.bop_get_elem_hits);
-    APPEND_STAT("bop_get_none_hits", "%"PRIu64, thread_stats.bop_get_none_hits);
-    APPEND_STAT("bop_count_misses", "%"PRIu64, thread_stats.bop_count_misses);
-    APPEND_STAT("bop_count_hits", "%"PRIu64, thread_stats.bop_count_hits);
-    APPEND_STAT("bop_position_misses", "%"PRIu64, thread_stats.bop_position_misses);
-    APPEND_STAT("bop_position_elem_hits", "%"PRIu64, thread_stats.bop_position_elem_hits);
-    APPEND_STAT("bop_position_none_hits", "%"PRIu64, thread_stats.bop_position_none_hits);
-    APPEND_STAT("bop_pwg_misses", "%"PRIu64, thread_stats.bop_pwg_misses);
-    APPEND_STAT("bop_pwg_elem_hits", "%"PRIu64, thread_stats.bop_pwg_elem_hits);
-    APPEND_STAT("bop_pwg_none_hits", "%"PRIu64, thread_stats.bop_pwg_none_hits);
-    APPEND_STAT("bop_gbp_misses", "%"PRIu64, thread_stats.bop_gbp_misses);
-    APPEND_STAT("bop_gbp_elem_hits", "%"PRIu64, thread_stats.bop_gbp_elem_hits);
-    APPEND_STAT("bop_gbp_none_hits", "%"PRIu64, thread_stats.bop_gbp_none_hits);
-#ifdef SUPPORT_BOP_MGET
-    APPEND_STAT("bop_mget_oks", "%"PRIu64, thread_stats.bop_mget_oks);
-#endif
-#ifdef SUPPORT_BOP_SMGET
-    APPEND_STAT("bop_smget_oks", "%"PRIu64, thread_stats.bop_smget_oks);
-#endif
-    APPEND_STAT("bop_incr_elem_hits", "%"PRIu64, thread_stats.bop_incr_elem_hits);
-    APPEND_STAT("bop_incr_none_hits", "%"PRIu64, thread_stats.bop_incr_none_hits);
-    APPEND_STAT("bop_incr_misses", "%"PRIu64, thread_stats.bop_incr_misses);
-    APPEND_STAT("bop_decr_elem_hits", "%"PRIu64, thread_stats.bop_decr_elem_hits);
-    APPEND_STAT("bop_decr_none_hits", "%"PRIu64, thread_stats.bop_decr_none_hits);
-    APPEND_STAT("bop_decr_misses", "%"PRIu64, thread_stats.bop_decr_misses);
-    APPEND_STAT("getattr_misses", "%"PRIu64, thread_stats.getattr_misses);
-    APPEND_STAT("getattr_hits", "%"PRIu64, thread_stats.getattr_hits);
-    APPEND_STAT("setattr_misses", "%"PRIu64, thread_stats.setattr_misses);
-    APPEND_STAT("setattr_hits", "%"PRIu64, thread_stats.setattr_hits);
-    APPEND_STAT("stat_prefixes", "%"PRIu64, stats_prefix_count());
-    APPEND_STAT("bytes_read", "%"PRIu64, thread_stats.bytes_read);
-    APPEND_STAT("bytes_written", "%"PRIu64, thread_stats.bytes_written);
-    APPEND_STAT("limit_maxbytes", "%"PRIu64, settings.maxbytes);
-    APPEND_STAT("threads", "%d", settings.num_threads);
-    APPEND_STAT("conn_yields", "%"PRIu64, thread_stats.conn_yields);
-    STATS_UNLOCK();
+    switch (ret) {
+    case ENGINE_SUCCESS:
+        c->coll_strkeys = (void*)&c->memblist;
+        ritem_set_first(c, CONN_RTYPE_MBLCK, vlen);
+        c->coll_op = OPERATION_MGET;
+        conn_set_state(c, conn_nread);
+        break;
+    default:
+        out_string(c, "SERVER_ERROR out of memory");
+        c->write_and_go = conn_swallow;
+        c->sbytes = vlen;
+    }
 }
 
-static void process_stat_settings(ADD_STAT add_stats, void *c) {
-    assert(add_stats);
-    APPEND_STAT("maxbytes", "%llu", (unsigned long long)settings.maxbytes);
-    APPEND_STAT("maxconns", "%d", settings.maxconns);
-    APPEND_STAT("tcpport", "%d", settings.port);
-    APPEND_STAT("udpport", "%d", settings.udpport);
-    APPEND_STAT("sticky_limit", "%llu", (unsigned long long)settings.sticky_limit);
-    APPEND_STAT("inter", "%s", settings.inter ? settings.inter : "NULL");
-    APPEND_STAT("verbosity", "%d", settings.verbose);
-    APPEND_STAT("oldest", "%lu", (unsigned long)settings.oldest_live);
-    APPEND_STAT("evictions", "%s", settings.evict_to_free ? "on" : "off");
-    APPEND_STAT("domain_socket", "%s",
-                settings.socketpath ? settings.socketpath : "NULL");
-    APPEND_STAT("umask", "%o", settings.access);
-    APPEND_STAT("growth_factor", "%.2f", settings.factor);
-    APPEND_STAT("chunk_size", "%d", settings.chunk_size);
-    APPEND_STAT("num_threads", "%d", settings.num_threads);
-    APPEND_STAT("stat_key_prefix", "%c", settings.prefix_delimiter);
-    APPEND_STAT("detail_enabled", "%s",
-                settings.detail_enabled ? "yes" : "no");
-    APPEND_STAT("allow_detailed", "%s",
-                settings.allow_detailed ? "yes" : "no");
-    APPEND_STAT("reqs_per_event", "%d", settings.reqs_per_event);
-    APPEND_STAT("cas_enabled", "%s", settings.use_cas ? "yes" : "no");
-    APPEND_STAT("tcp_backlog", "%d", settings.backlog);
-    APPEND_STAT("binding_protocol", "%s",
-                prot_text(settings.binding_protocol));
-#ifdef SASL_ENABLED
-    APPEND_STAT("auth_enabled_sasl", "%s", "yes");
-#else
-    APPEND_STAT("auth_enabled_sasl", "%s", "no");
-#endif
+static inline void process_mget_command(conn *c, token_t *tokens, const size_t ntokens)
+{
+    uint32_t lenkeys, numkeys;
 
-#ifdef ENABLE_ISASL
-    APPEND_STAT("auth_sasl_engine", "%s", "isasl");
-#elif defined(ENABLE_SASL)
-    APPEND_STAT("auth_sasl_engine", "%s", "cyrus");
-#else
-    APPEND_STAT("auth_sasl_engine", "%s", "none");
-#endif
-    APPEND_STAT("auth_required_sasl", "%s", settings.require_sasl ? "yes" : "no");
-    APPEND_STAT("item_size_max", "%llu", settings.item_size_max);
-    APPEND_STAT("max_list_size", "%d", settings.max_list_size);
-    APPEND_STAT("max_set_size", "%d", settings.max_set_size);
-    APPEND_STAT("max_map_size", "%d", settings.max_map_size);
-    APPEND_STAT("max_btree_size", "%d", settings.max_btree_size);
-    APPEND_STAT("topkeys", "%d", settings.topkeys);
+    if ((! safe_strtoul(tokens[COMMAND_TOKEN+1].value, &lenkeys)) ||
+        (! safe_strtoul(tokens[COMMAND_TOKEN+2].value, &numkeys)) ||
+        (lenkeys > (UINT_MAX-2))) {
+        print_invalid_command(c, tokens, ntokens);
+        out_string(c, "CLIENT_ERROR bad command line format");
+        return;
+    }
 
-    for (EXTENSION_DAEMON_DESCRIPTOR *ptr = settings.extensions.daemons;
-         ptr != NULL;
-         ptr = ptr->next) {
-        APPEND_STAT("extension", "%s", ptr->get_name());
+    if (lenkeys < 1 || numkeys < 1 || numkeys > ((lenkeys/2)+1)) {
+        /* ENGINE_EBADVALUE */
+        out_string(c, "CLIENT_ERROR bad value"); return;
+    }
+    if (numkeys > MAX_MGET_KEY_COUNT) {
+        out_string(c, "CLIENT_ERROR bad value"); return;
     }
+    lenkeys += 2;
 
-    APPEND_STAT("logger", "%s", mc_logger->get_name());
+    c->coll_numkeys = numkeys;
+    c->coll_lenkeys = lenkeys;
 
-    for (EXTENSION_ASCII_PROTOCOL_DESCRIPTOR *ptr = settings.extensions.ascii;
-         ptr != NULL;
-         ptr = ptr->next) {
-        APPEND_STAT("ascii_extension", "%s", ptr->get_name(ptr->cookie));
+    process_prepare_nread_keys(c, lenkeys, numkeys);
+}
+
+/*
+ * Allocates the item of a storage command and reads its data into it.
+ * The item is stored in complete_update_ascii().
+ */
+static void process_update_item(conn *c, char *key, size_t nkey,
+                                unsigned int flags, time_t exptime, int vlen,
+                                uint64_t req_cas_id, ENGINE_STORE_OPERATION store_op)
+{
+    item *it;
+
+    if (settings.detail_enabled) {
+        stats_prefix_record_set(key, nkey);
+    }
+
+    ENGINE_ERROR_CODE ret;
+    ret = mc_engine.v1->allocate(mc_engine.v0, c, &it, key, nkey, vlen,
+                                 htonl(flags), realtime(exptime), req_cas_id);
+
+    switch (ret) {
+    case ENGINE_SUCCESS:
+        if (!mc_engine.v1->get_item_info(mc_engine.v0, c, it, &c->hinfo)) {
+            mc_engine.v1->release(mc_engine.v0, c, it);
+            out_string(c, "SERVER_ERROR error getting item data");
+            break;
+        }
+        c->item = it;
+        ritem_set_first(c, CONN_RTYPE_HINFO, vlen);
+        c->store_op = store_op;
+        conn_set_state(c, conn_nread);
+        break;
+    case ENGINE_DISCONNECT:
+        c->state = conn_closing;
+        break;
+    case ENGINE_E2BIG:
+    case ENGINE_ENOMEM:
+        if (ret == ENGINE_E2BIG) {
+            out_string(c, "SERVER_ERROR object too large for cache");
+        } else {
+            out_string(c, "SERVER_ERROR out of memory storing object");
+        }
+        /* swallow the data line */
+        c->write_and_go = conn_swallow;
+        c->sbytes = vlen;
+
+        /* Avoid stale data persisting in cache because we failed alloc.
+         * Unacceptable for SET. Anywhere else too? */
+        if (store_op == OPERATION_SET) {
+            mc_engine.v1->remove(mc_engine.v0, c, key, nkey, 0, 0);
+        }
+        break;
+    default:
+        handle_unexpected_errorcode_ascii(c, ret);
+        /* swallow the data line */
+        c->write_and_go = conn_swallow;
+        c->sbytes = vlen;
     }
 }
 
-static void process_stat(conn *c, token_t *tokens, const size_t ntokens) {
-    const char *subcommand = tokens[SUBCOMMAND_TOKEN].value;
+static void process_update_command(conn *c, token_t *tokens, const size_t ntokens, ENGINE_STORE_OPERATION store_op, bool handle_cas) {
+    char *key;
+    size_t nkey;
+    unsigned int flags;
+    int32_t exptime_int=0;
+    time_t exptime;
+    int vlen;
+    uint64_t req_cas_id=0;
+
     assert(c != NULL);
 
-    if (ntokens < 2) {
-        out_string(c, "CLIENT_ERROR bad command line");
+    set_noreply_maybe(c, tokens, ntokens);
+
+    if (tokens[KEY_TOKEN].length > KEY_MAX_LENGTH) {
+        out_string(c, "CLIENT_ERROR bad command line format");
         return;
     }
 
-    if (ntokens == 2) {
-        server_stats(&append_stats, c, false);
-        (void)mc_engine.v1->get_stats(mc_engine.v0, c,
-                                      NULL, 0, &append_stats);
-    } else if (strcmp(subcommand, "reset") == 0) {
-        stats_reset(c);
-        out_string(c, "RESET");
-        return ;
-    } else if (strcmp(subcommand, "detail") == 0) {
-        /* NOTE: how to tackle detail with binary? */
-        if (ntokens < 4)
-            process_stats_detail(c, "");  /* outputs the error message */
-        else
-            process_stats_detail(c, tokens[2].value);
-        /* Output already generated */
-        return ;
-    } else if (strcmp(subcommand, "settings") == 0) {
-        process_stat_settings(&append_stats, c);
-    } else if (strcmp(subcommand, "cachedump") == 0) {
-        char *buf = NULL;
-        unsigned int bytes = 0, id, limit = 0;
-        bool forward=true, sticky=false;
+    key = tokens[KEY_TOKEN].value;
+    nkey = tokens[KEY_TOKEN].length;
 
-        if (ntokens < 5 || ntokens > 7) {
-            print_invalid_command(c, tokens, ntokens);
-            out_string(c, "CLIENT_ERROR bad command line format");
-            return;
-        }
-        if (!safe_strtoul(tokens[2].value, &id) ||
-            !safe_strtoul(tokens[3].value, &limit)) {
+    if (! (safe_strtoul(tokens[2].value, (uint32_t *)&flags)
+           && safe_strtol(tokens[3].value, &exptime_int)
+           && safe_strtol(tokens[4].value, (int32_t *)&vlen))) {
+        print_invalid_command(c, tokens, ntokens);
+        out_string(c, "CLIENT_ERROR bad command line format");
+        return;
+    }
+    if (vlen < 0 || vlen > (INT_MAX-2)) {
+        print_invalid_command(c, tokens, ntokens);
+        out_string(c, "CLIENT_ERROR bad command line format");
+        return;
+    }
+    vlen += 2;
+
+    /* Ubuntu 8.04 breaks when I pass exptime to safe_strtol */
+    exptime = exptime_int;
+
+    // does cas value exist?
+    if (handle_cas) {
+        if (!safe_strtoull(tokens[5].value, &req_cas_id)) {
             print_invalid_command(c, tokens, ntokens);
             out_string(c, "CLIENT_ERROR bad command line format");
             return;
         }
-        if (id > POWER_LARGEST) {
-            out_string(c, "CLIENT_ERROR Illegal slab id");
-            return;
-        }
+    }
 
-        if (limit == 0)  limit = 50;
-        if (limit > 200) limit = 200;
+    process_update_item(c, key, nkey, flags, exptime, vlen, req_cas_id, store_op);
+}
 
-        if (ntokens >= 6) {
-            if (strcmp(tokens[4].value, "forward")==0) forward = true;
-            else if (strcmp(tokens[4].value, "backward")==0) forward = false;
-            else {
-                print_invalid_command(c, tokens, ntokens);
-                out_string(c, "CLIENT_ERROR bad command line format");
-                return;
-            }
-        }
+static void process_arithmetic_command(conn *c, token_t *tokens, const size_t ntokens, const bool incr) {
 
-        if (ntokens == 7) {
-            if (strcmp(tokens[5].value, "sticky")==0) sticky = true;
-            else {
-                print_invalid_command(c, tokens, ntokens);
-                out_string(c, "CLIENT_ERROR bad command line format");
-                return;
-            }
-        }
+    uint64_t delta;
+    char *key;
+    size_t nkey;
 
-        buf = mc_engine.v1->cachedump(mc_engine.v0, c, id, limit,
-                                      forward, sticky,  &bytes);
-        write_and_free(c, buf, bytes);
-        return ;
-    } else if (strcmp(subcommand, "aggregate") == 0) {
-        server_stats(&append_stats, c, true);
-    } else if (strcmp(subcommand, "topkeys") == 0) {
-        topkeys_t *tk = get_independent_stats(c)->topkeys;
-        if (tk != NULL) {
-            topkeys_stats(tk, c, current_time, append_stats);
-        } else {
-            out_string(c, "NOT_SUPPORTED");
-            return;
-        }
-    } else if (strcmp(subcommand, "prefixes") == 0) {
-        process_stats_prefix(c, NULL, -1);
-        return;
-    /****** SPEC-OUT FUNCTIONS **********
-    } else if (strcmp(subcommand, "prefix") == 0) {
-        if (ntokens < 4) {
-            out_string(c, "CLIENT_ERROR usage: stats prefix <prefix>");
-        } else {
-            process_stats_prefix(c, tokens[2].value, tokens[2].length);
-        }
+    assert(c != NULL);
+    assert(c->ewouldblock == false);
+
+    set_noreply_maybe(c, tokens, ntokens);
+
+    if (tokens[KEY_TOKEN].length > KEY_MAX_LENGTH) {
+        out_string(c, "CLIENT_ERROR bad command line format");
         return;
-    } else if (strcmp(subcommand, "noprefix") == 0) {
-        process_stats_prefix(c, NULL, 0);
+    }
+
+    key = tokens[KEY_TOKEN].value;
+    nkey = tokens[KEY_TOKEN].length;
+
+    if (!safe_strtoull(tokens[2].value, &delta)) {
+        out_string(c, "CLIENT_ERROR invalid numeric delta argument");
         return;
-    ************************************/
-    } else {
-        /* getting here means that the subcommand is either engine specific or
-           is invalid. query the engine and see. */
-        ENGINE_ERROR_CODE ret;
-        int nb;
-        char buf[1024];
+    }
 
-        nb = detokenize(&tokens[1], ntokens - 2, buf, 1024);
-        if (nb <= 0) {
-            /* no matching stat */
-            ret = ENGINE_KEY_ENOENT;
-        } else {
-            ret = mc_engine.v1->get_stats(mc_engine.v0, c, buf,
-                                          nb, append_stats);
+    bool create = false;
+    unsigned int flags  = 0;
+    int32_t exptime_int = 0;
+    uint64_t init_value = 0;
+
+    if (ntokens >= 7) {
+        if (! (safe_strtoul(tokens[3].value, (uint32_t *)&flags)
+               && safe_strtol(tokens[4].value, &exptime_int)
+               && safe_strtoull(tokens[5].value, &init_value))) {
+            print_invalid_command(c, tokens, ntokens);
+            out_string(c, "CLIENT_ERROR bad command line format");
+            return;
         }
+        create = true;
+    }
 
-        switch (ret) {
-        case ENGINE_SUCCESS:
-            append_stats(NULL, 0, NULL, 0, c);
-            write_and_free(c, c->dynamic_buffer.buffer, c->dynamic_buffer.offset);
-            c->dynamic_buffer.buffer = NULL;
-            break;
-        case ENGINE_ENOMEM:
-            out_string(c, "SERVER_ERROR out of memory writing stats");
-            break;
-        case ENGINE_DISCONNECT:
-            c->state = conn_closing;
-            break;
-        case ENGINE_ENOTSUP:
-            out_string(c, "NOT_SUPPORTED");
-            break;
-        default:
-            out_string(c, "ERROR no matching stat");
-            break;
+    if (settings.detail_enabled) {
+        if (incr) {
+            stats_prefix_record_incr(key, nkey);
+        } else {
+            stats_prefix_record_decr(key, nkey);
         }
-        return ;
     }
 
-    /* append terminator and start the transfer */
-    append_stats(NULL, 0, NULL, 0, c);
+    ENGINE_ERROR_CODE ret;
+    uint64_t cas;
+    uint64_t result;
 
-    if (c->dynamic_buffer.buffer == NULL) {
-        out_string(c, "SERVER_ERROR out of memory writing stats");
-    } else {
-        write_and_free(c, c->dynamic_buffer.buffer, c->dynamic_buffer.offset);
-        c->dynamic_buffer.buffer = NULL;
+    ret = mc_engine.v1->arithmetic(mc_engine.v0, c, key, nkey,
+                                   incr, create, delta, init_value,
+                                   htonl(flags), realtime(exptime_int),
+                                   &cas, &result, 0);
+    if (ret == ENGINE_EWOULDBLOCK) {
+        c->ewouldblock = true;
+        ret = ENGINE_SUCCESS;
+    }
+
+    char temp[INCR_MAX_STORAGE_LEN];
+    switch (ret) {
+    case ENGINE_SUCCESS:
+        if (incr) {
+            STATS_HITS(c, incr, key, nkey);
+        } else {
+            STATS_HITS(c, decr, key, nkey);
+        }
+        snprintf(temp, sizeof(temp), "%"PRIu64, result);
+        out_string(c, temp);
+        break;
+    case ENGINE_KEY_ENOENT:
+        if (incr) {
+            STATS_MISS(c, incr, key, nkey);
+        } else {
+            STATS_MISS(c, decr, key, nkey);
+        }
+        out_string(c, "NOT_FOUND");
+        break;
+    case ENGINE_PREFIX_ENAME:
+        out_string(c, "CLIENT_ERROR invalid prefix name");
+
+        break;
+    case ENGINE_ENOMEM:
+        out_string(c, "SERVER_ERROR out of memory");
+        break;
+    case ENGINE_EINVAL:
+        out_string(c, "CLIENT_ERROR cannot increment or decrement non-numeric value");
+        break;
+    case ENGINE_NOT_STORED:
+        out_string(c, "SERVER_ERROR failed to store item");
+        break;
+    case ENGINE_DISCONNECT:
+        c->state = conn_closing;
+        break;
+    case ENGINE_ENOTSUP:
+        out_string(c, "NOT_SUPPORTED");
+        break;
+    case ENGINE_EBADTYPE:
+        out_string(c, "TYPE_MISMATCH");
+        break;
+    default:
+        handle_unexpected_errorcode_ascii(c, ret);
     }
 }
 
-/* ntokens is overwritten here... shrug.. */
-static inline void process_get_command(conn *c, token_t *tokens, size_t ntokens, bool return_cas)
-{
-    ENGINE_ERROR_CODE ret;
-    item *it;
+static void process_delete_command(conn *c, token_t *tokens, const size_t ntokens) {
     char *key;
     size_t nkey;
-    int nitems = 0;
-    int cas_len = 0;
-    char *cas_val = NULL;
-    token_t *key_token = &tokens[KEY_TOKEN];
+
     assert(c != NULL);
+    assert(c->ewouldblock == false);
 
-    do {
-        while (key_token->length != 0) {
-            key = key_token->value;
-            nkey = key_token->length;
-            if (nkey > KEY_MAX_LENGTH) {
-                out_string(c, "CLIENT_ERROR bad command line format");
-                return;
-            }
+    if (ntokens > 3) {
+        bool hold_is_zero = strcmp(tokens[KEY_TOKEN+1].value, "0") == 0;
+        bool sets_noreply = set_noreply_maybe(c, tokens, ntokens);
+        bool valid = (ntokens == 4 && (hold_is_zero || sets_noreply))
+            || (ntokens == 5 && hold_is_zero && sets_noreply);
+        if (!valid) {
+            print_invalid_command(c, tokens, ntokens);
+            out_string(c, "CLIENT_ERROR bad command line format.  "
+                       "Usage: delete <key> [noreply]");
+            return;
+        }
+    }
 
-            ret = mc_engine.v1->get(mc_engine.v0, c, &it, key, nkey, 0);
-            if (ret != ENGINE_SUCCESS) {
-                it = NULL;
-            }
-            if (settings.detail_enabled) {
-                stats_prefix_record_get(key, nkey, NULL != it);
-            }
 
-            if (it) {
-                if (!mc_engine.v1->get_item_info(mc_engine.v0, c, it, &c->hinfo)) {
-                    mc_engine.v1->release(mc_engine.v0, c, it);
-                    out_string(c, "SERVER_ERROR error getting item data");
-                    break;
-                }
-                assert(hinfo_check_ascii_tail_string(&c->hinfo) == 0); /* check "\r\n" */
+    key = tokens[KEY_TOKEN].value;
+    nkey = tokens[KEY_TOKEN].length;
 
-                if (nitems >= c->isize) {
-                    item **new_list = realloc(c->ilist, sizeof(item *) * c->isize * 2);
-                    if (new_list) {
-                        c->isize *= 2;
-                        c->ilist = new_list;
-                    } else {
-                        mc_engine.v1->release(mc_engine.v0, c, it);
-                        break;
-                    }
-                }
+    if(nkey > KEY_MAX_LENGTH) {
+        out_string(c, "CLIENT_ERROR bad command line format");
+        return;
+    }
 
-                /* Rebuild the suffix */
-                char *suffix = get_suffix_buffer(c);
-                if (suffix == NULL) {
-                    out_string(c, "SERVER_ERROR out of memory rebuilding suffix");
-                    mc_engine.v1->release(mc_engine.v0, c, it);
-                    return;
-                }
-                int suffix_len = snprintf(suffix, SUFFIX_SIZE, " %u %u\r\n",
-                                          htonl(c->hinfo.flags), c->hinfo.nbytes - 2);
+    if (settings.detail_enabled) {
+        stats_prefix_record_delete(key, nkey);
+    }
 
-                /* rebuild cas value */
-                if (return_cas) {
-                    cas_val = get_suffix_buffer(c);
-                    if (cas_val == NULL) {
-                        out_string(c, "SERVER_ERROR out of memory making CAS suffix");
-                        mc_engine.v1->release(mc_engine.v0, c, it);
-                        return;
-                    }
-                    cas_len = snprintf(cas_val, SUFFIX_SIZE, " %"PRIu64"\r\n", c->hinfo.cas);
-                    suffix_len -= 2; /* remove "\r\n" from suffix string */
-                }
+    ENGINE_ERROR_CODE ret;
+    ret = mc_engine.v1->remove(mc_engine.v0, c, key, nkey, 0, 0);
+    if (ret == ENGINE_EWOULDBLOCK) {
+        c->ewouldblock = true;
+        ret = ENGINE_SUCCESS;
+    }
 
-                MEMCACHED_COMMAND_GET(c->sfd, c->hinfo.key, c->hinfo.nkey, c->hinfo.nbytes, c->hinfo.cas);
-                /*
-                 * Construct the response. Each hit adds three elements to the
-                 * outgoing data list:
-                 *   "VALUE "
-                 *   key
-                 *   " " + flags + " " + data length + "\r\n" + data (with \r\n)
-                 */
-                if (add_iov(c, "VALUE ", 6) != 0 ||
-                    add_iov(c, c->hinfo.key, c->hinfo.nkey) != 0 ||
-                    add_iov(c, suffix, suffix_len) != 0 ||
-                    (return_cas && add_iov(c, cas_val, cas_len) != 0) ||
-                    add_iov_hinfo_value(c, &c->hinfo) != 0)
-                {
-                    mc_engine.v1->release(mc_engine.v0, c, it);
-                    break;
-                }
+    /* For some reason the SLAB_INCR tries to access this... */
+    if (ret == ENGINE_SUCCESS) {
+        out_string(c, "DELETED");
+        //SLAB_INCR(c, delete_hits, key, nkey);
+        STATS_HIT(c, delete, key, nkey);
+    } else if (ret == ENGINE_KEY_ENOENT) {
+        out_string(c, "NOT_FOUND");
+        //STATS_INCR(c, delete_misses, key, nkey);
+        STATS_MISS(c, delete, key, nkey);
+    } else if (ret == ENGINE_ENOTSUP) {
+        out_string(c, "NOT_SUPPORTED");
+    } else {
+        handle_unexpected_errorcode_ascii(c, ret);
+    }
+}
+
+/*
+ * Meta commands: mg, ms, md, ma and mn.
+ *
+ * A meta command has a key followed by one-letter flags, some of which
+ * take an argument right after the letter (e.g. T30). Its response is a
+ * two-letter code followed by the flags requested to be returned, so that
+ * a client can get the value with its TTL and CAS, touch it, or store it
+ * conditionally in one round trip.
+ *
+ *   mg <key> <flags>*\r\n               -> VA <size> <flags>*\r\n<data>\r\n | HD <flags>* | EN [Z]
+ *   ms <key> <datalen> <flags>*\r\n<data>\r\n -> HD | NS | EX | NF
+ *   md <key> <flags>*\r\n               -> HD | NF | EX
+ *   ma <key> <flags>*\r\n               -> HD | VA <size> <flags>*\r\n<number>\r\n | NF | NS
+ *   mn\r\n                              -> MN
+ */
+#define META_HEADER_SIZE 512
+
+static int32_t meta_ttl(rel_time_t exptime)
+{
+    if (exptime == 0 || exptime == (rel_time_t)(-1)) {
+        return -1; /* never expires */
+    }
+    return (exptime > current_time) ? (int32_t)(exptime - current_time) : 0;
+}
 
-                if (settings.verbose > 1) {
-                    mc_logger->log(EXTENSION_LOG_DEBUG, c, ">%d sending key %s\n",
-                                   c->sfd, (char*)c->hinfo.key);
-                }
-                /* item_get() has incremented it->refcount for us */
-                STATS_HIT(c, get, key, nkey);
-                *(c->ilist + nitems) = it;
-                nitems++;
-            } else {
-                STATS_MISS(c, get, key, nkey);
-                MEMCACHED_COMMAND_GET(c->sfd, key, nkey, -1, 0);
-            }
+/*
+ * Parses the flags common to the meta commands.
+ * Returns 1 if the flag is parsed, 0 if it is not a common flag,
+ * or -1 if it is invalid.
+ */
+static int meta_parse_common_flag(meta_flags_t *meta, token_t *token, const char *rflags)
+{
+    char flag = token->value[0];
 
-            key_token++;
+    if (flag == 'q' && token->length == 1) {
+        meta->quiet = true;
+        return 1;
+    }
+    if (flag == 'O') {
+        if (token->length - 1 > META_OPAQUE_MAX) {
+            return -1;
         }
-
-        /*
-         * If the command string hasn't been fully processed, get the next set
-         * of tokens.
-         */
-        if (key_token->value != NULL) {
-            /* The next reserved token has the length of untokenized command. */
-            ntokens = tokenize_command(key_token->value, (key_token+1)->length,
-                                       tokens, MAX_TOKENS);
-            key_token = tokens;
+        meta->nopaque = token->length - 1;
+        memcpy(meta->opaque, token->value + 1, meta->nopaque);
+        return 1;
+    }
+    if (strchr(rflags, flag) != NULL && token->length == 1) {
+        if (meta->nrflags >= META_RFLAGS_MAX ||
+            memchr(meta->rflags, flag, meta->nrflags) != NULL) {
+            return -1; /* too many or duplicated */
         }
+        meta->rflags[meta->nrflags++] = flag;
+        return 1;
+    }
+    return 0;
+}
 
-    } while(key_token->value != NULL);
-
-    c->icurr = c->ilist;
-    c->ileft = nitems;
-    c->suffixcurr = c->suffixlist;
+/*
+ * Appends to the header of a meta response ending at end.
+ * Returns NULL if it does not fit, or if ptr is NULL already.
+ */
+static char *meta_sprintf(char *ptr, char *end, const char *fmt, ...)
+{
+    va_list ap;
+    int len;
 
-    if (settings.verbose > 1) {
-        mc_logger->log(EXTENSION_LOG_DEBUG, c, ">%d END\n", c->sfd);
+    if (ptr == NULL) {
+        return NULL;
     }
+    va_start(ap, fmt);
+    len = vsnprintf(ptr, end - ptr, fmt, ap);
+    va_end(ap);
+    if (len < 0 || len >= end - ptr) {
+        return NULL;
+    }
+    return ptr + len;
+}
 
-    /*
-        If the loop was terminated because of out-of-memory, it is not
-        reliable to add END\r\n to the buffer, because it might not end
-        in \r\n. So we send SERVER_ERROR instead.
-    */
-    if (key_token->value != NULL || add_iov(c, "END\r\n", 5) != 0
-        || (IS_UDP(c->transport) && build_udp_headers(c) != 0)) {
-        out_string(c, "SERVER_ERROR out of memory writing get response");
+static char *meta_append_flags(char *ptr, char *end, meta_flags_t *meta,
+                               const char *key, size_t nkey,
+                               item_info *info, uint64_t cas, rel_time_t exptime)
+{
+    for (int i = 0; i < meta->nrflags; i++) {
+        switch (meta->rflags[i]) {
+        case 'c':
+            ptr = meta_sprintf(ptr, end, " c%"PRIu64, cas);
+            break;
+        case 'f':
+            ptr = meta_sprintf(ptr, end, " f%u", htonl(info->flags));
+            break;
+        case 'k':
+            ptr = meta_sprintf(ptr, end, " k%.*s", (int)nkey, key);
+            break;
+        case 's':
+            ptr = meta_sprintf(ptr, end, " s%u", info->nbytes - 2);
+            break;
+        case 't':
+            ptr = meta_sprintf(ptr, end, " t%d", meta_ttl(exptime));
+            break;
+        }
     }
-    else {
-        conn_set_state(c, conn_mwrite);
-        c->msgcurr = 0;
+    if (meta->nopaque > 0) {
+        ptr = meta_sprintf(ptr, end, " O%.*s", (int)meta->nopaque, meta->opaque);
     }
-    return;
+    return ptr;
 }
 
-static void process_prepare_nread_keys(conn *c, uint32_t vlen, uint32_t kcnt)
+static ENGINE_ERROR_CODE meta_set_exptime(conn *c, const char *key, size_t nkey, rel_time_t exptime)
 {
-    ENGINE_ERROR_CODE ret = ENGINE_SUCCESS;
+    ENGINE_ITEM_ATTR attr_id = ATTR_EXPIRETIME;
+    item_attr attr_data;
 
-    /* allocate memory blocks needed */
-    if (mblck_list_alloc(&c->thread->mblck_pool, 1, vlen, &c->memblist) < 0) {
-        ret = ENGINE_ENOMEM;
-    }
+    attr_data.exptime = exptime;
+    return mc_engine.v1->setattr(mc_engine.v0, c, key, nkey, &attr_id, 1, &attr_data, 0);
+}
 
-    switch (ret) {
-    case ENGINE_SUCCESS:
-        c->coll_strkeys = (void*)&c->memblist;
-        ritem_set_first(c, CONN_RTYPE_MBLCK, vlen);
-        c->coll_op = OPERATION_MGET;
-        conn_set_state(c, conn_nread);
-        break;
-    default:
-        out_string(c, "SERVER_ERROR out of memory");
-        c->write_and_go = conn_swallow;
-        c->sbytes = vlen;
+/*
+ * Installs a lease placeholder of the missing item, which expires in
+ * the given seconds unless filled by a set with its cas as the token.
+ * Returns ENGINE_KEY_EEXISTS if the lease is held by another client.
+ */
+static ENGINE_ERROR_CODE meta_lease_item(conn *c, const char *key, size_t nkey,
+                                         int32_t lease, item **it)
+{
+    uint64_t cas;
+    ENGINE_ERROR_CODE ret;
+
+    ret = mc_engine.v1->allocate(mc_engine.v0, c, it, key, nkey, 2, 0, realtime(lease), 0);
+    if (ret != ENGINE_SUCCESS) {
+        *it = NULL;
+        return ret;
+    }
+    if (!mc_engine.v1->get_item_info(mc_engine.v0, c, *it, &c->hinfo)) {
+        mc_engine.v1->release(mc_engine.v0, c, *it);
+        *it = NULL;
+        return ENGINE_FAILED;
     }
+    memcpy((char*)c->hinfo.value, "\r\n", 2);
+    ret = mc_engine.v1->store(mc_engine.v0, c, *it, &cas, OPERATION_LEASE, 0);
+    if (ret != ENGINE_SUCCESS) {
+        mc_engine.v1->release(mc_engine.v0, c, *it);
+        *it = NULL;
+        return ret;
+    }
+    c->hinfo.cas = cas; /* the lease token */
+    return ret;
 }
 
-static inline void process_mget_command(conn *c, token_t *tokens, const size_t ntokens)
+static void process_meta_get_command(conn *c, token_t *tokens, const size_t ntokens)
 {
-    uint32_t lenkeys, numkeys;
+    char *key = tokens[KEY_TOKEN].value;
+    size_t nkey = tokens[KEY_TOKEN].length;
+    meta_flags_t meta;
+    bool return_value = false;
+    bool touch = false;
+    bool win = false;
+    int32_t ttl = 0;
+    int32_t recache = 0;
+    int32_t lease = 0;
+    rel_time_t exptime;
+    char header[META_HEADER_SIZE];
+    char *ptr = header;
+    char *end = header + sizeof(header);
+    ENGINE_ERROR_CODE ret;
+    item *it;
+    int i, res;
 
-    if ((! safe_strtoul(tokens[COMMAND_TOKEN+1].value, &lenkeys)) ||
-        (! safe_strtoul(tokens[COMMAND_TOKEN+2].value, &numkeys)) ||
-        (lenkeys > (UINT_MAX-2))) {
+    memset(&meta, 0, sizeof(meta));
+    for (i = KEY_TOKEN+1; i < ntokens-1; i++) {
+        res = meta_parse_common_flag(&meta, &tokens[i], "cfkst");
+        if (res > 0) continue;
+        if (res < 0) break;
+        if (tokens[i].value[0] == 'v' && tokens[i].length == 1) {
+            return_value = true;
+        } else if (tokens[i].value[0] == 'T' && safe_strtol(tokens[i].value+1, &ttl)) {
+            touch = true;
+        } else if (tokens[i].value[0] == 'R' && safe_strtol(tokens[i].value+1, &recache) &&
+                   recache > 0) {
+            /* recache: R<seconds> */
+        } else if (tokens[i].value[0] == 'N' && safe_strtol(tokens[i].value+1, &lease) &&
+                   lease > 0) {
+            /* lease on miss: N<seconds> */
+        } else {
+            break;
+        }
+    }
+    if (nkey > KEY_MAX_LENGTH || i < ntokens-1 || tokens[ntokens-1].value != NULL) {
         print_invalid_command(c, tokens, ntokens);
         out_string(c, "CLIENT_ERROR bad command line format");
         return;
     }
 
-    if (lenkeys < 1 || numkeys < 1 || numkeys > ((lenkeys/2)+1)) {
-        /* ENGINE_EBADVALUE */
-        out_string(c, "CLIENT_ERROR bad value"); return;
+    ret = mc_engine.v1->get(mc_engine.v0, c, &it, key, nkey, 0);
+    if (ret != ENGINE_SUCCESS) {
+        it = NULL;
     }
-    if (numkeys > MAX_MGET_KEY_COUNT) {
-        out_string(c, "CLIENT_ERROR bad value"); return;
+    if (settings.detail_enabled) {
+        stats_prefix_record_get(key, nkey, NULL != it);
+    }
+    if (it == NULL) {
+        STATS_MISS(c, get, key, nkey);
+        MEMCACHED_COMMAND_GET(c->sfd, key, nkey, -1, 0);
+        if (lease > 0) {
+            /* The first client missing the item wins the lease to fill it,
+             * and the others are told to wait for it rather than missing
+             * all together.
+             */
+            ret = meta_lease_item(c, key, nkey, lease, &it);
+        }
+        if (it == NULL) {
+            if (ret == ENGINE_KEY_EEXISTS) {
+                out_string(c, "EN Z");
+            } else {
+                c->noreply = meta.quiet;
+                out_string(c, "EN");
+            }
+            return;
+        }
+        win = true;
+    } else {
+        if (!mc_engine.v1->get_item_info(mc_engine.v0, c, it, &c->hinfo)) {
+            mc_engine.v1->release(mc_engine.v0, c, it);
+            out_string(c, "SERVER_ERROR error getting item data");
+            return;
+        }
+        STATS_HIT(c, get, key, nkey);
+        MEMCACHED_COMMAND_GET(c->sfd, c->hinfo.key, c->hinfo.nkey, c->hinfo.nbytes, c->hinfo.cas);
     }
-    lenkeys += 2;
-
-    c->coll_numkeys = numkeys;
-    c->coll_lenkeys = lenkeys;
-
-    process_prepare_nread_keys(c, lenkeys, numkeys);
-}
-
-static void process_update_command(conn *c, token_t *tokens, const size_t ntokens, ENGINE_STORE_OPERATION store_op, bool handle_cas) {
-    char *key;
-    size_t nkey;
-    unsigned int flags;
-    int32_t exptime_int=0;
-    time_t exptime;
-    int vlen;
-    uint64_t req_cas_id=0;
-    item *it;
-
-    assert(c != NULL);
 
-    set_noreply_maybe(c, tokens, ntokens);
+    exptime = c->hinfo.exptime;
+    if (touch && meta_set_exptime(c, key, nkey, realtime(ttl)) == ENGINE_SUCCESS) {
+        exptime = realtime(ttl);
+    }
+    if (recache > 0 && meta_ttl(exptime) >= 0 && meta_ttl(exptime) < recache) {
+        /* The client wins to recache the item expiring soon. The item is
+         * kept for the others meanwhile, so that they are served with it
+         * rather than missing all together.
+         */
+        if (meta_set_exptime(c, key, nkey, exptime + recache) == ENGINE_SUCCESS) {
+            exptime += recache;
+            win = true;
+        }
+    }
 
-    if (tokens[KEY_TOKEN].length > KEY_MAX_LENGTH) {
-        out_string(c, "CLIENT_ERROR bad command line format");
+    if (return_value) {
+        ptr = meta_sprintf(ptr, end, "VA %u", c->hinfo.nbytes - 2);
+    } else {
+        ptr = meta_sprintf(ptr, end, "HD");
+    }
+    ptr = meta_append_flags(ptr, end, &meta, key, nkey, &c->hinfo, c->hinfo.cas, exptime);
+    if (win) {
+        ptr = meta_sprintf(ptr, end, " W");
+    }
+    if (return_value) {
+        ptr = meta_sprintf(ptr, end, "\r\n");
+    }
+    if (ptr == NULL) {
+        mc_engine.v1->release(mc_engine.v0, c, it);
+        out_string(c, "CLIENT_ERROR too long meta flags");
+        return;
+    }
+    if (!return_value) {
+        mc_engine.v1->release(mc_engine.v0, c, it);
+        out_string(c, header);
         return;
     }
 
-    key = tokens[KEY_TOKEN].value;
-    nkey = tokens[KEY_TOKEN].length;
-
-    if (! (safe_strtoul(tokens[2].value, (uint32_t *)&flags)
-           && safe_strtol(tokens[3].value, &exptime_int)
-           && safe_strtol(tokens[4].value, (int32_t *)&vlen))) {
-        print_invalid_command(c, tokens, ntokens);
-        out_string(c, "CLIENT_ERROR bad command line format");
+    memcpy(c->wbuf, header, ptr - header);
+    if (add_iov(c, c->wbuf, ptr - header) != 0 ||
+        add_iov_hinfo_value(c, &c->hinfo) != 0 ||
+        (IS_UDP(c->transport) && build_udp_headers(c) != 0)) {
+        mc_engine.v1->release(mc_engine.v0, c, it);
+        out_string(c, "SERVER_ERROR out of memory writing get response");
         return;
     }
-    if (vlen < 0 || vlen > (INT_MAX-2)) {
+    /* item_get() has incremented it->refcount for us */
+    c->ilist[0] = it;
+    c->icurr = c->ilist;
+    c->ileft = 1;
+    conn_set_state(c, conn_mwrite);
+    c->msgcurr = 0;
+}
+
+static void process_meta_set_command(conn *c, token_t *tokens, const size_t ntokens)
+{
+    char *key = tokens[KEY_TOKEN].value;
+    size_t nkey = tokens[KEY_TOKEN].length;
+    meta_flags_t meta;
+    ENGINE_STORE_OPERATION store_op = OPERATION_SET;
+    uint32_t flags = 0;
+    int32_t exptime = 0;
+    int32_t vlen;
+    uint64_t req_cas_id = 0;
+    int i, res;
+
+    if (!safe_strtol(tokens[2].value, &vlen) || vlen < 0 || vlen > (INT_MAX-2)) {
         print_invalid_command(c, tokens, ntokens);
         out_string(c, "CLIENT_ERROR bad command line format");
         return;
     }
     vlen += 2;
 
-    /* Ubuntu 8.04 breaks when I pass exptime to safe_strtol */
-    exptime = exptime_int;
-
-    // does cas value exist?
-    if (handle_cas) {
-        if (!safe_strtoull(tokens[5].value, &req_cas_id)) {
-            print_invalid_command(c, tokens, ntokens);
-            out_string(c, "CLIENT_ERROR bad command line format");
-            return;
+    memset(&meta, 0, sizeof(meta));
+    for (i = KEY_TOKEN+2; i < ntokens-1; i++) {
+        res = meta_parse_common_flag(&meta, &tokens[i], "ck");
+        if (res > 0) continue;
+        if (res < 0) break;
+        if (tokens[i].value[0] == 'F') {
+            if (!safe_strtoul(tokens[i].value+1, &flags)) break;
+        } else if (tokens[i].value[0] == 'T') {
+            if (!safe_strtol(tokens[i].value+1, &exptime)) break;
+        } else if (tokens[i].value[0] == 'C') {
+            if (!safe_strtoull(tokens[i].value+1, &req_cas_id)) break;
+        } else if (tokens[i].value[0] == 'M' && tokens[i].length == 2) {
+            char mode = tokens[i].value[1];
+            if (mode == 'S' || mode == 's')      store_op = OPERATION_SET;
+            else if (mode == 'E' || mode == 'e') store_op = OPERATION_ADD;
+            else if (mode == 'R' || mode == 'r') store_op = OPERATION_REPLACE;
+            else if (mode == 'A' || mode == 'a') store_op = OPERATION_APPEND;
+            else if (mode == 'P' || mode == 'p') store_op = OPERATION_PREPEND;
+            else break;
+        } else {
+            break;
         }
     }
-
-    if (settings.detail_enabled) {
-        stats_prefix_record_set(key, nkey);
+    if (req_cas_id != 0 && store_op != OPERATION_SET) {
+        i = 0; /* compare-and-swap is only for the set mode */
     }
-
-    ENGINE_ERROR_CODE ret;
-    ret = mc_engine.v1->allocate(mc_engine.v0, c, &it, key, nkey, vlen,
-                                 htonl(flags), realtime(exptime), req_cas_id);
-
-    switch (ret) {
-    case ENGINE_SUCCESS:
-        if (!mc_engine.v1->get_item_info(mc_engine.v0, c, it, &c->hinfo)) {
-            mc_engine.v1->release(mc_engine.v0, c, it);
-            out_string(c, "SERVER_ERROR error getting item data");
-            break;
-        }
-        c->item = it;
-        ritem_set_first(c, CONN_RTYPE_HINFO, vlen);
-        c->store_op = store_op;
-        conn_set_state(c, conn_nread);
-        break;
-    case ENGINE_DISCONNECT:
-        c->state = conn_closing;
-        break;
-    case ENGINE_E2BIG:
-    case ENGINE_ENOMEM:
-        if (ret == ENGINE_E2BIG) {
-            out_string(c, "SERVER_ERROR object too large for cache");
-        } else {
-            out_string(c, "SERVER_ERROR out of memory storing object");
-        }
+    if (nkey > KEY_MAX_LENGTH || i < ntokens-1 || tokens[ntokens-1].value != NULL) {
+        print_invalid_command(c, tokens, ntokens);
+        out_string(c, "CLIENT_ERROR bad command line format");
         /* swallow the data line */
         c->write_and_go = conn_swallow;
         c->sbytes = vlen;
+        return;
+    }
 
-        /* Avoid stale data persisting in cache because we failed alloc.
-         * Unacceptable for SET. Anywhere else too? */
-        if (store_op == OPERATION_SET) {
-            mc_engine.v1->remove(mc_engine.v0, c, key, nkey, 0, 0);
-        }
+    if (req_cas_id != 0) {
+        store_op = OPERATION_CAS;
+    }
+    process_update_item(c, key, nkey, flags, exptime, vlen, req_cas_id, store_op);
+    if (c->state == conn_nread) {
+        c->meta_store = true;
+        c->meta = meta;
+    }
+}
+
+/*
+ * Responds to the meta set command in complete_update_ascii().
+ * Returns false if the result is not the one of the meta command,
+ * which is responded as the other storage commands.
+ */
+static bool process_meta_set_complete(conn *c, ENGINE_ERROR_CODE ret)
+{
+    char header[META_HEADER_SIZE];
+    char *ptr = header;
+    char *end = header + sizeof(header);
+
+    switch (ret) {
+    case ENGINE_SUCCESS:
+        ptr = meta_sprintf(ptr, end, "HD");
+        c->noreply = c->meta.quiet;
+        break;
+    case ENGINE_KEY_EEXISTS:
+        ptr = meta_sprintf(ptr, end, "EX");
+        break;
+    case ENGINE_KEY_ENOENT:
+        ptr = meta_sprintf(ptr, end, "NF");
+        break;
+    case ENGINE_NOT_STORED:
+        ptr = meta_sprintf(ptr, end, "NS");
         break;
     default:
-        handle_unexpected_errorcode_ascii(c, ret);
-        /* swallow the data line */
-        c->write_and_go = conn_swallow;
-        c->sbytes = vlen;
+        return false;
+    }
+    ptr = meta_append_flags(ptr, end, &c->meta, c->hinfo.key, c->hinfo.nkey,
+                            &c->hinfo, c->cas, c->hinfo.exptime);
+    if (ptr == NULL) {
+        c->noreply = false;
+        out_string(c, "CLIENT_ERROR too long meta flags");
+        return true;
     }
+    out_string(c, header);
+    return true;
 }
 
-static void process_arithmetic_command(conn *c, token_t *tokens, const size_t ntokens, const bool incr) {
-
-    uint64_t delta;
-    char *key;
-    size_t nkey;
+static void process_meta_delete_command(conn *c, token_t *tokens, const size_t ntokens)
+{
+    char *key = tokens[KEY_TOKEN].value;
+    size_t nkey = tokens[KEY_TOKEN].length;
+    meta_flags_t meta;
+    uint64_t req_cas_id = 0;
+    char header[META_HEADER_SIZE];
+    char *ptr = header;
+    char *end = header + sizeof(header);
+    ENGINE_ERROR_CODE ret;
+    int i, res;
 
-    assert(c != NULL);
     assert(c->ewouldblock == false);
 
-    set_noreply_maybe(c, tokens, ntokens);
-
-    if (tokens[KEY_TOKEN].length > KEY_MAX_LENGTH) {
+    memset(&meta, 0, sizeof(meta));
+    for (i = KEY_TOKEN+1; i < ntokens-1; i++) {
+        res = meta_parse_common_flag(&meta, &tokens[i], "k");
+        if (res > 0) continue;
+        if (res < 0) break;
+        if (tokens[i].value[0] == 'C') {
+            if (!safe_strtoull(tokens[i].value+1, &req_cas_id)) break;
+        } else {
+            break;
+        }
+    }
+    if (nkey > KEY_MAX_LENGTH || i < ntokens-1 || tokens[ntokens-1].value != NULL) {
+        print_invalid_command(c, tokens, ntokens);
         out_string(c, "CLIENT_ERROR bad command line format");
         return;
     }
 
-    key = tokens[KEY_TOKEN].value;
-    nkey = tokens[KEY_TOKEN].length;
+    if (settings.detail_enabled) {
+        stats_prefix_record_delete(key, nkey);
+    }
 
-    if (!safe_strtoull(tokens[2].value, &delta)) {
-        out_string(c, "CLIENT_ERROR invalid numeric delta argument");
+    ret = mc_engine.v1->remove(mc_engine.v0, c, key, nkey, req_cas_id, 0);
+    if (ret == ENGINE_EWOULDBLOCK) {
+        c->ewouldblock = true;
+        ret = ENGINE_SUCCESS;
+    }
+
+    switch (ret) {
+    case ENGINE_SUCCESS:
+        STATS_HIT(c, delete, key, nkey);
+        ptr = meta_sprintf(ptr, end, "HD");
+        c->noreply = meta.quiet;
+        break;
+    case ENGINE_KEY_ENOENT:
+        STATS_MISS(c, delete, key, nkey);
+        ptr = meta_sprintf(ptr, end, "NF");
+        c->noreply = meta.quiet;
+        break;
+    case ENGINE_KEY_EEXISTS:
+        ptr = meta_sprintf(ptr, end, "EX");
+        break;
+    case ENGINE_ENOTSUP:
+        out_string(c, "NOT_SUPPORTED");
+        return;
+    default:
+        handle_unexpected_errorcode_ascii(c, ret);
         return;
     }
+    ptr = meta_append_flags(ptr, end, &meta, key, nkey, NULL, 0, 0);
+    if (ptr == NULL) {
+        c->noreply = false;
+        out_string(c, "CLIENT_ERROR too long meta flags");
+        return;
+    }
+    out_string(c, header);
+}
 
+static void process_meta_arithmetic_command(conn *c, token_t *tokens, const size_t ntokens)
+{
+    char *key = tokens[KEY_TOKEN].value;
+    size_t nkey = tokens[KEY_TOKEN].length;
+    meta_flags_t meta;
+    bool incr = true;
     bool create = false;
-    unsigned int flags  = 0;
-    int32_t exptime_int = 0;
+    bool return_value = false;
+    int32_t exptime = 0;
     uint64_t init_value = 0;
+    uint64_t delta = 1;
+    uint64_t cas;
+    uint64_t result;
+    char header[META_HEADER_SIZE];
+    char *ptr = header;
+    char *end = header + sizeof(header);
+    char temp[INCR_MAX_STORAGE_LEN];
+    ENGINE_ERROR_CODE ret;
+    int i, res;
 
-    if (ntokens >= 7) {
-        if (! (safe_strtoul(tokens[3].value, (uint32_t *)&flags)
-               && safe_strtol(tokens[4].value, &exptime_int)
-               && safe_strtoull(tokens[5].value, &init_value))) {
-            print_invalid_command(c, tokens, ntokens);
-            out_string(c, "CLIENT_ERROR bad command line format");
-            return;
+    assert(c->ewouldblock == false);
+
+    memset(&meta, 0, sizeof(meta));
+    for (i = KEY_TOKEN+1; i < ntokens-1; i++) {
+        res = meta_parse_common_flag(&meta, &tokens[i], "ck");
+        if (res > 0) continue;
+        if (res < 0) break;
+        if (tokens[i].value[0] == 'v' && tokens[i].length == 1) {
+            return_value = true;
+        } else if (tokens[i].value[0] == 'N') {
+            if (!safe_strtol(tokens[i].value+1, &exptime)) break;
+            create = true;
+        } else if (tokens[i].value[0] == 'J') {
+            if (!safe_strtoull(tokens[i].value+1, &init_value)) break;
+        } else if (tokens[i].value[0] == 'D') {
+            if (!safe_strtoull(tokens[i].value+1, &delta)) break;
+        } else if (tokens[i].value[0] == 'M' && tokens[i].length == 2) {
+            char mode = tokens[i].value[1];
+            if (mode == 'I' || mode == 'i' || mode == '+')      incr = true;
+            else if (mode == 'D' || mode == 'd' || mode == '-') incr = false;
+            else break;
+        } else {
+            break;
         }
-        create = true;
+    }
+    if (nkey > KEY_MAX_LENGTH || i < ntokens-1 || tokens[ntokens-1].value != NULL) {
+        print_invalid_command(c, tokens, ntokens);
+        out_string(c, "CLIENT_ERROR bad command line format");
+        return;
     }
 
     if (settings.detail_enabled) {
@@ -8825,20 +10693,14 @@ static void process_arithmetic_command(conn *c, token_t *tokens, const size_t nt
         }
     }
 
-    ENGINE_ERROR_CODE ret;
-    uint64_t cas;
-    uint64_t result;
-
     ret = mc_engine.v1->arithmetic(mc_engine.v0, c, key, nkey,
                                    incr, create, delta, init_value,
-                                   htonl(flags), realtime(exptime_int),
-                                   &cas, &result, 0);
+                                   0, realtime(exptime), &cas, &result, 0);
     if (ret == ENGINE_EWOULDBLOCK) {
         c->ewouldblock = true;
         ret = ENGINE_SUCCESS;
     }
 
-    char temp[INCR_MAX_STORAGE_LEN];
     switch (ret) {
     case ENGINE_SUCCESS:
         if (incr) {
@@ -8847,7 +10709,12 @@ static void process_arithmetic_command(conn *c, token_t *tokens, const size_t nt
             STATS_HITS(c, decr, key, nkey);
         }
         snprintf(temp, sizeof(temp), "%"PRIu64, result);
-        out_string(c, temp);
+        if (return_value) {
+            ptr = meta_sprintf(ptr, end, "VA %d", (int)strlen(temp));
+        } else {
+            ptr = meta_sprintf(ptr, end, "HD");
+            c->noreply = meta.quiet;
+        }
         break;
     case ENGINE_KEY_ENOENT:
         if (incr) {
@@ -8855,89 +10722,44 @@ static void process_arithmetic_command(conn *c, token_t *tokens, const size_t nt
         } else {
             STATS_MISS(c, decr, key, nkey);
         }
-        out_string(c, "NOT_FOUND");
+        ptr = meta_sprintf(ptr, end, "NF");
+        c->noreply = meta.quiet;
+        break;
+    case ENGINE_NOT_STORED:
+        ptr = meta_sprintf(ptr, end, "NS");
         break;
     case ENGINE_PREFIX_ENAME:
         out_string(c, "CLIENT_ERROR invalid prefix name");
-
-        break;
+        return;
     case ENGINE_ENOMEM:
         out_string(c, "SERVER_ERROR out of memory");
-        break;
+        return;
     case ENGINE_EINVAL:
         out_string(c, "CLIENT_ERROR cannot increment or decrement non-numeric value");
-        break;
-    case ENGINE_NOT_STORED:
-        out_string(c, "SERVER_ERROR failed to store item");
-        break;
+        return;
     case ENGINE_DISCONNECT:
         c->state = conn_closing;
-        break;
+        return;
     case ENGINE_ENOTSUP:
         out_string(c, "NOT_SUPPORTED");
-        break;
+        return;
     case ENGINE_EBADTYPE:
         out_string(c, "TYPE_MISMATCH");
-        break;
+        return;
     default:
         handle_unexpected_errorcode_ascii(c, ret);
-    }
-}
-
-static void process_delete_command(conn *c, token_t *tokens, const size_t ntokens) {
-    char *key;
-    size_t nkey;
-
-    assert(c != NULL);
-    assert(c->ewouldblock == false);
-
-    if (ntokens > 3) {
-        bool hold_is_zero = strcmp(tokens[KEY_TOKEN+1].value, "0") == 0;
-        bool sets_noreply = set_noreply_maybe(c, tokens, ntokens);
-        bool valid = (ntokens == 4 && (hold_is_zero || sets_noreply))
-            || (ntokens == 5 && hold_is_zero && sets_noreply);
-        if (!valid) {
-            print_invalid_command(c, tokens, ntokens);
-            out_string(c, "CLIENT_ERROR bad command line format.  "
-                       "Usage: delete <key> [noreply]");
-            return;
-        }
-    }
-
-
-    key = tokens[KEY_TOKEN].value;
-    nkey = tokens[KEY_TOKEN].length;
-
-    if(nkey > KEY_MAX_LENGTH) {
-        out_string(c, "CLIENT_ERROR bad command line format");
         return;
     }
-
-    if (settings.detail_enabled) {
-        stats_prefix_record_delete(key, nkey);
-    }
-
-    ENGINE_ERROR_CODE ret;
-    ret = mc_engine.v1->remove(mc_engine.v0, c, key, nkey, 0, 0);
-    if (ret == ENGINE_EWOULDBLOCK) {
-        c->ewouldblock = true;
-        ret = ENGINE_SUCCESS;
+    ptr = meta_append_flags(ptr, end, &meta, key, nkey, NULL, cas, 0);
+    if (ret == ENGINE_SUCCESS && return_value) {
+        ptr = meta_sprintf(ptr, end, "\r\n%s", temp);
     }
-
-    /* For some reason the SLAB_INCR tries to access this... */
-    if (ret == ENGINE_SUCCESS) {
-        out_string(c, "DELETED");
-        //SLAB_INCR(c, delete_hits, key, nkey);
-        STATS_HIT(c, delete, key, nkey);
-    } else if (ret == ENGINE_KEY_ENOENT) {
-        out_string(c, "NOT_FOUND");
-        //STATS_INCR(c, delete_misses, key, nkey);
-        STATS_MISS(c, delete, key, nkey);
-    } else if (ret == ENGINE_ENOTSUP) {
-        out_string(c, "NOT_SUPPORTED");
-    } else {
-        handle_unexpected_errorcode_ascii(c, ret);
+    if (ptr == NULL) {
+        c->noreply = false;
+        out_string(c, "CLIENT_ERROR too long meta flags");
+        return;
     }
+    out_string(c, header);
 }
 
 static void process_flush_command(conn *c, token_t *tokens, const size_t ntokens, bool flush_all)
@@ -9486,11 +11308,16 @@ static void process_help_command(conn *c, token_t *tokens, const size_t ntokens)
         "\t" "mget <lenkeys> <numkeys>\\r\\n<\"space separated keys\">\\r\\n" "\n"
         "\t" "incr|decr <key> <delta> [<flags> <exptime> <initial>] [noreply]\\r\\n" "\n"
         "\t" "delete <key> [<time>] [noreply]\\r\\n" "\n"
+        "\t" "mg <key> <flags>*\\r\\n" "\n"
+        "\t" "ms <key> <datalen> <flags>*\\r\\n<data>\\r\\n" "\n"
+        "\t" "md|ma <key> <flags>*\\r\\n" "\n"
+        "\t" "mn\\r\\n" "\n"
         );
     } else if (ntokens > 2 && strcmp(type, "list") == 0) {
         out_string(c,
         "\t" "lop create <key> <attributes> [noreply]\\r\\n" "\n"
         "\t" "lop insert <key> <index> <bytes> [create <attributes>] [noreply|pipe]\\r\\n<data>\\r\\n" "\n"
+        "\t" "lop minsert <key> <index> <count> <lenbytes> [create <attributes>] [noreply|pipe]\\r\\n<data block>\\r\\n" "\n"
         "\t" "lop delete <key> <index or range> [drop] [noreply|pipe]\\r\\n" "\n"
         "\t" "lop get <key> <index or range> [delete|drop]\\r\\n" "\n"
         "\n"
@@ -9500,8 +11327,10 @@ static void process_help_command(conn *c, token_t *tokens, const size_t ntokens)
         out_string(c,
         "\t" "sop create <key> <attributes> [noreply]\\r\\n" "\n"
         "\t" "sop insert <key> <bytes> [create <attributes>] [noreply|pipe]\\r\\n<data>\\r\\n" "\n"
+        "\t" "sop minsert <key> <count> <lenbytes> [create <attributes>] [noreply|pipe]\\r\\n<data block>\\r\\n" "\n"
         "\t" "sop delete <key> <bytes> [drop] [noreply|pipe]\\r\\n<data>\\r\\n" "\n"
-        "\t" "sop get <key> <count> [delete|drop]\\r\\n" "\n"
+        "\t" "sop get <key> <count> [delete|drop] [random]\\r\\n" "\n"
+        "\t" "sop scan <key> <cursor> [<count>]\\r\\n" "\n"
         "\t" "sop exist <key> <bytes> [pipe]\\r\\n<data>\\r\\n" "\n"
         "\n"
         "\t" "* <attributes> : <flags> <exptime> <maxcount> [<ovflaction>] [unreadable]" "\n"
@@ -9513,17 +11342,21 @@ static void process_help_command(conn *c, token_t *tokens, const size_t ntokens)
         "\t" "mop update <key> <field> <bytes> [noreply|pipe]\\r\\n<data>\\r\\n" "\n"
         "\t" "mop delete <key> <lenfields> <numfields> [drop] [noreply|pipe]\\r\\n[<\"space separated fields\">]\\r\\n" "\n"
         "\t" "mop get <key> <lenfields> <numfields> [delete|drop]\\r\\n[<\"space separated fields\">]\\r\\n" "\n"
+        "\t" "mop scan <key> <cursor> [<count>]\\r\\n" "\n"
+        "\t" "mop incr|decr <key> <field> <delta> [<initial>] [noreply|pipe]\\r\\n" "\n"
         "\n"
         "\t" "* <attributes> : <flags> <exptime> <maxcount> [<ovflaction>] [unreadable]" "\n"
         );
     } else if (ntokens > 2 && strcmp(type, "btree") == 0) {
         out_string(c,
-        "\t" "bop create <key> <attributes> [noreply]\\r\\n" "\n"
+        "\t" "bop create <key> <attributes> [eindex <fwhere> <flength>] [noreply]\\r\\n" "\n"
         "\t" "bop insert|upsert <key> <bkey> [<eflag>] <bytes> [create <attributes>] [noreply|pipe|getrim]\\r\\n<data>\\r\\n" "\n"
+        "\t" "bop minsert <key> <count> <lenbytes> [create <attributes>] [noreply|pipe]\\r\\n<data block>\\r\\n" "\n"
         "\t" "bop update <key> <bkey> [<eflag_update>] <bytes> [noreply|pipe]\\r\\n<data>\\r\\n" "\n"
         "\t" "bop delete <key> <bkey or \"bkey range\"> [<eflag_filter>] [<count>] [drop] [noreply|pipe]\\r\\n" "\n"
-        "\t" "bop get <key> <bkey or \"bkey range\"> [<eflag_filter>] [[<offset>] <count>] [delete|drop]\\r\\n" "\n"
+        "\t" "bop get <key> <bkey or \"bkey range\"> [<eflag_filter>] [[<offset>] <count>] [delete|drop|cursor [<cursor>]]\\r\\n" "\n"
         "\t" "bop count <key> <bkey or \"bkey range\"> [<eflag_filter>] \\r\\n" "\n"
+        "\t" "bop aggregate <key> <bkey or \"bkey range\"> [<eflag_filter>] [value|eflag <fwhere> <flength>] [group <fwhere> <flength>]\\r\\n" "\n"
         "\t" "bop incr|decr <key> <bkey> <delta> [<initial> [<eflag>]] [noreply|pipe]\\r\\n" "\n"
         "\t" "bop mget <lenkeys> <numkeys> <bkey or \"bkey range\"> [<eflag_filter>] [<offset>] <count>\\r\\n<\"space separated keys\">\\r\\n" "\n"
         "\t" "bop smget <lenkeys> <numkeys> <bkey or \"bkey range\"> [<eflag_filter>] <count> [duplicate|unique]\\r\\n<\"space separated keys\">\\r\\n" "\n"
@@ -9557,6 +11390,7 @@ static void process_help_command(conn *c, token_t *tokens, const size_t ntokens)
         "\t" "stats prefixes\\r\\n" "\n"
         "\t" "stats detail [on|off|dump]\\r\\n" "\n"
         "\t" "stats scrub\\r\\n" "\n"
+        "\t" "stats coll_del\\r\\n" "\n"
         "\t" "stats dump\\r\\n" "\n"
         "\t" "stats cachedump <slab_clsid> <limit> [forward|backward [sticky]]\\r\\n" "\n"
         "\t" "stats reset\\r\\n" "\n"
@@ -9914,6 +11748,8 @@ static inline int get_coll_create_attr_from_tokens(token_t *tokens, const int nt
 
     attrp->ovflaction = 0; /* undefined : will be set to default later */
     attrp->readable   = 1; /* readable = on */
+    attrp->eifwhere   = 0;
+    attrp->eiflength  = 0; /* no eflag index */
 
     if (ntokens >= 4) {
         if (strcmp(tokens[3].value, "error") == 0) {
@@ -10265,7 +12101,126 @@ static inline int get_list_range_from_str(char *str, int32_t *from_index, int32_
             return -1;
         *to_index = *from_index;
     }
-    return 0;
+    return 0;
+}
+
+static void process_coll_minsert_prepare_nread(conn *c, int cmd, char *key, size_t nkey,
+                                               int32_t index, uint32_t count, int vlen)
+{
+    eitem *elem = NULL;
+
+    ENGINE_ERROR_CODE ret = ENGINE_SUCCESS;
+    if ((uint32_t)vlen > (count * (MINSERT_ELEM_HEAD_LENG + MAX_ELEMENT_BYTES + 2)) + 2) {
+        ret = ENGINE_E2BIG;
+    } else {
+        if ((elem = (eitem *)malloc(sizeof(value_item) + vlen)) == NULL)
+            ret = ENGINE_ENOMEM;
+        else
+            ((value_item*)elem)->len = vlen;
+    }
+
+    switch (ret) {
+    case ENGINE_SUCCESS:
+        c->ritem       = ((value_item *)elem)->ptr;
+        c->rlbytes     = vlen;
+        c->coll_eitem  = (void *)elem;
+        c->coll_ecount = 1;
+        c->coll_op     = cmd;
+        c->coll_key    = key;
+        c->coll_nkey   = nkey;
+        c->coll_index  = index;
+        c->coll_rcount = count;
+        conn_set_state(c, conn_nread);
+        break;
+    case ENGINE_DISCONNECT:
+        c->state = conn_closing;
+        break;
+    default:
+        if (cmd == (int)OPERATION_LOP_MINSERT) {
+            STATS_NOKEY(c, cmd_lop_insert);
+        } else if (cmd == (int)OPERATION_SOP_MINSERT) {
+            STATS_NOKEY(c, cmd_sop_insert);
+        } else {
+            STATS_NOKEY(c, cmd_bop_insert);
+        }
+
+        if (ret == ENGINE_E2BIG) out_string(c, "CLIENT_ERROR too large value");
+        else if (ret == ENGINE_ENOMEM) out_string(c, "SERVER_ERROR out of memory");
+        else handle_unexpected_errorcode_ascii(c, ret);
+
+        /* swallow the data line */
+        c->write_and_go = conn_swallow;
+        c->sbytes = vlen;
+    }
+}
+
+/*
+ * lop minsert <key> <index> <count> <lenbytes> [create <attributes>] [noreply|pipe]\r\n<data block>\r\n
+ * sop minsert <key> <count> <lenbytes> [create <attributes>] [noreply|pipe]\r\n<data block>\r\n
+ * bop minsert <key> <count> <lenbytes> [create <attributes>] [noreply|pipe]\r\n<data block>\r\n
+ */
+static void process_coll_minsert_command(conn *c, token_t *tokens, const size_t ntokens, int cmd)
+{
+    ENGINE_ITEM_TYPE type = get_coll_minsert_type(cmd);
+    int key_token = (type == ITEM_TYPE_LIST ? LOP_KEY_TOKEN
+                   : (type == ITEM_TYPE_SET ? SOP_KEY_TOKEN : BOP_KEY_TOKEN));
+    char *key = tokens[key_token].value;
+    size_t nkey = tokens[key_token].length;
+    int32_t index = 0;
+    uint32_t count;
+    int32_t vlen;
+    int read_ntokens = key_token + 1;
+
+    set_pipe_noreply_maybe(c, tokens, ntokens);
+
+    if (type == ITEM_TYPE_LIST) {
+        if (! safe_strtol(tokens[read_ntokens].value, &index)) {
+            print_invalid_command(c, tokens, ntokens);
+            out_string(c, "CLIENT_ERROR bad command line format");
+            return;
+        }
+        read_ntokens++;
+    }
+    if ((! safe_strtoul(tokens[read_ntokens].value, &count)) ||
+        (! safe_strtol(tokens[read_ntokens+1].value, &vlen)) ||
+        (count == 0 || count > MAX_MINSERT_ELM_COUNT) ||
+        (vlen < 0 || vlen > (INT_MAX-2))) {
+        print_invalid_command(c, tokens, ntokens);
+        out_string(c, "CLIENT_ERROR bad command line format");
+        return;
+    }
+    vlen += 2;
+    read_ntokens += 2;
+
+    int post_ntokens = 1 + (c->noreply ? 1 : 0);
+    int rest_ntokens = ntokens - read_ntokens - post_ntokens;
+
+    if (rest_ntokens >= 2) {
+        if (strcmp(tokens[read_ntokens].value, "create") != 0) {
+            print_invalid_command(c, tokens, ntokens);
+            out_string(c, "CLIENT_ERROR bad command line format");
+            return;
+        }
+
+        c->coll_attrp = &c->coll_attr_space; /* create if not exist */
+        if (get_coll_create_attr_from_tokens(&tokens[read_ntokens+1], rest_ntokens-1,
+                                             type, c->coll_attrp) != 0) {
+            print_invalid_command(c, tokens, ntokens);
+            out_string(c, "CLIENT_ERROR bad command line format");
+            return;
+        }
+    } else {
+        if (rest_ntokens != 0) {
+            print_invalid_command(c, tokens, ntokens);
+            out_string(c, "CLIENT_ERROR bad command line format");
+            return;
+        }
+        c->coll_attrp = NULL;
+    }
+
+    if (check_and_handle_pipe_state(c, vlen)) {
+        process_coll_minsert_prepare_nread(c, cmd, key, nkey, index, count, vlen);
+    }
 }
 
 static void process_lop_command(conn *c, token_t *tokens, const size_t ntokens)
@@ -10326,6 +12281,10 @@ static void process_lop_command(conn *c, token_t *tokens, const size_t ntokens)
             process_lop_prepare_nread(c, (int)OPERATION_LOP_INSERT, vlen, key, nkey, index);
         }
     }
+    else if ((ntokens >= 7 && ntokens <= 14) && (strcmp(subcommand, "minsert") == 0))
+    {
+        process_coll_minsert_command(c, tokens, ntokens, (int)OPERATION_LOP_MINSERT);
+    }
     else if ((ntokens >= 7 && ntokens <= 10) && (strcmp(subcommand, "create") == 0))
     {
         set_noreply_maybe(c, tokens, ntokens);
@@ -10410,34 +12369,103 @@ static void process_lop_command(conn *c, token_t *tokens, const size_t ntokens)
     }
 }
 
-static void process_sop_get(conn *c, char *key, size_t nkey, uint32_t count,
-                            bool delete, bool drop_if_empty)
+static uint32_t sop_get_req_count(uint32_t count)
 {
-    eitem  **elem_array = NULL;
-    uint32_t elem_count;
-    uint32_t req_count = count;
-    uint32_t flags, i;
-    bool     dropped;
-    int      need_size;
-
-    assert(c->ewouldblock == false);
+    return (count <= 0 || count > MAX_SET_SIZE) ? MAX_SET_SIZE : count;
+}
 
-    ENGINE_ERROR_CODE ret = ENGINE_SUCCESS;
+/* Gets the elements of sop get by an engine call. */
+static void process_sop_get_all(conn *c)
+{
+    uint32_t elem_count = 0;
 
-    if (req_count <= 0 || req_count > MAX_SET_SIZE) req_count = MAX_SET_SIZE;
-    need_size = req_count * sizeof(eitem*);
-    if ((elem_array = (eitem **)malloc(need_size)) == NULL) {
-        out_string(c, "SERVER_ERROR out of memory");
-        return;
+    c->heavy.ret = mc_engine.v1->set_elem_get(mc_engine.v0, c, c->coll_key, c->coll_nkey,
+                                              sop_get_req_count(c->coll_rcount),
+                                              c->coll_delete, c->coll_drop, c->heavy.random,
+                                              (eitem **)c->coll_eitem, &elem_count,
+                                              &c->heavy.flags, &c->heavy.dropped, 0);
+    if (c->heavy.ret == ENGINE_EWOULDBLOCK) {
+        c->heavy.ret = ENGINE_SUCCESS;
     }
+    c->coll_ecount = elem_count;
+}
 
-    ret = mc_engine.v1->set_elem_get(mc_engine.v0, c, key, nkey, req_count,
-                                     delete, drop_if_empty, elem_array, &elem_count,
-                                     &flags, &dropped, 0);
+/*
+ * Gets the next elements of sop get, at most heavy_threshold of them by an
+ * engine call, so that the cache lock is not held long. The engine keeps
+ * a reference to the set in c->heavy.set across the calls, and fails the
+ * get if the key no longer maps to that set.
+ * Returns true if more elements are to be got.
+ */
+static bool process_sop_get_chunk(conn *c)
+{
+    eitem  **elem_array = (eitem **)c->coll_eitem + c->coll_ecount;
+    uint32_t req_count = sop_get_req_count(c->coll_rcount);
+    uint32_t count = req_count - c->coll_ecount;
+    uint32_t elem_count = 0;
+    uint32_t flags = 0;
+    bool     dropped = false;
+    ENGINE_ERROR_CODE ret;
+
+    assert(count > 0); /* the count 0 gets all elements */
+    if (count > settings.heavy_threshold) {
+        count = settings.heavy_threshold;
+    }
+    ret = mc_engine.v1->set_elem_get_chunk(mc_engine.v0, c, c->coll_key, c->coll_nkey,
+                                           &c->heavy.set, &c->heavy.cursor, count,
+                                           c->coll_delete, c->coll_drop, c->heavy.random,
+                                           elem_array, &elem_count, &flags, &dropped, 0);
     if (ret == ENGINE_EWOULDBLOCK) {
-        c->ewouldblock = true;
         ret = ENGINE_SUCCESS;
     }
+    if (ret != ENGINE_SUCCESS) {
+        /* The set emptied by the other clients ends the get. The set
+         * deleted or replaced fails the get with the elements got so far.
+         */
+        if (ret != ENGINE_ELEM_ENOENT || c->coll_ecount == 0) {
+            c->heavy.ret = ret;
+        }
+        return false;
+    }
+    c->heavy.flags = flags;
+    c->heavy.dropped = dropped;
+    c->coll_ecount += elem_count;
+    if (c->coll_ecount >= req_count) {
+        return false;
+    }
+    return c->coll_delete ? (elem_count == count && !dropped) : (c->heavy.cursor != 0);
+}
+
+static void process_sop_get_response(conn *c)
+{
+    eitem  **elem_array = (eitem **)c->coll_eitem;
+    uint32_t req_count = sop_get_req_count(c->coll_rcount);
+    uint32_t elem_count = c->coll_ecount;
+    uint32_t flags = c->heavy.flags;
+    uint32_t i;
+    bool     dropped = c->heavy.dropped;
+    bool     delete = c->coll_delete;
+    char    *key = c->coll_key;
+    size_t   nkey = c->coll_nkey;
+    int      need_size;
+
+    ENGINE_ERROR_CODE ret = c->heavy.ret;
+    c->coll_eitem = NULL;
+
+    if (c->heavy.set != NULL) {
+        mc_engine.v1->release(mc_engine.v0, c, c->heavy.set);
+        c->heavy.set = NULL;
+    }
+    if (ret != ENGINE_SUCCESS && elem_count > 0) {
+        /* the chunked get has failed after some chunks */
+        mc_engine.v1->set_elem_release(mc_engine.v0, c, elem_array, elem_count);
+        elem_count = 0;
+    } else if (elem_count > req_count) {
+        /* the scan returns the elements of a hash value all together */
+        mc_engine.v1->set_elem_release(mc_engine.v0, c, &elem_array[req_count],
+                                       elem_count - req_count);
+        elem_count = req_count;
+    }
 
     if (settings.detail_enabled) {
         stats_prefix_record_sop_get(key, nkey, (ret==ENGINE_SUCCESS || ret==ENGINE_ELEM_ENOENT));
@@ -10450,11 +12478,11 @@ static void process_sop_get(conn *c, char *key, size_t nkey, uint32_t count,
             struct lq_detect_argument argument;
             char *bufptr = argument.range;
 
-            snprintf(bufptr, 16, "%d", count);
+            snprintf(bufptr, 16, "%d", c->coll_rcount);
             argument.overhead = elem_count;
-            argument.count = count;
+            argument.count = c->coll_rcount;
             argument.delete_or_drop = 0;
-            if (drop_if_empty) {
+            if (c->coll_drop) {
                 argument.delete_or_drop = 2;
             } else if (delete) {
                 argument.delete_or_drop = 1;
@@ -10508,6 +12536,172 @@ static void process_sop_get(conn *c, char *key, size_t nkey, uint32_t count,
             }
         } while(0);
 
+        if (ret == ENGINE_SUCCESS) {
+            STATS_ELEM_HITS(c, sop_get, key, nkey);
+            c->coll_eitem  = (void *)elem_array;
+            c->coll_ecount = elem_count;
+            c->coll_resps  = respbuf;
+            c->coll_op     = OPERATION_SOP_GET;
+            conn_set_state(c, conn_mwrite);
+            c->msgcurr     = 0;
+        } else { /* ENGINE_ENOMEM */
+            STATS_NOKEY(c, cmd_sop_get);
+            mc_engine.v1->set_elem_release(mc_engine.v0, c, elem_array, elem_count);
+            free(respbuf);
+            out_string(c, "SERVER_ERROR out of memory writing get response");
+        }
+        }
+        break;
+    case ENGINE_ELEM_ENOENT:
+        STATS_NONE_HITS(c, sop_get, key, nkey);
+        out_string(c, "NOT_FOUND_ELEMENT");
+        break;
+    case ENGINE_DISCONNECT:
+        c->state = conn_closing;
+        break;
+    case ENGINE_KEY_ENOENT:
+    case ENGINE_UNREADABLE:
+        STATS_MISS(c, sop_get, key, nkey);
+        if (ret == ENGINE_KEY_ENOENT) out_string(c, "NOT_FOUND");
+        else                          out_string(c, "UNREADABLE");
+        break;
+    default:
+        STATS_NOKEY(c, cmd_sop_get);
+        if (ret == ENGINE_EBADTYPE) out_string(c, "TYPE_MISMATCH");
+        else if (ret == ENGINE_ENOTSUP) out_string(c, "NOT_SUPPORTED");
+        else handle_unexpected_errorcode_ascii(c, ret);
+    }
+
+    if (ret != ENGINE_SUCCESS && elem_array != NULL) {
+        free((void *)elem_array);
+    }
+}
+
+/* Gets the rest of the elements and builds the response on a heavy thread. */
+static void process_sop_get_execute(conn *c)
+{
+    while (process_sop_get_chunk(c));
+    process_sop_get_response(c);
+}
+
+static void process_sop_get(conn *c, char *key, size_t nkey, uint32_t count,
+                            bool delete, bool drop_if_empty, bool random)
+{
+    uint32_t req_count = sop_get_req_count(count);
+    /* The elements are got in chunks if the heavy threads may take the rest.
+     * The random get without delete cannot take them in turn.
+     */
+    bool chunked = (settings.heavy_threads > 0 && !IS_UDP(c->transport) &&
+                    (delete || !random));
+
+    assert(c->ewouldblock == false);
+
+    c->coll_eitem = malloc((req_count + (chunked ? MAX_SCAN_HASH_GROUP : 0)) * sizeof(eitem*));
+    if (c->coll_eitem == NULL) {
+        out_string(c, "SERVER_ERROR out of memory");
+        return;
+    }
+    c->coll_key = key;
+    c->coll_nkey = nkey;
+    c->coll_rcount = count;
+    c->coll_delete = delete;
+    c->coll_drop = drop_if_empty;
+    c->coll_ecount = 0;
+    c->heavy.ret = ENGINE_SUCCESS;
+    c->heavy.random = random;
+    c->heavy.cursor = 0;
+    c->heavy.set = NULL;
+
+    if (chunked) {
+        /* The first chunk is got by the worker thread. If it is full,
+         * the rest is left to a heavy thread.
+         */
+        if (process_sop_get_chunk(c)) {
+            if (heavy_cmd_offload(c, c->coll_ecount, process_sop_get_execute, NULL)) {
+                return;
+            }
+            while (process_sop_get_chunk(c));
+        }
+    } else {
+        process_sop_get_all(c);
+    }
+    process_sop_get_response(c);
+}
+
+static void process_sop_scan(conn *c, char *key, size_t nkey,
+                             uint32_t cursor, uint32_t count)
+{
+    eitem  **elem_array = NULL;
+    uint32_t elem_count;
+    uint32_t next_cursor;
+    uint32_t req_count = count;
+    uint32_t flags, i;
+    int      need_size;
+
+    assert(c->ewouldblock == false);
+
+    ENGINE_ERROR_CODE ret = ENGINE_SUCCESS;
+
+    if (req_count == 0) req_count = SCAN_DEFAULT_COUNT;
+    assert(req_count <= MAX_SCAN_COUNT);
+    /* the elements of the same hash value can be returned beyond the count */
+    need_size = (req_count > MAX_SCAN_HASH_GROUP ? req_count : MAX_SCAN_HASH_GROUP) * sizeof(eitem*);
+    if ((elem_array = (eitem **)malloc(need_size)) == NULL) {
+        out_string(c, "SERVER_ERROR out of memory");
+        return;
+    }
+
+    ret = mc_engine.v1->set_elem_scan(mc_engine.v0, c, key, nkey, cursor, req_count,
+                                      elem_array, &elem_count, &next_cursor, &flags, 0);
+    if (ret == ENGINE_EWOULDBLOCK) {
+        c->ewouldblock = true;
+        ret = ENGINE_SUCCESS;
+    }
+
+    if (settings.detail_enabled) {
+        stats_prefix_record_sop_get(key, nkey, (ret==ENGINE_SUCCESS || ret==ENGINE_ELEM_ENOENT));
+    }
+
+    switch (ret) {
+    case ENGINE_SUCCESS:
+        {
+        char *respbuf; /* response string buffer */
+        char *respptr;
+
+        do {
+            need_size = ((3*lenstr_size) + 30) /* response head and tail size */
+                      + (elem_count * (lenstr_size+2)); /* response body size */
+            if ((respbuf = (char*)malloc(need_size)) == NULL) {
+                ret = ENGINE_ENOMEM; break;
+            }
+            respptr = respbuf;
+
+            sprintf(respptr, "VALUE %u %u %u\r\n", htonl(flags), elem_count, next_cursor);
+            if (add_iov(c, respptr, strlen(respptr)) != 0) {
+                ret = ENGINE_ENOMEM; break;
+            }
+            respptr += strlen(respptr);
+
+            for (i = 0; i < elem_count; i++) {
+                mc_engine.v1->get_elem_info(mc_engine.v0, c, ITEM_TYPE_SET,
+                                            elem_array[i], &c->einfo);
+                sprintf(respptr, "%u ", c->einfo.nbytes-2);
+                if ((add_iov(c, respptr, strlen(respptr)) != 0) ||
+                    (add_iov_einfo_value(c, &c->einfo) != 0))
+                {
+                    ret = ENGINE_ENOMEM; break;
+                }
+                respptr += strlen(respptr);
+            }
+            if (ret == ENGINE_ENOMEM) break;
+
+            sprintf(respptr, "END\r\n");
+            if ((add_iov(c, respptr, strlen(respptr)) != 0) ||
+                (IS_UDP(c->transport) && build_udp_headers(c) != 0)) {
+                ret = ENGINE_ENOMEM; break;
+            }
+        } while(0);
+
         if (ret == ENGINE_SUCCESS) {
             STATS_ELEM_HITS(c, sop_get, key, nkey);
             c->coll_eitem  = (void *)elem_array;
@@ -10705,6 +12899,10 @@ static void process_sop_command(conn *c, token_t *tokens, const size_t ntokens)
             process_sop_prepare_nread(c, (int)OPERATION_SOP_INSERT, vlen, key, nkey);
         }
     }
+    else if ((ntokens >= 6 && ntokens <= 13) && (strcmp(subcommand, "minsert") == 0))
+    {
+        process_coll_minsert_command(c, tokens, ntokens, (int)OPERATION_SOP_MINSERT);
+    }
     else if ((ntokens >= 7 && ntokens <= 10) && (strcmp(subcommand, "create") == 0))
     {
         set_noreply_maybe(c, tokens, ntokens);
@@ -10776,11 +12974,13 @@ static void process_sop_command(conn *c, token_t *tokens, const size_t ntokens)
             process_sop_prepare_nread(c, (int)OPERATION_SOP_EXIST, vlen, key, nkey);
         }
     }
-    else if ((ntokens==5 || ntokens==6) && (strcmp(subcommand, "get") == 0))
+    else if ((ntokens >= 5 && ntokens <= 7) && (strcmp(subcommand, "get") == 0))
     {
         bool delete = false;
         bool drop_if_empty = false;
+        bool random = false;
         uint32_t count = 0;
+        int read_ntokens = SOP_KEY_TOKEN+2;
 
         if (! safe_strtoul(tokens[SOP_KEY_TOKEN+1].value, &count)) {
             print_invalid_command(c, tokens, ntokens);
@@ -10788,32 +12988,202 @@ static void process_sop_command(conn *c, token_t *tokens, const size_t ntokens)
             return;
         }
 
-        if (ntokens == 6) {
-            if (strcmp(tokens[SOP_KEY_TOKEN+2].value, "delete")==0) {
+        if (ntokens > (read_ntokens+1)) {
+            if (strcmp(tokens[read_ntokens].value, "delete")==0) {
                 delete = true;
-            } else if (strcmp(tokens[SOP_KEY_TOKEN+2].value, "drop")==0) {
+                read_ntokens += 1;
+            } else if (strcmp(tokens[read_ntokens].value, "drop")==0) {
                 delete = true;
                 drop_if_empty = true;
-            } else {
-                print_invalid_command(c, tokens, ntokens);
-                out_string(c, "CLIENT_ERROR bad command line format");
-                return;
+                read_ntokens += 1;
             }
         }
-
-        process_sop_get(c, key, nkey, count, delete, drop_if_empty);
+        if (ntokens > (read_ntokens+1)) {
+            if (strcmp(tokens[read_ntokens].value, "random")==0) {
+                random = true;
+                read_ntokens += 1;
+            }
+        }
+        if (ntokens != (read_ntokens+1)) {
+            print_invalid_command(c, tokens, ntokens);
+            out_string(c, "CLIENT_ERROR bad command line format");
+            return;
+        }
+
+        process_sop_get(c, key, nkey, count, delete, drop_if_empty, random);
+    }
+    else if ((ntokens >= 5 && ntokens <= 6) && (strcmp(subcommand, "scan") == 0))
+    {
+        uint32_t cursor = 0;
+        uint32_t count = 0;
+
+        if ((! safe_strtoul(tokens[SOP_KEY_TOKEN+1].value, &cursor)) ||
+            (ntokens == 6 && ! safe_strtoul(tokens[SOP_KEY_TOKEN+2].value, &count))) {
+            print_invalid_command(c, tokens, ntokens);
+            out_string(c, "CLIENT_ERROR bad command line format");
+            return;
+        }
+        if (count > MAX_SCAN_COUNT) {
+            out_string(c, "CLIENT_ERROR bad value");
+            return;
+        }
+
+        process_sop_scan(c, key, nkey, cursor, count);
+    }
+    else
+    {
+        print_invalid_command(c, tokens, ntokens);
+        out_string(c, "CLIENT_ERROR bad command line format");
+    }
+}
+
+/*
+ * bop get cursor
+ * The cursor is the next from bkey of the bkey range in the scan direction.
+ * It is a hexadecimal string of <nbkey(1 byte)><bkey>, and
+ * the uint64 bkey is encoded with nbkey 0 and 8 bytes in big-endian order.
+ * The cursor "0" means that no more elements remain within the bkey range.
+ */
+#define BOP_CURSOR_MAX_LENG ((1+MAX_BKEY_LENG)*2)
+
+static int bop_bkey_comp(const unsigned char *bkey1, const uint8_t nbkey1,
+                         const unsigned char *bkey2, const uint8_t nbkey2)
+{
+    if (nbkey1 == 0 && nbkey2 == 0) {
+        uint64_t val1 = *(uint64_t*)bkey1;
+        uint64_t val2 = *(uint64_t*)bkey2;
+        return (val1 == val2 ? 0 : (val1 < val2 ? -1 : 1));
+    } else {
+        int res = memcmp(bkey1, bkey2, (nbkey1 < nbkey2 ? nbkey1 : nbkey2));
+        if (res != 0) return res;
+        return (nbkey1 == nbkey2 ? 0 : (nbkey1 < nbkey2 ? -1 : 1));
+    }
+}
+
+/* get the bkey right after the given bkey in the scan direction */
+static bool bop_next_bkey(const unsigned char *bkey, const uint8_t nbkey, const bool ascending,
+                          unsigned char *next, uint8_t *nnext)
+{
+    if (nbkey == 0) { /* uint64 bkey */
+        uint64_t val = *(uint64_t*)bkey;
+        if (val == (ascending ? UINT64_MAX : 0)) {
+            return false;
+        }
+        val = (ascending ? val+1 : val-1);
+        memcpy(next, &val, sizeof(uint64_t));
+        *nnext = 0;
+        return true;
+    }
+
+    memcpy(next, bkey, nbkey);
+    if (ascending) {
+        if (nbkey < MAX_BKEY_LENG) { /* append 0x00 */
+            next[nbkey] = 0x00;
+            *nnext = nbkey + 1;
+        } else { /* increase the last byte less than 0xFF, and cut the rest */
+            int i = nbkey - 1;
+            while (i >= 0 && next[i] == 0xFF) i--;
+            if (i < 0) return false;
+            next[i] += 1;
+            *nnext = i + 1;
+        }
+    } else {
+        if (next[nbkey-1] == 0x00) { /* remove the last 0x00 */
+            if (nbkey == 1) return false;
+            *nnext = nbkey - 1;
+        } else { /* decrease the last byte, and fill the rest with 0xFF */
+            next[nbkey-1] -= 1;
+            memset(&next[nbkey], 0xFF, MAX_BKEY_LENG - nbkey);
+            *nnext = MAX_BKEY_LENG;
+        }
+    }
+    return true;
+}
+
+static void make_bop_cursor_string(char *cursor, const bkey_range *bkrange,
+                                   const unsigned char *last_bkey, const uint8_t last_nbkey)
+{
+    unsigned char next[MAX_BKEY_LENG];
+    unsigned char temp[1+MAX_BKEY_LENG];
+    uint8_t nnext;
+    bool ascending;
+    int res;
+
+    if (bkrange->to_nbkey == BKEY_NULL) { /* single bkey */
+        strcpy(cursor, "0"); return;
+    }
+    ascending = (bop_bkey_comp(bkrange->from_bkey, bkrange->from_nbkey,
+                               bkrange->to_bkey, bkrange->to_nbkey) <= 0);
+    if (! bop_next_bkey(last_bkey, last_nbkey, ascending, next, &nnext)) {
+        strcpy(cursor, "0"); return;
+    }
+    res = bop_bkey_comp(next, nnext, bkrange->to_bkey, bkrange->to_nbkey);
+    if ((ascending && res > 0) || (!ascending && res < 0)) {
+        strcpy(cursor, "0"); return;
+    }
+
+    temp[0] = nnext;
+    if (nnext == 0) {
+        uint64_t val = *(uint64_t*)next;
+        for (int i = 0; i < sizeof(uint64_t); i++) {
+            temp[1+i] = (unsigned char)(val >> (56 - 8*i));
+        }
+        safe_hexatostr(temp, 1+sizeof(uint64_t), cursor);
+    } else {
+        memcpy(&temp[1], next, nnext);
+        safe_hexatostr(temp, 1+nnext, cursor);
+    }
+}
+
+/* set the cursor to the from bkey of the bkey range */
+static int get_bop_cursor_from_str(const char *str, bkey_range *bkrange)
+{
+    unsigned char temp[1+MAX_BKEY_LENG];
+    unsigned char bkey[MAX_BKEY_LENG];
+    uint8_t nbkey;
+    int size = strlen(str) / 2;
+    int res_from, res_to;
+
+    if (bkrange->to_nbkey == BKEY_NULL ||
+        ! safe_strtohexa(str, temp, 1+MAX_BKEY_LENG)) {
+        return -1;
+    }
+    nbkey = temp[0];
+    if (nbkey == 0) { /* uint64 bkey */
+        uint64_t val = 0;
+        if (size != 1+sizeof(uint64_t) || bkrange->from_nbkey != 0) {
+            return -1;
+        }
+        for (int i = 1; i <= sizeof(uint64_t); i++) {
+            val = (val << 8) | temp[i];
+        }
+        memcpy(bkey, &val, sizeof(uint64_t));
+    } else {
+        if (nbkey > MAX_BKEY_LENG || size != 1+nbkey || bkrange->from_nbkey == 0) {
+            return -1;
+        }
+        memcpy(bkey, &temp[1], nbkey);
     }
-    else
-    {
-        print_invalid_command(c, tokens, ntokens);
-        out_string(c, "CLIENT_ERROR bad command line format");
+
+    /* the cursor must be within the bkey range */
+    res_from = bop_bkey_comp(bkey, nbkey, bkrange->from_bkey, bkrange->from_nbkey);
+    res_to   = bop_bkey_comp(bkey, nbkey, bkrange->to_bkey, bkrange->to_nbkey);
+    if (bop_bkey_comp(bkrange->from_bkey, bkrange->from_nbkey,
+                      bkrange->to_bkey, bkrange->to_nbkey) <= 0) {
+        if (res_from < 0 || res_to > 0) return -1;
+    } else {
+        if (res_from > 0 || res_to < 0) return -1;
     }
+    memcpy(bkrange->from_bkey, bkey, (nbkey == 0 ? sizeof(uint64_t) : nbkey));
+    bkrange->from_nbkey = nbkey;
+    return 0;
 }
 
 static void process_bop_get(conn *c, char *key, size_t nkey,
                             const bkey_range *bkrange, const eflag_filter *efilter,
                             const uint32_t offset, const uint32_t count,
-                            const bool delete, const bool drop_if_empty)
+                            const bool delete, const bool drop_if_empty,
+                            const bool use_cursor)
 {
     eitem  **elem_array = NULL;
     uint32_t elem_count;
@@ -10886,14 +13256,26 @@ static void process_bop_get(conn *c, char *key, size_t nkey,
         int   resplen;
 
         do {
-            need_size = ((2*lenstr_size) + 30) /* response head and tail size */
+            need_size = ((2*lenstr_size) + 30 + BOP_CURSOR_MAX_LENG) /* response head and tail size */
                       + (elem_count * ((MAX_BKEY_LENG*2+2) + (MAX_EFLAG_LENG*2+2) + lenstr_size+3)); /* response body size */
             if ((respbuf = (char*)malloc(need_size)) == NULL) {
                 ret = ENGINE_ENOMEM; break;
             }
             respptr = respbuf;
 
-            sprintf(respptr, "VALUE %u %u\r\n", htonl(flags), elem_count);
+            if (use_cursor) {
+                char cursor[BOP_CURSOR_MAX_LENG+1];
+                if (count > 0 && elem_count == count) {
+                    mc_engine.v1->get_elem_info(mc_engine.v0, c, ITEM_TYPE_BTREE,
+                                                elem_array[elem_count-1], &c->einfo);
+                    make_bop_cursor_string(cursor, bkrange, c->einfo.score, c->einfo.nscore);
+                } else { /* all elements within the bkey range are found */
+                    strcpy(cursor, "0");
+                }
+                sprintf(respptr, "VALUE %u %u %s\r\n", htonl(flags), elem_count, cursor);
+            } else {
+                sprintf(respptr, "VALUE %u %u\r\n", htonl(flags), elem_count);
+            }
             if (add_iov(c, respptr, strlen(respptr)) != 0) {
                 ret = ENGINE_ENOMEM; break;
             }
@@ -10960,6 +13342,7 @@ static void process_bop_get(conn *c, char *key, size_t nkey,
         STATS_NOKEY(c, cmd_bop_get);
         if (ret == ENGINE_EBADTYPE)      out_string(c, "TYPE_MISMATCH");
         else if (ret == ENGINE_EBADBKEY) out_string(c, "BKEY_MISMATCH");
+        else if (ret == ENGINE_ENOMEM)   out_string(c, "SERVER_ERROR out of memory");
         else if (ret == ENGINE_ENOTSUP)  out_string(c, "NOT_SUPPORTED");
         else handle_unexpected_errorcode_ascii(c, ret);
     }
@@ -11031,6 +13414,96 @@ static void process_bop_count(conn *c, char *key, size_t nkey,
     }
 }
 
+/* max length of a bop aggregate response line:
+ * [<group field>] <count> [<sum> <min> <max> <avg>]\r\n
+ */
+#define BOP_AGGR_LINE_MAX_LENG ((2+MAX_EFLAG_LENG*2+1) + (10+1) + (20+1)*3 + 32 + 2)
+
+static void process_bop_aggregate(conn *c, char *key, size_t nkey,
+                                  const bkey_range *bkrange, const eflag_filter *efilter,
+                                  const bop_aggr_spec *spec)
+{
+    bop_aggr_result result;
+    bop_aggr_group *group;
+    char    *respbuf = NULL;
+    char    *respptr;
+    uint32_t i;
+
+    ENGINE_ERROR_CODE ret;
+
+    result.group_arrsz = (spec->glength > 0 ? MAX_BOP_AGGR_GROUPS : 1);
+    result.groups = (bop_aggr_group *)malloc(result.group_arrsz * sizeof(bop_aggr_group));
+    if (result.groups == NULL) {
+        out_string(c, "SERVER_ERROR out of memory");
+        return;
+    }
+
+    ret = mc_engine.v1->btree_elem_aggregate(mc_engine.v0, c, key, nkey, bkrange, efilter,
+                                             spec, &result, 0);
+
+    /* bop aggregate is accounted as bop count in the stats */
+    if (settings.detail_enabled) {
+        stats_prefix_record_bop_count(key, nkey, (ret==ENGINE_SUCCESS || ret==ENGINE_ELEM_ENOENT));
+    }
+
+    if (ret == ENGINE_SUCCESS) {
+        respbuf = (char *)malloc(64 + result.group_count * BOP_AGGR_LINE_MAX_LENG);
+        if (respbuf == NULL) {
+            ret = ENGINE_ENOMEM;
+        } else {
+            respptr = respbuf;
+            respptr += sprintf(respptr, "AGGREGATED %u\r\n", result.group_count);
+            for (i = 0; i < result.group_count; i++) {
+                group = &result.groups[i];
+                if (spec->glength > 0) {
+                    respptr += sprintf(respptr, "0x");
+                    safe_hexatostr(group->gfield, spec->glength, respptr);
+                    respptr += strlen(respptr);
+                    *respptr++ = ' ';
+                }
+                respptr += sprintf(respptr, "%u", group->count);
+                if (spec->operand != BOP_AGGR_OPERAND_NONE) {
+                    respptr += sprintf(respptr, " %"PRId64" %"PRId64" %"PRId64" %.3f",
+                                       group->sum, group->min, group->max,
+                                       (double)group->sum / group->count);
+                }
+                respptr += sprintf(respptr, "\r\n");
+            }
+            respptr += sprintf(respptr, "END\r\n");
+        }
+    }
+
+    switch (ret) {
+    case ENGINE_SUCCESS:
+        STATS_HITS(c, bop_count, key, nkey);
+        write_and_free(c, respbuf, respptr - respbuf);
+        break;
+    case ENGINE_ELEM_ENOENT:
+        STATS_HITS(c, bop_count, key, nkey);
+        out_string(c, "NOT_FOUND_ELEMENT");
+        break;
+    case ENGINE_DISCONNECT:
+        c->state = conn_closing;
+        break;
+    case ENGINE_KEY_ENOENT:
+    case ENGINE_UNREADABLE:
+        STATS_MISS(c, bop_count, key, nkey);
+        if (ret == ENGINE_KEY_ENOENT) out_string(c, "NOT_FOUND");
+        else                          out_string(c, "UNREADABLE");
+        break;
+    default:
+        STATS_NOKEY(c, cmd_bop_count);
+        if (ret == ENGINE_EBADTYPE)        out_string(c, "TYPE_MISMATCH");
+        else if (ret == ENGINE_EBADBKEY)   out_string(c, "BKEY_MISMATCH");
+        else if (ret == ENGINE_EOVERFLOW)  out_string(c, "OVERFLOWED");
+        else if (ret == ENGINE_E2BIG)      out_string(c, "CLIENT_ERROR too many groups");
+        else if (ret == ENGINE_ENOMEM)     out_string(c, "SERVER_ERROR out of memory");
+        else if (ret == ENGINE_ENOTSUP)    out_string(c, "NOT_SUPPORTED");
+        else handle_unexpected_errorcode_ascii(c, ret);
+    }
+    free(result.groups);
+}
+
 static void process_bop_position(conn *c, char *key, size_t nkey,
                                  const bkey_range *bkrange, ENGINE_BTREE_ORDER order)
 {
@@ -11177,6 +13650,7 @@ static void process_bop_pwg(conn *c, char *key, size_t nkey, const bkey_range *b
         STATS_NOKEY(c, cmd_bop_pwg);
         if (ret == ENGINE_EBADTYPE)      out_string(c, "TYPE_MISMATCH");
         else if (ret == ENGINE_EBADBKEY) out_string(c, "BKEY_MISMATCH");
+        else if (ret == ENGINE_ENOMEM)   out_string(c, "SERVER_ERROR out of memory");
         else if (ret == ENGINE_ENOTSUP)  out_string(c, "NOT_SUPPORTED");
         else handle_unexpected_errorcode_ascii(c, ret);
     }
@@ -11307,6 +13781,7 @@ static void process_bop_gbp(conn *c, char *key, size_t nkey, ENGINE_BTREE_ORDER
     default:
         STATS_NOKEY(c, cmd_bop_gbp);
         if (ret == ENGINE_EBADTYPE)      out_string(c, "TYPE_MISMATCH");
+        else if (ret == ENGINE_ENOMEM)   out_string(c, "SERVER_ERROR out of memory");
         else if (ret == ENGINE_ENOTSUP)  out_string(c, "NOT_SUPPORTED");
         else handle_unexpected_errorcode_ascii(c, ret);
     }
@@ -11678,30 +14153,6 @@ static void process_bop_arithmetic(conn *c, char *key, size_t nkey, bkey_range *
     }
 }
 
-static inline int get_bkey_from_str(const char *str, unsigned char *bkey)
-{
-    if (strncmp(str, "0x", 2) == 0) { /* hexadeciaml bkey */
-        if (safe_strtohexa(str+2, bkey, MAX_BKEY_LENG)) {
-            return (strlen(str+2)/2);
-        }
-    } else { /* 64 bit unsigned integer */
-        if (safe_strtoull(str, (uint64_t*)bkey)) {
-            return 0;
-        }
-    }
-    return -1;
-}
-
-static inline int get_eflag_from_str(const char *str, unsigned char *eflag)
-{
-    if (strncmp(str, "0x", 2) == 0) {
-        if (safe_strtohexa(str+2, eflag, MAX_EFLAG_LENG)) {
-            return (strlen(str+2)/2);
-        }
-    }
-    return -1;
-}
-
 static inline int get_bkey_range_from_str(const char *str, bkey_range *bkrange)
 {
     char *delimiter = strstr(str, "..");
@@ -11893,100 +14344,285 @@ static void process_mop_prepare_nread(conn *c, int cmd, char *key, size_t nkey,
             c->ritem   = ((value_item *)elem)->ptr;
             c->rlbytes = vlen;
         }
-        c->coll_eitem  = (void *)elem;
-        c->coll_ecount = 1;
-        c->coll_op     = cmd;
-        c->coll_key    = key;
-        c->coll_nkey   = nkey;
-        c->coll_field  = *field;
-        conn_set_state(c, conn_nread);
-        break;
+        c->coll_eitem  = (void *)elem;
+        c->coll_ecount = 1;
+        c->coll_op     = cmd;
+        c->coll_key    = key;
+        c->coll_nkey   = nkey;
+        c->coll_field  = *field;
+        conn_set_state(c, conn_nread);
+        break;
+        }
+    case ENGINE_DISCONNECT:
+        c->state = conn_closing;
+        break;
+    default:
+        if (cmd == OPERATION_MOP_INSERT) {
+            STATS_NOKEY(c, cmd_mop_insert);
+        } else if (cmd == OPERATION_MOP_UPDATE) {
+            STATS_NOKEY(c, cmd_mop_update);
+        }
+
+        if (ret == ENGINE_E2BIG) out_string(c, "CLIENT_ERROR too large value");
+        else if (ret == ENGINE_ENOMEM) out_string(c, "SERVER_ERROR out of memory");
+        else if (ret == ENGINE_ENOTSUP) out_string(c, "NOT_SUPPORTED");
+        else handle_unexpected_errorcode_ascii(c, ret);
+
+        /* swallow the data line */
+        c->write_and_go = conn_swallow;
+        c->sbytes = vlen;
+    }
+}
+
+static void process_mop_prepare_nread_fields(conn *c, int cmd, char *key, size_t nkey, uint32_t flen)
+{
+    ENGINE_ERROR_CODE ret = ENGINE_SUCCESS;
+
+    /* allocate memory blocks needed */
+    if (mblck_list_alloc(&c->thread->mblck_pool, 1, flen, &c->memblist) < 0) {
+        ret = ENGINE_ENOMEM;
+    }
+
+    switch (ret) {
+    case ENGINE_SUCCESS:
+        {
+        c->coll_strkeys = (void*)&c->memblist;
+        ritem_set_first(c, CONN_RTYPE_MBLCK, flen);
+        c->coll_ecount = 1;
+        c->coll_op = cmd;
+        c->coll_key  = key;
+        c->coll_nkey = nkey;
+        c->coll_lenkeys = flen;
+        conn_set_state(c, conn_nread);
+        break;
+        }
+    default:
+        if (cmd == OPERATION_MOP_DELETE) {
+            STATS_NOKEY(c, cmd_mop_delete);
+        } else if (cmd == OPERATION_MOP_GET) {
+            STATS_NOKEY(c, cmd_mop_get);
+        }
+        /* ret == ENGINE_ENOMEM */
+        out_string(c, "SERVER_ERROR out of memory");
+
+        //swallow the data line
+        c->write_and_go = conn_swallow;
+        c->sbytes = flen;
+    }
+}
+
+static void process_mop_create(conn *c, char *key, size_t nkey, item_attr *attrp) {
+    assert(c->ewouldblock == false);
+    ENGINE_ERROR_CODE ret;
+    ret = mc_engine.v1->map_struct_create(mc_engine.v0, c, key, nkey, attrp, 0);
+    if (ret == ENGINE_EWOULDBLOCK) {
+        c->ewouldblock = true;
+        ret = ENGINE_SUCCESS;
+    }
+
+    if (settings.detail_enabled) {
+        stats_prefix_record_mop_create(key, nkey);
+    }
+
+    switch (ret) {
+    case ENGINE_SUCCESS:
+        STATS_OKS(c, mop_create, key, nkey);
+        out_string(c, "CREATED");
+        break;
+    case ENGINE_DISCONNECT:
+        c->state = conn_closing;
+        break;
+    default:
+        STATS_NOKEY(c, cmd_mop_create);
+        if (ret == ENGINE_KEY_EEXISTS) out_string(c, "EXISTS");
+        else if (ret == ENGINE_PREFIX_ENAME) out_string(c, "CLIENT_ERROR invalid prefix name");
+        else if (ret == ENGINE_ENOMEM) out_string(c, "SERVER_ERROR out of memory");
+        else if (ret == ENGINE_ENOTSUP) out_string(c, "NOT_SUPPORTED");
+        else handle_unexpected_errorcode_ascii(c, ret);
+    }
+}
+
+static void process_mop_scan(conn *c, char *key, size_t nkey,
+                             uint32_t cursor, uint32_t count)
+{
+    eitem  **elem_array = NULL;
+    uint32_t elem_count;
+    uint32_t next_cursor;
+    uint32_t req_count = count;
+    uint32_t flags, i;
+    int      resplen;
+    int      need_size;
+
+    assert(c->ewouldblock == false);
+
+    ENGINE_ERROR_CODE ret = ENGINE_SUCCESS;
+
+    if (req_count == 0) req_count = SCAN_DEFAULT_COUNT;
+    assert(req_count <= MAX_SCAN_COUNT);
+    /* the elements of the same hash value can be returned beyond the count */
+    need_size = (req_count > MAX_SCAN_HASH_GROUP ? req_count : MAX_SCAN_HASH_GROUP) * sizeof(eitem*);
+    if ((elem_array = (eitem **)malloc(need_size)) == NULL) {
+        out_string(c, "SERVER_ERROR out of memory");
+        return;
+    }
+
+    ret = mc_engine.v1->map_elem_scan(mc_engine.v0, c, key, nkey, cursor, req_count,
+                                      elem_array, &elem_count, &next_cursor, &flags, 0);
+    if (ret == ENGINE_EWOULDBLOCK) {
+        c->ewouldblock = true;
+        ret = ENGINE_SUCCESS;
+    }
+
+    if (settings.detail_enabled) {
+        stats_prefix_record_mop_get(key, nkey, (ret==ENGINE_SUCCESS || ret==ENGINE_ELEM_ENOENT));
+    }
+
+    switch (ret) {
+    case ENGINE_SUCCESS:
+        {
+        char *respbuf; /* response string buffer */
+        char *respptr;
+
+        do {
+            need_size = ((3*lenstr_size) + 30) /* response head and tail size */
+                      + (elem_count * ((MAX_FIELD_LENG+2) + (lenstr_size+2))); /* response body size */
+            if ((respbuf = (char*)malloc(need_size)) == NULL) {
+                ret = ENGINE_ENOMEM; break;
+            }
+            respptr = respbuf;
+
+            sprintf(respptr, "VALUE %u %u %u\r\n", htonl(flags), elem_count, next_cursor);
+            if (add_iov(c, respptr, strlen(respptr)) != 0) {
+                ret = ENGINE_ENOMEM; break;
+            }
+            respptr += strlen(respptr);
+
+            for (i = 0; i < elem_count; i++) {
+                mc_engine.v1->get_elem_info(mc_engine.v0, c, ITEM_TYPE_MAP,
+                                            elem_array[i], &c->einfo);
+                resplen = make_mop_elem_response(respptr, &c->einfo);
+                if ((add_iov(c, respptr, resplen) != 0) ||
+                    (add_iov_einfo_value(c, &c->einfo) != 0))
+                {
+                    ret = ENGINE_ENOMEM; break;
+                }
+                respptr += strlen(respptr);
+            }
+            if (ret == ENGINE_ENOMEM) break;
+
+            sprintf(respptr, "END\r\n");
+            if ((add_iov(c, respptr, strlen(respptr)) != 0) ||
+                (IS_UDP(c->transport) && build_udp_headers(c) != 0)) {
+                ret = ENGINE_ENOMEM; break;
+            }
+        } while(0);
+
+        if (ret == ENGINE_SUCCESS) {
+            STATS_ELEM_HITS(c, mop_get, key, nkey);
+            c->coll_eitem  = (void *)elem_array;
+            c->coll_ecount = elem_count;
+            c->coll_resps  = respbuf;
+            c->coll_op     = OPERATION_MOP_GET;
+            conn_set_state(c, conn_mwrite);
+            c->msgcurr     = 0;
+        } else { /* ENGINE_ENOMEM */
+            STATS_NOKEY(c, cmd_mop_get);
+            mc_engine.v1->map_elem_release(mc_engine.v0, c, elem_array, elem_count);
+            free(respbuf);
+            if (c->ewouldblock)
+                c->ewouldblock = false;
+            out_string(c, "SERVER_ERROR out of memory writing get response");
+        }
         }
+        break;
+    case ENGINE_ELEM_ENOENT:
+        STATS_NONE_HITS(c, mop_get, key, nkey);
+        out_string(c, "NOT_FOUND_ELEMENT");
+        break;
     case ENGINE_DISCONNECT:
         c->state = conn_closing;
         break;
+    case ENGINE_KEY_ENOENT:
+    case ENGINE_UNREADABLE:
+        STATS_MISS(c, mop_get, key, nkey);
+        if (ret == ENGINE_KEY_ENOENT) out_string(c, "NOT_FOUND");
+        else                          out_string(c, "UNREADABLE");
+        break;
     default:
-        if (cmd == OPERATION_MOP_INSERT) {
-            STATS_NOKEY(c, cmd_mop_insert);
-        } else if (cmd == OPERATION_MOP_UPDATE) {
-            STATS_NOKEY(c, cmd_mop_update);
-        }
-
-        if (ret == ENGINE_E2BIG) out_string(c, "CLIENT_ERROR too large value");
-        else if (ret == ENGINE_ENOMEM) out_string(c, "SERVER_ERROR out of memory");
+        STATS_NOKEY(c, cmd_mop_get);
+        if (ret == ENGINE_EBADTYPE) out_string(c, "TYPE_MISMATCH");
         else if (ret == ENGINE_ENOTSUP) out_string(c, "NOT_SUPPORTED");
         else handle_unexpected_errorcode_ascii(c, ret);
+    }
 
-        /* swallow the data line */
-        c->write_and_go = conn_swallow;
-        c->sbytes = vlen;
+    if (ret != ENGINE_SUCCESS && elem_array != NULL) {
+        free((void *)elem_array);
     }
 }
 
-static void process_mop_prepare_nread_fields(conn *c, int cmd, char *key, size_t nkey, uint32_t flen)
+static void process_mop_arithmetic(conn *c, char *key, size_t nkey, field_t *field,
+                                   const bool incr, const bool create,
+                                   const uint64_t delta, const uint64_t initial)
 {
-    ENGINE_ERROR_CODE ret = ENGINE_SUCCESS;
-
-    /* allocate memory blocks needed */
-    if (mblck_list_alloc(&c->thread->mblck_pool, 1, flen, &c->memblist) < 0) {
-        ret = ENGINE_ENOMEM;
-    }
-
-    switch (ret) {
-    case ENGINE_SUCCESS:
-        {
-        c->coll_strkeys = (void*)&c->memblist;
-        ritem_set_first(c, CONN_RTYPE_MBLCK, flen);
-        c->coll_ecount = 1;
-        c->coll_op = cmd;
-        c->coll_key  = key;
-        c->coll_nkey = nkey;
-        c->coll_lenkeys = flen;
-        conn_set_state(c, conn_nread);
-        break;
-        }
-    default:
-        if (cmd == OPERATION_MOP_DELETE) {
-            STATS_NOKEY(c, cmd_mop_delete);
-        } else if (cmd == OPERATION_MOP_GET) {
-            STATS_NOKEY(c, cmd_mop_get);
-        }
-        /* ret == ENGINE_ENOMEM */
-        out_string(c, "SERVER_ERROR out of memory");
-
-        //swallow the data line
-        c->write_and_go = conn_swallow;
-        c->sbytes = flen;
-    }
-}
+    ENGINE_ERROR_CODE ret;
+    uint64_t result;
+    char temp[INCR_MAX_STORAGE_LEN];
 
-static void process_mop_create(conn *c, char *key, size_t nkey, item_attr *attrp) {
     assert(c->ewouldblock == false);
-    ENGINE_ERROR_CODE ret;
-    ret = mc_engine.v1->map_struct_create(mc_engine.v0, c, key, nkey, attrp, 0);
+
+    ret = mc_engine.v1->map_elem_arithmetic(mc_engine.v0, c, key, nkey, field, incr, create,
+                                            delta, initial, &result, 0);
     if (ret == ENGINE_EWOULDBLOCK) {
         c->ewouldblock = true;
         ret = ENGINE_SUCCESS;
     }
 
     if (settings.detail_enabled) {
-        stats_prefix_record_mop_create(key, nkey);
+        stats_prefix_record_mop_update(key, nkey, (ret==ENGINE_SUCCESS || ret==ENGINE_ELEM_ENOENT));
     }
 
     switch (ret) {
     case ENGINE_SUCCESS:
-        STATS_OKS(c, mop_create, key, nkey);
-        out_string(c, "CREATED");
+        if (incr) {
+            STATS_ELEM_HITS(c, mop_incr, key, nkey);
+        } else {
+            STATS_ELEM_HITS(c, mop_decr, key, nkey);
+        }
+        snprintf(temp, sizeof(temp), "%"PRIu64, result);
+        out_string(c, temp);
+        break;
+    case ENGINE_KEY_ENOENT:
+        if (incr) {
+            STATS_MISS(c, mop_incr, key, nkey);
+        } else {
+            STATS_MISS(c, mop_decr, key, nkey);
+        }
+        out_string(c, "NOT_FOUND");
+        break;
+    case ENGINE_ELEM_ENOENT:
+        if (incr) {
+            STATS_NONE_HITS(c, mop_incr, key, nkey);
+        } else {
+            STATS_NONE_HITS(c, mop_decr, key, nkey);
+        }
+        out_string(c, "NOT_FOUND_ELEMENT");
         break;
     case ENGINE_DISCONNECT:
         c->state = conn_closing;
         break;
+    case ENGINE_EINVAL:
+        out_string(c, "CLIENT_ERROR cannot increment or decrement non-numeric value");
+        break;
     default:
-        STATS_NOKEY(c, cmd_mop_create);
-        if (ret == ENGINE_KEY_EEXISTS) out_string(c, "EXISTS");
-        else if (ret == ENGINE_PREFIX_ENAME) out_string(c, "CLIENT_ERROR invalid prefix name");
-        else if (ret == ENGINE_ENOMEM) out_string(c, "SERVER_ERROR out of memory");
-        else if (ret == ENGINE_ENOTSUP) out_string(c, "NOT_SUPPORTED");
+        if (incr) {
+            STATS_NOKEY(c, cmd_mop_incr);
+        } else {
+            STATS_NOKEY(c, cmd_mop_decr);
+        }
+        if (ret == ENGINE_EBADTYPE)       out_string(c, "TYPE_MISMATCH");
+        else if (ret == ENGINE_EOVERFLOW) out_string(c, "OVERFLOWED");
+        else if (ret == ENGINE_ENOMEM)    out_string(c, "SERVER_ERROR out of memory");
+        else if (ret == ENGINE_ENOTSUP)   out_string(c, "NOT_SUPPORTED");
         else handle_unexpected_errorcode_ascii(c, ret);
     }
 }
@@ -12227,6 +14863,65 @@ static void process_mop_command(conn *c, token_t *tokens, const size_t ntokens)
             process_mop_prepare_nread_fields(c, (int)OPERATION_MOP_GET, key, nkey, lenfields);
         }
     }
+    else if ((ntokens >= 6 && ntokens <= 8) && (strcmp(subcommand, "incr") == 0 || strcmp(subcommand, "decr") == 0))
+    {
+        field_t  field;
+        uint64_t delta;
+        uint64_t initial = 0;
+        bool     incr = (strcmp(subcommand, "incr") == 0 ? true : false);
+        bool     create = false;
+
+        set_pipe_noreply_maybe(c, tokens, ntokens);
+
+        field.value = tokens[MOP_KEY_TOKEN+1].value;
+        field.length = tokens[MOP_KEY_TOKEN+1].length;
+
+        if (field.length > MAX_FIELD_LENG) {
+            out_string(c, "CLIENT_ERROR too long field name");
+            return;
+        }
+
+        if (! safe_strtoull(tokens[MOP_KEY_TOKEN+2].value, &delta) || delta < 1) {
+            print_invalid_command(c, tokens, ntokens);
+            out_string(c, "CLIENT_ERROR bad command line format");
+            return;
+        }
+
+        int read_ntokens = MOP_KEY_TOKEN + 3;
+        int post_ntokens = 1 + (c->noreply ? 1 : 0);
+        int rest_ntokens = ntokens - read_ntokens - post_ntokens;
+
+        if (rest_ntokens > 0) {
+            if (rest_ntokens > 1 || ! safe_strtoull(tokens[read_ntokens].value, &initial)) {
+                print_invalid_command(c, tokens, ntokens);
+                out_string(c, "CLIENT_ERROR bad command line format");
+                return;
+            }
+            create = true;
+        }
+
+        if (check_and_handle_pipe_state(c, 0)) {
+            process_mop_arithmetic(c, key, nkey, &field, incr, create, delta, initial);
+        }
+    }
+    else if ((ntokens >= 5 && ntokens <= 6) && (strcmp(subcommand, "scan") == 0))
+    {
+        uint32_t cursor = 0;
+        uint32_t count = 0;
+
+        if ((! safe_strtoul(tokens[MOP_KEY_TOKEN+1].value, &cursor)) ||
+            (ntokens == 6 && ! safe_strtoul(tokens[MOP_KEY_TOKEN+2].value, &count))) {
+            print_invalid_command(c, tokens, ntokens);
+            out_string(c, "CLIENT_ERROR bad command line format");
+            return;
+        }
+        if (count > MAX_SCAN_COUNT) {
+            out_string(c, "CLIENT_ERROR bad value");
+            return;
+        }
+
+        process_mop_scan(c, key, nkey, cursor, count);
+    }
     else
     {
         print_invalid_command(c, tokens, ntokens);
@@ -12329,21 +15024,43 @@ static void process_bop_command(conn *c, token_t *tokens, const size_t ntokens)
             process_bop_prepare_nread(c, subcommid, key, nkey, bkey, nbkey, eflag, neflag, vlen);
         }
     }
-    else if ((ntokens >= 7 && ntokens <= 10) && (strcmp(subcommand, "create") == 0))
+    else if ((ntokens >= 6 && ntokens <= 13) && (strcmp(subcommand, "minsert") == 0))
+    {
+        process_coll_minsert_command(c, tokens, ntokens, (int)OPERATION_BOP_MINSERT);
+    }
+    else if ((ntokens >= 7 && ntokens <= 13) && (strcmp(subcommand, "create") == 0))
     {
         set_noreply_maybe(c, tokens, ntokens);
 
         int read_ntokens = BOP_KEY_TOKEN+1;
         int post_ntokens = 1 + (c->noreply ? 1 : 0);
         int rest_ntokens = ntokens - read_ntokens - post_ntokens;
+        uint32_t eifwhere = 0;
+        uint32_t eiflength = 0;
+
+        /* eindex <fwhere> <flength> : the eflag field to be indexed */
+        if (rest_ntokens >= 6 &&
+            strcmp(tokens[read_ntokens+rest_ntokens-3].value, "eindex") == 0) {
+            if ((! safe_strtoul(tokens[read_ntokens+rest_ntokens-2].value, &eifwhere)) ||
+                (! safe_strtoul(tokens[read_ntokens+rest_ntokens-1].value, &eiflength)) ||
+                eiflength < 1 || (eifwhere+eiflength) > MAX_EFLAG_LENG) {
+                print_invalid_command(c, tokens, ntokens);
+                out_string(c, "CLIENT_ERROR bad command line format");
+                return;
+            }
+            rest_ntokens -= 3;
+        }
 
         c->coll_attrp = &c->coll_attr_space;
-        if (get_coll_create_attr_from_tokens(&tokens[read_ntokens], rest_ntokens,
+        if (rest_ntokens > 5 ||
+            get_coll_create_attr_from_tokens(&tokens[read_ntokens], rest_ntokens,
                                              ITEM_TYPE_BTREE, c->coll_attrp) != 0) {
             print_invalid_command(c, tokens, ntokens);
             out_string(c, "CLIENT_ERROR bad command line format");
             return;
         }
+        c->coll_attrp->eifwhere  = (uint8_t)eifwhere;
+        c->coll_attrp->eiflength = (uint8_t)eiflength;
 
         process_bop_create(c, key, nkey, c->coll_attrp);
     }
@@ -12560,12 +15277,14 @@ static void process_bop_command(conn *c, token_t *tokens, const size_t ntokens)
                                    create, delta, initial, eflagptr);
         }
     }
-    else if ((ntokens >= 5 && ntokens <= 13) && (strcmp(subcommand, "get") == 0))
+    else if ((ntokens >= 5 && ntokens <= 14) && (strcmp(subcommand, "get") == 0))
     {
         uint32_t offset = 0;
         uint32_t count  = 0;
         bool delete = false;
         bool drop_if_empty = false;
+        bool use_cursor = false;
+        char *cursor = NULL;
 
         if (get_bkey_range_from_str(tokens[BOP_KEY_TOKEN+1].value, &c->coll_bkrange)) {
             print_invalid_command(c, tokens, ntokens);
@@ -12592,8 +15311,16 @@ static void process_bop_command(conn *c, token_t *tokens, const size_t ntokens)
         }
 
         if (rest_ntokens > 0) {
-            if (strcmp(tokens[read_ntokens+rest_ntokens-1].value, "delete")==0 ||
-                strcmp(tokens[read_ntokens+rest_ntokens-1].value, "drop")==0) {
+            if (strcmp(tokens[read_ntokens+rest_ntokens-1].value, "cursor")==0) {
+                use_cursor = true;
+                rest_ntokens -= 1;
+            } else if (rest_ntokens > 1 &&
+                       strcmp(tokens[read_ntokens+rest_ntokens-2].value, "cursor")==0) {
+                use_cursor = true;
+                cursor = tokens[read_ntokens+rest_ntokens-1].value;
+                rest_ntokens -= 2;
+            } else if (strcmp(tokens[read_ntokens+rest_ntokens-1].value, "delete")==0 ||
+                       strcmp(tokens[read_ntokens+rest_ntokens-1].value, "drop")==0) {
                 delete = true;
                 if (strlen(tokens[read_ntokens+rest_ntokens-1].value) == 4)
                     drop_if_empty = true;
@@ -12622,10 +15349,18 @@ static void process_bop_command(conn *c, token_t *tokens, const size_t ntokens)
             }
         }
 
+        /* offset skips elements only on the first page of a cursor scan */
+        if (cursor != NULL && (offset > 0 ||
+                               get_bop_cursor_from_str(cursor, &c->coll_bkrange) != 0)) {
+            print_invalid_command(c, tokens, ntokens);
+            out_string(c, "CLIENT_ERROR bad command line format");
+            return;
+        }
+
         process_bop_get(c, key, nkey, &c->coll_bkrange,
                         (c->coll_efilter.ncompval==0 ? NULL : &c->coll_efilter),
                         offset, count,
-                        delete, drop_if_empty);
+                        delete, drop_if_empty, use_cursor);
     }
     else if ((ntokens >= 5 && ntokens <= 10) && (strcmp(subcommand, "count") == 0))
     {
@@ -12662,6 +15397,78 @@ static void process_bop_command(conn *c, token_t *tokens, const size_t ntokens)
         process_bop_count(c, key, nkey, &c->coll_bkrange,
                           (c->coll_efilter.ncompval==0 ? NULL : &c->coll_efilter));
     }
+    else if ((ntokens >= 5 && ntokens <= 16) && (strcmp(subcommand, "aggregate") == 0))
+    {
+        bop_aggr_spec spec;
+        uint32_t where, length;
+
+        if (get_bkey_range_from_str(tokens[BOP_KEY_TOKEN+1].value, &c->coll_bkrange)) {
+            print_invalid_command(c, tokens, ntokens);
+            out_string(c, "CLIENT_ERROR bad command line format");
+            return;
+        }
+
+        int read_ntokens = 4;
+        int post_ntokens = 1; /* "\r\n" */
+        int rest_ntokens = ntokens - read_ntokens - post_ntokens;
+
+        if (rest_ntokens >= 3) {
+            int used_ntokens = get_efilter_from_tokens(&tokens[read_ntokens], rest_ntokens,
+                                                       &c->coll_efilter);
+            if (used_ntokens == -1) {
+                print_invalid_command(c, tokens, ntokens);
+                out_string(c, "CLIENT_ERROR bad command line format");
+                return;
+            }
+            read_ntokens += used_ntokens;
+            rest_ntokens -= used_ntokens;
+        } else {
+            c->coll_efilter.ncompval = 0;
+        }
+
+        memset(&spec, 0, sizeof(spec));
+        spec.operand = BOP_AGGR_OPERAND_NONE;
+        if (rest_ntokens >= 1 && strcmp(tokens[read_ntokens].value, "value") == 0) {
+            spec.operand = BOP_AGGR_OPERAND_VALUE;
+            read_ntokens += 1;
+            rest_ntokens -= 1;
+        } else if (rest_ntokens >= 3 && strcmp(tokens[read_ntokens].value, "eflag") == 0) {
+            if ((! safe_strtoul(tokens[read_ntokens+1].value, &where)) ||
+                (! safe_strtoul(tokens[read_ntokens+2].value, &length)) ||
+                length < 1 || length > sizeof(uint64_t) || (where+length) > MAX_EFLAG_LENG) {
+                print_invalid_command(c, tokens, ntokens);
+                out_string(c, "CLIENT_ERROR bad command line format");
+                return;
+            }
+            spec.operand = BOP_AGGR_OPERAND_EFLAG;
+            spec.fwhere  = (uint8_t)where;
+            spec.flength = (uint8_t)length;
+            read_ntokens += 3;
+            rest_ntokens -= 3;
+        }
+        if (rest_ntokens >= 3 && strcmp(tokens[read_ntokens].value, "group") == 0) {
+            if ((! safe_strtoul(tokens[read_ntokens+1].value, &where)) ||
+                (! safe_strtoul(tokens[read_ntokens+2].value, &length)) ||
+                length < 1 || (where+length) > MAX_EFLAG_LENG) {
+                print_invalid_command(c, tokens, ntokens);
+                out_string(c, "CLIENT_ERROR bad command line format");
+                return;
+            }
+            spec.gwhere  = (uint8_t)where;
+            spec.glength = (uint8_t)length;
+            read_ntokens += 3;
+            rest_ntokens -= 3;
+        }
+
+        if (rest_ntokens != 0) {
+            print_invalid_command(c, tokens, ntokens);
+            out_string(c, "CLIENT_ERROR bad command line format");
+            return;
+        }
+
+        process_bop_aggregate(c, key, nkey, &c->coll_bkrange,
+                              (c->coll_efilter.ncompval==0 ? NULL : &c->coll_efilter), &spec);
+    }
 #if defined(SUPPORT_BOP_MGET) || defined(SUPPORT_BOP_SMGET)
     else if ((ntokens >= 7 && ntokens <= 13) &&
              ((strcmp(subcommand, "mget") == 0  && (subcommid = (int)OPERATION_BOP_MGET)) ||
@@ -13249,6 +16056,26 @@ static void process_command(conn *c, char *command, int cmdlen)
     {
         process_delete_command(c, tokens, ntokens);
     }
+    else if ((ntokens >= 3) && (strcmp(tokens[COMMAND_TOKEN].value, "mg") == 0))
+    {
+        process_meta_get_command(c, tokens, ntokens);
+    }
+    else if ((ntokens >= 4) && (strcmp(tokens[COMMAND_TOKEN].value, "ms") == 0))
+    {
+        process_meta_set_command(c, tokens, ntokens);
+    }
+    else if ((ntokens >= 3) && (strcmp(tokens[COMMAND_TOKEN].value, "md") == 0))
+    {
+        process_meta_delete_command(c, tokens, ntokens);
+    }
+    else if ((ntokens >= 3) && (strcmp(tokens[COMMAND_TOKEN].value, "ma") == 0))
+    {
+        process_meta_arithmetic_command(c, tokens, ntokens);
+    }
+    else if ((ntokens == 2) && (strcmp(tokens[COMMAND_TOKEN].value, "mn") == 0))
+    {
+        out_string(c, "MN");
+    }
     else if ((ntokens >= 5 && ntokens <= 13) && (strcmp(tokens[COMMAND_TOKEN].value, "lop") == 0))
     {
         process_lop_command(c, tokens, ntokens);
@@ -13257,7 +16084,7 @@ static void process_command(conn *c, char *command, int cmdlen)
     {
         process_sop_command(c, tokens, ntokens);
     }
-    else if ((ntokens >= 6 && ntokens <= 13) && (strcmp(tokens[COMMAND_TOKEN].value, "mop") == 0))
+    else if ((ntokens >= 5 && ntokens <= 13) && (strcmp(tokens[COMMAND_TOKEN].value, "mop") == 0))
     {
         process_mop_command(c, tokens, ntokens);
     }
@@ -13486,28 +16313,129 @@ static int try_read_command(conn *c) {
 
         assert(cont <= (c->rcurr + c->rbytes));
 
-        process_command(c, c->rcurr, el - c->rcurr);
+        process_command(c, c->rcurr, el - c->rcurr);
+
+        c->rbytes -= (cont - c->rcurr);
+        c->rcurr = cont;
+
+        assert(c->rcurr <= (c->rbuf + c->rsize));
+    }
+
+    return 1;
+}
+
+#ifdef HAVE_RECVMMSG
+/*
+ * The datagrams received by a recvmmsg() call. They are processed one by
+ * one before receiving the next batch, each copied into the read buffer.
+ * The arrays of settings.udp_batch entries follow the structure.
+ */
+struct udp_batch {
+    int count;                  /* datagrams received */
+    int next;                   /* next datagram to process */
+    struct mmsghdr *msgs;
+    struct iovec *iovs;
+    struct sockaddr_storage *addrs;
+    char *data;                 /* buffers of UDP_BATCH_DGRAM_SIZE bytes */
+};
+
+static struct udp_batch *udp_batch_alloc(void)
+{
+    size_t n = settings.udp_batch;
+    struct udp_batch *b;
+
+    b = malloc(sizeof(struct udp_batch) +
+               n * (sizeof(struct sockaddr_storage) + sizeof(struct mmsghdr) +
+                    sizeof(struct iovec) + UDP_BATCH_DGRAM_SIZE));
+    if (b == NULL) {
+        return NULL;
+    }
+    /* sockaddr_storage first, which has the strictest alignment */
+    b->addrs = (struct sockaddr_storage *)(b + 1);
+    b->msgs = (struct mmsghdr *)(b->addrs + n);
+    b->iovs = (struct iovec *)(b->msgs + n);
+    b->data = (char *)(b->iovs + n);
+    b->count = b->next = 0;
+    return b;
+}
+
+static inline bool udp_batch_pending(conn *c)
+{
+    return c->udp_batch != NULL && c->udp_batch->next < c->udp_batch->count;
+}
 
-        c->rbytes -= (cont - c->rcurr);
-        c->rcurr = cont;
+/*
+ * Reads the next datagram of the batch into the read buffer,
+ * receiving a new batch if all of them have been processed.
+ * Returns the length of the datagram, or -1 if nothing is received.
+ * A datagram larger than UDP_BATCH_DGRAM_SIZE is truncated.
+ */
+static int udp_batch_recv(conn *c, bool *truncated)
+{
+    struct udp_batch *b = c->udp_batch;
+    struct mmsghdr *m;
+    int res;
 
-        assert(c->rcurr <= (c->rbuf + c->rsize));
+    if (b->next >= b->count) {
+        for (int i = 0; i < settings.udp_batch; i++) {
+            b->iovs[i].iov_base = b->data + (size_t)i * UDP_BATCH_DGRAM_SIZE;
+            b->iovs[i].iov_len = UDP_BATCH_DGRAM_SIZE;
+            memset(&b->msgs[i], 0, sizeof(b->msgs[i]));
+            b->msgs[i].msg_hdr.msg_iov = &b->iovs[i];
+            b->msgs[i].msg_hdr.msg_iovlen = 1;
+            b->msgs[i].msg_hdr.msg_name = &b->addrs[i];
+            b->msgs[i].msg_hdr.msg_namelen = sizeof(b->addrs[i]);
+        }
+        b->count = b->next = 0;
+        res = recvmmsg(c->sfd, b->msgs, settings.udp_batch, 0, NULL);
+        if (res <= 0) {
+            /* idle until the next datagram arrives */
+            free(c->udp_batch);
+            c->udp_batch = NULL;
+            return -1;
+        }
+        b->count = res;
     }
 
-    return 1;
+    m = &b->msgs[b->next];
+    res = m->msg_len < c->rsize ? m->msg_len : c->rsize;
+    memcpy(c->rbuf, b->iovs[b->next].iov_base, res);
+    c->request_addr_size = m->msg_hdr.msg_namelen < sizeof(c->request_addr)
+                         ? m->msg_hdr.msg_namelen : sizeof(c->request_addr);
+    memcpy(&c->request_addr, &b->addrs[b->next], c->request_addr_size);
+    *truncated = (m->msg_hdr.msg_flags & MSG_TRUNC) != 0;
+    b->next++;
+    return res;
+}
+#else
+static inline bool udp_batch_pending(conn *c)
+{
+    return false;
 }
+#endif
 
 /*
  * read a UDP request.
  */
 static enum try_read_result try_read_udp(conn *c) {
     int res;
+    bool truncated = false;
 
     assert(c != NULL);
 
-    c->request_addr_size = sizeof(c->request_addr);
-    res = recvfrom(c->sfd, c->rbuf, c->rsize,
-                   0, &c->request_addr, &c->request_addr_size);
+#ifdef HAVE_RECVMMSG
+    if (c->udp_batch == NULL && settings.udp_batch > 1) {
+        c->udp_batch = udp_batch_alloc();
+    }
+    if (c->udp_batch != NULL) {
+        res = udp_batch_recv(c, &truncated);
+    } else
+#endif
+    {
+        c->request_addr_size = sizeof(c->request_addr);
+        res = recvfrom(c->sfd, c->rbuf, c->rsize,
+                       0, (struct sockaddr *)&c->request_addr, &c->request_addr_size);
+    }
     if (res > 8) {
         unsigned char *buf = (unsigned char *)c->rbuf;
         STATS_ADD(c, bytes_read, res);
@@ -13515,8 +16443,8 @@ static enum try_read_result try_read_udp(conn *c) {
         /* Beginning of UDP packet is the request ID; save it. */
         c->request_id = buf[0] * 256 + buf[1];
 
-        /* If this is a multi-packet request, drop it. */
-        if (buf[4] != 0 || buf[5] != 1) {
+        /* If this is a multi-packet or truncated request, drop it. */
+        if (buf[4] != 0 || buf[5] != 1 || truncated) {
             out_string(c, "NOT_SUPPORTED");
             return READ_NO_DATA_RECEIVED;
         }
@@ -13532,6 +16460,31 @@ static enum try_read_result try_read_udp(conn *c) {
     return READ_NO_DATA_RECEIVED;
 }
 
+/*
+ * Socket I/O of a TCP connection.
+ * The connection attached to the io_uring of its worker thread
+ * reads and writes through the ring.
+ */
+static inline ssize_t conn_recv(conn *c, void *buf, size_t len)
+{
+#ifdef ENABLE_IO_URING
+    if (c->uring.active) {
+        return uring_conn_recv(c, buf, len);
+    }
+#endif
+    return read(c->sfd, buf, len);
+}
+
+static inline ssize_t conn_sendmsg(conn *c, struct msghdr *m)
+{
+#ifdef ENABLE_IO_URING
+    if (c->uring.active) {
+        return uring_conn_sendmsg(c, m);
+    }
+#endif
+    return sendmsg(c->sfd, m, 0);
+}
+
 /*
  * read from network as much as we can, handle buffer overflow and connection
  * close.
@@ -13582,7 +16535,7 @@ static enum try_read_result try_read_network(conn *c) {
         }
 
         int avail = c->rsize - c->rbytes;
-        res = read(c->sfd, c->rbuf + c->rbytes, avail);
+        res = conn_recv(c, c->rbuf + c->rbytes, avail);
         if (res > 0) {
             STATS_ADD(c, bytes_read, res);
             gotdata = READ_DATA_RECEIVED;
@@ -13621,6 +16574,12 @@ static bool update_event(conn *c, const int new_flags) {
     assert(c != NULL);
 
     struct event_base *base = c->event.ev_base;
+#ifdef ENABLE_IO_URING
+    if (c->uring.active) {
+        uring_conn_update(c, new_flags);
+        return true;
+    }
+#endif
     if (c->ev_flags == new_flags)
         return true;
 
@@ -13637,6 +16596,38 @@ static bool update_event(conn *c, const int new_flags) {
     return true;
 }
 
+#ifdef HAVE_SENDMMSG
+/*
+ * Sends the remaining datagrams of the UDP response by sendmmsg().
+ * Returns the number of datagrams sent, or -1 on error.
+ */
+static int transmit_udp_batch(conn *c)
+{
+    struct mmsghdr msgs[UDP_BATCH_MAX];
+    int count = c->msgused - c->msgcurr;
+    size_t bytes = 0;
+    int res;
+
+    if (count > UDP_BATCH_MAX) {
+        count = UDP_BATCH_MAX;
+    }
+    for (int i = 0; i < count; i++) {
+        msgs[i].msg_hdr = c->msglist[c->msgcurr + i];
+        msgs[i].msg_len = 0;
+    }
+    res = sendmmsg(c->sfd, msgs, count, 0);
+    for (int i = 0; i < res; i++) {
+        bytes += msgs[i].msg_len;
+        c->msglist[c->msgcurr].msg_iovlen = 0;
+        c->msgcurr++;
+    }
+    if (bytes > 0) {
+        STATS_ADD(c, bytes_written, bytes);
+    }
+    return res;
+}
+#endif
+
 /*
  * Transmit the next chunk of data from our list of msgbuf structures.
  *
@@ -13658,7 +16649,19 @@ static enum transmit_result transmit(conn *c) {
         ssize_t res;
         struct msghdr *m = &c->msglist[c->msgcurr];
 
-        res = sendmsg(c->sfd, m, 0);
+#ifdef HAVE_SENDMMSG
+        if (IS_UDP(c->transport) && c->msgused - c->msgcurr > 1) {
+            /* all the datagrams of the response at once */
+            res = transmit_udp_batch(c);
+            if (res > 0) {
+                return TRANSMIT_INCOMPLETE;
+            }
+        } else {
+            res = conn_sendmsg(c, m);
+        }
+#else
+        res = conn_sendmsg(c, m);
+#endif
         if (res > 0) {
             STATS_ADD(c, bytes_written, res);
 
@@ -13728,9 +16731,10 @@ bool conn_listening(conn *c)
         return false;
     }
 
-    STATS_LOCK();
-    int curr_conns = mc_stats.curr_conns++;
-    STATS_UNLOCK();
+    /* The worker threads with their own listening sockets
+     * accept concurrently, so count the connection atomically.
+     */
+    int curr_conns = __sync_fetch_and_add(&mc_stats.curr_conns, 1);
 
     if (curr_conns >= settings.maxconns) {
         /* Allow admin connection even if # of connections is over maxconns */
@@ -13760,13 +16764,31 @@ bool conn_listening(conn *c)
         return false;
     }
 
-    dispatch_conn_new(sfd, conn_new_cmd, EV_READ | EV_PERSIST,
-                      DATA_BUFFER_SIZE, tcp_transport);
+    if (c->thread != NULL) {
+        /* accepted by a worker thread on its own listening socket */
+        accept_conn_new(c, sfd, conn_new_cmd, EV_READ | EV_PERSIST,
+                        DATA_BUFFER_SIZE, tcp_transport);
+    } else {
+        dispatch_conn_new(sfd, conn_new_cmd, EV_READ | EV_PERSIST,
+                          DATA_BUFFER_SIZE, tcp_transport);
+    }
 
     return false;
 }
 
 bool conn_waiting(conn *c) {
+    if (c->coal_bytes > 0 && !conn_coal_send(c)) {
+        return false;
+    }
+    if (udp_batch_pending(c)) {
+        /* the datagrams received already are processed first */
+        conn_set_state(c, conn_read);
+        return true;
+    }
+    if (c->bufs_pooled && c->rbytes == 0 && c->ileft == 0 && c->suffixleft == 0) {
+        /* idle until the next request arrives */
+        conn_return_buffers(c, c->thread);
+    }
     if (!update_event(c, EV_READ | EV_PERSIST)) {
         if (settings.verbose > 0) {
             mc_logger->log(EXTENSION_LOG_WARNING, c,
@@ -13780,7 +16802,18 @@ bool conn_waiting(conn *c) {
 }
 
 bool conn_read(conn *c) {
-    int res = IS_UDP(c->transport) ? try_read_udp(c) : try_read_network(c);
+    int res;
+
+    if (c->rbuf == NULL && !conn_borrow_buffers(c)) {
+        if (settings.verbose > 0) {
+            mc_logger->log(EXTENSION_LOG_WARNING, c,
+                           "Couldn't allocate the buffers of connection.\n");
+        }
+        conn_set_state(c, conn_closing);
+        return true;
+    }
+
+    res = IS_UDP(c->transport) ? try_read_udp(c) : try_read_network(c);
     switch (res) {
     case READ_NO_DATA_RECEIVED:
         conn_set_state(c, conn_waiting);
@@ -13799,6 +16832,42 @@ bool conn_read(conn *c) {
     return true;
 }
 
+/*
+ * Removes the connection from the event loop to wait for notify_io_complete
+ * event, unless it was already called. The command offloaded to the heavy
+ * threads is dispatched only after the connection is parked.
+ * Returns true if the connection is parked.
+ */
+static bool conn_park(conn *c) {
+    LIBEVENT_THREAD *t = c->thread;
+    bool block = false;
+
+    if (c->coal_bytes > 0) {
+        conn_coal_flush(c);
+    }
+    LOCK_THREAD(t);
+    if (c->premature_notify_io_complete) {
+        /* notify_io_complete was called before we got here */
+        c->premature_notify_io_complete = false;
+    } else {
+        event_del(&c->event);
+#ifdef ENABLE_IO_URING
+        c->uring.parked = c->uring.active;
+#endif
+        c->io_blocked = true;
+        block = true;
+    }
+    UNLOCK_THREAD(t);
+    c->ewouldblock = false;
+
+    if (c->heavy.execute != NULL) {
+        /* nothing notifies the heavy command before it is dispatched */
+        assert(block);
+        heavy_cmd_dispatch(c);
+    }
+    return block;
+}
+
 bool conn_parse_cmd(conn *c) {
     if (try_read_command(c) == 0) {
         /* wee need more data! */
@@ -13811,24 +16880,8 @@ bool conn_parse_cmd(conn *c) {
      * and wait for notify_io_complete event.
      * See also conn_nread.
      */
-    if (c->ewouldblock) {
-        LIBEVENT_THREAD *t = c->thread;
-        bool block = false;
-
-        LOCK_THREAD(t);
-        if (c->premature_notify_io_complete) {
-            /* notify_io_complete was called before we got here */
-            c->premature_notify_io_complete = false;
-        } else {
-            event_del(&c->event);
-            c->io_blocked = true;
-            block = true;
-        }
-        UNLOCK_THREAD(t);
-        c->ewouldblock = false;
-
-        if (block)
-            return false;
+    if (c->ewouldblock && conn_park(c)) {
+        return false;
     }
 
     return true;
@@ -13838,10 +16891,19 @@ bool conn_new_cmd(conn *c) {
     /* Only process nreqs at a time to avoid starving other connections */
     --c->nevents;
     if (c->nevents >= 0) {
+        if (c->thread != NULL) {
+            __sync_fetch_and_add(&c->thread->load_reqs, 1);
+        }
+        c->last_cmd_time = current_time;
         reset_cmd_handler(c);
     } else {
         STATS_NOKEY(c, conn_yields);
-        if (c->rbytes > 0) {
+#ifdef ENABLE_IO_URING
+        /* The data received by the ring does not signal read events again. */
+        if (c->rbytes > 0 || (c->uring.active && c->uring.bytes > 0) || udp_batch_pending(c)) {
+#else
+        if (c->rbytes > 0 || udp_batch_pending(c)) {
+#endif
             /* We have already read in data into the input buffer,
                so libevent will most likely not signal read events
                on the socket (unless more data is available. As a
@@ -13881,8 +16943,13 @@ bool conn_swallow(conn *c) {
         return true;
     }
 
+    /* send the coalesced responses before waiting for the data */
+    if (c->coal_bytes > 0 && !conn_coal_send(c)) {
+        return false;
+    }
+
     /*  now try reading from the socket */
-    res = read(c->sfd, c->rbuf, c->rsize > c->sbytes ? c->sbytes : c->rsize);
+    res = conn_recv(c, c->rbuf, c->rsize > c->sbytes ? c->sbytes : c->rsize);
     if (res > 0) {
         STATS_ADD(c, bytes_read, res);
         c->sbytes -= res;
@@ -13933,19 +17000,7 @@ bool conn_nread(conn *c) {
 
         bool block = false;
         if (c->ewouldblock) {
-            LIBEVENT_THREAD *t = c->thread;
-
-            LOCK_THREAD(t);
-            if (c->premature_notify_io_complete) {
-                /* notify_io_complete was called before we got here */
-                c->premature_notify_io_complete = false;
-            } else {
-                event_del(&c->event);
-                c->io_blocked = true;
-                block = true;
-            }
-            UNLOCK_THREAD(t);
-            c->ewouldblock = false;
+            block = conn_park(c);
         }
         return !block;
     }
@@ -13972,8 +17027,13 @@ bool conn_nread(conn *c) {
         }
     }
 
+    /* send the coalesced responses before waiting for the data */
+    if (c->coal_bytes > 0 && !conn_coal_send(c)) {
+        return false;
+    }
+
     /*  now try reading from the socket */
-    res = read(c->sfd, c->ritem, c->rlbytes);
+    res = conn_recv(c, c->ritem, c->rlbytes);
     if (res > 0) {
         STATS_ADD(c, bytes_read, res);
         if (c->rcurr == c->ritem) {
@@ -14029,13 +17089,156 @@ bool conn_nread(conn *c) {
     return true;
 }
 
+/*
+ * Holds back the simple response of a pipelined command if the next command
+ * is already in rbuf, so that the responses are sent together with the
+ * response of a later command in a single sendmsg().
+ */
+static bool conn_coalesce_response(conn *c) {
+    if (c->protocol != ascii_prot || IS_UDP(c->transport) ||
+        c->write_and_go != conn_new_cmd || c->wbytes <= 0 ||
+        c->iovused != c->coal_iovs) {
+        return false; /* not a simple response, or it is being sent */
+    }
+    if (c->coal_bytes + c->wbytes > COAL_BUFFER_SIZE ||
+        memchr(c->rcurr, '\n', c->rbytes) == NULL) {
+        return false;
+    }
+    if (c->coal_bytes + c->wbytes > c->coal_size) {
+        /* grows by doubling, the coalesced bytes are copied */
+        int newsize = c->coal_size > 0 ? c->coal_size : DATA_BUFFER_SIZE;
+        while (newsize < c->coal_bytes + c->wbytes) {
+            newsize *= 2;
+        }
+        char *newbuf = realloc(c->coal_buf, newsize);
+        if (newbuf == NULL) {
+            return false;
+        }
+        c->coal_buf = newbuf;
+        c->coal_size = newsize;
+    }
+    memcpy(c->coal_buf + c->coal_bytes, c->wcurr, c->wbytes);
+    c->coal_bytes += c->wbytes;
+    c->wbytes = 0;
+    if (c->write_and_free) {
+        free(c->write_and_free);
+        c->write_and_free = 0;
+    }
+    STATS_NOKEY(c, coalesced_responses);
+    return true;
+}
+
+/*
+ * Sends the coalesced responses by themselves before the connection waits
+ * for more data or is closed. Returns false if it has to wait until the
+ * connection is writable. The responses are dropped on a send error,
+ * which the following read or write fails with as well.
+ */
+static bool conn_coal_send(conn *c) {
+    ssize_t res;
+    int i;
+
+    while (c->coal_sent < c->coal_bytes) {
+        c->coal_iov.iov_base = c->coal_buf + c->coal_sent;
+        c->coal_iov.iov_len = c->coal_bytes - c->coal_sent;
+        memset(&c->coal_msg, 0, sizeof(struct msghdr));
+        c->coal_msg.msg_iov = &c->coal_iov;
+        c->coal_msg.msg_iovlen = 1;
+
+        res = conn_sendmsg(c, &c->coal_msg);
+        if (res > 0) {
+            STATS_ADD(c, bytes_written, res);
+            c->coal_sent += res;
+            continue;
+        }
+        if (res == -1 && (errno == EAGAIN || errno == EWOULDBLOCK) &&
+            update_event(c, EV_WRITE | EV_PERSIST)) {
+            return false;
+        }
+        break;
+    }
+    /* do not send them again with the response being built */
+    for (i = 0; i < c->coal_iovs; i++) {
+        c->iov[i].iov_len = 0;
+    }
+    c->coal_bytes = 0;
+    c->coal_sent = 0;
+    return true;
+}
+
+/*
+ * Sends the coalesced responses before the connection is parked by a command
+ * waiting for the engine or a heavy thread, so that they are not held back
+ * as long as the command. What cannot be sent without blocking goes with
+ * the response of the command.
+ */
+static void conn_coal_flush(conn *c) {
+    ssize_t res;
+    size_t skip = 0;
+    int i;
+
+#ifdef ENABLE_IO_URING
+    if (c->uring.active) {
+        return; /* the send request must not be in flight while parked */
+    }
+#endif
+    while (c->coal_sent < c->coal_bytes) {
+        c->coal_iov.iov_base = c->coal_buf + c->coal_sent;
+        c->coal_iov.iov_len = c->coal_bytes - c->coal_sent;
+        memset(&c->coal_msg, 0, sizeof(struct msghdr));
+        c->coal_msg.msg_iov = &c->coal_iov;
+        c->coal_msg.msg_iovlen = 1;
+
+        res = conn_sendmsg(c, &c->coal_msg);
+        if (res <= 0) {
+            break;
+        }
+        STATS_ADD(c, bytes_written, res);
+        c->coal_sent += res;
+    }
+    if (c->coal_sent == c->coal_bytes) {
+        for (i = 0; i < c->coal_iovs; i++) {
+            c->iov[i].iov_len = 0;
+        }
+        c->coal_bytes = 0;
+        c->coal_sent = 0;
+        return;
+    }
+    /* skip the bytes sent from the iovs of the msglist */
+    for (i = 0; i < c->coal_iovs; i++) {
+        skip += c->iov[i].iov_len;
+    }
+    skip -= c->coal_bytes - c->coal_sent;
+    for (i = 0; i < c->coal_iovs && skip > 0; i++) {
+        size_t n = skip < c->iov[i].iov_len ? skip : c->iov[i].iov_len;
+        c->iov[i].iov_base = (char *)c->iov[i].iov_base + n;
+        c->iov[i].iov_len -= n;
+        skip -= n;
+    }
+}
+
+/* The coalesced responses in the msglist are sent or dropped. */
+static void conn_coal_done(conn *c) {
+    if (c->coal_iovs > 0) {
+        c->coal_iovs = 0;
+        c->coal_bytes = 0;
+        c->coal_sent = 0;
+    }
+}
+
 bool conn_write(conn *c) {
+    if (conn_coalesce_response(c)) {
+        conn_set_state(c, conn_new_cmd);
+        return true;
+    }
+
     /*
      * We want to write out a simple response. If we haven't already,
      * assemble it into a msgbuf list (this will be a single-entry
-     * list for TCP or a two-entry list for UDP).
+     * list for TCP or a two-entry list for UDP). The coalesced responses
+     * may be the first entries of the list.
      */
-    if (c->iovused == 0 || (IS_UDP(c->transport) && c->iovused == 1)) {
+    if (c->iovused == c->coal_iovs || (IS_UDP(c->transport) && c->iovused == 1)) {
         if (add_iov(c, c->wcurr, c->wbytes) != 0) {
             if (settings.verbose > 0) {
                 mc_logger->log(EXTENSION_LOG_WARNING, c,
@@ -14072,6 +17275,7 @@ bool conn_mwrite(conn *c) {
 
     switch (transmit(c)) {
     case TRANSMIT_COMPLETE:
+        conn_coal_done(c);
         if (c->state == conn_mwrite) {
             while (c->ileft > 0) {
                 item *it = *(c->icurr);
@@ -14120,8 +17324,11 @@ bool conn_mwrite(conn *c) {
         }
         break;
 
-    case TRANSMIT_INCOMPLETE:
     case TRANSMIT_HARD_ERROR:
+        conn_coal_done(c);
+        break;
+
+    case TRANSMIT_INCOMPLETE:
         break;                   /* Continue in state machine. */
 
     case TRANSMIT_SOFT_ERROR:
@@ -14131,7 +17338,30 @@ bool conn_mwrite(conn *c) {
     return true;
 }
 
+/*
+ * The command executed by a heavy thread has come back to the worker
+ * thread through notify_io_complete(). Release the per-thread resources
+ * of the command, and resume the state set by its response.
+ */
+bool conn_heavy_complete(conn *c) {
+    if (c->heavy.complete != NULL) {
+        c->heavy.complete(c);
+    }
+    c->heavy.execute = NULL;
+    conn_set_state(c, c->heavy.state);
+    return true;
+}
+
 bool conn_closing(conn *c) {
+    if (c->coal_bytes > 0 && !conn_coal_send(c)) {
+        return false; /* closed after sending the coalesced responses */
+    }
+#ifdef ENABLE_IO_URING
+    if (c->uring.active && !uring_conn_release(c)) {
+        /* closed when the requests in flight are completed */
+        return false;
+    }
+#endif
     if (IS_UDP(c->transport)) {
         conn_cleanup(c);
     } else {
@@ -14141,6 +17371,8 @@ bool conn_closing(conn *c) {
 }
 
 void event_handler(const int fd, const short which, void *arg) {
+    LIBEVENT_THREAD *thread;
+    struct timeval start, end;
     conn *c;
 
     c = (conn *)arg;
@@ -14180,11 +17412,26 @@ void event_handler(const int fd, const short which, void *arg) {
 
     perform_callbacks(ON_SWITCH_CONN, c, c);
 
+#ifdef ENABLE_IO_URING
+    /* The send completion of the ring continues the current requests. */
+    if (!c->uring.active || which != EV_WRITE)
+#endif
     c->nevents = settings.reqs_per_event;
 
+    /* the connection may be closed or migrated in the loop */
+    thread = c->thread;
+    gettimeofday(&start, NULL);
     while (c->state(c)) {
         /* do task */
     }
+    if (thread != NULL) {
+        gettimeofday(&end, NULL);
+        int64_t usec = (end.tv_sec - start.tv_sec) * 1000000
+                     + (end.tv_usec - start.tv_usec);
+        if (usec > 0) {
+            __sync_fetch_and_add(&thread->load_busy_usec, (uint64_t)usec);
+        }
+    }
 }
 
 static int new_socket(struct addrinfo *ai) {
@@ -14251,6 +17498,69 @@ static void maximize_sndbuf(const int sfd) {
  *        when they are successfully added to the list of ports we
  *        listen on.
  */
+/*
+ * Creates another TCP listening socket or UDP socket bound to the address
+ * of the given socket by SO_REUSEPORT. The kernel distributes the new
+ * connections or the datagrams among the sockets of the same address.
+ */
+static int new_reuseport_socket(const int sfd, struct addrinfo *ai,
+                                enum network_transport transport) {
+    struct sockaddr_storage addr;
+    socklen_t addrlen = sizeof(addr);
+    struct linger ling = {0, 0};
+    int flags = 1;
+    int nsfd;
+
+    if (getsockname(sfd, (struct sockaddr *)&addr, &addrlen) != 0) {
+        return -1;
+    }
+    if ((nsfd = new_socket(ai)) == -1) {
+        return -1;
+    }
+#ifdef IPV6_V6ONLY
+    if (ai->ai_family == AF_INET6) {
+        setsockopt(nsfd, IPPROTO_IPV6, IPV6_V6ONLY, (char *) &flags, sizeof(flags));
+    }
+#endif
+    setsockopt(nsfd, SOL_SOCKET, SO_REUSEADDR, (void *)&flags, sizeof(flags));
+    setsockopt(nsfd, SOL_SOCKET, SO_REUSEPORT, (void *)&flags, sizeof(flags));
+    if (IS_UDP(transport)) {
+        maximize_sndbuf(nsfd);
+    } else {
+        setsockopt(nsfd, SOL_SOCKET, SO_KEEPALIVE, (void *)&flags, sizeof(flags));
+        setsockopt(nsfd, SOL_SOCKET, SO_LINGER, (void *)&ling, sizeof(ling));
+        setsockopt(nsfd, IPPROTO_TCP, TCP_NODELAY, (void *)&flags, sizeof(flags));
+    }
+
+    if (bind(nsfd, (struct sockaddr *)&addr, addrlen) == -1 ||
+        (!IS_UDP(transport) && listen(nsfd, settings.backlog) == -1)) {
+        perror("reuseport listen()");
+        close(nsfd);
+        return -1;
+    }
+    return nsfd;
+}
+
+/*
+ * Hands the listening socket over to a worker thread, which accepts the
+ * new connections on it by itself. See conn_listening().
+ */
+static void dispatch_worker_listen(const int sfd) {
+    int *sfds = realloc(worker_listen_sfds, sizeof(int) * (worker_listen_count + 1));
+    if (sfds == NULL) {
+        mc_logger->log(EXTENSION_LOG_WARNING, NULL,
+                "failed to create worker listening connection\n");
+        exit(EXIT_FAILURE);
+    }
+    worker_listen_sfds = sfds;
+    worker_listen_sfds[worker_listen_count++] = sfd;
+
+    dispatch_conn_new(sfd, conn_listening, EV_READ | EV_PERSIST, 1, tcp_transport);
+    STATS_LOCK();
+    ++mc_stats.daemon_conns;
+    STATS_UNLOCK();
+}
+
 static int server_socket(int port, enum network_transport transport,
                          FILE *portnumber_file) {
     int sfd;
@@ -14303,6 +17613,15 @@ static int server_socket(int port, enum network_transport transport,
 #endif
 
         setsockopt(sfd, SOL_SOCKET, SO_REUSEADDR, (void *)&flags, sizeof(flags));
+        if (settings.worker_listen) {
+            error = setsockopt(sfd, SOL_SOCKET, SO_REUSEPORT, (void *)&flags, sizeof(flags));
+            if (error != 0) {
+                perror("setsockopt(SO_REUSEPORT)");
+                safe_close(sfd);
+                freeaddrinfo(ai);
+                return 1;
+            }
+        }
         if (IS_UDP(transport)) {
             maximize_sndbuf(sfd);
         } else {
@@ -14362,13 +17681,35 @@ static int server_socket(int port, enum network_transport transport,
             int c;
 
             for (c = 0; c < settings.num_threads; c++) {
+                int usfd = sfd;
+                if (settings.worker_listen && c > 0) {
+                    /* each worker thread reads on its own UDP socket */
+                    usfd = new_reuseport_socket(sfd, next, transport);
+                    if (usfd == -1) {
+                        mc_logger->log(EXTENSION_LOG_WARNING, NULL,
+                                "failed to create worker UDP socket\n");
+                        exit(EXIT_FAILURE);
+                    }
+                }
                 /* this is guaranteed to hit all threads because we round-robin */
-                dispatch_conn_new(sfd, conn_read, EV_READ | EV_PERSIST,
+                dispatch_conn_new(usfd, conn_read, EV_READ | EV_PERSIST,
                                   UDP_READ_BUFFER_SIZE, transport);
                 STATS_LOCK();
                 ++mc_stats.daemon_conns;
                 STATS_UNLOCK();
             }
+        } else if (settings.worker_listen) {
+            /* each worker thread accepts on its own listening socket */
+            dispatch_worker_listen(sfd);
+            for (int t = 1; t < settings.num_threads; t++) {
+                int wsfd = new_reuseport_socket(sfd, next, transport);
+                if (wsfd == -1) {
+                    mc_logger->log(EXTENSION_LOG_WARNING, NULL,
+                            "failed to create worker listening socket\n");
+                    exit(EXIT_FAILURE);
+                }
+                dispatch_worker_listen(wsfd);
+            }
         } else {
             if (!(listen_conn_add = conn_new(sfd, conn_listening,
                                              EV_READ | EV_PERSIST, 1,
@@ -14502,12 +17843,15 @@ static void clock_handler(const int fd, const short which, void *arg) {
     evtimer_add(&clockevent, &t);
 
     set_current_time();
+    threads_load_update();
 }
 
 static void usage(void) {
     printf(PACKAGE " " VERSION "\n");
     printf("-p <num>      TCP port number to listen on (default: 11211)\n"
            "-U <num>      UDP port number to listen on (default: 11211, 0 is off)\n"
+           "-Y <num>      UDP datagrams received by a system call (default: 8, max: 64),\n"
+           "              each up to 8KB if more than 1\n"
            "-s <file>     UNIX socket path to listen on (disables network support)\n"
            "-a <mask>     access mask for UNIX socket, in octal (default: 0700)\n"
            "-l <ip_addr>  interface to listen on (default: INADDR_ANY, all addresses)\n"
@@ -14551,6 +17895,20 @@ static void usage(void) {
     printf("-C            Disable use of CAS\n");
     printf("-b            Set the backlog queue limit (default: 1024)\n");
     printf("-B            Binding protocol - one of ascii, binary, or auto (default)\n");
+    printf("-W            Each worker thread accepts new connections on its own\n"
+           "              SO_REUSEPORT listening socket, and reads UDP requests\n"
+           "              on its own SO_REUSEPORT UDP socket\n");
+    printf("-w <policy>   Dispatch policy of new connections - roundrobin (default),\n"
+           "              load (to the least loaded worker thread), or migrate\n"
+           "              (load, and migrate idle connections off busy threads)\n");
+    printf("-H <num>      number of heavy threads executing the collection commands\n"
+           "              of a large cost, bop smget and sop get (default: 0, off)\n");
+    printf("-J <num>      estimated cost (keys or elements) of a command executed\n"
+           "              on the heavy threads (default: 1000)\n");
+#ifdef ENABLE_IO_URING
+    printf("-N <backend>  Network backend of worker threads - libevent (default)\n"
+           "              or io_uring\n");
+#endif
     printf("-I            Override the size of each slab page. Adjusts max item size\n"
            "              (default: 1mb, min: 1k, max: 128m)\n");
     printf("-E <engine>   Engine to load, must be given (for example, -E .libs/default_engine.so)\n");
@@ -15215,6 +18573,9 @@ static void close_listen_sockets(void)
         close(conn->sfd);
         conn = conn->next;
     }
+    for (int i = 0; i < worker_listen_count; i++) {
+        close(worker_listen_sfds[i]);
+    }
 }
 
 int main (int argc, char **argv) {
@@ -15269,6 +18630,7 @@ int main (int argc, char **argv) {
           "p:"  /* TCP port number to listen on */
           "s:"  /* unix socket path to listen on */
           "U:"  /* UDP port number to listen on */
+          "Y:"  /* UDP datagrams in a batch */
           "m:"  /* max memory to use for items in megabytes */
           "M"   /* return error on memory exhausted */
 #ifdef ENABLE_STICKY_ITEM
@@ -15292,6 +18654,11 @@ int main (int argc, char **argv) {
           "C"   /* Disable use of CAS */
           "b:"  /* backlog queue limit */
           "B:"  /* Binding protocol */
+          "N:"  /* Network backend */
+          "W"   /* Worker threads listen */
+          "w:"  /* Dispatch policy */
+          "H:"  /* Heavy threads */
+          "J:"  /* Heavy command threshold */
           "I:"  /* Max item size */
           "S"   /* Sasl ON */
           "E:"  /* Engine to load */
@@ -15316,6 +18683,15 @@ int main (int argc, char **argv) {
             settings.udpport = atoi(optarg);
             udp_specified = true;
             break;
+        case 'Y':
+            settings.udp_batch = atoi(optarg);
+            if (settings.udp_batch <= 0 || settings.udp_batch > UDP_BATCH_MAX) {
+                mc_logger->log(EXTENSION_LOG_WARNING, NULL,
+                        "Number of UDP datagrams in a batch must be between 1 and %d\n",
+                        UDP_BATCH_MAX);
+                return 1;
+            }
+            break;
         case 'p':
             settings.port = atoi(optarg);
             tcp_specified = true;
@@ -15462,6 +18838,57 @@ int main (int argc, char **argv) {
                 exit(EX_USAGE);
             }
             break;
+        case 'W':
+            settings.worker_listen = true;
+            break;
+        case 'w':
+            if (strcmp(optarg, "roundrobin") == 0) {
+                settings.dispatch = DISPATCH_ROUNDROBIN;
+            } else if (strcmp(optarg, "load") == 0) {
+                settings.dispatch = DISPATCH_LOAD;
+            } else if (strcmp(optarg, "migrate") == 0) {
+                settings.dispatch = DISPATCH_MIGRATE;
+            } else {
+                mc_logger->log(EXTENSION_LOG_WARNING, NULL,
+                        "Invalid value for dispatch policy: %s\n"
+                        " -- should be one of roundrobin, load, or migrate\n", optarg);
+                exit(EX_USAGE);
+            }
+            break;
+        case 'H':
+            settings.heavy_threads = atoi(optarg);
+            if (settings.heavy_threads < 0 || settings.heavy_threads > 64) {
+                mc_logger->log(EXTENSION_LOG_WARNING, NULL,
+                        "Number of heavy threads must be between 0 and 64\n");
+                return 1;
+            }
+            break;
+        case 'J':
+            settings.heavy_threshold = atoi(optarg);
+            if (settings.heavy_threshold <= 0) {
+                mc_logger->log(EXTENSION_LOG_WARNING, NULL,
+                        "Heavy command threshold must be greater than 0\n");
+                return 1;
+            }
+            break;
+        case 'N':
+            if (strcmp(optarg, "libevent") == 0) {
+                settings.io_uring = false;
+            } else if (strcmp(optarg, "io_uring") == 0) {
+#ifdef ENABLE_IO_URING
+                settings.io_uring = true;
+#else
+                mc_logger->log(EXTENSION_LOG_WARNING, NULL,
+                        "io_uring network backend is not supported.\n");
+                exit(EX_USAGE);
+#endif
+            } else {
+                mc_logger->log(EXTENSION_LOG_WARNING, NULL,
+                        "Invalid value for network backend: %s\n"
+                        " -- should be one of libevent or io_uring\n", optarg);
+                exit(EX_USAGE);
+            }
+            break;
         case 'I':
             unit = optarg[strlen(optarg)-1];
             if (unit == 'k' || unit == 'm' ||
@@ -15859,6 +19286,7 @@ int main (int argc, char **argv) {
 
     /* start up worker threads if MT mode */
     thread_init(settings.num_threads, main_base);
+    heavy_threads_init(settings.heavy_threads);
 
     /* initialise clock event */
     clock_handler(0, 0, 0);
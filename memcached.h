@@ -33,6 +33,9 @@
 #include "mc_util.h"
 #include "cmdlog.h"
 #include "lqdetect.h"
+#ifdef ENABLE_IO_URING
+#include "uring.h"
+#endif
 #include "engine_loader.h"
 #include "sasl_defs.h"
 
@@ -56,9 +59,13 @@
 #define INCR_MAX_STORAGE_LEN 24
 
 #define DATA_BUFFER_SIZE 2048
+/* max bytes of the responses coalesced for the pipelined commands */
+#define COAL_BUFFER_SIZE 16384
 #define UDP_READ_BUFFER_SIZE 65536
 #define UDP_MAX_PAYLOAD_SIZE 1400
 #define UDP_HEADER_SIZE 8
+#define UDP_BATCH_MAX 64 /* max datagrams received or sent by a system call */
+#define UDP_BATCH_DGRAM_SIZE 8192 /* max datagram received in a batch */
 #define MAX_SENDBUF_SIZE (256 * 1024 * 1024)
 /* I'm told the max length of a 64-bit num converted to string is 20 bytes.
  * Plus a few for spaces, \r\n, \0 */
@@ -82,6 +89,9 @@
 #define IOV_LIST_HIGHWAT 600
 #define MSG_LIST_HIGHWAT 100
 
+/* max buffer sets of the idle connections kept in the pool of a thread */
+#define CONN_BUFS_POOL_MAX 64
+
 /* Binary protocol stuff */
 #define MIN_BIN_PKT_LENGTH 16
 #define BIN_PKT_HDR_WORDS (MIN_BIN_PKT_LENGTH/sizeof(uint32_t))
@@ -91,6 +101,11 @@
 /* Max element value size */
 #define MAX_ELEMENT_BYTES  (4*1024)
 
+/* In lop/sop/bop minsert, max limit on the number of given elements */
+#define MAX_MINSERT_ELM_COUNT   1000
+/* In lop/sop/bop minsert, max length of element head line: <bkey> [<eflag>] <bytes> */
+#define MINSERT_ELEM_HEAD_LENG  ((MAX_BKEY_LENG*2+2)+(MAX_EFLAG_LENG*2+2)+12)
+
 #ifdef SUPPORT_BOP_MGET
 /* In bop mget, max limit on the number of given keys */
 #define MAX_BMGET_KEY_COUNT     200
@@ -105,6 +120,18 @@
 #define MAX_SMGET_REQ_COUNT     2000
 #endif
 
+/* In bop aggregate, max limit on the number of groups */
+#define MAX_BOP_AGGR_GROUPS     1000
+
+/* In sop scan and mop scan, the default and max limit on the count */
+#define SCAN_DEFAULT_COUNT      100
+#define MAX_SCAN_COUNT          1000
+/* In sop scan and mop scan, max number of the elements of the same hash
+ * value, which are returned together even beyond the count.
+ * It is the max hash chain size of the set and map collections.
+ */
+#define MAX_SCAN_HASH_GROUP     64
+
 /* command pipelining limits */
 #define PIPE_MAX_CMD_COUNT  500
 #define PIPE_MAX_RES_SIZE   ((PIPE_MAX_CMD_COUNT*40)+60) // 60: for head and tail response
@@ -161,6 +188,10 @@ enum bin_substates {
     bin_reading_sop_prepare_nread,
     bin_reading_sop_nread_complete,
     bin_reading_sop_get,
+    bin_reading_mop_create,
+    bin_reading_mop_prepare_nread,
+    bin_reading_mop_nread_field,
+    bin_reading_mop_nread_complete,
     bin_reading_bop_create,
     bin_reading_bop_prepare_nread,
     bin_reading_bop_nread_complete,
@@ -224,6 +255,7 @@ struct thread_stats {
     uint64_t          cmd_flush;
     uint64_t          cmd_flush_prefix;
     uint64_t          conn_yields; /* # of yields for connections (-R option)*/
+    uint64_t          coalesced_responses; /* # of responses sent with the later ones */
     uint64_t          auth_cmds;
     uint64_t          auth_errors;
     /* list command stats */
@@ -243,6 +275,8 @@ struct thread_stats {
     uint64_t          cmd_mop_update;
     uint64_t          cmd_mop_delete;
     uint64_t          cmd_mop_get;
+    uint64_t          cmd_mop_incr;
+    uint64_t          cmd_mop_decr;
     /* btree command stats */
     uint64_t          cmd_bop_create;
     uint64_t          cmd_bop_insert;
@@ -299,6 +333,12 @@ struct thread_stats {
     uint64_t          mop_get_elem_hits;
     uint64_t          mop_get_none_hits;
     uint64_t          mop_get_misses;
+    uint64_t          mop_incr_elem_hits;
+    uint64_t          mop_incr_none_hits;
+    uint64_t          mop_incr_misses;
+    uint64_t          mop_decr_elem_hits;
+    uint64_t          mop_decr_none_hits;
+    uint64_t          mop_decr_misses;
     /* btree hit & miss stats */
     uint64_t          bop_create_oks;
     uint64_t          bop_insert_hits;
@@ -372,6 +412,12 @@ struct mc_stats {
 /**
  * Globally accessible settings as derived from the commandline.
  */
+enum dispatch_policy {
+    DISPATCH_ROUNDROBIN = 0, /* in turn */
+    DISPATCH_LOAD,           /* to the least loaded worker thread */
+    DISPATCH_MIGRATE         /* DISPATCH_LOAD, and migrate idle connections */
+};
+
 struct settings {
     size_t maxbytes;
     int maxconns;
@@ -402,6 +448,12 @@ struct settings {
     int max_map_size;       /* Maximum elements in map collection */
     int max_btree_size;     /* Maximum elements in b+tree collection */
     int topkeys;            /* Number of top keys to track */
+    bool io_uring;          /* worker threads use the io_uring network backend */
+    bool worker_listen;     /* worker threads accept on their own listening sockets */
+    int udp_batch;          /* UDP datagrams received by a system call */
+    enum dispatch_policy dispatch; /* how new connections are assigned to worker threads */
+    int heavy_threads;      /* threads executing the heavy collection commands */
+    int heavy_threshold;    /* estimated cost of a command to be offloaded */
     struct {
         EXTENSION_DAEMON_DESCRIPTOR *daemons;
         EXTENSION_LOGGER_DESCRIPTOR *logger;
@@ -439,6 +491,23 @@ typedef struct {
     enum thread_type type;      /* Type of IO this thread processes */
     token_buff_t token_buff;    /* token buffer */
     mblck_pool_t mblck_pool;    /* memory block pool */
+#ifdef ENABLE_IO_URING
+    struct uring_thread *uring; /* io_uring of this thread (NULL if not used) */
+#endif
+    /* load of this thread (see dispatch_conn_new) */
+    int      load_conns;        /* connections handled by this thread */
+    uint64_t load_reqs;         /* requests processed */
+    uint64_t load_busy_usec;    /* time spent on processing the connections */
+    uint64_t last_reqs;         /* load_reqs at the last sampling */
+    uint64_t last_busy_usec;    /* load_busy_usec at the last sampling */
+    uint32_t req_rate;          /* requests per second */
+    uint32_t busy_permille;     /* busy time in permille */
+    uint64_t migrated_in;       /* idle connections migrated from other threads */
+    uint64_t migrated_out;      /* idle connections migrated to other threads */
+    /* buffers of the idle connections (see conn_borrow_buffers) */
+    struct conn_bufs *bufs_pool; /* buffer sets not used by any connection */
+    int      bufs_pooled;       /* buffer sets in bufs_pool */
+    uint64_t bufs_borrowed;     /* buffer sets borrowed by the connections */
 } LIBEVENT_THREAD;
 
 #define LOCK_THREAD(t)                          \
@@ -464,6 +533,18 @@ typedef struct {
 typedef struct conn conn;
 typedef bool (*STATE_FUNC)(conn *);
 
+/* flags of a meta command (see meta_parse_common_flag) */
+#define META_RFLAGS_MAX 8
+#define META_OPAQUE_MAX 32
+
+typedef struct {
+    char    rflags[META_RFLAGS_MAX]; /* flags to return, in the requested order */
+    uint8_t nrflags;
+    bool    quiet;                   /* q: omit the responses of success */
+    uint8_t nopaque;
+    char    opaque[META_OPAQUE_MAX]; /* O: token returned as it is */
+} meta_flags_t;
+
 /**
  * The structure representing a connection into memcached.
  */
@@ -482,6 +563,9 @@ struct conn {
     struct event event;
     short  ev_flags;
     short  which;   /** which events were just triggered */
+#ifdef ENABLE_IO_URING
+    struct uring_conn uring; /** io_uring network backend state */
+#endif
 
     char   *rbuf;   /** buffer to read commands into */
     char   *rcurr;  /** but if we parsed some already, this is where we stopped */
@@ -496,6 +580,15 @@ struct conn {
     STATE_FUNC   write_and_go;
     void        *write_and_free; /** free this memory after finishing writing */
 
+    /* responses held back while more pipelined commands are in rbuf */
+    char   *coal_buf;
+    int    coal_size;
+    int    coal_bytes;
+    int    coal_sent;   /** bytes sent by conn_coal_send() or conn_coal_flush() */
+    int    coal_iovs;   /** iovs of coal_buf at the head of the msglist */
+    struct msghdr coal_msg;
+    struct iovec  coal_iov;
+
     int         rtype;  /* CONN_RTYPE_XXXXX */
     int         rindex; /* used when rtype is HINFO or EINFO */
     char       *ritem;  /** when we read in an item's value, it goes here */
@@ -537,6 +630,24 @@ struct conn {
     /* map collection */
     field_t      coll_field;   /* field in map collection */
 
+    /* command offloaded to the heavy threads */
+    struct {
+        void (*execute)(struct conn *c);  /* runs on a heavy thread, builds the response */
+        void (*complete)(struct conn *c); /* runs on the worker thread, may be NULL */
+        struct conn      *next;   /* link in the queue of the heavy threads */
+        STATE_FUNC        state;  /* state to resume after the command */
+        ENGINE_ERROR_CODE ret;
+        uint32_t          cursor; /* scan cursor of the chunked sop get */
+        item             *set;    /* set referenced by the chunked sop get */
+        bool              random;
+        bool              dropped;
+        uint32_t          flags;
+        token_t          *keys;
+#ifdef SUPPORT_BOP_SMGET
+        smget_result_t    smres;
+#endif
+    } heavy;
+
     /* data for the nread state */
 
     /**
@@ -547,6 +658,8 @@ struct conn {
 
     void   *item;     /* for commands set/add/replace  */
     ENGINE_STORE_OPERATION    store_op; /* which one is it: set/add/replace */
+    bool          meta_store; /* the item is stored by a meta command (ms) */
+    meta_flags_t  meta;       /* flags of the meta command */
 
 
     /* data for the swallow state */
@@ -573,6 +686,8 @@ struct conn {
     char   **suffixcurr;
     int    suffixleft;
 
+    bool   bufs_pooled; /* the buffers above are borrowed only while active */
+
 #ifdef DETECT_LONG_QUERY
     int    lq_bufcnt;
 #endif
@@ -582,10 +697,11 @@ struct conn {
 
     /* data for UDP clients */
     int    request_id; /* Incoming UDP request ID, if this is a UDP "connection" */
-    struct sockaddr request_addr; /* Who sent the most recent request */
+    struct sockaddr_storage request_addr; /* Who sent the most recent request */
     socklen_t request_addr_size;
     unsigned char *hdrbuf; /* udp packet headers */
     int    hdrsize;   /* number of headers' worth of space is allocated */
+    struct udp_batch *udp_batch; /* datagrams received in a batch */
 
     /* command pipelining processing fields */
     int               pipe_state;
@@ -624,9 +740,11 @@ struct conn {
     int opaque;
     int keylen;
     conn   *next;     /* Used for generating a list of conn structures */
+    bool    io_pending; /* in the pending_io list of its thread */
     LIBEVENT_THREAD *thread; /* Pointer to the thread object serving this connection */
     conn *conn_prev;  /* used in the conn_list of a thread in charge */
     conn *conn_next;  /* used in the conn_list of a thread in charge */
+    rel_time_t last_cmd_time; /* the time the last command started */
 
     ENGINE_ERROR_CODE aiostat;
     bool ewouldblock;
@@ -681,6 +799,13 @@ void threads_shutdown(void);
 int  dispatch_event_add(int thread, conn *c);
 void dispatch_conn_new(int sfd, STATE_FUNC init_state, int event_flags,
                        int read_buffer_size, enum network_transport transport);
+void accept_conn_new(conn *listen_c, int sfd, STATE_FUNC init_state, int event_flags,
+                     int read_buffer_size, enum network_transport transport);
+void threads_load_update(void);
+void threads_load_stats(ADD_STAT add_stats, conn *c);
+void heavy_threads_init(int nthreads);
+void heavy_cmd_dispatch(conn *c);
+const char *dispatch_policy_text(enum dispatch_policy policy);
 
 /* Lock wrappers for cache functions that are called from main loop. */
 void accept_new_conns(const bool do_accept);
@@ -717,6 +842,7 @@ size_t list_to_array(conn **dest, size_t max_items, conn **l);
 void init_check_stdin(struct event_base *base);
 
 void conn_close(conn *c);
+void event_handler(const int fd, const short which, void *arg);
 
 #if HAVE_DROP_PRIVILEGES
 extern void drop_privileges(void);
@@ -735,6 +861,7 @@ bool conn_nread(conn *c);
 bool conn_swallow(conn *c);
 bool conn_closing(conn *c);
 bool conn_mwrite(conn *c);
+bool conn_heavy_complete(conn *c);
 
 /* If supported, give compiler hints for branch prediction. */
 #if !defined(__GNUC__) || (__GNUC__ == 2 && __GNUC_MINOR__ < 96)
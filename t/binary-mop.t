@@ -0,0 +1,175 @@
+#!/usr/bin/perl
+
+use strict;
+use warnings;
+use Test::More tests => 33;
+use FindBin qw($Bin);
+use lib "$Bin/lib";
+use MemcachedTest;
+
+my $engine = shift;
+my $server = get_memcached($engine);
+my $sock = $server->sock;
+my $bsock = $server->new_sock;
+
+use constant REQ_MAGIC       => 0x80;
+use constant PKT_FMT         => "CCnCCnNNNN";
+use constant HDR_LEN         => 24;
+
+use constant CMD_NOOP        => 0x0A;
+use constant CMD_MOP_CREATE  => 0x80;
+use constant CMD_MOP_INSERT  => 0x81;
+use constant CMD_MOP_UPDATE  => 0x82;
+use constant CMD_MOP_DELETE  => 0x83;
+use constant CMD_MOP_GET     => 0x84;
+use constant CMD_MOP_INSERTQ => 0x85;
+use constant CMD_MOP_UPDATEQ => 0x86;
+use constant CMD_MOP_DELETEQ => 0x87;
+
+use constant RES_SUCCESS      => 0x00;
+use constant RES_KEY_ENOENT   => 0x01;
+use constant RES_KEY_EEXISTS  => 0x02;
+use constant RES_EBADTYPE     => 0x32;
+use constant RES_EBADVALUE    => 0x34;
+use constant RES_ELEM_ENOENT  => 0x37;
+use constant RES_ELEM_EEXISTS => 0x38;
+
+sub bin_send {
+    my ($cmd, $key, $extra, $val, $opaque) = @_;
+    my $bodylen = length($extra) + length($key) + length($val);
+    my $msg = pack(PKT_FMT, REQ_MAGIC, $cmd, length($key), length($extra),
+                   0, 0, $bodylen, $opaque || 0, 0, 0);
+    print $bsock $msg . $extra . $key . $val;
+}
+
+sub bin_recv {
+    my ($hdr, $body) = ('', '');
+    read($bsock, $hdr, HDR_LEN) == HDR_LEN or die "short header";
+    my ($magic, $cmd, $keylen, $extlen, $datatype, $status, $bodylen,
+        $opaque) = unpack(PKT_FMT, $hdr);
+    read($bsock, $body, $bodylen) if $bodylen > 0;
+    return ($status, $body, $cmd, $opaque);
+}
+
+sub bin_cmd {
+    bin_send(@_);
+    my ($status, $body) = bin_recv();
+    return wantarray ? ($status, $body) : $status;
+}
+
+sub mop_create {
+    my ($key, $flags, $exptime, $maxcount) = @_;
+    return bin_cmd(CMD_MOP_CREATE, $key,
+                   pack("NNNCCCC", $flags, $exptime, $maxcount, 0, 1, 0, 0), '');
+}
+
+sub mop_insert_extra {
+    my ($field, $create) = @_;
+    return pack("NNNCCCC", 11, 0, 0, $create || 0, length($field), 0, 0);
+}
+
+sub mop_insert {
+    my ($key, $field, $value, $create) = @_;
+    return bin_cmd(CMD_MOP_INSERT, $key, mop_insert_extra($field, $create), $field . $value);
+}
+
+sub mop_update {
+    my ($key, $field, $value) = @_;
+    return bin_cmd(CMD_MOP_UPDATE, $key, pack("CCCC", length($field), 0, 0, 0), $field . $value);
+}
+
+sub mop_delete {
+    my ($key, $drop, @fields) = @_;
+    return bin_cmd(CMD_MOP_DELETE, $key, pack("NCCCC", scalar(@fields), $drop, 0, 0, 0),
+                   join(' ', @fields));
+}
+
+# returns (status, count, { field => value })
+sub mop_get {
+    my ($key, $delete, $drop, @fields) = @_;
+    my ($status, $body) = bin_cmd(CMD_MOP_GET, $key,
+                                  pack("NCCCC", scalar(@fields), $delete, $drop, 0, 0),
+                                  join(' ', @fields));
+    return ($status) if $status != RES_SUCCESS;
+    my ($flags, $count) = unpack("NN", substr($body, 0, 8, ''));
+    my @vlens = unpack("N$count", substr($body, 0, 4 * $count, ''));
+    my @flens = unpack("C$count", substr($body, 0, $count, ''));
+    my %result;
+    for (my $i = 0; $i < $count; $i++) {
+        my $field = substr($body, 0, $flens[$i], '');
+        $result{$field} = substr($body, 0, $vlens[$i], '');
+    }
+    return ($status, $count, \%result);
+}
+
+# Send a quiet command followed by noop, and check that only noop replies.
+sub quiet_ok {
+    my ($cmd, $key, $extra, $val, $msg) = @_;
+    bin_send($cmd, $key, $extra, $val, 1001);
+    bin_send(CMD_NOOP, '', '', '', 1002);
+    my ($status, $body, $rcmd, $opaque) = bin_recv();
+    is($opaque, 1002, $msg);
+}
+
+my ($status, $count, $res);
+
+# create
+is(mop_create("mkey", 11, 0, 0), RES_SUCCESS, "mop create");
+is(mop_create("mkey", 11, 0, 0), RES_KEY_EEXISTS, "mop create exists");
+
+# insert
+is(mop_insert("mkey", "f1", "value1"), RES_SUCCESS, "mop insert f1");
+is(mop_insert("mkey", "f2", "value22"), RES_SUCCESS, "mop insert f2");
+is(mop_insert("mkey", "f3", ""), RES_SUCCESS, "mop insert f3 empty value");
+is(mop_insert("mkey", "f1", "other"), RES_ELEM_EEXISTS, "mop insert element exists");
+is(mop_insert("nokey", "f1", "value1"), RES_KEY_ENOENT, "mop insert no key");
+is(mop_insert("ckey", "f1", "value1", 1), RES_SUCCESS, "mop insert with create");
+is(bin_cmd(CMD_MOP_INSERT, "mkey", mop_insert_extra(""), "novalue"), RES_EBADVALUE,
+   "mop insert without field");
+mem_cmd_is($sock, "set skey 0 0 1", "a", "STORED");
+is(mop_insert("skey", "f1", "value1"), RES_EBADTYPE, "mop insert type mismatch");
+
+# get all and some
+($status, $count, $res) = mop_get("mkey", 0, 0);
+is($status, RES_SUCCESS, "mop get all");
+is($count, 3, "mop get all count");
+is_deeply($res, { f1 => "value1", f2 => "value22", f3 => "" }, "mop get all elements");
+($status, $count, $res) = mop_get("mkey", 0, 0, "f2", "f3", "f9");
+is($count, 2, "mop get some count");
+is_deeply($res, { f2 => "value22", f3 => "" }, "mop get some elements");
+($status) = mop_get("mkey", 0, 0, "f9");
+is($status, RES_ELEM_ENOENT, "mop get no element");
+($status) = mop_get("nokey", 0, 0);
+is($status, RES_KEY_ENOENT, "mop get no key");
+
+# update
+is(mop_update("mkey", "f1", "updated_value"), RES_SUCCESS, "mop update f1");
+is(mop_update("mkey", "f9", "x"), RES_ELEM_ENOENT, "mop update no element");
+($status, $count, $res) = mop_get("mkey", 0, 0, "f1");
+is($res->{f1}, "updated_value", "mop update result");
+mem_cmd_is($sock, "mop get mkey 2 1", "f1",
+           "VALUE 11 1\nf1 13 updated_value\nEND");
+
+# delete
+is(mop_delete("mkey", 0, "f2"), RES_SUCCESS, "mop delete f2");
+is(mop_delete("mkey", 0, "f2"), RES_ELEM_ENOENT, "mop delete no element");
+mem_cmd_is($sock, "getattr mkey count", "", "ATTR count=2\nEND");
+
+# get with delete
+($status, $count, $res) = mop_get("mkey", 1, 0, "f3");
+is($count, 1, "mop get with delete");
+mem_cmd_is($sock, "getattr mkey count", "", "ATTR count=1\nEND");
+
+# quiet variants
+quiet_ok(CMD_MOP_INSERTQ, "mkey", mop_insert_extra("q1"), "q1qvalue", "mop insertq");
+quiet_ok(CMD_MOP_UPDATEQ, "mkey", pack("CCCC", 2, 0, 0, 0), "q1qvalue2", "mop updateq");
+($status, $count, $res) = mop_get("mkey", 0, 0, "q1");
+is($res->{q1}, "qvalue2", "mop quiet result");
+quiet_ok(CMD_MOP_DELETEQ, "mkey", pack("NCCCC", 1, 0, 0, 0, 0), "q1", "mop deleteq");
+
+# delete all with drop
+is(mop_delete("mkey", 1), RES_SUCCESS, "mop delete all with drop");
+mem_cmd_is($sock, "mop get mkey 0 0", "", "NOT_FOUND");
+
+# after test
+release_memcached($engine, $server);
@@ -0,0 +1,75 @@
+#!/usr/bin/perl
+
+# The responses of the pipelined commands are coalesced and sent
+# together with the response of a later command.
+
+use strict;
+use Test::More tests => 11;
+use FindBin qw($Bin);
+use lib "$Bin/lib";
+use MemcachedTest;
+
+my $engine = shift;
+my $server = get_memcached($engine);
+my $sock = $server->sock;
+
+sub read_lines {
+    my ($count) = @_;
+    my @lines;
+    push(@lines, scalar <$sock>) for (1 .. $count);
+    return @lines;
+}
+
+# pipelined simple responses
+my $count = 1000;
+print $sock join("", map { "set key$_ 0 0 " . length($_) . "\r\n$_\r\n" } (1 .. $count));
+my @lines = read_lines($count);
+is(scalar(grep { $_ eq "STORED\r\n" } @lines), $count, "pipelined set responses");
+my $coalesced = mem_stats($sock)->{"coalesced_responses"};
+ok($coalesced > 0, "responses coalesced: $coalesced");
+
+# the coalesced responses go ahead of the value responses
+print $sock join("", map { "incr key$_ 1\r\nget key$_\r\n" } (1 .. 100));
+@lines = read_lines(400);
+my $ok = 0;
+for (my $i = 1; $i <= 100; $i++) {
+    my $value = $i + 1;
+    my @res = splice(@lines, 0, 4);
+    $ok++ if ("@res" eq "$value\r\n VALUE key$i 0 " . length($value) . "\r\n $value\r\n END\r\n");
+}
+is($ok, 100, "incr and get pipelined");
+
+# error and noreply commands in the pipeline
+print $sock "set key1 0 0 1\r\na\r\nbogus\r\nset key2 0 0 1 noreply\r\nb\r\n" .
+            "set key3 0 0 1\r\nab\r\ndelete key1\r\nget key2\r\n";
+@lines = read_lines(7);
+is("@lines", "STORED\r\n ERROR unknown command\r\n CLIENT_ERROR bad data chunk\r\n" .
+             " ERROR unknown command\r\n" .
+             " DELETED\r\n VALUE key2 0 1\r\n b\r\n", "errors in the pipeline");
+is(scalar <$sock>, "END\r\n", "end of the pipeline");
+
+# the coalesced responses are sent while waiting for the data
+print $sock "set key1 0 0 1\r\n1\r\nset key2 0 0 10\r\n01234";
+is(scalar <$sock>, "STORED\r\n", "sent before waiting for the data");
+print $sock "56789\r\n";
+is(scalar <$sock>, "STORED\r\n", "stored after the data");
+
+# the coalesced responses are sent before closing
+print $sock "set key1 0 0 1\r\n1\r\nset key2 0 0 1\r\n2\r\nquit\r\n";
+@lines = read_lines(2);
+is("@lines", "STORED\r\n STORED\r\n", "sent before closing");
+
+# the coalesced responses are sent before the command on the heavy thread
+release_memcached($engine, $server);
+$server = get_memcached($engine, "-H 1 -J 10");
+$sock = $server->sock;
+my $block = join("", map { length("e$_") . "\r\ne$_\r\n" } (1 .. 20));
+print $sock "sop minsert set1 20 " . length($block) . " create 0 0 100\r\n$block\r\n";
+is(scalar <$sock>, "CREATED_STORED 20\r\n", "set of 20 elements");
+print $sock "set key1 0 0 1\r\n1\r\nset key2 0 0 1\r\n2\r\nsop get set1 0\r\nget key1\r\n";
+@lines = read_lines(27);
+is("@lines[0 .. 2]", "STORED\r\n STORED\r\n VALUE 0 20\r\n", "coalesced ahead of sop get");
+is("@lines[23 .. 26]", "END\r\n VALUE key1 0 1\r\n 1\r\n END\r\n", "followed by get");
+
+# after test
+release_memcached($engine, $server);
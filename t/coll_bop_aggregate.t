@@ -0,0 +1,140 @@
+#!/usr/bin/perl
+
+# Check bop aggregate results against the ones computed from the inserted elements.
+
+use strict;
+use Test::More tests => 40;
+use FindBin qw($Bin);
+use lib "$Bin/lib";
+use MemcachedTest;
+
+my $engine = shift;
+my $server = get_memcached($engine);
+my $sock = $server->sock;
+
+my $elem_count = 3000;
+my @elems = (); # [bkey, group, eflag value, value]
+
+# eflag: <group(1 byte)><eflag value(2 bytes)>
+mem_cmd_is($sock, "bop create abtree 0 0 -1", "", "CREATED");
+for (my $i = 0; $i < $elem_count; $i++) {
+    my $bkey = $i * 2;
+    my $group = $i % 5;
+    my $fval = ($i * 37) % 4000;
+    my $value = ($i % 7 == 0) ? "none$i" : ($i - 1500);
+    my $eflag = sprintf("0x%02X%04X", $group, $fval);
+    print $sock "bop insert abtree $bkey $eflag " . length($value) . "\r\n$value\r\n";
+    scalar <$sock>;
+    push(@elems, [$bkey, $group, $fval, $value]);
+}
+mem_cmd_is($sock, "bop count abtree 0..10000", "", "COUNT=$elem_count");
+
+# expected response of the elements in [$from, $to] passing the filter
+sub expected_result {
+    my ($from, $to, $filter, $operand, $grouped) = @_;
+    my ($min, $max) = ($from <= $to) ? ($from, $to) : ($to, $from);
+    my %groups = ();
+    foreach my $elem (grep { $_->[0] >= $min && $_->[0] <= $max && $filter->($_) } @elems) {
+        my $value;
+        if ($operand eq "value") {
+            next if ($elem->[3] !~ /^-?\d+$/);
+            $value = $elem->[3];
+        } elsif ($operand eq "eflag") {
+            $value = $elem->[2];
+        } else {
+            $value = 0;
+        }
+        my $g = $grouped ? sprintf("0x%02X", $elem->[1]) : "";
+        if (!defined($groups{$g})) {
+            $groups{$g} = [0, 0, $value, $value];
+        }
+        my $agg = $groups{$g};
+        $agg->[0]++;
+        $agg->[1] += $value;
+        $agg->[2] = $value if ($value < $agg->[2]);
+        $agg->[3] = $value if ($value > $agg->[3]);
+    }
+    return "NOT_FOUND_ELEMENT" if (scalar(keys %groups) == 0);
+
+    my $rst = "AGGREGATED " . scalar(keys %groups) . "\n";
+    foreach my $g (sort keys %groups) {
+        my $agg = $groups{$g};
+        $rst .= "$g " if ($grouped);
+        $rst .= $agg->[0];
+        if ($operand ne "") {
+            $rst .= sprintf(" %d %d %d %.3f", $agg->[1], $agg->[2], $agg->[3], $agg->[1] / $agg->[0]);
+        }
+        $rst .= "\n";
+    }
+    $rst .= "END";
+    return $rst;
+}
+
+my $all = sub { 1 };
+
+# unfiltered counts answered from the index nodes
+foreach my $range ([0, 10000], [10000, 0], [1, 5999], [5999, 1], [777, 4321],
+                   [4321, 777], [100, 100], [101, 101], [7000, 8000], [0, 0]) {
+    my ($from, $to) = @$range;
+    my $bkrange = ($from == $to) ? $from : "$from..$to";
+    mem_cmd_is($sock, "bop aggregate abtree $bkrange", "",
+               expected_result($from, $to, $all, "", 0));
+}
+
+# value and eflag operands
+mem_cmd_is($sock, "bop aggregate abtree 0..10000 value", "",
+           expected_result(0, 10000, $all, "value", 0));
+mem_cmd_is($sock, "bop aggregate abtree 5000..300 value", "",
+           expected_result(5000, 300, $all, "value", 0));
+mem_cmd_is($sock, "bop aggregate abtree 0..10000 eflag 1 2", "",
+           expected_result(0, 10000, $all, "eflag", 0));
+mem_cmd_is($sock, "bop aggregate abtree 14 value", "",
+           expected_result(14, 14, $all, "value", 0));
+
+# with eflag filter
+my $group2 = sub { $_[0]->[1] == 2 };
+mem_cmd_is($sock, "bop aggregate abtree 0..10000 0 EQ 0x02", "",
+           expected_result(0, 10000, $group2, "", 0));
+mem_cmd_is($sock, "bop aggregate abtree 0..10000 0 EQ 0x02 value", "",
+           expected_result(0, 10000, $group2, "value", 0));
+my $small = sub { $_[0]->[2] < 0x100 };
+mem_cmd_is($sock, "bop aggregate abtree 2000..0 1 LT 0x0100 eflag 1 2", "",
+           expected_result(2000, 0, $small, "eflag", 0));
+my $odd = sub { $_[0]->[1] % 2 == 1 };
+mem_cmd_is($sock, "bop aggregate abtree 0..10000 0 & 0x01 EQ 0x01 value group 0 1", "",
+           expected_result(0, 10000, $odd, "value", 1));
+
+# grouped by eflag field
+mem_cmd_is($sock, "bop aggregate abtree 0..10000 group 0 1", "",
+           expected_result(0, 10000, $all, "", 1));
+mem_cmd_is($sock, "bop aggregate abtree 0..10000 value group 0 1", "",
+           expected_result(0, 10000, $all, "value", 1));
+mem_cmd_is($sock, "bop aggregate abtree 3000..1000 eflag 1 2 group 0 1", "",
+           expected_result(3000, 1000, $all, "eflag", 1));
+mem_cmd_is($sock, "bop aggregate abtree 0..10000 0 NE 0x00,0x01,0x02 group 0 1", "",
+           expected_result(0, 10000, sub { $_[0]->[1] > 2 }, "", 1));
+
+# no aggregated element
+mem_cmd_is($sock, "bop aggregate abtree 0 value", "", "NOT_FOUND_ELEMENT");
+mem_cmd_is($sock, "bop aggregate abtree 0..10000 0 EQ 0x07", "", "NOT_FOUND_ELEMENT");
+mem_cmd_is($sock, "bop aggregate abtree 0..10000 group 5 1", "", "NOT_FOUND_ELEMENT");
+
+# elements without eflag
+mem_cmd_is($sock, "bop create nbtree 0 0 0", "", "CREATED");
+mem_cmd_is($sock, "bop insert nbtree 1 2", "10", "STORED");
+mem_cmd_is($sock, "bop insert nbtree 2 0x01 2", "20", "STORED");
+mem_cmd_is($sock, "bop aggregate nbtree 0..9 eflag 0 1", "", "AGGREGATED 1\n1 1 1 1 1.000\nEND");
+mem_cmd_is($sock, "bop aggregate nbtree 0..9 value", "", "AGGREGATED 1\n2 30 10 20 15.000\nEND");
+
+# failures
+mem_cmd_is($sock, "bop insert nbtree 3 19", "9223372036854775807", "STORED");
+mem_cmd_is($sock, "bop aggregate nbtree 0..9 value", "", "OVERFLOWED");
+mem_cmd_is($sock, "bop aggregate abtree 0..10000 group 1 2", "", "CLIENT_ERROR too many groups");
+mem_cmd_is($sock, "bop aggregate abtree 0x00..0xFF", "", "BKEY_MISMATCH");
+mem_cmd_is($sock, "bop aggregate nokey 0..10", "", "NOT_FOUND");
+mem_cmd_is($sock, "set skey 0 0 1", "1", "STORED");
+mem_cmd_is($sock, "bop aggregate skey 0..10", "", "TYPE_MISMATCH");
+mem_cmd_is($sock, "bop aggregate abtree 0..10000 eflag 0 9", "", "CLIENT_ERROR bad command line format");
+
+# after test
+release_memcached($engine, $server);
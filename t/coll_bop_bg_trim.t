@@ -0,0 +1,159 @@
+#!/usr/bin/perl
+
+# Check the b+tree trimmed by a large count with the model of its elements.
+# The trimmed elements are freed by the collection delete thread,
+# but they must not be seen right after the trim.
+
+use strict;
+use Test::More tests => 38;
+use FindBin qw($Bin);
+use lib "$Bin/lib";
+use MemcachedTest;
+
+my $engine = shift;
+my $server = get_memcached($engine, "-m 512");
+my $sock = $server->sock;
+
+srand(38);
+
+my $batch_size = 100;
+
+sub stat_bytes {
+    my $bytes = 0;
+    print $sock "stats\r\n";
+    while ((my $line = scalar <$sock>) !~ /^END/) {
+        $bytes = $1 if ($line =~ /^STAT bytes (\d+)/);
+    }
+    return $bytes;
+}
+
+sub load_tree {
+    my ($key, $bkeys, $attrs) = @_;
+    my @bkeys = @$bkeys;
+    for (my $i = 0; $i < scalar(@bkeys); $i += $batch_size) {
+        my @batch = @bkeys[$i .. ($i+$batch_size > $#bkeys ? $#bkeys : $i+$batch_size-1)];
+        my $block = join("", map { sprintf("%d 7\r\nd%06d\r\n", $_, $_) } @batch);
+        my $create = ($i == 0) ? " create 0 0 $attrs" : "";
+        print $sock "bop minsert $key " . scalar(@batch) . " " . length($block) . "$create\r\n$block\r\n";
+        scalar <$sock>;
+    }
+}
+
+# the bkeys found by bop get
+sub get_bkeys {
+    my ($key, $range, $count) = @_;
+    print $sock "bop get $key $range" . (defined($count) ? " $count" : "") . "\r\n";
+    my $line = scalar <$sock>;
+    return $line if ($line !~ /^VALUE \d+ (\d+)/);
+    my @bkeys = ();
+    while (($line = scalar <$sock>) !~ /^(END|TRIMMED)\r\n/) {
+        push(@bkeys, (split(/ /, $line))[0]);
+    }
+    $line =~ s/\r\n$//;
+    return join(",", @bkeys) . " $line";
+}
+
+sub expected_bkeys {
+    my ($model, $from, $to, $trimmed) = @_;
+    my @bkeys = grep { $_ >= ($from < $to ? $from : $to) && $_ <= ($from < $to ? $to : $from) } @$model;
+    @bkeys = reverse(@bkeys) if ($from > $to);
+    return (scalar(@bkeys) > 0 ? join(",", @bkeys) . " " . ($trimmed ? "TRIMMED" : "END")
+                               : ($trimmed ? "TRIMMED\r\n" : "NOT_FOUND_ELEMENT\r\n"));
+}
+
+# trim by lowering maxcount
+my @model = map { $_ * 10 } (0 .. 19999);
+load_tree("mtree", \@model, -1);
+mem_cmd_is($sock, "bop count mtree 0..1000000", "", "COUNT=20000");
+mem_cmd_is($sock, "setattr mtree maxcount=1000", "", "OK");
+@model = @model[19000 .. 19999];
+mem_cmd_is($sock, "bop count mtree 0..1000000", "", "COUNT=1000");
+mem_cmd_is($sock, "getattr mtree count trimmed", "", "ATTR count=1000\nATTR trimmed=1\nEND");
+is(get_bkeys("mtree", "0..1000000"), expected_bkeys(\@model, 0, 1000000, 1), "get after smallest trim");
+is(get_bkeys("mtree", "1000000..0"), expected_bkeys(\@model, 1000000, 0, 1), "reverse get after smallest trim");
+is(get_bkeys("mtree", "189000..190050"), expected_bkeys(\@model, 189000, 190050, 1), "get across the trimmed edge");
+is(get_bkeys("mtree", "0..100000"), "OUT_OF_RANGE\r\n", "get in the trimmed space");
+
+mem_cmd_is($sock, "setattr mtree maxcount=300 overflowaction=largest_trim", "", "OK");
+@model = @model[0 .. 299];
+mem_cmd_is($sock, "bop count mtree 0..1000000", "", "COUNT=300");
+is(get_bkeys("mtree", "1000000..0"), expected_bkeys(\@model, 1000000, 0, 1), "get after largest trim");
+is(get_bkeys("mtree", "0..1000000", 10), expected_bkeys([@model[0 .. 9]], 0, 1000000, 0), "get with count after largest trim");
+
+# the b+tree works after the trim
+mem_cmd_is($sock, "setattr mtree maxcount=-1", "", "OK");
+my @more = map { 190000 + $_ * 5 + 1 } (0 .. 999);
+load_tree("mtree", \@more, -1);
+@model = sort { $a <=> $b } (@model, @more);
+mem_cmd_is($sock, "bop delete mtree 191001..192001", "", "DELETED");
+@model = grep { $_ < 191001 || $_ > 192001 } @model;
+mem_cmd_is($sock, "bop count mtree 0..1000000", "", "COUNT=" . scalar(@model));
+is(get_bkeys("mtree", "0..1000000"), expected_bkeys(\@model, 0, 1000000, 1), "get after insert and delete");
+
+# trim by maxbkeyrange overflow
+@model = map { $_ * 2 } (0 .. 9999);
+load_tree("rtree", \@model, -1);
+mem_cmd_is($sock, "setattr rtree maxbkeyrange=20000", "", "OK");
+mem_cmd_is($sock, "bop insert rtree 30000 7", "d030000", "STORED");
+@model = grep { $_ >= 10000 } (@model, 30000);
+mem_cmd_is($sock, "bop count rtree 0..100000", "", "COUNT=" . scalar(@model));
+is(get_bkeys("rtree", "0..100000"), expected_bkeys(\@model, 0, 100000, 0), "get after range trim");
+mem_cmd_is($sock, "setattr rtree overflowaction=largest_trim", "", "OK");
+mem_cmd_is($sock, "bop insert rtree 9000 7", "d009000", "STORED");
+@model = grep { $_ <= 29000 } (9000, @model);
+mem_cmd_is($sock, "bop count rtree 0..100000", "", "COUNT=" . scalar(@model));
+is(get_bkeys("rtree", "100000..0"), expected_bkeys(\@model, 100000, 0, 0), "get after largest range trim");
+
+# random trims of b+trees with various depths
+for (my $t = 0; $t < 5; $t++) {
+    my $count = 200 + int(rand(30000));
+    my %bkeys = ();
+    $bkeys{int(rand(1000000))} = 1 while (scalar(keys %bkeys) < $count);
+    my @rmodel = sort { $a <=> $b } keys %bkeys;
+    my @shuffled = @rmodel;
+    for (my $i = $#shuffled; $i > 0; $i--) {
+        my $j = int(rand($i+1));
+        @shuffled[$i, $j] = @shuffled[$j, $i];
+    }
+    load_tree("ttree$t", \@shuffled, -1);
+    my $maxcount = 1 + int(rand($count - 1));
+    my $smallest = ($t % 2 == 0);
+    my $ovflact = $smallest ? "smallest_silent_trim" : "largest_silent_trim";
+    print $sock "setattr ttree$t maxcount=$maxcount overflowaction=$ovflact\r\n";
+    scalar <$sock>;
+    @rmodel = $smallest ? @rmodel[$count-$maxcount .. $count-1] : @rmodel[0 .. $maxcount-1];
+    is(get_bkeys("ttree$t", "0..1000000"), expected_bkeys(\@rmodel, 0, 1000000, 0),
+       "random trim of $count elements to $maxcount");
+}
+
+# the trimmed elements are freed in the background
+my $bytes = stat_bytes();
+my @big = map { $_ * 3 } (0 .. 29999);
+load_tree("btree", \@big, -1);
+my $loaded = stat_bytes() - $bytes;
+mem_cmd_is($sock, "setattr btree maxcount=100", "", "OK");
+my $wait = 0;
+while (stat_bytes() - $bytes > $loaded / 10 && $wait++ < 100) {
+    select(undef, undef, undef, 0.1);
+}
+ok(stat_bytes() - $bytes <= $loaded / 10, "trimmed space is freed");
+mem_cmd_is($sock, "bop count btree 0..1000000", "", "COUNT=100");
+
+# delete the b+tree while its trimmed elements are freed
+load_tree("dtree", \@big, -1);
+mem_cmd_is($sock, "setattr dtree maxcount=10", "", "OK");
+mem_cmd_is($sock, "delete dtree", "", "DELETED");
+load_tree("dtree", [0 .. 99], -1);
+mem_cmd_is($sock, "bop count dtree 0..1000", "", "COUNT=100");
+
+# failures
+mem_cmd_is($sock, "setattr dtree maxcount=10 overflowaction=error", "", "ATTR_ERROR bad value");
+mem_cmd_is($sock, "lop create ltree 0 0 -1", "", "CREATED");
+for (my $i = 0; $i < 10; $i++) {
+    print $sock "lop insert ltree -1 6\r\ndatum$i\r\n";
+    scalar <$sock>;
+}
+mem_cmd_is($sock, "setattr ltree maxcount=5", "", "ATTR_ERROR bad value");
+
+# after test
+release_memcached($engine, $server);
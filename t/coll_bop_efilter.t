@@ -0,0 +1,135 @@
+#!/usr/bin/perl
+
+# Check the eflag filter results against the expected ones
+# for the eflag lengths evaluated as integers(1~8 bytes) and others.
+
+use strict;
+use Test::More tests => 136;
+use FindBin qw($Bin);
+use lib "$Bin/lib";
+use MemcachedTest;
+
+my $engine = shift;
+my $server = get_memcached($engine);
+my $sock = $server->sock;
+
+my $elem_count = 200;
+my %eflags; # key => [eflag binary strings]
+
+srand(31);
+
+sub hex_str {
+    my ($bin) = @_;
+    return "0x" . uc(unpack("H*", $bin));
+}
+
+sub rand_bin {
+    my ($length) = @_;
+    # small byte values make equal values and IN-list hits frequent.
+    return join("", map { chr(int(rand(4)) * 0x55) } (1 .. $length));
+}
+
+sub prepare_btree {
+    my ($key, $eflag_leng) = @_;
+    mem_cmd_is($sock, "bop create $key 0 0 0", "", "CREATED");
+    my @list = ();
+    for (my $i = 0; $i < $elem_count; $i++) {
+        my $eflag;
+        if ($i % 20 == 0) {
+            $eflag = "";                                   # no eflag
+        } elsif ($i % 20 == 1) {
+            $eflag = rand_bin(1);                          # short eflag
+        } else {
+            $eflag = rand_bin($eflag_leng);
+        }
+        my $estr = ($eflag eq "") ? "" : " " . hex_str($eflag);
+        print $sock "bop insert $key $i$estr 5\r\ndatum\r\n";
+        scalar <$sock>;
+        push(@list, $eflag);
+    }
+    $eflags{$key} = \@list;
+}
+
+sub compare {
+    my ($op, $v1, $v2) = @_;
+    return $v1 eq $v2 if ($op eq "EQ");
+    return $v1 ne $v2 if ($op eq "NE");
+    return $v1 lt $v2 if ($op eq "LT");
+    return $v1 le $v2 if ($op eq "LE");
+    return $v1 gt $v2 if ($op eq "GT");
+    return $v1 ge $v2;
+}
+
+sub expected_count {
+    my ($key, $fwhere, $bitwop, $bitwval, $compop, @compvals) = @_;
+    my $length = length($compvals[0]);
+    my $count = 0;
+    foreach my $eflag (@{$eflags{$key}}) {
+        if (length($eflag) < $fwhere + $length) {
+            $count++ if ($compop eq "NE");
+            next;
+        }
+        my $operand = substr($eflag, $fwhere, $length);
+        if ($bitwop eq "&") { $operand = $operand & $bitwval; }
+        if ($bitwop eq "|") { $operand = $operand | $bitwval; }
+        if ($bitwop eq "^") { $operand = $operand ^ $bitwval; }
+        if (@compvals > 1) {
+            my $found = grep { $_ eq $operand } @compvals;
+            $count++ if (($compop eq "EQ") ? $found : !$found);
+        } else {
+            $count++ if (compare($compop, $operand, $compvals[0]));
+        }
+    }
+    return $count;
+}
+
+sub efilter_is {
+    my ($key, $fwhere, $bitwop, $bitwval, $compop, @compvals) = @_;
+    my $efilter = "$fwhere";
+    $efilter .= " $bitwop " . hex_str($bitwval) if ($bitwop ne "");
+    $efilter .= " $compop " . join(",", map { hex_str($_) } @compvals);
+    my $count = expected_count($key, $fwhere, $bitwop, $bitwval, $compop, @compvals);
+    mem_cmd_is($sock, "bop count $key 0..$elem_count $efilter", "", "COUNT=$count");
+}
+
+# eflag lengths: integer kernel(1, 4, 8) and byte-wise compare(12)
+foreach my $eflag_leng (1, 4, 8, 12) {
+    my $key = "bkey$eflag_leng";
+    prepare_btree($key, $eflag_leng);
+
+    foreach my $fwhere ($eflag_leng > 1 ? (0, 1) : (0)) {
+        my $length = $eflag_leng - $fwhere;
+        foreach my $compop ("EQ", "NE", "LT", "LE", "GT", "GE") {
+            my $compval = substr($eflags{$key}->[$elem_count/2 + 2], $fwhere, $length);
+            efilter_is($key, $fwhere, "", "", $compop, $compval);
+        }
+        foreach my $bitwop ("&", "|", "^") {
+            my $bitwval = rand_bin($length);
+            my $compval = substr($eflags{$key}->[3], $fwhere, $length) & $bitwval;
+            efilter_is($key, $fwhere, $bitwop, $bitwval, "EQ", $compval);
+            efilter_is($key, $fwhere, $bitwop, $bitwval, "GT", $compval);
+        }
+        # IN-list: linear scan(3), sorted search(40)
+        foreach my $compvcnt (3, 40) {
+            my @compvals = map { rand_bin($length) } (1 .. $compvcnt);
+            efilter_is($key, $fwhere, "", "", "EQ", @compvals);
+            efilter_is($key, $fwhere, "", "", "NE", @compvals);
+            efilter_is($key, $fwhere, "&", rand_bin($length), "EQ", @compvals);
+        }
+    }
+}
+
+# partial eflag compared from the middle of eflag
+efilter_is("bkey8", 3, "", "", "EQ", substr($eflags{bkey8}->[7], 3, 2));
+efilter_is("bkey8", 6, "^", rand_bin(2), "LE", substr($eflags{bkey8}->[9], 6, 2));
+efilter_is("bkey12", 4, "", "", "GE", substr($eflags{bkey12}->[7], 4, 8));
+efilter_is("bkey12", 2, "", "", "EQ", map { substr($eflags{bkey12}->[$_], 2, 9) } (2 .. 19, 22 .. 32));
+
+# filtered delete
+my $count = expected_count("bkey8", 0, "", "", "EQ", map { substr($eflags{bkey8}->[$_], 0, 1) } (2 .. 4));
+my $in = join(",", map { hex_str(substr($eflags{bkey8}->[$_], 0, 1)) } (2 .. 4));
+mem_cmd_is($sock, "bop delete bkey8 0..$elem_count 0 EQ $in", "", ($count > 0 ? "DELETED" : "NOT_FOUND_ELEMENT"));
+mem_cmd_is($sock, "bop count bkey8 0..$elem_count 0 EQ $in", "", "COUNT=0");
+
+# after test
+release_memcached($engine, $server);
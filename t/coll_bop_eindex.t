@@ -0,0 +1,153 @@
+#!/usr/bin/perl
+
+# Check the results of the b+tree having the eflag index against the ones
+# of the same b+tree without the index while the elements are changed.
+
+use strict;
+use Test::More tests => 54;
+use FindBin qw($Bin);
+use lib "$Bin/lib";
+use MemcachedTest;
+
+my $engine = shift;
+my $server = get_memcached($engine);
+my $sock = $server->sock;
+
+my $elem_count = 2000;
+
+# response of the command
+sub response {
+    my ($cmd, $val) = @_;
+    if (defined($val)) {
+        print $sock "$cmd\r\n$val\r\n";
+    } else {
+        print $sock "$cmd\r\n";
+    }
+    my $line = scalar <$sock>;
+    my $resp = $line;
+    if ($line =~ /^VALUE /) {
+        do {
+            $line = scalar <$sock>;
+            $resp .= $line;
+        } while ($line !~ /^(END|TRIMMED|DELETED|DELETED_DROPPED)\r\n/);
+    }
+    return $resp;
+}
+
+# run the command on both b+trees and compare the responses
+sub same_response {
+    my ($cmd, $val) = @_;
+    my $indexed = response("bop $cmd->[0] itree $cmd->[1]", $val);
+    my $scanned = response("bop $cmd->[0] ntree $cmd->[1]", $val);
+    is($indexed, $scanned, "bop $cmd->[0] $cmd->[1]");
+}
+
+# eflag: <group(1 byte)><indexed value(1 byte)>[<tail(1 byte)>]
+mem_cmd_is($sock, "bop create itree 0 0 -1 eindex 1 1", "", "CREATED");
+mem_cmd_is($sock, "bop create ntree 0 0 -1", "", "CREATED");
+for (my $i = 0; $i < $elem_count; $i++) {
+    my $eflag;
+    if ($i % 97 == 0) {
+        $eflag = "";                  # no eflag
+    } elsif ($i % 89 == 0) {
+        $eflag = " 0x07";             # no indexed field
+    } elsif ($i % 3 == 0) {
+        $eflag = sprintf(" 0x%02X%02X", $i % 4, $i % 50);
+    } else {
+        $eflag = sprintf(" 0x%02X%02XFF", $i % 4, $i % 50);
+    }
+    my $value = "datum$i";
+    foreach my $key ("itree", "ntree") {
+        print $sock "bop insert $key $i$eflag " . length($value) . "\r\n$value\r\n";
+        scalar <$sock>;
+    }
+}
+mem_cmd_is($sock, "bop count itree 0..100000", "", "COUNT=$elem_count");
+
+my @queries = (
+    ["get", "0..100000 1 EQ 0x07"],
+    ["get", "100000..0 1 EQ 0x07"],
+    ["get", "0..100000 1 EQ 0x07 5"],
+    ["get", "0..100000 1 EQ 0x07 3 5"],
+    ["get", "100000..0 1 EQ 0x07 3 5"],
+    ["get", "0..100000 1 EQ 0x07 100 5"],
+    ["get", "500..1500 1 EQ 0x0B"],
+    ["get", "1500..500 1 EQ 0x0B 2 10"],
+    ["get", "0..100000 1 EQ 0x01,0x02,0x01"],
+    ["get", "100000..0 1 EQ 0x01,0x31 1 7"],
+    ["get", "0..100000 1 EQ 0x40"],
+    ["get", "0..100000 1 EQ 0x07 cursor"],
+    ["count", "0..100000 1 EQ 0x07"],
+    ["count", "1500..500 1 EQ 0x0B,0x0C"],
+    ["count", "0..100000 1 EQ 0x40"],
+);
+
+foreach my $query (@queries) {
+    same_response($query);
+}
+
+# upsert changing the indexed field
+foreach my $i (7, 57, 107, 1007) {
+    foreach my $key ("itree", "ntree") {
+        response("bop upsert $key $i 0x0140 5", "moved");
+    }
+}
+# update the eflag: in-place and with reallocation
+foreach my $i (157, 207) {
+    foreach my $key ("itree", "ntree") {
+        response("bop update $key $i 1 | 0x40 -1");
+        response("bop update $key " . ($i+50) . " 0x0040 -1");
+        response("bop update $key " . ($i+100) . " 0x40 -1");
+        response("bop update $key " . ($i+200) . " 0x00400000 -1");
+    }
+}
+# delete
+foreach my $key ("itree", "ntree") {
+    response("bop delete $key 300..400 1 EQ 0x07");
+    response("bop delete $key 1900..1999");
+    response("bop get $key 600..700 1 EQ 0x07 delete");
+    response("bop delete $key 1357");
+}
+foreach my $query (@queries, ["get", "0..100000 1 EQ 0x40"], ["count", "0..100000 1 EQ 0x00"]) {
+    same_response($query);
+}
+
+# overflow trim
+mem_cmd_is($sock, "bop create itrim 0 0 100 eindex 0 1", "", "CREATED");
+mem_cmd_is($sock, "bop create ntrim 0 0 100", "", "CREATED");
+for (my $i = 0; $i < 300; $i++) {
+    my $eflag = sprintf("0x%02X", $i % 10);
+    foreach my $key ("itrim", "ntrim") {
+        print $sock "bop insert $key $i $eflag 5\r\ndatum\r\n";
+        scalar <$sock>;
+    }
+}
+is(response("bop get itrim 0..1000 0 EQ 0x03"), response("bop get ntrim 0..1000 0 EQ 0x03"),
+   "get after trim");
+is(response("bop count itrim 0..1000 0 EQ 0x03"), "COUNT=10\r\n", "count after trim");
+is(response("bop get itrim 1000..0 0 EQ 0x03 2"), response("bop get ntrim 1000..0 0 EQ 0x03 2"),
+   "get after trim with count");
+
+# the other filters are not changed
+foreach my $query (["get", "0..100000 1 NE 0x07 10"], ["get", "0..100000 1 & 0x07 EQ 0x07 10"],
+                   ["get", "0..100000 0 EQ 0x0107"], ["count", "0..100000 1 GT 0x30"]) {
+    same_response($query);
+}
+
+# delete all the elements and insert again
+mem_cmd_is($sock, "bop delete itree 0..100000", "", "DELETED");
+mem_cmd_is($sock, "bop insert itree 1 0x0007 5", "datum", "STORED");
+mem_cmd_is($sock, "bop get itree 0..100000 1 EQ 0x07", "",
+           "VALUE 0 1\n1 0x0007 5 datum\nEND");
+mem_cmd_is($sock, "delete itree", "", "DELETED");
+
+# failures
+mem_cmd_is($sock, "bop create etree 0 0 0 eindex 30 2", "", "CLIENT_ERROR bad command line format");
+mem_cmd_is($sock, "bop create etree 0 0 0 eindex 0 0", "", "CLIENT_ERROR bad command line format");
+mem_cmd_is($sock, "bop create etree 0 0 0 eindex 0", "", "CLIENT_ERROR bad command line format");
+mem_cmd_is($sock, "bop create etree 0 0 0 error unreadable eindex 2 4 noreply", "", "");
+mem_cmd_is($sock, "bop insert etree 1 0x0102030405 5", "datum", "STORED");
+mem_cmd_is($sock, "bop get etree 1 3 EQ 0x04", "", "UNREADABLE");
+
+# after test
+release_memcached($engine, $server);
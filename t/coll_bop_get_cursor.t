@@ -0,0 +1,165 @@
+#!/usr/bin/perl
+
+# Check paging through b+tree elements with the bop get cursor.
+
+use strict;
+use Test::More tests => 38;
+use FindBin qw($Bin);
+use lib "$Bin/lib";
+use MemcachedTest;
+
+my $engine = shift;
+my $server = get_memcached($engine);
+my $sock = $server->sock;
+
+srand(34);
+
+# returns (cursor, [bkeys]) or the response line if failed
+sub bop_get_page {
+    my ($cmd) = @_;
+    print $sock "$cmd\r\n";
+    my $line = scalar <$sock>;
+    if ($line !~ /^VALUE \d+ (\d+) (\S+)\r\n/) {
+        $line =~ s/\r\n$//;
+        return $line;
+    }
+    my ($count, $cursor) = ($1, $2);
+    my @bkeys = ();
+    for (my $i = 0; $i < $count; $i++) {
+        my $elem = scalar <$sock>;
+        push(@bkeys, (split(/ /, $elem))[0]);
+    }
+    $line = scalar <$sock>;
+    return ($cursor, \@bkeys);
+}
+
+# page through the bkey range and return the found bkeys
+sub bop_get_all_pages {
+    my ($key, $range, $filter, $count) = @_;
+    my @found = ();
+    my $cursor;
+    my $pages = 0;
+    do {
+        my $cmd = "bop get $key $range$filter $count cursor";
+        $cmd .= " $cursor" if (defined($cursor));
+        my ($next, $bkeys) = bop_get_page($cmd);
+        return () if (!defined($bkeys));
+        push(@found, @$bkeys);
+        $cursor = $next;
+        $pages++;
+    } while ($cursor ne "0" && $pages < 1000);
+    return @found;
+}
+
+sub bin_comp {
+    my ($a, $b) = @_;
+    return pack("H*", substr($a, 2)) cmp pack("H*", substr($b, 2));
+}
+
+# uint64 bkeys
+my @uints = map { $_ * 3 } (0 .. 199);
+mem_cmd_is($sock, "bop create ubtree 0 0 0", "", "CREATED");
+foreach my $bkey (@uints) {
+    my $eflag = sprintf("0x%02X", $bkey % 4);
+    print $sock "bop insert ubtree $bkey $eflag 6\r\ndatum0\r\n";
+    scalar <$sock>;
+}
+is(join(",", bop_get_all_pages("ubtree", "0..1000", "", 7)),
+   join(",", @uints), "uint ascending pages");
+is(join(",", bop_get_all_pages("ubtree", "1000..0", "", 7)),
+   join(",", reverse(@uints)), "uint descending pages");
+is(join(",", bop_get_all_pages("ubtree", "100..500", "", 10)),
+   join(",", grep { $_ >= 100 && $_ <= 500 } @uints), "uint partial range pages");
+is(join(",", bop_get_all_pages("ubtree", "597..0", "", 1)),
+   join(",", reverse(@uints)), "uint descending pages of single element");
+is(join(",", bop_get_all_pages("ubtree", "0..1000", " 0 EQ 0x01", 9)),
+   join(",", grep { $_ % 4 == 1 } @uints), "uint pages with eflag filter");
+is(join(",", bop_get_all_pages("ubtree", "18446744073709551615..18446744073709551000", "", 5)),
+   "", "uint pages at the end of bkey space");
+
+# the page right after the last element
+my ($cursor, $bkeys) = bop_get_page("bop get ubtree 0..597 200 cursor");
+is($cursor, "0", "no cursor after the last element");
+($cursor, $bkeys) = bop_get_page("bop get ubtree 0..1000 5 cursor");
+is($cursor, "00000000000000000D", "uint cursor");
+is(join(",", @$bkeys), "0,3,6,9,12", "uint first page");
+
+# the cursor stays valid after the elements around it are deleted
+mem_cmd_is($sock, "bop delete ubtree 12..20", "", "DELETED");
+($cursor, $bkeys) = bop_get_page("bop get ubtree 0..1000 3 cursor $cursor");
+is(join(",", @$bkeys), "21,24,27", "page after deletion");
+is(bop_get_page("bop get ubtree 0..1000 1 2 cursor $cursor"),
+   "CLIENT_ERROR bad command line format", "offset with cursor");
+($cursor, $bkeys) = bop_get_page("bop get ubtree 0..1000 0 2 cursor $cursor");
+is(join(",", @$bkeys), "30,33", "page with zero offset");
+($cursor, $bkeys) = bop_get_page("bop get ubtree 0..1000 1 2 cursor");
+is(join(",", @$bkeys), "3,6", "first page with offset");
+($cursor, $bkeys) = bop_get_page("bop get ubtree 0..1000 2 cursor $cursor");
+is(join(",", @$bkeys), "9,21", "next page after offset");
+is(bop_get_page("bop get ubtree 0..1000 5 cursor 000000000000FFFFFF"),
+   "CLIENT_ERROR bad command line format", "cursor out of range");
+
+# binary bkeys including the edges of bkey space
+my %bins = ();
+$bins{"0x00"} = 1;
+$bins{"0xFF"} = 1;
+$bins{"0x" . ("FF" x 31)} = 1;
+$bins{"0x" . ("00" x 31)} = 1;
+$bins{"0x" . ("00" x 30) . "01"} = 1;
+$bins{"0x0000"} = 1;
+$bins{"0x01" . ("FF" x 30)} = 1;
+$bins{"0x02"} = 1;
+while (scalar(keys %bins) < 300) {
+    my $len = 1 + int(rand(3)) * int(rand(11));
+    $len = 31 if (rand(10) < 1);
+    my $bkey = "0x" . join("", map { sprintf("%02X", (0, 1, 0x7F, 0xFE, 0xFF)[int(rand(5))]) } (1 .. $len));
+    $bins{$bkey} = 1;
+}
+my @bins = sort { bin_comp($a, $b) } keys %bins;
+mem_cmd_is($sock, "bop create bbtree 0 0 0", "", "CREATED");
+foreach my $bkey (@bins) {
+    print $sock "bop insert bbtree $bkey 6\r\ndatum0\r\n";
+    scalar <$sock>;
+}
+mem_cmd_is($sock, "bop count bbtree 0x00..0x" . ("FF" x 31), "", "COUNT=300");
+
+my $bmin = "0x00";
+my $bmax = "0x" . ("FF" x 31);
+foreach my $count (1, 7, 50) {
+    is(join(",", bop_get_all_pages("bbtree", "$bmin..$bmax", "", $count)),
+       join(",", @bins), "binary ascending pages of $count");
+    is(join(",", bop_get_all_pages("bbtree", "$bmax..$bmin", "", $count)),
+       join(",", reverse(@bins)), "binary descending pages of $count");
+}
+my @part = grep { bin_comp($_, "0x01") >= 0 && bin_comp($_, "0xFE") <= 0 } @bins;
+is(join(",", bop_get_all_pages("bbtree", "0x01..0xFE", "", 11)),
+   join(",", @part), "binary partial range pages");
+is(join(",", bop_get_all_pages("bbtree", "0xFE..0x01", "", 11)),
+   join(",", reverse(@part)), "binary descending partial range pages");
+
+($cursor, $bkeys) = bop_get_page("bop get bbtree 0x00..0xFF 2 cursor");
+is($cursor, "03000000", "binary cursor");
+is(join(",", @$bkeys), "0x00,0x0000", "binary first page");
+
+# failures
+is(bop_get_page("bop get bbtree 0x00..0xFF 2 cursor 00000000000000000D"),
+   "CLIENT_ERROR bad command line format", "uint cursor on binary range");
+is(bop_get_page("bop get ubtree 0..1000 2 cursor 020000"),
+   "CLIENT_ERROR bad command line format", "binary cursor on uint range");
+is(bop_get_page("bop get ubtree 0..1000 2 cursor 0x0D"),
+   "CLIENT_ERROR bad command line format", "bad cursor string");
+is(bop_get_page("bop get ubtree 0..1000 2 cursor 0000000000000000"),
+   "CLIENT_ERROR bad command line format", "short cursor");
+is(bop_get_page("bop get ubtree 6 2 cursor 000000000000000006"),
+   "CLIENT_ERROR bad command line format", "cursor on single bkey");
+is(bop_get_page("bop get ubtree 0..1000 2 delete cursor"),
+   "CLIENT_ERROR bad command line format", "cursor with delete");
+($cursor, $bkeys) = bop_get_page("bop get ubtree 6 cursor");
+is("$cursor:" . join(",", @$bkeys), "0:6", "single bkey with cursor");
+is(bop_get_page("bop get ubtree 1..2 5 cursor"), "NOT_FOUND_ELEMENT", "no element with cursor");
+
+# plain bop get is not changed
+mem_cmd_is($sock, "bop get ubtree 0..3", "", "VALUE 0 2\n0 0x00 6 datum0\n3 0x03 6 datum0\nEND");
+
+# after test
+release_memcached($engine, $server);
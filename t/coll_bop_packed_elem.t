@@ -0,0 +1,175 @@
+#!/usr/bin/perl
+
+# The small elements of uint64 bkey without eflag are packed into
+# the leaf nodes of b+tree. They must behave the same as other elements.
+
+use strict;
+use Test::More tests => 41;
+use FindBin qw($Bin);
+use lib "$Bin/lib";
+use MemcachedTest;
+
+my $engine = shift;
+my $server = get_memcached($engine);
+my $sock = $server->sock;
+
+my $cmd;
+my $val;
+my $rst;
+
+# values of 0 ~ 9 bytes: packed up to 7 bytes
+$cmd = "bop insert bkey1 0 0 create 11 0 0\r\n"; $val = ""; $rst = "CREATED_STORED";
+mem_cmd_is($sock, $cmd, $val, $rst, "bop insert of empty value");
+for (my $i = 1; $i <= 9; $i++) {
+    $cmd = "bop insert bkey1 $i $i"; $val = substr("abcdefghi", 0, $i); $rst = "STORED";
+    mem_cmd_is($sock, $cmd, $val, $rst);
+}
+$cmd = "bop insert bkey1 10 0x0A 2"; $val = "ef"; $rst = "STORED";
+mem_cmd_is($sock, $cmd, $val, $rst);
+$cmd = "bop get bkey1 0..10";
+$rst = "VALUE 11 11\n0 0 \n" . "1 1 a
+2 2 ab
+3 3 abc
+4 4 abcd
+5 5 abcde
+6 6 abcdef
+7 7 abcdefg
+8 8 abcdefgh
+9 9 abcdefghi
+10 0x0A 2 ef
+END";
+mem_cmd_is($sock, $cmd, "", $rst);
+
+# update and upsert between packed and unpacked elements
+$cmd = "bop update bkey1 2 10"; $val = "0123456789"; $rst = "UPDATED";
+mem_cmd_is($sock, $cmd, $val, $rst);
+$cmd = "bop update bkey1 8 1"; $val = "h"; $rst = "UPDATED";
+mem_cmd_is($sock, $cmd, $val, $rst);
+$cmd = "bop upsert bkey1 3 2"; $val = "xy"; $rst = "REPLACED";
+mem_cmd_is($sock, $cmd, $val, $rst);
+$cmd = "bop update bkey1 4 0x04 2"; $val = "ff"; $rst = "UPDATED";
+mem_cmd_is($sock, $cmd, $val, $rst);
+$cmd = "bop get bkey1 1..8";
+$rst = "VALUE 11 8
+1 1 a
+2 10 0123456789
+3 2 xy
+4 0x04 2 ff
+5 5 abcde
+6 6 abcdef
+7 7 abcdefg
+8 1 h
+END";
+mem_cmd_is($sock, $cmd, "", $rst);
+
+# incr and decr of packed elements
+$cmd = "bop insert bkey1 20 7"; $val = "9999998"; $rst = "STORED";
+mem_cmd_is($sock, $cmd, $val, $rst);
+$cmd = "bop incr bkey1 20 1"; $rst = "9999999";
+mem_cmd_is($sock, $cmd, "", $rst);
+$cmd = "bop incr bkey1 20 1"; $rst = "10000000";
+mem_cmd_is($sock, $cmd, "", $rst);
+$cmd = "bop decr bkey1 20 9999995"; $rst = "5";
+mem_cmd_is($sock, $cmd, "", $rst);
+$cmd = "bop get bkey1 20"; $rst = "VALUE 11 1\n20 1 5\nEND";
+mem_cmd_is($sock, $cmd, "", $rst);
+
+# count, position and get by position
+$cmd = "bop count bkey1 0..20"; $rst = "COUNT=12";
+mem_cmd_is($sock, $cmd, "", $rst);
+$cmd = "bop position bkey1 7 asc"; $rst = "POSITION=7";
+mem_cmd_is($sock, $cmd, "", $rst);
+$cmd = "bop gbp bkey1 asc 5..6";
+$rst = "VALUE 11 2
+5 5 abcde
+6 6 abcdef
+END";
+mem_cmd_is($sock, $cmd, "", $rst);
+$cmd = "bop pwg bkey1 5 asc 1";
+$rst = "VALUE 5 11 3 1
+4 0x04 2 ff
+5 5 abcde
+6 6 abcdef
+END";
+mem_cmd_is($sock, $cmd, "", $rst);
+
+# get with delete of packed elements
+$cmd = "bop get bkey1 5..7 delete";
+$rst = "VALUE 11 3
+5 5 abcde
+6 6 abcdef
+7 7 abcdefg
+DELETED";
+mem_cmd_is($sock, $cmd, "", $rst);
+$cmd = "bop delete bkey1 0..1"; $rst = "DELETED";
+mem_cmd_is($sock, $cmd, "", $rst);
+$cmd = "bop get bkey1 0..20";
+$rst = "VALUE 11 7
+2 10 0123456789
+3 2 xy
+4 0x04 2 ff
+8 1 h
+9 9 abcdefghi
+10 0x0A 2 ef
+20 1 5
+END";
+mem_cmd_is($sock, $cmd, "", $rst);
+
+# overflow trim of packed elements
+$cmd = "setattr bkey1 maxcount=7 overflowaction=smallest_trim"; $rst = "OK";
+mem_cmd_is($sock, $cmd, "", $rst);
+$cmd = "bop insert bkey1 30 2 getrim"; $val = "zz";
+$rst = "VALUE 11 1
+2 10 0123456789
+TRIMMED";
+mem_cmd_is($sock, $cmd, $val, $rst);
+$cmd = "bop insert bkey1 31 2 getrim"; $val = "zz";
+$rst = "VALUE 11 1
+3 2 xy
+TRIMMED";
+mem_cmd_is($sock, $cmd, $val, $rst);
+
+# smget of packed elements
+$cmd = "bop insert bkey2 8 2 create 12 0 0"; $val = "hh"; $rst = "CREATED_STORED";
+mem_cmd_is($sock, $cmd, $val, $rst);
+$cmd = "bop insert bkey2 21 2"; $val = "uu"; $rst = "STORED";
+mem_cmd_is($sock, $cmd, $val, $rst);
+$cmd = "bop smget 11 2 4..100 4 duplicate"; $val = "bkey1 bkey2";
+$rst = "ELEMENTS 4
+bkey1 11 4 0x04 2 ff
+bkey1 11 8 1 h
+bkey2 12 8 2 hh
+bkey1 11 9 9 abcdefghi
+MISSED_KEYS 0
+TRIMMED_KEYS 0
+DUPLICATED";
+mem_cmd_is($sock, $cmd, $val, $rst);
+$cmd = "bop smget 11 2 100..0 3 duplicate"; $val = "bkey1 bkey2";
+$rst = "ELEMENTS 3
+bkey1 11 31 2 zz
+bkey1 11 30 2 zz
+bkey2 12 21 2 uu
+MISSED_KEYS 0
+TRIMMED_KEYS 0
+END";
+mem_cmd_is($sock, $cmd, $val, $rst);
+
+# smget of the trimmed b+tree ending with a packed element
+$cmd = "bop create bkey3 13 0 2 largest_trim"; $rst = "CREATED";
+mem_cmd_is($sock, $cmd, "", $rst);
+for (my $i = 3; $i >= 1; $i--) {
+    $cmd = "bop insert bkey3 $i 2"; $val = "c$i"; $rst = "STORED";
+    mem_cmd_is($sock, $cmd, $val, $rst);
+}
+$cmd = "bop smget 5 1 0..100 10 duplicate"; $val = "bkey3";
+$rst = "ELEMENTS 2
+bkey3 13 1 2 c1
+bkey3 13 2 2 c2
+MISSED_KEYS 0
+TRIMMED_KEYS 1
+bkey3 2
+END";
+mem_cmd_is($sock, $cmd, $val, $rst);
+
+# after test
+release_memcached($engine, $server);
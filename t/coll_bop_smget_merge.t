@@ -0,0 +1,84 @@
+#!/usr/bin/perl
+
+# Check the smget results over hundreds of b+trees against the expected ones.
+# The bkeys are overlapped among the b+trees, so the sort order of
+# the same bkeys and the unique bkey handling are checked together.
+
+use strict;
+use Test::More tests => 14;
+use FindBin qw($Bin);
+use lib "$Bin/lib";
+use MemcachedTest;
+
+my $engine = shift;
+my $server = get_memcached($engine);
+my $sock = $server->sock;
+
+my $key_count = 300;
+my $elem_count = 20;
+my $bkey_max = 999;
+my @keys = map { sprintf("KEY_%04d", $_) } (0 .. $key_count-1);
+my @elems = (); # [bkey, key]
+
+srand(33);
+
+foreach my $key (@keys) {
+    my %bkeys = ();
+    $bkeys{int(rand($bkey_max+1))} = 1 while (scalar(keys %bkeys) < $elem_count);
+    print $sock "bop create $key 7 0 0\r\n";
+    scalar <$sock>;
+    foreach my $bkey (keys %bkeys) {
+        print $sock "bop insert $key $bkey 6\r\ndatum0\r\n";
+        scalar <$sock>;
+        push(@elems, [$bkey, $key]);
+    }
+}
+
+sub expected_result {
+    my ($from, $to, $count, $mode) = @_;
+    my $ascending = ($from <= $to);
+    my ($min, $max) = $ascending ? ($from, $to) : ($to, $from);
+    my @sorted = sort { $a->[0] <=> $b->[0] or $a->[1] cmp $b->[1] }
+                 grep { $_->[0] >= $min && $_->[0] <= $max } @elems;
+    @sorted = reverse(@sorted) if (!$ascending);
+
+    my @result = ();
+    my $duplicated = 0;
+    my $prev;
+    foreach my $elem (@sorted) {
+        if (defined($prev) && $prev == $elem->[0]) {
+            next if ($mode eq "unique");
+            $duplicated = 1;
+        }
+        $prev = $elem->[0];
+        push(@result, $elem);
+        last if (@result >= $count);
+    }
+    my $rst = "ELEMENTS " . scalar(@result) . "\n";
+    $rst .= join("", map { "$_->[1] 7 $_->[0] 6 datum0\n" } @result);
+    $rst .= "MISSED_KEYS 0\nTRIMMED_KEYS 0\n";
+    $rst .= ($duplicated ? "DUPLICATED" : "END");
+    return $rst;
+}
+
+my $key_str = join(" ", @keys);
+my $key_len = length($key_str);
+foreach my $range ([0, 999, 1000], [999, 0, 1000], [100, 400, 500],
+                   [900, 200, 300], [500, 520, 2000], [0, 999, 7]) {
+    my ($from, $to, $count) = @$range;
+    foreach my $mode ("duplicate", "unique") {
+        mem_cmd_is($sock, "bop smget $key_len $key_count $from..$to $count $mode",
+                   $key_str, expected_result($from, $to, $count, $mode));
+    }
+}
+
+# the same key is given twice
+$key_str = join(" ", @keys, $keys[$key_count/2]);
+$key_len = length($key_str);
+foreach my $mode ("duplicate", "unique") {
+    mem_cmd_is($sock, "bop smget $key_len " . ($key_count+1) . " 0..999 1000 $mode",
+               $key_str, "CLIENT_ERROR bad data chunk");
+}
+
+# after test
+release_memcached($engine, $server);
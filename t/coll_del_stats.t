@@ -0,0 +1,103 @@
+#!/usr/bin/perl
+
+# Check the collections deleted by the collection delete thread:
+# the deleted elements and the reclaimed space are reported by stats coll_del.
+
+use strict;
+use Test::More tests => 27;
+use FindBin qw($Bin);
+use lib "$Bin/lib";
+use MemcachedTest;
+
+my $engine = shift;
+my $server = get_memcached($engine, "-m 512");
+my $sock = $server->sock;
+
+my $batch_size = 100;
+
+sub stats_of {
+    my ($cmd) = @_;
+    my %stats = ();
+    print $sock "$cmd\r\n";
+    while ((my $line = scalar <$sock>) !~ /^END/) {
+        $stats{$1} = $2 if ($line =~ /^STAT (\S+) (.*)\r\n/);
+    }
+    return \%stats;
+}
+
+sub stat_bytes {
+    return stats_of("stats")->{"bytes"};
+}
+
+# load the elements with pipelined commands reading one line per command
+sub load {
+    my ($create, @cmds) = @_;
+    print $sock "$create\r\n";
+    scalar <$sock>;
+    for (my $i = 0; $i < scalar(@cmds); $i += $batch_size) {
+        my $last = ($i + $batch_size > $#cmds) ? $#cmds : $i + $batch_size - 1;
+        print $sock join("", @cmds[$i .. $last]);
+        scalar <$sock> for ($i .. $last);
+    }
+}
+
+sub wait_deleted {
+    my ($colls) = @_;
+    my $stats;
+    for (my $wait = 0; $wait < 100; $wait++) {
+        $stats = stats_of("stats coll_del");
+        last if ($stats->{"coll_del:deleted_colls"} >= $colls &&
+                 $stats->{"coll_del:queued_colls"} == 0 &&
+                 $stats->{"coll_del:deleting_colls"} == 0);
+        select(undef, undef, undef, 0.1);
+    }
+    return $stats;
+}
+
+my $stats = stats_of("stats coll_del");
+is($stats->{"coll_del:deleting_colls"}, 0, "no collection being deleted");
+is($stats->{"coll_del:queued_colls"}, 0, "empty delete queue");
+is($stats->{"coll_del:deleted_elems"}, 0, "no deleted element");
+
+# the collections of each type
+my $bytes = stat_bytes();
+my $elems = 0;
+for (my $t = 0; $t < 4; $t++) {
+    load("bop create btree$t 0 0 -1",
+         map { "bop insert btree$t $_ 7\r\nd" . sprintf("%06d", $_) . "\r\n" } (1 .. 20000));
+    $elems += 20000;
+}
+load("lop create ltree 0 0 -1", map { "lop insert ltree -1 7\r\nd" . sprintf("%06d", $_) . "\r\n" } (1 .. 20000));
+load("sop create stree 0 0 -1", map { "sop insert stree 7\r\nd" . sprintf("%06d", $_) . "\r\n" } (1 .. 20000));
+load("mop create mtree 0 0 -1", map { "mop insert mtree f$_ 7\r\nd" . sprintf("%06d", $_) . "\r\n" } (1 .. 20000));
+$elems += 60000;
+my $loaded = stat_bytes() - $bytes;
+ok($loaded > 0, "collections loaded");
+
+foreach my $key ("btree0", "btree1", "btree2", "btree3", "ltree", "stree", "mtree") {
+    mem_cmd_is($sock, "delete $key", "", "DELETED");
+}
+$stats = wait_deleted(7);
+is($stats->{"coll_del:deleted_colls"}, 7, "deleted collections");
+is($stats->{"coll_del:deleted_elems"}, $elems, "deleted elements");
+is($stats->{"coll_del:reclaimed_bytes"}, $loaded, "reclaimed bytes");
+is(stat_bytes(), $bytes, "space is freed");
+
+# the collections deleted by flush_all
+$bytes = stat_bytes();
+for (my $t = 0; $t < 8; $t++) {
+    load("bop create ftree$t 0 0 -1",
+         map { "bop insert ftree$t $_ 7\r\nd" . sprintf("%06d", $_) . "\r\n" } (1 .. 5000));
+}
+mem_cmd_is($sock, "flush_all", "", "OK");
+# the collections older than the flush are unlinked when accessed
+for (my $t = 0; $t < 8; $t++) {
+    mem_cmd_is($sock, "bop count ftree$t 0..10000", "", "NOT_FOUND");
+}
+$stats = wait_deleted(15);
+is($stats->{"coll_del:deleted_colls"}, 15, "deleted collections after flush_all");
+is($stats->{"coll_del:deleted_elems"}, $elems + 40000, "deleted elements after flush_all");
+is(stat_bytes(), 0, "space is freed after flush_all");
+
+# after test
+release_memcached($engine, $server);
@@ -0,0 +1,154 @@
+#!/usr/bin/perl
+
+use strict;
+use Test::More tests => 49;
+use FindBin qw($Bin);
+use lib "$Bin/lib";
+use MemcachedTest;
+
+my $engine = shift;
+my $server = get_memcached($engine);
+my $sock = $server->sock;
+
+my $cmd;
+my $val;
+my $rst;
+
+# make the data block of minsert from (header, data) pairs.
+sub minsert_block {
+    my @pairs = @_;
+    my $block = "";
+    while (@pairs) {
+        my $head = shift @pairs;
+        my $data = shift @pairs;
+        $block .= "$head\r\n$data\r\n";
+    }
+    return $block;
+}
+
+sub lop_minsert {
+    my ($key, $index, $opts, @datas) = @_;
+    $val = minsert_block(map { (length($_), $_) } @datas);
+    $cmd = "lop minsert $key $index " . scalar(@datas) . " " . length($val) . $opts;
+    return ($cmd, $val);
+}
+
+sub sop_minsert {
+    my ($key, $opts, @datas) = @_;
+    $val = minsert_block(map { (length($_), $_) } @datas);
+    $cmd = "sop minsert $key " . scalar(@datas) . " " . length($val) . $opts;
+    return ($cmd, $val);
+}
+
+# elements: [bkey, eflag, data]
+sub bop_minsert {
+    my ($key, $opts, @elems) = @_;
+    $val = minsert_block(map { (join(" ", grep { $_ ne "" } ($_->[0], $_->[1], length($_->[2]))), $_->[2]) } @elems);
+    $cmd = "bop minsert $key " . scalar(@elems) . " " . length($val) . $opts;
+    return ($cmd, $val);
+}
+
+# lop minsert
+mem_cmd_is($sock, lop_minsert("lkey", 0, "", "datum0", "datum1"), "NOT_FOUND");
+mem_cmd_is($sock, lop_minsert("lkey", 0, " create 11 0 0", "datum0", "datum1", "datum2"),
+           "CREATED_STORED 3");
+mem_cmd_is($sock, lop_minsert("lkey", -1, "", "datum5", "datum6"), "STORED 2");
+mem_cmd_is($sock, lop_minsert("lkey", 3, "", "datum3", "datum4"), "STORED 2");
+mem_cmd_is($sock, "lop get lkey 0..-1", "",
+           "VALUE 11 7\n6 datum0\n6 datum1\n6 datum2\n6 datum3\n6 datum4\n6 datum5\n6 datum6\nEND");
+mem_cmd_is($sock, lop_minsert("lkey", 100, "", "datumx"), "OUT_OF_RANGE");
+
+# sop minsert
+mem_cmd_is($sock, sop_minsert("skey", " create 11 0 0", "datum1", "datum2", "datum3"),
+           "CREATED_STORED 3");
+mem_cmd_is($sock, sop_minsert("skey", "", "datum3", "datum4"), "STORED 1");
+mem_cmd_is($sock, sop_minsert("skey", "", "datum1", "datum2"), "ELEMENT_EXISTS");
+sop_get_is($sock, "skey 0", 11, 4, "datum1,datum2,datum3,datum4");
+
+# bop minsert: the elements are given out of order
+mem_cmd_is($sock, bop_minsert("bkey", " create 11 0 0",
+                              [5, "", "datum5"], [1, "0x01", "datum1"], [3, "", "datum3"],
+                              [2, "", "datum2"], [4, "0x04", "datum4"]),
+           "CREATED_STORED 5");
+mem_cmd_is($sock, "bop get bkey 0..10", "",
+           "VALUE 11 5\n1 0x01 6 datum1\n2 6 datum2\n3 6 datum3\n4 0x04 6 datum4\n5 6 datum5\nEND");
+mem_cmd_is($sock, bop_minsert("bkey", "", [0, "", "datum0"], [3, "", "datum3"], [6, "", "datum6"]),
+           "STORED 2");
+mem_cmd_is($sock, "bop count bkey 0..10", "", "COUNT=7");
+mem_cmd_is($sock, bop_minsert("bkey", "", [1, "", "datum1"], [2, "", "datum2"]), "ELEMENT_EXISTS");
+mem_cmd_is($sock, bop_minsert("bkey", "", ["0x01", "", "datum1"]), "BKEY_MISMATCH");
+mem_cmd_is($sock, bop_minsert("nokey", "", [1, "", "datum1"]), "NOT_FOUND");
+
+# bop minsert: many elements across leaf nodes
+my @elems = ();
+for (my $i = 1000; $i >= 1; $i--) {
+    push(@elems, [$i * 2, "", "datum" . ($i * 2)]);
+}
+mem_cmd_is($sock, bop_minsert("bkey2", " create 11 0 0", @elems), "CREATED_STORED 1000");
+@elems = ();
+for (my $i = 0; $i < 1000; $i++) {
+    push(@elems, [$i * 2 + 1, "", "datum" . ($i * 2 + 1)]);
+}
+mem_cmd_is($sock, bop_minsert("bkey2", "", @elems), "STORED 1000");
+mem_cmd_is($sock, "bop count bkey2 0..10000", "", "COUNT=2000");
+mem_cmd_is($sock, "bop get bkey2 998..1002", "",
+           "VALUE 11 5\n998 8 datum998\n999 8 datum999\n1000 9 datum1000\n1001 9 datum1001\n1002 9 datum1002\nEND");
+mem_cmd_is($sock, "bop position bkey2 1500 asc", "", "POSITION=1499");
+
+# bop minsert: sorted elements appended after the last element
+mem_cmd_is($sock, "bop create bkey4 11 0 -1", "", "CREATED");
+for (my $b = 0; $b < 3; $b++) {
+    @elems = ();
+    for (my $i = $b * 1000; $i < ($b + 1) * 1000; $i++) {
+        push(@elems, [$i * 3, sprintf("0x%02X", $i % 7), "datum" . ($i * 3)]);
+    }
+    mem_cmd_is($sock, bop_minsert("bkey4", "", @elems), "STORED 1000");
+}
+mem_cmd_is($sock, bop_minsert("bkey4", "", [1, "", "datum1"], [8998, "", "datum8998"],
+                              [9000, "", "datum9000"], [9001, "", "datum9001"]),
+           "STORED 4");
+mem_cmd_is($sock, "bop count bkey4 0..10000", "", "COUNT=3004");
+mem_cmd_is($sock, "bop count bkey4 0..10000 0 EQ 0x03", "", "COUNT=429");
+mem_cmd_is($sock, "bop get bkey4 5994..6003", "",
+           "VALUE 11 4\n5994 0x03 9 datum5994\n5997 0x04 9 datum5997\n6000 0x05 9 datum6000\n6003 0x06 9 datum6003\nEND");
+mem_cmd_is($sock, "bop get bkey4 10000..8997", "",
+           "VALUE 11 4\n9001 9 datum9001\n9000 9 datum9000\n8998 9 datum8998\n8997 0x03 9 datum8997\nEND");
+mem_cmd_is($sock, "bop position bkey4 6000 asc", "", "POSITION=2001");
+mem_cmd_is($sock, "bop gbp bkey4 asc 3003", "", "VALUE 11 1\n9001 9 datum9001\nEND");
+
+# bop minsert: appending stops at maxcount and the rest are trimmed
+mem_cmd_is($sock, "bop create bkey5 11 0 100", "", "CREATED");
+@elems = ();
+for (my $i = 0; $i < 150; $i++) {
+    push(@elems, ["0x" . sprintf("%04X", $i), "", "datum$i"]);
+}
+mem_cmd_is($sock, bop_minsert("bkey5", "", @elems), "STORED 150");
+mem_cmd_is($sock, "bop count bkey5 0x00..0xFFFF", "", "COUNT=100");
+mem_cmd_is($sock, "bop get bkey5 0x0031..0x0033", "",
+           "VALUE 11 2\n0x0032 7 datum50\n0x0033 7 datum51\nTRIMMED");
+
+# maxcount overflow with trimming
+mem_cmd_is($sock, "bop create bkey3 11 0 3", "", "CREATED");
+mem_cmd_is($sock, bop_minsert("bkey3", "", [1, "", "datum1"], [2, "", "datum2"], [3, "", "datum3"],
+                              [4, "", "datum4"], [5, "", "datum5"]),
+           "STORED 5");
+mem_cmd_is($sock, "bop get bkey3 0..10", "",
+           "VALUE 11 3\n3 6 datum3\n4 6 datum4\n5 6 datum5\nTRIMMED");
+
+# type mismatch
+mem_cmd_is($sock, "set kvkey 0 0 6", "datumx", "STORED");
+mem_cmd_is($sock, sop_minsert("kvkey", "", "datum1"), "TYPE_MISMATCH");
+
+# noreply
+mem_cmd_is($sock, sop_minsert("skey", " noreply", "datum5", "datum6"), "");
+mem_cmd_is($sock, "getattr skey count", "", "ATTR count=6\nEND");
+
+# bad command line and bad data chunk
+mem_cmd_is($sock, "sop minsert skey 0 11", "", "CLIENT_ERROR bad command line format");
+mem_cmd_is($sock, "sop minsert skey 2 11", "6\r\ndatum7\r\n", "CLIENT_ERROR bad data chunk");
+mem_cmd_is($sock, "sop minsert skey 1 11", "7\r\ndatum7\r\n", "CLIENT_ERROR bad data chunk");
+mem_cmd_is($sock, "bop minsert bkey 1 11", "6\r\ndatum7\r\n", "CLIENT_ERROR bad data chunk");
+mem_cmd_is($sock, "getattr skey count", "", "ATTR count=6\nEND");
+
+# after test
+release_memcached($engine, $server);
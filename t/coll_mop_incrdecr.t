@@ -0,0 +1,149 @@
+#!/usr/bin/perl
+
+use strict;
+use Test::More tests => 35;
+use FindBin qw($Bin);
+use lib "$Bin/lib";
+use MemcachedTest;
+
+=head
+get mkey1
+
+mop insert mkey1 f1 1 create 11 0 0
+1
+mop insert mkey1 f2 1
+2
+mop insert mkey1 f3 1
+3
+mop insert mkey1 f4 1
+a
+
+mop incr mkey1 f1 1
+mop get mkey1 2 1
+f1
+mop incr mkey1 f2 99
+mop decr mkey1 f2 90
+mop decr mkey1 f3 10
+mop incr mkey1 f4 10
+mop incr mkey1 f5 10
+mop incr mkey1 f5 10 100
+mop decr mkey1 f6 10 5
+
+delete mkey1
+=cut
+
+my $engine = shift;
+my $server = get_memcached($engine);
+my $sock = $server->sock;
+
+my $cmd;
+my $val;
+my $rst;
+
+# Initialize
+$cmd = "get mkey1"; $rst = "END";
+mem_cmd_is($sock, $cmd, "", $rst);
+
+# Prepare Keys
+$cmd = "mop insert mkey1 f1 1 create 11 0 0"; $val = "1"; $rst = "CREATED_STORED";
+mem_cmd_is($sock, $cmd, $val, $rst);
+$cmd = "mop insert mkey1 f2 1"; $val = "2"; $rst = "STORED";
+mem_cmd_is($sock, $cmd, $val, $rst);
+$cmd = "mop insert mkey1 f3 1"; $val = "3"; $rst = "STORED";
+mem_cmd_is($sock, $cmd, $val, $rst);
+$cmd = "mop insert mkey1 f4 1"; $val = "a"; $rst = "STORED";
+mem_cmd_is($sock, $cmd, $val, $rst);
+
+# Success Cases
+$cmd = "mop incr mkey1 f1 1"; $rst = "2";
+mem_cmd_is($sock, $cmd, "", $rst);
+$cmd = "mop get mkey1 2 1"; $val = "f1";
+$rst = "VALUE 11 1
+f1 1 2
+END";
+mem_cmd_is($sock, $cmd, $val, $rst);
+# length grows: the element is re-allocated
+$cmd = "mop incr mkey1 f2 99"; $rst = "101";
+mem_cmd_is($sock, $cmd, "", $rst);
+$cmd = "mop get mkey1 2 1"; $val = "f2";
+$rst = "VALUE 11 1
+f2 3 101
+END";
+mem_cmd_is($sock, $cmd, $val, $rst);
+# length shrinks
+$cmd = "mop decr mkey1 f2 95"; $rst = "6";
+mem_cmd_is($sock, $cmd, "", $rst);
+$cmd = "mop get mkey1 2 1"; $val = "f2";
+$rst = "VALUE 11 1
+f2 1 6
+END";
+mem_cmd_is($sock, $cmd, $val, $rst);
+# decrement below zero
+$cmd = "mop decr mkey1 f3 10"; $rst = "0";
+mem_cmd_is($sock, $cmd, "", $rst);
+$cmd = "mop incr mkey1 f1 18446744073709551613"; $rst = "18446744073709551615";
+mem_cmd_is($sock, $cmd, "", $rst);
+$cmd = "mop incr mkey1 f1 1 noreply";
+print $sock "$cmd\r\n";
+$cmd = "mop get mkey1 2 1"; $val = "f1";
+$rst = "VALUE 11 1
+f1 1 0
+END";
+mem_cmd_is($sock, $cmd, $val, $rst);
+
+# Create Cases
+$cmd = "mop incr mkey1 f5 10"; $rst = "NOT_FOUND_ELEMENT";
+mem_cmd_is($sock, $cmd, "", $rst);
+$cmd = "mop incr mkey1 f5 10 100"; $rst = "100";
+mem_cmd_is($sock, $cmd, "", $rst);
+$cmd = "mop incr mkey1 f5 10 100"; $rst = "110";
+mem_cmd_is($sock, $cmd, "", $rst);
+$cmd = "mop decr mkey1 f6 10 5"; $rst = "5";
+mem_cmd_is($sock, $cmd, "", $rst);
+$cmd = "mop get mkey1 5 2"; $val = "f5 f6";
+$rst = "VALUE 11 2
+f5 3 110
+f6 1 5
+END";
+mem_cmd_is($sock, $cmd, $val, $rst);
+$cmd = "getattr mkey1 count"; $rst = "ATTR count=6\nEND";
+mem_cmd_is($sock, $cmd, "", $rst);
+
+# Fail Cases
+$cmd = "mop incr mkey1 f4 10"; $rst = "CLIENT_ERROR cannot increment or decrement non-numeric value";
+mem_cmd_is($sock, $cmd, "", $rst);
+$cmd = "mop incr mkey2 f1 10"; $rst = "NOT_FOUND";
+mem_cmd_is($sock, $cmd, "", $rst);
+$cmd = "mop incr mkey2 f1 10 0"; $rst = "NOT_FOUND";
+mem_cmd_is($sock, $cmd, "", $rst);
+$cmd = "mop incr mkey1 f1 0"; $rst = "CLIENT_ERROR bad command line format";
+mem_cmd_is($sock, $cmd, "", $rst);
+$cmd = "mop incr mkey1 f1 -1"; $rst = "CLIENT_ERROR bad command line format";
+mem_cmd_is($sock, $cmd, "", $rst);
+$cmd = "mop incr mkey1 f1 1 a"; $rst = "CLIENT_ERROR bad command line format";
+mem_cmd_is($sock, $cmd, "", $rst);
+$cmd = "mop incr mkey1 f1 1 1 1"; $rst = "CLIENT_ERROR bad command line format";
+mem_cmd_is($sock, $cmd, "", $rst);
+$cmd = "set kvkey 0 0 1"; $val = "1"; $rst = "STORED";
+mem_cmd_is($sock, $cmd, $val, $rst);
+$cmd = "mop incr kvkey f1 1"; $rst = "TYPE_MISMATCH";
+mem_cmd_is($sock, $cmd, "", $rst);
+
+# Overflow Case
+$cmd = "mop create mkey3 11 0 2"; $rst = "CREATED";
+mem_cmd_is($sock, $cmd, "", $rst);
+$cmd = "mop incr mkey3 f1 1 1"; $rst = "1";
+mem_cmd_is($sock, $cmd, "", $rst);
+$cmd = "mop incr mkey3 f2 1 1"; $rst = "1";
+mem_cmd_is($sock, $cmd, "", $rst);
+$cmd = "mop incr mkey3 f3 1 1"; $rst = "OVERFLOWED";
+mem_cmd_is($sock, $cmd, "", $rst);
+
+# Finalize
+$cmd = "delete mkey1"; $rst = "DELETED";
+mem_cmd_is($sock, $cmd, "", $rst);
+$cmd = "delete mkey3"; $rst = "DELETED";
+mem_cmd_is($sock, $cmd, "", $rst);
+
+# after test
+release_memcached($engine, $server);
@@ -0,0 +1,167 @@
+#!/usr/bin/perl
+
+use strict;
+use Test::More tests => 31;
+use FindBin qw($Bin);
+use lib "$Bin/lib";
+use MemcachedTest;
+
+my $engine = shift;
+my $server = get_memcached($engine);
+my $sock = $server->sock;
+
+my $cmd;
+my $val;
+my $rst;
+
+# inserts elements with noreply and checks the element count.
+sub coll_insert {
+    my ($type, $key, $from, $to) = @_;
+    my $index;
+
+    for ($index = $from; $index <= $to; $index++) {
+        $val = "datum$index";
+        if ($type eq "set") {
+            print $sock "sop insert $key " . length($val) . " create 13 0 0 noreply\r\n$val\r\n";
+        } else {
+            print $sock "mop insert $key field$index " . length($val) . " create 13 0 0 noreply\r\n$val\r\n";
+        }
+    }
+}
+
+# returns (head, next cursor, element list) of a scan response
+sub coll_scan {
+    my ($type, $key, $cursor, $count) = @_;
+    my @elems = ();
+    my $op = ($type eq "set" ? "sop" : "mop");
+
+    print $sock "$op scan $key $cursor $count\r\n";
+    my $head = scalar <$sock>;
+    $head =~ s/\r\n$//;
+    if ($head !~ /^VALUE (\d+) (\d+) (\d+)$/) {
+        return ($head, 0, @elems);
+    }
+    my ($ecount, $next) = ($2, $3);
+    my $line = scalar <$sock>;
+    while ($line !~ /^END/) {
+        $line =~ s/\r\n$//;
+        if ($type eq "set") {
+            push(@elems, (split(/ /, $line))[1]);
+        } else {
+            push(@elems, (split(/ /, $line))[0]);
+        }
+        $line = scalar <$sock>;
+    }
+    return ("VALUE $1 $ecount", $next, @elems);
+}
+
+# scans the whole collection.
+# the callback is called between scan steps, and
+# returns (max response count, element hash, duplicated count)
+sub coll_scan_all {
+    my ($type, $key, $count, $callback) = @_;
+    my %seen = ();
+    my $dup = 0;
+    my $max = 0;
+    my $cursor = 0;
+    my $step = 0;
+
+    do {
+        my ($head, $next, @elems) = coll_scan($type, $key, $cursor, $count);
+        if ($head =~ /^VALUE/) {
+            $max = scalar(@elems) if (scalar(@elems) > $max);
+            foreach my $elem (@elems) {
+                $dup++ if ($seen{$elem});
+                $seen{$elem} = 1;
+            }
+        }
+        $cursor = $next;
+        $step++;
+        $callback->($step) if (defined $callback);
+    } while ($cursor != 0);
+    return ($max, \%seen, $dup);
+}
+
+sub check_all_seen {
+    my ($seen, $prefix, $from, $to) = @_;
+    my $index;
+    for ($index = $from; $index <= $to; $index++) {
+        return 0 if (! $seen->{"$prefix$index"});
+    }
+    return 1;
+}
+
+my ($max, $seen, $dup);
+
+# testSOPScan
+coll_insert("set", "skey", 1, 3000);
+mem_cmd_is($sock, "getattr skey count", "", "ATTR count=3000\nEND");
+($max, $seen, $dup) = coll_scan_all("set", "skey", 100);
+ok($max <= 100, "sop scan: response count limited");
+is($dup, 0, "sop scan: no duplicated elements");
+is(scalar(keys %$seen), 3000, "sop scan: all elements returned");
+($max, $seen, $dup) = coll_scan_all("set", "skey", 1);
+ok($max == 1 && $dup == 0 && scalar(keys %$seen) == 3000, "sop scan: count 1");
+($max, $seen, $dup) = coll_scan_all("set", "skey", 0);
+ok($max <= 100 && $dup == 0 && scalar(keys %$seen) == 3000, "sop scan: count 0 means 100");
+
+# testSOPScanWithUpdate: delete datum[1..1000] and insert datum[3001..4000] while scanning
+($max, $seen, $dup) = coll_scan_all("set", "skey", 50, sub {
+    my ($step) = @_;
+    if ($step == 10) {
+        my $index;
+        for ($index = 1; $index <= 1000; $index++) {
+            $val = "datum$index";
+            print $sock "sop delete skey " . length($val) . " noreply\r\n$val\r\n";
+        }
+        coll_insert("set", "skey", 3001, 4000);
+    }
+});
+is($dup, 0, "sop scan with update: no duplicated elements");
+ok(check_all_seen($seen, "datum", 1001, 3000), "sop scan with update: unchanged elements returned");
+mem_cmd_is($sock, "getattr skey count", "", "ATTR count=3000\nEND");
+
+# testMOPScan
+coll_insert("map", "mkey", 1, 3000);
+mem_cmd_is($sock, "getattr mkey count", "", "ATTR count=3000\nEND");
+($max, $seen, $dup) = coll_scan_all("map", "mkey", 100);
+ok($max <= 100, "mop scan: response count limited");
+is($dup, 0, "mop scan: no duplicated elements");
+is(scalar(keys %$seen), 3000, "mop scan: all elements returned");
+ok(check_all_seen($seen, "field", 1, 3000), "mop scan: all fields returned");
+
+# testMOPScanWithUpdate
+($max, $seen, $dup) = coll_scan_all("map", "mkey", 50, sub {
+    my ($step) = @_;
+    if ($step == 10) {
+        my $index;
+        for ($index = 1; $index <= 1000; $index++) {
+            print $sock "mop delete mkey " . length("field$index") . " 1 noreply\r\nfield$index\r\n";
+        }
+        coll_insert("map", "mkey", 3001, 4000);
+    }
+});
+is($dup, 0, "mop scan with update: no duplicated elements");
+ok(check_all_seen($seen, "field", 1001, 3000), "mop scan with update: unchanged elements returned");
+mem_cmd_is($sock, "getattr mkey count", "", "ATTR count=3000\nEND");
+
+# testScanSmall
+mem_cmd_is($sock, "sop insert skey2 6 create 13 0 0", "datum1", "CREATED_STORED");
+mem_cmd_is($sock, "sop scan skey2 0", "", "VALUE 13 1 0\n6 datum1\nEND");
+mem_cmd_is($sock, "mop insert mkey2 f1 6 create 13 0 0", "datum1", "CREATED_STORED");
+mem_cmd_is($sock, "mop scan mkey2 0 10", "", "VALUE 13 1 0\nf1 6 datum1\nEND");
+
+# testScanFail
+mem_cmd_is($sock, "sop scan nokey 0", "", "NOT_FOUND");
+mem_cmd_is($sock, "mop scan skey 0", "", "TYPE_MISMATCH");
+mem_cmd_is($sock, "sop scan mkey 0", "", "TYPE_MISMATCH");
+mem_cmd_is($sock, "sop scan skey cursor", "", "CLIENT_ERROR bad command line format");
+mem_cmd_is($sock, "mop scan mkey 0 10 20", "", "CLIENT_ERROR bad command line format");
+mem_cmd_is($sock, "sop scan skey 0 1001", "", "CLIENT_ERROR bad value");
+mem_cmd_is($sock, "mop scan mkey 0 1001", "", "CLIENT_ERROR bad value");
+mem_cmd_is($sock, "sop delete skey2 6 drop", "datum1", "DELETED_DROPPED");
+mem_cmd_is($sock, "sop create skey3 13 0 0", "", "CREATED");
+mem_cmd_is($sock, "sop scan skey3 0", "", "NOT_FOUND_ELEMENT");
+
+# after test
+release_memcached($engine, $server);
@@ -0,0 +1,120 @@
+#!/usr/bin/perl
+
+use strict;
+use Test::More tests => 3032;
+use FindBin qw($Bin);
+use lib "$Bin/lib";
+use MemcachedTest;
+
+my $engine = shift;
+my $server = get_memcached($engine);
+my $sock = $server->sock;
+
+my $cmd;
+my $val;
+my $rst;
+
+# SOP test sub routines
+sub sop_insert {
+    my ($key, $from, $to, $create) = @_;
+    my $index;
+    my $vleng;
+
+    for ($index = $from; $index <= $to; $index++) {
+        $val = "datum$index";
+        $vleng = length($val);
+        if ($index == $from) {
+            $cmd = "sop insert $key $vleng $create";
+            $rst = "CREATED_STORED";
+        } else {
+            $cmd = "sop insert $key $vleng";
+            $rst = "STORED";
+        }
+        mem_cmd_is($sock, $cmd, $val, $rst);
+    }
+}
+
+# returns (head, tail, element list) of sop get response
+sub sop_get_elems {
+    my ($args) = @_;
+    my @elems = ();
+
+    print $sock "sop get $args\r\n";
+    my $head = scalar <$sock>;
+    if ($head !~ /^VALUE/) {
+        $head =~ s/\r\n$//;
+        return ($head, "", @elems);
+    }
+    my $line = scalar <$sock>;
+    while ($line !~ /^END/ and $line !~ /^DELETED/) {
+        my $vleng = substr $line, 0, index($line, ' ');
+        my $rleng = length($vleng) + 1;
+        push(@elems, substr($line, $rleng, length($line)-$rleng-2));
+        $line = scalar <$sock>;
+    }
+    $head =~ s/\r\n$//;
+    $line =~ s/\r\n$//;
+    return ($head, $line, @elems);
+}
+
+# checks that the elements are distinct members of datum[from..to]
+sub assert_random_elems {
+    my ($args, $ecount, $tail, $from, $to) = @_;
+    my ($head, $rtail, @elems) = sop_get_elems($args);
+    my %seen = ();
+    my $valid = 1;
+    foreach my $elem (@elems) {
+        if ($elem !~ /^datum(\d+)$/ or $1 < $from or $1 > $to or $seen{$elem}) {
+            $valid = 0;
+        }
+        $seen{$elem} = 1;
+    }
+    is("$head $rtail", "VALUE 13 $ecount $tail", "sop get $args: response");
+    ok($valid && scalar(@elems) == $ecount, "sop get $args: $ecount distinct elements");
+    return @elems;
+}
+
+my @elems1;
+my @elems2;
+
+# testSOPRandomGet
+sop_insert("skey", 0, 2999, "create 13 0 0");
+$cmd = "getattr skey count"; $rst = "ATTR count=3000\nEND";
+mem_cmd_is($sock, $cmd, "", $rst);
+
+@elems1 = assert_random_elems("skey 100 random", 100, "END", 0, 2999);
+@elems2 = assert_random_elems("skey 100 random", 100, "END", 0, 2999);
+isnt(join(",", @elems1), join(",", @elems2), "random samples are different");
+assert_random_elems("skey 1 random", 1, "END", 0, 2999);
+assert_random_elems("skey 1500 random", 1500, "END", 0, 2999);
+assert_random_elems("skey 2999 random", 2999, "END", 0, 2999);
+assert_random_elems("skey 3000 random", 3000, "END", 0, 2999);
+assert_random_elems("skey 0 random", 3000, "END", 0, 2999);
+
+# testSOPRandomPop
+@elems1 = assert_random_elems("skey 100 delete random", 100, "DELETED", 0, 2999);
+$cmd = "getattr skey count"; $rst = "ATTR count=2900\nEND";
+mem_cmd_is($sock, $cmd, "", $rst);
+my $exist_cnt = 0;
+foreach my $elem (@elems1) {
+    print $sock "sop exist skey " . length($elem) . "\r\n$elem\r\n";
+    $exist_cnt++ if (scalar <$sock> =~ /^EXIST/);
+}
+is($exist_cnt, 0, "popped elements do not exist");
+@elems2 = assert_random_elems("skey 2000 delete random", 2000, "DELETED", 0, 2999);
+$cmd = "getattr skey count"; $rst = "ATTR count=900\nEND";
+mem_cmd_is($sock, $cmd, "", $rst);
+assert_random_elems("skey 900 random", 900, "END", 0, 2999);
+assert_random_elems("skey 899 drop random", 899, "DELETED", 0, 2999);
+assert_random_elems("skey 1 drop random", 1, "DELETED_DROPPED", 0, 2999);
+$cmd = "sop get skey 1 random"; $rst = "NOT_FOUND";
+mem_cmd_is($sock, $cmd, "", $rst);
+
+# testSOPRandomInvalid
+$cmd = "sop get skey 10 random delete"; $rst = "CLIENT_ERROR bad command line format";
+mem_cmd_is($sock, $cmd, "", $rst);
+$cmd = "sop get skey 10 delete random drop"; $rst = "CLIENT_ERROR bad command line format";
+mem_cmd_is($sock, $cmd, "", $rst);
+
+# after test
+release_memcached($engine, $server);
@@ -0,0 +1,72 @@
+#!/usr/bin/perl
+
+# The idle client connections return their buffers to the pool of
+# the worker thread, and borrow them again when reading a request.
+
+use strict;
+use Test::More tests => 7;
+use FindBin qw($Bin);
+use lib "$Bin/lib";
+use MemcachedTest;
+
+my $engine = shift;
+my $server = get_memcached($engine, "-t 2");
+my $sock = $server->sock;
+
+sub thread_stats_sum {
+    my ($name) = @_;
+    my $stats = mem_stats($sock, "threads");
+    my $sum = 0;
+    $sum += $stats->{"thread$_:$name"} for (grep { defined($stats->{"thread$_:$name"}) } (0 .. 15));
+    return $sum;
+}
+
+# the idle connections do not keep the buffers
+my $borrowed = thread_stats_sum("bufs_borrowed");
+my @socks = map { $server->new_sock } (1 .. 50);
+for (my $i = 0; $i < 50; $i++) {
+    my $s = $socks[$i];
+    print $s "set key$i 0 0 " . length($i) . "\r\n$i\r\n";
+}
+my $stored = 0;
+for (my $i = 0; $i < 50; $i++) {
+    my $s = $socks[$i];
+    $stored++ if (scalar <$s> eq "STORED\r\n");
+}
+is($stored, 50, "set on each connection");
+ok(thread_stats_sum("bufs_borrowed") >= $borrowed + 50, "buffers borrowed");
+my $pooled = thread_stats_sum("bufs_pooled");
+ok($pooled > 0 && $pooled <= 2 * 64, "buffers returned to the pool: $pooled");
+
+# the borrowed buffers work again
+my $found = 0;
+for (my $i = 0; $i < 50; $i++) {
+    my $s = $socks[$i];
+    print $s "get key$i\r\n";
+}
+for (my $i = 0; $i < 50; $i++) {
+    my $s = $socks[$i];
+    $found++ if (scalar <$s> eq "VALUE key$i 0 " . length($i) . "\r\n" &&
+                 scalar <$s> eq "$i\r\n" && scalar <$s> eq "END\r\n");
+}
+is($found, 50, "get on each connection");
+close($_) for (@socks);
+
+# a request larger than the default buffers
+my $keys = join(" ", map { "key$_" } (0 .. 49)) . (" nokey" x 2000);
+print $sock "get $keys\r\n";
+$found = 0;
+while ((my $line = scalar <$sock>) ne "END\r\n") {
+    $found++ if ($line =~ /^VALUE /);
+}
+is($found, 50, "get with a long key list");
+mem_get_is($sock, "key7", "7");
+
+# a request split across the reads
+print $sock "set key1 0 0 5\r\n";
+select(undef, undef, undef, 0.1);
+print $sock "hello\r\n";
+is(scalar <$sock>, "STORED\r\n", "set with the data sent later");
+
+# after test
+release_memcached($engine, $server);
@@ -0,0 +1,123 @@
+#!/usr/bin/perl
+
+# The collection commands of a large estimated cost (sop get, bop smget)
+# are executed on the heavy threads, and their responses are sent by
+# the worker thread of the connection.
+
+use strict;
+use Test::More tests => 18;
+use FindBin qw($Bin);
+use lib "$Bin/lib";
+use POSIX qw(_exit);
+use MemcachedTest;
+
+my $engine = shift;
+my $server = get_memcached($engine, "-H 2 -J 100");
+my $sock = $server->sock;
+
+sub heavy_stat {
+    my ($name) = @_;
+    return mem_stats($sock, "threads")->{"heavy_$name"};
+}
+
+sub read_until {
+    my ($s, $regex) = @_;
+    my @lines;
+    while (defined(my $line = scalar <$s>)) {
+        push(@lines, $line);
+        last if ($line =~ $regex);
+    }
+    return @lines;
+}
+
+my $settings = mem_stats($sock, "settings");
+is($settings->{"heavy_threads"}, 2, "heavy threads");
+is($settings->{"heavy_threshold"}, 100, "heavy threshold");
+is(heavy_stat("offloaded"), 0, "nothing offloaded yet");
+
+# a set of 500 elements
+for (my $i = 0; $i < 500; $i += 100) {
+    my $block = join("", map { length("e$_") . "\r\ne$_\r\n" } ($i .. $i+99));
+    my $create = ($i == 0) ? " create 0 0 1000" : "";
+    print $sock "sop minsert bigset 100 " . length($block) . "$create\r\n$block\r\n";
+    scalar <$sock>;
+}
+
+# sop get of all elements
+print $sock "sop get bigset 0\r\n";
+my @lines = read_until($sock, qr/^(END|[A-Z_]+)\r\n$/);
+is(shift(@lines), "VALUE 0 500\r\n", "sop get of all elements");
+my %elems = map { /^\d+ (e\d+)\r\n$/ ? ($1 => 1) : () } @lines;
+is(scalar(keys %elems), 500, "all elements returned");
+is(heavy_stat("offloaded"), 1, "sop get offloaded");
+
+# the small commands stay on the worker thread
+print $sock "sop get bigset 10\r\n";
+@lines = read_until($sock, qr/^(END|[A-Z_]+)\r\n$/);
+is(shift(@lines), "VALUE 0 10\r\n", "sop get of 10 elements");
+mem_cmd_is($sock, "sop get noset 1000", "", "NOT_FOUND");
+is(heavy_stat("offloaded"), 1, "small commands not offloaded");
+
+# pipelined commands are answered in order
+print $sock "sop get bigset 200\r\nset foo 0 0 3\r\nbar\r\nget foo\r\n";
+@lines = read_until($sock, qr/^END\r\n$/);
+is(scalar(@lines), 202, "offloaded sop get in the pipeline");
+@lines = read_until($sock, qr/^END\r\n$/);
+is("@lines", "STORED\r\n VALUE foo 0 3\r\n bar\r\n END\r\n", "followed by set and get");
+
+# bop smget over 200 b+trees
+for (my $i = 0; $i < 200; $i++) {
+    print $sock "bop insert bt$i $i 4 create 0 0 10\r\n" . sprintf("v%03d", $i) . "\r\n";
+    scalar <$sock>;
+}
+my $keys = join(" ", map { "bt$_" } (0 .. 199));
+print $sock "bop smget " . length($keys) . " 200 0..1000 50 duplicate\r\n$keys\r\n";
+@lines = read_until($sock, qr/^(END|DUPLICATED|[A-Z_]+ERROR.*)\r\n$/);
+is(shift(@lines), "ELEMENTS 50\r\n", "bop smget of 200 keys");
+my @bkeys = map { /^bt\d+ \d+ (\d+) / ? $1 : () } @lines;
+is("@bkeys", join(" ", (0 .. 49)), "elements sorted by bkey");
+is(heavy_stat("offloaded"), 3, "sop get and bop smget offloaded");
+is(heavy_stat("queued"), 0, "no command queued");
+
+# sop get with drop on the heavy threads
+print $sock "sop get bigset 0 drop\r\n";
+@lines = read_until($sock, qr/^(DELETED_DROPPED|END|[A-Z_]+)\r\n$/);
+is($lines[-1], "DELETED_DROPPED\r\n", "sop get with drop");
+
+# the chunked sop get never mixes the elements of a set and of the set
+# created again on its key by another client
+sub recreate_set {
+    my ($s, $gen) = @_;
+    print $s "delete gset\r\n";
+    scalar <$s>;
+    for (my $i = 0; $i < 300; $i += 100) {
+        my $block = join("", map { length("g${gen}_$_") . "\r\ng${gen}_$_\r\n" } ($i .. $i+99));
+        my $create = ($i == 0) ? " create 0 0 1000" : "";
+        print $s "sop minsert gset 100 " . length($block) . "$create\r\n$block\r\n";
+        scalar <$s>;
+    }
+}
+
+recreate_set($sock, 0);
+my $pid = fork();
+if ($pid == 0) {
+    my $csock = $server->new_sock or _exit(1);
+    for (my $gen = 1; ; $gen++) {
+        recreate_set($csock, $gen);
+    }
+}
+foreach my $opt ("", " delete") {
+    my $mixed = 0;
+    for (my $n = 0; $n < 200; $n++) {
+        print $sock "sop get gset 0$opt\r\n";
+        @lines = read_until($sock, qr/^(END|DELETED|[A-Z_]+)\r\n$/);
+        my %gens = map { /^\d+ g(\d+)_\d+\r\n$/ ? ($1 => 1) : () } @lines;
+        $mixed++ if (scalar(keys %gens) > 1);
+    }
+    is($mixed, 0, "sop get$opt of the set created again");
+}
+kill('KILL', $pid);
+waitpid($pid, 0);
+
+# after test
+release_memcached($engine, $server);
@@ -0,0 +1,74 @@
+#!/usr/bin/perl
+
+# Lease on cache misses: the first client missing an item wins the lease
+# to fill it, and the others are told to wait for it.
+
+use strict;
+use Test::More tests => 28;
+use FindBin qw($Bin);
+use lib "$Bin/lib";
+use MemcachedTest;
+
+my $engine = shift;
+my $server = get_memcached($engine);
+my $sock = $server->sock;
+my $other = $server->new_sock;
+
+sub meta_is {
+    my ($s, $cmd, $expected, $msg) = @_;
+    print $s "$cmd\r\n";
+    my $res = "";
+    foreach (1 .. scalar(split(/\r\n/, $expected, -1)) - 1) {
+        $res .= scalar <$s>;
+    }
+    ($msg = $cmd) =~ s/\r\n.*//s unless (defined($msg));
+    is($res, $expected, $msg);
+}
+
+# the first miss wins the lease
+print $sock "mg foo v c N30\r\n";
+my $line = scalar <$sock>;
+ok($line =~ /^VA 0 c([1-9]\d*) W\r\n$/, "lease won");
+my $token = $1;
+is(scalar <$sock>, "\r\n", "empty value of the lease");
+meta_is($other, "mg foo v c N30", "EN Z\r\n", "wait for the lease");
+meta_is($sock, "mg foo v c N30", "EN Z\r\n", "wait for the lease again");
+
+# the lease is missing to the others
+meta_is($other, "get foo", "END\r\n");
+meta_is($other, "mg foo v", "EN\r\n");
+meta_is($other, "replace foo 0 0 3\r\nbar", "NOT_STORED\r\n");
+meta_is($other, "ms foo 3 C" . ($token + 1) . "\r\nbar", "EX\r\n", "ms with a wrong token");
+
+# the lease is filled with the token
+meta_is($sock, "ms foo 3 C$token\r\nbar", "HD\r\n", "ms with the token");
+meta_is($other, "mg foo v N30", "VA 3\r\nbar\r\n", "served with the filled item");
+mem_get_is($other, "foo", "bar");
+
+# add and set replace the lease
+meta_is($sock, "mg key1 N30", "HD W\r\n", "lease of key1");
+meta_is($other, "add key1 0 0 1\r\na", "STORED\r\n");
+mem_get_is($other, "key1", "a");
+
+# delete invalidates the lease
+print $sock "mg key2 c N30\r\n";
+$line = scalar <$sock>;
+ok($line =~ /^HD c([1-9]\d*) W\r\n$/, "lease of key2");
+$token = $1;
+meta_is($other, "delete key2", "DELETED\r\n");
+meta_is($sock, "ms key2 3 C$token\r\nbar", "NF\r\n", "ms with the invalidated token");
+
+# collections created on the lease replace it
+foreach my $create ("lop create lkey1 0 0 10", "sop create lkey2 0 0 10",
+                    "mop create lkey3 0 0 10", "bop create lkey4 0 0 10") {
+    my ($key) = ($create =~ / (lkey\d) /);
+    meta_is($sock, "mg $key N30", "HD W\r\n", "lease of $key");
+    meta_is($other, $create, "CREATED\r\n");
+}
+meta_is($sock, "mg lkey5 N30", "HD W\r\n", "lease of lkey5");
+meta_is($other, "bop insert lkey5 1 1 create 0 0 10\r\na", "CREATED_STORED\r\n",
+        "bop insert with create");
+meta_is($other, "bop get lkey5 1", "VALUE 0 1\r\n1 1 a\r\nEND\r\n");
+
+# after test
+release_memcached($engine, $server);
@@ -90,7 +90,7 @@ sub mem_cmd_is {
             $rst_type = 2;
         } elsif ($line =~ /^RESPONSE/) { # pipe command
             $rst_type = 2;
-        } elsif ($line =~ /^(ATTR|PREFIX)/) {
+        } elsif ($line =~ /^(ATTR|PREFIX|AGGREGATED)/) {
             $rst_type = 1;
             @response_list = ("END");
         } else {
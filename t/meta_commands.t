@@ -0,0 +1,93 @@
+#!/usr/bin/perl
+
+# Meta commands: mg, ms, md, ma and mn.
+
+use strict;
+use Test::More tests => 37;
+use FindBin qw($Bin);
+use lib "$Bin/lib";
+use MemcachedTest;
+
+my $engine = shift;
+my $server = get_memcached($engine);
+my $sock = $server->sock;
+
+sub meta_is {
+    my ($cmd, $expected, $msg) = @_;
+    print $sock "$cmd\r\n";
+    my $res = "";
+    foreach (1 .. scalar(split(/\r\n/, $expected, -1)) - 1) {
+        $res .= scalar <$sock>;
+    }
+    ($msg = $cmd) =~ s/\r\n.*//s unless (defined($msg));
+    is($res, $expected, $msg);
+}
+
+# ms and mg
+meta_is("ms foo 3 T0 F5\r\nbar", "HD\r\n");
+meta_is("mg foo v", "VA 3\r\nbar\r\n");
+meta_is("mg foo v f s t k Oabc", "VA 3 f5 s3 t-1 kfoo Oabc\r\nbar\r\n");
+meta_is("mg foo", "HD\r\n", "mg without value");
+meta_is("mg missing v", "EN\r\n");
+meta_is("mg missing v q\r\nmn", "MN\r\n", "quiet miss");
+
+# CAS
+print $sock "mg foo c\r\n";
+my $line = scalar <$sock>;
+ok($line =~ /^HD c(\d+)\r\n$/, "mg returns cas");
+my $cas = $1;
+meta_is("ms foo 3 C" . ($cas + 1) . "\r\nbaz", "EX\r\n", "ms with a wrong cas");
+meta_is("ms foo 3 c C$cas\r\nbaz", "HD c" . ($cas + 1) . "\r\n", "ms with the cas");
+meta_is("mg foo v", "VA 3\r\nbaz\r\n");
+meta_is("ms foo 3 C1 ME\r\nbaz", "CLIENT_ERROR bad command line format\r\n", "cas with add mode");
+
+# modes
+meta_is("ms foo 3 ME\r\nnew", "NS\r\n", "add mode on the existing key");
+meta_is("ms newkey 3 ME k\r\nnew", "HD knewkey\r\n", "add mode");
+meta_is("ms nokey 3 MR\r\nnew", "NS\r\n", "replace mode on the missing key");
+meta_is("ms newkey 3 MA\r\n123", "HD\r\n", "append mode");
+meta_is("ms newkey 3 MP q\r\nold\r\nmn", "MN\r\n", "quiet prepend mode");
+meta_is("mg newkey v", "VA 9\r\noldnew123\r\n");
+
+# TTL: touch on read and recache
+meta_is("ms ttlkey 2 T100\r\nhi", "HD\r\n");
+print $sock "mg ttlkey t\r\n";
+ok(scalar <$sock> =~ /^HD t(99|100)\r\n$/, "mg returns ttl");
+print $sock "mg ttlkey t T1000 v\r\n";
+ok(scalar <$sock> =~ /^VA 2 t(999|1000)\r\n$/, "mg touches the item");
+scalar <$sock>;
+print $sock "mg ttlkey t R2000\r\n";
+ok(scalar <$sock> =~ /^HD t(2999|3000) W\r\n$/, "the first client wins to recache");
+print $sock "mg ttlkey t R2000\r\n";
+ok(scalar <$sock> =~ /^HD t(2999|3000)\r\n$/, "the other clients are served");
+
+# md
+meta_is("md foo C1", "EX\r\n", "md with a wrong cas");
+meta_is("md foo k Oxyz", "HD kfoo Oxyz\r\n");
+meta_is("md foo", "NF\r\n");
+meta_is("md foo q\r\nmn", "MN\r\n", "quiet md");
+
+# ma
+meta_is("ma cnt", "NF\r\n");
+meta_is("ma cnt N0 J10 v", "VA 2\r\n10\r\n", "ma creates the item");
+meta_is("ma cnt D5 v", "VA 2\r\n15\r\n");
+meta_is("ma cnt MD D20 v", "VA 1\r\n0\r\n", "ma decrements");
+meta_is("ma foo2", "NF\r\n");
+
+# errors
+meta_is("mg foo X", "CLIENT_ERROR bad command line format\r\n", "invalid flag");
+meta_is("mg foo O" . ("a" x 33), "CLIENT_ERROR bad command line format\r\n", "too long opaque");
+
+# duplicated return flags with the longest key
+my $longkey = "k" x 250;
+my $opaque = "o" x 32;
+meta_is("ms $longkey 3 T0 F5\r\nbar", "HD\r\n", "ms of the longest key");
+meta_is("mg $longkey k k k v", "CLIENT_ERROR bad command line format\r\n",
+        "duplicated return flags");
+meta_is("md $longkey k k", "CLIENT_ERROR bad command line format\r\n",
+        "duplicated return flags of md");
+meta_is("mg $longkey k f s t v O$opaque", "VA 3 k$longkey f5 s3 t-1 O$opaque\r\nbar\r\n",
+        "all return flags with the longest key");
+
+# after test
+release_memcached($engine, $server);
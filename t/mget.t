@@ -1,7 +1,7 @@
 #!/usr/bin/perl
 
 use strict;
-use Test::More tests => 18;
+use Test::More tests => 24;
 use FindBin qw($Bin);
 use lib "$Bin/lib";
 use MemcachedTest;
@@ -180,5 +180,27 @@ mem_cmd_is($sock, $cmd, "", $rst);
 $cmd = "delete key5"; $rst = "DELETED";
 mem_cmd_is($sock, $cmd, "", $rst);
 
+# key lists whose delimiters are found at every offset of 16 and 32 bytes
+my @keys = map { "k" . ("x" x $_) } (0 .. 40);
+for (my $i = 0; $i < scalar(@keys); $i++) {
+    print $sock "set $keys[$i] 0 0 " . length($i) . "\r\n$i\r\n";
+    scalar <$sock>;
+}
+foreach my $list ([@keys], [reverse(@keys)], [@keys[7 .. 40]], [map { $keys[($_ * 13) % 41] } (0 .. 40)]) {
+    my @list = @$list;
+    $val = join(" ", @list);
+    $cmd = "mget " . length($val) . " " . scalar(@list);
+    $rst = join("", map { my $i = length($_) - 1; "VALUE $_ 0 " . length($i) . "\n$i\n" } @list) . "END";
+    mem_cmd_is($sock, $cmd, $val, $rst);
+}
+
+# invalid key lists
+$val = join(" ", @keys[30 .. 33]) . "  " . $keys[34];
+$cmd = "mget " . length($val) . " 5"; $rst = "CLIENT_ERROR bad data chunk";
+mem_cmd_is($sock, $cmd, $val, $rst);
+$val = join(" ", @keys[30 .. 34]);
+$cmd = "mget " . length($val) . " 4"; $rst = "CLIENT_ERROR bad data chunk";
+mem_cmd_is($sock, $cmd, $val, $rst);
+
 # after test
 release_memcached($engine, $server);
@@ -0,0 +1,79 @@
+#!/usr/bin/perl
+
+# Run the commands on the connections of the io_uring network backend.
+
+use strict;
+use Test::More;
+use FindBin qw($Bin);
+use lib "$Bin/lib";
+use MemcachedTest;
+
+my $engine = shift;
+my $server = eval { get_memcached($engine, "-N io_uring -R 5") };
+if (!$server) {
+    plan skip_all => "io_uring network backend is not built";
+}
+my $sock = $server->sock;
+if (mem_stats($sock, "settings")->{"network_backend"} ne "io_uring") {
+    plan skip_all => "io_uring is not available";
+}
+plan tests => 17;
+
+# simple commands
+mem_cmd_is($sock, "set foo 0 0 6", "fooval", "STORED");
+mem_get_is($sock, "foo", "fooval");
+mem_cmd_is($sock, "delete foo", "", "DELETED");
+mem_get_is($sock, "foo", undef);
+
+# the value received by many recv buffers and sent by partial sends
+my $large = join("", map { chr(ord('a') + $_ % 26) } (1 .. 512 * 1024));
+mem_cmd_is($sock, "set large 0 0 " . length($large), $large, "STORED", "set a large value");
+mem_get_is($sock, "large", $large, "get the large value");
+
+# pipelined commands are processed with yields
+my $count = 200;
+print $sock join("", map { "set key$_ 0 0 " . length($_) . "\r\n$_\r\n" } (1 .. $count));
+my $stored = 0;
+for (1 .. $count) {
+    $stored++ if (scalar <$sock> eq "STORED\r\n");
+}
+is($stored, $count, "pipelined sets");
+print $sock join("", map { "get key$_\r\n" } (1 .. $count));
+my $found = 0;
+for my $i (1 .. $count) {
+    my $head = scalar <$sock>;
+    my $data = scalar <$sock>;
+    my $end = scalar <$sock>;
+    $found++ if ($head eq "VALUE key$i 0 " . length($i) . "\r\n" &&
+                 $data eq "$i\r\n" && $end eq "END\r\n");
+}
+is($found, $count, "pipelined gets");
+ok(mem_stats($sock)->{"conn_yields"} > 0, "connection yields");
+
+# collection commands
+mem_cmd_is($sock, "lop create lkey 0 0 -1", "", "CREATED");
+mem_cmd_is($sock, "lop insert lkey 0 6", "datum0", "STORED");
+lop_get_is($sock, "lkey 0..-1", 0, 1, "datum0");
+
+# connections interleaved and closed
+my $conns = mem_stats($sock)->{"curr_connections"};
+my $sock2 = $server->new_sock;
+mem_cmd_is($sock2, "set bar 0 0 6", "barval", "STORED");
+mem_get_is($sock, "bar", "barval");
+my $sock3 = $server->new_sock;
+print $sock3 "set baz 0 0 10\r\nbaz";
+close($sock3);
+print $sock2 "quit\r\n";
+is(scalar <$sock2>, undef, "quit closes the connection");
+close($sock2);
+my $curr;
+for (my $wait = 0; $wait < 50; $wait++) {
+    $curr = mem_stats($sock)->{"curr_connections"};
+    last if ($curr == $conns);
+    select(undef, undef, undef, 0.1);
+}
+is($curr, $conns, "closed connections are released");
+mem_get_is($sock, "baz", undef);
+
+# after test
+release_memcached($engine, $server);
@@ -0,0 +1,116 @@
+#!/usr/bin/perl
+
+# Dispatch the new connections to the least loaded worker threads,
+# and migrate the idle connections off the busy worker thread.
+
+use strict;
+use Test::More tests => 12;
+use Time::HiRes qw(time);
+use FindBin qw($Bin);
+use lib "$Bin/lib";
+use MemcachedTest;
+
+my $engine = shift;
+my $server = get_memcached($engine, "-w load -t 4");
+my $sock = $server->sock;
+
+sub thread_stats {
+    my ($name, $stats) = @_;
+    $stats = mem_stats($sock, "threads") unless (defined $stats);
+    return map { $stats->{"thread$_:$name"} } grep { defined($stats->{"thread$_:$name"}) } (0 .. 15);
+}
+
+sub sum {
+    my $sum = 0;
+    $sum += $_ for (@_);
+    return $sum;
+}
+
+is(mem_stats($sock, "settings")->{"dispatch"}, "load", "dispatch policy");
+is(mem_stats($sock, "threads")->{"dispatch"}, "load", "dispatch policy in thread stats");
+my $conns = sum(thread_stats("conns"));
+
+# the idle connections are spread over the worker threads
+my @socks = map { $server->new_sock } (1 .. 15);
+for (my $i = 0; $i < 15; $i++) {
+    my $s = $socks[$i];
+    print $s "set key$i 0 0 " . length($i) . "\r\n$i\r\n";
+    scalar <$s>;
+}
+my @conns = thread_stats("conns");
+is(scalar(@conns), 4, "stats of each thread");
+is(sum(@conns), $conns + 15, "connections counted");
+my @sorted = sort { $a <=> $b } @conns;
+ok($sorted[-1] - $sorted[0] <= 1, "connections balanced: @conns");
+close($_) for (@socks);
+for (my $wait = 0; $wait < 50; $wait++) {
+    last if (sum(thread_stats("conns")) == $conns);
+    select(undef, undef, undef, 0.1);
+}
+is(sum(thread_stats("conns")), $conns, "closed connections are released");
+release_memcached($engine, $server);
+
+# migrate the idle connections off the busy thread
+$server = get_memcached($engine, "-w migrate -t 2");
+$sock = $server->sock;
+$conns = sum(thread_stats("conns"));
+@socks = map { $server->new_sock } (1 .. 10);
+for (my $i = 0; $i < 10; $i++) {
+    my $s = $socks[$i];
+    print $s "set key$i 0 0 " . length($i) . "\r\n$i\r\n";
+    scalar <$s>;
+}
+for (my $i = 0; $i < 50000; $i += 100) {
+    my $block = join("", map { "$_ 0x01 1\r\n1\r\n" } ($i .. $i+99));
+    my $create = ($i == 0) ? " create 0 0 50000" : "";
+    print $sock "bop minsert hot 100 " . length($block) . "$create\r\n$block\r\n";
+    scalar <$sock>;
+}
+mem_cmd_is($sock, "bop count hot 0..100000", "", "COUNT=50000");
+
+# keep the thread of the busy connection busy by scanning the b+tree
+my $busy = $server->new_sock;
+my $start = time;
+my @migrated;
+while (time - $start < 10) {
+    print $busy "bop count hot 0..100000 0 & 0x01 EQ 0x00\r\n" x 10;
+    scalar <$busy> for (1 .. 10);
+    @migrated = thread_stats("migrated_out");
+    last if (sum(@migrated) > 0);
+}
+ok(sum(@migrated) > 0, "idle connections migrated: @migrated");
+
+# the busy traffic has stopped. Wait until the migrations settle, and
+# compare the counters of the same stats output.
+my ($stats, $last);
+for (my $wait = 0; $wait < 50; $wait++) {
+    select(undef, undef, undef, 0.1);
+    $stats = mem_stats($sock, "threads");
+    my $now = join(" ", thread_stats("migrated_out", $stats), thread_stats("migrated_in", $stats));
+    last if (defined($last) && $now eq $last &&
+             sum(thread_stats("migrated_in", $stats)) == sum(thread_stats("migrated_out", $stats)));
+    $last = $now;
+}
+is(sum(thread_stats("migrated_in", $stats)), sum(thread_stats("migrated_out", $stats)),
+   "migrated connections adopted");
+is(sum(thread_stats("conns")), $conns + 11, "connections counted after migration");
+
+# the migrated connections work
+my $found = 0;
+for (my $i = 0; $i < 10; $i++) {
+    my $s = $socks[$i];
+    print $s "get key$i\r\n";
+}
+for (my $i = 0; $i < 10; $i++) {
+    my $s = $socks[$i];
+    my $line = scalar <$s>;
+    $found++ if ($line eq "VALUE key$i 0 " . length($i) . "\r\n" &&
+                 scalar <$s> eq "$i\r\n" && scalar <$s> eq "END\r\n");
+}
+is($found, 10, "get on each connection");
+close($_) for (@socks);
+close($busy);
+mem_get_is($sock, "key9", "9");
+
+# after test
+release_memcached($engine, $server);
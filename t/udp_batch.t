@@ -0,0 +1,99 @@
+#!/usr/bin/perl
+
+# UDP requests are received in batches by recvmmsg() and the datagrams of
+# a response are sent together by sendmmsg(). With -W, each worker thread
+# reads on its own SO_REUSEPORT UDP socket.
+
+use strict;
+use Test::More tests => 12;
+use FindBin qw($Bin);
+use lib "$Bin/lib";
+use MemcachedTest;
+
+my $engine = shift;
+my $server = get_memcached($engine, "-W -t 2 -Y 16");
+my $sock = $server->sock;
+
+# the datagrams of the responses, keyed by the request id and sequence number
+sub recv_udp_responses {
+    my ($usock, $count) = @_;
+    my %res;
+    my $got = 0;
+    while ($got < $count) {
+        my $rin = '';
+        vec($rin, fileno($usock), 1) = 1;
+        last unless (select(my $rout = $rin, undef, undef, 2));
+        my $dgram;
+        $usock->recv($dgram, 1500, 0);
+        my ($reqid, $seq, $numpkts) = unpack("nnn", substr($dgram, 0, 8));
+        $res{$reqid}{$seq} = substr($dgram, 8);
+        $got++;
+    }
+    return \%res;
+}
+
+sub udp_message {
+    my ($dgrams) = @_;
+    return join("", map { $dgrams->{$_} } sort { $a <=> $b } keys %$dgrams);
+}
+
+my $settings = mem_stats($sock, "settings");
+is($settings->{"udp_batch"}, 16, "udp_batch setting");
+is($settings->{"worker_listen"}, "yes", "worker_listen setting");
+
+my $value = "x" x 100;
+print $sock join("", map { "set key$_ 0 0 100\r\n$value\r\n" } (0 .. 99));
+my $stored = 0;
+for (0 .. 99) {
+    $stored++ if (scalar <$sock> eq "STORED\r\n");
+}
+is($stored, 100, "items stored");
+
+# a burst of requests received in batches
+my $usock = $server->new_udp_sock or die "Can't bind : $@\n";
+for my $i (0 .. 99) {
+    send($usock, pack("nnnn", $i, 0, 1, 0) . "get key$i\r\n", 0);
+}
+my $res = recv_udp_responses($usock, 100);
+my $ok = grep { udp_message($res->{$_}) eq "VALUE key$_ 0 100\r\n$value\r\nEND\r\n" } (0 .. 99);
+is($ok, 100, "responses of the burst of requests");
+
+# a response of many datagrams sent together
+my $large = join("", map { chr(65 + $_ % 26) } (0 .. 19999));
+mem_cmd_is($sock, "set large 0 0 20000", $large, "STORED");
+send($usock, pack("nnnn", 1000, 0, 1, 0) . "get large\r\n", 0);
+my $numpkts = int((length("VALUE large 0 20000\r\n$large\r\nEND\r\n") + 1399) / 1400);
+$res = recv_udp_responses($usock, $numpkts);
+is(scalar(keys %{$res->{1000}}), $numpkts, "datagrams of the large response");
+is(udp_message($res->{1000}), "VALUE large 0 20000\r\n$large\r\nEND\r\n", "large response");
+
+# the clients spread over the UDP sockets of the worker threads
+my @usocks = map { $server->new_udp_sock } (1 .. 8);
+for my $i (0 .. 7) {
+    send($usocks[$i], pack("nnnn", $i, 0, 1, 0) . "get key$i\r\n", 0);
+}
+$ok = 0;
+for my $i (0 .. 7) {
+    $res = recv_udp_responses($usocks[$i], 1);
+    $ok++ if (udp_message($res->{$i}) eq "VALUE key$i 0 100\r\n$value\r\nEND\r\n");
+}
+is($ok, 8, "responses to each client");
+
+# the requests of the burst are served with the TCP requests
+send($usock, pack("nnnn", 2000, 0, 1, 0) . "get key1\r\n", 0);
+mem_get_is($sock, "key2", $value);
+$res = recv_udp_responses($usock, 1);
+is(udp_message($res->{2000}), "VALUE key1 0 100\r\n$value\r\nEND\r\n", "response after the TCP request");
+
+# a request larger than a datagram of the batch is dropped
+my $mid = "m" x 5000;
+my $big = "b" x 9000;
+send($usock, pack("nnnn", 3000, 0, 1, 0) . "set mid 0 0 5000\r\n$mid\r\n", 0);
+$res = recv_udp_responses($usock, 1);
+is(udp_message($res->{3000}), "STORED\r\n", "request up to 8KB");
+send($usock, pack("nnnn", 3001, 0, 1, 0) . "set big 0 0 9000\r\n$big\r\n", 0);
+recv_udp_responses($usock, 1);
+mem_get_is($sock, "big", undef, "request over 8KB dropped");
+
+# after test
+release_memcached($engine, $server);
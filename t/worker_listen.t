@@ -0,0 +1,65 @@
+#!/usr/bin/perl
+
+# Accept the connections on the SO_REUSEPORT listening sockets of
+# the worker threads, and limit them by maxconns.
+
+use strict;
+use Test::More tests => 9;
+use FindBin qw($Bin);
+use lib "$Bin/lib";
+use MemcachedTest;
+
+my $engine = shift;
+my $server = get_memcached($engine, "-W -t 4");
+my $sock = $server->sock;
+
+is(mem_stats($sock, "settings")->{"worker_listen"}, "yes", "worker threads listen");
+my $conns = mem_stats($sock)->{"curr_connections"};
+
+# the connections accepted by the worker threads
+my @socks = map { $server->new_sock } (1 .. 16);
+is(scalar(grep { defined } @socks), 16, "connections accepted");
+my $stored = 0;
+for (my $i = 0; $i < 16; $i++) {
+    my $s = $socks[$i];
+    print $s "set key$i 0 0 " . length($i) . "\r\n$i\r\n";
+}
+for (my $i = 0; $i < 16; $i++) {
+    my $s = $socks[$i];
+    $stored++ if (scalar <$s> eq "STORED\r\n");
+}
+is($stored, 16, "set on each connection");
+mem_get_is($socks[15], "key0", "0");
+mem_get_is($socks[0], "key15", "15");
+is(mem_stats($sock)->{"curr_connections"}, $conns + 16, "connections counted");
+close($_) for (@socks);
+my $curr;
+for (my $wait = 0; $wait < 50; $wait++) {
+    $curr = mem_stats($sock)->{"curr_connections"};
+    last if ($curr == $conns);
+    select(undef, undef, undef, 0.1);
+}
+is($curr, $conns, "closed connections are released");
+release_memcached($engine, $server);
+
+# maxconns with the admin connections of the local host
+my $maxconns = 20;
+my $admin_conns = 10;
+$server = get_memcached($engine, "-W -t 4 -c $maxconns");
+$sock = $server->sock;
+$conns = mem_stats($sock)->{"curr_connections"};
+my $accepted = 0;
+@socks = ();
+for (1 .. $maxconns + $admin_conns + 10) {
+    my $s = $server->new_sock;
+    next unless defined($s);
+    push(@socks, $s);
+    print $s "version\r\n";
+    my $line = scalar <$s>;
+    $accepted++ if (defined($line) && $line =~ /^VERSION/);
+}
+is($accepted, $maxconns + $admin_conns - $conns, "connections limited by maxconns");
+is(mem_stats($sock)->{"reject_connections"}, 10 + $conns, "connections rejected");
+
+# after test
+release_memcached($engine, $server);
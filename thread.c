@@ -33,6 +33,11 @@
 
 #define ITEMS_PER_ALLOC 64
 
+/* connection migration (DISPATCH_MIGRATE) */
+#define MIGRATE_BUSY_GAP   100 /* busy time gap (permille) to migrate connections */
+#define MIGRATE_MAX_CONNS  4   /* max connections migrated at once */
+#define MIGRATE_IDLE_TIME  2   /* min idle time (seconds) of the migrated connections */
+
 extern volatile sig_atomic_t memcached_shutdown;
 
 /* An item in the connection queue. */
@@ -43,6 +48,8 @@ struct conn_queue_item {
     int               event_flags;
     int               read_buffer_size;
     enum network_transport     transport;
+    conn             *c;          /* the connection migrated to the thread */
+    int               migrate_to; /* migrate idle connections to this thread */
     CQ_ITEM          *next;
 };
 
@@ -287,7 +294,9 @@ static void *worker_libevent(void *arg) {
     }
     item = cq_pop(me->new_conn_queue);
     while (item != NULL) {
-        close(item->sfd);
+        if (item->c != NULL || item->migrate_to < 0) {
+            close(item->sfd);
+        }
         cqi_free(item);
         item = cq_pop(me->new_conn_queue);
     }
@@ -306,6 +315,148 @@ int number_of_pending(conn *c, conn *list) {
     return rv;
 }
 
+/*
+ * Sets up a new connection handled by the given thread.
+ */
+static void thread_conn_new(LIBEVENT_THREAD *me, int sfd, STATE_FUNC init_state,
+                            int event_flags, int read_buffer_size,
+                            enum network_transport transport) {
+    conn *c = conn_new(sfd, init_state, event_flags,
+                       read_buffer_size, transport, me->base, NULL);
+    if (c == NULL) {
+        if (IS_UDP(transport)) {
+            mc_logger->log(EXTENSION_LOG_WARNING, NULL,
+                    "Can't listen for events on UDP socket\n");
+            exit(1);
+        } else if (init_state == conn_listening) {
+            mc_logger->log(EXTENSION_LOG_WARNING, NULL,
+                    "Can't listen for events on TCP socket\n");
+            exit(1);
+        } else {
+            if (settings.verbose > 0) {
+                mc_logger->log(EXTENSION_LOG_INFO, NULL,
+                        "Can't listen for events on fd %d\n", sfd);
+            }
+            close(sfd);
+        }
+        __sync_fetch_and_sub(&me->load_conns, 1);
+    } else {
+        assert(c->thread == NULL);
+        c->thread = me;
+        /* link to the conn_list of the thread */
+        if (me->conn_list != NULL) {
+            c->conn_next = me->conn_list;
+            me->conn_list->conn_prev = c;
+        }
+        me->conn_list = c;
+#ifdef ENABLE_IO_URING
+        if (me->uring != NULL && !IS_UDP(transport) && init_state != conn_listening) {
+            if (!uring_conn_attach(me->uring, c) && settings.verbose > 0) {
+                mc_logger->log(EXTENSION_LOG_INFO, NULL,
+                        "Can't attach fd %d to io_uring\n", sfd);
+            }
+        }
+#endif
+    }
+}
+
+extern volatile rel_time_t current_time;
+
+/*
+ * Checks if the connection has waited for its next command without any data
+ * for a while. Such a connection does not refer to the resources of its thread,
+ * so that it can be migrated to another thread.
+ */
+static bool thread_conn_is_idle(conn *c) {
+    return c->state == conn_read && !IS_UDP(c->transport) &&
+           current_time - c->last_cmd_time >= MIGRATE_IDLE_TIME &&
+           c->rbytes == 0 && c->ileft == 0 && c->suffixleft == 0 && c->coal_bytes == 0 &&
+           c->coll_strkeys == NULL && !c->io_pending &&
+           !c->io_blocked && !c->ewouldblock
+#ifdef ENABLE_IO_URING
+           && !c->uring.active
+#endif
+           ;
+}
+
+static void thread_notify(LIBEVENT_THREAD *thread) {
+    if (write(thread->notify_send_fd, "", 1) != 1) {
+        mc_logger->log(EXTENSION_LOG_WARNING, NULL,
+                "Writing to thread notify pipe: %s", strerror(errno));
+    }
+}
+
+/*
+ * Migrates at most count idle connections of the thread to another thread.
+ */
+static void thread_conn_migrate(LIBEVENT_THREAD *me, int tid, int count) {
+    LIBEVENT_THREAD *to = threads + tid;
+    conn *c = me->conn_list;
+
+    while (c != NULL && count > 0) {
+        conn *next = c->conn_next;
+        bool idle;
+        pthread_mutex_lock(&me->mutex); /* io_pending is set by other threads */
+        idle = thread_conn_is_idle(c);
+        pthread_mutex_unlock(&me->mutex);
+        if (idle) {
+            CQ_ITEM *item = cqi_new();
+            if (item == NULL) {
+                break;
+            }
+            event_del(&c->event);
+            /* disconnect it from the conn_list of this thread */
+            if (c->conn_prev != NULL) {
+                c->conn_prev->conn_next = c->conn_next;
+            } else {
+                me->conn_list = c->conn_next;
+            }
+            if (c->conn_next != NULL) {
+                c->conn_next->conn_prev = c->conn_prev;
+            }
+            c->conn_prev = c->conn_next = NULL;
+            c->thread = NULL;
+            __sync_fetch_and_sub(&me->load_conns, 1);
+            __sync_fetch_and_add(&to->load_conns, 1);
+            me->migrated_out++;
+
+            item->sfd = c->sfd;
+            item->c = c;
+            item->migrate_to = -1;
+            cq_push(to->new_conn_queue, item);
+            thread_notify(to);
+            count--;
+        }
+        c = next;
+    }
+}
+
+/*
+ * Takes over the idle connection migrated from another thread.
+ */
+static void thread_conn_adopt(LIBEVENT_THREAD *me, conn *c) {
+    assert(c->thread == NULL);
+    c->thread = me;
+    if (me->conn_list != NULL) {
+        c->conn_next = me->conn_list;
+        me->conn_list->conn_prev = c;
+    }
+    me->conn_list = c;
+    me->migrated_in++;
+
+    event_set(&c->event, c->sfd, c->ev_flags, event_handler, (void *)c);
+    event_base_set(me->base, &c->event);
+    if (event_add(&c->event, 0) == -1) {
+        mc_logger->log(EXTENSION_LOG_WARNING, c,
+                "Failed to add the migrated connection to libevent: %s\n",
+                strerror(errno));
+        conn_set_state(c, conn_closing);
+        while (c->state(c)) {
+            /* close it */
+        }
+    }
+}
+
 /*
  * Processes an incoming "handle a new connection" item. This is called when
  * input arrives on the libevent wakeup pipe.
@@ -336,29 +487,13 @@ static void thread_libevent_process(int fd, short which, void *arg) {
     item = cq_pop(me->new_conn_queue);
 
     if (NULL != item) {
-        conn *c = conn_new(item->sfd, item->init_state, item->event_flags,
-                           item->read_buffer_size, item->transport, me->base, NULL);
-        if (c == NULL) {
-            if (IS_UDP(item->transport)) {
-                mc_logger->log(EXTENSION_LOG_WARNING, NULL,
-                        "Can't listen for events on UDP socket\n");
-                exit(1);
-            } else {
-                if (settings.verbose > 0) {
-                    mc_logger->log(EXTENSION_LOG_INFO, NULL,
-                            "Can't listen for events on fd %d\n", item->sfd);
-                }
-                close(item->sfd);
-            }
+        if (item->c != NULL) {
+            thread_conn_adopt(me, item->c);
+        } else if (item->migrate_to >= 0) {
+            thread_conn_migrate(me, item->migrate_to, item->sfd);
         } else {
-            assert(c->thread == NULL);
-            c->thread = me;
-            /* link to the conn_list of the thread */
-            if (me->conn_list != NULL) {
-                c->conn_next = me->conn_list;
-                me->conn_list->conn_prev = c;
-            }
-            me->conn_list = c;
+            thread_conn_new(me, item->sfd, item->init_state, item->event_flags,
+                            item->read_buffer_size, item->transport);
         }
         cqi_free(item);
     }
@@ -372,17 +507,29 @@ static void thread_libevent_process(int fd, short which, void *arg) {
         assert(me == c->thread);
         pending = pending->next;
         c->next = NULL;
+        c->io_pending = false;
+#ifdef ENABLE_IO_URING
+        if (c->uring.active) {
+            c->uring.parked = false;
+        } else {
+            event_add(&c->event, 0);
+        }
+#else
         event_add(&c->event, 0);
+#endif
 
         c->nevents = settings.reqs_per_event;
         while (c->state(c)) {
             /* do task */
         }
     }
+#ifdef ENABLE_IO_URING
+    if (me->uring != NULL) {
+        uring_thread_submit(me->uring);
+    }
+#endif
 }
 
-extern volatile rel_time_t current_time;
-
 bool has_cycle(conn *c) {
     if (!c) {
         return false;
@@ -469,6 +616,7 @@ void notify_io_complete(const void *cookie, ENGINE_ERROR_CODE status)
             notify = 1;
         }
         conn->next = thr->pending_io;
+        conn->io_pending = true;
         thr->pending_io = conn;
     }
     assert(number_of_pending(conn, thr->pending_io) == 1);
@@ -490,10 +638,47 @@ static int last_thread = -1;
  * from the main thread, either during initialization (for UDP) or because
  * of an incoming connection.
  */
+/*
+ * Selects the least loaded thread for a new connection.
+ * The load of a thread is the sum of its share of the connections,
+ * its share of the requests per second, and its busy time, all in permille.
+ * Ties are broken in turn from the thread after last_thread.
+ */
+static int select_least_loaded_thread(void) {
+    uint64_t total_conns = 0, total_rate = 0;
+    uint64_t load, min_load = UINT64_MAX;
+    int tid, min_tid = 0;
+
+    for (tid = 0; tid < nthreads; tid++) {
+        total_conns += threads[tid].load_conns;
+        total_rate += threads[tid].req_rate;
+    }
+    for (int i = 1; i <= nthreads; i++) {
+        LIBEVENT_THREAD *t;
+        tid = (last_thread + i) % nthreads;
+        t = threads + tid;
+        load = t->busy_permille;
+        if (total_conns > 0) load += (uint64_t)t->load_conns * 1000 / total_conns;
+        if (total_rate > 0) load += (uint64_t)t->req_rate * 1000 / total_rate;
+        if (load < min_load) {
+            min_load = load;
+            min_tid = tid;
+        }
+    }
+    return min_tid;
+}
+
 void dispatch_conn_new(int sfd, STATE_FUNC init_state, int event_flags,
                        int read_buffer_size, enum network_transport transport) {
     CQ_ITEM *item = cqi_new();
-    int tid = (last_thread + 1) % settings.num_threads;
+    int tid;
+
+    /* UDP and listening connections are given to all threads in turn. */
+    if (settings.dispatch != DISPATCH_ROUNDROBIN && init_state == conn_new_cmd) {
+        tid = select_least_loaded_thread();
+    } else {
+        tid = (last_thread + 1) % settings.num_threads;
+    }
 
     LIBEVENT_THREAD *thread = threads + tid;
 
@@ -504,14 +689,227 @@ void dispatch_conn_new(int sfd, STATE_FUNC init_state, int event_flags,
     item->event_flags = event_flags;
     item->read_buffer_size = read_buffer_size;
     item->transport = transport;
+    item->c = NULL;
+    item->migrate_to = -1;
 
+    __sync_fetch_and_add(&thread->load_conns, 1);
     cq_push(thread->new_conn_queue, item);
 
     MEMCACHED_CONN_DISPATCH(sfd, (uintptr_t)thread->thread_id);
-    if (write(thread->notify_send_fd, "", 1) != 1) {
-        mc_logger->log(EXTENSION_LOG_WARNING, NULL,
-                "Writing to thread notify pipe: %s", strerror(errno));
+    thread_notify(thread);
+}
+
+/*
+ * Sets up a new connection accepted by a worker thread on its own
+ * listening socket. The connection is handled by the worker thread
+ * without the handoff through the connection queue.
+ */
+void accept_conn_new(conn *listen_c, int sfd, STATE_FUNC init_state, int event_flags,
+                     int read_buffer_size, enum network_transport transport) {
+    LIBEVENT_THREAD *me = listen_c->thread;
+
+    assert(me != NULL);
+    MEMCACHED_CONN_DISPATCH(sfd, (uintptr_t)me->thread_id);
+    __sync_fetch_and_add(&me->load_conns, 1);
+    thread_conn_new(me, sfd, init_state, event_flags, read_buffer_size, transport);
+#ifdef ENABLE_IO_URING
+    if (me->uring != NULL) {
+        /* the listening connection is driven by libevent */
+        uring_thread_submit(me->uring);
+    }
+#endif
+}
+
+/*
+ * Samples the load of the worker threads. This is called from the main thread
+ * about every second. With DISPATCH_MIGRATE, some idle connections of the
+ * busiest thread are migrated to the least busy one if their busy time differs
+ * by MIGRATE_BUSY_GAP or more, so that they do not wait for the busy
+ * connections of the thread when they become active.
+ */
+void threads_load_update(void) {
+    static struct timeval last = {0, 0};
+    struct timeval now;
+    uint64_t elapsed;
+    int max_tid = 0, min_tid = 0;
+
+    gettimeofday(&now, NULL);
+    elapsed = (now.tv_sec - last.tv_sec) * 1000000 + (now.tv_usec - last.tv_usec);
+    if (last.tv_sec == 0 || elapsed == 0) {
+        elapsed = 1000000;
+    }
+    last = now;
+
+    for (int i = 0; i < nthreads; i++) {
+        LIBEVENT_THREAD *t = threads + i;
+        uint64_t reqs = __sync_fetch_and_add(&t->load_reqs, 0);
+        uint64_t busy = __sync_fetch_and_add(&t->load_busy_usec, 0);
+        t->req_rate = (uint32_t)((reqs - t->last_reqs) * 1000000 / elapsed);
+        t->busy_permille = (uint32_t)((busy - t->last_busy_usec) * 1000 / elapsed);
+        if (t->busy_permille > 1000) {
+            t->busy_permille = 1000;
+        }
+        t->last_reqs = reqs;
+        t->last_busy_usec = busy;
+
+        if (t->busy_permille > threads[max_tid].busy_permille) max_tid = i;
+        if (t->busy_permille < threads[min_tid].busy_permille) min_tid = i;
+    }
+
+    if (settings.dispatch == DISPATCH_MIGRATE && max_tid != min_tid &&
+        threads[max_tid].busy_permille - threads[min_tid].busy_permille >= MIGRATE_BUSY_GAP &&
+        threads[max_tid].load_conns > 1) {
+        CQ_ITEM *item = cqi_new();
+        if (item != NULL) {
+            item->sfd = MIGRATE_MAX_CONNS;
+            item->c = NULL;
+            item->migrate_to = min_tid;
+            cq_push(threads[max_tid].new_conn_queue, item);
+            thread_notify(threads + max_tid);
+        }
+    }
+}
+
+const char *dispatch_policy_text(enum dispatch_policy policy) {
+    switch (policy) {
+    case DISPATCH_ROUNDROBIN: return "roundrobin";
+    case DISPATCH_LOAD:       return "load";
+    case DISPATCH_MIGRATE:    return "migrate";
+    }
+    return "unknown";
+}
+
+/******************************* HEAVY THREADS *******************************/
+
+/*
+ * The heavy collection commands (bop smget of many keys, sop get of many
+ * elements) are executed on a separate pool of threads, so that the worker
+ * thread keeps serving the other connections meanwhile. The command is
+ * queued after the connection is parked like an EWOULDBLOCK command, so the
+ * heavy thread has the connection to itself: it executes the command in
+ * bounded engine calls and builds the response. The connection goes back to
+ * its worker thread through notify_io_complete() in the conn_heavy_complete
+ * state, which resumes the state set by the response.
+ */
+static struct {
+    pthread_mutex_t lock;
+    pthread_cond_t  cond;
+    conn           *head;
+    conn           *tail;
+    int             queued;    /* commands waiting for a heavy thread */
+    uint64_t        offloaded; /* commands executed by the heavy threads */
+    bool            shutdown;
+    int             nthreads;
+    pthread_t      *thread_ids;
+} heavy;
+
+static void *heavy_worker(void *arg) {
+    pthread_mutex_lock(&heavy.lock);
+    while (!heavy.shutdown) {
+        conn *c = heavy.head;
+        if (c == NULL) {
+            pthread_cond_wait(&heavy.cond, &heavy.lock);
+            continue;
+        }
+        heavy.head = c->heavy.next;
+        if (heavy.head == NULL) {
+            heavy.tail = NULL;
+        }
+        heavy.queued--;
+        pthread_mutex_unlock(&heavy.lock);
+
+        c->heavy.next = NULL;
+        c->heavy.execute(c);
+        c->heavy.state = c->state;
+        conn_set_state(c, conn_heavy_complete);
+        notify_io_complete(c, ENGINE_SUCCESS);
+
+        pthread_mutex_lock(&heavy.lock);
+        heavy.offloaded++;
+    }
+    pthread_mutex_unlock(&heavy.lock);
+    return NULL;
+}
+
+void heavy_threads_init(int nthreads) {
+    pthread_mutex_init(&heavy.lock, NULL);
+    pthread_cond_init(&heavy.cond, NULL);
+    if (nthreads <= 0) {
+        return;
+    }
+    heavy.thread_ids = calloc(nthreads, sizeof(pthread_t));
+    if (heavy.thread_ids == NULL) {
+        perror("Can't allocate heavy thread descriptors");
+        exit(1);
+    }
+    for (int i = 0; i < nthreads; i++) {
+        create_worker(heavy_worker, NULL, &heavy.thread_ids[i]);
+    }
+    heavy.nthreads = nthreads;
+}
+
+/*
+ * Queues the command of the connection to the heavy threads.
+ * The caller has set c->heavy.execute and c->heavy.complete, and parked
+ * the connection.
+ */
+void heavy_cmd_dispatch(conn *c) {
+    assert(heavy.nthreads > 0);
+    c->heavy.next = NULL;
+    pthread_mutex_lock(&heavy.lock);
+    if (heavy.tail == NULL) {
+        heavy.head = c;
+    } else {
+        heavy.tail->heavy.next = c;
+    }
+    heavy.tail = c;
+    heavy.queued++;
+    pthread_cond_signal(&heavy.cond);
+    pthread_mutex_unlock(&heavy.lock);
+}
+
+static void heavy_threads_shutdown(void) {
+    pthread_mutex_lock(&heavy.lock);
+    heavy.shutdown = true;
+    pthread_cond_broadcast(&heavy.cond);
+    pthread_mutex_unlock(&heavy.lock);
+    for (int i = 0; i < heavy.nthreads; i++) {
+        pthread_join(heavy.thread_ids[i], NULL);
     }
+    free(heavy.thread_ids);
+    heavy.thread_ids = NULL;
+    heavy.nthreads = 0;
+}
+
+/*
+ * Stats of the load of the worker threads ("stats threads").
+ */
+void threads_load_stats(ADD_STAT add_stats, conn *c) {
+    char key_str[STAT_KEY_LEN];
+    char val_str[STAT_VAL_LEN];
+    int klen, vlen;
+
+    APPEND_STAT("dispatch", "%s", dispatch_policy_text(settings.dispatch));
+    for (int i = 0; i < nthreads; i++) {
+        LIBEVENT_THREAD *t = threads + i;
+        APPEND_NUM_FMT_STAT("thread%d:%s", i, "conns", "%d", t->load_conns);
+        APPEND_NUM_FMT_STAT("thread%d:%s", i, "requests", "%"PRIu64,
+                            __sync_fetch_and_add(&t->load_reqs, 0));
+        APPEND_NUM_FMT_STAT("thread%d:%s", i, "req_rate", "%u", t->req_rate);
+        APPEND_NUM_FMT_STAT("thread%d:%s", i, "busy_permille", "%u", t->busy_permille);
+        APPEND_NUM_FMT_STAT("thread%d:%s", i, "migrated_in", "%"PRIu64, t->migrated_in);
+        APPEND_NUM_FMT_STAT("thread%d:%s", i, "migrated_out", "%"PRIu64, t->migrated_out);
+        APPEND_NUM_FMT_STAT("thread%d:%s", i, "bufs_pooled", "%d", t->bufs_pooled);
+        APPEND_NUM_FMT_STAT("thread%d:%s", i, "bufs_borrowed", "%"PRIu64, t->bufs_borrowed);
+    }
+
+    pthread_mutex_lock(&heavy.lock);
+    int heavy_queued = heavy.queued;
+    uint64_t heavy_offloaded = heavy.offloaded;
+    pthread_mutex_unlock(&heavy.lock);
+    APPEND_STAT("heavy_threads", "%d", heavy.nthreads);
+    APPEND_STAT("heavy_queued", "%d", heavy_queued);
+    APPEND_STAT("heavy_offloaded", "%"PRIu64, heavy_offloaded);
 }
 
 /*
@@ -555,6 +953,7 @@ void threadlocal_stats_clear(struct thread_stats *stats) {
     stats->cmd_flush = 0;
     stats->cmd_flush_prefix = 0;
     stats->conn_yields = 0;
+    stats->coalesced_responses = 0;
     stats->auth_cmds = 0;
     stats->auth_errors = 0;
     stats->cmd_lop_create = 0;
@@ -571,6 +970,8 @@ void threadlocal_stats_clear(struct thread_stats *stats) {
     stats->cmd_mop_update = 0;
     stats->cmd_mop_delete = 0;
     stats->cmd_mop_get = 0;
+    stats->cmd_mop_incr = 0;
+    stats->cmd_mop_decr = 0;
     stats->cmd_bop_create = 0;
     stats->cmd_bop_insert = 0;
     stats->cmd_bop_update = 0;
@@ -622,6 +1023,12 @@ void threadlocal_stats_clear(struct thread_stats *stats) {
     stats->mop_get_elem_hits = 0;
     stats->mop_get_none_hits = 0;
     stats->mop_get_misses = 0;
+    stats->mop_incr_elem_hits = 0;
+    stats->mop_incr_none_hits = 0;
+    stats->mop_incr_misses = 0;
+    stats->mop_decr_elem_hits = 0;
+    stats->mop_decr_none_hits = 0;
+    stats->mop_decr_misses = 0;
     stats->bop_create_oks = 0;
     stats->bop_insert_hits = 0;
     stats->bop_insert_misses = 0;
@@ -695,6 +1102,7 @@ void threadlocal_stats_aggregate(struct thread_stats *thread_stats, struct threa
         stats->cmd_flush += thread_stats[ii].cmd_flush;
         stats->cmd_flush_prefix += thread_stats[ii].cmd_flush_prefix;
         stats->conn_yields += thread_stats[ii].conn_yields;
+        stats->coalesced_responses += thread_stats[ii].coalesced_responses;
         stats->auth_cmds += thread_stats[ii].auth_cmds;
         stats->auth_errors += thread_stats[ii].auth_errors;
         stats->cmd_lop_create += thread_stats[ii].cmd_lop_create;
@@ -711,6 +1119,8 @@ void threadlocal_stats_aggregate(struct thread_stats *thread_stats, struct threa
         stats->cmd_mop_update += thread_stats[ii].cmd_mop_update;
         stats->cmd_mop_delete += thread_stats[ii].cmd_mop_delete;
         stats->cmd_mop_get += thread_stats[ii].cmd_mop_get;
+        stats->cmd_mop_incr += thread_stats[ii].cmd_mop_incr;
+        stats->cmd_mop_decr += thread_stats[ii].cmd_mop_decr;
         stats->cmd_bop_create += thread_stats[ii].cmd_bop_create;
         stats->cmd_bop_insert += thread_stats[ii].cmd_bop_insert;
         stats->cmd_bop_update += thread_stats[ii].cmd_bop_update;
@@ -762,6 +1172,12 @@ void threadlocal_stats_aggregate(struct thread_stats *thread_stats, struct threa
         stats->mop_get_elem_hits += thread_stats[ii].mop_get_elem_hits;
         stats->mop_get_none_hits += thread_stats[ii].mop_get_none_hits;
         stats->mop_get_misses += thread_stats[ii].mop_get_misses;
+        stats->mop_incr_elem_hits += thread_stats[ii].mop_incr_elem_hits;
+        stats->mop_incr_none_hits += thread_stats[ii].mop_incr_none_hits;
+        stats->mop_incr_misses += thread_stats[ii].mop_incr_misses;
+        stats->mop_decr_elem_hits += thread_stats[ii].mop_decr_elem_hits;
+        stats->mop_decr_none_hits += thread_stats[ii].mop_decr_none_hits;
+        stats->mop_decr_misses += thread_stats[ii].mop_decr_misses;
         stats->bop_create_oks += thread_stats[ii].bop_create_oks;
         stats->bop_insert_hits += thread_stats[ii].bop_insert_hits;
         stats->bop_insert_misses += thread_stats[ii].bop_insert_misses;
@@ -914,6 +1330,28 @@ void thread_init(int nthr, struct event_base *main_base) {
 #endif
     }
 
+#ifdef ENABLE_IO_URING
+    /* The network backend is decided once for all worker threads
+     * before they are started. If the io_uring of any thread cannot be
+     * set up, all the threads use libevent.
+     */
+    if (settings.io_uring) {
+        for (i = 0; i < nthreads; i++) {
+            threads[i].uring = uring_thread_init(threads[i].base);
+            if (threads[i].uring == NULL) break;
+        }
+        if (i < nthreads) {
+            mc_logger->log(EXTENSION_LOG_WARNING, NULL,
+                           "Failed to use io_uring. Use libevent instead.\n");
+            while (--i >= 0) {
+                uring_thread_final(threads[i].uring);
+                threads[i].uring = NULL;
+            }
+            settings.io_uring = false;
+        }
+    }
+#endif
+
     /* Create threads after we've done all the libevent setup. */
     for (i = 0; i < nthreads; i++) {
         create_worker(worker_libevent, &threads[i], &thread_ids[i]);
@@ -930,6 +1368,7 @@ void thread_init(int nthr, struct event_base *main_base) {
 
 void threads_shutdown(void)
 {
+    heavy_threads_shutdown();
     for (int ii = 0; ii < nthreads; ++ii) {
         if (write(threads[ii].notify_send_fd, "", 1) < 0) {
             perror("write failure shutting down.");
@@ -939,5 +1378,10 @@ void threads_shutdown(void)
     for (int ii = 0; ii < nthreads; ++ii) {
         close(threads[ii].notify_send_fd);
         close(threads[ii].notify_receive_fd);
+#ifdef ENABLE_IO_URING
+        if (threads[ii].uring != NULL) {
+            uring_thread_final(threads[ii].uring);
+        }
+#endif
     }
 }
@@ -38,7 +38,9 @@
 #define TK_MOPS(C)  C(mop_create_oks) C(mop_insert_hits) C(mop_insert_misses) \
                     C(mop_update_elem_hits) C(mop_update_none_hits) C(mop_update_misses) \
                     C(mop_delete_elem_hits) C(mop_delete_none_hits) C(mop_delete_misses) \
-                    C(mop_get_elem_hits) C(mop_get_none_hits) C(mop_get_misses)
+                    C(mop_get_elem_hits) C(mop_get_none_hits) C(mop_get_misses) \
+                    C(mop_incr_elem_hits) C(mop_incr_none_hits) C(mop_incr_misses) \
+                    C(mop_decr_elem_hits) C(mop_decr_none_hits) C(mop_decr_misses)
 #define TK_BOPS(C)  C(bop_create_oks) C(bop_insert_hits) C(bop_insert_misses) \
                     C(bop_update_elem_hits) C(bop_update_none_hits) C(bop_update_misses) \
                     C(bop_delete_elem_hits) C(bop_delete_none_hits) C(bop_delete_misses) \
@@ -0,0 +1,727 @@
+/* -*- Mode: C; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ * arcus-memcached - Arcus memory cache server
+ * Copyright 2010-2014 NAVER Corp.
+ * Copyright 2014-2015 JaM2in Co., Ltd.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+/*
+ * io_uring network backend of worker threads. See uring.h.
+ */
+#include "config.h"
+#include "memcached.h"
+#include <assert.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/eventfd.h>
+#include <linux/io_uring.h>
+
+#define URING_ENTRIES      256   /* submission queue entries */
+#define URING_RECV_BGID    0     /* buffer group of the provided buffers */
+#define URING_RECV_BUFS    256   /* number of provided buffers (power of 2) */
+#define URING_RECV_BUFSIZE 4096  /* size of a provided buffer */
+/* Stop receiving while the connection has this much data not read yet. */
+#define URING_RECV_LIMIT   (4 * 1024 * 1024)
+
+/* The request type is kept in the low bits of user_data,
+ * and the rest is the connection pointer.
+ */
+#define URING_REQ_CANCEL   0
+#define URING_REQ_RECV     1
+#define URING_REQ_SEND     2
+#define URING_REQ_WAKE     3
+#define URING_REQ_MASK     3
+
+struct uring_thread {
+    int ring_fd;
+    int event_fd;
+    struct event event;   /* the completion event on event_fd */
+    /* submission queue */
+    unsigned *sq_head;
+    unsigned *sq_tail;
+    unsigned *sq_array;
+    unsigned  sq_mask;
+    unsigned  sq_entries;
+    unsigned  sq_local;   /* the tail including the queued entries */
+    unsigned  sq_queued;  /* the entries not submitted yet */
+    struct io_uring_sqe *sqes;
+    /* completion queue */
+    unsigned *cq_head;
+    unsigned *cq_tail;
+    unsigned  cq_mask;
+    struct io_uring_cqe *cqes;
+    /* provided buffers */
+    struct io_uring_buf_ring *br;
+    char     *bufs;
+    uint16_t  br_tail;
+    /* mapped memory */
+    void     *sq_ptr;
+    size_t    sq_len;
+    void     *cq_ptr;
+    size_t    cq_len;
+    size_t    sqes_len;
+    size_t    br_len;
+};
+
+static int sys_uring_setup(unsigned entries, struct io_uring_params *p)
+{
+    return (int)syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int sys_uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags)
+{
+    return (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, NULL, 0);
+}
+
+static int sys_uring_register(int fd, unsigned opcode, void *arg, unsigned nr_args)
+{
+    return (int)syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+/*
+ * Ring management
+ */
+static void uring_event_handler(const int fd, const short which, void *arg);
+static struct io_uring_sqe *uring_get_sqe(struct uring_thread *ut);
+
+static void uring_unmap(struct uring_thread *ut)
+{
+    if (ut->br != NULL && ut->br != MAP_FAILED) munmap(ut->br, ut->br_len);
+    if (ut->sqes != NULL && ut->sqes != MAP_FAILED) munmap(ut->sqes, ut->sqes_len);
+    if (ut->cq_ptr != NULL && ut->cq_ptr != MAP_FAILED && ut->cq_ptr != ut->sq_ptr)
+        munmap(ut->cq_ptr, ut->cq_len);
+    if (ut->sq_ptr != NULL && ut->sq_ptr != MAP_FAILED) munmap(ut->sq_ptr, ut->sq_len);
+    free(ut->bufs);
+}
+
+static bool uring_map(struct uring_thread *ut, struct io_uring_params *p)
+{
+    ut->sq_len = p->sq_off.array + p->sq_entries * sizeof(unsigned);
+    ut->cq_len = p->cq_off.cqes + p->cq_entries * sizeof(struct io_uring_cqe);
+    if (p->features & IORING_FEAT_SINGLE_MMAP) {
+        if (ut->cq_len > ut->sq_len) ut->sq_len = ut->cq_len;
+        ut->cq_len = ut->sq_len;
+    }
+    ut->sq_ptr = mmap(NULL, ut->sq_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                      ut->ring_fd, IORING_OFF_SQ_RING);
+    if (ut->sq_ptr == MAP_FAILED) return false;
+    if (p->features & IORING_FEAT_SINGLE_MMAP) {
+        ut->cq_ptr = ut->sq_ptr;
+    } else {
+        ut->cq_ptr = mmap(NULL, ut->cq_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                          ut->ring_fd, IORING_OFF_CQ_RING);
+        if (ut->cq_ptr == MAP_FAILED) return false;
+    }
+    ut->sqes_len = p->sq_entries * sizeof(struct io_uring_sqe);
+    ut->sqes = mmap(NULL, ut->sqes_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                    ut->ring_fd, IORING_OFF_SQES);
+    if (ut->sqes == MAP_FAILED) return false;
+
+    ut->sq_head = (unsigned *)((char *)ut->sq_ptr + p->sq_off.head);
+    ut->sq_tail = (unsigned *)((char *)ut->sq_ptr + p->sq_off.tail);
+    ut->sq_array = (unsigned *)((char *)ut->sq_ptr + p->sq_off.array);
+    ut->sq_mask = *(unsigned *)((char *)ut->sq_ptr + p->sq_off.ring_mask);
+    ut->sq_entries = p->sq_entries;
+    ut->sq_local = *ut->sq_tail;
+    ut->cq_head = (unsigned *)((char *)ut->cq_ptr + p->cq_off.head);
+    ut->cq_tail = (unsigned *)((char *)ut->cq_ptr + p->cq_off.tail);
+    ut->cq_mask = *(unsigned *)((char *)ut->cq_ptr + p->cq_off.ring_mask);
+    ut->cqes = (struct io_uring_cqe *)((char *)ut->cq_ptr + p->cq_off.cqes);
+    return true;
+}
+
+static void uring_recycle_buffer(struct uring_thread *ut, uint16_t bid)
+{
+    struct io_uring_buf *buf = &ut->br->bufs[ut->br_tail & (URING_RECV_BUFS - 1)];
+    buf->addr = (uint64_t)(uintptr_t)(ut->bufs + (size_t)bid * URING_RECV_BUFSIZE);
+    buf->len = URING_RECV_BUFSIZE;
+    buf->bid = bid;
+    ut->br_tail++;
+    __atomic_store_n(&ut->br->tail, ut->br_tail, __ATOMIC_RELEASE);
+}
+
+static bool uring_provide_buffers(struct uring_thread *ut)
+{
+    struct io_uring_buf_reg reg;
+
+    ut->br_len = URING_RECV_BUFS * sizeof(struct io_uring_buf);
+    ut->br = mmap(NULL, ut->br_len, PROT_READ | PROT_WRITE,
+                  MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+    if (ut->br == MAP_FAILED) return false;
+    ut->bufs = malloc((size_t)URING_RECV_BUFS * URING_RECV_BUFSIZE);
+    if (ut->bufs == NULL) return false;
+
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = (uint64_t)(uintptr_t)ut->br;
+    reg.ring_entries = URING_RECV_BUFS;
+    reg.bgid = URING_RECV_BGID;
+    if (sys_uring_register(ut->ring_fd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0) {
+        return false;
+    }
+    ut->br_tail = 0;
+    for (uint16_t bid = 0; bid < URING_RECV_BUFS; bid++) {
+        uring_recycle_buffer(ut, bid);
+    }
+    return true;
+}
+
+/*
+ * Kernel feature probe
+ */
+static bool uring_probe_ops(struct uring_thread *ut)
+{
+    static const int ops[] = { IORING_OP_NOP, IORING_OP_SENDMSG,
+                               IORING_OP_ASYNC_CANCEL, IORING_OP_RECV };
+    struct io_uring_probe *probe;
+    size_t size = sizeof(*probe) + 256 * sizeof(struct io_uring_probe_op);
+    bool supported = false;
+    int i;
+
+    if ((probe = calloc(1, size)) == NULL) {
+        return false;
+    }
+    if (sys_uring_register(ut->ring_fd, IORING_REGISTER_PROBE, probe, 256) == 0) {
+        supported = true;
+        for (i = 0; i < sizeof(ops) / sizeof(ops[0]); i++) {
+            if (ops[i] > probe->last_op ||
+                !(probe->ops[ops[i]].flags & IO_URING_OP_SUPPORTED)) {
+                supported = false;
+                break;
+            }
+        }
+    }
+    free(probe);
+    return supported;
+}
+
+static bool uring_probe_wait(struct uring_thread *ut, struct io_uring_cqe *cqe)
+{
+    unsigned head = *ut->cq_head;
+
+    while (head == __atomic_load_n(ut->cq_tail, __ATOMIC_ACQUIRE)) {
+        if (sys_uring_enter(ut->ring_fd, 0, 1, IORING_ENTER_GETEVENTS) < 0 && errno != EINTR) {
+            return false;
+        }
+    }
+    *cqe = ut->cqes[head & ut->cq_mask];
+    __atomic_store_n(ut->cq_head, head + 1, __ATOMIC_RELEASE);
+    return true;
+}
+
+/*
+ * Runs a multishot recv (Linux 6.0) on a socketpair, and cancels it by its
+ * fd (Linux 5.19). The older kernels set up the ring, but fail these
+ * requests of every connection with -EINVAL.
+ */
+static bool uring_probe_recv(struct uring_thread *ut)
+{
+    struct io_uring_sqe *sqe;
+    struct io_uring_cqe cqe;
+    bool recv_ok = false, recv_done = false;
+    bool cancel_ok = false, cancel_done = false;
+    int sv[2];
+
+    if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, sv) < 0) {
+        return false;
+    }
+    if (write(sv[1], "x", 1) == 1 && (sqe = uring_get_sqe(ut)) != NULL) {
+        sqe->opcode = IORING_OP_RECV;
+        sqe->fd = sv[0];
+        sqe->ioprio = IORING_RECV_MULTISHOT;
+        sqe->flags = IOSQE_BUFFER_SELECT;
+        sqe->buf_group = URING_RECV_BGID;
+        sqe->user_data = URING_REQ_RECV;
+        uring_thread_submit(ut);
+
+        while (!recv_done || (recv_ok && !cancel_done)) {
+            if (!uring_probe_wait(ut, &cqe)) {
+                recv_ok = false;
+                break;
+            }
+            if (cqe.user_data == URING_REQ_CANCEL) {
+                cancel_ok = (cqe.res >= 0);
+                cancel_done = true;
+                continue;
+            }
+            if (cqe.res > 0 && (cqe.flags & IORING_CQE_F_BUFFER)) {
+                uring_recycle_buffer(ut, (uint16_t)(cqe.flags >> IORING_CQE_BUFFER_SHIFT));
+            }
+            if (!(cqe.flags & IORING_CQE_F_MORE)) {
+                recv_done = true;
+            } else if (cqe.res > 0 && !recv_ok) {
+                /* the recv stays armed: cancel it */
+                recv_ok = true;
+                if ((sqe = uring_get_sqe(ut)) == NULL) {
+                    recv_ok = false;
+                    break;
+                }
+                sqe->opcode = IORING_OP_ASYNC_CANCEL;
+                sqe->fd = sv[0];
+                sqe->cancel_flags = IORING_ASYNC_CANCEL_FD | IORING_ASYNC_CANCEL_ALL;
+                sqe->user_data = URING_REQ_CANCEL;
+                uring_thread_submit(ut);
+            }
+        }
+    }
+    close(sv[0]);
+    close(sv[1]);
+    return recv_ok && cancel_ok;
+}
+
+struct uring_thread *uring_thread_init(struct event_base *base)
+{
+    struct uring_thread *ut = calloc(1, sizeof(struct uring_thread));
+    struct io_uring_params params;
+
+    if (ut == NULL) {
+        return NULL;
+    }
+    ut->ring_fd = ut->event_fd = -1;
+
+    memset(&params, 0, sizeof(params));
+    params.flags = IORING_SETUP_CQSIZE;
+    params.cq_entries = URING_ENTRIES * 4;
+    ut->ring_fd = sys_uring_setup(URING_ENTRIES, &params);
+    if (ut->ring_fd < 0) {
+        mc_logger->log(EXTENSION_LOG_WARNING, NULL,
+                       "Failed to set up io_uring: %s\n", strerror(errno));
+        goto error;
+    }
+    if (!(params.features & IORING_FEAT_NODROP) || !uring_map(ut, &params)) {
+        mc_logger->log(EXTENSION_LOG_WARNING, NULL,
+                       "Failed to map io_uring: %s\n", strerror(errno));
+        goto error;
+    }
+    if (!uring_provide_buffers(ut)) {
+        mc_logger->log(EXTENSION_LOG_WARNING, NULL,
+                       "Failed to provide io_uring buffers: %s\n", strerror(errno));
+        goto error;
+    }
+    if (!uring_probe_ops(ut) || !uring_probe_recv(ut)) {
+        mc_logger->log(EXTENSION_LOG_WARNING, NULL,
+                       "The kernel does not support multishot recv of io_uring\n");
+        goto error;
+    }
+
+    ut->event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (ut->event_fd < 0 ||
+        sys_uring_register(ut->ring_fd, IORING_REGISTER_EVENTFD, &ut->event_fd, 1) < 0) {
+        mc_logger->log(EXTENSION_LOG_WARNING, NULL,
+                       "Failed to register io_uring eventfd: %s\n", strerror(errno));
+        goto error;
+    }
+    event_set(&ut->event, ut->event_fd, EV_READ | EV_PERSIST, uring_event_handler, ut);
+    event_base_set(base, &ut->event);
+    if (event_add(&ut->event, 0) == -1) {
+        mc_logger->log(EXTENSION_LOG_WARNING, NULL,
+                       "Can't monitor io_uring eventfd\n");
+        goto error;
+    }
+    return ut;
+
+error:
+    uring_unmap(ut);
+    if (ut->event_fd >= 0) close(ut->event_fd);
+    if (ut->ring_fd >= 0) close(ut->ring_fd);
+    free(ut);
+    return NULL;
+}
+
+void uring_thread_final(struct uring_thread *ut)
+{
+    event_del(&ut->event);
+    uring_unmap(ut);
+    close(ut->event_fd);
+    close(ut->ring_fd);
+    free(ut);
+}
+
+void uring_thread_submit(struct uring_thread *ut)
+{
+    int ret;
+
+    while (ut->sq_queued > 0) {
+        __atomic_store_n(ut->sq_tail, ut->sq_local, __ATOMIC_RELEASE);
+        ret = sys_uring_enter(ut->ring_fd, ut->sq_queued, 0, 0);
+        if (ret < 0) {
+            if (errno == EINTR) continue;
+            /* EAGAIN or EBUSY: submit them in the next iteration */
+            if (settings.verbose > 1) {
+                mc_logger->log(EXTENSION_LOG_DEBUG, NULL,
+                               "io_uring submit failed: %s\n", strerror(errno));
+            }
+            break;
+        }
+        ut->sq_queued -= ret;
+        if (ret == 0) break;
+    }
+}
+
+static struct io_uring_sqe *uring_get_sqe(struct uring_thread *ut)
+{
+    struct io_uring_sqe *sqe;
+    unsigned head = __atomic_load_n(ut->sq_head, __ATOMIC_ACQUIRE);
+    unsigned index;
+
+    if (ut->sq_local - head >= ut->sq_entries) {
+        /* the queue is full: submit the queued entries */
+        uring_thread_submit(ut);
+        head = __atomic_load_n(ut->sq_head, __ATOMIC_ACQUIRE);
+        if (ut->sq_local - head >= ut->sq_entries) {
+            return NULL;
+        }
+    }
+    index = ut->sq_local & ut->sq_mask;
+    sqe = &ut->sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    ut->sq_array[index] = index;
+    ut->sq_local++;
+    ut->sq_queued++;
+    return sqe;
+}
+
+static inline uint64_t uring_user_data(conn *c, int req)
+{
+    assert(((uintptr_t)c & URING_REQ_MASK) == 0);
+    return (uint64_t)(uintptr_t)c | (uint64_t)req;
+}
+
+/*
+ * Connection requests
+ */
+static bool uring_conn_arm_recv(conn *c)
+{
+    struct uring_conn *uc = &c->uring;
+    struct io_uring_sqe *sqe = uring_get_sqe(uc->ut);
+
+    if (sqe == NULL) {
+        return false;
+    }
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = c->sfd;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = URING_RECV_BGID;
+    sqe->user_data = uring_user_data(c, URING_REQ_RECV);
+    uc->recv_armed = true;
+    uc->inflight++;
+    return true;
+}
+
+static void uring_conn_cancel_recv(conn *c)
+{
+    struct uring_conn *uc = &c->uring;
+    struct io_uring_sqe *sqe;
+
+    if (!uc->recv_armed || uc->recv_cancel) {
+        return;
+    }
+    sqe = uring_get_sqe(uc->ut);
+    if (sqe == NULL) {
+        return;
+    }
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->fd = -1;
+    sqe->addr = uring_user_data(c, URING_REQ_RECV);
+    sqe->user_data = URING_REQ_CANCEL;
+    uc->recv_cancel = true;
+}
+
+static void uring_conn_wake(conn *c)
+{
+    struct uring_conn *uc = &c->uring;
+    struct io_uring_sqe *sqe;
+
+    if (uc->wake_inflight) {
+        return;
+    }
+    sqe = uring_get_sqe(uc->ut);
+    if (sqe == NULL) {
+        return;
+    }
+    sqe->opcode = IORING_OP_NOP;
+    sqe->user_data = uring_user_data(c, URING_REQ_WAKE);
+    uc->wake_inflight = true;
+    uc->inflight++;
+}
+
+static void uring_conn_resume_recv(conn *c)
+{
+    struct uring_conn *uc = &c->uring;
+
+    if (!uc->recv_armed && !uc->eof && uc->error == 0 &&
+        uc->bytes < URING_RECV_LIMIT / 2 && c->state != conn_closing) {
+        if (!uring_conn_arm_recv(c)) {
+            uc->error = ENOBUFS;
+        }
+    }
+}
+
+bool uring_conn_attach(struct uring_thread *ut, conn *c)
+{
+    struct uring_conn *uc = &c->uring;
+
+    memset(uc, 0, sizeof(*uc));
+    uc->ut = ut;
+    if (!uring_conn_arm_recv(c)) {
+        return false;
+    }
+    /* the connection is driven by the completions from now on */
+    event_del(&c->event);
+    uc->active = true;
+    return true;
+}
+
+void uring_conn_detach(conn *c)
+{
+    struct uring_conn *uc = &c->uring;
+
+    assert(uc->inflight == 0);
+    free(uc->buf);
+    memset(uc, 0, sizeof(*uc));
+}
+
+/* Read the received data like read(2) of a non-blocking socket. */
+ssize_t uring_conn_recv(conn *c, void *buf, size_t len)
+{
+    struct uring_conn *uc = &c->uring;
+
+    if (uc->bytes > 0) {
+        size_t n = (len < uc->bytes) ? len : uc->bytes;
+        memcpy(buf, uc->buf + uc->offset, n);
+        uc->offset += n;
+        uc->bytes -= n;
+        if (uc->bytes == 0) {
+            uc->offset = 0;
+        }
+        uring_conn_resume_recv(c);
+        return (ssize_t)n;
+    }
+    if (uc->eof) {
+        return 0;
+    }
+    if (uc->error != 0) {
+        errno = uc->error;
+        return -1;
+    }
+    uring_conn_resume_recv(c);
+    errno = EAGAIN;
+    return -1;
+}
+
+/* Send the message like sendmsg(2) of a non-blocking socket.
+ * The message is sent by a request, and EAGAIN is returned until the
+ * request is completed. Then, the result of the request is returned.
+ */
+ssize_t uring_conn_sendmsg(conn *c, struct msghdr *m)
+{
+    struct uring_conn *uc = &c->uring;
+    struct io_uring_sqe *sqe;
+
+    if (uc->send_done) {
+        uc->send_done = false;
+        if (uc->send_res < 0) {
+            errno = (int)-uc->send_res;
+            return -1;
+        }
+        return uc->send_res;
+    }
+    if (!uc->send_inflight) {
+        sqe = uring_get_sqe(uc->ut);
+        if (sqe == NULL) {
+            errno = ENOBUFS;
+            return -1;
+        }
+        sqe->opcode = IORING_OP_SENDMSG;
+        sqe->fd = c->sfd;
+        sqe->addr = (uint64_t)(uintptr_t)m;
+        sqe->len = 1;
+        sqe->user_data = uring_user_data(c, URING_REQ_SEND);
+        uc->send_inflight = true;
+        uc->inflight++;
+    }
+    errno = EAGAIN;
+    return -1;
+}
+
+/* The state machine waits for the events of new_flags.
+ * Wake it up by a request if the event has already happened.
+ */
+void uring_conn_update(conn *c, const int new_flags)
+{
+    struct uring_conn *uc = &c->uring;
+
+    c->ev_flags = new_flags;
+    if (new_flags & EV_WRITE) {
+        if (!uc->send_inflight) {
+            uring_conn_wake(c);
+        }
+    } else if (new_flags & EV_READ) {
+        if (uc->bytes > 0 || uc->eof || uc->error != 0) {
+            uring_conn_wake(c);
+        }
+    }
+}
+
+/* Check if the connection can be closed.
+ * The requests in flight refer to the connection, so the connection is
+ * closed after they are completed or canceled.
+ */
+bool uring_conn_release(conn *c)
+{
+    struct uring_conn *uc = &c->uring;
+
+    struct io_uring_sqe *sqe;
+
+    if (uc->inflight == 0) {
+        return true;
+    }
+    /* cancel the recv and the send of the connection */
+    sqe = uring_get_sqe(uc->ut);
+    if (sqe != NULL) {
+        sqe->opcode = IORING_OP_ASYNC_CANCEL;
+        sqe->fd = c->sfd;
+        sqe->cancel_flags = IORING_ASYNC_CANCEL_FD | IORING_ASYNC_CANCEL_ALL;
+        sqe->user_data = URING_REQ_CANCEL;
+    } else {
+        /* No entry is free even after the queued ones are submitted.
+         * Shut the socket down so that the requests in flight complete.
+         */
+        shutdown(c->sfd, SHUT_RDWR);
+    }
+    return false;
+}
+
+/*
+ * Completions
+ */
+static void uring_recv_complete(struct uring_thread *ut, conn *c, int res, unsigned flags)
+{
+    struct uring_conn *uc = &c->uring;
+
+    if (res > 0 && (flags & IORING_CQE_F_BUFFER)) {
+        uint16_t bid = (uint16_t)(flags >> IORING_CQE_BUFFER_SHIFT);
+        if (uc->offset + uc->bytes + res > uc->size) {
+            if (uc->offset > 0) {
+                memmove(uc->buf, uc->buf + uc->offset, uc->bytes);
+                uc->offset = 0;
+            }
+            if (uc->bytes + res > uc->size) {
+                uint32_t size = (uc->size > 0) ? uc->size : URING_RECV_BUFSIZE;
+                while (size < uc->bytes + res) size *= 2;
+                char *buf = realloc(uc->buf, size);
+                if (buf == NULL) {
+                    uc->error = ENOMEM;
+                    res = 0;
+                } else {
+                    uc->buf = buf;
+                    uc->size = size;
+                }
+            }
+        }
+        if (res > 0) {
+            memcpy(uc->buf + uc->offset + uc->bytes,
+                   ut->bufs + (size_t)bid * URING_RECV_BUFSIZE, res);
+            uc->bytes += res;
+        }
+        uring_recycle_buffer(ut, bid);
+        if (uc->bytes >= URING_RECV_LIMIT) {
+            /* the connection does not read: stop receiving */
+            uring_conn_cancel_recv(c);
+        }
+    } else if (res == 0) {
+        uc->eof = true;
+    } else if (res < 0 && res != -ENOBUFS && res != -ECANCELED) {
+        uc->error = -res;
+    }
+
+    if (!(flags & IORING_CQE_F_MORE)) {
+        /* multishot recv is finished */
+        uc->recv_armed = false;
+        uc->recv_cancel = false;
+        uc->inflight--;
+        uring_conn_resume_recv(c);
+    }
+}
+
+static void uring_process(struct uring_thread *ut)
+{
+    unsigned head, tail;
+
+    do {
+        head = *ut->cq_head;
+        tail = __atomic_load_n(ut->cq_tail, __ATOMIC_ACQUIRE);
+        while (head != tail) {
+            struct io_uring_cqe *cqe = &ut->cqes[head & ut->cq_mask];
+            uint64_t user_data = cqe->user_data;
+            int res = cqe->res;
+            unsigned flags = cqe->flags;
+            head++;
+            __atomic_store_n(ut->cq_head, head, __ATOMIC_RELEASE);
+
+            int req = (int)(user_data & URING_REQ_MASK);
+            conn *c = (conn *)(uintptr_t)(user_data & ~(uint64_t)URING_REQ_MASK);
+            short which = EV_READ;
+            if (req == URING_REQ_CANCEL) {
+                continue;
+            }
+            if (req == URING_REQ_RECV) {
+                uring_recv_complete(ut, c, res, flags);
+            } else if (req == URING_REQ_SEND) {
+                c->uring.send_inflight = false;
+                c->uring.send_done = true;
+                c->uring.send_res = res;
+                c->uring.inflight--;
+                which = EV_WRITE;
+            } else { /* URING_REQ_WAKE */
+                c->uring.wake_inflight = false;
+                c->uring.inflight--;
+            }
+
+            if (c->state == conn_closing) {
+                /* close it after all the requests are completed */
+                if (c->uring.inflight == 0) {
+                    event_handler(c->sfd, which, c);
+                }
+            } else if (!c->uring.parked) {
+                if (req != URING_REQ_SEND && c->uring.send_inflight) {
+                    /* the state machine waits for the send completion */
+                    continue;
+                }
+                event_handler(c->sfd, which, c);
+            }
+            tail = __atomic_load_n(ut->cq_tail, __ATOMIC_ACQUIRE);
+        }
+        uring_thread_submit(ut);
+    } while (head != __atomic_load_n(ut->cq_tail, __ATOMIC_ACQUIRE));
+}
+
+static void uring_event_handler(const int fd, const short which, void *arg)
+{
+    struct uring_thread *ut = arg;
+    uint64_t count;
+
+    if (read(fd, &count, sizeof(count)) < 0 && errno != EAGAIN) {
+        if (settings.verbose > 0) {
+            mc_logger->log(EXTENSION_LOG_WARNING, NULL,
+                           "Can't read from io_uring eventfd: %s\n", strerror(errno));
+        }
+    }
+    uring_process(ut);
+}
@@ -0,0 +1,75 @@
+/* -*- Mode: C; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ * arcus-memcached - Arcus memory cache server
+ * Copyright 2010-2014 NAVER Corp.
+ * Copyright 2014-2015 JaM2in Co., Ltd.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef URING_H
+#define URING_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+
+/*
+ * io_uring network backend of worker threads.
+ *
+ * Each worker thread has a ring whose completions wake up its libevent loop
+ * through an eventfd. A TCP connection of the worker receives its data with
+ * a multishot recv into the buffers provided to the ring, and sends each
+ * message with a sendmsg request. The requests queued while the connections
+ * are processed are submitted at once at the end of the loop iteration.
+ *
+ * The connection state machine is not changed. The received data is kept
+ * in the connection until the state machine reads it, and the completions
+ * drive the state machine as the readiness events of libevent do.
+ */
+struct uring_thread;
+
+struct uring_conn {
+    struct uring_thread *ut; /* the ring of the worker thread */
+    bool     active;      /* the connection uses the ring */
+    bool     parked;      /* removed from the event loop (see conn_parse_cmd) */
+    bool     recv_armed;  /* multishot recv is submitted */
+    bool     recv_cancel; /* multishot recv is being canceled */
+    bool     send_inflight;
+    bool     send_done;   /* send_res has the result of the last sendmsg */
+    bool     wake_inflight;
+    bool     eof;         /* the peer has shut down the connection */
+    int      error;       /* errno of the failed recv */
+    int      inflight;    /* number of requests not completed */
+    ssize_t  send_res;
+    char    *buf;         /* received data not read yet */
+    uint32_t size;
+    uint32_t offset;
+    uint32_t bytes;
+};
+
+struct event_base;
+struct conn;
+
+struct uring_thread *uring_thread_init(struct event_base *base);
+void    uring_thread_final(struct uring_thread *ut);
+void    uring_thread_submit(struct uring_thread *ut);
+
+bool    uring_conn_attach(struct uring_thread *ut, struct conn *c);
+void    uring_conn_detach(struct conn *c);
+ssize_t uring_conn_recv(struct conn *c, void *buf, size_t len);
+ssize_t uring_conn_sendmsg(struct conn *c, struct msghdr *m);
+void    uring_conn_update(struct conn *c, const int new_flags);
+bool    uring_conn_release(struct conn *c);
+
+#endif